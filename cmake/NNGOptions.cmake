@@ -58,6 +58,13 @@ if (NNG_ENABLE_SQLITE)
 endif()
 mark_as_advanced(NNG_ENABLE_SQLITE)
 
+# zlib compression of MQTT bridge envelopes.
+option (NNG_ENABLE_ZLIB "Enable zlib compression of MQTT envelopes." OFF)
+if (NNG_ENABLE_ZLIB)
+    set(NNG_SUPP_ZLIB ON)
+endif()
+mark_as_advanced(NNG_ENABLE_ZLIB)
+
 # Protocols.
 option (NNG_PROTO_BUS0 "Enable BUSv0 protocol." ON)
 mark_as_advanced(NNG_PROTO_BUS0)
@@ -147,6 +154,11 @@ mark_as_advanced(NNG_ENABLE_HTTP)
 option (NNG_ENABLE_IPV6 "Enable IPv6." ON)
 mark_as_advanced(NNG_ENABLE_IPV6)
 
+# Completion based I/O for TCP and IPC streams on Linux.  When the
+# kernel cannot give us a ring at run time, epoll is used as before.
+option (NNG_ENABLE_IO_URING "Use io_uring for TCP and IPC streams." OFF)
+mark_as_advanced(NNG_ENABLE_IO_URING)
+
 #
 # Transport Options.
 #
@@ -191,6 +203,14 @@ mark_as_advanced(NNG_TRANSPORT_MQTT_TCP)
 option (NNG_TRANSPORT_MQTT_BROKER_TCP "Enable MQTT BROKER TCP transport." ON)
 mark_as_advanced(NNG_TRANSPORT_MQTT_BROKER_TCP)
 
+#MQTT Broker inproc, shared with embedded MQTT clients
+option (NNG_TRANSPORT_MQTT_BROKER_INPROC "Enable MQTT BROKER inproc transport." ON)
+mark_as_advanced(NNG_TRANSPORT_MQTT_BROKER_INPROC)
+
+#MQTT over shared memory, between processes of the same host
+option (NNG_TRANSPORT_MQTT_SHM "Enable MQTT shared memory transport." ON)
+mark_as_advanced(NNG_TRANSPORT_MQTT_SHM)
+
 #MQTT Broker TLS
 option (NNG_TRANSPORT_MQTT_BROKER_TLS "Enable MQTT BROKER TLS transport." ON)
 mark_as_advanced(NNG_TRANSPORT_MQTT_BROKER_TLS)
@@ -17,6 +17,10 @@ struct exchange_s {
 
 	ringBuffer_t *rbs[RINGBUFFER_MAX];
 	unsigned int rb_count;
+
+	exchange_partition partition;
+	/* Time window of each ring buffer in ms for EX_PARTITION_TIME */
+	uint64_t window;
 };
 
 NNG_DECL int exchange_client_get_msg_by_key(void *arg, uint64_t key, nni_msg **msg);
@@ -31,4 +35,21 @@ NNG_DECL int exchange_release(exchange_t *ex);
 NNG_DECL int exchange_handle_msg(exchange_t *ex, uint64_t key, void *msg, nng_aio *aio);
 NNG_DECL int exchange_get_ringBuffer(exchange_t *ex, char *rbName, ringBuffer_t **rb);
 
+/*
+ * Partitioning spreads msgs over the ring buffers so they are enqueued and
+ * searched under different locks. EX_PARTITION_NONE keeps a full copy in
+ * every ring buffer.
+ */
+NNG_DECL int exchange_set_partition(exchange_t *ex, exchange_partition partition, uint64_t window);
+/* Ring buffer a msg with key is enqueued to, the first one without partitions */
+NNG_DECL ringBuffer_t *exchange_get_ringBuffer_by_key(exchange_t *ex, uint64_t key);
+/* Ring buffers holding distinct msgs, only the first one without partitions */
+NNG_DECL unsigned int exchange_partition_count(exchange_t *ex);
+
+/* Same as ringBuffer_search_msgs_*, results of all partitions in key order */
+NNG_DECL int exchange_search_msgs_by_key(exchange_t *ex, uint64_t key, uint32_t count, nng_msg ***list);
+NNG_DECL int exchange_search_msgs_fuzz(exchange_t *ex, uint64_t start, uint64_t end, uint32_t *count, nng_msg ***list);
+/* Sort msgs from search results by their key */
+NNG_DECL void exchange_sort_msgs(nng_msg **list, uint32_t count);
+
 #endif
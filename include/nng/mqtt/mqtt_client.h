@@ -71,6 +71,44 @@ extern "C" {
 
 #define NNG_OPT_MQTT_SQLITE "mqtt-sqlite-option"
 
+// NNG_OPT_MQTT_INFLIGHT_WINDOW is an int, the most QoS 1/2 messages the
+// client keeps unacknowledged at once.  MQTT v5 further limits it to the
+// Receive Maximum of the server.  Sends beyond it are held until acks arrive,
+// and fail with NNG_EAGAIN once 1024 are held.  Packet ids are given to the
+// messages as they enter the window.
+#define NNG_OPT_MQTT_INFLIGHT_WINDOW "mqtt-inflight-window"
+
+// NNG_OPT_MQTT_INFLIGHT is a read-only int, the number of QoS 1/2 messages
+// currently waiting to be acknowledged.
+#define NNG_OPT_MQTT_INFLIGHT "mqtt-inflight"
+
+// NNG_OPT_MQTT_STRIPES is an int, how many connections to the same server
+// a client socket keeps, at most 16.  Add as many dialers, each with a
+// CONNECT msg of its own client ID.  PUBLISH packets go out on a connection
+// picked by topic hash, so msgs of a topic keep their order; QoS 1/2 msgs
+// of a connection that is down wait for it, and are only resent over it.
+// All other packets use the first connection up.  Received msgs of all
+// connections are merged.  Set it before dialing, it fails with NNG_EBUSY
+// once connected or while QoS 1/2 msgs are in flight.
+#define NNG_OPT_MQTT_STRIPES "mqtt-stripes"
+
+// NNG_OPT_MQTT_SEND_BATCH is an int, the most queued packets a connection
+// hands the transport at once to be written by a single system call.
+// 1 turns batching off.  Only the mqtt-tcp transport batches.
+#define NNG_OPT_MQTT_SEND_BATCH "mqtt-send-batch"
+
+// NNG_OPT_MQTT_SEND_DELAY is an nng_duration, how long a connection that
+// is idle waits before it writes a packet, so that packets sent close
+// together go out in one batch.  0 (default) writes right away.
+#define NNG_OPT_MQTT_SEND_DELAY "mqtt-send-delay"
+
+// NNG_OPT_MQTT_ENVELOPE is a pointer to a conf_bridge_envelope.  While it
+// is enabled, QoS 0 PUBLISH msgs without properties are collected by topic
+// prefix for a window and sent together as one PUBLISH to
+// "$envelope/<prefix>", which the broker unpacks again.  The settings are
+// copied.
+#define NNG_OPT_MQTT_ENVELOPE "mqtt-envelope"
+
 // NNG_OPT_MQTT_QOS is a byte (only lower two bits significant) representing
 // the quality of service.  At this time, only level zero is supported.
 // TODO: level 1 and level 2 QoS
@@ -393,6 +431,7 @@ NNG_DECL int  nng_mqtt_msg_encode(nng_msg *);
 NNG_DECL int  nng_mqtt_msg_decode(nng_msg *);
 NNG_DECL int  nng_mqttv5_msg_encode(nng_msg *);
 NNG_DECL int  nng_mqttv5_msg_decode(nng_msg *);
+NNG_DECL int  nng_mqttv5_msg_decode_full(nng_msg *);
 NNG_DECL int  nng_mqtt_msg_validate(nng_msg *, uint8_t);
 NNG_DECL void nng_mqtt_msg_set_packet_type(nng_msg *, nng_mqtt_packet_type);
 NNG_DECL nng_mqtt_packet_type nng_mqtt_msg_get_packet_type(nng_msg *);
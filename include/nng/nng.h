@@ -862,6 +862,18 @@ NNG_DECL nng_listener nng_pipe_listener(nng_pipe);
 // which makes it more convenient than using the NNG_OPT_LOCADDR option.
 #define NNG_OPT_TCP_BOUND_PORT "tcp-bound-port"
 
+// Reuse port lets several listeners bind the same address and port
+// (SO_REUSEPORT), with the kernel spreading new connections over them.
+// This is a boolean, and must be set before the listener is started.
+#define NNG_OPT_TCP_REUSEPORT "tcp-reuseport"
+
+// Poller pins a listener, and the connections it accepts, to one poller
+// thread, by number modulo NNG_INIT_MAX_POLLER_THREADS.  That thread is
+// started if it does not run yet.  This is an int, -1 (the default) to
+// spread them over the running pollers, and must be set before the
+// listener is started.  Platforms with a single poller ignore it.
+#define NNG_OPT_TCP_POLLER "tcp-poller"
+
 // IPC options.  These will largely vary depending on the platform,
 // as POSIX systems have very different options than Windows.
 
@@ -1525,6 +1537,7 @@ enum {
 
 	// Fix the number of poller threads (used for I/O).  Support varies
 	// by platform (many platforms only support a single poller thread.)
+	// With epoll the default is one; each socket stays on one of them.
 	NNG_INIT_NUM_POLLER_THREADS,
 
 	// Fix the number of threads used for DNS resolution.  At least one
@@ -18,6 +18,22 @@
 
 /* NNG OPTs */
 #define NANO_CONF "nano:conf"
+// NNG_OPT_MQTT_LISTEN_SHARDS is an int, how many sockets a broker TCP
+// listener binds to its port with SO_REUSEPORT, each with its own accept
+// loop on a poller thread of its own.  Poller threads are started for the
+// shards as needed, but no more than NNG_INIT_MAX_POLLER_THREADS of them
+// (8 by default); beyond that shards share them.  It must be set before
+// the listener is started.
+#define NNG_OPT_MQTT_LISTEN_SHARDS "mqtt-listen-shards"
+// Admission control of broker listeners, all ints and 0 for no limit.
+// NNG_OPT_MQTT_CONNECT_RATE is how many connections per second are let
+// through to negotiate, and NNG_OPT_MQTT_CONNECT_BURST how many of them
+// may come at once (the rate, by default).  NNG_OPT_MQTT_CONNECT_PENDING
+// bounds the connections still waiting for their CONNACK.  Connections
+// beyond these are answered with a server busy CONNACK and closed.
+#define NNG_OPT_MQTT_CONNECT_RATE "mqtt-connect-rate"
+#define NNG_OPT_MQTT_CONNECT_BURST "mqtt-connect-burst"
+#define NNG_OPT_MQTT_CONNECT_PENDING "mqtt-connect-pending"
 
 
 /* Length defination */
@@ -32,7 +48,7 @@
 #ifdef NANO_PACKET_SIZE
 #define NNI_NANO_MAX_PACKET_SIZE sizeof(uint8_t) * NANO_PACKET_SIZE
 #else
-#define NNI_NANO_MAX_PACKET_SIZE sizeof(uint8_t) * 16
+#define NNI_NANO_MAX_PACKET_SIZE sizeof(uint8_t) * 32
 #endif
 
 /* Error values */
@@ -93,6 +93,11 @@ NNG_DECL uint32_t fnv1a_hashn(char *str, size_t n);
 NNG_DECL uint8_t  crc_hashn(char *str, size_t n);
 NNG_DECL uint32_t crc32_hashn(char *str, size_t n);
 NNG_DECL uint32_t crc32c_hashn(char *str, size_t n);
+// Fastest hash for the tables of the broker in memory. Values may change
+// across versions, never persist them or send them to peers; the ones above
+// are stable.
+NNG_DECL uint64_t nano_hash64n(const void *buf, size_t n, uint64_t seed);
+NNG_DECL uint32_t nano_hashn(const void *buf, size_t n);
 NNG_DECL uint8_t  verify_connect(conn_param *cparam, conf *conf);
 
 // repack
@@ -141,8 +146,50 @@ NNG_DECL void      property_append(property *prop_list, property *last);
 NNG_DECL int  nmq_subtopic_decode(nng_msg *msg, uint8_t ver, topic_queue **ptq);
 NNG_DECL int  nmq_subinfo_decode(nng_msg *msg, void *l, uint8_t ver);
 NNG_DECL int  nmq_unsubinfo_decode(nng_msg *msg, void *l, uint8_t ver);
+
+struct subinfo;
+NNG_DECL struct subinfo *nmq_subinfo_next(void *l, struct subinfo *info,
+    const char *topic, size_t tlen, bool all);
+
+typedef struct nmq_alias_tbl nmq_alias_tbl;
+NNG_DECL nmq_alias_tbl *nmq_alias_tbl_alloc(uint16_t max);
+NNG_DECL void           nmq_alias_tbl_free(nmq_alias_tbl *tbl);
+NNG_DECL int            nmq_alias_set(
+               nmq_alias_tbl *tbl, uint16_t alias, const char *topic, uint32_t len);
+NNG_DECL const char *nmq_alias_get(
+    nmq_alias_tbl *tbl, uint16_t alias, uint32_t *len);
+NNG_DECL uint16_t nmq_alias_assign(
+    nmq_alias_tbl *tbl, const char *topic, uint32_t len, bool *known);
+NNG_DECL void nmq_alias_forget(nmq_alias_tbl *tbl, uint16_t alias);
+NNG_DECL int  nmq_pub_alias_resolve(nng_msg *msg, nmq_alias_tbl **tblp);
+
+// Admission control of a broker listener: a token bucket of rate
+// CONNECTs per second holding up to burst of them, and a bound on the
+// connections admitted but not yet answered with a CONNACK.  0 turns
+// either limit off.  The caller serializes access.
+typedef struct {
+	uint32_t rate;
+	uint32_t burst;
+	uint32_t max_pending;
+	uint32_t pending;
+	uint64_t tokens; // thousandths of a token
+	uint64_t last;   // msec of the last refill
+} nmq_admission;
+
+NNG_DECL bool nmq_admission_take(nmq_admission *adm, uint64_t now);
+NNG_DECL void nmq_admission_done(nmq_admission *adm);
+NNG_DECL int  nmq_connack_busy(
+     const uint8_t *connect, size_t len, uint8_t *buf);
+
+// Every subscription in subinfol l matching topic, or all of them.
+#define NMQ_SUBINFO_FOREACH(l, info, topic, tlen, all)                 \
+	for (info = nmq_subinfo_next(l, NULL, topic, tlen, all);        \
+	     info != NULL; info = nmq_subinfo_next(l, info, topic, tlen, all))
+NNG_DECL bool topic_name_valid(const char *topic, size_t len);
 NNG_DECL bool topic_filter(const char *origin, const char *input);
 NNG_DECL bool topic_filtern(const char *origin, const char *input, size_t n);
+NNG_DECL bool topic_match(
+    const char *filter, size_t flen, const char *topic, size_t tlen);
 
 NNG_DECL int nmq_auth_http_connect(conn_param *cparam, conf_auth_http *conf);
 
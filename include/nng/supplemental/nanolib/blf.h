@@ -33,6 +33,26 @@ typedef struct {
 	uint32_t size;
 } blf_data_packet;
 
+// Binary CAN frame payload, written to BLF without any JSON parsing.
+// A payload starting with a blf_can_frames_hdr carrying this magic is
+// followed by hdr.count packed blf_can_frame records (little endian).
+// Any other payload is parsed as JSON: {"frames":[{"id":..,"data":".."}]}
+#define BLF_CAN_FRAMES_MAGIC 0x46424e43 // "CNBF"
+
+typedef struct {
+	uint32_t magic;
+	uint32_t count;
+} blf_can_frames_hdr;
+
+typedef struct {
+	uint64_t timestamp;
+	uint32_t id;
+	uint16_t channel;
+	uint8_t  flags;
+	uint8_t  dlc;
+	uint8_t  data[8];
+} blf_can_frame;
+
 struct blf_object {
 	uint64_t        *keys;
 	uint8_t        **darray;
@@ -94,6 +94,10 @@ struct conf_sqlite {
 	    flush_mem_threshold; // flush to sqlite table when count of message
 	                         // is equal or greater than this value
 	uint64_t resend_interval; // resend caching message interval (ms)
+	size_t   replay_window;   // cached messages read ahead when resending
+	size_t   replay_batch;    // resent messages deleted in one transaction
+	size_t   replay_live_share; // percent of sends kept for live messages
+	                            // while resending
 };
 
 typedef struct conf_sqlite conf_sqlite;
@@ -238,6 +242,21 @@ typedef struct {
 	conf_user_property **user_property;
 } conf_bridge_sub_properties;
 
+/* How the msgs of an envelope are compressed */
+typedef enum {
+	ENVELOPE_CODEC_NONE,
+	ENVELOPE_CODEC_ZLIB, // needs NNG_ENABLE_ZLIB, else sent as none
+} envelope_codec;
+
+/* QoS 0 msgs forwarded in one PUBLISH per topic prefix */
+typedef struct {
+	bool           enable;
+	uint8_t        prefix_levels; // topic levels msgs are grouped by
+	uint32_t       window;        // ms a group collects msgs
+	uint32_t       max_size;      // bytes of msgs that send a group early
+	envelope_codec codec;
+} conf_bridge_envelope;
+
 struct conf_bridge_node {
 	bool         enable;
 	bool         dynamic;
@@ -263,6 +282,7 @@ struct conf_bridge_node {
 	conf_tls     tls;
 	conf_tcp     tcp;
 	conf_sqlite *sqlite;
+	conf_bridge_envelope envelope;
 	nng_aio    **bridge_aio;
 	void        *bridge_arg;	// for reloading bridge case
 
@@ -306,12 +326,21 @@ struct ringBuffer_node {
 	uint64_t cap;
 };
 
+/* How msgs of an exchange are spread over its ring buffers */
+typedef enum {
+	EX_PARTITION_NONE, // every ring buffer gets every msg
+	EX_PARTITION_KEY,  // one ring buffer by hash of the key
+	EX_PARTITION_TIME, // one ring buffer per time window of the key
+} exchange_partition;
+
 typedef struct conf_exchange_node conf_exchange_node;
 struct conf_exchange_node {
 	char             *name;
 	char             *topic;
 	ringBuffer_node **rbufs;
 	size_t            rbufs_sz;
+	uint32_t          partition;
+	uint64_t          partition_window; // seconds, for EX_PARTITION_TIME
 
 	nng_socket       *sock;
 	nng_mtx          *mtx;
@@ -564,6 +593,8 @@ struct conf {
 	bool       daemon;
 	bool       ipc_internal;
 	bool       bridge_mode;
+	bool       envelope_unpack;      // PUBLISH to $envelope/ of bridges
+	uint32_t   envelope_max_records; // per envelope
 
 	conf_sqlite          sqlite;
 	conf_tls             tls;
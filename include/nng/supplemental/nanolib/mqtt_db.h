@@ -15,6 +15,14 @@ typedef enum {
 
 typedef struct dbtree            dbtree;
 
+// How one member of a shared subscription group is picked for a publish
+typedef enum {
+	DBTREE_SHARED_ROUND_ROBIN,
+	DBTREE_SHARED_RANDOM,
+	DBTREE_SHARED_STICKY,         // same publisher key, same member
+	DBTREE_SHARED_LEAST_INFLIGHT, // member with the shortest queue
+} dbtree_shared_strategy;
+
 typedef struct {
 	char * topic;
 	char **clients;
@@ -117,6 +125,39 @@ NNG_DECL nng_msg *dbtree_delete_retain(dbtree *db, char *topic);
  */
 NNG_DECL nng_msg **dbtree_find_retain(dbtree *db, char *topic);
 
+/**
+ * @brief dbtree_find_retain_chunked - Get the retain messages
+ * matching topic, handed to cb at most chunk at a time. cb owns
+ * the messages and runs under the read lock of db, so it must not
+ * insert into or delete from db.
+ * @param db - dbtree
+ * @param topic - topic filter
+ * @param chunk - largest number of messages per call of cb
+ * @param cb - callback
+ * @param arg - passed to cb
+ * @return void
+ */
+NNG_DECL void dbtree_find_retain_chunked(dbtree *db, char *topic,
+    size_t chunk, void (*cb)(nng_msg **msgs, size_t n, void *arg),
+    void *arg);
+
+/**
+ * @brief dbtree_set_retain_limit - Set the budget of the retain
+ * messages in bytes, the least recently used ones are freed once
+ * it is exceeded. 0 means no limit, the default.
+ * @param db - dbtree
+ * @param bytes - budget
+ * @return void
+ */
+NNG_DECL void dbtree_set_retain_limit(dbtree *db, size_t bytes);
+
+/**
+ * @brief dbtree_retain_bytes - Bytes of the retain messages held.
+ * @param db - dbtree
+ * @return size in bytes
+ */
+NNG_DECL size_t dbtree_retain_bytes(dbtree *db);
+
 /**
  * @brief dbtree_find_shared_clients - This function
  * will Find shared subscribe client.
@@ -126,6 +167,32 @@ NNG_DECL nng_msg **dbtree_find_retain(dbtree *db, char *topic);
  */
 NNG_DECL uint32_t *dbtree_find_shared_clients(dbtree *db, char *topic);
 
+/**
+ * @brief dbtree_find_shared_clients_by - Same as
+ * dbtree_find_shared_clients, with the key of the publisher
+ * which the sticky strategy dispatches by.
+ * @param dbtree - dbtree
+ * @param topic - topic
+ * @param key - hash of the publishing client
+ * @return pipe id array
+ */
+NNG_DECL uint32_t *dbtree_find_shared_clients_by(
+    dbtree *db, char *topic, uint32_t key);
+
+/**
+ * @brief dbtree_set_shared_strategy - Select how shared
+ * subscription groups dispatch, round robin by default.
+ * Every group keeps a cursor of its own.
+ * @param dbtree - dbtree
+ * @param strategy - dbtree_shared_strategy
+ * @param depth - queue depth of a pipe, for least in-flight
+ * @param arg - passed to depth
+ * @return void
+ */
+NNG_DECL void dbtree_set_shared_strategy(dbtree *db,
+    dbtree_shared_strategy strategy,
+    uint32_t (*depth)(uint32_t pipe_id, void *arg), void *arg);
+
 /**
  * @brief dbtree_get_tree - This function will
  * get all info about this tree.
@@ -64,8 +64,27 @@ const char **parquet_find_span(
 
 parquet_data_packet *parquet_find_data_packet(conf_parquet *conf, char *filename, uint64_t key);
 
+// Results are returned in the order of keys, NULL for keys not found.
 parquet_data_packet **parquet_find_data_packets(conf_parquet *conf, char **filenames, uint64_t *keys, uint32_t len);
 
+// Same lookup, run on the parquet reader pool with one file per reader.
+// Filenames and keys are copied, callers may free them once this returns.
+// On completion output 0 of the aio holds the packets (in key order) and
+// output 1 their count. Release them with parquet_data_packets_free.
+int parquet_find_data_packets_async(conf_parquet *conf, char **filenames,
+    uint64_t *keys, uint32_t len, nng_aio *aio);
+void parquet_data_packets_free(parquet_data_packet **packets, uint32_t len);
+
+// Read every message with a key in [start_key, end_key] from the files
+// covering that span. Row groups and pages outside of it are skipped.
+parquet_data_packet **parquet_find_data_span_packets(conf_parquet *conf,
+    uint64_t start_key, uint64_t end_key, uint32_t *size);
+
+// Same span read, run on the parquet reader pool with one file per reader.
+// Output 0 and 1 of the aio are set as for parquet_find_data_packets_async.
+int parquet_find_data_span_packets_async(conf_parquet *conf,
+    uint64_t start_key, uint64_t end_key, nng_aio *aio);
+
 #ifdef __cplusplus
 }
 #endif
@@ -33,6 +33,13 @@ typedef struct ringBufferRule_s ringBufferRule_t;
 typedef struct ringBufferFile_s ringBufferFile_t;
 typedef struct ringBufferFileRange_s ringBufferFileRange_t;
 
+/* For RB_FULL_MMAP */
+typedef struct ringBufferMmap_s ringBufferMmap_t;
+
+#define RB_MMAP_DEFAULT_DIR      "/tmp"
+#define RB_MMAP_DEFAULT_SEG_SIZE (64 * 1024 * 1024)
+#define RB_MMAP_DEFAULT_MAX_SEGS 16
+
 struct ringBufferMsg_s {
 	uint64_t  key;
 	void *data;
@@ -45,6 +52,8 @@ enum fullOption {
 	RB_FULL_DROP,
 	RB_FULL_RETURN,
 	RB_FULL_FILE,
+	/* Spill the oldest msgs to memory-mapped segments */
+	RB_FULL_MMAP,
 
 	RB_FULL_MAX
 };
@@ -57,6 +66,7 @@ struct ringBufferFileRange_s {
 
 struct ringBufferFile_s {
 	uint64_t *keys;
+	unsigned int keysLen;
 	nng_aio *aio;
 	ringBufferFileRange_t **ranges;
 };
@@ -83,6 +93,11 @@ struct ringBuffer_s {
 	/* FOR RB_FULL_FILE */
 	ringBufferFile_t        **files;
 
+	/* FOR RB_FULL_MMAP, created on first spill if not set */
+	ringBufferMmap_t        *mmap;
+	/* Drop the oldest segment beyond maxSegs instead of refusing */
+	bool                    mmapDrop;
+
 	nng_mtx                 *ring_lock;
 
 	ringBufferMsg_t *msgs;
@@ -125,14 +140,42 @@ int ringBuffer_search_msgs_fuzz(ringBuffer_t *rb,
 								uint64_t end,
 								uint32_t *count,
 								nng_msg ***list);
+/* Like the fuzz search from start on, but only the first limit msgs */
+int ringBuffer_search_msgs_from(ringBuffer_t *rb,
+								uint64_t start,
+								uint32_t limit,
+								uint32_t *count,
+								nng_msg ***list);
 int ringBuffer_get_and_clean_msgs(ringBuffer_t *rb,
 								  unsigned int *count, nng_msg ***list);
 
 int ringBuffer_set_fullOp(ringBuffer_t *rb, enum fullOption fullOp);
+/*
+ * Segments of RB_FULL_MMAP are created in dir with segSize bytes each.
+ * Dequeue drains them before RAM and searches by key cover them as well.
+ * Beyond maxSegs enqueue fails, see ringBuffer_set_mmap_drop. Must be
+ * called before the first spill.
+ */
+int ringBuffer_set_mmap(ringBuffer_t *rb, const char *dir,
+						size_t segSize, unsigned int maxSegs);
+/* Beyond maxSegs drop the oldest sealed segment rather than fail enqueue */
+int ringBuffer_set_mmap_drop(ringBuffer_t *rb, bool drop);
 #ifdef SUPP_PARQUET
 int ringBuffer_get_msgs_from_file(ringBuffer_t *rb, void ***msgs, int **msgLen);
 int ringBuffer_get_msgs_from_file_by_keys(ringBuffer_t *rb, uint64_t *keys, uint32_t count,
 										  void ***msgs, int **msgLen);
+/*
+ * Async variants, the files are read on the parquet reader pool and the
+ * ring buffer locks are only held while collecting the filenames. Files of
+ * all given ring buffers are searched at once, e.g. all partitions of an
+ * exchange. On completion aio output 0 is a parquet_data_packet ** (NULL
+ * slots for keys not found) and output 1 its length.
+ */
+int ringBuffer_get_msgs_from_file_async(ringBuffer_t **rbs, unsigned int rbsCount,
+										nng_aio *aio);
+int ringBuffer_get_msgs_from_file_by_keys_async(ringBuffer_t **rbs, unsigned int rbsCount,
+												uint64_t *keys, uint32_t count,
+												nng_aio *aio);
 #endif
 
 #endif
@@ -96,8 +96,8 @@ test_init_too_many_expire_threads(void)
 	nng_fini();
 }
 
-// poller tuning only supported on Windows right now
-#ifdef NNG_PLATFORM_WINDOWS
+// poller tuning only supported on Windows and with epoll right now
+#if defined(NNG_PLATFORM_WINDOWS) || defined(NNG_HAVE_EPOLL)
 void
 test_init_poller_no_threads(void)
 {
@@ -131,7 +131,7 @@ NUTS_TESTS = {
 	{ "init too many task threads", test_init_too_many_task_threads },
 	{ "init no expire thread", test_init_no_expire_thread },
 	{ "init too many expire threads", test_init_too_many_expire_threads },
-#ifdef NNG_PLATFORM_WINDOWS
+#if defined(NNG_PLATFORM_WINDOWS) || defined(NNG_HAVE_EPOLL)
 	{ "init no poller thread", test_init_poller_no_threads },
 	{ "init too many poller threads", test_init_too_many_poller_threads },
 #endif
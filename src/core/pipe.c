@@ -71,7 +71,12 @@ pipe_destroy(void *arg)
 				nng_free(s, sizeof(*s));
 			}
 		}
-		nni_free(p->subinfol, sizeof(nni_list));
+		struct subinfo_tbl *tbl = (struct subinfo_tbl *) p->subinfol;
+		if (tbl->exact != NULL) {
+			nni_free(tbl->exact,
+			    tbl->nbuckets * sizeof(struct subinfo *));
+		}
+		nni_free(tbl, sizeof(*tbl));
 	}
 
 
@@ -276,8 +281,10 @@ pipe_create(nni_pipe **pp, nni_sock *sock, nni_sp_tran *tran, void *tran_data)
 	// NanoMQ
 	p->packet_id = 0;
 	p->cache     = false;
-	p->subinfol = nni_zalloc(sizeof(nni_list));
-	NNI_LIST_INIT(p->subinfol, struct subinfo, node);
+	struct subinfo_tbl *tbl = nni_zalloc(sizeof(*tbl));
+	NNI_LIST_INIT(&tbl->list, struct subinfo, node);
+	NNI_LIST_INIT(&tbl->wild, struct subinfo, wnode);
+	p->subinfol = &tbl->list;
 
 	nni_atomic_init_bool(&p->p_closed);
 	nni_atomic_flag_reset(&p->p_stop);
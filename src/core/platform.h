@@ -380,6 +380,12 @@ typedef struct nni_ipc_listener nni_ipc_listener;
 extern int nni_ipc_dialer_alloc(nng_stream_dialer **, const nng_url *);
 extern int nni_ipc_listener_alloc(nng_stream_listener **, const nng_url *);
 
+// Shared memory streams between processes of the same host, set up over a
+// UNIX domain socket at the path of the URL.  Only some POSIX platforms
+// implement these, as NNG_TRANSPORT_MQTT_SHM tells.
+extern int nni_shm_dialer_alloc(nng_stream_dialer **, const nng_url *);
+extern int nni_shm_listener_alloc(nng_stream_listener **, const nng_url *);
+
 //
 // UDP support. UDP is not connection oriented, and only has the notion
 // of being bound, sendto, and recvfrom.  (It is possible to set up a
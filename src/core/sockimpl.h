@@ -102,6 +102,25 @@ struct subinfo {
 	char *        topic;
 	int           subid;
 	nni_list_node node;
+
+	// Compiled at SUBSCRIBE time, see struct subinfo_tbl
+	char *          filter; // topic without $share/<group>/, or NULL
+	uint32_t        flen;
+	uint32_t        hash; // of filter, for exact filters
+	bool            wildcard;
+	struct subinfo *hnext;
+	nni_list_node   wnode;
+};
+
+// Subscriptions of a pipe. Filters without wildcards are kept in a hash
+// set keyed by the filter, the others on a list of their own, so that a
+// publish only tries the filters which may match it.
+struct subinfo_tbl {
+	nni_list         list; // every subinfo, keep it first
+	nni_list         wild;
+	struct subinfo **exact;
+	uint32_t         nbuckets;
+	uint32_t         nexact;
 };
 
 struct nni_pipe {
@@ -138,7 +157,7 @@ struct nni_pipe {
 	void    *conn_param;
 	bool     cache;
 	uint16_t packet_id;
-	nni_list *subinfol;    // additional info for sub
+	nni_list *subinfol;    // additional info for sub, a subinfo_tbl
 	void    *nano_qos_db; // qos msgs, 'sqlite' or 'nni_id_hash_map'
 };
 
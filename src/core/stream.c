@@ -181,6 +181,18 @@ static struct {
 	    .dialer_alloc   = nni_ws_dialer_alloc,
 	    .listener_alloc = nni_ws_listener_alloc,
 	},
+#ifdef NNG_TRANSPORT_MQTT_SHM
+	{
+	    .scheme         = "nmq-shm",
+	    .dialer_alloc   = nni_shm_dialer_alloc,
+	    .listener_alloc = nni_shm_listener_alloc,
+	},
+	{
+	    .scheme         = "mqtt-shm",
+	    .dialer_alloc   = nni_shm_dialer_alloc,
+	    .listener_alloc = nni_shm_listener_alloc,
+	},
+#endif
 #ifdef NNG_TRANSPORT_FDC
 	{
 	    .scheme         = "socket",
@@ -344,7 +344,9 @@ nni_url_parse(nni_url **urlp, const char *raw)
 	if ((strcmp(url->u_scheme, "ipc") == 0) ||
 	    (strcmp(url->u_scheme, "unix") == 0) ||
 	    (strcmp(url->u_scheme, "abstract") == 0) ||
-	    (strcmp(url->u_scheme, "inproc") == 0)) {
+	    (strcmp(url->u_scheme, "inproc") == 0) ||
+	    (strcmp(url->u_scheme, "nmq-shm") == 0) ||
+	    (strcmp(url->u_scheme, "mqtt-shm") == 0)) {
 		if ((url->u_path = nni_strdup(s)) == NULL) {
 			rv = NNG_ENOMEM;
 			goto error;
@@ -532,7 +534,9 @@ nni_url_asprintf(char **str, const nni_url *url)
 	if ((strcmp(scheme, "ipc") == 0) || (strcmp(scheme, "inproc") == 0) ||
             (strcmp(scheme, "unix") == 0) ||
             (strcmp(scheme, "ipc+abstract") == 0) ||
-	    (strcmp(scheme, "unix+abstract") == 0)) {
+	    (strcmp(scheme, "unix+abstract") == 0) ||
+	    (strcmp(scheme, "nmq-shm") == 0) ||
+	    (strcmp(scheme, "mqtt-shm") == 0)) {
 		return (nni_asprintf(str, "%s://%s", scheme, url->u_path));
 	}
 
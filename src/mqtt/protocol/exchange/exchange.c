@@ -55,6 +55,8 @@ exchange_init(exchange_t **ex, char *name, char *topic,
 	}
 
 	newEx->rb_count = 0;
+	newEx->partition = EX_PARTITION_NONE;
+	newEx->window = 1000;
 
 	for (unsigned int i = 0; i < rbsCount; i++) {
 		ringBuffer_t *rb = NULL;
@@ -111,6 +113,62 @@ exchange_release(exchange_t *ex)
 	return 0;
 }
 
+int
+exchange_set_partition(exchange_t *ex, exchange_partition partition, uint64_t window)
+{
+	if (ex == NULL || partition > EX_PARTITION_TIME) {
+		return -1;
+	}
+	if (partition == EX_PARTITION_TIME && window == 0) {
+		log_error("Exchange time partition needs a window!\n");
+		return -1;
+	}
+
+	ex->partition = partition;
+	ex->window = window;
+
+	return 0;
+}
+
+/* splitmix64 finalizer, sequential keys spread evenly over partitions */
+static inline uint64_t
+exchange_key_hash(uint64_t key)
+{
+	key ^= key >> 30;
+	key *= 0xbf58476d1ce4e5b9ULL;
+	key ^= key >> 27;
+	key *= 0x94d049bb133111ebULL;
+	key ^= key >> 31;
+	return key;
+}
+
+ringBuffer_t *
+exchange_get_ringBuffer_by_key(exchange_t *ex, uint64_t key)
+{
+	if (ex == NULL || ex->rb_count == 0) {
+		return NULL;
+	}
+
+	switch (ex->partition) {
+	case EX_PARTITION_KEY:
+		return ex->rbs[exchange_key_hash(key) % ex->rb_count];
+	case EX_PARTITION_TIME:
+		return ex->rbs[(key / ex->window) % ex->rb_count];
+	default:
+		return ex->rbs[0];
+	}
+}
+
+unsigned int
+exchange_partition_count(exchange_t *ex)
+{
+	if (ex == NULL || ex->rb_count == 0) {
+		return 0;
+	}
+
+	return ex->partition == EX_PARTITION_NONE ? 1 : ex->rb_count;
+}
+
 int
 exchange_handle_msg(exchange_t *ex, uint64_t key, void *msg, nng_aio *aio)
 {
@@ -121,6 +179,20 @@ exchange_handle_msg(exchange_t *ex, uint64_t key, void *msg, nng_aio *aio)
 		return -1;
 	}
 
+	if (ex->partition != EX_PARTITION_NONE) {
+		ringBuffer_t *rb = exchange_get_ringBuffer_by_key(ex, key);
+		if (rb == NULL) {
+			return -1;
+		}
+		ret = ringBuffer_enqueue(rb, key, msg, -1, aio);
+		if (ret != 0) {
+			log_error("Ring Buffer enqueue failed\n");
+			return -1;
+		}
+		log_debug("msg enqueued to %s! msg %p key: %ld", rb->name, msg, key);
+		return 0;
+	}
+
 	for (i = 0; i < ex->rb_count; i++) {
 		log_debug("handling msg key %ld", key);
 		ret = ringBuffer_enqueue(ex->rbs[i], key, msg, -1, aio);
@@ -135,6 +207,163 @@ exchange_handle_msg(exchange_t *ex, uint64_t key, void *msg, nng_aio *aio)
 	return 0;
 }
 
+static int
+exchange_msg_key_cmp(const void *a, const void *b)
+{
+	uint64_t ka = (uintptr_t)nng_msg_get_proto_data(*(nng_msg **)a);
+	uint64_t kb = (uintptr_t)nng_msg_get_proto_data(*(nng_msg **)b);
+
+	return ka < kb ? -1 : (ka > kb ? 1 : 0);
+}
+
+void
+exchange_sort_msgs(nng_msg **list, uint32_t count)
+{
+	if (list != NULL && count > 1) {
+		qsort(list, count, sizeof(nng_msg *), exchange_msg_key_cmp);
+	}
+}
+
+/* Only the partitions a time window in [start, end] maps to hold its msgs */
+static inline bool
+exchange_partition_in_span(exchange_t *ex, unsigned int i, uint64_t start, uint64_t end)
+{
+	if (ex->partition != EX_PARTITION_TIME) {
+		return true;
+	}
+
+	uint64_t first = start / ex->window;
+	uint64_t last = end / ex->window;
+	if (last - first + 1 >= ex->rb_count) {
+		return true;
+	}
+
+	return (i + ex->rb_count - first % ex->rb_count) % ex->rb_count <= last - first;
+}
+
+int
+exchange_search_msgs_fuzz(exchange_t *ex, uint64_t start, uint64_t end, uint32_t *count, nng_msg ***list)
+{
+	unsigned int parts = exchange_partition_count(ex);
+	nng_msg **msgs = NULL;
+
+	if (parts == 0 || count == NULL || list == NULL || start > end) {
+		return -1;
+	}
+	if (parts == 1) {
+		return ringBuffer_search_msgs_fuzz(ex->rbs[0], start, end, count, list);
+	}
+
+	for (unsigned int i = 0; i < parts; i++) {
+		uint32_t partCount = 0;
+		nng_msg **partList = NULL;
+
+		if (!exchange_partition_in_span(ex, i, start, end)) {
+			continue;
+		}
+		if (ringBuffer_search_msgs_fuzz(ex->rbs[i], start, end, &partCount, &partList) != 0) {
+			continue;
+		}
+		for (uint32_t j = 0; j < partCount; j++) {
+			cvector_push_back(msgs, partList[j]);
+		}
+		nng_free(partList, sizeof(nng_msg *) * partCount);
+	}
+
+	if (cvector_size(msgs) == 0) {
+		return -1;
+	}
+
+	*count = cvector_size(msgs);
+	nng_msg **newList = nng_alloc(sizeof(nng_msg *) * (*count));
+	if (newList == NULL) {
+		cvector_free(msgs);
+		return -1;
+	}
+	memcpy(newList, msgs, sizeof(nng_msg *) * (*count));
+	cvector_free(msgs);
+
+	exchange_sort_msgs(newList, *count);
+	*list = newList;
+
+	return 0;
+}
+
+int
+exchange_search_msgs_by_key(exchange_t *ex, uint64_t key, uint32_t count, nng_msg ***list)
+{
+	unsigned int parts = exchange_partition_count(ex);
+	nng_msg **partLists[RINGBUFFER_MAX] = { NULL };
+	uint32_t partCounts[RINGBUFFER_MAX] = { 0 };
+	uint32_t pos[RINGBUFFER_MAX] = { 0 };
+	nng_msg **msgs = NULL;
+	uint32_t found = 0;
+	int ret = -1;
+
+	if (parts <= 1) {
+		if (ex == NULL || ex->rb_count == 0) {
+			return -1;
+		}
+		return ringBuffer_search_msgs_by_key(ex->rbs[0], key, count, list);
+	}
+	if (count == 0 || list == NULL) {
+		return -1;
+	}
+
+	/*
+	 * The count msgs from key on are spread over the partitions, no more
+	 * than count of each can be among them. Merge the sorted heads and
+	 * stop once count are taken.
+	 */
+	for (unsigned int i = 0; i < parts; i++) {
+		if (ringBuffer_search_msgs_from(ex->rbs[i], key, count,
+				&partCounts[i], &partLists[i]) != 0) {
+			partCounts[i] = 0;
+			partLists[i] = NULL;
+		}
+	}
+
+	msgs = nng_alloc(sizeof(nng_msg *) * count);
+	if (msgs == NULL) {
+		goto out;
+	}
+	while (found < count) {
+		unsigned int min = parts;
+		uint64_t minKey = 0;
+		for (unsigned int i = 0; i < parts; i++) {
+			if (pos[i] == partCounts[i]) {
+				continue;
+			}
+			uint64_t k = (uintptr_t)nng_msg_get_proto_data(partLists[i][pos[i]]);
+			if (min == parts || k < minKey) {
+				min = i;
+				minKey = k;
+			}
+		}
+		if (min == parts) {
+			break;
+		}
+		msgs[found++] = partLists[min][pos[min]++];
+	}
+
+	if (found == count && (uintptr_t)nng_msg_get_proto_data(msgs[0]) == key) {
+		*list = msgs;
+		msgs = NULL;
+		ret = 0;
+	}
+
+out:
+	if (msgs != NULL) {
+		nng_free(msgs, sizeof(nng_msg *) * count);
+	}
+	for (unsigned int i = 0; i < parts; i++) {
+		if (partLists[i] != NULL) {
+			nng_free(partLists[i], sizeof(nng_msg *) * partCounts[i]);
+		}
+	}
+	return ret;
+}
+
 int
 exchange_get_ringBuffer(exchange_t *ex, char *rbName, ringBuffer_t **rb)
 {
@@ -36,6 +36,9 @@ struct exchange_pipe_s {
 	uint32_t         id;
 	nni_aio          ex_aio;	// recv cmd from Consumer
 	nni_aio          rp_aio;	// send msg to consumer
+	nni_aio          qr_aio;	// file query running on the reader pool
+	nni_msg         *qr_msg;	// request waiting for the file query
+	cJSON           *qr_obj;	// reply built so far, or NULL
 	nni_lmq          lmq;
 };
 
@@ -60,7 +63,7 @@ struct exchange_sock_s {
 	nni_atomic_bool closed;
 	nni_id_map      rbmsgmap;
 	nni_id_map      pipes;		//pipe = consumer client
-	exchange_node_t *ex_node;
+	exchange_node_t **ex_nodes;	// one per exchange, selected by topic
 	nni_pollable    readable;
 	nni_pollable    writable;
 };
@@ -77,10 +80,12 @@ exchange_add_ex(exchange_sock_t *s, exchange_t *ex)
 {
 	nni_mtx_lock(&s->mtx);
 
-	if (s->ex_node != NULL) {
-		log_error("exchange client add exchange failed! ex_node is not NULL!\n");
-		nni_mtx_unlock(&s->mtx);
-		return -1;
+	for (size_t i = 0; i < cvector_size(s->ex_nodes); i++) {
+		if (strcmp(s->ex_nodes[i]->ex->name, ex->name) == 0) {
+			log_error("exchange client add exchange failed! %s exists!\n", ex->name);
+			nni_mtx_unlock(&s->mtx);
+			return -1;
+		}
 	}
 
 	exchange_node_t *node;
@@ -95,7 +100,7 @@ exchange_add_ex(exchange_sock_t *s, exchange_t *ex)
 	node->ex = ex;
 	node->sock = s;
 
-	s->ex_node = node;
+	cvector_push_back(s->ex_nodes, node);
 	nni_mtx_unlock(&s->mtx);
 	return 0;
 }
@@ -111,6 +116,7 @@ exchange_sock_init(void *arg, nni_sock *sock)
 	nni_mtx_init(&s->mtx);
 	nni_id_map_init(&s->rbmsgmap, 0, 0, true);
 	nni_id_map_init(&s->pipes, 0, 0, false);
+	s->ex_nodes = NULL;
 
 	nni_pollable_init(&s->writable);
 	nni_pollable_init(&s->readable);
@@ -121,16 +127,15 @@ static void
 exchange_sock_fini(void *arg)
 {
 	exchange_sock_t *s = arg;
-	exchange_node_t *ex_node;
-
-	ex_node = s->ex_node;
 
 	nni_pollable_fini(&s->writable);
 	nni_pollable_fini(&s->readable);
-	exchange_release(ex_node->ex);
-
-	nni_free(ex_node, sizeof(*ex_node));
-	ex_node = NULL;
+	for (size_t i = 0; i < cvector_size(s->ex_nodes); i++) {
+		exchange_release(s->ex_nodes[i]->ex);
+		nni_free(s->ex_nodes[i], sizeof(exchange_node_t));
+	}
+	cvector_free(s->ex_nodes);
+	s->ex_nodes = NULL;
 
 	nni_id_map_fini(&s->pipes);
 	nni_id_map_fini(&s->rbmsgmap);
@@ -156,26 +161,34 @@ exchange_sock_close(void *arg)
 	return;
 }
 
-/* Check if the msg is already in rbmsgmap, if not, add it to rbmsgmap */
+/*
+ * Check if the msg is already in rbmsgmap, if not, add it to rbmsgmap.
+ * Only rbmsgmap needs the sock lock, the msg is enqueued under the lock of
+ * its ring buffer so exchanges and partitions are filled in parallel.
+ */
 static inline int
 exchange_client_handle_msg(exchange_node_t *ex_node, nni_msg *msg, nni_aio *aio)
 {
 	int ret = 0;
 	uint64_t key;
 	nni_msg *tmsg = NULL;
+	exchange_sock_t *s = ex_node->sock;
 
 	key  = nni_msg_get_timestamp(msg);
 	nni_aio_set_prov_data(aio, NULL);
 
-	tmsg = nni_id_get(&ex_node->sock->rbmsgmap, key);
+	nni_mtx_lock(&s->mtx);
+	tmsg = nni_id_get(&s->rbmsgmap, key);
 	if (tmsg != NULL) {
+		nni_mtx_unlock(&s->mtx);
 		log_error("msg already in rbmsgmap, overwirte is not allowed");
 		/* free msg here! */
 		nni_msg_free(msg);
 		return -1;
 	}
 
-	ret = nni_id_set(&ex_node->sock->rbmsgmap, key, msg);
+	ret = nni_id_set(&s->rbmsgmap, key, msg);
+	nni_mtx_unlock(&s->mtx);
 	if (ret != 0) {
 		log_error("rbmsgmap set failed");
 		/* free msg here! */
@@ -186,6 +199,9 @@ exchange_client_handle_msg(exchange_node_t *ex_node, nni_msg *msg, nni_aio *aio)
 	ret = exchange_handle_msg(ex_node->ex, key, msg, aio);
 	if (ret != 0) {
 		log_error("exchange_handle_msg failed!\n");
+		nni_mtx_lock(&s->mtx);
+		nni_id_remove(&s->rbmsgmap, key);
+		nni_mtx_unlock(&s->mtx);
 		/* free msg here! */
 		nni_msg_free(msg);
 		return -1;
@@ -196,18 +212,44 @@ exchange_client_handle_msg(exchange_node_t *ex_node, nni_msg *msg, nni_aio *aio)
 		nng_msg *tmsg = nng_aio_get_msg(aio);
 		int *msgs_lenp = (int *)nng_msg_get_proto_data(tmsg);
 		if (msgs_lenp != NULL) {
+			nni_mtx_lock(&s->mtx);
 			for (int i = 0; i < *msgs_lenp; i++) {
 				if (msgs[i] != NULL) {
 					uint64_t tkey = nni_msg_get_timestamp(msgs[i]);
-					nni_id_remove(&ex_node->sock->rbmsgmap, tkey);
+					nni_id_remove(&s->rbmsgmap, tkey);
 				}
 			}
+			nni_mtx_unlock(&s->mtx);
 		}
 	}
 
 	return 0;
 }
 
+/* The only exchange takes every msg, otherwise it is selected by topic */
+static exchange_node_t *
+exchange_find_node(exchange_sock_t *s, nni_msg *msg)
+{
+	uint32_t    len = 0;
+	const char *topic;
+
+	if (cvector_size(s->ex_nodes) == 1) {
+		return s->ex_nodes[0];
+	}
+
+	topic = nng_mqtt_msg_get_publish_topic(msg, &len);
+	if (topic == NULL) {
+		return NULL;
+	}
+	for (size_t i = 0; i < cvector_size(s->ex_nodes); i++) {
+		if (topic_filtern(s->ex_nodes[i]->ex->topic, topic, len)) {
+			return s->ex_nodes[i];
+		}
+	}
+
+	return NULL;
+}
+
 static inline void
 exchange_do_send(exchange_node_t *ex_node, nni_msg *msg, nni_aio *user_aio)
 {
@@ -257,18 +299,101 @@ exchange_sock_send(void *arg, nni_aio *aio)
 		return;
 	}
 	nni_mtx_lock(&s->mtx);
-	if (s->ex_node == NULL) {
+	ex_node = exchange_find_node(s, msg);
+	nni_mtx_unlock(&s->mtx);
+	if (ex_node == NULL) {
+		log_warn("no exchange for msg!");
+		nni_msg_free(msg);
 		nni_aio_finish_error(aio, NNG_EINVAL);
-		nni_mtx_unlock(&s->mtx);
 		return;
 	}
 
-	ex_node = s->ex_node;
 	exchange_do_send(ex_node, msg, aio);
-	nni_mtx_unlock(&s->mtx);
 	return;
 }
 
+/*
+ * Ring buffers holding distinct msgs of all exchanges, replicas are skipped
+ * unless all is set. Returns a cvector, caller holds the sock lock.
+ */
+static ringBuffer_t **
+exchange_sock_rbs(exchange_sock_t *s, bool all)
+{
+	ringBuffer_t **rbs = NULL;
+
+	for (size_t i = 0; i < cvector_size(s->ex_nodes); i++) {
+		exchange_t  *ex = s->ex_nodes[i]->ex;
+		unsigned int n  = all ? ex->rb_count : exchange_partition_count(ex);
+		for (unsigned int j = 0; j < n; j++) {
+			cvector_push_back(rbs, ex->rbs[j]);
+		}
+	}
+
+	return rbs;
+}
+
+static int
+exchange_client_get_and_clean_msgs(exchange_sock_t *s, uint32_t *count, nng_msg ***list)
+{
+	nng_msg     **msgs  = NULL;
+	unsigned int  parts = 0;
+	ringBuffer_t **rbs  = exchange_sock_rbs(s, false);
+
+	for (size_t i = 0; i < cvector_size(rbs); i++) {
+		unsigned int rbcount = 0;
+		nng_msg    **rblist  = NULL;
+
+		nng_mtx_lock(rbs[i]->ring_lock);
+		if (rbs[i]->size != 0 &&
+		    ringBuffer_get_and_clean_msgs(rbs[i], &rbcount, &rblist) == 0) {
+			for (unsigned int j = 0; j < rbcount; j++) {
+				cvector_push_back(msgs, rblist[j]);
+			}
+			nng_free(rblist, sizeof(nng_msg *) * rbcount);
+			parts++;
+		}
+		nng_mtx_unlock(rbs[i]->ring_lock);
+	}
+	cvector_free(rbs);
+
+	if (cvector_size(msgs) == 0) {
+		return -1;
+	}
+
+	*count = cvector_size(msgs);
+	*list  = nng_alloc(sizeof(nng_msg *) * (*count));
+	if (*list == NULL) {
+		cvector_free(msgs);
+		return -1;
+	}
+	memcpy(*list, msgs, sizeof(nng_msg *) * (*count));
+	cvector_free(msgs);
+	if (parts > 1) {
+		exchange_sort_msgs(*list, *count);
+	}
+
+	return 0;
+}
+
+static int
+exchange_client_set_fullOp(exchange_sock_t *s, uint64_t fullOp)
+{
+	int            ret = -1;
+	ringBuffer_t **rbs = exchange_sock_rbs(s, true);
+
+	for (size_t i = 0; i < cvector_size(rbs); i++) {
+		nng_mtx_lock(rbs[i]->ring_lock);
+		ret = ringBuffer_set_fullOp(rbs[i], fullOp);
+		nng_mtx_unlock(rbs[i]->ring_lock);
+		if (ret != 0) {
+			break;
+		}
+	}
+	cvector_free(rbs);
+
+	return ret;
+}
+
 /**
  * For exchanger, sock_recv is meant for consuming msg from MQ actively
 */
@@ -327,30 +452,22 @@ exchange_sock_recv(void *arg, nni_aio *aio)
 			}
 		} else if (tss[2] == 1) {
 			/* clean up and return */
-			/* Only one exchange with one ringBuffer now */
-			nng_mtx_lock(s->ex_node->ex->rbs[0]->ring_lock);
-			ret = ringBuffer_get_and_clean_msgs(s->ex_node->ex->rbs[0], &count, &list);
+			ret = exchange_client_get_and_clean_msgs(s, &count, &list);
 			if (ret != 0) {
 				log_warn("ringBuffer_get_and_clean_msgs failed!");
-				nng_mtx_unlock(s->ex_node->ex->rbs[0]->ring_lock);
 				nni_mtx_unlock(&s->mtx);
 				nni_aio_finish_error(aio, NNG_EINVAL);
 				return;
 			}
-			nng_mtx_unlock(s->ex_node->ex->rbs[0]->ring_lock);
 		} else if (tss[2] == 2) {
 			/* Change MQ fullOp to tss[1] */
-			/* Only one exchange with one ringBuffer now */
-			nng_mtx_lock(s->ex_node->ex->rbs[0]->ring_lock);
-			ret = ringBuffer_set_fullOp(s->ex_node->ex->rbs[0], tss[1]);
+			ret = exchange_client_set_fullOp(s, tss[1]);
 			if (ret != 0) {
 				log_warn("ringBuffer_fullOp failed!");
-				nng_mtx_unlock(s->ex_node->ex->rbs[0]->ring_lock);
 				nni_mtx_unlock(&s->mtx);
 				nni_aio_finish_error(aio, NNG_EINVAL);
 				return;
 			}
-			nng_mtx_unlock(s->ex_node->ex->rbs[0]->ring_lock);
 		}
 	}
 
@@ -394,7 +511,17 @@ exchange_sock_bind_exchange(void *arg, const void *v, size_t sz, nni_opt_type t)
 		return rv;
 	}
 
+	rv = exchange_set_partition(ex, node->partition, node->partition_window * 1000);
+	if (rv != 0) {
+		log_error("Failed to set partition of exchange %s", node->name);
+		exchange_release(ex);
+		return rv;
+	}
+
 	rv = exchange_add_ex(s, ex);
+	if (rv != 0) {
+		exchange_release(ex);
+	}
 
 	return (rv);
 }
@@ -427,8 +554,19 @@ exchange_client_get_msg_by_key(void *arg, uint64_t key, nni_msg **msg)
 		return -1;
 	}
 
-	*msg = tmsg;
-	return 0;
+	/*
+	 * rbmsgmap tells whether the key was seen, the msg itself is taken
+	 * from its ring buffer as it may have been spilled out of RAM.
+	 */
+	for (size_t i = 0; i < cvector_size(s->ex_nodes); i++) {
+		ringBuffer_t *rb = exchange_get_ringBuffer_by_key(s->ex_nodes[i]->ex, key);
+		if (rb != NULL && ringBuffer_search_msg_by_key(rb, key, &tmsg) == 0) {
+			*msg = tmsg;
+			return 0;
+		}
+	}
+
+	return -1;
 }
 
 int
@@ -438,10 +576,8 @@ exchange_client_get_msgs_by_key(void *arg, uint64_t key, uint32_t count, nng_msg
 	nni_msg *tmsg = NULL;
 	exchange_sock_t *s = arg;
 
-	nni_id_map *rbmsgmap = &s->rbmsgmap;
 	uint32_t key2 = key & 0XFFFFFFFF;
-	tmsg = nni_id_get(rbmsgmap, key2);
-	if (tmsg == NULL || list == NULL) {
+	if (list == NULL || exchange_client_get_msg_by_key(s, key2, &tmsg) != 0) {
 		log_error("tmsg is NULL or list is NULL\n");
 		return -1;
 	}
@@ -456,8 +592,11 @@ exchange_client_get_msgs_by_key(void *arg, uint64_t key, uint32_t count, nng_msg
 		newList[0] = tmsg;
 		*list = newList;
 	} else {
-		/* Only one exchange with one ringBuffer now */
-		ret = ringBuffer_search_msgs_by_key(s->ex_node->ex->rbs[0], key, count, list);
+		/* keys are unique in the sock, only one exchange has it */
+		ret = -1;
+		for (size_t i = 0; i < cvector_size(s->ex_nodes) && ret != 0; i++) {
+			ret = exchange_search_msgs_by_key(s->ex_nodes[i]->ex, key, count, list);
+		}
 		if (ret != 0 || *list == NULL) {
 			log_error("ringBuffer_get_msgs_by_key failed!\n");
 			return -1;
@@ -470,16 +609,50 @@ exchange_client_get_msgs_by_key(void *arg, uint64_t key, uint32_t count, nng_msg
 int
 exchange_client_get_msgs_fuzz(void *arg, uint64_t start, uint64_t end, uint32_t *count, nng_msg ***list)
 {
-	int ret = 0;
 	exchange_sock_t *s = arg;
+	nng_msg **msgs = NULL;
+	unsigned int parts = 0;
+
+	if (count == NULL || list == NULL) {
+		return -1;
+	}
+
+	for (size_t i = 0; i < cvector_size(s->ex_nodes); i++) {
+		uint32_t exCount = 0;
+		nng_msg **exList = NULL;
+
+		if (exchange_search_msgs_fuzz(s->ex_nodes[i]->ex, start, end, &exCount, &exList) != 0) {
+			continue;
+		}
+		if (cvector_size(s->ex_nodes) == 1) {
+			*count = exCount;
+			*list = exList;
+			return 0;
+		}
+		for (uint32_t j = 0; j < exCount; j++) {
+			cvector_push_back(msgs, exList[j]);
+		}
+		nng_free(exList, sizeof(nng_msg *) * exCount);
+		parts++;
+	}
 
-	/* Only one exchange with one ringBuffer now */
-	ret = ringBuffer_search_msgs_fuzz(s->ex_node->ex->rbs[0], start, end, count, list);
-	if (ret != 0 || *list == NULL) {
+	if (cvector_size(msgs) == 0) {
 		log_error("ringBuffer_get_msgs_fuzz failed!\n");
 		return -1;
 	}
 
+	*count = cvector_size(msgs);
+	*list = nng_alloc(sizeof(nng_msg *) * (*count));
+	if (*list == NULL) {
+		cvector_free(msgs);
+		return -1;
+	}
+	memcpy(*list, msgs, sizeof(nng_msg *) * (*count));
+	cvector_free(msgs);
+	if (parts > 1) {
+		exchange_sort_msgs(*list, *count);
+	}
+
 	return 0;
 }
 
@@ -775,34 +948,107 @@ static inline int splitstr(char *str, char *delim, char *result[], int max_num)
 	return count;
 }
 
+static void
+ex_query_reply(exchange_pipe_t *p, nni_msg *msg, cJSON *obj)
+{
+	char *buf = cJSON_PrintUnformatted(obj);
+	cJSON_Delete(obj);
+	if (buf != NULL) {
+		nni_msg_append(msg, buf, strlen(buf));
+		nng_free(buf, strlen(buf));
+	}
+
+	nni_aio_wait(&p->rp_aio);
+	nni_time time = 3000;
+	nni_aio_set_expire(&p->rp_aio, time);
+	nni_aio_set_msg(&p->rp_aio, msg);
+	nni_pipe_send(p->pipe, &p->rp_aio);
+}
+
 #ifdef SUPP_PARQUET
-static inline int find_keys_in_file(ringBuffer_t *rb, uint64_t *keys, uint32_t count, cJSON *obj)
+static int
+file_packets_result_cat(parquet_data_packet **packets, uint32_t len, cJSON *obj)
 {
 	int ret = 0;
-	int msgCount = 0;
-	int *msgLen = NULL;
-	char **msgs = NULL;
+	uint32_t count = 0;
 
-	/* Only one exchange with one ringBuffer now */
-	msgCount = ringBuffer_get_msgs_from_file_by_keys(rb, keys, count, (void ***)&msgs, &msgLen);
-	if (msgCount <= 0 || msgs == NULL || msgLen == NULL) {
+	char **msgs = nng_alloc(sizeof(char *) * len);
+	int *msgLen = nng_alloc(sizeof(int) * len);
+	if (msgs == NULL || msgLen == NULL) {
+		nng_free(msgs, sizeof(char *) * len);
+		nng_free(msgLen, sizeof(int) * len);
+		return -1;
+	}
+	for (uint32_t i = 0; i < len; i++) {
+		if (packets[i] != NULL) {
+			msgs[count] = (char *)packets[i]->data;
+			msgLen[count++] = packets[i]->size;
+		}
+	}
+
+	if (count == 0) {
 		log_error("not found msgs in file!");
 	} else {
-		ret = dump_file_result_cat(msgs, msgLen, msgCount, obj);
+		ret = dump_file_result_cat(msgs, msgLen, count, obj);
+	}
 
-		for(int i = 0; i < msgCount; ++i) {
-			nng_free(msgs[i], 0);
-		}
-		nng_free(msgs, sizeof(char *) * msgCount);
-		nng_free(msgLen, sizeof(int) * msgCount);
+	nng_free(msgs, sizeof(char *) * len);
+	nng_free(msgLen, sizeof(int) * len);
+	return ret;
+}
 
-		if (ret != 0) {
+/* File queries finish here, off the socket lock, once all files are read */
+static void
+ex_query_file_cb(void *arg)
+{
+	exchange_pipe_t *p    = arg;
+	exchange_sock_t *sock = p->sock;
+	nni_msg         *msg;
+	cJSON           *obj;
+	int              rv;
+
+	nni_mtx_lock(&sock->mtx);
+	msg       = p->qr_msg;
+	obj       = p->qr_obj;
+	p->qr_msg = NULL;
+	p->qr_obj = NULL;
+	nni_mtx_unlock(&sock->mtx);
+
+	rv = nni_aio_result(&p->qr_aio);
+	if (rv == NNG_ECANCELED || rv == NNG_ECLOSED) {
+		// the pipe is stopping, nobody is left to answer
+		if (msg != NULL) {
+			nni_msg_free(msg);
+		}
+		if (obj != NULL) {
+			cJSON_Delete(obj);
+		}
+		return;
+	}
+	if (obj == NULL) {
+		obj = cJSON_CreateObject();
+	}
+	if (rv == 0) {
+		parquet_data_packet **packets = nni_aio_get_output(&p->qr_aio, 0);
+		uint32_t len = (uint32_t)(uintptr_t) nni_aio_get_output(&p->qr_aio, 1);
+		if (file_packets_result_cat(packets, len, obj) != 0) {
 			log_error("dump_file_result_cat failed!");
-			return -1;
 		}
+		parquet_data_packets_free(packets, len);
+	} else {
+		log_error("not found msgs in file!");
 	}
 
-	return 0;
+	if (msg == NULL) {
+		cJSON_Delete(obj);
+		return;
+	}
+
+	nni_mtx_lock(&sock->mtx);
+	ex_query_reply(p, msg, obj);
+	nni_mtx_unlock(&sock->mtx);
+
+	nni_pipe_recv(p->pipe, &p->ex_aio);
 }
 #endif
 
@@ -845,30 +1091,17 @@ ex_query_recv_cb(void *arg)
 	cJSON *obj = cJSON_CreateObject();
 	if (strstr(keystr, "dumpfile") != NULL) {
 #ifdef SUPP_PARQUET
-		char **msgs = NULL;
-		int *msgLen = NULL;
-		int msgCount = 0;
-
-		/* Only one exchange with one ringBuffer now */
-		msgCount = ringBuffer_get_msgs_from_file(sock->ex_node->ex->rbs[0], (void ***)&msgs, &msgLen);
-		if (msgCount <= 0 || msgs == NULL || msgLen == NULL) {
-			log_error("not found msgs in file!");
-		} else {
-			ret = dump_file_result_cat(msgs, msgLen, msgCount, obj);
-
-			for(int i = 0; i < msgCount; ++i) {
-				nng_free(msgs[i], 0);
-			}
-			nng_free(msgs, sizeof(char *) * msgCount);
-			nng_free(msgLen, sizeof(int) * msgCount);
-
-			if (ret != 0) {
-				cJSON_Delete(obj);
-				nni_mtx_unlock(&sock->mtx);
-				log_error("dump_file_result_cat failed!");
-				return;
-			}
+		ringBuffer_t **rbs = exchange_sock_rbs(sock, false);
+		p->qr_msg = msg;
+		ret = ringBuffer_get_msgs_from_file_async(rbs, cvector_size(rbs), &p->qr_aio);
+		cvector_free(rbs);
+		if (ret == 0) {
+			cJSON_Delete(obj);
+			nni_mtx_unlock(&sock->mtx);
+			return;
 		}
+		p->qr_msg = NULL;
+		log_error("not found msgs in file!");
 #else
 		log_error("dumpfile: parquet not enable!");
 #endif
@@ -883,13 +1116,17 @@ ex_query_recv_cb(void *arg)
 			return;
 		}
 
-		ret = find_keys_in_file(sock->ex_node->ex->rbs[0], &key, 1, obj);
-		if (ret != 0) {
+		ringBuffer_t **rbs = exchange_sock_rbs(sock, false);
+		p->qr_msg = msg;
+		ret = ringBuffer_get_msgs_from_file_by_keys_async(rbs, cvector_size(rbs), &key, 1, &p->qr_aio);
+		cvector_free(rbs);
+		if (ret == 0) {
 			cJSON_Delete(obj);
-			log_error("find_keys_in_file failed!");
 			nni_mtx_unlock(&sock->mtx);
 			return;
 		}
+		p->qr_msg = NULL;
+		log_error("find keys in file failed!");
 #else
 		log_error("dumpkey: parquet not enable!");
 #endif
@@ -898,18 +1135,30 @@ ex_query_recv_cb(void *arg)
 		/* Only lookups of up to 100 keys are supported */
 		char *result[100];
 		uint64_t keys[100];
+		uint64_t startKey;
+		uint64_t endKey;
 
-		int count = splitstr(keystr + strlen("dumpkeys:"), ",", result, 100);
-		for (int i = 0; i < count; i++) {
-			sscanf(result[i], "%"SCNu64, &keys[i]);
+		p->qr_msg = msg;
+		if (sscanf(keystr + strlen("dumpkeys:"), "%"SCNu64"-%"SCNu64,
+		        &startKey, &endKey) == 2) {
+			/* a span of keys is read by pages, not key by key */
+			ret = parquet_find_data_span_packets_async(NULL, startKey, endKey, &p->qr_aio);
+		} else {
+			int count = splitstr(keystr + strlen("dumpkeys:"), ",", result, 100);
+			for (int i = 0; i < count; i++) {
+				sscanf(result[i], "%"SCNu64, &keys[i]);
+			}
+			ringBuffer_t **rbs = exchange_sock_rbs(sock, false);
+			ret = ringBuffer_get_msgs_from_file_by_keys_async(rbs, cvector_size(rbs), keys, count, &p->qr_aio);
+			cvector_free(rbs);
 		}
-		ret = find_keys_in_file(sock->ex_node->ex->rbs[0], keys, count, obj);
-		if (ret != 0) {
+		if (ret == 0) {
 			cJSON_Delete(obj);
-			log_error("find_keys_in_file failed!");
 			nni_mtx_unlock(&sock->mtx);
 			return;
 		}
+		p->qr_msg = NULL;
+		log_error("find keys in file failed!");
 #else
 		log_error("dumpkeys: parquet not enable!");
 #endif
@@ -1023,7 +1272,6 @@ ex_query_recv_cb(void *arg)
 #if defined(SUPP_PARQUET)
 		const char **parquet_fnames = NULL;
 		uint32_t     parquet_sz     = 0;
-		/* parquet not support fuzz search now */
 		parquet_fnames = parquet_find_span(startKey, endKey, &parquet_sz);
 		if (parquet_fnames && parquet_sz > 0) {
 			ret = get_persistence_files(parquet_sz, (char **) parquet_fnames, obj);
@@ -1047,21 +1295,24 @@ ex_query_recv_cb(void *arg)
 		} else {
 			log_error("blf_find_span failed! sz: %d", blf_sz);
 		}
+#endif
+#if defined(SUPP_PARQUET)
+		if (parquet_sz > 0) {
+			/* msgs of the span in those files are added on the reader pool */
+			p->qr_msg = msg;
+			p->qr_obj = obj;
+			ret = parquet_find_data_span_packets_async(NULL, startKey, endKey, &p->qr_aio);
+			if (ret == 0) {
+				nni_mtx_unlock(&sock->mtx);
+				return;
+			}
+			p->qr_msg = NULL;
+			p->qr_obj = NULL;
+			log_error("find span in file failed!");
+		}
 #endif
 	}
-	char *buf = cJSON_PrintUnformatted(obj);
-	cJSON_Delete(obj);
-	if (buf != NULL) {
-		nni_msg_append(msg, buf, strlen(buf));
-		nng_free(buf, strlen(buf));
-	}
-
-	tar_msg = msg;
-	nni_aio_wait(&p->rp_aio);
-	nni_time time = 3000;
-	nni_aio_set_expire(&p->rp_aio, time);
-	nni_aio_set_msg(&p->rp_aio, tar_msg);
-	nni_pipe_send(p->pipe, &p->rp_aio);
+	ex_query_reply(p, msg, obj);
 
 	nni_mtx_unlock(&sock->mtx);
 
@@ -1084,6 +1335,13 @@ exchange_pipe_init(void *arg, nni_pipe *pipe, void *s)
 
 	nni_aio_init(&p->ex_aio, ex_query_recv_cb, p);
 	nni_aio_init(&p->rp_aio, ex_query_send_cb, p);
+#ifdef SUPP_PARQUET
+	nni_aio_init(&p->qr_aio, ex_query_file_cb, p);
+#else
+	nni_aio_init(&p->qr_aio, NULL, NULL);
+#endif
+	p->qr_msg = NULL;
+	p->qr_obj = NULL;
 	nni_lmq_init(&p->lmq, 256);
 
 	p->pipe = pipe;
@@ -1121,6 +1379,7 @@ exchange_pipe_stop(void *arg)
 
 	nni_aio_stop(&p->ex_aio);
 	nni_aio_stop(&p->rp_aio);
+	nni_aio_stop(&p->qr_aio);
 	return;
 }
 
@@ -1135,6 +1394,14 @@ exchange_pipe_close(void *arg)
 
 	nni_mtx_lock(&s->mtx);
 	p->closed = true;
+	if (p->qr_msg != NULL) {
+		nni_msg_free(p->qr_msg);
+		p->qr_msg = NULL;
+	}
+	if (p->qr_obj != NULL) {
+		cJSON_Delete(p->qr_obj);
+		p->qr_obj = NULL;
+	}
 
 	nni_id_remove(&s->pipes, nni_pipe_id(p->pipe));
 	nni_mtx_unlock(&s->mtx);
@@ -1156,6 +1423,7 @@ exchange_pipe_fini(void *arg)
 
 	nni_aio_fini(&p->ex_aio);
 	nni_aio_fini(&p->rp_aio);
+	nni_aio_fini(&p->qr_aio);
 	return;
 }
 
@@ -146,6 +146,8 @@ test_exchange_client(void)
 	NUTS_TRUE(conf != NULL);
 	conf->name = "exchange1";
 	conf->topic = "topic1";
+	conf->partition = EX_PARTITION_NONE;
+	conf->partition_window = 1;
 
 	ringBuffer_node *rb_node = NNI_ALLOC_STRUCT(rb_node);
 	NUTS_TRUE(rb_node != NULL);
@@ -236,7 +238,82 @@ test_exchange_client(void)
 	return;
 }
 
+void
+test_exchange_client_multi(void)
+{
+	int rv = 0;
+	nng_socket sock;
+	nni_sock *nsock = NULL;
+	conf_exchange_node confs[2];
+	ringBuffer_node rb_nodes[3];
+	char *topics[2] = { "topic1", "topic2/#" };
+	char *names[2] = { "exchange1", "exchange2" };
+
+	NUTS_TRUE(nng_exchange_client_open(&sock) == 0);
+
+	/* exchange2 is partitioned by key over two ring buffers */
+	for (int i = 0; i < 2; i++) {
+		confs[i].name = names[i];
+		confs[i].topic = topics[i];
+		confs[i].partition = i == 0 ? EX_PARTITION_NONE : EX_PARTITION_KEY;
+		confs[i].partition_window = 1;
+		confs[i].rbufs = NULL;
+	}
+	for (int i = 0; i < 3; i++) {
+		rb_nodes[i].name = i == 0 ? "ringBuffer1" : (i == 1 ? "ringBuffer2" : "ringBuffer3");
+		rb_nodes[i].cap = 10;
+		rb_nodes[i].fullOp = RB_FULL_NONE;
+	}
+	cvector_push_back(confs[0].rbufs, &rb_nodes[0]);
+	cvector_push_back(confs[1].rbufs, &rb_nodes[1]);
+	cvector_push_back(confs[1].rbufs, &rb_nodes[2]);
+	for (int i = 0; i < 2; i++) {
+		confs[i].rbufs_sz = cvector_size(confs[i].rbufs);
+		conf_exchange_node *conf = &confs[i];
+		NUTS_PASS(nng_socket_set_ptr(sock, NNG_OPT_EXCHANGE_BIND, conf));
+	}
+	/* Names of exchanges are unique in a sock */
+	conf_exchange_node *dup = &confs[0];
+	NUTS_FAIL(nng_socket_set_ptr(sock, NNG_OPT_EXCHANGE_BIND, dup), -1);
+
+	/* Msgs are routed by topic */
+	for (int i = 0; i < 4; i++) {
+		client_publish(sock, "topic1", i * 2, NULL, 0, 0, 0);
+		client_publish(sock, "topic2/a", i * 2 + 1, NULL, 0, 0, 0);
+	}
+
+	rv = nni_sock_find(&nsock, sock.id);
+	NUTS_TRUE(rv == 0 && nsock != NULL);
+	nni_sock_rele(nsock);
+
+	nni_msg *msg = NULL;
+	rv = exchange_client_get_msg_by_key(nni_sock_proto_data(nsock), 5, &msg);
+	NUTS_TRUE(rv == 0 && msg != NULL);
+
+	/* Fuzz search covers all exchanges and partitions */
+	uint32_t len = 0;
+	nng_msg **msgList = NULL;
+	rv = exchange_client_get_msgs_fuzz(nni_sock_proto_data(nsock), 0, 7, &len, &msgList);
+	NUTS_TRUE(rv == 0 && len == 8 && msgList != NULL);
+	for (uint32_t i = 0; i < len; i++) {
+		NUTS_TRUE((uintptr_t)nng_msg_get_proto_data(msgList[i]) == i);
+	}
+	nng_free(msgList, sizeof(nng_msg *) * len);
+
+	uint32_t *lenp = nng_alloc(sizeof(uint32_t));
+	*lenp = 0;
+	client_get_and_clean_msgs(sock, lenp, &msgList);
+	NUTS_TRUE(*lenp == 8 && msgList != NULL);
+	free_msg_list(msgList, NULL, lenp, 1);
+
+	for (int i = 0; i < 2; i++) {
+		cvector_free(confs[i].rbufs);
+	}
+	NUTS_CLOSE(sock);
+}
+
 NUTS_TESTS = {
 	{ "Exchange client test", test_exchange_client },
+	{ "Exchange client multiple exchanges test", test_exchange_client_multi },
 	{ NULL, NULL },
 };
@@ -132,9 +132,95 @@ void test_exchange_ringBuffer(void)
 	NUTS_TRUE(exchange_release(ex) == 0);
 }
 
+static exchange_t *
+alloc_partitioned_exchange(exchange_partition partition, uint64_t window)
+{
+	exchange_t *ex = NULL;
+	char *ringBufferName[4] = { "rb0", "rb1", "rb2", "rb3" };
+	unsigned int caps[4] = { 100, 100, 100, 100 };
+	uint8_t fullOps[4] = { RB_FULL_NONE, RB_FULL_NONE, RB_FULL_NONE, RB_FULL_NONE };
+
+	NUTS_TRUE(exchange_init(&ex, EX_NAME, "topic1", caps, ringBufferName, fullOps, 4) == 0);
+	NUTS_TRUE(exchange_set_partition(ex, partition, window) == 0);
+
+	for (int i = 0; i < 100; i++) {
+		nng_msg *msg = alloc_pub_msg("topic1");
+		NUTS_TRUE(msg != NULL);
+		NUTS_TRUE(exchange_handle_msg(ex, i, (void *)msg, NULL) == 0);
+	}
+
+	return ex;
+}
+
+void test_exchange_partition(void)
+{
+	exchange_t *ex = NULL;
+	nng_msg **msgList = NULL;
+	uint32_t count = 0;
+
+	NUTS_TRUE(exchange_init(&ex, EX_NAME, "topic1", (unsigned int[]){ 10 },
+	    (char *[]){ "rb0" }, (uint8_t[]){ RB_FULL_NONE }, 1) == 0);
+	NUTS_TRUE(exchange_set_partition(ex, EX_PARTITION_TIME, 0) != 0);
+	NUTS_TRUE(exchange_partition_count(ex) == 1);
+	NUTS_TRUE(exchange_release(ex) == 0);
+
+	/* Each msg goes to one ring buffer by hash of the key */
+	ex = alloc_partitioned_exchange(EX_PARTITION_KEY, 0);
+	NUTS_TRUE(exchange_partition_count(ex) == 4);
+	unsigned int total = 0;
+	for (unsigned int i = 0; i < ex->rb_count; i++) {
+		NUTS_TRUE(ex->rbs[i]->size < 100);
+		total += ex->rbs[i]->size;
+	}
+	NUTS_TRUE(total == 100);
+	for (uint64_t key = 0; key < 100; key++) {
+		nng_msg *msg = NULL;
+		ringBuffer_t *rb = exchange_get_ringBuffer_by_key(ex, key);
+		NUTS_TRUE(ringBuffer_search_msg_by_key(rb, key, &msg) == 0);
+	}
+
+	/* Results of all partitions in key order */
+	NUTS_TRUE(exchange_search_msgs_fuzz(ex, 10, 39, &count, &msgList) == 0);
+	NUTS_TRUE(count == 30);
+	for (uint32_t i = 0; i < count; i++) {
+		NUTS_TRUE((uintptr_t)nng_msg_get_proto_data(msgList[i]) == 10 + i);
+	}
+	nng_free(msgList, sizeof(nng_msg *) * count);
+
+	NUTS_TRUE(exchange_search_msgs_by_key(ex, 5, 3, &msgList) == 0);
+	for (uint32_t i = 0; i < 3; i++) {
+		NUTS_TRUE((uintptr_t)nng_msg_get_proto_data(msgList[i]) == 5 + i);
+	}
+	nng_free(msgList, sizeof(nng_msg *) * 3);
+	/* Exactly count of them, though more follow in every partition */
+	NUTS_TRUE(exchange_search_msgs_by_key(ex, 40, 50, &msgList) == 0);
+	for (uint32_t i = 0; i < 50; i++) {
+		NUTS_TRUE((uintptr_t)nng_msg_get_proto_data(msgList[i]) == 40 + i);
+	}
+	nng_free(msgList, sizeof(nng_msg *) * 50);
+	NUTS_TRUE(exchange_search_msgs_by_key(ex, 98, 3, &msgList) != 0);
+	NUTS_TRUE(exchange_search_msgs_by_key(ex, 100, 1, &msgList) != 0);
+	NUTS_TRUE(exchange_release(ex) == 0);
+
+	/* Consecutive windows of 10 keys go to consecutive ring buffers */
+	ex = alloc_partitioned_exchange(EX_PARTITION_TIME, 10);
+	for (unsigned int i = 0; i < ex->rb_count; i++) {
+		NUTS_TRUE(ex->rbs[i]->size == (i < 2 ? 30 : 20));
+	}
+	NUTS_TRUE(exchange_get_ringBuffer_by_key(ex, 45) == ex->rbs[0]);
+	NUTS_TRUE(exchange_search_msgs_fuzz(ex, 35, 54, &count, &msgList) == 0);
+	NUTS_TRUE(count == 20);
+	for (uint32_t i = 0; i < count; i++) {
+		NUTS_TRUE((uintptr_t)nng_msg_get_proto_data(msgList[i]) == 35 + i);
+	}
+	nng_free(msgList, sizeof(nng_msg *) * count);
+	NUTS_TRUE(exchange_release(ex) == 0);
+}
+
 NUTS_TESTS = {
 	{ "Exchange init test", test_exchange_init },
 	{ "Exchange release test", test_exchange_release },
 	{ "Exchange ringBuffer test", test_exchange_ringBuffer },
+	{ "Exchange partition test", test_exchange_partition },
 	{ NULL, NULL },
 };
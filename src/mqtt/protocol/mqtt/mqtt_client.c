@@ -28,6 +28,21 @@
 #define NNG_MQTT_PEER 0
 #define NNG_MQTT_PEER_NAME "mqtt-server"
 
+// Most connections a socket stripes its PUBLISH packets over.
+#define NNG_MQTT_MAX_STRIPES 16
+// QoS 1/2 msgs held beyond the inflight window before sends fail
+#define NNG_MQTT_MAX_HELD 1024
+
+#ifdef NNG_ENABLE_STATS
+#define BUMP_STAT(x) nni_stat_inc(x, 1)
+#define ADD_STAT(x, n) nni_stat_inc(x, n)
+#define SET_STAT(x, v) nni_stat_set_value(x, v)
+#else
+#define BUMP_STAT(x)
+#define ADD_STAT(x, n)
+#define SET_STAT(x, v)
+#endif
+
 typedef struct mqtt_sock_s mqtt_sock_t;
 typedef struct mqtt_pipe_s mqtt_pipe_t;
 typedef struct mqtt_ctx_s  mqtt_ctx_t;
@@ -40,6 +55,11 @@ static void mqtt_sock_recv(void *arg, nni_aio *aio);
 static void mqtt_send_cb(void *arg);
 static void mqtt_recv_cb(void *arg);
 static void mqtt_timer_cb(void *arg);
+static void mqtt_delay_cb(void *arg);
+static void mqtt_envelope_cb(void *arg);
+static void mqtt_inflight_close(mqtt_sock_t *s);
+static void mqtt_envelope_flush(mqtt_sock_t *s);
+static void mqtt_envelope_free_cb(void *key, void *val);
 
 static int  mqtt_pipe_init(void *arg, nni_pipe *pipe, void *s);
 static void mqtt_pipe_fini(void *arg);
@@ -78,9 +98,15 @@ struct mqtt_pipe_s {
 	nni_aio         send_aio;      // send aio to the underlying transport
 	nni_aio         recv_aio;      // recv aio to the underlying transport
 	nni_aio         time_aio;      // timer aio to resend unack msg
+	nni_aio         delay_aio;     // timer aio to hold back a send
 	nni_lmq         recv_messages; // recv messages queue
 	nni_lmq         send_messages; // send messages queue
+	nni_lmq         send_batch;    // msgs written along with send_aio
+	uint16_t        batch_max;     // most msgs to put in send_batch
+	bool            batching;      // transport takes send_batch
 	uint16_t        rid;           // index of resending packet id
+	uint16_t        stripe;        // slot among connections of the sock
+	nni_duration    timeleft;      // left time to send next ping
 	bool            busy;
 	uint8_t         pingcnt;
 	nni_msg        *pingmsg;
@@ -96,18 +122,53 @@ struct mqtt_sock_s {
 	nni_atomic_int  next_packet_id; // next packet id to use
 	nni_duration    retry;
 	nni_duration    keepalive; // mqtt keepalive
-	nni_duration    timeleft;  // left time to send next ping
 	nni_mtx         mtx;    // more fine grained mutual exclusion
 	mqtt_ctx_t      master; // to which we delegate send/recv calls
-	mqtt_pipe_t    *mqtt_pipe;
+	mqtt_pipe_t    *mqtt_pipe;  // takes all but PUBLISH packets
+	mqtt_pipe_t    *stripes[NNG_MQTT_MAX_STRIPES];
+	uint16_t        stripe_cnt; // connections PUBLISH packets go over
+	uint16_t        recv_next;  // stripe to pick up recv msgs first
+	uint16_t        send_batch; // most msgs per write of a connection
+	nni_duration    send_delay; // time to wait for more msgs to batch
 	nni_list        recv_queue; // ctx pending to receive
 	nni_list        send_queue; // ctx pending to send (only offline msg)
 	reason_code     disconnect_code; // disconnect reason code
 	property       *dis_prop;        // disconnect property
 
 	nni_mqtt_sqlite_option *sqlite_opt;
+
+	// QoS 1/2 msgs waiting for their ack, keyed by packet id, one map
+	// per stripe. They outlive the pipe and are resent when the next one
+	// of the same stripe starts.
+	nni_id_map      inflight[NNG_MQTT_MAX_STRIPES];
+	uint32_t        inflight_cnt; // of all stripes
+	nni_lmq         held;         // QoS 1/2 msgs waiting for a slot
+	uint16_t        inflight_max; // configured window
+	uint16_t        inflight_win; // window of the current connection
+#ifdef NNG_ENABLE_STATS
+	nni_stat_item stat_inflight;
+	nni_stat_item stat_held;
+	nni_stat_item stat_resent;
+	nni_stat_item stat_stripes;
+	nni_stat_item stat_enveloped;
+	nni_stat_item stat_envelopes;
+#endif
+
+	// QoS 0 PUBLISH msgs collected by topic prefix, sent in envelopes
+	conf_bridge_envelope envelope;
+	nni_id_map           env_groups; // mqtt_env_group by prefix hash
+	nni_aio              env_aio;    // ends the collecting window
+	bool                 env_armed;
 };
 
+// The msgs of a topic prefix waiting to go out in one envelope.
+typedef struct {
+	char    *prefix;
+	size_t   len;
+	nni_msg *records;
+	uint32_t count;
+} mqtt_env_group;
+
 /******************************************************************************
  *                              Sock Implementation                           *
  ******************************************************************************/
@@ -120,6 +181,16 @@ mqttv5_sock_init(void *arg, nni_sock *sock)
 	s->mqtt_ver = MQTT_PROTOCOL_VERSION_v5;
 }
 
+#ifdef NNG_ENABLE_STATS
+static void
+mqtt_add_sock_stat(
+    nni_sock *sock, nni_stat_item *item, const nni_stat_info *info)
+{
+	nni_stat_init(item, info);
+	nni_sock_add_stat(sock, item);
+}
+#endif
+
 static void
 mqtt_sock_init(void *arg, nni_sock *sock)
 {
@@ -133,15 +204,77 @@ mqtt_sock_init(void *arg, nni_sock *sock)
 	// this is "semi random" start for request IDs.
 	s->retry     = NNI_SECOND * 5;
 	s->keepalive = NNI_SECOND * 10; // default mqtt keepalive
-	s->timeleft  = NNI_SECOND * 10;
 
 	nni_mtx_init(&s->mtx);
 	mqtt_ctx_init(&s->master, s);
 
-	s->mqtt_ver  = MQTT_PROTOCOL_VERSION_v311;
-	s->mqtt_pipe = NULL;
+	s->mqtt_ver   = MQTT_PROTOCOL_VERSION_v311;
+	s->mqtt_pipe  = NULL;
+	s->stripe_cnt = 1;
+	s->send_batch = 64;
+	s->send_delay = 0;
 	NNI_LIST_INIT(&s->recv_queue, mqtt_ctx_t, rqnode);
 	NNI_LIST_INIT(&s->send_queue, mqtt_ctx_t, sqnode);
+
+	for (uint16_t i = 0; i < NNG_MQTT_MAX_STRIPES; i++) {
+		nni_id_map_init(&s->inflight[i], 0x0000u, 0xffffu, false);
+	}
+	s->inflight_cnt = 0;
+	nni_lmq_init(&s->held, NNG_MQTT_MAX_HELD);
+	s->inflight_max = 0xffff;
+	s->inflight_win = 0xffff;
+
+	memset(&s->envelope, 0, sizeof(s->envelope));
+	nni_id_map_init(&s->env_groups, 0, 0, false);
+	nni_aio_init(&s->env_aio, mqtt_envelope_cb, s);
+	s->env_armed = false;
+
+#ifdef NNG_ENABLE_STATS
+	static const nni_stat_info inflight_info = {
+		.si_name = "inflight",
+		.si_desc = "QoS 1/2 messages waiting for an ack",
+		.si_type = NNG_STAT_LEVEL,
+		.si_unit = NNG_UNIT_MESSAGES,
+	};
+	static const nni_stat_info held_info = {
+		.si_name = "held",
+		.si_desc = "QoS 1/2 messages waiting for the inflight window",
+		.si_type = NNG_STAT_LEVEL,
+		.si_unit = NNG_UNIT_MESSAGES,
+	};
+	static const nni_stat_info resent_info = {
+		.si_name   = "resent",
+		.si_desc   = "QoS 1/2 messages resent after reconnecting",
+		.si_type   = NNG_STAT_COUNTER,
+		.si_unit   = NNG_UNIT_MESSAGES,
+		.si_atomic = true,
+	};
+	mqtt_add_sock_stat(sock, &s->stat_inflight, &inflight_info);
+	mqtt_add_sock_stat(sock, &s->stat_held, &held_info);
+	static const nni_stat_info stripes_info = {
+		.si_name = "stripes",
+		.si_desc = "connections PUBLISH packets are striped over",
+		.si_type = NNG_STAT_LEVEL,
+	};
+	mqtt_add_sock_stat(sock, &s->stat_resent, &resent_info);
+	mqtt_add_sock_stat(sock, &s->stat_stripes, &stripes_info);
+	static const nni_stat_info enveloped_info = {
+		.si_name   = "enveloped",
+		.si_desc   = "QoS 0 messages sent inside envelopes",
+		.si_type   = NNG_STAT_COUNTER,
+		.si_unit   = NNG_UNIT_MESSAGES,
+		.si_atomic = true,
+	};
+	static const nni_stat_info envelopes_info = {
+		.si_name   = "envelopes",
+		.si_desc   = "envelopes sent",
+		.si_type   = NNG_STAT_COUNTER,
+		.si_unit   = NNG_UNIT_MESSAGES,
+		.si_atomic = true,
+	};
+	mqtt_add_sock_stat(sock, &s->stat_enveloped, &enveloped_info);
+	mqtt_add_sock_stat(sock, &s->stat_envelopes, &envelopes_info);
+#endif
 }
 
 static void
@@ -154,6 +287,13 @@ mqtt_sock_fini(void *arg)
 #endif
 	mqtt_ctx_fini(&s->master);
 
+	nni_aio_fini(&s->env_aio);
+	nni_id_map_foreach(&s->env_groups, mqtt_envelope_free_cb);
+	nni_id_map_fini(&s->env_groups);
+	for (uint16_t i = 0; i < NNG_MQTT_MAX_STRIPES; i++) {
+		nni_id_map_fini(&s->inflight[i]);
+	}
+	nni_lmq_fini(&s->held);
 	nni_mtx_fini(&s->mtx);
 }
 
@@ -210,6 +350,164 @@ mqtt_sock_set_retry_interval(void *arg, const void *v, size_t sz, nni_opt_type t
 	return (rv);
 }
 
+static int
+mqtt_sock_set_inflight_window(
+    void *arg, const void *v, size_t sz, nni_opt_type t)
+{
+	mqtt_sock_t *s = arg;
+	int          win;
+	int          rv;
+
+	if ((rv = nni_copyin_int(&win, v, sz, 1, 0xffff, t)) == 0) {
+		nni_mtx_lock(&s->mtx);
+		s->inflight_max = (uint16_t) win;
+		if (s->inflight_win > s->inflight_max) {
+			s->inflight_win = s->inflight_max;
+		}
+		nni_mtx_unlock(&s->mtx);
+	}
+	return (rv);
+}
+
+static int
+mqtt_sock_get_inflight_window(void *arg, void *v, size_t *szp, nni_opt_type t)
+{
+	mqtt_sock_t *s = arg;
+	int          rv;
+
+	nni_mtx_lock(&s->mtx);
+	rv = nni_copyout_int(s->inflight_max, v, szp, t);
+	nni_mtx_unlock(&s->mtx);
+	return (rv);
+}
+
+static int
+mqtt_sock_get_inflight(void *arg, void *v, size_t *szp, nni_opt_type t)
+{
+	mqtt_sock_t *s = arg;
+	int          rv;
+
+	nni_mtx_lock(&s->mtx);
+	rv = nni_copyout_int((int) s->inflight_cnt, v, szp, t);
+	nni_mtx_unlock(&s->mtx);
+	return (rv);
+}
+
+static int
+mqtt_sock_set_stripes(void *arg, const void *v, size_t sz, nni_opt_type t)
+{
+	mqtt_sock_t *s = arg;
+	int          cnt;
+	int          rv;
+
+	if ((rv = nni_copyin_int(&cnt, v, sz, 1, NNG_MQTT_MAX_STRIPES, t)) !=
+	    0) {
+		return (rv);
+	}
+	nni_mtx_lock(&s->mtx);
+	if (s->mqtt_pipe != NULL || s->inflight_cnt != 0 ||
+	    !nni_lmq_empty(&s->held)) {
+		// connections are already striped, or msgs are tied to them
+		rv = NNG_EBUSY;
+	} else {
+		s->stripe_cnt = (uint16_t) cnt;
+	}
+	nni_mtx_unlock(&s->mtx);
+	return (rv);
+}
+
+static int
+mqtt_sock_get_stripes(void *arg, void *v, size_t *szp, nni_opt_type t)
+{
+	mqtt_sock_t *s = arg;
+	int          rv;
+
+	nni_mtx_lock(&s->mtx);
+	rv = nni_copyout_int(s->stripe_cnt, v, szp, t);
+	nni_mtx_unlock(&s->mtx);
+	return (rv);
+}
+
+static int
+mqtt_sock_set_send_batch(void *arg, const void *v, size_t sz, nni_opt_type t)
+{
+	mqtt_sock_t *s = arg;
+	int          cnt;
+	int          rv;
+
+	if ((rv = nni_copyin_int(&cnt, v, sz, 1, 1024, t)) == 0) {
+		nni_mtx_lock(&s->mtx);
+		s->send_batch = (uint16_t) cnt;
+		nni_mtx_unlock(&s->mtx);
+	}
+	return (rv);
+}
+
+static int
+mqtt_sock_get_send_batch(void *arg, void *v, size_t *szp, nni_opt_type t)
+{
+	mqtt_sock_t *s = arg;
+	int          rv;
+
+	nni_mtx_lock(&s->mtx);
+	rv = nni_copyout_int(s->send_batch, v, szp, t);
+	nni_mtx_unlock(&s->mtx);
+	return (rv);
+}
+
+static int
+mqtt_sock_set_send_delay(void *arg, const void *v, size_t sz, nni_opt_type t)
+{
+	mqtt_sock_t *s = arg;
+	nni_duration tmp;
+	int          rv;
+
+	if ((rv = nni_copyin_ms(&tmp, v, sz, t)) == 0) {
+		nni_mtx_lock(&s->mtx);
+		s->send_delay = tmp > 1000 ? 1000 : tmp;
+		nni_mtx_unlock(&s->mtx);
+	}
+	return (rv);
+}
+
+static int
+mqtt_sock_get_send_delay(void *arg, void *v, size_t *szp, nni_opt_type t)
+{
+	mqtt_sock_t *s = arg;
+	int          rv;
+
+	nni_mtx_lock(&s->mtx);
+	rv = nni_copyout_ms(s->send_delay, v, szp, t);
+	nni_mtx_unlock(&s->mtx);
+	return (rv);
+}
+
+static int
+mqtt_sock_set_envelope(void *arg, const void *v, size_t sz, nni_opt_type t)
+{
+	mqtt_sock_t          *s = arg;
+	conf_bridge_envelope *env;
+	int                   rv;
+
+	if ((rv = nni_copyin_ptr((void **) &env, v, sz, t)) != 0) {
+		return (rv);
+	}
+	if (env == NULL) {
+		return (NNG_EINVAL);
+	}
+	nni_mtx_lock(&s->mtx);
+	if (s->envelope.enable) {
+		// msgs collected so far go with the former settings
+		mqtt_envelope_flush(s);
+	}
+	s->envelope = *env;
+	if (s->envelope.window == 0) {
+		s->envelope.window = 1;
+	}
+	nni_mtx_unlock(&s->mtx);
+	return (0);
+}
+
 static int
 mqtt_sock_set_sqlite_option(
     void *arg, const void *v, size_t sz, nni_opt_type t)
@@ -261,6 +559,12 @@ mqtt_sock_close(void *arg)
 		// there should be no msg waiting
 		nni_aio_finish_error(aio, NNG_ECLOSED);
 	}
+	nni_mtx_lock(&s->mtx);
+	mqtt_inflight_close(s);
+	// the last window is cut short
+	mqtt_envelope_flush(s);
+	nni_mtx_unlock(&s->mtx);
+	nni_aio_close(&s->env_aio);
 }
 
 static void
@@ -302,7 +606,8 @@ mqtt_sock_get_next_packet_id(mqtt_sock_t *s)
 static int
 mqtt_pipe_init(void *arg, nni_pipe *pipe, void *s)
 {
-	mqtt_pipe_t *p = arg;
+	mqtt_pipe_t *p    = arg;
+	mqtt_sock_t *sock = s;
 
 	nni_atomic_init_bool(&p->closed);
 	nni_atomic_set_bool(&p->closed, true);
@@ -325,6 +630,7 @@ mqtt_pipe_init(void *arg, nni_pipe *pipe, void *s)
 	nni_aio_init(&p->send_aio, mqtt_send_cb, p);
 	nni_aio_init(&p->recv_aio, mqtt_recv_cb, p);
 	nni_aio_init(&p->time_aio, mqtt_timer_cb, p);
+	nni_aio_init(&p->delay_aio, mqtt_delay_cb, p);
 	// Packet IDs are 16 bits
 	// We start at a random point, to minimize likelihood of
 	// accidental collision across restarts.
@@ -334,6 +640,10 @@ mqtt_pipe_init(void *arg, nni_pipe *pipe, void *s)
 	// nni_lmq_init(&p->send_messages, NNG_MAX_SEND_LMQ);
 	nni_lmq_init(&p->recv_messages, 102400);
 	nni_lmq_init(&p->send_messages, 102400);
+	// the msg of send_aio itself is not in the batch
+	p->batch_max = sock->send_batch - 1;
+	p->batching  = false;
+	nni_lmq_init(&p->send_batch, p->batch_max);
 
 #ifdef NNG_HAVE_MQTT_BROKER
 	p->cparam = NULL;
@@ -367,11 +677,14 @@ mqtt_pipe_fini(void *arg)
 	nni_aio_fini(&p->send_aio);
 	nni_aio_fini(&p->recv_aio);
 	nni_aio_fini(&p->time_aio);
+	nni_aio_fini(&p->delay_aio);
 
 	nni_id_map_fini(&p->sent_unack);
 	nni_id_map_fini(&p->recv_unack);
 	nni_lmq_fini(&p->recv_messages);
 	nni_lmq_fini(&p->send_messages);
+	// the transport may still have held msgs of an aborted batch
+	nni_lmq_fini(&p->send_batch);
 }
 
 static inline int
@@ -394,6 +707,591 @@ mqtt_pipe_recv_msgq_putq(mqtt_pipe_t *p, nni_msg *msg)
 	return rv;
 }
 
+// The stripe a PUBLISH belongs to, picked by the hash of its topic.
+static uint16_t
+mqtt_stripe_home(mqtt_sock_t *s, nni_msg *msg)
+{
+	const char *topic;
+	uint32_t    len;
+
+	if (s->stripe_cnt == 1 ||
+	    nni_mqtt_msg_get_packet_type(msg) != NNG_MQTT_PUBLISH ||
+	    (topic = nni_mqtt_msg_get_publish_topic(msg, &len)) == NULL) {
+		return (0);
+	}
+	return (fnv1a_hashn((char *) topic, len) % s->stripe_cnt);
+}
+
+// Pick the connection a QoS 0 PUBLISH goes out on. A topic sticks to one
+// connection to keep its msgs in order, unless that one is down.
+static mqtt_pipe_t *
+mqtt_stripe_pipe(mqtt_sock_t *s, nni_msg *msg)
+{
+	uint16_t     i;
+	mqtt_pipe_t *p;
+
+	if (s->stripe_cnt == 1 ||
+	    nni_mqtt_msg_get_packet_type(msg) != NNG_MQTT_PUBLISH) {
+		return (s->mqtt_pipe);
+	}
+	i = mqtt_stripe_home(s, msg);
+	for (uint16_t n = 0; n < s->stripe_cnt; n++) {
+		p = s->stripes[(i + n) % s->stripe_cnt];
+		if (p != NULL && !nni_atomic_get_bool(&p->closed)) {
+			return (p);
+		}
+	}
+	return (s->mqtt_pipe);
+}
+
+static inline uint16_t
+mqtt_stripe_count(mqtt_sock_t *s)
+{
+	uint16_t cnt = 0;
+
+	for (uint16_t i = 0; i < s->stripe_cnt; i++) {
+		if (s->stripes[i] != NULL) {
+			cnt++;
+		}
+	}
+	return (cnt);
+}
+
+// Only the first connection resends msgs cached in sqlite.
+static inline bool
+mqtt_stripe_replays(mqtt_sock_t *s, mqtt_pipe_t *p)
+{
+	return (s->stripes[0] == p);
+}
+
+// Hand the transport the first msg queued, and as many queued behind it
+// as fit in a batch if the transport writes them together. Returns false
+// if nothing is queued. Should be called with mutex lock hold.
+static bool
+mqtt_pipe_send_queued(mqtt_pipe_t *p)
+{
+	nni_msg *msg;
+
+	if (nni_lmq_get(&p->send_messages, &msg) != 0) {
+		return (false);
+	}
+	if (p->batching) {
+		nni_msg *tmsg;
+		while (nni_lmq_len(&p->send_batch) < p->batch_max &&
+		    nni_lmq_get(&p->send_messages, &tmsg) == 0) {
+			(void) nni_lmq_put(&p->send_batch, tmsg);
+		}
+	}
+	p->busy = true;
+	nni_aio_set_msg(&p->send_aio, msg);
+	nni_pipe_send(p->pipe, &p->send_aio);
+	return (true);
+}
+
+// Hand a msg to the transport, or queue it behind the one being written.
+// Should be called with mutex lock hold.
+static void
+mqtt_pipe_send_msg(mqtt_pipe_t *p, nni_msg *msg)
+{
+	mqtt_sock_t *s = p->mqtt_sock;
+	nni_msg     *tmsg;
+
+	if (!p->busy) {
+		p->busy = true;
+		if (p->batching && s->send_delay > 0) {
+			// wait a bit for more msgs to write along
+			(void) nni_lmq_put(&p->send_messages, msg);
+			nni_sleep_aio(s->send_delay, &p->delay_aio);
+			return;
+		}
+		nni_aio_set_msg(&p->send_aio, msg);
+		nni_pipe_send(p->pipe, &p->send_aio);
+		return;
+	}
+	if (nni_lmq_full(&p->send_messages)) {
+		log_error("rhack: pipe is busy and lmq is full\n");
+		(void) nni_lmq_get(&p->send_messages, &tmsg);
+		nni_msg_free(tmsg);
+	}
+	if (0 != nni_lmq_put(&p->send_messages, msg)) {
+		log_error("Warning! msg lost due to busy socket");
+		nni_msg_free(msg);
+	}
+}
+
+static inline bool
+mqtt_inflight_full(mqtt_sock_t *s)
+{
+	return (s->inflight_cnt >= s->inflight_win);
+}
+
+// Tell whether a packet id is taken by a msg waiting for its ack, on the
+// given stripe or, with NNG_MQTT_MAX_STRIPES, on any of them.
+static bool
+mqtt_inflight_id_busy(mqtt_sock_t *s, uint16_t stripe, uint16_t id)
+{
+	mqtt_pipe_t *p;
+
+	for (uint16_t i = 0; i < s->stripe_cnt; i++) {
+		if (stripe != NNG_MQTT_MAX_STRIPES && stripe != i) {
+			continue;
+		}
+		if (nni_id_get(&s->inflight[i], id) != NULL) {
+			return (true);
+		}
+		if ((p = s->stripes[i]) != NULL &&
+		    nni_id_get(&p->sent_unack, id) != NULL) {
+			return (true);
+		}
+	}
+	return (false);
+}
+
+// Hand out the next packet id not in use. Ids of QoS 1/2 msgs are taken
+// when they enter the window, so a msg held for long never replays an id
+// of another one still waiting for its ack.
+static uint16_t
+mqtt_inflight_next_id(mqtt_sock_t *s, uint16_t stripe)
+{
+	uint16_t id;
+
+	for (uint32_t n = 0; n < 0xffff; n++) {
+		id = mqtt_get_next_packet_id(&s->next_packet_id);
+		if (!mqtt_inflight_id_busy(s, stripe, id)) {
+			return (id);
+		}
+	}
+	return (id);
+}
+
+// Write the packet id into a PUBLISH that is encoded already, right after
+// its topic.
+static void
+mqtt_inflight_set_id(nni_msg *msg, uint16_t id)
+{
+	uint8_t *body = nni_msg_body(msg);
+	uint16_t len;
+
+	NNI_GET16(body, len);
+	nni_mqtt_msg_set_publish_packet_id(msg, id);
+	NNI_PUT16(body + 2 + len, id);
+}
+
+// Keep a reference of a QoS 1/2 msg until it is acknowledged on its
+// stripe.
+static int
+mqtt_inflight_add(
+    mqtt_sock_t *s, uint16_t stripe, uint16_t packet_id, nni_msg *msg)
+{
+	nni_id_map *map = &s->inflight[stripe];
+	nni_msg    *old;
+	nni_aio    *aio;
+	int         rv;
+
+	if ((old = nni_id_get(map, packet_id)) != NULL) {
+		log_warn("msg %d lost due to packetID duplicated!", packet_id);
+		nni_id_remove(map, packet_id);
+		s->inflight_cnt--;
+		if ((aio = nni_mqtt_msg_get_aio(old)) != NULL) {
+			nni_aio_finish_error(aio, NNG_ECANCELED);
+		}
+		nni_msg_free(old);
+	}
+	nni_msg_clone(msg);
+	if ((rv = nni_id_set(map, packet_id, msg)) != 0) {
+		nni_msg_free(msg);
+		return (rv);
+	}
+	s->inflight_cnt++;
+	SET_STAT(&s->stat_inflight, s->inflight_cnt);
+	return (0);
+}
+
+// Release the slot of an acknowledged msg, returns the aio of its sender.
+static nni_aio *
+mqtt_inflight_ack(mqtt_sock_t *s, uint16_t stripe, uint16_t packet_id)
+{
+	nni_msg *msg;
+	nni_aio *aio;
+
+	if ((msg = nni_id_get(&s->inflight[stripe], packet_id)) == NULL) {
+		return (NULL);
+	}
+	nni_id_remove(&s->inflight[stripe], packet_id);
+	s->inflight_cnt--;
+	aio = nni_mqtt_msg_get_aio(msg);
+	nni_msg_free(msg);
+	SET_STAT(&s->stat_inflight, s->inflight_cnt);
+	return (aio);
+}
+
+// Send a msg taken into the window of its stripe. While the connection
+// of the stripe is down it waits there, to go first when it is back.
+static void
+mqtt_inflight_send(mqtt_sock_t *s, uint16_t stripe, nni_msg *msg)
+{
+	mqtt_pipe_t *p = s->stripes[stripe];
+
+	if (p == NULL || nni_atomic_get_bool(&p->closed)) {
+		nni_msg_set_pipe(msg, 0);
+		nni_msg_free(msg);
+		return;
+	}
+	nni_msg_set_pipe(msg, nni_pipe_id(p->pipe));
+	mqtt_pipe_send_msg(p, msg);
+}
+
+#if defined(NNG_SUPP_SQLITE)
+// Tell whether msg is a copy of one kept in the inflight window.
+static bool
+mqtt_inflight_queued(mqtt_sock_t *s, uint16_t stripe, nni_msg *msg)
+{
+	uint8_t type;
+
+	if (nni_msg_get_proto_data(msg) == NULL) {
+		return (false);
+	}
+	type = nni_mqtt_msg_get_packet_type(msg);
+	if (type != NNG_MQTT_PUBLISH && type != NNG_MQTT_PUBREL) {
+		return (false);
+	}
+	return (nni_id_get(&s->inflight[stripe],
+	            nni_mqtt_msg_get_packet_id(msg)) == msg);
+}
+#endif
+
+// A QoS 2 msg got its PUBREC, so it is the PUBREL that has to be resent
+// from now on.
+static void
+mqtt_inflight_pubrel(mqtt_sock_t *s, uint16_t stripe, uint16_t packet_id)
+{
+	nni_msg *old;
+	nni_msg *rel;
+
+	if ((old = nni_id_get(&s->inflight[stripe], packet_id)) == NULL) {
+		return;
+	}
+	if (nni_mqtt_msg_alloc(&rel, 0) != 0) {
+		return;
+	}
+	nni_mqtt_msg_set_packet_type(rel, NNG_MQTT_PUBREL);
+	nni_mqtt_msg_set_pubrel_packet_id(rel, packet_id);
+	nni_mqtt_msgack_encode(rel, packet_id, 0, NULL, s->mqtt_ver);
+	nni_mqtt_pubres_header_encode(rel, CMD_PUBREL);
+	nni_mqtt_msg_set_aio(rel, nni_mqtt_msg_get_aio(old));
+	nni_msg_set_pipe(rel, nni_msg_get_pipe(old));
+	if (nni_id_set(&s->inflight[stripe], packet_id, rel) != 0) {
+		nni_msg_free(rel);
+		return;
+	}
+	nni_msg_free(old);
+}
+
+// Move held msgs into the window as long as it has free slots.
+static void
+mqtt_inflight_release(mqtt_sock_t *s)
+{
+	nni_msg *msg;
+	nni_aio *aio;
+	uint16_t stripe;
+	uint16_t packet_id;
+
+	if (s->mqtt_pipe == NULL) {
+		return;
+	}
+	while (!mqtt_inflight_full(s) && nni_lmq_get(&s->held, &msg) == 0) {
+		aio       = nni_mqtt_msg_get_aio(msg);
+		stripe    = mqtt_stripe_home(s, msg);
+		packet_id = mqtt_inflight_next_id(s, stripe);
+		mqtt_inflight_set_id(msg, packet_id);
+		if (mqtt_inflight_add(s, stripe, packet_id, msg) != 0) {
+			nni_mqtt_msg_set_aio(msg, NULL);
+			nni_msg_free(msg);
+			if (aio != NULL) {
+				nni_aio_finish_error(aio, NNG_ENOMEM);
+			}
+			continue;
+		}
+		if (aio != NULL) {
+			nni_aio_bump_count(
+			    aio, nni_msg_header_len(msg) + nni_msg_len(msg));
+		}
+		mqtt_inflight_send(s, stripe, msg);
+	}
+	SET_STAT(&s->stat_held, nni_lmq_len(&s->held));
+}
+
+typedef struct {
+	uint32_t *keys;
+	size_t    len;
+	uint16_t  next;
+} mqtt_inflight_order;
+
+static void
+mqtt_inflight_order_cb(void *key, void *val, void *arg)
+{
+	mqtt_inflight_order *o  = arg;
+	uint16_t             id = (uint16_t) * (uint64_t *) key;
+
+	NNI_ARG_UNUSED(val);
+	// ids are handed out incrementally, so the distance from the next
+	// one to hand out tells which msg was sent first
+	o->keys[o->len++] = ((uint32_t) (uint16_t) (id - o->next) << 16) | id;
+}
+
+static int
+mqtt_inflight_order_cmp(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *) a;
+	uint32_t y = *(const uint32_t *) b;
+
+	return (x < y ? -1 : (x > y ? 1 : 0));
+}
+
+// Resend the unacknowledged msgs of the stripe of p, the connection that
+// took it over, in the order they were first sent. PUBLISH packets that
+// went out before are flagged as DUP.
+static void
+mqtt_inflight_resend(mqtt_sock_t *s, mqtt_pipe_t *p)
+{
+	nni_id_map         *map = &s->inflight[p->stripe];
+	mqtt_inflight_order o;
+	size_t              sz;
+	nni_msg            *msg;
+
+	if (map->id_count == 0) {
+		return;
+	}
+	sz = sizeof(uint32_t) * map->id_count;
+	if ((o.keys = nni_alloc(sz)) == NULL) {
+		log_error("no memory to resend %d inflight msgs",
+		    map->id_count);
+		return;
+	}
+	o.len  = 0;
+	o.next = (uint16_t) nni_atomic_get(&s->next_packet_id);
+	nni_id_map_foreach2(map, mqtt_inflight_order_cb, &o);
+	qsort(o.keys, o.len, sizeof(uint32_t), mqtt_inflight_order_cmp);
+
+	for (size_t i = 0; i < o.len; i++) {
+		msg = nni_id_get(map, o.keys[i] & 0xffff);
+		if (nni_msg_get_pipe(msg) != 0) {
+			if (nni_mqtt_msg_get_packet_type(msg) ==
+			    NNG_MQTT_PUBLISH) {
+				*(uint8_t *) nni_msg_header(msg) |= 0x08;
+			}
+			BUMP_STAT(&s->stat_resent);
+		}
+		nni_msg_set_pipe(msg, nni_pipe_id(p->pipe));
+		nni_msg_clone(msg);
+		mqtt_pipe_send_msg(p, msg);
+	}
+	log_info("resent %zu inflight msgs of stripe %u", o.len, p->stripe);
+	nni_free(o.keys, sz);
+}
+
+// Finish the senders of all msgs still waiting for acks or slots.
+static void
+mqtt_inflight_close_cb(void *key, void *val)
+{
+	nni_msg *msg = val;
+	nni_aio *aio;
+
+	NNI_ARG_UNUSED(key);
+	if ((aio = nni_mqtt_msg_get_aio(msg)) != NULL) {
+		nni_aio_finish_error(aio, NNG_ECLOSED);
+	}
+	nni_msg_free(msg);
+}
+
+static void
+mqtt_inflight_close(mqtt_sock_t *s)
+{
+	nni_msg *msg;
+
+	for (uint16_t i = 0; i < NNG_MQTT_MAX_STRIPES; i++) {
+		nni_id_map_foreach(&s->inflight[i], mqtt_inflight_close_cb);
+		nni_id_map_fini(&s->inflight[i]);
+		nni_id_map_init(&s->inflight[i], 0x0000u, 0xffffu, false);
+	}
+	s->inflight_cnt = 0;
+	while (nni_lmq_get(&s->held, &msg) == 0) {
+		mqtt_inflight_close_cb(NULL, msg);
+	}
+	SET_STAT(&s->stat_inflight, 0);
+	SET_STAT(&s->stat_held, 0);
+}
+
+static void
+mqtt_envelope_free_cb(void *key, void *val)
+{
+	mqtt_env_group *g = val;
+
+	NNI_ARG_UNUSED(key);
+	nni_msg_free(g->records);
+	nni_free(g->prefix, g->len + 1);
+	NNI_FREE_STRUCT(g);
+}
+
+// Length of the first prefix_levels levels of a topic.
+static size_t
+mqtt_envelope_prefix(const char *topic, size_t len, uint8_t levels)
+{
+	for (size_t i = 0; i < len; i++) {
+		if (topic[i] == '/' && --levels == 0) {
+			return (i);
+		}
+	}
+	return (len);
+}
+
+// Send the msgs of a group in one envelope, or drop them if there is no
+// connection. Should be called with mutex lock hold.
+static void
+mqtt_envelope_send(mqtt_sock_t *s, mqtt_env_group *g)
+{
+	nni_msg     *msg;
+	mqtt_pipe_t *p;
+	char        *topic;
+	size_t       tlen;
+	uint32_t     count = g->count;
+	int          rv;
+
+	if (count == 0) {
+		return;
+	}
+	tlen = strlen(NNI_MQTT_ENVELOPE_TOPIC) + g->len;
+	if ((rv = nni_mqtt_msg_alloc(&msg, 0)) != 0) {
+		goto drop;
+	}
+	if ((topic = nni_alloc(tlen + 1)) == NULL) {
+		nni_msg_free(msg);
+		goto drop;
+	}
+	(void) snprintf(topic, tlen + 1, "%s%s", NNI_MQTT_ENVELOPE_TOPIC,
+	    g->prefix);
+	nni_mqtt_msg_set_packet_type(msg, NNG_MQTT_PUBLISH);
+	nni_mqtt_msg_set_publish_qos(msg, 0);
+	rv = nni_mqtt_msg_set_publish_topic(msg, topic);
+	nni_free(topic, tlen + 1);
+	if (rv != 0 ||
+	    nni_mqtt_envelope_seal(
+	        g->records, count, s->envelope.codec, msg) != 0 ||
+	    (s->mqtt_ver == MQTT_PROTOCOL_VERSION_v5
+	            ? nni_mqttv5_msg_encode(msg)
+	            : nni_mqtt_msg_encode(msg)) != MQTT_SUCCESS) {
+		nni_msg_free(msg);
+		goto drop;
+	}
+	nni_msg_clear(g->records);
+	g->count = 0;
+
+	p = mqtt_stripe_pipe(s, msg);
+	if (p == NULL || nni_atomic_get_bool(&p->closed)) {
+#if defined(NNG_SUPP_SQLITE)
+		nni_mqtt_sqlite_option *sqlite =
+		    mqtt_sock_get_sqlite_option(s);
+		if (sqlite_is_enabled(sqlite)) {
+			nni_lmq_put(&sqlite->offline_cache, msg);
+			if (nni_lmq_full(&sqlite->offline_cache)) {
+				sqlite_flush_offline_cache(sqlite);
+			}
+			return;
+		}
+#endif
+		log_warn("envelope of %u msgs dropped while disconnected",
+		    count);
+		nni_msg_free(msg);
+		return;
+	}
+	ADD_STAT(&s->stat_enveloped, count);
+	BUMP_STAT(&s->stat_envelopes);
+	mqtt_pipe_send_msg(p, msg);
+	return;
+
+drop:
+	log_error("envelope of %u msgs dropped, no memory", count);
+	nni_msg_clear(g->records);
+	g->count = 0;
+}
+
+static void
+mqtt_envelope_flush_cb(void *key, void *val, void *arg)
+{
+	NNI_ARG_UNUSED(key);
+	mqtt_envelope_send(arg, val);
+}
+
+// Should be called with mutex lock hold.
+static void
+mqtt_envelope_flush(mqtt_sock_t *s)
+{
+	nni_id_map_foreach2(&s->env_groups, mqtt_envelope_flush_cb, s);
+}
+
+// Collect a QoS 0 PUBLISH into the envelope of its topic prefix. Msgs
+// with properties are left alone, an envelope does not carry them.
+// Should be called with mutex lock hold.
+static int
+mqtt_envelope_put(mqtt_sock_t *s, nni_msg *msg)
+{
+	mqtt_env_group *g;
+	const char     *topic;
+	uint8_t        *payload;
+	uint32_t        tlen;
+	uint32_t        plen;
+	size_t          len;
+	uint64_t        key;
+
+	if (nni_mqtt_msg_get_publish_property(msg) != NULL ||
+	    (topic = nni_mqtt_msg_get_publish_topic(msg, &tlen)) == NULL ||
+	    tlen > 0xffff || nni_mqtt_envelope_topic(topic, tlen)) {
+		return (NNG_EINVAL);
+	}
+	payload = nni_mqtt_msg_get_publish_payload(msg, &plen);
+	len     = mqtt_envelope_prefix(topic, tlen, s->envelope.prefix_levels);
+	key     = fnv1a_hashn((char *) topic, len);
+
+	if ((g = nni_id_get(&s->env_groups, key)) != NULL &&
+	    (g->len != len || memcmp(g->prefix, topic, len) != 0)) {
+		// another prefix of the same hash, take its place
+		mqtt_envelope_send(s, g);
+		nni_id_remove(&s->env_groups, key);
+		mqtt_envelope_free_cb(NULL, g);
+		g = NULL;
+	}
+	if (g == NULL) {
+		if ((g = NNI_ALLOC_STRUCT(g)) == NULL) {
+			return (NNG_ENOMEM);
+		}
+		if ((g->prefix = nni_alloc(len + 1)) == NULL ||
+		    nni_msg_alloc(&g->records, 0) != 0) {
+			nni_free(g->prefix, len + 1);
+			NNI_FREE_STRUCT(g);
+			return (NNG_ENOMEM);
+		}
+		memcpy(g->prefix, topic, len);
+		g->prefix[len] = '\0';
+		g->len         = len;
+		if (nni_id_set(&s->env_groups, key, g) != 0) {
+			mqtt_envelope_free_cb(NULL, g);
+			return (NNG_ENOMEM);
+		}
+	}
+	if (nni_mqtt_envelope_add(g->records, topic, (uint16_t) tlen, payload,
+	        plen, nni_mqtt_msg_get_publish_retain(msg)) != 0) {
+		return (NNG_ENOMEM);
+	}
+	g->count++;
+	if (nni_msg_len(g->records) >= s->envelope.max_size) {
+		mqtt_envelope_send(s, g);
+	} else if (!s->env_armed) {
+		s->env_armed = true;
+		nni_sleep_aio(s->envelope.window, &s->env_aio);
+	}
+	return (0);
+}
+
 // Should be called with mutex lock hold. and it will unlock mtx.
 // flag indicates if need to skip msg in sqlite 1: check sqlite 0: only aio
 static inline void
@@ -403,10 +1301,11 @@ mqtt_send_msg(nni_aio *aio, mqtt_ctx_t *arg)
 	mqtt_sock_t *    s     = ctx->mqtt_sock;
 	mqtt_pipe_t *    p     = s->mqtt_pipe;
 	uint16_t         ptype = 0, packet_id = 0;
+	uint16_t         stripe;
 	uint8_t          qos   = 0;
 	nni_msg *        msg   = NULL;
-	nni_msg *        tmsg  = NULL;
 	nni_aio *        taio  = NULL;
+	int              rv;
 
 	if (p == NULL || nni_atomic_get_bool(&p->closed) || aio == NULL) {
 		//pipe closed, should never gets here
@@ -441,9 +1340,36 @@ mqtt_send_msg(nni_aio *aio, mqtt_ctx_t *arg)
 	case NNG_MQTT_PUBLISH:
 		qos = nni_mqtt_msg_get_publish_qos(msg);
 		if (0 == qos) {
+			p = mqtt_stripe_pipe(s, msg);
 			break; // QoS 0 need no packet id
 		}
-		// FALLTHROUGH
+		// the msg stays with us until acked, the aio finishes then
+		nni_mqtt_msg_set_aio(msg, aio);
+		nni_aio_set_msg(aio, NULL);
+		if (mqtt_inflight_full(s)) {
+			// no free slot, wait for an ack, as long as there is
+			// room to hold it
+			if (nni_lmq_full(&s->held)) {
+				rv = NNG_EAGAIN;
+				goto fail;
+			}
+			nni_lmq_put(&s->held, msg);
+			SET_STAT(&s->stat_held, nni_lmq_len(&s->held));
+			nni_mtx_unlock(&s->mtx);
+			return;
+		}
+		stripe    = mqtt_stripe_home(s, msg);
+		packet_id = mqtt_inflight_next_id(s, stripe);
+		mqtt_inflight_set_id(msg, packet_id);
+		if ((rv = mqtt_inflight_add(s, stripe, packet_id, msg)) != 0) {
+			goto fail;
+		}
+		nni_aio_bump_count(
+		    aio, nni_msg_header_len(msg) + nni_msg_len(msg));
+		mqtt_inflight_send(s, stripe, msg);
+		nni_mtx_unlock(&s->mtx);
+		return;
+
 	case NNG_MQTT_SUBSCRIBE:
 	case NNG_MQTT_UNSUBSCRIBE:
 		nni_mqtt_msg_set_aio(msg, aio);
@@ -468,28 +1394,16 @@ mqtt_send_msg(nni_aio *aio, mqtt_ctx_t *arg)
 		nni_aio_finish_error(aio, NNG_EPROTO);
 		return;
 	}
-	if (!p->busy) {
-		p->busy = true;
-		nni_aio_set_msg(&p->send_aio, msg);
-		nni_aio_bump_count(
-		    aio, nni_msg_header_len(msg) + nni_msg_len(msg));
-		nni_pipe_send(p->pipe, &p->send_aio);
-		nni_mtx_unlock(&s->mtx);
-		if (0 == qos && ptype != NNG_MQTT_SUBSCRIBE &&
-		    ptype != NNG_MQTT_UNSUBSCRIBE) {
-			nni_aio_set_msg(aio, NULL);
-			nni_aio_finish(aio, 0, 0);
-		}
-		return;
-	}
-	if (nni_lmq_full(&p->send_messages)) {
-		log_error("rhack: pipe is busy and lmq is full\n");
-		(void) nni_lmq_get(&p->send_messages, &tmsg);
-		nni_msg_free(tmsg);
-	}
-	if (0 != nni_lmq_put(&p->send_messages, msg)) {
-		log_error("Warning! msg lost due to busy socket");
+	nni_aio_bump_count(aio, nni_msg_header_len(msg) + nni_msg_len(msg));
+	mqtt_pipe_send_msg(p, msg);
+	nni_mtx_unlock(&s->mtx);
+	if (0 == qos && ptype != NNG_MQTT_SUBSCRIBE &&
+	    ptype != NNG_MQTT_UNSUBSCRIBE) {
+		nni_aio_set_msg(aio, NULL);
+		nni_aio_finish(aio, 0, 0);
 	}
+	return;
+
 out:
 	nni_mtx_unlock(&s->mtx);
 	if (0 == qos && ptype != NNG_MQTT_SUBSCRIBE &&
@@ -497,6 +1411,12 @@ out:
 		nni_aio_finish(aio, 0, 0);
 	}
 	return;
+
+fail:
+	nni_mqtt_msg_set_aio(msg, NULL);
+	nni_aio_set_msg(aio, msg);
+	nni_mtx_unlock(&s->mtx);
+	nni_aio_finish_error(aio, rv);
 }
 
 static int
@@ -505,13 +1425,59 @@ mqtt_pipe_start(void *arg)
 	mqtt_pipe_t *p = arg;
 	mqtt_sock_t *s = p->mqtt_sock;
 	mqtt_ctx_t  *c = NULL;
+	uint16_t     i;
 
 	nni_mtx_lock(&s->mtx);
+	for (i = 0; i < s->stripe_cnt && s->stripes[i] != NULL; i++)
+		;
+	if (i == s->stripe_cnt) {
+		nni_mtx_unlock(&s->mtx);
+		log_warn("no stripe left for another connection");
+		return (NNG_EBUSY);
+	}
+	p->stripe     = i;
+	p->timeleft   = s->keepalive;
+	s->stripes[i] = p;
+	SET_STAT(&s->stat_stripes, mqtt_stripe_count(s));
 	nni_atomic_set_bool(&p->closed, false);
-	s->mqtt_pipe       = p;
+	if (s->mqtt_pipe == NULL) {
+		s->mqtt_pipe = p;
+	}
 	s->disconnect_code = SUCCESS;
 	s->dis_prop        = NULL;
 
+	// the server may take fewer QoS 1/2 msgs at once than we would
+	s->inflight_win = s->inflight_max;
+	if (s->mqtt_ver == MQTT_PROTOCOL_VERSION_v5) {
+		property      *prop = NULL;
+		property_data *data;
+		size_t         sz   = sizeof(prop);
+		if (nni_pipe_getopt(p->pipe, NNG_OPT_MQTT_CONNECT_PROPERTY,
+		        &prop, &sz, NNI_TYPE_POINTER) == 0 &&
+		    prop != NULL &&
+		    (data = property_get_value(prop, RECEIVE_MAXIMUM)) != NULL &&
+		    data->p_value.u16 != 0 &&
+		    data->p_value.u16 < s->inflight_win) {
+			s->inflight_win = data->p_value.u16;
+		}
+	}
+	// write queued msgs in batches if the transport can
+	p->batching = false;
+	if (p->batch_max > 0) {
+		bool   batching = false;
+		size_t sz       = sizeof(batching);
+		if (nni_pipe_getopt(p->pipe, NNG_OPT_MQTT_SEND_BATCH,
+		        &batching, &sz, NNI_TYPE_BOOL) == 0 &&
+		    batching) {
+			p->batching = true;
+			nni_aio_set_input(&p->send_aio, 0, &p->send_batch);
+		}
+	}
+
+	// unacknowledged msgs of the last connection of the stripe go first
+	mqtt_inflight_resend(s, p);
+	mqtt_inflight_release(s);
+
 	if ((c = nni_list_first(&s->send_queue)) != NULL) {
 		nni_list_remove(&s->send_queue, c);
 		nni_pipe_recv(p->pipe, &p->recv_aio);
@@ -535,6 +1501,7 @@ mqtt_pipe_stop(void *arg)
 	nni_aio_stop(&p->send_aio);
 	nni_aio_stop(&p->recv_aio);
 	nni_aio_stop(&p->time_aio);
+	nni_aio_stop(&p->delay_aio);
 }
 
 static int
@@ -543,20 +1510,75 @@ mqtt_pipe_close(void *arg)
 	mqtt_pipe_t *p = arg;
 	mqtt_sock_t *s = p->mqtt_sock;
 
+
 	nni_mtx_lock(&s->mtx);
 	nni_atomic_set_bool(&p->closed, true);
-	s->mqtt_pipe = NULL;
+#if defined(NNG_SUPP_SQLITE)
+	bool replays = mqtt_stripe_replays(s, p);
+#endif
+	if (s->stripes[p->stripe] == p) {
+		s->stripes[p->stripe] = NULL;
+		SET_STAT(&s->stat_stripes, mqtt_stripe_count(s));
+	}
+	if (s->mqtt_pipe == p) {
+		// hand other packets over to the next connection up
+		s->mqtt_pipe = NULL;
+		for (uint16_t i = 0; i < s->stripe_cnt; i++) {
+			if (s->stripes[i] != NULL) {
+				s->mqtt_pipe = s->stripes[i];
+				break;
+			}
+		}
+	}
 	nni_aio_close(&p->send_aio);
 	nni_aio_close(&p->recv_aio);
 	nni_aio_close(&p->time_aio);
+	nni_aio_close(&p->delay_aio);
+
+	// msgs of the batch the transport did not get to go back in front
+	// of the queue, to be cached or dropped along with it
+	if (!nni_lmq_empty(&p->send_batch)) {
+		size_t   n = nni_lmq_len(&p->send_messages);
+		nni_msg *msg;
+
+		if (nni_lmq_cap(&p->send_messages) <
+		    n + nni_lmq_len(&p->send_batch)) {
+			(void) nni_lmq_resize(&p->send_messages,
+			    n + nni_lmq_len(&p->send_batch));
+		}
+		while (nni_lmq_get(&p->send_batch, &msg) == 0) {
+			if (nni_lmq_put(&p->send_messages, msg) != 0) {
+				nni_msg_free(msg);
+			}
+		}
+		for (; n > 0; n--) {
+			(void) nni_lmq_get(&p->send_messages, &msg);
+			(void) nni_lmq_put(&p->send_messages, msg);
+		}
+	}
 
 #if defined(NNG_SUPP_SQLITE)
+	// unacknowledged msgs are resent from the inflight window, do not
+	// cache the copies still queued here
+	for (size_t n = nni_lmq_len(&p->send_messages); n > 0; n--) {
+		nni_msg *msg;
+		(void) nni_lmq_get(&p->send_messages, &msg);
+		if (mqtt_inflight_queued(s, p->stripe, msg)) {
+			nni_msg_free(msg);
+			continue;
+		}
+		(void) nni_lmq_put(&p->send_messages, msg);
+	}
 	// flush to disk
 	if (!nni_lmq_empty(&p->send_messages)) {
 		log_info("cached msg into sqlite");
 		sqlite_flush_lmq(
 		    mqtt_sock_get_sqlite_option(s), &p->send_messages);
 	}
+	// unsent cached msgs are read again after reconnecting
+	if (replays && sqlite_is_enabled(mqtt_sock_get_sqlite_option(s))) {
+		sqlite_replay_reset(mqtt_sock_get_sqlite_option(s));
+	}
 #endif
 
 	nni_lmq_flush(&p->send_messages);
@@ -632,12 +1654,12 @@ mqtt_timer_cb(void *arg)
 	}
 
 	// Update left time to send pingreq
-	s->timeleft -= s->retry;
+	p->timeleft -= s->retry;
 
 	if (!p->busy && !nni_aio_busy(&p->send_aio) && p->pingmsg &&
-			s->timeleft <= 0) {
+			p->timeleft <= 0) {
 		p->busy = true;
-		s->timeleft = s->keepalive;
+		p->timeleft = s->keepalive;
 		// send pingreq
 		nni_msg_clone(p->pingmsg);
 		nni_aio_set_msg(&p->send_aio, p->pingmsg);
@@ -679,7 +1701,7 @@ mqtt_timer_cb(void *arg)
 	// 	}
 	// }
 #if defined(NNG_SUPP_SQLITE)
-	if (!p->busy) {
+	if (!p->busy && mqtt_stripe_replays(s, p)) {
 		nni_msg     *msg = NULL;
 		nni_mqtt_sqlite_option *sqlite =
 		    mqtt_sock_get_sqlite_option(s);
@@ -687,7 +1709,7 @@ mqtt_timer_cb(void *arg)
 			if (!nni_lmq_empty(&sqlite->offline_cache)) {
 				sqlite_flush_offline_cache(sqlite);
 			}
-			if (NULL != (msg = sqlite_get_cache_msg(sqlite))) {
+			if (NULL != (msg = sqlite_replay_next(sqlite))) {
 				p->busy = true;
 				nni_aio_set_msg(&p->send_aio, msg);
 				nni_pipe_send(p->pipe, &p->send_aio);
@@ -709,7 +1731,6 @@ mqtt_send_cb(void *arg)
 	mqtt_pipe_t *p   = arg;
 	mqtt_sock_t *s   = p->mqtt_sock;
 	mqtt_ctx_t * c   = NULL;
-	nni_msg *    msg = NULL;
 	int          rv;
 
 	if ((rv = nni_aio_result(&p->send_aio)) != 0) {
@@ -724,7 +1745,14 @@ mqtt_send_cb(void *arg)
 	nni_mtx_lock(&s->mtx);
 
 	p->busy     = false;
-	s->timeleft = s->keepalive;
+	p->timeleft = s->keepalive;
+#if defined(NNG_SUPP_SQLITE)
+	nni_mqtt_sqlite_option *sqlite = mqtt_sock_get_sqlite_option(s);
+	if (sqlite_is_enabled(sqlite) && mqtt_stripe_replays(s, p)) {
+		// the cached msg just sent can leave the table now
+		sqlite_replay_done(sqlite, true);
+	}
+#endif
 	if (nni_atomic_get_bool(&s->closed) ||
 	    nni_atomic_get_bool(&p->closed)) {
 		// This occurs if the mqtt_pipe_close has been called.
@@ -740,19 +1768,66 @@ mqtt_send_cb(void *arg)
 		c->saio = NULL;
 		return;
 	}
-	if (nni_lmq_get(&p->send_messages, &msg) == 0) {
+#if defined(NNG_SUPP_SQLITE)
+	// keep resending cached msgs back to back, sharing the link with
+	// live msgs
+	nni_msg *msg = NULL;
+	if (sqlite_is_enabled(sqlite) && mqtt_stripe_replays(s, p) &&
+	    sqlite_replay_turn(sqlite, !nni_lmq_empty(&p->send_messages)) &&
+	    (msg = sqlite_replay_next(sqlite)) != NULL) {
 		p->busy = true;
 		nni_aio_set_msg(&p->send_aio, msg);
 		nni_pipe_send(p->pipe, &p->send_aio);
 		nni_mtx_unlock(&s->mtx);
 		return;
 	}
+#endif
+	if (mqtt_pipe_send_queued(p)) {
+		nni_mtx_unlock(&s->mtx);
+		return;
+	}
 
 	p->busy = false;
 	nni_mtx_unlock(&s->mtx);
 	return;
 }
 
+// The wait for more msgs to batch is over, write what was queued.
+static void
+mqtt_delay_cb(void *arg)
+{
+	mqtt_pipe_t *p = arg;
+	mqtt_sock_t *s = p->mqtt_sock;
+
+	if (nni_aio_result(&p->delay_aio) != 0) {
+		return;
+	}
+	nni_mtx_lock(&s->mtx);
+	if (nni_atomic_get_bool(&p->closed)) {
+		nni_mtx_unlock(&s->mtx);
+		return;
+	}
+	if (!mqtt_pipe_send_queued(p)) {
+		p->busy = false;
+	}
+	nni_mtx_unlock(&s->mtx);
+}
+
+// The window of the envelopes is over, send what they collected.
+static void
+mqtt_envelope_cb(void *arg)
+{
+	mqtt_sock_t *s = arg;
+
+	nni_mtx_lock(&s->mtx);
+	s->env_armed = false;
+	if (nni_aio_result(&s->env_aio) == 0 &&
+	    !nni_atomic_get_bool(&s->closed)) {
+		mqtt_envelope_flush(s);
+	}
+	nni_mtx_unlock(&s->mtx);
+}
+
 static void
 mqtt_recv_cb(void *arg)
 {
@@ -877,7 +1952,7 @@ mqtt_recv_cb(void *arg)
 
 			// Set keepalive
 			s->keepalive = conn_param_get_keepalive(p->cparam) * 1000;
-			s->timeleft  = s->keepalive;
+			p->timeleft  = s->keepalive;
 
 			rv = nng_pipe_get_addr(
 			    nng_pipe, NNG_OPT_REMADDR, &addr);
@@ -933,7 +2008,13 @@ mqtt_recv_cb(void *arg)
 		// FALLTHROUGH
 	case NNG_MQTT_PUBCOMP:
 		// we have received a PUBCOMP, successful delivery of a QoS 2
-		// FALLTHROUGH
+		packet_id = nni_mqtt_msg_get_packet_id(msg);
+		p->rid ++;
+		user_aio = mqtt_inflight_ack(s, p->stripe, packet_id);
+		mqtt_inflight_release(s);
+		nni_msg_free(msg);
+		break;
+
 	case NNG_MQTT_SUBACK:
 		// we have received a SUBACK, successful subscription
 		// FALLTHROUGH
@@ -960,6 +2041,9 @@ mqtt_recv_cb(void *arg)
 		return;
 
 	case NNG_MQTT_PUBREC:
+		// the transport replied PUBREL already
+		packet_id = nni_mqtt_msg_get_pubrec_packet_id(msg);
+		mqtt_inflight_pubrel(s, p->stripe, packet_id);
 		nni_msg_free(msg);
 		break;
 
@@ -1152,12 +2236,21 @@ mqtt_ctx_send(void *arg, nni_aio *aio)
 	case NNG_MQTT_PUBLISH:
 		qos = nni_mqtt_msg_get_publish_qos(msg);
 		if (qos == 0) {
+			if (s->envelope.enable && mqtt_envelope_put(s, msg) == 0) {
+				// copied into the envelope
+				nni_mtx_unlock(&s->mtx);
+				nni_msg_free(msg);
+				nni_aio_set_msg(aio, NULL);
+				nni_aio_finish(aio, 0, 0);
+				return;
+			}
 			break;
 		}
-		// fall through
+		// QoS 1/2 get their packet id when they enter the window
+		break;
 	case NNG_MQTT_SUBSCRIBE:
 	case NNG_MQTT_UNSUBSCRIBE:
-		packet_id = mqtt_get_next_packet_id(&s->next_packet_id);
+		packet_id = mqtt_inflight_next_id(s, NNG_MQTT_MAX_STRIPES);
 		nni_mqtt_msg_set_packet_id(msg, packet_id);
 		break;
 	default:
@@ -1244,12 +2337,17 @@ mqtt_ctx_recv(void *arg, nni_aio *aio)
 		return;
 	}
 
-	if (nni_lmq_get(&p->recv_messages, &msg) == 0) {
-		nni_aio_set_msg(aio, msg);
-		nni_mtx_unlock(&s->mtx);
-		// let user gets a quick reply
-		nni_aio_finish(aio, 0, nni_msg_len(msg));
-		return;
+	// take turns among the connections so none of them starves
+	for (uint16_t i = 0; i < s->stripe_cnt; i++) {
+		p            = s->stripes[s->recv_next];
+		s->recv_next = (s->recv_next + 1) % s->stripe_cnt;
+		if (p != NULL && nni_lmq_get(&p->recv_messages, &msg) == 0) {
+			nni_aio_set_msg(aio, msg);
+			nni_mtx_unlock(&s->mtx);
+			// let user gets a quick reply
+			nni_aio_finish(aio, 0, nni_msg_len(msg));
+			return;
+		}
 	}
 
 	// no open pipe or msg waiting
@@ -1307,6 +2405,34 @@ static nni_option mqtt_sock_options[] = {
 	    .o_name = NNG_OPT_MQTT_SQLITE,
 	    .o_set  = mqtt_sock_set_sqlite_option,
 	},
+	{
+	    .o_name = NNG_OPT_MQTT_INFLIGHT_WINDOW,
+	    .o_get  = mqtt_sock_get_inflight_window,
+	    .o_set  = mqtt_sock_set_inflight_window,
+	},
+	{
+	    .o_name = NNG_OPT_MQTT_INFLIGHT,
+	    .o_get  = mqtt_sock_get_inflight,
+	},
+	{
+	    .o_name = NNG_OPT_MQTT_STRIPES,
+	    .o_get  = mqtt_sock_get_stripes,
+	    .o_set  = mqtt_sock_set_stripes,
+	},
+	{
+	    .o_name = NNG_OPT_MQTT_ENVELOPE,
+	    .o_set  = mqtt_sock_set_envelope,
+	},
+	{
+	    .o_name = NNG_OPT_MQTT_SEND_BATCH,
+	    .o_get  = mqtt_sock_get_send_batch,
+	    .o_set  = mqtt_sock_set_send_batch,
+	},
+	{
+	    .o_name = NNG_OPT_MQTT_SEND_DELAY,
+	    .o_get  = mqtt_sock_get_send_delay,
+	    .o_set  = mqtt_sock_set_send_delay,
+	},
 	// terminate list
 	{
 	    .o_name = NULL,
@@ -0,0 +1,410 @@
+//
+// Copyright 2024 NanoMQ Team, Inc. <jaylin@emqx.io>
+//
+// This software is supplied under the terms of the MIT License, a
+// copy of which should be located in the distribution where this
+// file was obtained (LICENSE.txt).  A copy of the license may also be
+// found online at https://opensource.org/licenses/MIT.
+//
+
+#include <string.h>
+
+#include <nng/mqtt/mqtt_client.h>
+#include <nng/nng.h>
+#include <nng/supplemental/util/platform.h>
+
+#include <nuts.h>
+
+// The tests below script the server side of the connection over a plain
+// TCP stream, so they decide when acks are sent.
+
+typedef struct {
+	nng_stream_listener *l;
+	nng_stream          *s;
+	nng_aio             *aio;
+	char                 url[64];
+} fake_server;
+
+static void
+fake_open(fake_server *fs)
+{
+	nng_sockaddr sa;
+	size_t       sz = sizeof(sa);
+
+	NUTS_PASS(nng_stream_listener_alloc(&fs->l, "tcp://127.0.0.1:0"));
+	NUTS_PASS(nng_stream_listener_listen(fs->l));
+	NUTS_PASS(nng_stream_listener_get(fs->l, NNG_OPT_LOCADDR, &sa, &sz));
+	(void) snprintf(fs->url, sizeof(fs->url), "mqtt-tcp://127.0.0.1:%d",
+	    nuts_be16(sa.s_in.sa_port));
+	NUTS_PASS(nng_aio_alloc(&fs->aio, NULL, NULL));
+	nng_aio_set_timeout(fs->aio, 5000);
+	fs->s = NULL;
+}
+
+static void
+fake_close(fake_server *fs)
+{
+	if (fs->s != NULL) {
+		nng_stream_free(fs->s);
+	}
+	nng_stream_listener_free(fs->l);
+	nng_aio_free(fs->aio);
+}
+
+static int
+fake_io(fake_server *fs, uint8_t *buf, size_t len, bool out)
+{
+	nng_iov iov;
+	int     rv;
+
+	while (len > 0) {
+		iov.iov_buf = buf;
+		iov.iov_len = len;
+		NUTS_PASS(nng_aio_set_iov(fs->aio, 1, &iov));
+		if (out) {
+			nng_stream_send(fs->s, fs->aio);
+		} else {
+			nng_stream_recv(fs->s, fs->aio);
+		}
+		nng_aio_wait(fs->aio);
+		if ((rv = nng_aio_result(fs->aio)) != 0) {
+			return (rv);
+		}
+		buf += nng_aio_count(fs->aio);
+		len -= nng_aio_count(fs->aio);
+	}
+	return (0);
+}
+
+// Read a whole packet, returns its fixed header byte.
+static int
+fake_read(fake_server *fs, uint8_t *body, size_t *lenp, uint8_t *hdr)
+{
+	uint8_t  b;
+	uint32_t len   = 0;
+	int      shift = 0;
+	int      rv;
+
+	if ((rv = fake_io(fs, hdr, 1, false)) != 0) {
+		return (rv);
+	}
+	do {
+		NUTS_PASS(fake_io(fs, &b, 1, false));
+		len |= (uint32_t) (b & 0x7f) << shift;
+		shift += 7;
+	} while ((b & 0x80) != 0);
+	NUTS_TRUE(len <= *lenp);
+	*lenp = len;
+	return (fake_io(fs, body, len, false));
+}
+
+// Read a QoS 1/2 PUBLISH, returns its packet id.
+static uint16_t
+fake_read_publish(fake_server *fs, uint8_t *hdr)
+{
+	uint8_t  body[256];
+	size_t   len = sizeof(body);
+	uint16_t tlen;
+
+	NUTS_PASS(fake_read(fs, body, &len, hdr));
+	NUTS_TRUE((*hdr & 0xf0) == 0x30);
+	tlen = (uint16_t) ((body[0] << 8) | body[1]);
+	return ((uint16_t) ((body[2 + tlen] << 8) | body[3 + tlen]));
+}
+
+static void
+fake_write_ack(fake_server *fs, uint8_t type, uint16_t id)
+{
+	uint8_t ack[4];
+
+	ack[0] = type;
+	ack[1] = 2;
+	ack[2] = (uint8_t) (id >> 8);
+	ack[3] = (uint8_t) (id & 0xff);
+	NUTS_PASS(fake_io(fs, ack, sizeof(ack), true));
+}
+
+// Accept the connection of the client and take its CONNECT.
+static void
+fake_accept(fake_server *fs)
+{
+	uint8_t connack[] = { 0x20, 0x02, 0x00, 0x00 };
+	uint8_t body[256];
+	size_t  len = sizeof(body);
+	uint8_t hdr;
+
+	if (fs->s != NULL) {
+		nng_stream_free(fs->s);
+	}
+	nng_stream_listener_accept(fs->l, fs->aio);
+	nng_aio_wait(fs->aio);
+	NUTS_PASS(nng_aio_result(fs->aio));
+	fs->s = nng_aio_get_output(fs->aio, 0);
+	NUTS_PASS(fake_read(fs, body, &len, &hdr));
+	NUTS_TRUE(hdr == 0x10);
+	NUTS_PASS(fake_io(fs, connack, sizeof(connack), true));
+}
+
+// Nothing more is sent by the client for a while.
+static void
+fake_quiet(fake_server *fs)
+{
+	uint8_t hdr;
+	nng_iov iov;
+
+	iov.iov_buf = &hdr;
+	iov.iov_len = 1;
+	nng_aio_set_timeout(fs->aio, 100);
+	NUTS_PASS(nng_aio_set_iov(fs->aio, 1, &iov));
+	nng_stream_recv(fs->s, fs->aio);
+	nng_aio_wait(fs->aio);
+	NUTS_FAIL(nng_aio_result(fs->aio), NNG_ETIMEDOUT);
+	nng_aio_set_timeout(fs->aio, 5000);
+}
+
+static void
+client_open(nng_socket *sock, nng_dialer *d, fake_server *fs, int window)
+{
+	nng_msg *connmsg;
+
+	NUTS_PASS(nng_mqtt_client_open(sock));
+	NUTS_PASS(nng_socket_set_int(
+	    *sock, NNG_OPT_MQTT_INFLIGHT_WINDOW, window));
+	NUTS_PASS(nng_mqtt_msg_alloc(&connmsg, 0));
+	nng_mqtt_msg_set_packet_type(connmsg, NNG_MQTT_CONNECT);
+	nng_mqtt_msg_set_connect_proto_version(connmsg, 4);
+	nng_mqtt_msg_set_connect_keep_alive(connmsg, 60);
+	nng_mqtt_msg_set_connect_client_id(connmsg, "inflight");
+	nng_mqtt_msg_set_connect_clean_session(connmsg, false);
+	NUTS_PASS(nng_dialer_create(d, *sock, fs->url));
+	NUTS_PASS(nng_dialer_set_ptr(*d, NNG_OPT_MQTT_CONNMSG, connmsg));
+	NUTS_PASS(nng_dialer_set_ms(*d, NNG_OPT_RECONNMINT, 10));
+	NUTS_PASS(nng_dialer_set_ms(*d, NNG_OPT_RECONNMAXT, 10));
+	NUTS_PASS(nng_dialer_start(*d, NNG_FLAG_NONBLOCK));
+	fake_accept(fs);
+	nng_msleep(50); // let the client take the CONNACK
+}
+
+static void
+client_publish(nng_socket sock, nng_aio *aio, uint8_t qos)
+{
+	nng_msg *msg;
+
+	NUTS_PASS(nng_mqtt_msg_alloc(&msg, 0));
+	nng_mqtt_msg_set_packet_type(msg, NNG_MQTT_PUBLISH);
+	nng_mqtt_msg_set_publish_qos(msg, qos);
+	nng_mqtt_msg_set_publish_topic(msg, "inflight");
+	nng_mqtt_msg_set_publish_payload(msg, (uint8_t *) "data", 4);
+	nng_aio_set_msg(aio, msg);
+	nng_send_aio(sock, aio);
+}
+
+static int
+client_inflight(nng_socket sock)
+{
+	int cnt;
+
+	NUTS_PASS(nng_socket_get_int(sock, NNG_OPT_MQTT_INFLIGHT, &cnt));
+	return (cnt);
+}
+
+void
+test_inflight_window(void)
+{
+	fake_server fs;
+	nng_socket  sock;
+	nng_dialer  d;
+	nng_aio    *aio[3];
+	uint16_t    id[3];
+	uint8_t     hdr;
+
+	fake_open(&fs);
+	client_open(&sock, &d, &fs, 2);
+	for (int i = 0; i < 3; i++) {
+		NUTS_PASS(nng_aio_alloc(&aio[i], NULL, NULL));
+		client_publish(sock, aio[i], 1);
+	}
+
+	// only the window goes out, the last one is held
+	id[0] = fake_read_publish(&fs, &hdr);
+	id[1] = fake_read_publish(&fs, &hdr);
+	NUTS_TRUE(id[0] != id[1]);
+	fake_quiet(&fs);
+	NUTS_TRUE(client_inflight(sock) == 2);
+	NUTS_TRUE(nng_aio_busy(aio[0]));
+
+	// an ack finishes its sender and frees the slot for the held one
+	fake_write_ack(&fs, 0x40, id[0]);
+	nng_aio_wait(aio[0]);
+	NUTS_PASS(nng_aio_result(aio[0]));
+	id[2] = fake_read_publish(&fs, &hdr);
+	NUTS_TRUE(hdr == 0x32);
+	NUTS_TRUE(id[2] != id[1]);
+	NUTS_TRUE(nng_aio_busy(aio[1]));
+	NUTS_TRUE(nng_aio_busy(aio[2]));
+
+	fake_write_ack(&fs, 0x40, id[1]);
+	fake_write_ack(&fs, 0x40, id[2]);
+	nng_aio_wait(aio[1]);
+	nng_aio_wait(aio[2]);
+	NUTS_PASS(nng_aio_result(aio[1]));
+	NUTS_PASS(nng_aio_result(aio[2]));
+	NUTS_TRUE(client_inflight(sock) == 0);
+
+	NUTS_CLOSE(sock);
+	for (int i = 0; i < 3; i++) {
+		nng_aio_free(aio[i]);
+	}
+	fake_close(&fs);
+}
+
+void
+test_inflight_qos2(void)
+{
+	fake_server fs;
+	nng_socket  sock;
+	nng_dialer  d;
+	nng_aio    *aio[2];
+	uint16_t    id[2];
+	uint8_t     body[16];
+	size_t      len = sizeof(body);
+	uint8_t     hdr;
+
+	fake_open(&fs);
+	client_open(&sock, &d, &fs, 1);
+	for (int i = 0; i < 2; i++) {
+		NUTS_PASS(nng_aio_alloc(&aio[i], NULL, NULL));
+		client_publish(sock, aio[i], 2);
+	}
+	id[0] = fake_read_publish(&fs, &hdr);
+	NUTS_TRUE(hdr == 0x34);
+
+	// the PUBREC is answered by a PUBREL, which keeps the slot
+	fake_write_ack(&fs, 0x50, id[0]);
+	NUTS_PASS(fake_read(&fs, body, &len, &hdr));
+	NUTS_TRUE(hdr == 0x62);
+	NUTS_TRUE(len == 2);
+	NUTS_TRUE(((body[0] << 8) | body[1]) == id[0]);
+	fake_quiet(&fs);
+	NUTS_TRUE(nng_aio_busy(aio[0]));
+	NUTS_TRUE(client_inflight(sock) == 1);
+
+	// the PUBCOMP ends it
+	fake_write_ack(&fs, 0x70, id[0]);
+	nng_aio_wait(aio[0]);
+	NUTS_PASS(nng_aio_result(aio[0]));
+	id[1] = fake_read_publish(&fs, &hdr);
+	NUTS_TRUE(id[1] != id[0]);
+	fake_write_ack(&fs, 0x50, id[1]);
+	len = sizeof(body);
+	NUTS_PASS(fake_read(&fs, body, &len, &hdr));
+	NUTS_TRUE(hdr == 0x62);
+	fake_write_ack(&fs, 0x70, id[1]);
+	nng_aio_wait(aio[1]);
+	NUTS_PASS(nng_aio_result(aio[1]));
+	NUTS_TRUE(client_inflight(sock) == 0);
+
+	NUTS_CLOSE(sock);
+	for (int i = 0; i < 2; i++) {
+		nng_aio_free(aio[i]);
+	}
+	fake_close(&fs);
+}
+
+void
+test_inflight_resend(void)
+{
+	fake_server fs;
+	nng_socket  sock;
+	nng_dialer  d;
+	nng_aio    *aio[3];
+	uint16_t    id[3];
+	uint8_t     body[16];
+	size_t      len = sizeof(body);
+	uint8_t     hdr;
+
+	fake_open(&fs);
+	client_open(&sock, &d, &fs, 4);
+	for (int i = 0; i < 3; i++) {
+		NUTS_PASS(nng_aio_alloc(&aio[i], NULL, NULL));
+		client_publish(sock, aio[i], i == 2 ? 2 : 1);
+	}
+	for (int i = 0; i < 3; i++) {
+		id[i] = fake_read_publish(&fs, &hdr);
+		NUTS_TRUE((hdr & 0x08) == 0);
+	}
+	fake_write_ack(&fs, 0x50, id[2]);
+	NUTS_PASS(fake_read(&fs, body, &len, &hdr));
+	NUTS_TRUE(hdr == 0x62);
+
+	// drop the connection, all of them come again on the next one
+	nng_stream_close(fs.s);
+	fake_accept(&fs);
+	for (int i = 0; i < 2; i++) {
+		NUTS_TRUE(fake_read_publish(&fs, &hdr) == id[i]);
+		NUTS_TRUE(hdr == 0x3a);
+	}
+	len = sizeof(body);
+	NUTS_PASS(fake_read(&fs, body, &len, &hdr));
+	NUTS_TRUE(hdr == 0x62);
+	NUTS_TRUE(((body[0] << 8) | body[1]) == id[2]);
+	NUTS_TRUE(nng_aio_busy(aio[0]));
+
+	fake_write_ack(&fs, 0x40, id[0]);
+	fake_write_ack(&fs, 0x40, id[1]);
+	fake_write_ack(&fs, 0x70, id[2]);
+	for (int i = 0; i < 3; i++) {
+		nng_aio_wait(aio[i]);
+		NUTS_PASS(nng_aio_result(aio[i]));
+	}
+	NUTS_TRUE(client_inflight(sock) == 0);
+
+	NUTS_CLOSE(sock);
+	for (int i = 0; i < 3; i++) {
+		nng_aio_free(aio[i]);
+	}
+	fake_close(&fs);
+}
+
+#define HELD_MAX 1024
+
+void
+test_inflight_held_bound(void)
+{
+	fake_server fs;
+	nng_socket  sock;
+	nng_dialer  d;
+	nng_aio    *aio[HELD_MAX + 2];
+	uint8_t     hdr;
+
+	fake_open(&fs);
+	client_open(&sock, &d, &fs, 1);
+	for (int i = 0; i < HELD_MAX + 2; i++) {
+		NUTS_PASS(nng_aio_alloc(&aio[i], NULL, NULL));
+		client_publish(sock, aio[i], 1);
+	}
+	(void) fake_read_publish(&fs, &hdr);
+
+	// one in the window, the next ones held up to the bound
+	nng_aio_wait(aio[HELD_MAX + 1]);
+	NUTS_FAIL(nng_aio_result(aio[HELD_MAX + 1]), NNG_EAGAIN);
+	nng_msg_free(nng_aio_get_msg(aio[HELD_MAX + 1]));
+	for (int i = 0; i < HELD_MAX + 1; i++) {
+		NUTS_TRUE(nng_aio_busy(aio[i]));
+	}
+
+	NUTS_CLOSE(sock);
+	for (int i = 0; i < HELD_MAX + 2; i++) {
+		nng_aio_wait(aio[i]);
+		nng_aio_free(aio[i]);
+	}
+	fake_close(&fs);
+}
+
+NUTS_TESTS = {
+	{ "inflight window", test_inflight_window },
+	{ "inflight qos2", test_inflight_qos2 },
+	{ "inflight resend", test_inflight_resend },
+	{ "inflight held bound", test_inflight_held_bound },
+	{ NULL, NULL },
+};
@@ -1401,7 +1401,7 @@ quic_mqtt_stream_bind(mqtt_sock_t *s, mqtt_pipe_t *p, nni_pipe *npipe)
 		for (uint32_t i = 0; i < count; i++) {
 			// Sub on same topic twice gonna replace old pipe with
 			// new This may result in potentioal memleak
-			hash = DJBHashn((char *) topics[i].topic.buf,
+			hash = nano_hashn((char *) topics[i].topic.buf,
 			    topics[i].topic.length);
 			if (nni_id_set(s->sub_streams, hash, p) != 0) {
 				log_error("Error in setting sub streams.");
@@ -1419,7 +1419,7 @@ quic_mqtt_stream_bind(mqtt_sock_t *s, mqtt_pipe_t *p, nni_pipe *npipe)
 		uint32_t topic_len;
 		char    *topic =
 		    (char *) nni_mqtt_msg_get_publish_topic(msg, &topic_len);
-		hash = DJBHashn(topic, topic_len);
+		hash = nano_hashn(topic, topic_len);
 		if (nni_id_set(s->pub_streams, hash, p) != 0) {
 			log_error("Error in setting sub streams.");
 			return -1;
@@ -1790,7 +1790,7 @@ quic_mqtt_pipe_close(void *arg)
 				// pipe with new This may result in potentioal
 				// memleak
 				nni_id_remove(s->sub_streams,
-				    DJBHashn((char *) topics[i].topic.buf,
+				    nano_hashn((char *) topics[i].topic.buf,
 				        topics[i].topic.length));
 			}
 			nni_msg_free(p->idmsg);
@@ -1800,7 +1800,7 @@ quic_mqtt_pipe_close(void *arg)
 			char *topic = (char *) nni_mqtt_msg_get_publish_topic(
 			    p->idmsg, &topic_len);
 			nni_id_remove(
-			    s->sub_streams, DJBHashn(topic, topic_len));
+			    s->sub_streams, nano_hashn(topic, topic_len));
 			nni_msg_free(p->idmsg);
 		}
 	}
@@ -1958,7 +1958,7 @@ mqtt_quic_ctx_send(void *arg, nni_aio *aio)
 			uint32_t     topic_len;
 			char *       topic = (char *) nni_mqtt_msg_get_publish_topic(msg, &topic_len);
 			mqtt_pipe_t *pub_pipe;
-			uint32_t     hash = DJBHashn(topic, topic_len);
+			uint32_t     hash = nano_hashn(topic, topic_len);
 			pub_pipe = nni_id_get(s->pub_streams, hash);
 			// check if pub stream already exist
 			if (pub_pipe == NULL) {
@@ -521,6 +521,10 @@ mqtt_pipe_close(void *arg)
 		sqlite_flush_lmq(
 		    mqtt_sock_get_sqlite_option(s), &p->send_messages);
 	}
+	// unsent cached msgs are read again after reconnecting
+	if (sqlite_is_enabled(mqtt_sock_get_sqlite_option(s))) {
+		sqlite_replay_reset(mqtt_sock_get_sqlite_option(s));
+	}
 #endif
 
 	nni_lmq_flush(&p->send_messages);
@@ -646,7 +650,7 @@ mqtt_timer_cb(void *arg)
 			if (!nni_lmq_empty(&sqlite->offline_cache)) {
 				sqlite_flush_offline_cache(sqlite);
 			}
-			if (NULL != (msg = sqlite_get_cache_msg(sqlite))) {
+			if (NULL != (msg = sqlite_replay_next(sqlite))) {
 				p->busy = true;
 				nni_aio_set_msg(&p->send_aio, msg);
 				nni_pipe_send(p->pipe, &p->send_aio);
@@ -684,6 +688,13 @@ mqtt_send_cb(void *arg)
 
 	p->busy     = false;
 	s->timeleft = s->keepalive;
+#if defined(NNG_SUPP_SQLITE)
+	nni_mqtt_sqlite_option *sqlite = mqtt_sock_get_sqlite_option(s);
+	if (sqlite_is_enabled(sqlite)) {
+		// the cached msg just sent can leave the table now
+		sqlite_replay_done(sqlite, true);
+	}
+#endif
 	if (nni_atomic_get_bool(&s->closed) ||
 	    nni_atomic_get_bool(&p->closed)) {
 		// This occurs if the mqtt_pipe_close has been called.
@@ -700,6 +711,19 @@ mqtt_send_cb(void *arg)
 		return;
 	}
 
+#if defined(NNG_SUPP_SQLITE)
+	// keep resending cached msgs back to back, sharing the link with
+	// live msgs
+	if (sqlite_is_enabled(sqlite) &&
+	    sqlite_replay_turn(sqlite, !nni_lmq_empty(&p->send_messages)) &&
+	    (msg = sqlite_replay_next(sqlite)) != NULL) {
+		p->busy = true;
+		nni_aio_set_msg(&p->send_aio, msg);
+		nni_pipe_send(p->pipe, &p->send_aio);
+		nni_mtx_unlock(&s->mtx);
+		return;
+	}
+#endif
 	if (nni_lmq_get(&p->send_messages, &msg) == 0) {
 		p->busy = true;
 		nni_aio_set_msg(&p->send_aio, msg);
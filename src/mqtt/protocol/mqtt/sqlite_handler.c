@@ -13,21 +13,137 @@ sqlite_is_enabled(nni_mqtt_sqlite_option *sqlite)
 	return false;
 }
 
+// Deletes the rows sent so far in one transaction
+static void
+sqlite_replay_flush(nni_mqtt_sqlite_option *sqlite)
+{
+	nni_mqtt_replay *r = &sqlite->replay;
+
+	if (r->nacked > 0) {
+		nni_mqtt_qos_db_remove_client_offline_msg_batch(
+		    sqlite->db, r->acked, r->nacked);
+		r->nacked = 0;
+	}
+}
+
+static void
+sqlite_replay_ack(nni_mqtt_sqlite_option *sqlite, int64_t row_id)
+{
+	nni_mqtt_replay *r = &sqlite->replay;
+
+	r->acked[r->nacked++] = row_id;
+	if (r->nacked == r->batch) {
+		sqlite_replay_flush(sqlite);
+	}
+}
+
+// Takes the next message of the window, reading the next batch from the
+// table once the window is used up.
+static nni_msg *
+sqlite_replay_pop(nni_mqtt_sqlite_option *sqlite, int64_t *row_id)
+{
+	nni_mqtt_replay *r = &sqlite->replay;
+	nni_msg         *msg;
+
+	if (r->len == 0) {
+		sqlite_replay_flush(sqlite);
+		if (r->cap == 0 || r->drained) {
+			return NULL;
+		}
+		r->head    = 0;
+		r->len     = nni_mqtt_qos_db_get_client_offline_msg_batch(
+		    sqlite->db, &r->cursor, sqlite->bridge->name, r->msgs,
+		    r->rows, r->cap);
+		r->drained = r->len == 0;
+		if (r->len == 0) {
+			return NULL;
+		}
+	}
+	msg     = r->msgs[r->head];
+	*row_id = r->rows[r->head];
+	r->head++;
+	r->len--;
+	return msg;
+}
+
+// The row is taken as sent as soon as it is read, for callers which
+// cannot tell when the message goes out.
 inline nni_msg *
 sqlite_get_cache_msg(nni_mqtt_sqlite_option *sqlite)
 {
 	nni_msg *msg    = NULL;
 	int64_t  row_id = 0;
 
-	msg = nni_mqtt_qos_db_get_client_offline_msg(
-	    sqlite->db, &row_id, sqlite->bridge->name);
-	if (msg != NULL) {
-		nni_mqtt_qos_db_remove_client_offline_msg(sqlite->db, row_id);
+	if ((msg = sqlite_replay_pop(sqlite, &row_id)) != NULL) {
+		sqlite_replay_ack(sqlite, row_id);
 	}
 
 	return msg;
 }
 
+// Like sqlite_get_cache_msg, but the row stays in the table until
+// sqlite_replay_done reports the message sent.
+inline nni_msg *
+sqlite_replay_next(nni_mqtt_sqlite_option *sqlite)
+{
+	nni_mqtt_replay *r      = &sqlite->replay;
+	nni_msg         *msg    = NULL;
+	int64_t          row_id = 0;
+
+	if ((msg = sqlite_replay_pop(sqlite, &row_id)) != NULL) {
+		r->inflight = row_id;
+	}
+	return msg;
+}
+
+inline void
+sqlite_replay_done(nni_mqtt_sqlite_option *sqlite, bool sent)
+{
+	nni_mqtt_replay *r = &sqlite->replay;
+
+	if (r->inflight != 0) {
+		if (sent) {
+			sqlite_replay_ack(sqlite, r->inflight);
+		}
+		r->inflight = 0;
+	}
+}
+
+// Whether the next send goes to cached messages rather than live ones.
+// Live messages keep replay_live_share percent of the sends while both
+// are waiting.
+inline bool
+sqlite_replay_turn(nni_mqtt_sqlite_option *sqlite, bool live_pending)
+{
+	nni_mqtt_replay *r = &sqlite->replay;
+
+	if (r->len == 0 && r->drained) {
+		return false;
+	}
+	if (!live_pending) {
+		return true;
+	}
+	r->turn = (r->turn + 1) % 100;
+	return r->turn >= r->live_share;
+}
+
+// Drops the window when the connection is lost, rows not sent yet are
+// read again after reconnecting.
+inline void
+sqlite_replay_reset(nni_mqtt_sqlite_option *sqlite)
+{
+	nni_mqtt_replay *r = &sqlite->replay;
+
+	sqlite_replay_flush(sqlite);
+	for (; r->len > 0; r->len--) {
+		nni_msg_free(r->msgs[r->head++]);
+	}
+	r->head     = 0;
+	r->cursor   = 0;
+	r->inflight = 0;
+	r->drained  = false;
+}
+
 inline void
 sqlite_flush_lmq(nni_mqtt_sqlite_option *sqlite, nni_lmq *lmq)
 {
@@ -37,6 +153,7 @@ sqlite_flush_lmq(nni_mqtt_sqlite_option *sqlite, nni_lmq *lmq)
 		nni_mqtt_qos_db_remove_oldest_client_offline_msg(sqlite->db,
 		    sqlite->bridge->sqlite->disk_cache_size,
 		    sqlite->bridge->name);
+		sqlite->replay.drained = false;
 	}
 }
 
@@ -62,6 +179,34 @@ sqlite_get_cache_msg(nni_mqtt_sqlite_option *sqlite)
 	return NULL;
 }
 
+inline nni_msg *
+sqlite_replay_next(nni_mqtt_sqlite_option *sqlite)
+{
+	NNI_ARG_UNUSED(sqlite);
+	return NULL;
+}
+
+inline void
+sqlite_replay_done(nni_mqtt_sqlite_option *sqlite, bool sent)
+{
+	NNI_ARG_UNUSED(sqlite);
+	NNI_ARG_UNUSED(sent);
+}
+
+inline bool
+sqlite_replay_turn(nni_mqtt_sqlite_option *sqlite, bool live_pending)
+{
+	NNI_ARG_UNUSED(sqlite);
+	NNI_ARG_UNUSED(live_pending);
+	return false;
+}
+
+inline void
+sqlite_replay_reset(nni_mqtt_sqlite_option *sqlite)
+{
+	NNI_ARG_UNUSED(sqlite);
+}
+
 inline void
 sqlite_flush_offline_cache(nni_mqtt_sqlite_option *sqlite)
 {
@@ -7,6 +7,10 @@
 
 extern bool     sqlite_is_enabled(nni_mqtt_sqlite_option *);
 extern nni_msg *sqlite_get_cache_msg(nni_mqtt_sqlite_option *);
+extern nni_msg *sqlite_replay_next(nni_mqtt_sqlite_option *);
+extern void     sqlite_replay_done(nni_mqtt_sqlite_option *, bool);
+extern bool     sqlite_replay_turn(nni_mqtt_sqlite_option *, bool);
+extern void     sqlite_replay_reset(nni_mqtt_sqlite_option *);
 extern void     sqlite_flush_lmq(nni_mqtt_sqlite_option *, nni_lmq *);
 extern void     sqlite_flush_offline_cache(nni_mqtt_sqlite_option *);
 
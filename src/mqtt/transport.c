@@ -58,6 +58,9 @@ extern void nni_mqtts_tcp_register();
 #ifdef NNG_TRANSPORT_MQTT_QUIC
 extern void nni_mqtt_quic_register();
 #endif
+#ifdef NNG_TRANSPORT_MQTT_BROKER_INPROC
+extern void nni_mqtt_inproc_register(void);
+#endif
 
 void
 nni_mqtt_tran_sys_init(void)
@@ -74,6 +77,9 @@ nni_mqtt_tran_sys_init(void)
 #ifdef NNG_TRANSPORT_MQTT_QUIC
 	nni_mqtt_quic_register();
 #endif
+#ifdef NNG_TRANSPORT_MQTT_BROKER_INPROC
+	nni_mqtt_inproc_register();
+#endif
 }
 
 // nni_mqtt_tran_sys_fini finalizes the entire transport system, including all
@@ -17,6 +17,10 @@
 #include "supplemental/mqtt/mqtt_msg.h"
 #include "nng/protocol/mqtt/mqtt_parser.h"
 
+// Small msgs of a batch are copied into a buffer of this size, to go out
+// with a single writev.
+#define MQTT_TCPTRAN_TXBUF 16384
+
 // TCP transport.   Platform specific TCP operations must be
 // supplied as well.
 
@@ -47,6 +51,10 @@ struct mqtt_tcptran_pipe {
 	nni_list         recvq;
 	nni_list         sendq;
 	nni_aio         *txaio;
+	uint8_t         *txbuf;   // msgs of a batch copied for one writev
+	nni_msg         *txmsg;   // msg of a batch too large to copy
+	nni_msg         *txcarry; // msg of a batch left for the next round
+	size_t           txsize;  // bytes of the current send
 	nni_aio         *rxaio;
 	nni_aio         *negoaio;
 	nni_aio         *rpaio;
@@ -93,6 +101,8 @@ struct mqtt_tcptran_ep {
 };
 
 static void mqtt_tcptran_pipe_send_start(mqtt_tcptran_pipe *);
+static bool mqtt_tcptran_pipe_send_round(
+    mqtt_tcptran_pipe *, nni_lmq *, nni_iov *, unsigned *);
 static void mqtt_tcptran_pipe_recv_start(mqtt_tcptran_pipe *);
 static void mqtt_tcptran_pipe_send_cb(void *);
 static void mqtt_tcptran_pipe_recv_cb(void *);
@@ -189,6 +199,11 @@ mqtt_tcptran_pipe_fini(void *arg)
 	nni_aio_free(p->rpaio);
 	nng_stream_free(p->conn);
 	nni_msg_free(p->rxmsg);
+	nni_msg_free(p->txmsg);
+	nni_msg_free(p->txcarry);
+	if (p->txbuf != NULL) {
+		nni_free(p->txbuf, MQTT_TCPTRAN_TXBUF);
+	}
 	// nni_lmq_fini(&p->rslmq);
 	nni_mtx_fini(&p->mtx);
 #ifdef NNG_HAVE_MQTT_BROKER
@@ -475,11 +490,17 @@ mqtt_tcptran_pipe_send_cb(void *arg)
 	size_t             n;
 	nni_msg *          msg;
 	nni_aio *          txaio = p->txaio;
+	nni_iov            iov[2];
+	unsigned           niov;
 
 	nni_mtx_lock(&p->mtx);
 	aio = nni_list_first(&p->sendq);
 
 	if ((rv = nni_aio_result(txaio)) != 0) {
+		nni_msg_free(p->txmsg);
+		nni_msg_free(p->txcarry);
+		p->txmsg   = NULL;
+		p->txcarry = NULL;
 		nni_pipe_bump_error(p->npipe, rv);
 		// Intentionally we do not queue up another transfer.
 		// There's an excellent chance that the pipe is no longer
@@ -499,12 +520,25 @@ mqtt_tcptran_pipe_send_cb(void *arg)
 		nni_mtx_unlock(&p->mtx);
 		return;
 	}
+	if (p->txmsg != NULL) {
+		nni_msg_free(p->txmsg);
+		p->txmsg = NULL;
+	}
+	// keep writing until the whole batch is out
+	niov = 0;
+	if (mqtt_tcptran_pipe_send_round(
+	        p, nni_aio_get_input(aio, 0), iov, &niov)) {
+		nni_aio_set_iov(txaio, niov, iov);
+		nng_stream_send(p->conn, txaio);
+		nni_mtx_unlock(&p->mtx);
+		return;
+	}
 
 	nni_aio_list_remove(aio);
+	n = p->txsize;
 	mqtt_tcptran_pipe_send_start(p);
 
 	msg = nni_aio_get_msg(aio);
-	n   = nni_msg_len(msg);
 	nni_pipe_bump_tx(p->npipe, n);
 	nni_mtx_unlock(&p->mtx);
 
@@ -742,6 +776,97 @@ mqtt_tcptran_pipe_send_cancel(nni_aio *aio, void *arg, int rv)
 	nni_aio_finish_error(aio, rv);
 }
 
+// Apply the limits of the server to a msg about to be sent.
+static int
+mqtt_tcptran_pipe_send_prep(mqtt_tcptran_pipe *p, nni_msg *msg)
+{
+	uint8_t *header = nni_msg_header(msg);
+
+	if (p->proto == MQTT_PROTOCOL_VERSION_v5) {
+		if ((*header & 0XF0) == CMD_PUBLISH) {
+			// check max qos
+			uint8_t qos = nni_mqtt_msg_get_publish_qos(msg);
+			if (qos > 0)
+				p->sndmax --;
+			if (qos > p->qosmax) {
+				p->qosmax == 1 ? ((*header &= 0XF9), (*header |= 0X02)) : NNI_ARG_UNUSED(*header);
+				p->qosmax == 0 ? *header &= 0XF9 : NNI_ARG_UNUSED(*header);
+			}
+		}
+	}
+
+	// check max packet size
+	if (nni_msg_header_len(msg) + nni_msg_len(msg) > p->packmax) {
+		return (UNSPECIFIED_ERROR);
+	}
+	return (0);
+}
+
+// Add the next round of a batch to iov, the msgs the protocol queued
+// behind the one of the user aio. Msgs are copied into txbuf as long as
+// they fit, so that they all go out with a single writev; one too large
+// for it goes alone, uncopied. Returns false when the batch is done.
+static bool
+mqtt_tcptran_pipe_send_round(
+    mqtt_tcptran_pipe *p, nni_lmq *batch, nni_iov *iov, unsigned *niovp)
+{
+	nni_msg *msg;
+	unsigned niov = *niovp;
+	size_t   len  = 0;
+	size_t   cap  = MQTT_TCPTRAN_TXBUF;
+	size_t   sz;
+
+	if (p->txbuf == NULL && (p->txbuf = nni_alloc(cap)) == NULL) {
+		cap = 0;
+	}
+	for (;;) {
+		if ((msg = p->txcarry) != NULL) {
+			p->txcarry = NULL;
+		} else if (batch == NULL || nni_lmq_get(batch, &msg) != 0) {
+			break;
+		} else if (mqtt_tcptran_pipe_send_prep(p, msg) != 0) {
+			log_warn("msg of %zu bytes exceeds packet size limit",
+			    nni_msg_len(msg));
+			nni_msg_free(msg);
+			continue;
+		}
+		sz = nni_msg_header_len(msg) + nni_msg_len(msg);
+		if (len + sz <= cap) {
+			memcpy(p->txbuf + len, nni_msg_header(msg),
+			    nni_msg_header_len(msg));
+			memcpy(p->txbuf + len + nni_msg_header_len(msg),
+			    nni_msg_body(msg), nni_msg_len(msg));
+			len += sz;
+			nni_msg_free(msg);
+			continue;
+		}
+		if (len == 0) {
+			p->txmsg = msg;
+			iov[niov].iov_buf = nni_msg_header(msg);
+			iov[niov].iov_len = nni_msg_header_len(msg);
+			niov++;
+			iov[niov].iov_buf = nni_msg_body(msg);
+			iov[niov].iov_len = nni_msg_len(msg);
+			niov++;
+			p->txsize += sz;
+			break;
+		}
+		p->txcarry = msg;
+		break;
+	}
+	if (len > 0) {
+		iov[niov].iov_buf = p->txbuf;
+		iov[niov].iov_len = len;
+		niov++;
+		p->txsize += len;
+	}
+	if (niov == *niovp) {
+		return (false);
+	}
+	*niovp = niov;
+	return (true);
+}
+
 static void
 mqtt_tcptran_pipe_send_start(mqtt_tcptran_pipe *p)
 {
@@ -751,8 +876,8 @@ mqtt_tcptran_pipe_send_start(mqtt_tcptran_pipe *p)
 	nni_aio *aio;
 	nni_aio *txaio;
 	nni_msg *msg;
-	int      niov;
-	nni_iov  iov[3];
+	unsigned niov;
+	nni_iov  iov[4];
 
 	if (p->closed) {
 		while ((aio = nni_list_first(&p->sendq)) != NULL) {
@@ -768,26 +893,12 @@ mqtt_tcptran_pipe_send_start(mqtt_tcptran_pipe *p)
 
 	// This runs to send the message.
 	msg = nni_aio_get_msg(aio);
-	header = nni_msg_header(msg);
-	if (msg != NULL && p->proto == MQTT_PROTOCOL_VERSION_v5) {
-		if ((*header & 0XF0) == CMD_PUBLISH) {
-			// check max qos
-			uint8_t qos = nni_mqtt_msg_get_publish_qos(msg);
-			if (qos > 0)
-				p->sndmax --;
-			if (qos > p->qosmax) {
-				p->qosmax == 1 ? ((*header &= 0XF9), (*header |= 0X02)) : NNI_ARG_UNUSED(*header);
-				p->qosmax == 0 ? *header &= 0XF9 : NNI_ARG_UNUSED(*header);
-			}
-		}
-	}
-
-	// check max packet size
-	if (nni_msg_header_len(msg) + nni_msg_len(msg) > p->packmax) {
+	if (mqtt_tcptran_pipe_send_prep(p, msg) != 0) {
 		txaio = p->txaio;
 		nni_aio_finish_error(txaio, UNSPECIFIED_ERROR);
 		return;
 	}
+	header = nni_msg_header(msg);
 
 	txaio = p->txaio;
 	niov  = 0;
@@ -805,6 +916,10 @@ mqtt_tcptran_pipe_send_start(mqtt_tcptran_pipe *p)
 	// assure send correct packet
 	len = get_var_integer((header + 1), &len_of_var);
 	NNI_ASSERT(len == nni_msg_len(msg));
+	p->txsize = nni_msg_header_len(msg) + nni_msg_len(msg);
+
+	// msgs queued behind this one by the protocol share its writev
+	mqtt_tcptran_pipe_send_round(p, nni_aio_get_input(aio, 0), iov, &niov);
 
 	nni_aio_set_iov(txaio, niov, iov);
 	nng_stream_send(p->conn, txaio);
@@ -926,12 +1041,36 @@ mqtt_tcptran_pipe_peer(void *arg)
 	return (p->peer);
 }
 
+static int
+mqtt_tcptran_pipe_get_send_batch(void *arg, void *v, size_t *szp, nni_opt_type t)
+{
+	NNI_ARG_UNUSED(arg);
+	return (nni_copyout_bool(true, v, szp, t));
+}
+
+static const nni_option mqtt_tcptran_pipe_opts[] = {
+	{
+	    .o_name = NNG_OPT_MQTT_SEND_BATCH,
+	    .o_get  = mqtt_tcptran_pipe_get_send_batch,
+	},
+	// terminate list
+	{
+	    .o_name = NULL,
+	},
+};
+
 static int
 mqtt_tcptran_pipe_getopt(
     void *arg, const char *name, void *buf, size_t *szp, nni_type t)
 {
 	mqtt_tcptran_pipe *p = arg;
-	return (nni_stream_get(p->conn, name, buf, szp, t));
+	int                rv;
+
+	rv = nni_stream_get(p->conn, name, buf, szp, t);
+	if (rv == NNG_ENOTSUP) {
+		rv = nni_getopt(mqtt_tcptran_pipe_opts, name, p, buf, szp, t);
+	}
+	return (rv);
 }
 
 static void
@@ -1326,6 +1465,34 @@ mqtt_tcptran_dialer_init(void **dp, nng_url *url, nni_dialer *ndialer)
 	return (0);
 }
 
+#ifdef NNG_TRANSPORT_MQTT_SHM
+// The path of a shm URL is where the UNIX domain socket of the broker is.
+static int
+mqtt_tcptran_shm_dialer_init(void **dp, nng_url *url, nni_dialer *ndialer)
+{
+	mqtt_tcptran_ep *ep;
+	int              rv;
+	nni_sock        *sock = nni_dialer_sock(ndialer);
+
+	if (strlen(url->u_path) == 0) {
+		return (NNG_EADDRINVAL);
+	}
+	if ((rv = mqtt_tcptran_ep_init(&ep, url, sock)) != 0) {
+		return (rv);
+	}
+	ep->ndialer = ndialer;
+
+	if (((rv = nni_aio_alloc(&ep->connaio, mqtt_tcptran_dial_cb, ep)) !=
+	        0) ||
+	    ((rv = nng_stream_dialer_alloc_url(&ep->dialer, url)) != 0)) {
+		mqtt_tcptran_ep_fini(ep);
+		return (rv);
+	}
+	*dp = ep;
+	return (0);
+}
+#endif
+
 static int
 mqtt_tcptran_listener_init(void **lp, nng_url *url, nni_listener *nlistener)
 {
@@ -1655,6 +1822,17 @@ static nni_sp_dialer_ops mqtt_tcptran_dialer_ops = {
 	.d_setopt  = mqtt_tcptran_dialer_setopt,
 };
 
+#ifdef NNG_TRANSPORT_MQTT_SHM
+static nni_sp_dialer_ops mqtt_tcptran_shm_dialer_ops = {
+	.d_init    = mqtt_tcptran_shm_dialer_init,
+	.d_fini    = mqtt_tcptran_ep_fini,
+	.d_connect = mqtt_tcptran_ep_connect,
+	.d_close   = mqtt_tcptran_ep_close,
+	.d_getopt  = mqtt_tcptran_dialer_getopt,
+	.d_setopt  = mqtt_tcptran_dialer_setopt,
+};
+#endif
+
 // TODO Remove: MQTT SDK has no listener though
 static nni_sp_listener_ops mqtt_tcptran_listener_ops = {
 	.l_init   = mqtt_tcptran_listener_init,
@@ -1693,6 +1871,17 @@ static nni_sp_tran mqtt_tcp6_tran = {
 	.tran_fini     = mqtt_tcptran_fini,
 };
 
+#ifdef NNG_TRANSPORT_MQTT_SHM
+// MQTT over the shared memory streams, the bytes are the same as on TCP.
+static nni_sp_tran mqtt_shm_tran = {
+	.tran_scheme = "mqtt-shm",
+	.tran_dialer = &mqtt_tcptran_shm_dialer_ops,
+	.tran_pipe   = &mqtt_tcptran_pipe_ops,
+	.tran_init   = mqtt_tcptran_init,
+	.tran_fini   = mqtt_tcptran_fini,
+};
+#endif
+
 #ifndef NNG_ELIDE_DEPRECATED
 int
 nng_mqtt_tcp_register(void)
@@ -1707,4 +1896,7 @@ nni_mqtt_tcp_register(void)
 	nni_mqtt_tran_register(&mqtt_tcp_tran);
 	nni_mqtt_tran_register(&mqtt_tcp4_tran);
 	nni_mqtt_tran_register(&mqtt_tcp6_tran);
+#ifdef NNG_TRANSPORT_MQTT_SHM
+	nni_mqtt_tran_register(&mqtt_shm_tran);
+#endif
 }
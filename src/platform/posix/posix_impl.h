@@ -151,5 +151,9 @@ extern int  nni_posix_pollq_sysinit(void);
 extern void nni_posix_pollq_sysfini(void);
 extern int  nni_posix_resolv_sysinit(void);
 extern void nni_posix_resolv_sysfini(void);
+#ifdef NNG_HAVE_IO_URING
+extern int  nni_posix_uring_sysinit(void);
+extern void nni_posix_uring_sysfini(void);
+#endif
 
 #endif // PLATFORM_POSIX_IMPL_H
@@ -186,6 +186,13 @@ ipc_close(void *arg)
 	if (!c->closed) {
 		nni_aio *aio;
 		c->closed = true;
+#ifdef NNG_HAVE_IO_URING
+		if (c->uring) {
+			// Anything with the kernel finishes at its CQE.
+			nni_posix_uring_io_close(&c->rio);
+			nni_posix_uring_io_close(&c->wio);
+		} else
+#endif
 		while (((aio = nni_list_first(&c->readq)) != NULL) ||
 		    ((aio = nni_list_first(&c->writeq)) != NULL)) {
 			nni_aio_list_remove(aio);
@@ -233,6 +240,13 @@ ipc_cancel(nni_aio *aio, void *arg, int rv)
 	ipc_conn *c = arg;
 
 	nni_mtx_lock(&c->mtx);
+#ifdef NNG_HAVE_IO_URING
+	if (c->uring && (nni_posix_uring_io_cancel(&c->rio, aio, rv) ||
+	                    nni_posix_uring_io_cancel(&c->wio, aio, rv))) {
+		nni_mtx_unlock(&c->mtx);
+		return;
+	}
+#endif
 	if (nni_aio_list_active(aio)) {
 		nni_aio_list_remove(aio);
 		nni_aio_finish_error(aio, rv);
@@ -258,6 +272,13 @@ ipc_send(void *arg, nni_aio *aio)
 	}
 	nni_aio_list_append(&c->writeq, aio);
 
+#ifdef NNG_HAVE_IO_URING
+	if (c->uring) {
+		nni_posix_uring_io_start(&c->wio, nni_posix_pfd_fd(c->pfd));
+		nni_mtx_unlock(&c->mtx);
+		return;
+	}
+#endif
 	if (nni_list_first(&c->writeq) == aio) {
 		ipc_dowrite(c);
 		// If we are still the first thing on the list, that
@@ -288,6 +309,13 @@ ipc_recv(void *arg, nni_aio *aio)
 	}
 	nni_aio_list_append(&c->readq, aio);
 
+#ifdef NNG_HAVE_IO_URING
+	if (c->uring) {
+		nni_posix_uring_io_start(&c->rio, nni_posix_pfd_fd(c->pfd));
+		nni_mtx_unlock(&c->mtx);
+		return;
+	}
+#endif
 	// If we are only job on the list, go ahead and try to do an
 	// immediate transfer. This allows for faster completions in
 	// many cases.  We also need not arm a list if it was already
@@ -382,6 +410,22 @@ ipc_get_addr(void *arg, void *buf, size_t *szp, nni_type t)
 void
 nni_posix_ipc_start(nni_ipc_conn *c)
 {
+#ifdef NNG_HAVE_IO_URING
+	// See nni_posix_tcp_start.  This may be called again on a
+	// started conn (shm borrows the poller for its handshake).
+	if (nni_posix_uring_enabled()) {
+		if (!c->uring) {
+			c->uring = true;
+			nni_posix_uring_io_init(
+			    &c->rio, &c->mtx, &c->readq, false);
+			nni_posix_uring_io_init(
+			    &c->wio, &c->mtx, &c->writeq, true);
+		}
+		nni_posix_pfd_set_cb(c->pfd, NULL, NULL);
+		(void) nni_posix_pfd_arm(c->pfd, 0);
+		return;
+	}
+#endif
 	nni_posix_pfd_set_cb(c->pfd, ipc_cb, c);
 }
 
@@ -390,6 +434,12 @@ ipc_reap(void *arg)
 {
 	ipc_conn *c = arg;
 	ipc_close(c);
+#ifdef NNG_HAVE_IO_URING
+	if (c->uring) {
+		nni_posix_uring_io_fini(&c->rio);
+		nni_posix_uring_io_fini(&c->wio);
+	}
+#endif
 	if (c->pfd != NULL) {
 		nni_posix_pfd_fini(c->pfd);
 	}
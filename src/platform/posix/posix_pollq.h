@@ -26,6 +26,7 @@ typedef struct nni_posix_pfd nni_posix_pfd;
 typedef void (*nni_posix_pfd_cb)(nni_posix_pfd *, unsigned, void *);
 
 extern int  nni_posix_pfd_init(nni_posix_pfd **, int);
+extern int  nni_posix_pfd_init_pollq(nni_posix_pfd **, int, int);
 extern void nni_posix_pfd_fini(nni_posix_pfd *);
 extern int  nni_posix_pfd_arm(nni_posix_pfd *, unsigned);
 extern int  nni_posix_pfd_fd(nni_posix_pfd *);
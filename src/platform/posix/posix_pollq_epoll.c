@@ -74,19 +74,24 @@ struct nni_posix_pfd {
 	nni_cv           cv;
 };
 
-// single global instance for now.
-static nni_posix_pollq nni_posix_global_pollq;
+// The pollqs each have their own epoll handle and thread.  A pfd stays
+// on the pollq it was put on; new ones are spread over all of them.  More
+// pollqs are started on demand when a pfd asks for a given one, up to the
+// slots allocated at init.
+static nni_posix_pollq **nni_posix_pollqs;
+static int               nni_posix_maxpollq;
+static nni_atomic_int    nni_posix_npollq;
+static nni_mtx           nni_posix_pollq_mtx;
 
-int
-nni_posix_pfd_init(nni_posix_pfd **pfdp, int fd)
+static int nni_posix_pollq_create(nni_posix_pollq *);
+
+static int
+nni_posix_pfd_add(nni_posix_pfd **pfdp, int fd, nni_posix_pollq *pq)
 {
 	nni_posix_pfd *    pfd;
-	nni_posix_pollq *  pq;
 	struct epoll_event ev;
 	int                rv;
 
-	pq = &nni_posix_global_pollq;
-
 	(void) fcntl(fd, F_SETFD, FD_CLOEXEC);
 	(void) fcntl(fd, F_SETFL, O_NONBLOCK);
 
@@ -123,6 +128,48 @@ nni_posix_pfd_init(nni_posix_pfd **pfdp, int fd)
 	return (0);
 }
 
+int
+nni_posix_pfd_init(nni_posix_pfd **pfdp, int fd)
+{
+	nni_posix_pollq *pq;
+	int              n = nni_atomic_get(&nni_posix_npollq);
+
+	pq = nni_posix_pollqs[nni_random() % n];
+	return (nni_posix_pfd_add(pfdp, fd, pq));
+}
+
+// nni_posix_pfd_init_pollq puts fd on pollq number pollq, modulo the slots
+// there are, starting that pollq and the ones before it if need be.  This
+// way the shards of a listener each get a poller thread of their own, even
+// with NNG_INIT_NUM_POLLER_THREADS left at one.
+int
+nni_posix_pfd_init_pollq(nni_posix_pfd **pfdp, int fd, int pollq)
+{
+	nni_posix_pollq *pq;
+	int              n;
+	int              rv;
+
+	pollq %= nni_posix_maxpollq;
+	nni_mtx_lock(&nni_posix_pollq_mtx);
+	while ((n = nni_atomic_get(&nni_posix_npollq)) <= pollq) {
+		if ((pq = NNI_ALLOC_STRUCT(pq)) == NULL) {
+			nni_mtx_unlock(&nni_posix_pollq_mtx);
+			return (NNG_ENOMEM);
+		}
+		if ((rv = nni_posix_pollq_create(pq)) != 0) {
+			NNI_FREE_STRUCT(pq);
+			nni_mtx_unlock(&nni_posix_pollq_mtx);
+			return (rv);
+		}
+		nni_posix_pollqs[n] = pq;
+		nni_atomic_set(&nni_posix_npollq, n + 1);
+	}
+	pq = nni_posix_pollqs[pollq];
+	nni_mtx_unlock(&nni_posix_pollq_mtx);
+
+	return (nni_posix_pfd_add(pfdp, fd, pq));
+}
+
 int
 nni_posix_pfd_arm(nni_posix_pfd *pfd, unsigned events)
 {
@@ -397,13 +444,77 @@ nni_posix_pollq_create(nni_posix_pollq *pq)
 int
 nni_posix_pollq_sysinit(void)
 {
-	return (nni_posix_pollq_create(&nni_posix_global_pollq));
+	int rv;
+	int num_thr;
+	int max_thr;
+
+	// Unlike Windows, one poller thread is the default here.  More
+	// of them help when many connections are busy at once; a broker
+	// listener sharded over SO_REUSEPORT sockets starts one per shard
+	// itself, up to NNG_INIT_MAX_POLLER_THREADS.
+#ifndef NNG_MAX_POLLER_THREADS
+#define NNG_MAX_POLLER_THREADS 8
+#endif
+#ifndef NNG_NUM_POLLER_THREADS
+#define NNG_NUM_POLLER_THREADS 1
+#endif
+	max_thr = (int) nni_init_get_param(
+	    NNG_INIT_MAX_POLLER_THREADS, NNG_MAX_POLLER_THREADS);
+
+	num_thr = (int) nni_init_get_param(
+	    NNG_INIT_NUM_POLLER_THREADS, NNG_NUM_POLLER_THREADS);
+
+	if ((max_thr > 0) && (num_thr > max_thr)) {
+		num_thr = max_thr;
+	}
+	if (num_thr < 1) {
+		num_thr = 1;
+	}
+	nni_init_set_effective(NNG_INIT_NUM_POLLER_THREADS, num_thr);
+
+	// Without a limit, on demand pollqs still stop at the default one
+	if (max_thr <= 0) {
+		max_thr = NNG_MAX_POLLER_THREADS > num_thr
+		    ? NNG_MAX_POLLER_THREADS
+		    : num_thr;
+	}
+	if ((nni_posix_pollqs = nni_zalloc(
+	         sizeof(nni_posix_pollq *) * max_thr)) == NULL) {
+		return (NNG_ENOMEM);
+	}
+	nni_posix_maxpollq = max_thr;
+	nni_atomic_init(&nni_posix_npollq);
+	nni_mtx_init(&nni_posix_pollq_mtx);
+	for (int i = 0; i < num_thr; i++) {
+		nni_posix_pollq *pq;
+		if (((pq = NNI_ALLOC_STRUCT(pq)) == NULL) ||
+		    ((rv = nni_posix_pollq_create(pq)) != 0)) {
+			rv = pq == NULL ? NNG_ENOMEM : rv;
+			NNI_FREE_STRUCT(pq);
+			nni_posix_pollq_sysfini();
+			return (rv);
+		}
+		nni_posix_pollqs[i] = pq;
+		nni_atomic_set(&nni_posix_npollq, i + 1);
+	}
+	return (0);
 }
 
 void
 nni_posix_pollq_sysfini(void)
 {
-	nni_posix_pollq_destroy(&nni_posix_global_pollq);
+	int n = nni_atomic_get(&nni_posix_npollq);
+
+	for (int i = 0; i < n; i++) {
+		nni_posix_pollq_destroy(nni_posix_pollqs[i]);
+		NNI_FREE_STRUCT(nni_posix_pollqs[i]);
+	}
+	nni_free(
+	    nni_posix_pollqs, sizeof(nni_posix_pollq *) * nni_posix_maxpollq);
+	nni_mtx_fini(&nni_posix_pollq_mtx);
+	nni_posix_pollqs   = NULL;
+	nni_posix_maxpollq = 0;
+	nni_atomic_set(&nni_posix_npollq, 0);
 }
 
 #endif // NNG_HAVE_EPOLL
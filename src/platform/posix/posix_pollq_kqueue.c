@@ -108,6 +108,14 @@ nni_posix_pfd_init(nni_posix_pfd **pfdp, int fd)
 	return (0);
 }
 
+// There is a single pollq, so every pfd shares it.
+int
+nni_posix_pfd_init_pollq(nni_posix_pfd **pfdp, int fd, int pollq)
+{
+	NNI_ARG_UNUSED(pollq);
+	return (nni_posix_pfd_init(pfdp, fd));
+}
+
 void
 nni_posix_pfd_close(nni_posix_pfd *pf)
 {
@@ -0,0 +1,1183 @@
+//
+// Copyright 2024 NanoMQ Team, Inc. <jaylin@emqx.io>
+//
+// This software is supplied under the terms of the MIT License, a
+// copy of which should be located in the distribution where this
+// file was obtained (LICENSE.txt).  A copy of the license may also be
+// found online at https://opensource.org/licenses/MIT.
+//
+
+#include "core/nng_impl.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#ifndef MSG_CMSG_CLOEXEC
+#define MSG_CMSG_CLOEXEC 0
+#endif
+
+#include "posix_ipc.h"
+
+// Shared memory streams, between processes of the same host.
+//
+// The listener binds a UNIX domain socket at the path of the URL. For
+// each connection it accepts, it creates a shared memory region holding
+// a ring of bytes for either direction, and two eventfds, and hands
+// them to the dialer over the socket. From then on the bytes go through
+// the rings only; a side sleeping on an empty (or full) ring is woken by
+// its eventfd. The socket stays open, and is closed by a peer going
+// away, so we learn about that without polling the rings.
+//
+// Each ring has a single producer and a single consumer, which only
+// ever advance their own index, so no locks are shared between the
+// processes.
+
+#define SHM_MAGIC 0x4e534d52u // "NSMR"
+#define SHM_VERSION 1
+#define SHM_LINE 64
+#define SHM_HDR_LEN 4096
+#define SHM_RING_SIZE (256 * 1024) // must be a power of two
+
+typedef struct {
+	uint64_t head; // consumed up to here, by the consumer
+	uint8_t  pad0[SHM_LINE - 8];
+	uint64_t tail; // produced up to here, by the producer
+	uint8_t  pad1[SHM_LINE - 8];
+	uint32_t rd_wait; // consumer is waiting for bytes
+	uint32_t wr_wait; // producer is waiting for room
+	uint8_t  pad2[SHM_LINE - 8];
+} shm_ring;
+
+// Ring 0 carries bytes from the dialer to the listener, ring 1 the other
+// way. The data of the rings follows the first SHM_HDR_LEN bytes.
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t ring_size;
+	uint32_t reserved;
+	uint8_t  pad[SHM_LINE - 16];
+	shm_ring rings[2];
+} shm_header;
+
+typedef struct shm_conn     shm_conn;
+typedef struct shm_dialer   shm_dialer;
+typedef struct shm_listener shm_listener;
+
+struct shm_conn {
+	nng_stream     stream;
+	nng_stream    *ctrl;     // the UNIX domain socket
+	nni_aio       *ctrl_aio; // dials, then waits for the peer to go
+	uint8_t        ctrl_buf;
+	nni_posix_pfd *pfd;      // our eventfd
+	int            peer_efd; // eventfd of the peer
+	uint8_t       *region;
+	size_t         region_len;
+	shm_ring      *tx;
+	shm_ring      *rx;
+	uint8_t       *tx_data;
+	uint8_t       *rx_data;
+	size_t         size;
+	nni_list       readq;
+	nni_list       writeq;
+	bool           closed;
+	bool           peer_closed;
+	bool           dialing;
+	nni_mtx        mtx;
+	nni_aio       *dial_aio;
+	shm_dialer    *dialer;
+	nni_reap_node  reap;
+};
+
+struct shm_dialer {
+	nng_stream_dialer  sd;
+	nng_stream_dialer *ipc;
+	nni_list           connq; // pending connections
+	bool               closed;
+	nni_mtx            mtx;
+	nni_atomic_u64     ref;
+	nni_atomic_bool    fini;
+};
+
+struct shm_listener {
+	nng_stream_listener  sl;
+	nng_stream_listener *ipc;
+	nni_aio             *aio; // accepts from the UNIX domain socket
+	nni_list             acceptq;
+	bool                 closed;
+	nni_mtx              mtx;
+};
+
+static void shm_dialer_rele(shm_dialer *);
+static void shm_dialer_handshake(shm_conn *);
+
+static void
+shm_raise(shm_conn *c)
+{
+	uint64_t one = 1;
+
+	(void) write(c->peer_efd, &one, sizeof(one));
+}
+
+// Copy as many bytes of the aio as there is room for into the ring we
+// produce. It returns the number of bytes copied.
+static size_t
+shm_ring_put(shm_conn *c, nni_aio *aio)
+{
+	shm_ring *r    = c->tx;
+	uint64_t  tail = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+	uint64_t  head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+	size_t    room = c->size - (size_t) (tail - head);
+	size_t    n    = 0;
+	unsigned  naiov;
+	nni_iov  *aiov;
+
+	nni_aio_get_iov(aio, &naiov, &aiov);
+	for (unsigned i = 0; i < naiov && n < room; i++) {
+		uint8_t *src = aiov[i].iov_buf;
+		size_t   len = aiov[i].iov_len;
+		if (len > room - n) {
+			len = room - n;
+		}
+		while (len > 0) {
+			size_t off   = (size_t) (tail + n) & (c->size - 1);
+			size_t chunk = c->size - off;
+			if (chunk > len) {
+				chunk = len;
+			}
+			memcpy(c->tx_data + off, src, chunk);
+			src += chunk;
+			len -= chunk;
+			n += chunk;
+		}
+	}
+	if (n > 0) {
+		__atomic_store_n(&r->tail, tail + n, __ATOMIC_SEQ_CST);
+		if (__atomic_exchange_n(&r->rd_wait, 0, __ATOMIC_SEQ_CST)) {
+			shm_raise(c);
+		}
+	}
+	return (n);
+}
+
+// Copy as many bytes as the ring we consume has into the aio. It
+// returns the number of bytes copied.
+static size_t
+shm_ring_get(shm_conn *c, nni_aio *aio)
+{
+	shm_ring *r     = c->rx;
+	uint64_t  head  = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+	uint64_t  tail  = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+	size_t    avail = (size_t) (tail - head);
+	size_t    n     = 0;
+	unsigned  naiov;
+	nni_iov  *aiov;
+
+	nni_aio_get_iov(aio, &naiov, &aiov);
+	for (unsigned i = 0; i < naiov && n < avail; i++) {
+		uint8_t *dst = aiov[i].iov_buf;
+		size_t   len = aiov[i].iov_len;
+		if (len > avail - n) {
+			len = avail - n;
+		}
+		while (len > 0) {
+			size_t off   = (size_t) (head + n) & (c->size - 1);
+			size_t chunk = c->size - off;
+			if (chunk > len) {
+				chunk = len;
+			}
+			memcpy(dst, c->rx_data + off, chunk);
+			dst += chunk;
+			len -= chunk;
+			n += chunk;
+		}
+	}
+	if (n > 0) {
+		__atomic_store_n(&r->head, head + n, __ATOMIC_SEQ_CST);
+		if (__atomic_exchange_n(&r->wr_wait, 0, __ATOMIC_SEQ_CST)) {
+			shm_raise(c);
+		}
+	}
+	return (n);
+}
+
+// Returns true if the ring we produce is full, after telling the peer
+// to wake us once there is room again.
+static bool
+shm_tx_full(shm_conn *c)
+{
+	shm_ring *r    = c->tx;
+	uint64_t  tail = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&r->wr_wait, 1, __ATOMIC_SEQ_CST);
+	if (tail - __atomic_load_n(&r->head, __ATOMIC_SEQ_CST) != c->size) {
+		__atomic_store_n(&r->wr_wait, 0, __ATOMIC_RELAXED);
+		return (false);
+	}
+	return (true);
+}
+
+// Returns true if the ring we consume is empty, after telling the peer
+// to wake us once there are bytes again.
+static bool
+shm_rx_empty(shm_conn *c)
+{
+	shm_ring *r    = c->rx;
+	uint64_t  head = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&r->rd_wait, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&r->tail, __ATOMIC_SEQ_CST) != head) {
+		__atomic_store_n(&r->rd_wait, 0, __ATOMIC_RELAXED);
+		return (false);
+	}
+	return (true);
+}
+
+// Returns true if a writer is left waiting for room.
+static bool
+shm_dowrite(shm_conn *c)
+{
+	nni_aio *aio;
+	size_t   n;
+
+	while ((aio = nni_list_first(&c->writeq)) != NULL) {
+		if (c->peer_closed) {
+			nni_aio_list_remove(aio);
+			nni_aio_finish_error(aio, NNG_ECONNSHUT);
+			continue;
+		}
+		if ((n = shm_ring_put(c, aio)) == 0) {
+			if (nni_aio_iov_count(aio) == 0) {
+				nni_aio_list_remove(aio);
+				nni_aio_finish(aio, 0, 0);
+				continue;
+			}
+			if (shm_tx_full(c)) {
+				return (true);
+			}
+			continue;
+		}
+		nni_aio_bump_count(aio, n);
+		nni_aio_list_remove(aio);
+		nni_aio_finish(aio, 0, nni_aio_count(aio));
+	}
+	return (false);
+}
+
+// Returns true if a reader is left waiting for bytes.
+static bool
+shm_doread(shm_conn *c)
+{
+	nni_aio *aio;
+	size_t   n;
+
+	while ((aio = nni_list_first(&c->readq)) != NULL) {
+		if ((n = shm_ring_get(c, aio)) == 0) {
+			if (nni_aio_iov_count(aio) == 0) {
+				nni_aio_list_remove(aio);
+				nni_aio_finish(aio, 0, 0);
+				continue;
+			}
+			if (!shm_rx_empty(c)) {
+				continue;
+			}
+			if (c->peer_closed) {
+				// Everything the peer sent is read.
+				nni_aio_list_remove(aio);
+				nni_aio_finish_error(aio, NNG_ECONNSHUT);
+				continue;
+			}
+			return (true);
+		}
+		nni_aio_bump_count(aio, n);
+		nni_aio_list_remove(aio);
+		nni_aio_finish(aio, 0, nni_aio_count(aio));
+	}
+	return (false);
+}
+
+static void
+shm_run(shm_conn *c)
+{
+	bool wait;
+
+	if (c->closed) {
+		return;
+	}
+	wait = shm_doread(c);
+	wait = shm_dowrite(c) || wait;
+	if (wait) {
+		nni_posix_pfd_arm(c->pfd, NNI_POLL_IN);
+	}
+}
+
+static void
+shm_error(shm_conn *c, int err)
+{
+	nni_aio *aio;
+
+	nni_mtx_lock(&c->mtx);
+	while (((aio = nni_list_first(&c->readq)) != NULL) ||
+	    ((aio = nni_list_first(&c->writeq)) != NULL)) {
+		nni_aio_list_remove(aio);
+		nni_aio_finish_error(aio, err);
+	}
+	nni_posix_pfd_close(c->pfd);
+	nni_mtx_unlock(&c->mtx);
+}
+
+static void
+shm_cb(nni_posix_pfd *pfd, unsigned events, void *arg)
+{
+	shm_conn *c = arg;
+	uint64_t  cnt;
+
+	if (events & (NNI_POLL_HUP | NNI_POLL_ERR | NNI_POLL_INVAL)) {
+		shm_error(c, NNG_ECONNSHUT);
+		return;
+	}
+	(void) read(nni_posix_pfd_fd(pfd), &cnt, sizeof(cnt));
+	nni_mtx_lock(&c->mtx);
+	shm_run(c);
+	nni_mtx_unlock(&c->mtx);
+}
+
+// The peer closed the socket, or we did.
+static void
+shm_ctrl_cb(void *arg)
+{
+	shm_conn *c = arg;
+
+	if (c->dialing) {
+		shm_dialer_handshake(c);
+		return;
+	}
+	nni_mtx_lock(&c->mtx);
+	c->peer_closed = true;
+	shm_run(c);
+	nni_mtx_unlock(&c->mtx);
+}
+
+static void
+shm_close(void *arg)
+{
+	shm_conn *c = arg;
+
+	nni_mtx_lock(&c->mtx);
+	if (!c->closed) {
+		nni_aio *aio;
+		c->closed = true;
+		while (((aio = nni_list_first(&c->readq)) != NULL) ||
+		    ((aio = nni_list_first(&c->writeq)) != NULL)) {
+			nni_aio_list_remove(aio);
+			nni_aio_finish_error(aio, NNG_ECLOSED);
+		}
+		if (c->pfd != NULL) {
+			nni_posix_pfd_close(c->pfd);
+		}
+	}
+	nni_mtx_unlock(&c->mtx);
+	if (c->ctrl != NULL) {
+		nng_stream_close(c->ctrl);
+	}
+}
+
+static void
+shm_cancel(nni_aio *aio, void *arg, int rv)
+{
+	shm_conn *c = arg;
+
+	nni_mtx_lock(&c->mtx);
+	if (nni_aio_list_active(aio)) {
+		nni_aio_list_remove(aio);
+		nni_aio_finish_error(aio, rv);
+	}
+	nni_mtx_unlock(&c->mtx);
+}
+
+static void
+shm_send(void *arg, nni_aio *aio)
+{
+	shm_conn *c = arg;
+	int       rv;
+
+	if (nni_aio_begin(aio) != 0) {
+		return;
+	}
+	nni_mtx_lock(&c->mtx);
+	if (c->closed) {
+		nni_mtx_unlock(&c->mtx);
+		nni_aio_finish_error(aio, NNG_ECLOSED);
+		return;
+	}
+	if ((rv = nni_aio_schedule(aio, shm_cancel, c)) != 0) {
+		nni_mtx_unlock(&c->mtx);
+		nni_aio_finish_error(aio, rv);
+		return;
+	}
+	nni_aio_list_append(&c->writeq, aio);
+	if (nni_list_first(&c->writeq) == aio) {
+		shm_run(c);
+	}
+	nni_mtx_unlock(&c->mtx);
+}
+
+static void
+shm_recv(void *arg, nni_aio *aio)
+{
+	shm_conn *c = arg;
+	int       rv;
+
+	if (nni_aio_begin(aio) != 0) {
+		return;
+	}
+	nni_mtx_lock(&c->mtx);
+	if (c->closed) {
+		nni_mtx_unlock(&c->mtx);
+		nni_aio_finish_error(aio, NNG_ECLOSED);
+		return;
+	}
+	if ((rv = nni_aio_schedule(aio, shm_cancel, c)) != 0) {
+		nni_mtx_unlock(&c->mtx);
+		nni_aio_finish_error(aio, rv);
+		return;
+	}
+	nni_aio_list_append(&c->readq, aio);
+	if (nni_list_first(&c->readq) == aio) {
+		shm_run(c);
+	}
+	nni_mtx_unlock(&c->mtx);
+}
+
+// Addresses and peer credentials are those of the socket.
+static int
+shm_get(void *arg, const char *name, void *val, size_t *szp, nni_type t)
+{
+	shm_conn *c = arg;
+	return (nni_stream_get(c->ctrl, name, val, szp, t));
+}
+
+static int
+shm_set(void *arg, const char *name, const void *val, size_t sz, nni_type t)
+{
+	shm_conn *c = arg;
+	return (nni_stream_set(c->ctrl, name, val, sz, t));
+}
+
+static void
+shm_reap(void *arg)
+{
+	shm_conn *c = arg;
+
+	shm_close(c);
+	nni_aio_stop(c->ctrl_aio);
+	if (c->ctrl != NULL) {
+		nng_stream_free(c->ctrl);
+	}
+	nni_aio_free(c->ctrl_aio);
+	if (c->pfd != NULL) {
+		nni_posix_pfd_fini(c->pfd);
+	}
+	if (c->peer_efd >= 0) {
+		(void) close(c->peer_efd);
+	}
+	if (c->region != NULL) {
+		(void) munmap(c->region, c->region_len);
+	}
+	nni_mtx_fini(&c->mtx);
+	if (c->dialer != NULL) {
+		shm_dialer_rele(c->dialer);
+	}
+	NNI_FREE_STRUCT(c);
+}
+
+static nni_reap_list shm_reap_list = {
+	.rl_offset = offsetof(shm_conn, reap),
+	.rl_func   = shm_reap,
+};
+
+static void
+shm_free(void *arg)
+{
+	shm_conn *c = arg;
+	nni_reap(&shm_reap_list, c);
+}
+
+static int
+shm_alloc(shm_conn **cp)
+{
+	shm_conn *c;
+	nni_iov   iov;
+	int       rv;
+
+	if ((c = NNI_ALLOC_STRUCT(c)) == NULL) {
+		return (NNG_ENOMEM);
+	}
+	if ((rv = nni_aio_alloc(&c->ctrl_aio, shm_ctrl_cb, c)) != 0) {
+		NNI_FREE_STRUCT(c);
+		return (rv);
+	}
+	c->peer_efd       = -1;
+	c->stream.s_free  = shm_free;
+	c->stream.s_close = shm_close;
+	c->stream.s_send  = shm_send;
+	c->stream.s_recv  = shm_recv;
+	c->stream.s_get   = shm_get;
+	c->stream.s_set   = shm_set;
+	nni_mtx_init(&c->mtx);
+	nni_aio_list_init(&c->readq);
+	nni_aio_list_init(&c->writeq);
+	iov.iov_buf = &c->ctrl_buf;
+	iov.iov_len = 1;
+	nni_aio_set_iov(c->ctrl_aio, 1, &iov);
+
+	*cp = c;
+	return (0);
+}
+
+// Take over the region and eventfds, and watch the socket for the peer
+// going away. The fds are ours from here on, even on failure.
+static int
+shm_start(shm_conn *c, uint8_t *region, size_t len, int efd, int peer_efd,
+    bool dialer)
+{
+	shm_header *hdr = (void *) region;
+	int         rv;
+
+	c->region     = region;
+	c->region_len = len;
+	c->peer_efd   = peer_efd;
+	c->size       = hdr->ring_size;
+	c->tx         = &hdr->rings[dialer ? 0 : 1];
+	c->rx         = &hdr->rings[dialer ? 1 : 0];
+	c->tx_data    = region + SHM_HDR_LEN + (dialer ? 0 : c->size);
+	c->rx_data    = region + SHM_HDR_LEN + (dialer ? c->size : 0);
+
+	if ((rv = nni_posix_pfd_init(&c->pfd, efd)) != 0) {
+		(void) close(efd);
+		return (rv);
+	}
+	nni_posix_pfd_set_cb(c->pfd, shm_cb, c);
+	nng_stream_recv(c->ctrl, c->ctrl_aio);
+	return (0);
+}
+
+// Dialer stuff.
+static void
+shm_dialer_close(void *arg)
+{
+	shm_dialer *d = arg;
+	nni_aio    *aio;
+
+	nni_mtx_lock(&d->mtx);
+	d->closed = true;
+	while ((aio = nni_list_first(&d->connq)) != NULL) {
+		shm_conn *c;
+		nni_list_remove(&d->connq, aio);
+		if ((c = nni_aio_get_prov_data(aio)) != NULL) {
+			c->dial_aio = NULL;
+			nni_aio_set_prov_data(aio, NULL);
+			nng_stream_free(&c->stream);
+		}
+		nni_aio_finish_error(aio, NNG_ECLOSED);
+	}
+	nni_mtx_unlock(&d->mtx);
+	nng_stream_dialer_close(d->ipc);
+}
+
+static void
+shm_dialer_fini(shm_dialer *d)
+{
+	nng_stream_dialer_free(d->ipc);
+	nni_mtx_fini(&d->mtx);
+	NNI_FREE_STRUCT(d);
+}
+
+static void
+shm_dialer_free(void *arg)
+{
+	shm_dialer *d = arg;
+
+	shm_dialer_close(d);
+	nni_atomic_set_bool(&d->fini, true);
+	shm_dialer_rele(d);
+}
+
+static void
+shm_dialer_rele(shm_dialer *d)
+{
+	if (((nni_atomic_dec64_nv(&d->ref)) != 0) ||
+	    (!nni_atomic_get_bool(&d->fini))) {
+		return;
+	}
+	shm_dialer_fini(d);
+}
+
+static void
+shm_dialer_cancel(nni_aio *aio, void *arg, int rv)
+{
+	shm_dialer *d = arg;
+	shm_conn   *c;
+
+	nni_mtx_lock(&d->mtx);
+	if ((!nni_aio_list_active(aio)) ||
+	    ((c = nni_aio_get_prov_data(aio)) == NULL)) {
+		nni_mtx_unlock(&d->mtx);
+		return;
+	}
+	nni_aio_list_remove(aio);
+	c->dial_aio = NULL;
+	nni_aio_set_prov_data(aio, NULL);
+	nni_mtx_unlock(&d->mtx);
+
+	nni_aio_finish_error(aio, rv);
+	nng_stream_free(&c->stream);
+}
+
+// Finish the dial of a connection, unless it was cancelled meanwhile.
+static void
+shm_dialer_done(shm_conn *c, int rv)
+{
+	shm_dialer *d = c->dialer;
+	nni_aio    *aio;
+
+	nni_mtx_lock(&d->mtx);
+	if ((aio = c->dial_aio) == NULL) {
+		// the canceller frees the connection
+		nni_mtx_unlock(&d->mtx);
+		return;
+	}
+	c->dial_aio = NULL;
+	nni_aio_list_remove(aio);
+	nni_aio_set_prov_data(aio, NULL);
+	nni_mtx_unlock(&d->mtx);
+
+	if (rv != 0) {
+		nng_stream_free(&c->stream);
+		nni_aio_finish_error(aio, rv);
+		return;
+	}
+	nni_aio_set_output(aio, 0, c);
+	nni_aio_finish(aio, 0, 0);
+}
+
+// Receive the region and the eventfds the listener sends as soon as it
+// accepts us.
+static int
+shm_dialer_recv_fds(
+    int fd, uint8_t **regionp, size_t *lenp, int *efdp, int *peer_efdp)
+{
+	struct msghdr   hdr;
+	struct iovec    iov;
+	struct cmsghdr *cmsg;
+	struct stat     st;
+	shm_header     *shdr;
+	uint8_t        *region;
+	uint8_t         byte;
+	int             fds[3];
+	int             rv;
+	union {
+		struct cmsghdr align;
+		char           buf[CMSG_SPACE(sizeof(fds))];
+	} ctl;
+
+	memset(&hdr, 0, sizeof(hdr));
+	iov.iov_base       = &byte;
+	iov.iov_len        = 1;
+	hdr.msg_iov        = &iov;
+	hdr.msg_iovlen     = 1;
+	hdr.msg_control    = ctl.buf;
+	hdr.msg_controllen = sizeof(ctl.buf);
+
+	switch (recvmsg(fd, &hdr, MSG_CMSG_CLOEXEC)) {
+	case -1:
+		if (errno == EAGAIN || errno == EINTR) {
+			return (NNG_EAGAIN);
+		}
+		return (nni_plat_errno(errno));
+	case 0:
+		return (NNG_ECONNSHUT);
+	}
+	cmsg = CMSG_FIRSTHDR(&hdr);
+	if ((cmsg == NULL) || (cmsg->cmsg_level != SOL_SOCKET) ||
+	    (cmsg->cmsg_type != SCM_RIGHTS) ||
+	    (cmsg->cmsg_len != CMSG_LEN(sizeof(fds)))) {
+		return (NNG_EPROTO);
+	}
+	memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+	rv = 0;
+	if (fstat(fds[0], &st) != 0) {
+		rv = nni_plat_errno(errno);
+	} else if (st.st_size != SHM_HDR_LEN + 2 * SHM_RING_SIZE) {
+		rv = NNG_EPROTO;
+	} else if ((region = mmap(NULL, (size_t) st.st_size,
+	                PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0)) ==
+	    MAP_FAILED) {
+		rv = nni_plat_errno(errno);
+	} else {
+		shdr = (void *) region;
+		if ((shdr->magic != SHM_MAGIC) ||
+		    (shdr->version != SHM_VERSION) ||
+		    (shdr->ring_size != SHM_RING_SIZE)) {
+			(void) munmap(region, (size_t) st.st_size);
+			rv = NNG_EPROTO;
+		}
+	}
+	(void) close(fds[0]);
+	if (rv != 0) {
+		(void) close(fds[1]);
+		(void) close(fds[2]);
+		return (rv);
+	}
+	*regionp   = region;
+	*lenp      = (size_t) st.st_size;
+	*efdp      = fds[2];
+	*peer_efdp = fds[1];
+	return (0);
+}
+
+static void
+shm_dialer_hs_cb(nni_posix_pfd *pfd, unsigned events, void *arg)
+{
+	shm_conn     *c  = arg;
+	nni_ipc_conn *ic = (void *) c->ctrl;
+	uint8_t      *region;
+	size_t        len;
+	int           efd;
+	int           peer_efd;
+	int           rv;
+
+	if (events & (NNI_POLL_HUP | NNI_POLL_ERR | NNI_POLL_INVAL)) {
+		rv = NNG_ECONNSHUT;
+	} else if ((rv = shm_dialer_recv_fds(nni_posix_pfd_fd(pfd), &region,
+	                &len, &efd, &peer_efd)) == NNG_EAGAIN) {
+		nni_posix_pfd_arm(pfd, NNI_POLL_IN);
+		return;
+	}
+	// The socket is an ordinary IPC connection again.
+	nni_posix_ipc_start(ic);
+	if (rv == 0) {
+		rv = shm_start(c, region, len, efd, peer_efd, true);
+	}
+	shm_dialer_done(c, rv);
+}
+
+// The socket is connected; wait for the listener to send the region.
+static void
+shm_dialer_handshake(shm_conn *c)
+{
+	nni_ipc_conn *ic;
+	int           rv;
+
+	c->dialing = false;
+	if ((rv = nni_aio_result(c->ctrl_aio)) != 0) {
+		shm_dialer_done(c, rv);
+		return;
+	}
+	c->ctrl = nni_aio_get_output(c->ctrl_aio, 0);
+	ic      = (void *) c->ctrl;
+	nni_posix_pfd_set_cb(ic->pfd, shm_dialer_hs_cb, c);
+	if ((rv = nni_posix_pfd_arm(ic->pfd, NNI_POLL_IN)) != 0) {
+		nni_posix_ipc_start(ic);
+		shm_dialer_done(c, rv);
+	}
+}
+
+static void
+shm_dialer_dial(void *arg, nni_aio *aio)
+{
+	shm_dialer *d = arg;
+	shm_conn   *c;
+	int         rv;
+
+	if (nni_aio_begin(aio) != 0) {
+		return;
+	}
+	if ((rv = shm_alloc(&c)) != 0) {
+		nni_aio_finish_error(aio, rv);
+		return;
+	}
+	nni_atomic_inc64(&d->ref);
+	c->dialer  = d;
+	c->dialing = true;
+
+	nni_mtx_lock(&d->mtx);
+	if (d->closed) {
+		rv = NNG_ECLOSED;
+	} else {
+		rv = nni_aio_schedule(aio, shm_dialer_cancel, d);
+	}
+	if (rv != 0) {
+		nni_mtx_unlock(&d->mtx);
+		nng_stream_free(&c->stream);
+		nni_aio_finish_error(aio, rv);
+		return;
+	}
+	c->dial_aio = aio;
+	nni_aio_set_prov_data(aio, c);
+	nni_list_append(&d->connq, aio);
+	nni_mtx_unlock(&d->mtx);
+
+	nng_stream_dialer_dial(d->ipc, c->ctrl_aio);
+}
+
+static int
+shm_dialer_get(void *arg, const char *nm, void *buf, size_t *szp, nni_type t)
+{
+	shm_dialer *d = arg;
+	return (nni_stream_dialer_get(d->ipc, nm, buf, szp, t));
+}
+
+static int
+shm_dialer_set(
+    void *arg, const char *nm, const void *buf, size_t sz, nni_type t)
+{
+	shm_dialer *d = arg;
+	return (nni_stream_dialer_set(d->ipc, nm, buf, sz, t));
+}
+
+// The socket is found at the path of the URL.
+static void
+shm_ipc_url(nng_url *ipc, const nng_url *url)
+{
+	memset(ipc, 0, sizeof(*ipc));
+	ipc->u_rawurl = url->u_rawurl;
+	ipc->u_scheme = "ipc";
+	ipc->u_path   = url->u_path;
+}
+
+int
+nni_shm_dialer_alloc(nng_stream_dialer **dp, const nng_url *url)
+{
+	shm_dialer *d;
+	nng_url     ipc;
+	int         rv;
+
+	if ((d = NNI_ALLOC_STRUCT(d)) == NULL) {
+		return (NNG_ENOMEM);
+	}
+	shm_ipc_url(&ipc, url);
+	if ((rv = nni_ipc_dialer_alloc(&d->ipc, &ipc)) != 0) {
+		NNI_FREE_STRUCT(d);
+		return (rv);
+	}
+
+	nni_mtx_init(&d->mtx);
+	nni_aio_list_init(&d->connq);
+	d->closed      = false;
+	d->sd.sd_free  = shm_dialer_free;
+	d->sd.sd_close = shm_dialer_close;
+	d->sd.sd_dial  = shm_dialer_dial;
+	d->sd.sd_get   = shm_dialer_get;
+	d->sd.sd_set   = shm_dialer_set;
+	nni_atomic_init_bool(&d->fini);
+	nni_atomic_init64(&d->ref);
+	nni_atomic_inc64(&d->ref);
+
+	*dp = (void *) d;
+	return (0);
+}
+
+// Listener stuff.
+static int
+shm_region_create(int *fdp, size_t len)
+{
+	int fd;
+
+#ifdef NNG_HAVE_MEMFD_CREATE
+	if ((fd = memfd_create("nng-shm", MFD_CLOEXEC)) < 0) {
+		return (nni_plat_errno(errno));
+	}
+#else
+	char name[64];
+
+	(void) snprintf(name, sizeof(name), "/nng-shm-%d-%08x", (int) getpid(),
+	    nni_random());
+	if ((fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600)) < 0) {
+		return (nni_plat_errno(errno));
+	}
+	(void) shm_unlink(name);
+	(void) fcntl(fd, F_SETFD, FD_CLOEXEC);
+#endif
+	if (ftruncate(fd, (off_t) len) != 0) {
+		int rv = nni_plat_errno(errno);
+		(void) close(fd);
+		return (rv);
+	}
+	*fdp = fd;
+	return (0);
+}
+
+static int
+shm_send_fds(int sock, int *fds, size_t nfds)
+{
+	struct msghdr   hdr;
+	struct iovec    iov;
+	struct cmsghdr *cmsg;
+	uint8_t         byte = 'S';
+	union {
+		struct cmsghdr align;
+		char           buf[CMSG_SPACE(sizeof(int) * 3)];
+	} ctl;
+
+	NNI_ASSERT(nfds <= 3);
+	memset(&hdr, 0, sizeof(hdr));
+	memset(&ctl, 0, sizeof(ctl));
+	iov.iov_base       = &byte;
+	iov.iov_len        = 1;
+	hdr.msg_iov        = &iov;
+	hdr.msg_iovlen     = 1;
+	hdr.msg_control    = ctl.buf;
+	hdr.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+
+	cmsg             = CMSG_FIRSTHDR(&hdr);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type  = SCM_RIGHTS;
+	cmsg->cmsg_len   = CMSG_LEN(sizeof(int) * nfds);
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * nfds);
+
+	// A fresh socket always has room for this.
+	if (sendmsg(sock, &hdr, MSG_NOSIGNAL) != 1) {
+		return (nni_plat_errno(errno));
+	}
+	return (0);
+}
+
+// Set up the region for a connection just accepted, and send it to the
+// dialer.
+static int
+shm_listener_conn(shm_conn *c)
+{
+	nni_ipc_conn *ic  = (void *) c->ctrl;
+	size_t        len = SHM_HDR_LEN + 2 * SHM_RING_SIZE;
+	uint8_t      *region;
+	shm_header   *hdr;
+	int           fds[3]; // the region, our eventfd, that of the dialer
+	int           rv;
+
+	if ((rv = shm_region_create(&fds[0], len)) != 0) {
+		return (rv);
+	}
+	if ((region = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED,
+	         fds[0], 0)) == MAP_FAILED) {
+		rv = nni_plat_errno(errno);
+		(void) close(fds[0]);
+		return (rv);
+	}
+	hdr            = (void *) region;
+	hdr->magic     = SHM_MAGIC;
+	hdr->version   = SHM_VERSION;
+	hdr->ring_size = SHM_RING_SIZE;
+
+	if ((fds[1] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0) {
+		rv = nni_plat_errno(errno);
+		(void) close(fds[0]);
+		(void) munmap(region, len);
+		return (rv);
+	}
+	if ((fds[2] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0) {
+		rv = nni_plat_errno(errno);
+		(void) close(fds[0]);
+		(void) close(fds[1]);
+		(void) munmap(region, len);
+		return (rv);
+	}
+	rv = shm_send_fds(nni_posix_pfd_fd(ic->pfd), fds, 3);
+	(void) close(fds[0]);
+	if (rv != 0) {
+		(void) close(fds[1]);
+		(void) close(fds[2]);
+		(void) munmap(region, len);
+		return (rv);
+	}
+	return (shm_start(c, region, len, fds[1], fds[2], false));
+}
+
+static void
+shm_listener_cb(void *arg)
+{
+	shm_listener *l = arg;
+	nni_aio      *uaio;
+	nng_stream   *ipc;
+	shm_conn     *c;
+	int           rv;
+
+	nni_mtx_lock(&l->mtx);
+	rv  = nni_aio_result(l->aio);
+	ipc = rv == 0 ? nni_aio_get_output(l->aio, 0) : NULL;
+	if ((uaio = nni_list_first(&l->acceptq)) == NULL) {
+		// the accept was cancelled
+		nni_mtx_unlock(&l->mtx);
+		if (ipc != NULL) {
+			nng_stream_free(ipc);
+		}
+		return;
+	}
+	nni_aio_list_remove(uaio);
+	if (rv == 0) {
+		if ((rv = shm_alloc(&c)) != 0) {
+			nng_stream_free(ipc);
+		} else {
+			c->ctrl = ipc;
+			if ((rv = shm_listener_conn(c)) != 0) {
+				nng_stream_free(&c->stream);
+			}
+		}
+	}
+	if (!nni_list_empty(&l->acceptq)) {
+		nng_stream_listener_accept(l->ipc, l->aio);
+	}
+	nni_mtx_unlock(&l->mtx);
+
+	if (rv != 0) {
+		nni_aio_finish_error(uaio, rv);
+		return;
+	}
+	nni_aio_set_output(uaio, 0, c);
+	nni_aio_finish(uaio, 0, 0);
+}
+
+static void
+shm_listener_cancel(nni_aio *aio, void *arg, int rv)
+{
+	shm_listener *l = arg;
+	bool          idle;
+
+	nni_mtx_lock(&l->mtx);
+	if (!nni_aio_list_active(aio)) {
+		nni_mtx_unlock(&l->mtx);
+		return;
+	}
+	nni_aio_list_remove(aio);
+	idle = nni_list_empty(&l->acceptq);
+	nni_mtx_unlock(&l->mtx);
+
+	nni_aio_finish_error(aio, rv);
+	if (idle) {
+		nni_aio_abort(l->aio, rv);
+	}
+}
+
+static void
+shm_listener_accept(void *arg, nni_aio *aio)
+{
+	shm_listener *l = arg;
+	int           rv;
+
+	if (nni_aio_begin(aio) != 0) {
+		return;
+	}
+	nni_mtx_lock(&l->mtx);
+	if (l->closed) {
+		nni_mtx_unlock(&l->mtx);
+		nni_aio_finish_error(aio, NNG_ECLOSED);
+		return;
+	}
+	if ((rv = nni_aio_schedule(aio, shm_listener_cancel, l)) != 0) {
+		nni_mtx_unlock(&l->mtx);
+		nni_aio_finish_error(aio, rv);
+		return;
+	}
+	nni_aio_list_append(&l->acceptq, aio);
+	if (nni_list_first(&l->acceptq) == aio) {
+		nng_stream_listener_accept(l->ipc, l->aio);
+	}
+	nni_mtx_unlock(&l->mtx);
+}
+
+static int
+shm_listener_listen(void *arg)
+{
+	shm_listener *l = arg;
+	return (nng_stream_listener_listen(l->ipc));
+}
+
+static void
+shm_listener_close(void *arg)
+{
+	shm_listener *l = arg;
+	nni_aio      *aio;
+
+	nni_mtx_lock(&l->mtx);
+	l->closed = true;
+	while ((aio = nni_list_first(&l->acceptq)) != NULL) {
+		nni_aio_list_remove(aio);
+		nni_aio_finish_error(aio, NNG_ECLOSED);
+	}
+	nni_mtx_unlock(&l->mtx);
+	nng_stream_listener_close(l->ipc);
+}
+
+static void
+shm_listener_free(void *arg)
+{
+	shm_listener *l = arg;
+
+	shm_listener_close(l);
+	nni_aio_stop(l->aio);
+	nng_stream_listener_free(l->ipc);
+	nni_aio_free(l->aio);
+	nni_mtx_fini(&l->mtx);
+	NNI_FREE_STRUCT(l);
+}
+
+static int
+shm_listener_get(
+    void *arg, const char *nm, void *buf, size_t *szp, nni_type t)
+{
+	shm_listener *l = arg;
+	return (nni_stream_listener_get(l->ipc, nm, buf, szp, t));
+}
+
+static int
+shm_listener_set(
+    void *arg, const char *nm, const void *buf, size_t sz, nni_type t)
+{
+	shm_listener *l = arg;
+	return (nni_stream_listener_set(l->ipc, nm, buf, sz, t));
+}
+
+int
+nni_shm_listener_alloc(nng_stream_listener **lp, const nng_url *url)
+{
+	shm_listener *l;
+	nng_url       ipc;
+	int           rv;
+
+	if ((l = NNI_ALLOC_STRUCT(l)) == NULL) {
+		return (NNG_ENOMEM);
+	}
+	shm_ipc_url(&ipc, url);
+	if ((rv = nni_aio_alloc(&l->aio, shm_listener_cb, l)) != 0) {
+		NNI_FREE_STRUCT(l);
+		return (rv);
+	}
+	if ((rv = nni_ipc_listener_alloc(&l->ipc, &ipc)) != 0) {
+		nni_aio_free(l->aio);
+		NNI_FREE_STRUCT(l);
+		return (rv);
+	}
+
+	nni_mtx_init(&l->mtx);
+	nni_aio_list_init(&l->acceptq);
+	l->sl.sl_free   = shm_listener_free;
+	l->sl.sl_close  = shm_listener_close;
+	l->sl.sl_listen = shm_listener_listen;
+	l->sl.sl_accept = shm_listener_accept;
+	l->sl.sl_get    = shm_listener_get;
+	l->sl.sl_set    = shm_listener_set;
+
+	*lp = (void *) l;
+	return (0);
+}
@@ -15,6 +15,7 @@
 #include "core/nng_impl.h"
 
 #include "platform/posix/posix_aio.h"
+#include "platform/posix/posix_uring.h"
 
 struct nni_tcp_conn {
 	nng_stream      stream;
@@ -26,6 +27,11 @@ struct nni_tcp_conn {
 	nni_aio *       dial_aio;
 	nni_tcp_dialer *dialer;
 	nni_reap_node   reap;
+#ifdef NNG_HAVE_IO_URING
+	bool               uring;
+	nni_posix_uring_io rio;
+	nni_posix_uring_io wio;
+#endif
 };
 
 struct nni_tcp_dialer {
@@ -188,6 +188,13 @@ tcp_close(void *arg)
 	if (!c->closed) {
 		nni_aio *aio;
 		c->closed = true;
+#ifdef NNG_HAVE_IO_URING
+		if (c->uring) {
+			// Anything with the kernel finishes at its CQE.
+			nni_posix_uring_io_close(&c->rio);
+			nni_posix_uring_io_close(&c->wio);
+		} else
+#endif
 		while (((aio = nni_list_first(&c->readq)) != NULL) ||
 		    ((aio = nni_list_first(&c->writeq)) != NULL)) {
 			nni_aio_list_remove(aio);
@@ -207,6 +214,12 @@ tcp_fini(void *arg)
 {
 	nni_tcp_conn *c = arg;
 	tcp_close(c);
+#ifdef NNG_HAVE_IO_URING
+	if (c->uring) {
+		nni_posix_uring_io_fini(&c->rio);
+		nni_posix_uring_io_fini(&c->wio);
+	}
+#endif
 	if (c->pfd != NULL) {
 		nni_posix_pfd_fini(c->pfd);
 	}
@@ -264,6 +277,13 @@ tcp_cancel(nni_aio *aio, void *arg, int rv)
 	nni_tcp_conn *c = arg;
 
 	nni_mtx_lock(&c->mtx);
+#ifdef NNG_HAVE_IO_URING
+	if (c->uring && (nni_posix_uring_io_cancel(&c->rio, aio, rv) ||
+	                    nni_posix_uring_io_cancel(&c->wio, aio, rv))) {
+		nni_mtx_unlock(&c->mtx);
+		return;
+	}
+#endif
 	if (nni_aio_list_active(aio)) {
 		nni_aio_list_remove(aio);
 		nni_aio_finish_error(aio, rv);
@@ -289,6 +309,13 @@ tcp_send(void *arg, nni_aio *aio)
 	}
 	nni_aio_list_append(&c->writeq, aio);
 
+#ifdef NNG_HAVE_IO_URING
+	if (c->uring) {
+		nni_posix_uring_io_start(&c->wio, nni_posix_pfd_fd(c->pfd));
+		nni_mtx_unlock(&c->mtx);
+		return;
+	}
+#endif
 	if (nni_list_first(&c->writeq) == aio) {
 		tcp_dowrite(c);
 		// If we are still the first thing on the list, that
@@ -319,6 +346,13 @@ tcp_recv(void *arg, nni_aio *aio)
 	}
 	nni_aio_list_append(&c->readq, aio);
 
+#ifdef NNG_HAVE_IO_URING
+	if (c->uring) {
+		nni_posix_uring_io_start(&c->rio, nni_posix_pfd_fd(c->pfd));
+		nni_mtx_unlock(&c->mtx);
+		return;
+	}
+#endif
 	// If we are only job on the list, go ahead and try to do an
 	// immediate transfer. This allows for faster completions in
 	// many cases.  We also need not arm a list if it was already
@@ -522,5 +556,18 @@ nni_posix_tcp_start(nni_tcp_conn *c, int nodelay, int keepalive)
 	(void) setsockopt(nni_posix_pfd_fd(c->pfd), SOL_SOCKET, SO_KEEPALIVE,
 	    &keepalive, sizeof(int));
 
+#ifdef NNG_HAVE_IO_URING
+	if (nni_posix_uring_enabled()) {
+		// The kernel does the I/O and tells us when it is done,
+		// so the poller is never armed.  The empty arm only makes
+		// the registration one shot, so a hangup cannot spin it.
+		c->uring = true;
+		nni_posix_uring_io_init(&c->rio, &c->mtx, &c->readq, false);
+		nni_posix_uring_io_init(&c->wio, &c->mtx, &c->writeq, true);
+		nni_posix_pfd_set_cb(c->pfd, NULL, NULL);
+		(void) nni_posix_pfd_arm(c->pfd, 0);
+		return;
+	}
+#endif
 	nni_posix_pfd_set_cb(c->pfd, tcp_cb, c);
 }
@@ -14,6 +14,7 @@
 #include <arpa/inet.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <netinet/in.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -33,6 +34,13 @@
 
 #include "posix_tcp.h"
 
+#ifdef NNG_HAVE_IO_URING
+#include <linux/io_uring.h>
+
+// Connections the kernel accepted for us before anyone asked.
+#define NNI_TCP_URING_BACKLOG 128
+#endif
+
 struct nni_tcp_listener {
 	nni_posix_pfd *pfd;
 	nni_list       acceptq;
@@ -40,7 +48,19 @@ struct nni_tcp_listener {
 	bool           closed;
 	bool           nodelay;
 	bool           keepalive;
+	bool           reuseport;
+	int            pollq; // pinned pollq of it and its conns, or -1
 	nni_mtx        mtx;
+#ifdef NNG_HAVE_IO_URING
+	bool               uring;
+	bool               multishot;
+	bool               accepting; // accept op is with the kernel
+	nni_posix_uring_op accept_op;
+	nni_cv             cv;
+	int                fds[NNI_TCP_URING_BACKLOG];
+	unsigned           fd_get;
+	unsigned           nfds;
+#endif
 };
 
 int
@@ -52,10 +72,14 @@ nni_tcp_listener_init(nni_tcp_listener **lp)
 	}
 
 	nni_mtx_init(&l->mtx);
+#ifdef NNG_HAVE_IO_URING
+	nni_cv_init(&l->cv, &l->mtx);
+#endif
 
 	l->pfd     = NULL;
 	l->closed  = false;
 	l->started = false;
+	l->pollq   = -1;
 
 	nni_aio_list_init(&l->acceptq);
 	*lp = l;
@@ -72,6 +96,16 @@ tcp_listener_doclose(nni_tcp_listener *l)
 		nni_aio_list_remove(aio);
 		nni_aio_finish_error(aio, NNG_ECLOSED);
 	}
+#ifdef NNG_HAVE_IO_URING
+	while (l->nfds > 0) {
+		(void) close(l->fds[l->fd_get]);
+		l->fd_get = (l->fd_get + 1) % NNI_TCP_URING_BACKLOG;
+		l->nfds--;
+	}
+	if (l->accepting) {
+		nni_posix_uring_cancel(&l->accept_op);
+	}
+#endif
 
 	if (l->pfd != NULL) {
 		nni_posix_pfd_close(l->pfd);
@@ -86,19 +120,136 @@ nni_tcp_listener_close(nni_tcp_listener *l)
 	nni_mtx_unlock(&l->mtx);
 }
 
+// tcp_listener_conn completes the accept aio with a stream for newfd.
+static void
+tcp_listener_conn(nni_tcp_listener *l, nni_aio *aio, int newfd)
+{
+	int            rv;
+	int            nd;
+	int            ka;
+	nni_posix_pfd *pfd;
+	nni_tcp_conn  *c;
+
+	nni_aio_list_remove(aio);
+	if ((rv = nni_posix_tcp_alloc(&c, NULL)) != 0) {
+		close(newfd);
+		nni_aio_finish_error(aio, rv);
+		return;
+	}
+
+	rv = l->pollq < 0 ? nni_posix_pfd_init(&pfd, newfd)
+	                  : nni_posix_pfd_init_pollq(&pfd, newfd, l->pollq);
+	if (rv != 0) {
+		close(newfd);
+		nng_stream_free(&c->stream);
+		nni_aio_finish_error(aio, rv);
+		return;
+	}
+
+	nni_posix_tcp_init(c, pfd);
+
+	ka = l->keepalive ? 1 : 0;
+	nd = l->nodelay ? 1 : 0;
+	nni_posix_tcp_start(c, nd, ka);
+	nni_aio_set_output(aio, 0, c);
+	nni_aio_finish(aio, 0, 0);
+}
+
+#ifdef NNG_HAVE_IO_URING
+static void tcp_listener_uring_cb(nni_posix_uring_op *, int, unsigned);
+
+// With io_uring, one multishot accept keeps handing us connections
+// until it is canceled; they wait in fds until an accept aio shows
+// up.  The accept is started when someone is waiting, and stopped
+// when fds is full, leaving the rest in the kernel backlog.
+static void
+tcp_listener_uring_doaccept(nni_tcp_listener *l)
+{
+	nni_aio *aio;
+
+	while ((l->nfds > 0) && ((aio = nni_list_first(&l->acceptq)) != NULL)) {
+		int newfd = l->fds[l->fd_get];
+		l->fd_get = (l->fd_get + 1) % NNI_TCP_URING_BACKLOG;
+		l->nfds--;
+		tcp_listener_conn(l, aio, newfd);
+	}
+	if (l->accepting || l->closed || nni_list_empty(&l->acceptq) ||
+	    (l->nfds == NNI_TCP_URING_BACKLOG)) {
+		return;
+	}
+	l->accept_op.cb     = tcp_listener_uring_cb;
+	l->accept_op.arg    = l;
+	l->accept_op.opcode = IORING_OP_ACCEPT;
+	l->accept_op.ioprio = l->multishot ? IORING_ACCEPT_MULTISHOT : 0;
+	l->accept_op.fd     = nni_posix_pfd_fd(l->pfd);
+	l->accept_op.addr   = NULL;
+	l->accept_op.len    = 0;
+	l->accept_op.flags  = SOCK_CLOEXEC;
+	l->accepting        = true;
+	nni_posix_uring_submit(&l->accept_op);
+}
+
+static void
+tcp_listener_uring_cb(nni_posix_uring_op *op, int res, unsigned flags)
+{
+	nni_tcp_listener *l = op->arg;
+	nni_aio          *aio;
+
+	nni_mtx_lock(&l->mtx);
+	if (res >= 0) {
+		if (l->closed) {
+			(void) close(res);
+		} else {
+			l->fds[(l->fd_get + l->nfds) % NNI_TCP_URING_BACKLOG] =
+			    res;
+			l->nfds++;
+		}
+	}
+	if ((flags & IORING_CQE_F_MORE) == 0) {
+		l->accepting = false;
+		nni_cv_wake(&l->cv);
+		switch (res) {
+		case -EINVAL:
+			if (l->multishot) {
+				// Before 5.19; accept one at a time.
+				l->multishot = false;
+				break;
+			}
+			// FALLTHROUGH
+		default:
+			if ((res < 0) && (res != -ECANCELED) &&
+			    (res != -ECONNABORTED) && (res != -ECONNRESET) &&
+			    (res != -EINTR) &&
+			    ((aio = nni_list_first(&l->acceptq)) != NULL)) {
+				// Like accept(), fail one and carry on.
+				nni_aio_list_remove(aio);
+				nni_aio_finish_error(aio, nni_plat_errno(-res));
+			}
+			break;
+		}
+	} else if (l->nfds == NNI_TCP_URING_BACKLOG) {
+		nni_posix_uring_cancel(op);
+	}
+	tcp_listener_uring_doaccept(l);
+	nni_mtx_unlock(&l->mtx);
+}
+#endif
+
 static void
 tcp_listener_doaccept(nni_tcp_listener *l)
 {
 	nni_aio *aio;
 
+#ifdef NNG_HAVE_IO_URING
+	if (l->uring) {
+		tcp_listener_uring_doaccept(l);
+		return;
+	}
+#endif
 	while ((aio = nni_list_first(&l->acceptq)) != NULL) {
-		int            newfd;
-		int            fd;
-		int            rv;
-		int            nd;
-		int            ka;
-		nni_posix_pfd *pfd;
-		nni_tcp_conn  *c;
+		int newfd;
+		int fd;
+		int rv;
 
 		fd = nni_posix_pfd_fd(l->pfd);
 
@@ -140,29 +291,7 @@ tcp_listener_doaccept(nni_tcp_listener *l)
 			}
 		}
 
-		if ((rv = nni_posix_tcp_alloc(&c, NULL)) != 0) {
-			close(newfd);
-			nni_aio_list_remove(aio);
-			nni_aio_finish_error(aio, rv);
-			continue;
-		}
-
-		if ((rv = nni_posix_pfd_init(&pfd, newfd)) != 0) {
-			close(newfd);
-			nng_stream_free(&c->stream);
-			nni_aio_list_remove(aio);
-			nni_aio_finish_error(aio, rv);
-			continue;
-		}
-
-		nni_posix_tcp_init(c, pfd);
-
-		ka = l->keepalive ? 1 : 0;
-		nd = l->nodelay ? 1 : 0;
-		nni_aio_list_remove(aio);
-		nni_posix_tcp_start(c, nd, ka);
-		nni_aio_set_output(aio, 0, c);
-		nni_aio_finish(aio, 0, 0);
+		tcp_listener_conn(l, aio, newfd);
 	}
 }
 
@@ -234,7 +363,9 @@ nni_tcp_listener_listen(nni_tcp_listener *l, const nni_sockaddr *sa)
 		return (nni_plat_errno(errno));
 	}
 
-	if ((rv = nni_posix_pfd_init(&pfd, fd)) != 0) {
+	rv = l->pollq < 0 ? nni_posix_pfd_init(&pfd, fd)
+	                  : nni_posix_pfd_init_pollq(&pfd, fd, l->pollq);
+	if (rv != 0) {
 		nni_mtx_unlock(&l->mtx);
 		(void) close(fd);
 		return (rv);
@@ -253,6 +384,24 @@ nni_tcp_listener_listen(nni_tcp_listener *l, const nni_sockaddr *sa)
 	}
 #endif
 
+	if (l->reuseport) {
+#ifdef SO_REUSEPORT
+		int on = 1;
+		// Unlike SO_REUSEADDR, sharing the port is the point here.
+		if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) !=
+		    0) {
+			rv = nni_plat_errno(errno);
+			nni_mtx_unlock(&l->mtx);
+			nni_posix_pfd_fini(pfd);
+			return (rv);
+		}
+#else
+		nni_mtx_unlock(&l->mtx);
+		nni_posix_pfd_fini(pfd);
+		return (NNG_ENOTSUP);
+#endif
+	}
+
 	if (bind(fd, (struct sockaddr *) &ss, len) < 0) {
 		rv = nni_plat_errno(errno);
 		nni_mtx_unlock(&l->mtx);
@@ -273,6 +422,12 @@ nni_tcp_listener_listen(nni_tcp_listener *l, const nni_sockaddr *sa)
 
 	l->pfd     = pfd;
 	l->started = true;
+#ifdef NNG_HAVE_IO_URING
+	if (nni_posix_uring_enabled()) {
+		l->uring     = true;
+		l->multishot = true;
+	}
+#endif
 	nni_mtx_unlock(&l->mtx);
 
 	return (0);
@@ -285,12 +440,20 @@ nni_tcp_listener_fini(nni_tcp_listener *l)
 
 	nni_mtx_lock(&l->mtx);
 	tcp_listener_doclose(l);
+#ifdef NNG_HAVE_IO_URING
+	while (l->accepting) {
+		nni_cv_wait(&l->cv);
+	}
+#endif
 	pfd = l->pfd;
 	nni_mtx_unlock(&l->mtx);
 
 	if (pfd != NULL) {
 		nni_posix_pfd_fini(pfd);
 	}
+#ifdef NNG_HAVE_IO_URING
+	nni_cv_fini(&l->cv);
+#endif
 	nni_mtx_fini(&l->mtx);
 	NNI_FREE_STRUCT(l);
 }
@@ -404,6 +567,69 @@ tcp_listener_get_keepalive(void *arg, void *buf, size_t *szp, nni_type t)
 	return (nni_copyout_bool(b, buf, szp, t));
 }
 
+static int
+tcp_listener_set_reuseport(void *arg, const void *buf, size_t sz, nni_type t)
+{
+	nni_tcp_listener *l = arg;
+	int               rv;
+	bool              b;
+
+	if (((rv = nni_copyin_bool(&b, buf, sz, t)) != 0) || (l == NULL)) {
+		return (rv);
+	}
+	nni_mtx_lock(&l->mtx);
+	if (l->started) {
+		nni_mtx_unlock(&l->mtx);
+		return (NNG_EBUSY);
+	}
+	l->reuseport = b;
+	nni_mtx_unlock(&l->mtx);
+	return (0);
+}
+
+static int
+tcp_listener_get_reuseport(void *arg, void *buf, size_t *szp, nni_type t)
+{
+	bool              b;
+	nni_tcp_listener *l = arg;
+	nni_mtx_lock(&l->mtx);
+	b = l->reuseport;
+	nni_mtx_unlock(&l->mtx);
+	return (nni_copyout_bool(b, buf, szp, t));
+}
+
+static int
+tcp_listener_set_poller(void *arg, const void *buf, size_t sz, nni_type t)
+{
+	nni_tcp_listener *l = arg;
+	int               rv;
+	int               n;
+
+	if (((rv = nni_copyin_int(&n, buf, sz, -1, INT_MAX, t)) != 0) ||
+	    (l == NULL)) {
+		return (rv);
+	}
+	nni_mtx_lock(&l->mtx);
+	if (l->started) {
+		nni_mtx_unlock(&l->mtx);
+		return (NNG_EBUSY);
+	}
+	l->pollq = n;
+	nni_mtx_unlock(&l->mtx);
+	return (0);
+}
+
+static int
+tcp_listener_get_poller(void *arg, void *buf, size_t *szp, nni_type t)
+{
+	int               n;
+	nni_tcp_listener *l = arg;
+	nni_mtx_lock(&l->mtx);
+	n = l->pollq;
+	nni_mtx_unlock(&l->mtx);
+	return (nni_copyout_int(n, buf, szp, t));
+}
+
 static const nni_option tcp_listener_options[] = {
 	{
 	    .o_name = NNG_OPT_LOCADDR,
@@ -419,6 +645,16 @@ static const nni_option tcp_listener_options[] = {
 	    .o_set  = tcp_listener_set_keepalive,
 	    .o_get  = tcp_listener_get_keepalive,
 	},
+	{
+	    .o_name = NNG_OPT_TCP_REUSEPORT,
+	    .o_set  = tcp_listener_set_reuseport,
+	    .o_get  = tcp_listener_get_reuseport,
+	},
+	{
+	    .o_name = NNG_OPT_TCP_POLLER,
+	    .o_set  = tcp_listener_set_poller,
+	    .o_get  = tcp_listener_get_poller,
+	},
 	{
 	    .o_name = NULL,
 	},
@@ -401,8 +401,24 @@ nni_plat_init(int (*helper)(void))
 		return (rv);
 	}
 
+#ifdef NNG_HAVE_IO_URING
+	// If the kernel has no io_uring for us, this still succeeds
+	// and the streams stay on the pollq.
+	if ((rv = nni_posix_uring_sysinit()) != 0) {
+		pthread_mutex_unlock(&nni_plat_init_lock);
+		nni_posix_pollq_sysfini();
+		pthread_mutexattr_destroy(&nni_mxattr);
+		pthread_condattr_destroy(&nni_cvattr);
+		pthread_attr_destroy(&nni_thrattr);
+		return (rv);
+	}
+#endif
+
 	if ((rv = nni_posix_resolv_sysinit()) != 0) {
 		pthread_mutex_unlock(&nni_plat_init_lock);
+#ifdef NNG_HAVE_IO_URING
+		nni_posix_uring_sysfini();
+#endif
 		nni_posix_pollq_sysfini();
 		pthread_mutexattr_destroy(&nni_mxattr);
 		pthread_condattr_destroy(&nni_cvattr);
@@ -413,6 +429,9 @@ nni_plat_init(int (*helper)(void))
 	if (pthread_atfork(NULL, NULL, nni_atfork_child) != 0) {
 		pthread_mutex_unlock(&nni_plat_init_lock);
 		nni_posix_resolv_sysfini();
+#ifdef NNG_HAVE_IO_URING
+		nni_posix_uring_sysfini();
+#endif
 		nni_posix_pollq_sysfini();
 		pthread_mutexattr_destroy(&nni_mxattr);
 		pthread_condattr_destroy(&nni_cvattr);
@@ -433,6 +452,9 @@ nni_plat_fini(void)
 	pthread_mutex_lock(&nni_plat_init_lock);
 	if (nni_plat_inited) {
 		nni_posix_resolv_sysfini();
+#ifdef NNG_HAVE_IO_URING
+		nni_posix_uring_sysfini();
+#endif
 		nni_posix_pollq_sysfini();
 		pthread_mutexattr_destroy(&nni_mxattr);
 		pthread_condattr_destroy(&nni_cvattr);
@@ -0,0 +1,505 @@
+//
+// Copyright 2024 NanoMQ Team, Inc. <jaylin@emqx.io>
+//
+// This software is supplied under the terms of the MIT License, a
+// copy of which should be located in the distribution where this
+// file was obtained (LICENSE.txt).  A copy of the license may also be
+// found online at https://opensource.org/licenses/MIT.
+//
+
+#include "core/nng_impl.h"
+
+#ifdef NNG_HAVE_IO_URING
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "platform/posix/posix_uring.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define NNI_URING_ENTRIES 1024
+
+// We need the kernel to poll sockets for us (FAST_POLL), to never drop
+// a completion (NODROP), and to be done with the SQE once it has been
+// submitted (SUBMIT_STABLE).  Those arrived in 5.7.
+#define NNI_URING_FEATURES                                            \
+	(IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP |                \
+	    IORING_FEAT_SUBMIT_STABLE | IORING_FEAT_FAST_POLL)
+
+// Locking strategy:
+//
+// The ring mutex protects the SQ tail and the SQE slots.  Any thread
+// may queue SQEs.  The first one to find nobody flushing becomes the
+// flusher, and keeps entering the kernel until every queued SQE has
+// been handed over; the others just leave theirs behind for it.  When
+// many connections are busy, one system call submits all of them.
+//
+// The CQ is only ever touched by the completion thread, which runs
+// the callbacks without holding the ring mutex.  SQEs queued from a
+// callback are submitted with the next wait for completions.
+
+typedef struct nni_posix_uring {
+	int                  fd;
+	bool                 enabled;
+	bool                 flushing;
+	nni_mtx              mtx;
+	nni_thr              thr;
+	nni_posix_uring_op   stop;
+	void *               ring;
+	size_t               ring_sz;
+	struct io_uring_sqe *sqes;
+	size_t               sqes_sz;
+	unsigned             sq_entries;
+	unsigned             sq_tail;
+	unsigned *           sq_khead;
+	unsigned *           sq_ktail;
+	unsigned *           sq_mask;
+	unsigned *           sq_array;
+	unsigned *           cq_khead;
+	unsigned *           cq_ktail;
+	unsigned *           cq_mask;
+	struct io_uring_cqe *cqes;
+} nni_posix_uring;
+
+static nni_posix_uring nni_posix_global_uring;
+
+static int
+uring_setup(unsigned entries, struct io_uring_params *p)
+{
+	return ((int) syscall(__NR_io_uring_setup, entries, p));
+}
+
+static int
+uring_enter(int fd, unsigned submit, unsigned wait, unsigned flags)
+{
+	return ((int) syscall(
+	    __NR_io_uring_enter, fd, submit, wait, flags, NULL, 0));
+}
+
+// Number of SQEs we have queued that the kernel has not consumed.
+static unsigned
+uring_unsubmitted(nni_posix_uring *u)
+{
+	unsigned tail = __atomic_load_n(&u->sq_tail, __ATOMIC_RELAXED);
+	return (tail - __atomic_load_n(u->sq_khead, __ATOMIC_ACQUIRE));
+}
+
+static void
+uring_enter_submit(nni_posix_uring *u, unsigned n)
+{
+	while (uring_enter(u->fd, n, 0, 0) < 0) {
+		switch (errno) {
+		case EINTR:
+		case EAGAIN:
+		case EBUSY:
+			// Transient; the completion thread is draining.
+			continue;
+		default:
+			nni_panic("BUG! io_uring submit failed: %d", errno);
+		}
+	}
+}
+
+// uring_push queues one SQE.  Called with the ring mutex held.
+static void
+uring_push(nni_posix_uring *u, const nni_posix_uring_op *op, uint64_t data)
+{
+	struct io_uring_sqe *sqe;
+	unsigned             idx;
+	unsigned             n;
+
+	// Full SQ, just hand the kernel what we have.  This is rare,
+	// the SQ holds only the SQEs that were not flushed yet.
+	while ((n = uring_unsubmitted(u)) == u->sq_entries) {
+		uring_enter_submit(u, n);
+	}
+
+	idx = u->sq_tail & *u->sq_mask;
+	sqe = &u->sqes[idx];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode    = op->opcode;
+	sqe->ioprio    = op->ioprio;
+	sqe->fd        = op->fd;
+	sqe->addr      = (uint64_t) (uintptr_t) op->addr;
+	sqe->len       = op->len;
+	sqe->rw_flags  = op->flags;
+	sqe->user_data = data;
+
+	u->sq_array[idx] = idx;
+	u->sq_tail++;
+	__atomic_store_n(u->sq_ktail, u->sq_tail, __ATOMIC_RELEASE);
+}
+
+// uring_flush is called with the ring mutex held, and drops it.
+static void
+uring_flush(nni_posix_uring *u)
+{
+	unsigned n;
+
+	if (u->flushing || nni_thr_is_self(&u->thr)) {
+		nni_mtx_unlock(&u->mtx);
+		return;
+	}
+	u->flushing = true;
+	while ((n = uring_unsubmitted(u)) != 0) {
+		nni_mtx_unlock(&u->mtx);
+		uring_enter_submit(u, n);
+		nni_mtx_lock(&u->mtx);
+	}
+	u->flushing = false;
+	nni_mtx_unlock(&u->mtx);
+}
+
+bool
+nni_posix_uring_enabled(void)
+{
+	return (nni_posix_global_uring.enabled);
+}
+
+void
+nni_posix_uring_submit(nni_posix_uring_op *op)
+{
+	nni_posix_uring *u = &nni_posix_global_uring;
+
+	nni_mtx_lock(&u->mtx);
+	uring_push(u, op, (uint64_t) (uintptr_t) op);
+	uring_flush(u);
+}
+
+void
+nni_posix_uring_cancel(nni_posix_uring_op *op)
+{
+	nni_posix_uring *  u = &nni_posix_global_uring;
+	nni_posix_uring_op cancel;
+
+	// The completion of the cancel itself is of no interest to
+	// anyone, so it carries no op.
+	memset(&cancel, 0, sizeof(cancel));
+	cancel.opcode = IORING_OP_ASYNC_CANCEL;
+	cancel.fd     = -1;
+	cancel.addr   = op;
+
+	nni_mtx_lock(&u->mtx);
+	uring_push(u, &cancel, 0);
+	uring_flush(u);
+}
+
+static void
+uring_thr(void *arg)
+{
+	nni_posix_uring *u = arg;
+
+	for (;;) {
+		unsigned head;
+		unsigned tail;
+
+		if (uring_enter(u->fd, uring_unsubmitted(u), 1,
+		        IORING_ENTER_GETEVENTS) < 0) {
+			switch (errno) {
+			case EINTR:
+			case EAGAIN:
+			case EBUSY:
+				break;
+			default:
+				nni_panic(
+				    "BUG! io_uring wait failed: %d", errno);
+			}
+		}
+
+		head = *u->cq_khead;
+		tail = __atomic_load_n(u->cq_ktail, __ATOMIC_ACQUIRE);
+		while (head != tail) {
+			struct io_uring_cqe *cqe;
+			nni_posix_uring_op * op;
+			int                  res;
+			unsigned             flags;
+
+			cqe   = &u->cqes[head & *u->cq_mask];
+			op    = (void *) (uintptr_t) cqe->user_data;
+			res   = cqe->res;
+			flags = cqe->flags;
+			head++;
+			__atomic_store_n(u->cq_khead, head, __ATOMIC_RELEASE);
+
+			if (op == &u->stop) {
+				return;
+			}
+			if (op != NULL) {
+				op->cb(op, res, flags);
+			}
+			if (head == tail) {
+				tail = __atomic_load_n(
+				    u->cq_ktail, __ATOMIC_ACQUIRE);
+			}
+		}
+	}
+}
+
+static void
+uring_unmap(nni_posix_uring *u)
+{
+	if (u->sqes != NULL) {
+		(void) munmap(u->sqes, u->sqes_sz);
+	}
+	if (u->ring != NULL) {
+		(void) munmap(u->ring, u->ring_sz);
+	}
+	(void) close(u->fd);
+}
+
+static int
+uring_create(nni_posix_uring *u)
+{
+	struct io_uring_params p;
+	size_t                 sq_sz;
+	size_t                 cq_sz;
+	uint8_t *              ring;
+
+	memset(&p, 0, sizeof(p));
+	if ((u->fd = uring_setup(NNI_URING_ENTRIES, &p)) < 0) {
+		return (nni_plat_errno(errno));
+	}
+	if ((p.features & NNI_URING_FEATURES) != NNI_URING_FEATURES) {
+		(void) close(u->fd);
+		return (NNG_ENOTSUP);
+	}
+
+	sq_sz      = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	cq_sz      = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	u->ring_sz = sq_sz > cq_sz ? sq_sz : cq_sz;
+	u->ring    = mmap(NULL, u->ring_sz, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+	if (u->ring == MAP_FAILED) {
+		u->ring = NULL;
+		uring_unmap(u);
+		return (NNG_ENOMEM);
+	}
+	u->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+	u->sqes    = mmap(NULL, u->sqes_sz, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+	if (u->sqes == MAP_FAILED) {
+		u->sqes = NULL;
+		uring_unmap(u);
+		return (NNG_ENOMEM);
+	}
+
+	ring          = u->ring;
+	u->sq_entries = p.sq_entries;
+	u->sq_khead   = (unsigned *) (ring + p.sq_off.head);
+	u->sq_ktail   = (unsigned *) (ring + p.sq_off.tail);
+	u->sq_mask    = (unsigned *) (ring + p.sq_off.ring_mask);
+	u->sq_array   = (unsigned *) (ring + p.sq_off.array);
+	u->sq_tail    = *u->sq_ktail;
+	u->cq_khead   = (unsigned *) (ring + p.cq_off.head);
+	u->cq_ktail   = (unsigned *) (ring + p.cq_off.tail);
+	u->cq_mask    = (unsigned *) (ring + p.cq_off.ring_mask);
+	u->cqes       = (struct io_uring_cqe *) (ring + p.cq_off.cqes);
+	return (0);
+}
+
+int
+nni_posix_uring_sysinit(void)
+{
+	nni_posix_uring *u = &nni_posix_global_uring;
+	int              rv;
+
+	memset(u, 0, sizeof(*u));
+	if (uring_create(u) != 0) {
+		// Old kernel, seccomp, or io_uring_disabled.  None of
+		// that is fatal, we just stay with the pollq.
+		log_info("io_uring unavailable, using the poller for streams");
+		return (0);
+	}
+	nni_mtx_init(&u->mtx);
+	u->stop.opcode = IORING_OP_NOP;
+	u->stop.fd     = -1;
+	if ((rv = nni_thr_init(&u->thr, uring_thr, u)) != 0) {
+		nni_mtx_fini(&u->mtx);
+		uring_unmap(u);
+		return (rv);
+	}
+	nni_thr_set_name(&u->thr, "nng:poll:uring");
+	nni_thr_run(&u->thr);
+	u->enabled = true;
+	return (0);
+}
+
+void
+nni_posix_uring_sysfini(void)
+{
+	nni_posix_uring *u = &nni_posix_global_uring;
+
+	if (!u->enabled) {
+		return;
+	}
+	u->enabled = false;
+	nni_posix_uring_submit(&u->stop);
+	nni_thr_fini(&u->thr);
+	nni_mtx_fini(&u->mtx);
+	uring_unmap(u);
+}
+
+static void uring_io_cb(nni_posix_uring_op *, int, unsigned);
+
+void
+nni_posix_uring_io_init(
+    nni_posix_uring_io *io, nni_mtx *mtx, nni_list *q, bool write)
+{
+	memset(io, 0, sizeof(*io));
+	io->mtx    = mtx;
+	io->q      = q;
+	io->write  = write;
+	io->op.cb  = uring_io_cb;
+	io->op.arg = io;
+	io->op.fd  = -1;
+	nni_cv_init(&io->cv, mtx);
+}
+
+void
+nni_posix_uring_io_fini(nni_posix_uring_io *io)
+{
+	// The kernel may still be writing into the iov of the last aio.
+	nni_mtx_lock(io->mtx);
+	while (io->busy != NULL) {
+		nni_cv_wait(&io->cv);
+	}
+	nni_mtx_unlock(io->mtx);
+	nni_cv_fini(&io->cv);
+}
+
+void
+nni_posix_uring_io_start(nni_posix_uring_io *io, int fd)
+{
+	nni_aio *aio;
+
+	if ((io->busy != NULL) || io->closed) {
+		return;
+	}
+	while ((aio = nni_list_first(io->q)) != NULL) {
+		unsigned naiov;
+		nni_iov *aiov;
+		int      niov;
+
+		nni_aio_get_iov(aio, &naiov, &aiov);
+		if (naiov > NNI_NUM_ELEMENTS(io->iov)) {
+			nni_aio_list_remove(aio);
+			nni_aio_finish_error(aio, NNG_EINVAL);
+			continue;
+		}
+		niov = 0;
+		for (unsigned i = 0; i < naiov; i++) {
+			if (aiov[i].iov_len != 0) {
+				io->iov[niov].iov_len  = aiov[i].iov_len;
+				io->iov[niov].iov_base = aiov[i].iov_buf;
+				niov++;
+			}
+		}
+		memset(&io->hdr, 0, sizeof(io->hdr));
+		io->hdr.msg_iov    = io->iov;
+		io->hdr.msg_iovlen = niov;
+
+		io->op.opcode = io->write ? IORING_OP_SENDMSG : IORING_OP_RECVMSG;
+		io->op.flags  = io->write ? MSG_NOSIGNAL : 0;
+		io->op.fd     = fd;
+		io->op.addr   = &io->hdr;
+		io->op.len    = 1;
+		io->busy      = aio;
+		io->rv        = 0;
+		nni_posix_uring_submit(&io->op);
+		return;
+	}
+}
+
+bool
+nni_posix_uring_io_cancel(nni_posix_uring_io *io, nni_aio *aio, int rv)
+{
+	if (aio != io->busy) {
+		return (false);
+	}
+	if (io->rv == 0) {
+		io->rv = rv;
+		nni_posix_uring_cancel(&io->op);
+	}
+	// The kernel may use the iov until the CQE, which finishes the
+	// aio.  Callers (nni_aio_fini) need it finished before we return.
+	while (io->busy == aio) {
+		nni_cv_wait(&io->cv);
+	}
+	return (true);
+}
+
+void
+nni_posix_uring_io_close(nni_posix_uring_io *io)
+{
+	nni_aio *aio;
+
+	io->closed = true;
+	aio        = nni_list_first(io->q);
+	while (aio != NULL) {
+		nni_aio *next = nni_list_next(io->q, aio);
+		if (aio != io->busy) {
+			nni_aio_list_remove(aio);
+			nni_aio_finish_error(aio, NNG_ECLOSED);
+		}
+		aio = next;
+	}
+	if (io->busy != NULL && io->rv == 0) {
+		io->rv = NNG_ECLOSED;
+		nni_posix_uring_cancel(&io->op);
+	}
+}
+
+static void
+uring_io_cb(nni_posix_uring_op *op, int res, unsigned flags)
+{
+	nni_posix_uring_io *io = op->arg;
+	nni_aio *           aio;
+	int                 rv;
+
+	NNI_ARG_UNUSED(flags);
+
+	nni_mtx_lock(io->mtx);
+	aio      = io->busy;
+	io->busy = NULL;
+
+	if ((res == -ECANCELED || res == -EINTR) && (io->rv == 0) &&
+	    !io->closed) {
+		// Nobody asked for this.  The kernel cancels requests of
+		// a thread that exits, or a stale cancel caught the next
+		// op.  Either way the aio is still ours to do.
+		nni_posix_uring_io_start(io, op->fd);
+		nni_mtx_unlock(io->mtx);
+		return;
+	}
+
+	if (res < 0) {
+		rv = io->rv != 0 ? io->rv : nni_plat_errno(-res);
+	} else if ((res == 0) && !io->write) {
+		// No bytes indicates a closed descriptor.
+		rv = io->rv != 0 ? io->rv : NNG_ECONNSHUT;
+	} else {
+		rv = 0;
+	}
+	io->rv = 0;
+
+	nni_aio_list_remove(aio);
+	if (rv != 0) {
+		nni_aio_finish_error(aio, rv);
+	} else {
+		nni_aio_bump_count(aio, res);
+		nni_aio_finish(aio, 0, nni_aio_count(aio));
+	}
+	nni_cv_wake(&io->cv);
+
+	nni_posix_uring_io_start(io, op->fd);
+	nni_mtx_unlock(io->mtx);
+}
+
+#endif // NNG_HAVE_IO_URING
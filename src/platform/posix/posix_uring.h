@@ -0,0 +1,75 @@
+//
+// Copyright 2024 NanoMQ Team, Inc. <jaylin@emqx.io>
+//
+// This software is supplied under the terms of the MIT License, a
+// copy of which should be located in the distribution where this
+// file was obtained (LICENSE.txt).  A copy of the license may also be
+// found online at https://opensource.org/licenses/MIT.
+//
+
+#ifndef PLATFORM_POSIX_URING_H
+#define PLATFORM_POSIX_URING_H
+
+#include "core/nng_impl.h"
+
+#ifdef NNG_HAVE_IO_URING
+
+// This is an optional completion based backend for stream sockets on
+// Linux.  Rather than waiting for readiness and then doing the I/O
+// ourselves, we hand the kernel the iov of the aio and are told when
+// it is done.  All streams share a single ring, so that SQEs queued
+// by many connections are handed to the kernel with one system call.
+// If the kernel cannot give us a ring, nni_posix_uring_enabled()
+// returns false and the streams stay on the pollq.
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+typedef struct nni_posix_uring_op nni_posix_uring_op;
+
+// The callback is run on the completion thread with the CQE result
+// (a negative errno on failure) and the CQE flags.
+typedef void (*nni_posix_uring_cb)(nni_posix_uring_op *, int, unsigned);
+
+struct nni_posix_uring_op {
+	nni_posix_uring_cb cb;
+	void *             arg;
+	uint8_t            opcode;
+	uint16_t           ioprio;
+	int                fd;
+	void *             addr;
+	uint32_t           len;
+	uint32_t           flags; // msg_flags or accept_flags
+};
+
+// nni_posix_uring_io runs one direction (reads or writes) of a stream.
+// Only the aio at the head of the queue is ever with the kernel.  The
+// start, cancel and close functions are called with the lock of the
+// stream held.
+typedef struct nni_posix_uring_io {
+	nni_posix_uring_op op;
+	nni_mtx *          mtx;
+	nni_cv             cv;
+	nni_list *         q;
+	nni_aio *          busy;
+	int                rv; // result for busy, when it was canceled
+	bool               write;
+	bool               closed;
+	struct msghdr      hdr;
+	struct iovec       iov[16];
+} nni_posix_uring_io;
+
+extern bool nni_posix_uring_enabled(void);
+extern void nni_posix_uring_submit(nni_posix_uring_op *);
+extern void nni_posix_uring_cancel(nni_posix_uring_op *);
+
+extern void nni_posix_uring_io_init(
+    nni_posix_uring_io *, nni_mtx *, nni_list *, bool);
+extern void nni_posix_uring_io_fini(nni_posix_uring_io *);
+extern void nni_posix_uring_io_start(nni_posix_uring_io *, int);
+extern bool nni_posix_uring_io_cancel(nni_posix_uring_io *, nni_aio *, int);
+extern void nni_posix_uring_io_close(nni_posix_uring_io *);
+
+#endif // NNG_HAVE_IO_URING
+
+#endif // PLATFORM_POSIX_URING_H
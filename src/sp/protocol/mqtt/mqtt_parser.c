@@ -13,6 +13,7 @@
 #include "nng/protocol/mqtt/mqtt.h"
 #include "nng/protocol/mqtt/mqtt_parser.h"
 #include "supplemental/mqtt/mqtt_msg.h"
+#include "mqtt_simd.h"
 
 #include "nng/mqtt/packet.h"
 // #include <iconv.h>
@@ -40,9 +41,6 @@ struct pub_extra {
 	void *   msg;
 };
 
-static uint8_t  get_value_size(uint64_t value);
-static uint64_t power(uint64_t x, uint32_t n);
-
 pub_extra *
 pub_extra_alloc(pub_extra *extra)
 {
@@ -93,44 +91,6 @@ pub_extra_set_msg(pub_extra *pub_extra, void *msg)
 	pub_extra->msg = msg;
 }
 
-static uint64_t
-power(uint64_t x, uint32_t n)
-{
-	uint64_t val = 1;
-
-	for (uint32_t i = 0; i <= n; ++i) {
-		val = x * val;
-	}
-
-	return val / x;
-}
-
-/**
- * get size from value
- *
- * @param value
- * @return
- */
-static uint8_t
-get_value_size(uint64_t value)
-{
-	uint8_t  i = 0;
-	uint8_t  len = 1;
-	uint64_t pow;
-	for ( i = 1; i < 4; ++i) {
-		pow = power(0x080, i);
-		if (value >= pow) {
-			++len;
-		} else {
-			break;
-		}
-	}
-	if (i == 4 && value > pow) {
-		log_error("Malformaed variable value detected!");
-	}
-	return len;
-}
-
 /**
  * put a value to variable byte array
  * @param dest
@@ -140,21 +100,17 @@ get_value_size(uint64_t value)
 uint8_t
 put_var_integer(uint8_t *dest, uint32_t value)
 {
-	uint8_t  len        = 0;
-	uint32_t init_val   = 0x7F;
-	uint8_t  value_size = get_value_size(value);
-
-	for (uint32_t i = 0; i < value_size; ++i) {
+	uint8_t len = 0;
 
-		if (i > 0) {
-			init_val = (init_val * 0x80) | 0xFF;
-		}
-		dest[i] = value / (uint32_t) power(0x80, i);
-		if (value > init_val) {
-			dest[i] |= 0x80;
-		}
-		len++;
+	if (value > 0x0FFFFFFF) {
+		log_error("Malformed variable value detected!");
+	}
+	while (value > 0x7F && len < 3) {
+		dest[len++] = (uint8_t) value | 0x80;
+		value >>= 7;
 	}
+	// Out of range values keep the continuation bit on the 4th byte
+	dest[len++] = (uint8_t) value | (value > 0x7F ? 0x80 : 0);
 	return len;
 }
 
@@ -168,18 +124,33 @@ put_var_integer(uint8_t *dest, uint32_t value)
 uint32_t
 get_var_integer(const uint8_t *buf, uint8_t *pos)
 {
-	uint8_t  temp;
-	uint32_t result = 0;
-
-	uint32_t p = *pos;
-	int      i = 0;
-
-	do {
-		temp   = *(buf + p);
-		result = result + (uint32_t)(temp & 0x7f) * (power(0x80, i));
-		p++;
-	} while ((temp & 0x80) > 0 && i++ < 4);
-	*pos = p;
+	const uint8_t *p = buf + *pos;
+	uint32_t       result;
+
+	// Unrolled, most of the lengths fit in 1 or 2 bytes. Never reads
+	// behind the byte that ends the integer, nor more than 5 bytes.
+	result = p[0] & 0x7f;
+	if (p[0] < 0x80) {
+		*pos += 1;
+		return result;
+	}
+	result |= (uint32_t) (p[1] & 0x7f) << 7;
+	if (p[1] < 0x80) {
+		*pos += 2;
+		return result;
+	}
+	result |= (uint32_t) (p[2] & 0x7f) << 14;
+	if (p[2] < 0x80) {
+		*pos += 3;
+		return result;
+	}
+	result |= (uint32_t) (p[3] & 0x7f) << 21;
+	if (p[3] < 0x80) {
+		*pos += 4;
+		return result;
+	}
+	result |= (uint32_t) (p[4] & 0x7f) << 28;
+	*pos += 5;
 	return result;
 }
 
@@ -306,8 +277,33 @@ copyn_str(const uint8_t *src, uint32_t *pos, int *str_len, int limit)
 	return dest;
 }
 
+/**
+ * Validate a utf-8 string of MQTT, with the vector extension of the CPU
+ * when the string is long enough.
+ *
+ * @return ERR_SUCCESS, ERR_INVAL or ERR_MALFORMED_UTF8
+ */
 int
 utf8_check(const char *str, size_t len)
+{
+	mqtt_simd_level level;
+
+	if (!str)
+		return ERR_INVAL;
+	if (len > 65535)
+		return ERR_INVAL;
+
+	if (len >= MQTT_UTF8_SIMD_MIN &&
+	    (level = mqtt_simd_detect()) != MQTT_SIMD_NONE) {
+		return mqtt_utf8_valid((const uint8_t *) str, len, level)
+		    ? ERR_SUCCESS
+		    : ERR_MALFORMED_UTF8;
+	}
+	return utf8_check_scalar(str, len);
+}
+
+int
+utf8_check_scalar(const char *str, size_t len)
 {
 	int i;
 	int j;
@@ -1122,6 +1118,15 @@ static uint32_t crc32c_sw(uint32_t crci, const void *buf, size_t len)
 uint32_t
 crc32c_hashn(char *str, size_t n)
 {
+	// -1 not checked yet, 0 software table, 1 instruction of the CPU
+	static volatile int hw = -1;
+
+	if (hw < 0) {
+		hw = mqtt_crc32c_hw_supported() ? 1 : 0;
+	}
+	if (hw == 1) {
+		return mqtt_crc32c_hw(0, str, n);
+	}
 	if (crc32c_init == 0) {
 		crc32c_init_sw();
 		crc32c_init = 1;
@@ -1130,6 +1135,113 @@ crc32c_hashn(char *str, size_t n)
 	return crc32c_sw(0, (void *)str, n);
 }
 
+/*
+ * wyhash (final 4) by Wang Yi, released into the public domain. Strings
+ * up to 16 bytes take two loads and one multiply, longer ones are mixed
+ * 48 bytes per round.
+ */
+static const uint64_t wyhash_secret[4] = { 0x2d358dccaa6c78a5ull,
+	0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull };
+
+static inline void
+wyhash_mum(uint64_t *a, uint64_t *b)
+{
+#if defined(__SIZEOF_INT128__)
+	__uint128_t r = (__uint128_t) *a * *b;
+	*a            = (uint64_t) r;
+	*b            = (uint64_t) (r >> 64);
+#else
+	uint64_t ha = *a >> 32, hb = *b >> 32;
+	uint64_t la = (uint32_t) *a, lb = (uint32_t) *b;
+	uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+	uint64_t t = rl + (rm0 << 32), c = t < rl;
+	uint64_t lo = t + (rm1 << 32);
+	c += lo < t;
+	*a = lo;
+	*b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64_t
+wyhash_mix(uint64_t a, uint64_t b)
+{
+	wyhash_mum(&a, &b);
+	return a ^ b;
+}
+
+static inline uint64_t
+wyhash_r8(const uint8_t *p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return le64toh(v);
+}
+
+static inline uint64_t
+wyhash_r4(const uint8_t *p)
+{
+	return (uint64_t) p[0] | (uint64_t) p[1] << 8 | (uint64_t) p[2] << 16 |
+	    (uint64_t) p[3] << 24;
+}
+
+uint64_t
+nano_hash64n(const void *buf, size_t n, uint64_t seed)
+{
+	const uint8_t  *p = buf;
+	const uint64_t *s = wyhash_secret;
+	uint64_t        a, b;
+
+	seed ^= wyhash_mix(seed ^ s[0], s[1]);
+	if (n <= 16) {
+		if (n >= 4) {
+			a = (wyhash_r4(p) << 32) | wyhash_r4(p + ((n >> 3) << 2));
+			b = (wyhash_r4(p + n - 4) << 32) |
+			    wyhash_r4(p + n - 4 - ((n >> 3) << 2));
+		} else if (n > 0) {
+			a = ((uint64_t) p[0] << 16) | ((uint64_t) p[n >> 1] << 8) |
+			    p[n - 1];
+			b = 0;
+		} else {
+			a = b = 0;
+		}
+	} else {
+		size_t i = n;
+		if (i > 48) {
+			uint64_t see1 = seed, see2 = seed;
+			do {
+				seed = wyhash_mix(wyhash_r8(p) ^ s[1],
+				    wyhash_r8(p + 8) ^ seed);
+				see1 = wyhash_mix(wyhash_r8(p + 16) ^ s[2],
+				    wyhash_r8(p + 24) ^ see1);
+				see2 = wyhash_mix(wyhash_r8(p + 32) ^ s[3],
+				    wyhash_r8(p + 40) ^ see2);
+				p += 48;
+				i -= 48;
+			} while (i > 48);
+			seed ^= see1 ^ see2;
+		}
+		while (i > 16) {
+			seed = wyhash_mix(
+			    wyhash_r8(p) ^ s[1], wyhash_r8(p + 8) ^ seed);
+			i -= 16;
+			p += 16;
+		}
+		a = wyhash_r8(p + i - 16);
+		b = wyhash_r8(p + i - 8);
+	}
+	a ^= s[1];
+	b ^= seed;
+	wyhash_mum(&a, &b);
+	return wyhash_mix(a ^ s[0] ^ n, b ^ s[1]);
+}
+
+uint32_t
+nano_hashn(const void *buf, size_t n)
+{
+	uint64_t h = nano_hash64n(buf, n, 0);
+	return (uint32_t) (h ^ (h >> 32));
+}
+
 inline void
 nano_msg_set_dup(nng_msg *msg)
 {
@@ -1478,14 +1590,130 @@ nano_msg_ubsub_free(nano_pipe_db *db)
 	return;
 }
 
+// The filter after $share/<group>/ of a shared subscription, the filter
+// itself otherwise. NULL when a shared filter has no slash after the group.
+static char *
+topic_share_strip(char *filter, size_t *len)
+{
+	char *pos;
+
+	if (*len <= 7 || strncmp(filter, "$share/", 7) != 0) {
+		return (filter);
+	}
+	if ((pos = memchr(filter + 7, '/', *len - 7)) == NULL) {
+		return (NULL);
+	}
+	*len -= pos + 1 - filter;
+	return (pos + 1);
+}
+
+// Strip $share/<group>/ once and sort the filter into the exact set or
+// the wildcard list. A shared filter without a slash after the group never
+// matches, such a subinfo is kept on the list only.
+static void
+nmq_subinfo_compile(struct subinfo *sn)
+{
+	size_t len    = strlen(sn->topic);
+	char  *filter = topic_share_strip(sn->topic, &len);
+
+	if (filter == NULL) {
+		sn->filter = NULL;
+		return;
+	}
+	sn->filter   = filter;
+	sn->flen     = (uint32_t) len;
+	sn->wildcard = memchr(filter, '+', len) != NULL ||
+	    memchr(filter, '#', len) != NULL;
+	sn->hash  = sn->wildcard ? 0 : nano_hashn(filter, len);
+	sn->hnext = NULL;
+	NNI_LIST_NODE_INIT(&sn->wnode);
+}
+
+static struct subinfo **
+nmq_subinfo_bucket(struct subinfo_tbl *tbl, uint32_t hash)
+{
+	return (&tbl->exact[hash & (tbl->nbuckets - 1)]);
+}
+
 static int
-nmq_subinfol_add_or(nni_list *l, struct subinfo *n)
+nmq_subinfo_grow(struct subinfo_tbl *tbl)
+{
+	struct subinfo **old  = tbl->exact;
+	uint32_t         oldn = tbl->nbuckets;
+	uint32_t         n    = oldn == 0 ? 8 : oldn * 2;
+
+	if ((tbl->exact = nni_zalloc(n * sizeof(struct subinfo *))) == NULL) {
+		tbl->exact = old;
+		return (NNG_ENOMEM);
+	}
+	tbl->nbuckets = n;
+	for (uint32_t i = 0; i < oldn; i++) {
+		struct subinfo *sn, *next;
+		for (sn = old[i]; sn != NULL; sn = next) {
+			struct subinfo **b = nmq_subinfo_bucket(tbl, sn->hash);
+			next               = sn->hnext;
+			sn->hnext          = *b;
+			*b                 = sn;
+		}
+	}
+	if (old != NULL) {
+		nni_free(old, oldn * sizeof(struct subinfo *));
+	}
+	return (0);
+}
+
+// Finds the subinfo with the same topic as n, n must be compiled. If pp is
+// given it is set to the link pointing to the exact entry found.
+static struct subinfo *
+nmq_subinfo_find(
+    struct subinfo_tbl *tbl, struct subinfo *n, struct subinfo ***pp)
 {
 	struct subinfo *sn = NULL;
-	NNI_LIST_FOREACH(l, sn) {
-		if (0 == strcmp(n->topic, sn->topic)) {
-			return -1;
+
+	if (n->filter == NULL) {
+		NNI_LIST_FOREACH (&tbl->list, sn) {
+			if (sn->filter == NULL && strcmp(n->topic, sn->topic) == 0)
+				return (sn);
+		}
+	} else if (n->wildcard) {
+		NNI_LIST_FOREACH (&tbl->wild, sn) {
+			if (strcmp(n->topic, sn->topic) == 0)
+				return (sn);
+		}
+	} else if (tbl->nbuckets != 0) {
+		struct subinfo **link = nmq_subinfo_bucket(tbl, n->hash);
+		for (; (sn = *link) != NULL; link = &sn->hnext) {
+			if (sn->hash == n->hash &&
+			    strcmp(n->topic, sn->topic) == 0) {
+				if (pp != NULL)
+					*pp = link;
+				return (sn);
+			}
+		}
+	}
+	return (NULL);
+}
+
+static int
+nmq_subinfol_add_or(nni_list *l, struct subinfo *n)
+{
+	struct subinfo_tbl *tbl = (struct subinfo_tbl *) l;
+
+	nmq_subinfo_compile(n);
+	if (nmq_subinfo_find(tbl, n, NULL) != NULL) {
+		return -1;
+	}
+	if (n->filter != NULL && n->wildcard) {
+		nni_list_append(&tbl->wild, n);
+	} else if (n->filter != NULL) {
+		if (tbl->nexact >= tbl->nbuckets &&
+		    nmq_subinfo_grow(tbl) != 0 && tbl->nbuckets == 0) {
+			return -2;
 		}
+		struct subinfo **b = nmq_subinfo_bucket(tbl, n->hash);
+		n->hnext           = *b;
+		*b                 = n;
+		tbl->nexact++;
 	}
 	nni_list_append(l, n);
 	return 0;
@@ -1494,17 +1722,470 @@ nmq_subinfol_add_or(nni_list *l, struct subinfo *n)
 static void *
 nmq_subinfol_rm_or(nni_list *l, struct subinfo *n)
 {
-	struct subinfo *sn = NULL;
-	NNI_LIST_FOREACH(l, sn) {
-		if (0 == strcmp(n->topic, sn->topic)) {
-			break;
+	struct subinfo_tbl *tbl  = (struct subinfo_tbl *) l;
+	struct subinfo    **link = NULL;
+	struct subinfo     *sn;
+
+	nmq_subinfo_compile(n);
+	if ((sn = nmq_subinfo_find(tbl, n, &link)) == NULL) {
+		return NULL;
+	}
+	if (link != NULL) {
+		*link = sn->hnext;
+		tbl->nexact--;
+	} else if (sn->filter != NULL) {
+		nni_list_remove(&tbl->wild, sn);
+	}
+	nni_list_remove(l, sn);
+	return sn;
+}
+
+/**
+ * @brief iterate the subscriptions of a pipe which match a topic, the
+ *        exact filters first, then the wildcard ones. With all set every
+ *        subscription is returned in the order of the list.
+ *
+ * @param l     subinfol of the pipe
+ * @param info  the last subinfo returned, NULL to start
+ * @param topic topic of the publish
+ * @param tlen  length of topic
+ * @param all   ignore the topic
+ * @return struct subinfo* the next one, NULL at the end
+ */
+struct subinfo *
+nmq_subinfo_next(void *l, struct subinfo *info, const char *topic,
+    size_t tlen, bool all)
+{
+	struct subinfo_tbl *tbl = l;
+	struct subinfo     *sn;
+	uint32_t            hash;
+
+	if (all) {
+		return (info == NULL ? nni_list_first(&tbl->list)
+		                     : nni_list_next(&tbl->list, info));
+	}
+	if (topic == NULL) {
+		return (NULL);
+	}
+	if (info == NULL || !info->wildcard) {
+		hash = nano_hashn(topic, tlen);
+		if (info != NULL) {
+			sn = info->hnext;
+		} else if (tbl->nbuckets != 0) {
+			sn = *nmq_subinfo_bucket(tbl, hash);
+		} else {
+			sn = NULL;
+		}
+		for (; sn != NULL; sn = sn->hnext) {
+			if (sn->hash == hash && sn->flen == tlen &&
+			    memcmp(sn->filter, topic, tlen) == 0)
+				return (sn);
+		}
+		sn = nni_list_first(&tbl->wild);
+	} else {
+		sn = nni_list_next(&tbl->wild, info);
+	}
+	for (; sn != NULL; sn = nni_list_next(&tbl->wild, sn)) {
+		if (topic_match(sn->filter, sn->flen, topic, tlen))
+			return (sn);
+	}
+	return (NULL);
+}
+
+// The bucket refills lazily, when a connection asks for a token.  It
+// starts full, and the first burst after an idle period is admitted at
+// once.
+bool
+nmq_admission_take(nmq_admission *adm, uint64_t now)
+{
+	uint64_t cap;
+
+	if (adm->max_pending != 0 && adm->pending >= adm->max_pending) {
+		return (false);
+	}
+	if (adm->rate != 0) {
+		cap = (uint64_t) (adm->burst != 0 ? adm->burst : adm->rate) *
+		    1000;
+		if (adm->last == 0) {
+			adm->tokens = cap;
+		} else if (now > adm->last) {
+			adm->tokens += (now - adm->last) * adm->rate;
+		}
+		adm->last = now;
+		if (adm->tokens > cap) {
+			adm->tokens = cap;
+		}
+		if (adm->tokens < 1000) {
+			return (false);
+		}
+		adm->tokens -= 1000;
+	}
+	adm->pending++;
+	return (true);
+}
+
+void
+nmq_admission_done(nmq_admission *adm)
+{
+	if (adm->pending > 0) {
+		adm->pending--;
+	}
+}
+
+// Build the CONNACK that turns a client away because the server is
+// busy, in the version of its CONNECT packet.  buf holds 5 bytes; the
+// length of the packet, or 0 if connect is not a CONNECT, is returned.
+int
+nmq_connack_busy(const uint8_t *connect, size_t len, uint8_t *buf)
+{
+	uint32_t rlen;
+	uint8_t  used;
+	size_t   pos;
+
+	if (len < 2 || (connect[0] & 0xF0) != CMD_CONNECT ||
+	    mqtt_get_remaining_length(
+	        (uint8_t *) connect, (uint32_t) len, &rlen, &used) != 0) {
+		return (0);
+	}
+	pos = 1 + used;
+	if (pos + 2 > len) {
+		return (0);
+	}
+	pos += 2 + (((size_t) connect[pos] << 8) | connect[pos + 1]);
+	if (pos >= len) {
+		return (0);
+	}
+	buf[0] = CMD_CONNACK;
+	buf[2] = 0x00;
+	if (connect[pos] == MQTT_PROTOCOL_VERSION_v5) {
+		buf[1] = 0x03;
+		buf[3] = NMQ_SERVER_BUSY;
+		buf[4] = 0x00; // no properties
+		return (5);
+	}
+	buf[1] = 0x02;
+	buf[3] = 0x03; // server unavailable, there is no busy before v5
+	return (4);
+}
+
+// Topic aliases of one direction of a connection. Entries are kept by
+// alias in an id map, so memory follows the aliases in use rather than the
+// largest one a client picks, with hash chains by topic for the outbound
+// direction to find the alias of a topic.
+typedef struct nmq_alias_ent nmq_alias_ent;
+struct nmq_alias_ent {
+	char          *topic;
+	uint32_t       len;
+	uint32_t       hash;
+	uint16_t       alias;
+	nmq_alias_ent *hnext;
+};
+
+struct nmq_alias_tbl {
+	nni_id_map      ents;    // by alias
+	nmq_alias_ent **buckets; // by topic hash, cap of them
+	uint32_t        cap;
+	uint32_t        count;
+	uint16_t        max;
+	uint16_t        next;  // next alias never handed out
+	uint16_t        clock; // next alias to recycle once all are used
+};
+
+nmq_alias_tbl *
+nmq_alias_tbl_alloc(uint16_t max)
+{
+	nmq_alias_tbl *tbl;
+
+	if (max == 0 || (tbl = nni_zalloc(sizeof(*tbl))) == NULL) {
+		return (NULL);
+	}
+	nni_id_map_init(&tbl->ents, 1, max, false);
+	tbl->max   = max;
+	tbl->next  = 1;
+	tbl->clock = 1;
+	return (tbl);
+}
+
+static void
+nmq_alias_ent_free(void *key, void *val)
+{
+	nmq_alias_ent *e = val;
+
+	NNI_ARG_UNUSED(key);
+	if (e->len > 0) {
+		nni_free(e->topic, e->len);
+	}
+	NNI_FREE_STRUCT(e);
+}
+
+void
+nmq_alias_tbl_free(nmq_alias_tbl *tbl)
+{
+	if (tbl == NULL) {
+		return;
+	}
+	nni_id_map_foreach(&tbl->ents, nmq_alias_ent_free);
+	nni_id_map_fini(&tbl->ents);
+	if (tbl->cap > 0) {
+		nni_free(tbl->buckets, tbl->cap * sizeof(nmq_alias_ent *));
+	}
+	nni_free(tbl, sizeof(*tbl));
+}
+
+// Makes room for one more topic in the hash chains, the number of buckets
+// stays a power of two no smaller than the number of entries.
+static int
+nmq_alias_grow(nmq_alias_tbl *tbl)
+{
+	uint32_t        cap = tbl->cap == 0 ? 16 : tbl->cap * 2;
+	nmq_alias_ent **buckets;
+	nmq_alias_ent  *e;
+
+	if (tbl->count < tbl->cap) {
+		return (0);
+	}
+	if ((buckets = nni_zalloc(cap * sizeof(nmq_alias_ent *))) == NULL) {
+		return (MQTT_ERR_NOMEM);
+	}
+	for (uint32_t i = 0; i < tbl->cap; i++) {
+		while ((e = tbl->buckets[i]) != NULL) {
+			tbl->buckets[i] = e->hnext;
+			e->hnext        = buckets[e->hash & (cap - 1)];
+			buckets[e->hash & (cap - 1)] = e;
 		}
 	}
-	if (sn) {
-		nni_list_remove(l, sn);
-		return sn;
+	if (tbl->cap > 0) {
+		nni_free(tbl->buckets, tbl->cap * sizeof(nmq_alias_ent *));
+	}
+	tbl->buckets = buckets;
+	tbl->cap     = cap;
+	return (0);
+}
+
+static void
+nmq_alias_unlink(nmq_alias_tbl *tbl, uint16_t alias)
+{
+	nmq_alias_ent  *e;
+	nmq_alias_ent **link;
+
+	if ((e = nni_id_get(&tbl->ents, alias)) == NULL) {
+		return;
+	}
+	link = &tbl->buckets[e->hash & (tbl->cap - 1)];
+	while (*link != e) {
+		link = &(*link)->hnext;
+	}
+	*link = e->hnext;
+	nni_id_remove(&tbl->ents, alias);
+	tbl->count--;
+	nmq_alias_ent_free(NULL, e);
+}
+
+/**
+ * @brief bind a topic to an alias, the former topic of it is dropped
+ *
+ * @param tbl
+ * @param alias 1 up to the maximum of the table
+ * @param topic not NUL terminated
+ * @param len length of topic
+ * @return int MQTT_ERR_PROTOCOL for an alias out of range
+ */
+int
+nmq_alias_set(nmq_alias_tbl *tbl, uint16_t alias, const char *topic,
+    uint32_t len)
+{
+	nmq_alias_ent *e;
+
+	if (alias == 0 || alias > tbl->max) {
+		return (MQTT_ERR_PROTOCOL);
+	}
+	nmq_alias_unlink(tbl, alias);
+	if (nmq_alias_grow(tbl) != 0 || (e = NNI_ALLOC_STRUCT(e)) == NULL) {
+		return (MQTT_ERR_NOMEM);
+	}
+	if (len > 0 && (e->topic = nni_alloc(len)) == NULL) {
+		NNI_FREE_STRUCT(e);
+		return (MQTT_ERR_NOMEM);
+	}
+	if (nni_id_set(&tbl->ents, alias, e) != 0) {
+		nmq_alias_ent_free(NULL, e);
+		return (MQTT_ERR_NOMEM);
+	}
+	memcpy(e->topic, topic, len);
+	e->len   = len;
+	e->alias = alias;
+	e->hash  = nano_hashn(topic, len);
+	e->hnext = tbl->buckets[e->hash & (tbl->cap - 1)];
+	tbl->buckets[e->hash & (tbl->cap - 1)] = e;
+	tbl->count++;
+	return (0);
+}
+
+// Topic bound to alias or NULL, not NUL terminated
+const char *
+nmq_alias_get(nmq_alias_tbl *tbl, uint16_t alias, uint32_t *len)
+{
+	nmq_alias_ent *e;
+
+	if (tbl == NULL || alias == 0 ||
+	    (e = nni_id_get(&tbl->ents, alias)) == NULL) {
+		return (NULL);
+	}
+	*len = e->len;
+	return (e->topic);
+}
+
+/**
+ * @brief pick the alias to send a topic with. A topic which is new to the
+ *        peer gets a fresh alias, or takes over the oldest one once the
+ *        maximum of the peer is reached. Topics no longer than the alias
+ *        property itself are not worth one.
+ *
+ * @param tbl NULL if the peer does not take aliases
+ * @param topic
+ * @param len length of topic
+ * @param known set if the peer has the alias already, send no topic then
+ * @return uint16_t alias, 0 for none
+ */
+uint16_t
+nmq_alias_assign(
+    nmq_alias_tbl *tbl, const char *topic, uint32_t len, bool *known)
+{
+	nmq_alias_ent *e;
+	uint32_t       hash;
+	uint16_t       alias;
+
+	*known = false;
+	if (tbl == NULL || len <= 3) {
+		return (0);
+	}
+	hash = nano_hashn(topic, len);
+	if (tbl->cap > 0) {
+		for (e = tbl->buckets[hash & (tbl->cap - 1)]; e != NULL;
+		     e = e->hnext) {
+			if (e->hash == hash && e->len == len &&
+			    memcmp(e->topic, topic, len) == 0) {
+				*known = true;
+				return (e->alias);
+			}
+		}
+	}
+	if (tbl->next <= tbl->max && tbl->next != 0) {
+		alias = tbl->next++;
+	} else {
+		alias      = tbl->clock;
+		tbl->clock = tbl->clock == tbl->max ? 1 : tbl->clock + 1;
+	}
+	if (nmq_alias_set(tbl, alias, topic, len) != 0) {
+		return (0);
+	}
+	return (alias);
+}
+
+// Takes back an alias which did not reach the peer
+void
+nmq_alias_forget(nmq_alias_tbl *tbl, uint16_t alias)
+{
+	if (tbl == NULL || alias == 0 ||
+	    nni_id_get(&tbl->ents, alias) == NULL) {
+		return;
+	}
+	nmq_alias_unlink(tbl, alias);
+	if (alias + 1 == tbl->next) {
+		tbl->next--;
 	}
-	return NULL;
+}
+
+/**
+ * @brief resolve the topic alias of a v5 PUBLISH received. A topic given
+ *        with an alias is stored in tbl, an empty topic is replaced by the
+ *        stored one. The alias property is removed either way, so the
+ *        rest of the broker always sees the topic.
+ *
+ * @param msg v5 PUBLISH
+ * @param tblp table of the pipe, allocated on first use
+ * @return int 0, MQTT_ERR_PROTOCOL for an unknown alias or a malformed
+ *         packet, left as it is.
+ */
+int
+nmq_pub_alias_resolve(nni_msg *msg, nmq_alias_tbl **tblp)
+{
+	uint8_t    *body = nni_msg_body(msg);
+	uint32_t    mlen = (uint32_t) nni_msg_len(msg);
+	uint32_t    tlen, pidlen, pos, plen, off, nlen;
+	uint8_t     bytes = 0, nbytes, varint[4], hdr[5];
+	uint8_t    *nbody, *np;
+	uint16_t    alias;
+	const char *topic;
+	int         rv;
+
+	if (mlen < 2) {
+		return (MQTT_ERR_PROTOCOL);
+	}
+	NNI_GET16(body, tlen);
+	hdr[0] = *(uint8_t *) nni_msg_header(msg);
+	pidlen = (hdr[0] & 0x06) != 0 ? 2 : 0;
+	pos    = 2 + tlen + pidlen;
+	if (pos >= mlen) {
+		return (MQTT_ERR_PROTOCOL);
+	}
+	plen = get_var_integer(body + pos, &bytes);
+	if (bytes == 0 || pos + bytes + plen > mlen) {
+		return (MQTT_ERR_PROTOCOL);
+	}
+	rv = property_scan(body + pos + bytes, plen, TOPIC_ALIAS, &off);
+	if (rv == MQTT_ERR_NOT_FOUND) {
+		return (0);
+	} else if (rv != 0 || off + 3 > plen) {
+		return (MQTT_ERR_PROTOCOL);
+	}
+	NNI_GET16(body + pos + bytes + off + 1, alias);
+
+	if (tlen > 0) {
+		if (*tblp == NULL &&
+		    (*tblp = nmq_alias_tbl_alloc(0xFFFF)) == NULL) {
+			return (MQTT_ERR_NOMEM);
+		}
+		rv = nmq_alias_set(*tblp, alias, (char *) body + 2, tlen);
+		if (rv != 0) {
+			return (rv);
+		}
+		topic = (char *) body + 2;
+	} else if ((topic = nmq_alias_get(*tblp, alias, &tlen)) == NULL) {
+		log_warn("Unknown topic alias %d", alias);
+		return (MQTT_ERR_PROTOCOL);
+	}
+
+	// topic, packet id, properties without the alias, payload
+	nbytes = (uint8_t) put_var_integer(varint, plen - 3);
+	nlen   = 2 + tlen + pidlen + nbytes + (plen - 3) +
+	    (mlen - pos - bytes - plen);
+	if ((nbody = nni_alloc(nlen)) == NULL) {
+		return (MQTT_ERR_NOMEM);
+	}
+	np = nbody;
+	NNI_PUT16(np, tlen);
+	memcpy(np + 2, topic, tlen);
+	np += 2 + tlen;
+	memcpy(np, body + pos - pidlen, pidlen);
+	np += pidlen;
+	memcpy(np, varint, nbytes);
+	np += nbytes;
+	memcpy(np, body + pos + bytes, off);
+	np += off;
+	memcpy(np, body + pos + bytes + off + 3, mlen - (pos + bytes + off + 3));
+
+	nni_msg_clear(msg);
+	rv = nni_msg_append(msg, nbody, nlen);
+	nni_free(nbody, nlen);
+	if (rv != 0) {
+		return (MQTT_ERR_NOMEM);
+	}
+	nbytes = (uint8_t) put_var_integer(hdr + 1, nlen);
+	nni_msg_header_clear(msg);
+	nni_msg_header_append(msg, hdr, nbytes + 1);
+	nni_msg_set_remaining_len(msg, nlen);
+	return (0);
 }
 
 /**
@@ -1860,125 +2541,69 @@ nmq_unsubinfo_decode(nng_msg *msg, void *l, uint8_t ver)
 }
 
 
-static int
-topic_count(const char *topic)
-{
-	int         cnt = 0;
-	const char *t   = topic;
-
-	while (t) {
-		// log_info("%s", t);
-		t = strchr(t, '/');
-		cnt++;
-		if (t == NULL) {
-			break;
-		}
-		t++;
-	}
-
-	return cnt;
-}
-
-static void
-topic_queue_free(char **topic_queue)
+// Length of the topic level starting at pos, a level ends at the next '/'
+// or at the end of the string.
+static inline size_t
+topic_level_len(const char *s, size_t pos, size_t len)
 {
-	char * t  = NULL;
-	char **tq = topic_queue;
-
-	while (*topic_queue) {
-		t = *topic_queue;
-		topic_queue++;
-		zfree(t);
-		t = NULL;
-	}
-
-	if (tq) {
-		zfree(tq);
-	}
+	const char *sep = memchr(s + pos, '/', len - pos);
+	return sep == NULL ? len - pos : (size_t) (sep - (s + pos));
 }
 
-static char **
-topic_parse(const char *topic)
+/**
+ * @brief match a topic against a filter level by level in a single pass,
+ *        nothing is copied or allocated. '+' matches exactly one level,
+ *        '#' matches the current level and everything below it.
+ *
+ * @param filter subscription filter, without $share/ prefix
+ * @param flen   length of filter
+ * @param topic  topic in pub packet, needs not to be NUL terminated
+ * @param tlen   length of topic
+ * @return true
+ * @return false
+ */
+bool
+topic_match(const char *filter, size_t flen, const char *topic, size_t tlen)
 {
-	if (topic == NULL) {
-		// log_err("topic is NULL");
-		return NULL;
-	}
-
-	int         row   = 0;
-	int         len   = 2;
-	const char *b_pos = topic;
-	char *      pos   = NULL;
-
-	int cnt = topic_count(topic);
-
-	// Here we will get (cnt + 1) memory, one for NULL end
-	char **topic_queue = (char **) zmalloc(sizeof(char *) * (cnt + 1));
-
-	while ((pos = strchr(b_pos, '/')) != NULL) {
-
-		len              = pos - b_pos + 1;
-		topic_queue[row] = (char *) zmalloc(sizeof(char) * len);
-		memcpy(topic_queue[row], b_pos, (len - 1));
-		topic_queue[row][len - 1] = '\0';
-		b_pos                     = pos + 1;
-		row++;
-	}
-
-	len = strlen(b_pos);
-
-	topic_queue[row] = (char *) zmalloc(sizeof(char) * (len + 1));
-	memcpy(topic_queue[row], b_pos, (len));
-	topic_queue[row][len] = '\0';
-	topic_queue[++row]    = NULL;
-
-	return topic_queue;
+	size_t fpos = 0, tpos = 0;
+	bool   fend = false, tend = false;
+
+	while (!fend && !tend) {
+		size_t fl = topic_level_len(filter, fpos, flen);
+		size_t tl = topic_level_len(topic, tpos, tlen);
+
+		if (fl != tl || memcmp(filter + fpos, topic + tpos, fl) != 0) {
+			if (fl == 1 && filter[fpos] == '#') {
+				return true;
+			} else if (fl != 1 || filter[fpos] != '+') {
+				return false;
+			}
+		}
+		// Step over the level and its separator
+		fpos += fl;
+		tpos += tl;
+		if (fpos < flen)
+			fpos++;
+		else
+			fend = true;
+		if (tpos < tlen)
+			tpos++;
+		else
+			tend = true;
+	}
+
+	if (!fend) {
+		// "a/#" matches "a" as well
+		return topic_level_len(filter, fpos, flen) == 1 &&
+		    filter[fpos] == '#';
+	}
+	return tend;
 }
 
-
 bool
 check_ifwildcard(const char *w, const char *n)
 {
-	char **w_q    = topic_parse(w);
-	char **n_q    = topic_parse(n);
-	char **wq_free = w_q;
-	char **nq_free = n_q;
-	bool   result = true;
-	bool   flag   = false;
-
-	while (*w_q != NULL && *n_q != NULL) {
-		// printf("w: %s, n: %s\n", *w_q, *n_q);
-		if (strcmp(*w_q, *n_q) != 0) {
-			if (strcmp(*w_q, "#") == 0) {
-				flag = true;
-				break;
-			} else if (strcmp(*w_q, "+") != 0) {
-				result = false;
-				break;
-			}
-		}
-		w_q++;
-		n_q++;
-	}
-
-	if (*w_q && strcmp(*w_q, "#") == 0) {
-		flag = true;
-	}
-	if (*w_q && strcmp(*w_q, "+") == 0) {
-		flag = false;
-	}
-
-	if (!flag) {
-		if (*w_q || *n_q) {
-			result = false;
-		}
-	}
-
-	topic_queue_free(wq_free);
-	topic_queue_free(nq_free);
-
-	// printf("value: %d\n", result);
-	return result;
+	return topic_match(w, strlen(w), n, strlen(n));
 }
 
 /**
@@ -1990,16 +2615,27 @@ check_ifwildcard(const char *w, const char *n)
  * @return true 
  * @return false 
  */
+/**
+ * @brief check a topic name by the rules of a PUBLISH: not empty, valid
+ *        utf-8 without U+0000, and no wildcard
+ */
+bool
+topic_name_valid(const char *topic, size_t len)
+{
+	if (topic == NULL || len == 0 || memchr(topic, '+', len) != NULL ||
+	    memchr(topic, '#', len) != NULL) {
+		return false;
+	}
+	return utf8_check(topic, len) == ERR_SUCCESS;
+}
+
 bool
 topic_filter(const char *origin, const char *input)
 {
 	// Wrong topic or invalid topic alias
 	if (input == NULL || origin == NULL)
 		return false;
-	if (strcmp(origin, input) == 0) {
-		return true;
-	}
-	return check_ifwildcard(origin, input);
+	return topic_filtern(origin, input, strlen(input));
 }
 
 bool
@@ -2008,16 +2644,10 @@ topic_filtern(const char *origin, const char *input, size_t n)
 	// Wrong topic or invalid topic alias
 	if (input == NULL || origin == NULL)
 		return false;
-		
-	char *buff = nni_zalloc(n + 1);
-	strncpy(buff, input, n);
-	bool res = false;
+
 	size_t len = strlen(origin);
-	if (len == n && strncmp(origin, input, n) == 0) {
-		res = true;
-	} else {
-		res = check_ifwildcard(origin, buff);
+	if (len == n && memcmp(origin, input, n) == 0) {
+		return true;
 	}
-	nni_free(buff, n + 1);
-	return res;
+	return topic_match(origin, len, input, n);
 }
@@ -1,4 +1,8 @@
+#include "core/nng_impl.h"
+#include "core/sockimpl.h"
 #include "nng/protocol/mqtt/mqtt_parser.h"
+#include "sp/protocol/mqtt/mqtt_simd.h"
+#include "supplemental/mqtt/mqtt_msg.h"
 #include <assert.h>
 #include <nuts.h>
 #include <stdio.h>
@@ -47,6 +51,210 @@ test_utf8_check()
 	    ERR_MALFORMED_UTF8);
 }
 
+static uint32_t
+test_rand(uint32_t *state)
+{
+	// xorshift32, reproducible across runs
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+static size_t
+test_put_utf8(uint8_t *dst, uint32_t cp)
+{
+	if (cp < 0x80) {
+		dst[0] = (uint8_t) cp;
+		return 1;
+	} else if (cp < 0x800) {
+		dst[0] = 0xC0 | (cp >> 6);
+		dst[1] = 0x80 | (cp & 0x3F);
+		return 2;
+	} else if (cp < 0x10000) {
+		dst[0] = 0xE0 | (cp >> 12);
+		dst[1] = 0x80 | ((cp >> 6) & 0x3F);
+		dst[2] = 0x80 | (cp & 0x3F);
+		return 3;
+	}
+	dst[0] = 0xF0 | (cp >> 18);
+	dst[1] = 0x80 | ((cp >> 12) & 0x3F);
+	dst[2] = 0x80 | ((cp >> 6) & 0x3F);
+	dst[3] = 0x80 | (cp & 0x3F);
+	return 4;
+}
+
+static void
+test_utf8_diff(const uint8_t *buf, size_t len)
+{
+	bool expect = utf8_check_scalar((const char *) buf, len) == 0;
+
+	for (int l = MQTT_SIMD_NONE; l <= MQTT_SIMD_NEON; l++) {
+		if (!mqtt_simd_supported(l)) {
+			continue;
+		}
+		if (mqtt_utf8_valid(buf, len, l) != expect) {
+			NUTS_MSG("level %d len %zu differs", l, len);
+			NUTS_TRUE(false);
+		}
+	}
+}
+
+// Every vector version must agree with the scalar one.
+static void
+test_utf8_check_simd()
+{
+	uint8_t  buf[160];
+	uint32_t state = 0x2545F491;
+	// Boundaries of the ranges utf8_check cares about
+	static const uint32_t edges[] = { 0x1F, 0x20, 0x7E, 0x7F, 0x80, 0x9F,
+		0xA0, 0x7FF, 0x800, 0xD7FF, 0xE000, 0xFDCF, 0xFDD0, 0xFDEF,
+		0xFDF0, 0xFFFD, 0xFFFE, 0xFFFF, 0x10000, 0x1FFFE, 0x1FFFF,
+		0x10FFFD, 0x10FFFE, 0x10FFFF };
+
+	uint8_t follow[72];
+
+	NUTS_MSG("simd level %d", mqtt_simd_detect());
+	// Every continuation and the bytes around them
+	for (int i = 0; i < 64; i++) {
+		follow[i] = 0x80 + i;
+	}
+	memcpy(follow + 64, "\x00\x1F\x20\x7F\xC0\xC2\xEF\xFF", 8);
+
+	// Every byte pair, and 3 or 4 byte leads followed by every pair of
+	// the bytes above, across the border of 16 and 32 byte blocks.
+	memset(buf, 'a', sizeof(buf));
+	for (size_t off = 14; off <= 30; off += 16) {
+		for (uint32_t v = 0; v < 0x10000; v++) {
+			buf[off]     = v >> 8;
+			buf[off + 1] = v & 0xFF;
+			test_utf8_diff(buf, 40);
+			test_utf8_diff(buf, off + 2);
+		}
+		for (uint32_t lead = 0xE0; lead <= 0xF4; lead++) {
+			for (size_t x = 0; x < sizeof(follow); x++) {
+				for (size_t y = 0; y < sizeof(follow); y++) {
+					buf[off]     = lead;
+					buf[off + 1] = follow[x];
+					buf[off + 2] = follow[y];
+					test_utf8_diff(buf, 40);
+				}
+			}
+		}
+		memset(buf, 'a', sizeof(buf));
+	}
+
+	// Random strings of valid and invalid code points
+	for (int n = 0; n < 50000; n++) {
+		size_t len = test_rand(&state) % (sizeof(buf) - 4);
+		size_t pos = 0;
+		while (pos < len) {
+			uint32_t r = test_rand(&state);
+			switch (r % 6) {
+			case 0:
+				buf[pos++] = 0x20 + r % 0x5F;
+				break;
+			case 1:
+				buf[pos++] = (r >> 8) & 0xFF;
+				break;
+			case 2:
+				pos += test_put_utf8(buf + pos,
+				    edges[(r >> 8) % (sizeof(edges) / sizeof(edges[0]))]);
+				break;
+			default:
+				pos += test_put_utf8(
+				    buf + pos, (r >> 8) % 0x110000);
+				break;
+			}
+		}
+		// Cut sequences at the end now and then
+		test_utf8_diff(buf, len);
+		test_utf8_diff(buf, pos);
+	}
+}
+
+// The former loops of get_var_integer and put_var_integer
+static uint32_t
+legacy_get_var_integer(const uint8_t *buf, uint8_t *pos)
+{
+	uint8_t  temp;
+	uint32_t result = 0;
+	uint32_t p      = *pos;
+	int      i      = 0;
+
+	do {
+		temp   = *(buf + p);
+		result = result + (uint32_t) (temp & 0x7f) * (1ULL << (7 * i));
+		p++;
+	} while ((temp & 0x80) > 0 && i++ < 4);
+	*pos = p;
+	return result;
+}
+
+static uint8_t
+legacy_put_var_integer(uint8_t *dest, uint32_t value)
+{
+	uint8_t  len      = 0;
+	uint32_t init_val = 0x7F;
+	uint8_t  size     = 1;
+
+	for (uint32_t i = 1; i < 4 && value >= (1U << (7 * i)); i++) {
+		size++;
+	}
+	for (uint32_t i = 0; i < size; ++i) {
+		if (i > 0) {
+			init_val = (init_val * 0x80) | 0xFF;
+		}
+		dest[i] = value / (1U << (7 * i));
+		if (value > init_val) {
+			dest[i] |= 0x80;
+		}
+		len++;
+	}
+	return len;
+}
+
+static void
+test_var_integer()
+{
+	uint8_t  a[8], b[8];
+	uint8_t  pa, pb;
+	uint32_t state = 0x9E3779B9;
+	uint32_t edges[] = { 0, 1, 127, 128, 16383, 16384, 2097151, 2097152,
+		268435455, 268435456, 0xFFFFFFFF };
+
+	for (size_t i = 0; i < sizeof(edges) / sizeof(edges[0]) + 100000; i++) {
+		uint32_t v = i < sizeof(edges) / sizeof(edges[0])
+		    ? edges[i]
+		    : test_rand(&state) >> (test_rand(&state) % 32);
+		memset(a, 0, sizeof(a));
+		memset(b, 0, sizeof(b));
+		uint8_t la = put_var_integer(a, v);
+		uint8_t lb = legacy_put_var_integer(b, v);
+		NUTS_TRUE(la == lb && memcmp(a, b, la) == 0);
+
+		pa = pb = 0;
+		NUTS_TRUE(get_var_integer(a, &pa) ==
+		    legacy_get_var_integer(a, &pb));
+		NUTS_TRUE(pa == pb);
+		if (v <= 268435455) {
+			pa = 0;
+			NUTS_TRUE(get_var_integer(a, &pa) == v && pa == la);
+		}
+	}
+	// Malformed integers with 5 continuation bytes
+	for (int i = 0; i < 100000; i++) {
+		for (int j = 0; j < 5; j++) {
+			a[j + 1] = test_rand(&state) | 0x80;
+		}
+		a[6] = test_rand(&state) & 0x7F;
+		pa = pb = 1;
+		NUTS_TRUE(get_var_integer(a, &pa) ==
+		    legacy_get_var_integer(a, &pb));
+		NUTS_TRUE(pa == pb && pa == 6);
+	}
+}
+
 static void
 test_get_utf8_str()
 {
@@ -144,6 +352,82 @@ test_hash()
 	NUTS_ASSERT(crc32c_hashn(str2, strlen(str2)) == 788723578);
 }
 
+// Bit by bit CRC32C, the reference for the table and the CPU instruction
+static uint32_t
+test_crc32c_bitwise(const uint8_t *p, size_t n)
+{
+	uint32_t crc = 0xFFFFFFFF;
+	while (n--) {
+		crc ^= *p++;
+		for (int k = 0; k < 8; k++) {
+			crc = (crc >> 1) ^ (0x82F63B78 & (0 - (crc & 1)));
+		}
+	}
+	return ~crc;
+}
+
+static void
+test_hash_crc32c()
+{
+	uint8_t  buf[300];
+	uint32_t state = 0x1234567;
+
+	for (size_t i = 0; i < sizeof(buf); i++) {
+		buf[i] = test_rand(&state);
+	}
+	NUTS_ASSERT(crc32c_hashn("123456789", 9) == 0xE3069283);
+	NUTS_MSG("crc32c instruction %s",
+	    mqtt_crc32c_hw_supported() ? "available" : "not available");
+
+	// Every length at every alignment
+	for (size_t off = 0; off < 8; off++) {
+		for (size_t n = 0; n + off <= sizeof(buf); n++) {
+			uint32_t expect = test_crc32c_bitwise(buf + off, n);
+			NUTS_TRUE(crc32c_hashn((char *) buf + off, n) == expect);
+			if (mqtt_crc32c_hw_supported()) {
+				NUTS_TRUE(
+				    mqtt_crc32c_hw(0, buf + off, n) == expect);
+			}
+		}
+	}
+	// Chained over chunks
+	if (mqtt_crc32c_hw_supported()) {
+		uint32_t crc = mqtt_crc32c_hw(0, buf, 101);
+		NUTS_TRUE(mqtt_crc32c_hw(crc, buf + 101, 199) ==
+		    test_crc32c_bitwise(buf, 300));
+	}
+}
+
+static void
+test_hash_nano()
+{
+	uint8_t  buf[200];
+	uint32_t state = 0x7654321;
+	int      collisions = 0;
+
+	for (size_t i = 0; i < sizeof(buf); i++) {
+		buf[i] = test_rand(&state);
+	}
+	NUTS_TRUE(nano_hashn("", 0) == nano_hashn("", 0));
+	NUTS_TRUE(nano_hash64n("topic", 5, 0) != nano_hash64n("topic", 5, 1));
+
+	// Stable for the same bytes anywhere, sensitive to every byte
+	for (size_t n = 1; n < 100; n++) {
+		uint8_t copy[100];
+		memcpy(copy, buf + 1, n);
+		NUTS_TRUE(nano_hash64n(buf + 1, n, 7) == nano_hash64n(copy, n, 7));
+		NUTS_TRUE(nano_hashn(buf, n) != nano_hashn(buf, n + 1));
+		for (size_t i = 0; i < n; i++) {
+			copy[i] ^= 0x01;
+			if (nano_hash64n(copy, n, 7) == nano_hash64n(buf + 1, n, 7)) {
+				collisions++;
+			}
+			copy[i] ^= 0x01;
+		}
+	}
+	NUTS_TRUE(collisions == 0);
+}
+
 static void
 test_topic_filter()
 {
@@ -163,11 +447,413 @@ test_topic_filtern()
 	NUTS_ASSERT(topic_filtern(orgin, input, 10) == true);
 
 	NUTS_ASSERT(topic_filtern(orgin, input, 11) == false);
+
+	// A shared filter is matched literally, the prefix is not stripped
+	NUTS_ASSERT(topic_filtern("$share/g1/test/+", input, 10) == false);
+	NUTS_ASSERT(topic_filter("$share/g/a", "$share/g/a") == true);
+	NUTS_ASSERT(topic_filter("$share/+/a", "$share/g/a") == true);
+}
+
+static void
+test_topic_match()
+{
+	struct {
+		const char *filter;
+		const char *topic;
+		bool        match;
+	} cases[] = {
+		{ "a/b/c/d/e", "a/b/c/d/e", true },
+		{ "a/b/c/d/e", "a/b/c/d/f", false },
+		{ "a/b/c/d", "a/b/c/d/e", false },
+		{ "a/b/c/d/e", "a/b/c/d", false },
+		{ "a/+/c/+/e", "a/b/c/d/e", true },
+		{ "a/+/c/+/e", "a/b/x/d/e", false },
+		{ "a/+", "a", false },
+		{ "a/+", "a/", true },
+		{ "+/+", "/", true },
+		{ "+", "", true },
+		{ "a/#", "a", true },
+		{ "a/#", "a/b/c/d/e", true },
+		{ "a/b/#", "a/c/d", false },
+		{ "#", "a/b/c", true },
+		{ "a/b/", "a/b", false },
+		{ "a/b", "a/b/", false },
+		{ "a//b", "a//b", true },
+		{ "a/+/b", "a//b", true },
+	};
+
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		NUTS_ASSERT(topic_match(cases[i].filter,
+		                strlen(cases[i].filter), cases[i].topic,
+		                strlen(cases[i].topic)) == cases[i].match);
+		NUTS_ASSERT(topic_filter(cases[i].filter, cases[i].topic) ==
+		    cases[i].match);
+	}
+
+	// Topic in a pub packet is not NUL terminated
+	const char *topic = "a/b/c/d/e/f";
+	NUTS_ASSERT(topic_match("a/b/c/d/e", 9, topic, 9) == true);
+	NUTS_ASSERT(topic_match("a/b/c/d/+", 9, topic, 11) == false);
+	NUTS_ASSERT(topic_match("a/b/c/d/#", 9, topic, 11) == true);
+}
+
+// SUBSCRIBE or UNSUBSCRIBE of a single topic from a v4 client
+static void
+subinfo_apply(nni_list *l, const char *topic, uint8_t qos, bool sub)
+{
+	nng_msg *msg;
+	uint16_t len = (uint16_t) strlen(topic);
+
+	NUTS_PASS(nng_msg_alloc(&msg, 0));
+	NUTS_PASS(nng_msg_append_u16(msg, 1));
+	NUTS_PASS(nng_msg_append_u16(msg, len));
+	NUTS_PASS(nng_msg_append(msg, topic, len));
+	if (sub) {
+		NUTS_PASS(nng_msg_append(msg, &qos, 1));
+	}
+	nni_msg_set_remaining_len(msg, nng_msg_len(msg));
+	if (sub) {
+		NUTS_TRUE(nmq_subinfo_decode(msg, l, MQTT_PROTOCOL_VERSION_v311) == 1);
+	} else {
+		NUTS_TRUE(nmq_unsubinfo_decode(msg, l, MQTT_PROTOCOL_VERSION_v311) == 1);
+	}
+	nng_msg_free(msg);
+}
+
+// The index must find exactly the subscriptions the plain scan finds
+static int
+subinfo_count(nni_list *l, const char *topic)
+{
+	subinfo *info;
+	int      n = 0, scan = 0;
+	size_t   tlen = strlen(topic);
+
+	// info->filter is the topic without $share/<group>/
+	NMQ_SUBINFO_FOREACH (l, info, topic, tlen, false) {
+		NUTS_TRUE(topic_match(info->filter, info->flen, topic, tlen));
+		n++;
+	}
+	NNI_LIST_FOREACH (l, info) {
+		scan += info->filter != NULL &&
+		    topic_match(info->filter, info->flen, topic, tlen);
+	}
+	NUTS_TRUE(n == scan);
+	return (n);
+}
+
+static int
+subinfo_total(nni_list *l)
+{
+	subinfo *info;
+	int      n = 0;
+
+	NNI_LIST_FOREACH (l, info) {
+		n++;
+	}
+	return (n);
+}
+
+static void
+test_subinfo_index()
+{
+	struct subinfo_tbl tbl = { 0 };
+	nni_list          *l   = &tbl.list;
+	subinfo           *info;
+	char               topic[32];
+	int                n;
+
+	NNI_LIST_INIT(&tbl.list, struct subinfo, node);
+	NNI_LIST_INIT(&tbl.wild, struct subinfo, wnode);
+
+	subinfo_apply(l, "a/b", 0, true);
+	subinfo_apply(l, "$share/g/a/b", 1, true);
+	subinfo_apply(l, "a/+", 2, true);
+	subinfo_apply(l, "x/#", 0, true);
+	subinfo_apply(l, "$share/nogroup", 0, true);
+	subinfo_apply(l, "c/d", 1, true);
+	// Already subscribed
+	subinfo_apply(l, "a/b", 2, true);
+	NUTS_TRUE(subinfo_total(l) == 6);
+	NUTS_TRUE(tbl.nexact == 3);
+
+	NUTS_TRUE(subinfo_count(l, "a/b") == 3);
+	NUTS_TRUE(subinfo_count(l, "a/c") == 1);
+	NUTS_TRUE(subinfo_count(l, "x/y/z") == 1);
+	NUTS_TRUE(subinfo_count(l, "c/d") == 1);
+	NUTS_TRUE(subinfo_count(l, "nogroup") == 0);
+	NUTS_TRUE(subinfo_count(l, "q") == 0);
+
+	// Exact filters come first
+	info = nmq_subinfo_next(l, NULL, "a/b", 3, false);
+	NUTS_TRUE(info != NULL && !info->wildcard);
+	NUTS_TRUE(nmq_subinfo_next(l, NULL, NULL, 0, false) == NULL);
+
+	// Retained msgs go to every subscription in order
+	n = 0;
+	NMQ_SUBINFO_FOREACH (l, info, "q", 1, true) {
+		n++;
+	}
+	NUTS_TRUE(n == 6);
+	NUTS_MATCH(nmq_subinfo_next(l, NULL, "q", 1, true)->topic, "a/b");
+
+	// Enough to grow the buckets a few times
+	for (int i = 0; i < 100; i++) {
+		snprintf(topic, sizeof(topic), "t/%d", i);
+		subinfo_apply(l, topic, 0, true);
+	}
+	NUTS_TRUE(tbl.nexact == 103);
+	NUTS_TRUE(tbl.nbuckets >= 103);
+	for (int i = 0; i < 100; i++) {
+		snprintf(topic, sizeof(topic), "t/%d", i);
+		NUTS_TRUE(subinfo_count(l, topic) == 1);
+	}
+
+	subinfo_apply(l, "a/b", 0, false);
+	NUTS_TRUE(subinfo_count(l, "a/b") == 2);
+	subinfo_apply(l, "a/+", 0, false);
+	NUTS_TRUE(subinfo_count(l, "a/b") == 1);
+	subinfo_apply(l, "$share/nogroup", 0, false);
+	subinfo_apply(l, "not/subscribed", 0, false);
+	for (int i = 0; i < 100; i++) {
+		snprintf(topic, sizeof(topic), "t/%d", i);
+		subinfo_apply(l, topic, 0, false);
+		NUTS_TRUE(subinfo_count(l, topic) == 0);
+	}
+	NUTS_TRUE(subinfo_total(l) == 3);
+	NUTS_TRUE(tbl.nexact == 2);
+
+	while ((info = nni_list_first(l)) != NULL) {
+		nni_list_remove(l, info);
+		nng_free(info->topic, strlen(info->topic));
+		nng_free(info, sizeof(*info));
+	}
+	nni_free(tbl.exact, tbl.nbuckets * sizeof(struct subinfo *));
+}
+
+static void
+test_alias_table(void)
+{
+	nmq_alias_tbl *tbl;
+	uint32_t       len;
+	bool           known;
+	uint16_t       a1, a2;
+
+	NUTS_TRUE(nmq_alias_tbl_alloc(0) == NULL);
+	tbl = nmq_alias_tbl_alloc(2);
+	NUTS_ASSERT(tbl != NULL);
+
+	NUTS_TRUE(nmq_alias_set(tbl, 0, "a/b", 3) == MQTT_ERR_PROTOCOL);
+	NUTS_TRUE(nmq_alias_set(tbl, 3, "a/b", 3) == MQTT_ERR_PROTOCOL);
+	NUTS_TRUE(nmq_alias_get(tbl, 1, &len) == NULL);
+
+	// too short to be worth an alias
+	NUTS_TRUE(nmq_alias_assign(tbl, "a/b", 3, &known) == 0);
+	NUTS_TRUE(nmq_alias_assign(NULL, "sensor/1", 8, &known) == 0);
+
+	a1 = nmq_alias_assign(tbl, "sensor/1", 8, &known);
+	NUTS_TRUE(a1 == 1);
+	NUTS_TRUE(!known);
+	NUTS_TRUE(nmq_alias_assign(tbl, "sensor/1", 8, &known) == a1);
+	NUTS_TRUE(known);
+	a2 = nmq_alias_assign(tbl, "sensor/2", 8, &known);
+	NUTS_TRUE(a2 == 2);
+	NUTS_TRUE(!known);
+	NUTS_TRUE(strncmp(nmq_alias_get(tbl, a2, &len), "sensor/2", 8) == 0);
+	NUTS_TRUE(len == 8);
+
+	// maximum reached, the oldest alias is taken over
+	NUTS_TRUE(nmq_alias_assign(tbl, "sensor/3", 8, &known) == a1);
+	NUTS_TRUE(!known);
+	NUTS_TRUE(nmq_alias_assign(tbl, "sensor/1", 8, &known) == a2);
+	NUTS_TRUE(!known);
+	NUTS_TRUE(nmq_alias_assign(tbl, "sensor/3", 8, &known) == a1);
+	NUTS_TRUE(known);
+
+	nmq_alias_forget(tbl, a1);
+	NUTS_TRUE(nmq_alias_get(tbl, a1, &len) == NULL);
+	NUTS_TRUE(nmq_alias_assign(tbl, "sensor/3", 8, &known) != 0);
+	NUTS_TRUE(!known);
+
+	// a new topic replaces the former one of the alias
+	NUTS_PASS(nmq_alias_set(tbl, 2, "other/topic", 11));
+	NUTS_TRUE(strncmp(nmq_alias_get(tbl, 2, &len), "other/topic", 11) == 0);
+	NUTS_TRUE(nmq_alias_assign(tbl, "other/topic", 11, &known) == 2);
+	NUTS_TRUE(known);
+
+	nmq_alias_tbl_free(tbl);
+}
+
+static void
+test_alias_sparse(void)
+{
+	nmq_alias_tbl *tbl;
+	uint32_t       len;
+	bool           known;
+	char           topic[16];
+	uint16_t       alias;
+
+	// a client may pick any alias up to the maximum, far apart ones
+	// only cost what is bound to them
+	tbl = nmq_alias_tbl_alloc(0xFFFF);
+	NUTS_ASSERT(tbl != NULL);
+	NUTS_PASS(nmq_alias_set(tbl, 0xFFFF, "last/alias", 10));
+	NUTS_TRUE(strncmp(nmq_alias_get(tbl, 0xFFFF, &len), "last/alias",
+	              10) == 0);
+	NUTS_TRUE(len == 10);
+	NUTS_TRUE(nmq_alias_get(tbl, 0xFFFE, &len) == NULL);
+
+	for (int i = 0; i < 100; i++) {
+		alias = (uint16_t) (i * 601 + 1);
+		(void) snprintf(topic, sizeof(topic), "sensor/%d", i);
+		NUTS_PASS(nmq_alias_set(tbl, alias, topic, strlen(topic)));
+	}
+	for (int i = 0; i < 100; i++) {
+		alias = (uint16_t) (i * 601 + 1);
+		(void) snprintf(topic, sizeof(topic), "sensor/%d", i);
+		NUTS_TRUE(strncmp(nmq_alias_get(tbl, alias, &len), topic,
+		              strlen(topic)) == 0);
+		NUTS_TRUE(nmq_alias_assign(tbl, topic, strlen(topic),
+		              &known) == alias);
+		NUTS_TRUE(known);
+	}
+
+	// rebinding drops the former topic
+	NUTS_PASS(nmq_alias_set(tbl, 0xFFFF, "sensor/0", 8));
+	NUTS_TRUE(strncmp(nmq_alias_get(tbl, 0xFFFF, &len), "sensor/0", 8) ==
+	    0);
+	nmq_alias_forget(tbl, 1);
+	NUTS_TRUE(nmq_alias_get(tbl, 1, &len) == NULL);
+	NUTS_TRUE(nmq_alias_assign(tbl, "sensor/0", 8, &known) == 0xFFFF);
+	NUTS_TRUE(known);
+
+	nmq_alias_tbl_free(tbl);
+}
+
+static void
+test_alias_resolve(void)
+{
+	nmq_alias_tbl *tbl = NULL;
+	nng_msg       *msg;
+	uint8_t        header[2] = { 0x32, 0 };
+	// topic, packet id, properties: payload format and alias 5, payload
+	uint8_t first[] = { 0x00, 0x0d, 's', 'e', 'n', 's', 'o', 'r', '/',
+		'1', '/', 't', 'e', 'm', 'p', 0x00, 0x01, 0x05, 0x01, 0x01,
+		0x23, 0x00, 0x05, 'h', 'e', 'l', 'l', 'o' };
+	// empty topic, only alias 5 in the properties
+	uint8_t second[] = { 0x00, 0x00, 0x00, 0x02, 0x03, 0x23, 0x00, 0x05,
+		'w', 'o', 'r', 'l', 'd' };
+	uint8_t want[] = { 0x00, 0x0d, 's', 'e', 'n', 's', 'o', 'r', '/', '1',
+		'/', 't', 'e', 'm', 'p', 0x00, 0x02, 0x00, 'w', 'o', 'r', 'l',
+		'd' };
+	uint8_t unknown[] = { 0x00, 0x00, 0x00, 0x03, 0x03, 0x23, 0x00, 0x07,
+		'x' };
+
+	NUTS_PASS(nng_msg_alloc(&msg, 0));
+	header[1] = sizeof(first);
+	NUTS_PASS(nng_msg_header_append(msg, header, 2));
+	NUTS_PASS(nng_msg_append(msg, first, sizeof(first)));
+	NUTS_PASS(nmq_pub_alias_resolve(msg, &tbl));
+	NUTS_ASSERT(tbl != NULL);
+	// the alias property is gone, the other one is kept
+	NUTS_TRUE(nng_msg_len(msg) == sizeof(first) - 3);
+	NUTS_TRUE(((uint8_t *) nng_msg_body(msg))[17] == 0x02);
+	NUTS_TRUE(((uint8_t *) nng_msg_body(msg))[18] == 0x01);
+	NUTS_TRUE(((uint8_t *) nng_msg_header(msg))[1] == sizeof(first) - 3);
+	nng_msg_free(msg);
+
+	NUTS_PASS(nng_msg_alloc(&msg, 0));
+	header[1] = sizeof(second);
+	NUTS_PASS(nng_msg_header_append(msg, header, 2));
+	NUTS_PASS(nng_msg_append(msg, second, sizeof(second)));
+	NUTS_PASS(nmq_pub_alias_resolve(msg, &tbl));
+	NUTS_TRUE(nng_msg_len(msg) == sizeof(want));
+	NUTS_TRUE(memcmp(nng_msg_body(msg), want, sizeof(want)) == 0);
+	NUTS_TRUE(nng_msg_header_len(msg) == 2);
+	NUTS_TRUE(((uint8_t *) nng_msg_header(msg))[1] == sizeof(want));
+	nng_msg_free(msg);
+
+	NUTS_PASS(nng_msg_alloc(&msg, 0));
+	header[1] = sizeof(unknown);
+	NUTS_PASS(nng_msg_header_append(msg, header, 2));
+	NUTS_PASS(nng_msg_append(msg, unknown, sizeof(unknown)));
+	NUTS_TRUE(nmq_pub_alias_resolve(msg, &tbl) == MQTT_ERR_PROTOCOL);
+	NUTS_TRUE(nng_msg_len(msg) == sizeof(unknown));
+	nng_msg_free(msg);
+
+	nmq_alias_tbl_free(tbl);
+}
+
+static void
+test_admission(void)
+{
+	nmq_admission adm;
+
+	memset(&adm, 0, sizeof(adm));
+	// no limits
+	for (int i = 0; i < 100; i++) {
+		NUTS_TRUE(nmq_admission_take(&adm, 1000));
+	}
+	NUTS_TRUE(adm.pending == 100);
+
+	// 10 per second, 2 at once
+	memset(&adm, 0, sizeof(adm));
+	adm.rate  = 10;
+	adm.burst = 2;
+	NUTS_TRUE(nmq_admission_take(&adm, 1000));
+	NUTS_TRUE(nmq_admission_take(&adm, 1000));
+	NUTS_TRUE(!nmq_admission_take(&adm, 1050));
+	NUTS_TRUE(nmq_admission_take(&adm, 1100));
+	NUTS_TRUE(!nmq_admission_take(&adm, 1100));
+	// an idle minute buys no more than the burst
+	NUTS_TRUE(nmq_admission_take(&adm, 61100));
+	NUTS_TRUE(nmq_admission_take(&adm, 61100));
+	NUTS_TRUE(!nmq_admission_take(&adm, 61100));
+
+	// pending bound
+	memset(&adm, 0, sizeof(adm));
+	adm.max_pending = 2;
+	NUTS_TRUE(nmq_admission_take(&adm, 1000));
+	NUTS_TRUE(nmq_admission_take(&adm, 1000));
+	NUTS_TRUE(!nmq_admission_take(&adm, 1000));
+	nmq_admission_done(&adm);
+	NUTS_TRUE(nmq_admission_take(&adm, 1000));
+	nmq_admission_done(&adm);
+	nmq_admission_done(&adm);
+	nmq_admission_done(&adm);
+	NUTS_TRUE(adm.pending == 0);
+}
+
+static void
+test_connack_busy(void)
+{
+	// CONNECT of MQTT 3.1.1 and 5, and of 3.1 with its longer name
+	uint8_t v4[] = { 0x10, 0x0c, 0x00, 0x04, 'M', 'Q', 'T', 'T', 0x04,
+		0x02, 0x00, 0x3c, 0x00, 0x00 };
+	uint8_t v5[] = { 0x10, 0x0d, 0x00, 0x04, 'M', 'Q', 'T', 'T', 0x05,
+		0x02, 0x00, 0x3c, 0x00, 0x00, 0x00 };
+	uint8_t v3[] = { 0x10, 0x0e, 0x00, 0x06, 'M', 'Q', 'I', 's', 'd',
+		'p', 0x03, 0x02, 0x00, 0x3c, 0x00, 0x00 };
+	uint8_t buf[5];
+
+	NUTS_TRUE(nmq_connack_busy(v4, sizeof(v4), buf) == 4);
+	NUTS_TRUE(buf[0] == CMD_CONNACK && buf[1] == 2 && buf[3] == 0x03);
+	NUTS_TRUE(nmq_connack_busy(v5, sizeof(v5), buf) == 5);
+	NUTS_TRUE(buf[0] == CMD_CONNACK && buf[1] == 3);
+	NUTS_TRUE(buf[3] == NMQ_SERVER_BUSY && buf[4] == 0);
+	NUTS_TRUE(nmq_connack_busy(v3, sizeof(v3), buf) == 4);
+
+	// not a CONNECT, or too short to tell its version
+	v4[0] = CMD_PUBLISH;
+	NUTS_TRUE(nmq_connack_busy(v4, sizeof(v4), buf) == 0);
+	NUTS_TRUE(nmq_connack_busy(v5, 8, buf) == 0);
+	NUTS_TRUE(nmq_connack_busy(v5, 1, buf) == 0);
 }
 
 NUTS_TESTS = {
 	{ "mqtt_parser pub_extras", test_pub_extra },
 	{ "mqtt_parser utf8_check", test_utf8_check },
+	{ "mqtt_parser utf8_check_simd", test_utf8_check_simd },
+	{ "mqtt_parser var_integer", test_var_integer },
 	{ "mqtt_parser get_utf8_str", test_get_utf8_str },
 	{ "mqtt_parser copyn_utf8_str", test_copyn_utf8_str },
 	{ "mqtt_parser copyn_str", test_copyn_str },
@@ -175,9 +861,18 @@ NUTS_TESTS = {
 	{ "mqtt_parser ws_msg_adaptor", test_ws_msg_adaptor },
 	// TODO more tests needed.
 	{ "mqtt_parser hash", test_hash },
+	{ "mqtt_parser hash crc32c", test_hash_crc32c },
+	{ "mqtt_parser hash nano", test_hash_nano },
 	// TODO more tests needed.
 	{ "mqtt_parser topic_filter", test_topic_filter },
 	{ "mqtt_parser topic_filtern", test_topic_filtern },
+	{ "mqtt_parser topic_match", test_topic_match },
+	{ "mqtt_parser subinfo_index", test_subinfo_index },
+	{ "mqtt_parser alias_table", test_alias_table },
+	{ "mqtt_parser alias_sparse", test_alias_sparse },
+	{ "mqtt_parser alias_resolve", test_alias_resolve },
+	{ "mqtt_parser admission", test_admission },
+	{ "mqtt_parser connack_busy", test_connack_busy },
 
 	{ NULL, NULL },
 };
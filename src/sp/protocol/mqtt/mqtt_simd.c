@@ -0,0 +1,576 @@
+//
+// Copyright 2023 NanoMQ Team, Inc.
+//
+// This software is supplied under the terms of the MIT License, a
+// copy of which should be located in the distribution where this
+// file was obtained (LICENSE.txt).  A copy of the license may also be
+// found online at https://opensource.org/licenses/MIT.
+//
+
+#include <string.h>
+
+#include "mqtt_simd.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define MQTT_SIMD_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define MQTT_SIMD_ARM 1
+#include <arm_acle.h>
+#include <arm_neon.h>
+#if defined(__linux__)
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+#endif
+
+// UTF-8 validation by lookup tables, as described by Keiser and Lemire in
+// "Validating UTF-8 In Less Than One Instruction Per Byte". Each byte is
+// classified by the high nibble of its predecessor, the low nibble of its
+// predecessor and its own high nibble. Bits set in all of the three
+// lookups are errors, except that two continuations in a row are expected
+// in the third and fourth byte of a sequence.
+//
+// On top of that MQTT rejects NUL, the C0 and C1 control characters and
+// the non-characters U+FDD0..U+FDEF and U+xFFFE/U+xFFFF, which are checked
+// on the same vectors.
+
+#define TOO_SHORT (1 << 0)      // 11______ 0_______ or 11______ 11______
+#define TOO_LONG (1 << 1)       // 0_______ 10______
+#define OVERLONG_3 (1 << 2)     // 11100000 100_____
+#define TOO_LARGE (1 << 3)      // 11110100 1001____ or 11110101+ 10______
+#define SURROGATE (1 << 4)      // 11101101 101_____
+#define OVERLONG_2 (1 << 5)     // 1100000_ 10______
+#define TOO_LARGE_1000 (1 << 6) // 11110101+ 1000____
+#define OVERLONG_4 (1 << 6)     // 11110000 1000____
+#define TWO_CONTS (1 << 7)      // 10______ 10______
+#define CARRY (TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+#if defined(MQTT_SIMD_X86) || defined(MQTT_SIMD_ARM)
+
+static const uint8_t utf8_byte_1_high[16] = {
+	TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+	TOO_LONG, TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+	TOO_SHORT | OVERLONG_2, TOO_SHORT, TOO_SHORT | OVERLONG_3 | SURROGATE,
+	TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4,
+};
+
+static const uint8_t utf8_byte_1_low[16] = {
+	CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+	CARRY | OVERLONG_2,
+	CARRY,
+	CARRY,
+	CARRY | TOO_LARGE,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+};
+
+static const uint8_t utf8_byte_2_high[16] = {
+	TOO_SHORT,
+	TOO_SHORT,
+	TOO_SHORT,
+	TOO_SHORT,
+	TOO_SHORT,
+	TOO_SHORT,
+	TOO_SHORT,
+	TOO_SHORT,
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 |
+	    OVERLONG_4,
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+	TOO_SHORT,
+	TOO_SHORT,
+	TOO_SHORT,
+	TOO_SHORT,
+};
+
+// A lead byte in the last 3 bytes of a block that is not followed by all
+// of its continuations, saturated subtraction leaves non zero for those.
+static const uint8_t utf8_incomplete_max[32] = {
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1,
+};
+
+#endif
+
+#if defined(MQTT_SIMD_X86)
+
+#define SSE41_TARGET __attribute__((target("sse4.1")))
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+// x <= max as unsigned bytes
+#define SSE_LE(x, max) _mm_cmpeq_epi8(_mm_min_epu8((x), (max)), (x))
+#define AVX2_LE(x, max) _mm256_cmpeq_epi8(_mm256_min_epu8((x), (max)), (x))
+
+SSE41_TARGET static inline __m128i
+sse41_mqtt_rules(__m128i in, __m128i prev1, __m128i prev2, __m128i prev3)
+{
+	__m128i err;
+	__m128i last;
+
+	// C0 controls, NUL and DEL
+	err = _mm_or_si128(SSE_LE(in, _mm_set1_epi8(0x1F)),
+	    _mm_cmpeq_epi8(in, _mm_set1_epi8(0x7F)));
+	// C1 controls, C2 80..C2 9F
+	err = _mm_or_si128(err,
+	    _mm_and_si128(_mm_cmpeq_epi8(prev1, _mm_set1_epi8((char) 0xC2)),
+	        _mm_cmpeq_epi8(_mm_and_si128(in, _mm_set1_epi8((char) 0xE0)),
+	            _mm_set1_epi8((char) 0x80))));
+	// U+FDD0..U+FDEF, EF B7 90..EF B7 AF
+	err = _mm_or_si128(err,
+	    _mm_and_si128(
+	        _mm_and_si128(_mm_cmpeq_epi8(prev2, _mm_set1_epi8((char) 0xEF)),
+	            _mm_cmpeq_epi8(prev1, _mm_set1_epi8((char) 0xB7))),
+	        SSE_LE(_mm_sub_epi8(in, _mm_set1_epi8((char) 0x90)),
+	            _mm_set1_epi8(0x1F))));
+	// U+xFFFE and U+xFFFF, EF BF BE/BF or F_ _F BF BE/BF
+	last = _mm_and_si128(_mm_cmpeq_epi8(prev1, _mm_set1_epi8((char) 0xBF)),
+	    _mm_cmpeq_epi8(_mm_and_si128(in, _mm_set1_epi8((char) 0xFE)),
+	        _mm_set1_epi8((char) 0xBE)));
+	last = _mm_and_si128(last,
+	    _mm_or_si128(_mm_cmpeq_epi8(prev2, _mm_set1_epi8((char) 0xEF)),
+	        _mm_and_si128(SSE_LE(_mm_set1_epi8((char) 0xF0), prev3),
+	            _mm_cmpeq_epi8(_mm_and_si128(prev2, _mm_set1_epi8(0x0F)),
+	                _mm_set1_epi8(0x0F)))));
+	return _mm_or_si128(err, last);
+}
+
+SSE41_TARGET static inline __m128i
+sse41_check_block(__m128i in, __m128i prev_in)
+{
+	__m128i mask  = _mm_set1_epi8(0x0F);
+	__m128i prev1 = _mm_alignr_epi8(in, prev_in, 15);
+	__m128i prev2 = _mm_alignr_epi8(in, prev_in, 14);
+	__m128i prev3 = _mm_alignr_epi8(in, prev_in, 13);
+	__m128i b1h   = _mm_shuffle_epi8(
+            _mm_loadu_si128((const __m128i *) utf8_byte_1_high),
+            _mm_and_si128(_mm_srli_epi16(prev1, 4), mask));
+	__m128i b1l = _mm_shuffle_epi8(
+	    _mm_loadu_si128((const __m128i *) utf8_byte_1_low),
+	    _mm_and_si128(prev1, mask));
+	__m128i b2h = _mm_shuffle_epi8(
+	    _mm_loadu_si128((const __m128i *) utf8_byte_2_high),
+	    _mm_and_si128(_mm_srli_epi16(in, 4), mask));
+	__m128i sc  = _mm_and_si128(_mm_and_si128(b1h, b1l), b2h);
+	__m128i third =
+	    _mm_subs_epu8(prev2, _mm_set1_epi8((char) (0xE0 - 0x80)));
+	__m128i fourth =
+	    _mm_subs_epu8(prev3, _mm_set1_epi8((char) (0xF0 - 0x80)));
+	__m128i must23 = _mm_and_si128(
+	    _mm_or_si128(third, fourth), _mm_set1_epi8((char) 0x80));
+
+	return _mm_or_si128(_mm_xor_si128(must23, sc),
+	    sse41_mqtt_rules(in, prev1, prev2, prev3));
+}
+
+SSE41_TARGET static bool
+utf8_valid_sse41(const uint8_t *str, size_t len)
+{
+	__m128i prev       = _mm_setzero_si128();
+	__m128i err        = _mm_setzero_si128();
+	__m128i incomplete = _mm_setzero_si128();
+	__m128i max = _mm_loadu_si128((const __m128i *) (utf8_incomplete_max + 16));
+	uint8_t tail[16];
+	size_t  i = 0;
+
+	for (;;) {
+		__m128i in;
+		bool    last = i + 16 > len;
+
+		if (!last) {
+			in = _mm_loadu_si128((const __m128i *) (str + i));
+		} else {
+			// Spaces are valid and end any sequence left open
+			memset(tail, 0x20, sizeof(tail));
+			memcpy(tail, str + i, len - i);
+			in = _mm_loadu_si128((const __m128i *) tail);
+		}
+		if (_mm_movemask_epi8(in) == 0) {
+			err = _mm_or_si128(err, incomplete);
+			err = _mm_or_si128(err,
+			    _mm_or_si128(SSE_LE(in, _mm_set1_epi8(0x1F)),
+			        _mm_cmpeq_epi8(in, _mm_set1_epi8(0x7F))));
+			incomplete = _mm_setzero_si128();
+		} else {
+			err        = _mm_or_si128(err, sse41_check_block(in, prev));
+			incomplete = _mm_subs_epu8(in, max);
+		}
+		prev = in;
+		if (last) {
+			break;
+		}
+		i += 16;
+	}
+	return _mm_testz_si128(err, err);
+}
+
+AVX2_TARGET static inline __m256i
+avx2_prev(__m256i in, __m256i prev_in, const int n)
+{
+	__m256i shifted = _mm256_permute2x128_si256(prev_in, in, 0x21);
+	switch (n) {
+	case 1:
+		return _mm256_alignr_epi8(in, shifted, 15);
+	case 2:
+		return _mm256_alignr_epi8(in, shifted, 14);
+	default:
+		return _mm256_alignr_epi8(in, shifted, 13);
+	}
+}
+
+AVX2_TARGET static inline __m256i
+avx2_mqtt_rules(__m256i in, __m256i prev1, __m256i prev2, __m256i prev3)
+{
+	__m256i err;
+	__m256i last;
+
+	err = _mm256_or_si256(AVX2_LE(in, _mm256_set1_epi8(0x1F)),
+	    _mm256_cmpeq_epi8(in, _mm256_set1_epi8(0x7F)));
+	err = _mm256_or_si256(err,
+	    _mm256_and_si256(
+	        _mm256_cmpeq_epi8(prev1, _mm256_set1_epi8((char) 0xC2)),
+	        _mm256_cmpeq_epi8(
+	            _mm256_and_si256(in, _mm256_set1_epi8((char) 0xE0)),
+	            _mm256_set1_epi8((char) 0x80))));
+	err = _mm256_or_si256(err,
+	    _mm256_and_si256(
+	        _mm256_and_si256(
+	            _mm256_cmpeq_epi8(prev2, _mm256_set1_epi8((char) 0xEF)),
+	            _mm256_cmpeq_epi8(prev1, _mm256_set1_epi8((char) 0xB7))),
+	        AVX2_LE(_mm256_sub_epi8(in, _mm256_set1_epi8((char) 0x90)),
+	            _mm256_set1_epi8(0x1F))));
+	last = _mm256_and_si256(
+	    _mm256_cmpeq_epi8(prev1, _mm256_set1_epi8((char) 0xBF)),
+	    _mm256_cmpeq_epi8(
+	        _mm256_and_si256(in, _mm256_set1_epi8((char) 0xFE)),
+	        _mm256_set1_epi8((char) 0xBE)));
+	last = _mm256_and_si256(last,
+	    _mm256_or_si256(
+	        _mm256_cmpeq_epi8(prev2, _mm256_set1_epi8((char) 0xEF)),
+	        _mm256_and_si256(AVX2_LE(_mm256_set1_epi8((char) 0xF0), prev3),
+	            _mm256_cmpeq_epi8(
+	                _mm256_and_si256(prev2, _mm256_set1_epi8(0x0F)),
+	                _mm256_set1_epi8(0x0F)))));
+	return _mm256_or_si256(err, last);
+}
+
+AVX2_TARGET static inline __m256i
+avx2_check_block(__m256i in, __m256i prev_in)
+{
+	__m256i mask  = _mm256_set1_epi8(0x0F);
+	__m256i prev1 = avx2_prev(in, prev_in, 1);
+	__m256i prev2 = avx2_prev(in, prev_in, 2);
+	__m256i prev3 = avx2_prev(in, prev_in, 3);
+	__m256i b1h   = _mm256_shuffle_epi8(
+            _mm256_broadcastsi128_si256(
+                _mm_loadu_si128((const __m128i *) utf8_byte_1_high)),
+            _mm256_and_si256(_mm256_srli_epi16(prev1, 4), mask));
+	__m256i b1l = _mm256_shuffle_epi8(
+	    _mm256_broadcastsi128_si256(
+	        _mm_loadu_si128((const __m128i *) utf8_byte_1_low)),
+	    _mm256_and_si256(prev1, mask));
+	__m256i b2h = _mm256_shuffle_epi8(
+	    _mm256_broadcastsi128_si256(
+	        _mm_loadu_si128((const __m128i *) utf8_byte_2_high)),
+	    _mm256_and_si256(_mm256_srli_epi16(in, 4), mask));
+	__m256i sc = _mm256_and_si256(_mm256_and_si256(b1h, b1l), b2h);
+	__m256i third =
+	    _mm256_subs_epu8(prev2, _mm256_set1_epi8((char) (0xE0 - 0x80)));
+	__m256i fourth =
+	    _mm256_subs_epu8(prev3, _mm256_set1_epi8((char) (0xF0 - 0x80)));
+	__m256i must23 = _mm256_and_si256(
+	    _mm256_or_si256(third, fourth), _mm256_set1_epi8((char) 0x80));
+
+	return _mm256_or_si256(_mm256_xor_si256(must23, sc),
+	    avx2_mqtt_rules(in, prev1, prev2, prev3));
+}
+
+AVX2_TARGET static bool
+utf8_valid_avx2(const uint8_t *str, size_t len)
+{
+	__m256i prev       = _mm256_setzero_si256();
+	__m256i err        = _mm256_setzero_si256();
+	__m256i incomplete = _mm256_setzero_si256();
+	__m256i max = _mm256_loadu_si256((const __m256i *) utf8_incomplete_max);
+	uint8_t tail[32];
+	size_t  i = 0;
+
+	for (;;) {
+		__m256i in;
+		bool    last = i + 32 > len;
+
+		if (!last) {
+			in = _mm256_loadu_si256((const __m256i *) (str + i));
+		} else {
+			memset(tail, 0x20, sizeof(tail));
+			memcpy(tail, str + i, len - i);
+			in = _mm256_loadu_si256((const __m256i *) tail);
+		}
+		if (_mm256_movemask_epi8(in) == 0) {
+			err = _mm256_or_si256(err, incomplete);
+			err = _mm256_or_si256(err,
+			    _mm256_or_si256(AVX2_LE(in, _mm256_set1_epi8(0x1F)),
+			        _mm256_cmpeq_epi8(in, _mm256_set1_epi8(0x7F))));
+			incomplete = _mm256_setzero_si256();
+		} else {
+			err = _mm256_or_si256(err, avx2_check_block(in, prev));
+			incomplete = _mm256_subs_epu8(in, max);
+		}
+		prev = in;
+		if (last) {
+			break;
+		}
+		i += 32;
+	}
+	return _mm256_testz_si256(err, err);
+}
+
+#endif // MQTT_SIMD_X86
+
+#if defined(MQTT_SIMD_ARM)
+
+static inline uint8x16_t
+neon_check_block(uint8x16_t in, uint8x16_t prev_in)
+{
+	uint8x16_t prev1 = vextq_u8(prev_in, in, 15);
+	uint8x16_t prev2 = vextq_u8(prev_in, in, 14);
+	uint8x16_t prev3 = vextq_u8(prev_in, in, 13);
+	uint8x16_t b1h =
+	    vqtbl1q_u8(vld1q_u8(utf8_byte_1_high), vshrq_n_u8(prev1, 4));
+	uint8x16_t b1l = vqtbl1q_u8(
+	    vld1q_u8(utf8_byte_1_low), vandq_u8(prev1, vdupq_n_u8(0x0F)));
+	uint8x16_t b2h =
+	    vqtbl1q_u8(vld1q_u8(utf8_byte_2_high), vshrq_n_u8(in, 4));
+	uint8x16_t sc     = vandq_u8(vandq_u8(b1h, b1l), b2h);
+	uint8x16_t third  = vqsubq_u8(prev2, vdupq_n_u8(0xE0 - 0x80));
+	uint8x16_t fourth = vqsubq_u8(prev3, vdupq_n_u8(0xF0 - 0x80));
+	uint8x16_t must23 =
+	    vandq_u8(vorrq_u8(third, fourth), vdupq_n_u8(0x80));
+	uint8x16_t err = veorq_u8(must23, sc);
+	uint8x16_t last;
+
+	err = vorrq_u8(err, vcleq_u8(in, vdupq_n_u8(0x1F)));
+	err = vorrq_u8(err, vceqq_u8(in, vdupq_n_u8(0x7F)));
+	err = vorrq_u8(err,
+	    vandq_u8(vceqq_u8(prev1, vdupq_n_u8(0xC2)),
+	        vceqq_u8(vandq_u8(in, vdupq_n_u8(0xE0)), vdupq_n_u8(0x80))));
+	err = vorrq_u8(err,
+	    vandq_u8(vandq_u8(vceqq_u8(prev2, vdupq_n_u8(0xEF)),
+	                 vceqq_u8(prev1, vdupq_n_u8(0xB7))),
+	        vcleq_u8(vsubq_u8(in, vdupq_n_u8(0x90)), vdupq_n_u8(0x1F))));
+	last = vandq_u8(vceqq_u8(prev1, vdupq_n_u8(0xBF)),
+	    vceqq_u8(vandq_u8(in, vdupq_n_u8(0xFE)), vdupq_n_u8(0xBE)));
+	last = vandq_u8(last,
+	    vorrq_u8(vceqq_u8(prev2, vdupq_n_u8(0xEF)),
+	        vandq_u8(vcgeq_u8(prev3, vdupq_n_u8(0xF0)),
+	            vceqq_u8(vandq_u8(prev2, vdupq_n_u8(0x0F)),
+	                vdupq_n_u8(0x0F)))));
+	return vorrq_u8(err, last);
+}
+
+static bool
+utf8_valid_neon(const uint8_t *str, size_t len)
+{
+	uint8x16_t prev       = vdupq_n_u8(0);
+	uint8x16_t err        = vdupq_n_u8(0);
+	uint8x16_t incomplete = vdupq_n_u8(0);
+	uint8x16_t max        = vld1q_u8(utf8_incomplete_max + 16);
+	uint8_t    tail[16];
+	size_t     i = 0;
+
+	for (;;) {
+		uint8x16_t in;
+		bool       last = i + 16 > len;
+
+		if (!last) {
+			in = vld1q_u8(str + i);
+		} else {
+			memset(tail, 0x20, sizeof(tail));
+			memcpy(tail, str + i, len - i);
+			in = vld1q_u8(tail);
+		}
+		if (vmaxvq_u8(in) < 0x80) {
+			err = vorrq_u8(err, incomplete);
+			err = vorrq_u8(err, vcleq_u8(in, vdupq_n_u8(0x1F)));
+			err = vorrq_u8(err, vceqq_u8(in, vdupq_n_u8(0x7F)));
+			incomplete = vdupq_n_u8(0);
+		} else {
+			err        = vorrq_u8(err, neon_check_block(in, prev));
+			incomplete = vqsubq_u8(in, max);
+		}
+		prev = in;
+		if (last) {
+			break;
+		}
+		i += 16;
+	}
+	return vmaxvq_u8(err) == 0;
+}
+
+#endif // MQTT_SIMD_ARM
+
+#if defined(MQTT_SIMD_X86)
+
+__attribute__((target("sse4.2"))) static uint32_t
+crc32c_sse42(uint32_t crc, const uint8_t *p, size_t len)
+{
+	// Byte wise until aligned, the 8 byte instruction does the rest
+	while (len > 0 && ((uintptr_t) p & 7) != 0) {
+		crc = _mm_crc32_u8(crc, *p++);
+		len--;
+	}
+#if defined(__x86_64__)
+	uint64_t crc64 = crc;
+	while (len >= 8) {
+		uint64_t v;
+		memcpy(&v, p, sizeof(v));
+		crc64 = _mm_crc32_u64(crc64, v);
+		p += 8;
+		len -= 8;
+	}
+	crc = (uint32_t) crc64;
+#endif
+	while (len >= 4) {
+		uint32_t v;
+		memcpy(&v, p, sizeof(v));
+		crc = _mm_crc32_u32(crc, v);
+		p += 4;
+		len -= 4;
+	}
+	while (len > 0) {
+		crc = _mm_crc32_u8(crc, *p++);
+		len--;
+	}
+	return crc;
+}
+
+#endif // MQTT_SIMD_X86
+
+#if defined(MQTT_SIMD_ARM)
+
+__attribute__((target("+crc"))) static uint32_t
+crc32c_armv8(uint32_t crc, const uint8_t *p, size_t len)
+{
+	while (len > 0 && ((uintptr_t) p & 7) != 0) {
+		crc = __crc32cb(crc, *p++);
+		len--;
+	}
+	while (len >= 8) {
+		uint64_t v;
+		memcpy(&v, p, sizeof(v));
+		crc = __crc32cd(crc, v);
+		p += 8;
+		len -= 8;
+	}
+	while (len > 0) {
+		crc = __crc32cb(crc, *p++);
+		len--;
+	}
+	return crc;
+}
+
+#endif // MQTT_SIMD_ARM
+
+bool
+mqtt_crc32c_hw_supported(void)
+{
+#if defined(MQTT_SIMD_X86)
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse4.2");
+#elif defined(MQTT_SIMD_ARM) && defined(__linux__) && defined(HWCAP_CRC32)
+	return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#elif defined(MQTT_SIMD_ARM) && defined(__APPLE__)
+	return true;
+#else
+	return false;
+#endif
+}
+
+uint32_t
+mqtt_crc32c_hw(uint32_t crc, const void *buf, size_t len)
+{
+	crc = ~crc;
+#if defined(MQTT_SIMD_X86)
+	crc = crc32c_sse42(crc, buf, len);
+#elif defined(MQTT_SIMD_ARM)
+	crc = crc32c_armv8(crc, buf, len);
+#else
+	(void) buf;
+	(void) len;
+#endif
+	return ~crc;
+}
+
+bool
+mqtt_simd_supported(mqtt_simd_level level)
+{
+	switch (level) {
+	case MQTT_SIMD_NONE:
+		return true;
+#if defined(MQTT_SIMD_X86)
+	case MQTT_SIMD_SSE41:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("sse4.1");
+	case MQTT_SIMD_AVX2:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+#endif
+#if defined(MQTT_SIMD_ARM)
+	case MQTT_SIMD_NEON:
+		return true;
+#endif
+	default:
+		return false;
+	}
+}
+
+mqtt_simd_level
+mqtt_simd_detect(void)
+{
+	// Written once with the same value by whoever gets here first
+	static volatile int level = -1;
+
+	if (level < 0) {
+		if (mqtt_simd_supported(MQTT_SIMD_AVX2)) {
+			level = MQTT_SIMD_AVX2;
+		} else if (mqtt_simd_supported(MQTT_SIMD_SSE41)) {
+			level = MQTT_SIMD_SSE41;
+		} else if (mqtt_simd_supported(MQTT_SIMD_NEON)) {
+			level = MQTT_SIMD_NEON;
+		} else {
+			level = MQTT_SIMD_NONE;
+		}
+	}
+	return (mqtt_simd_level) level;
+}
+
+bool
+mqtt_utf8_valid(const uint8_t *str, size_t len, mqtt_simd_level level)
+{
+	switch (level) {
+#if defined(MQTT_SIMD_X86)
+	case MQTT_SIMD_AVX2:
+		return utf8_valid_avx2(str, len);
+	case MQTT_SIMD_SSE41:
+		return utf8_valid_sse41(str, len);
+#endif
+#if defined(MQTT_SIMD_ARM)
+	case MQTT_SIMD_NEON:
+		return utf8_valid_neon(str, len);
+#endif
+	default:
+		return utf8_check_scalar((const char *) str, len) == 0;
+	}
+}
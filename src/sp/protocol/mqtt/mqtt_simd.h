@@ -0,0 +1,47 @@
+//
+// Copyright 2023 NanoMQ Team, Inc.
+//
+// This software is supplied under the terms of the MIT License, a
+// copy of which should be located in the distribution where this
+// file was obtained (LICENSE.txt).  A copy of the license may also be
+// found online at https://opensource.org/licenses/MIT.
+//
+
+#ifndef NNG_MQTT_SIMD_H
+#define NNG_MQTT_SIMD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Vector extensions the MQTT parser is able to make use of. Which one is
+// used is decided once at runtime by the features of the CPU.
+typedef enum {
+	MQTT_SIMD_NONE,
+	MQTT_SIMD_SSE41,
+	MQTT_SIMD_AVX2,
+	MQTT_SIMD_NEON,
+} mqtt_simd_level;
+
+// Shorter strings are not worth the setup of the vector loop.
+#define MQTT_UTF8_SIMD_MIN 16
+
+extern mqtt_simd_level mqtt_simd_detect(void);
+extern bool            mqtt_simd_supported(mqtt_simd_level level);
+
+// Validates UTF-8 as required by MQTT with the given extension, NUL,
+// control characters and non-characters are rejected too. Results are the
+// same as the ones of utf8_check_scalar for every level. Passing a level
+// the CPU does not support is undefined, check mqtt_simd_supported first.
+extern bool mqtt_utf8_valid(
+    const uint8_t *str, size_t len, mqtt_simd_level level);
+
+// Byte by byte validation, the reference for the vector versions.
+extern int utf8_check_scalar(const char *str, size_t len);
+
+// CRC32C instruction of SSE4.2 or of the ARMv8 CRC extension. crc is the
+// value of the previous chunk, 0 to start.
+extern bool     mqtt_crc32c_hw_supported(void);
+extern uint32_t mqtt_crc32c_hw(uint32_t crc, const void *buf, size_t len);
+
+#endif // NNG_MQTT_SIMD_H
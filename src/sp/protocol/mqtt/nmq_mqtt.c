@@ -90,6 +90,7 @@ struct nano_pipe {
 	conn_param *conn_param;
 	nni_lmq     rlmq; 		 // only for sending cache
 	void       *nano_qos_db; // 'sqlite' or 'nni_id_hash_map'
+	nmq_alias_tbl *alias_in; // topic aliases of the client
 };
 
 void
@@ -407,14 +408,10 @@ nano_ctx_send(void *arg, nni_aio *aio)
 			qos_pac = nni_msg_get_pub_qos(msg);
 			pld_pac = nni_msg_get_pub_topic(msg, &tlen_pac);
 		}
-		subinfo *info = NULL;
-		NNI_LIST_FOREACH(p->pipe->subinfol, info) {
-			if (!info)
-				continue;
-			if (topic_filtern(info->topic, pld_pac, tlen_pac)) {
-				qos = qos_pac > info->qos ? info->qos : qos_pac; // MIN
-				break;
-			}
+		subinfo *info = nmq_subinfo_next(
+		    p->pipe->subinfol, NULL, pld_pac, tlen_pac, false);
+		if (info != NULL) {
+			qos = qos_pac > info->qos ? info->qos : qos_pac; // MIN
 		}
 		if (qos > 0) {
 			packetid = nni_pipe_inc_packetid(p->pipe);
@@ -573,6 +570,9 @@ nano_pipe_fini(void *arg)
 	nng_msg   *msg;
 
 	log_trace(" ########## nano_pipe_fini ########## ");
+	// Aliases never outlive the connection, even with a session kept
+	nmq_alias_tbl_free(p->alias_in);
+	p->alias_in = NULL;
 	if (p->pipe->cache) {
 		return; // your time is yet to come
 	}
@@ -1039,6 +1039,127 @@ nano_ctx_recv(void *arg, nni_aio *aio)
 	nni_aio_finish(aio, 0, nni_msg_len(msg));
 }
 
+// Hand a msg to a waiting ctx, or keep it in waitlmq until one asks.
+// Should be called with s->lk hold.
+static void
+nano_sock_deliver(nano_sock *s, nni_msg *msg)
+{
+	nano_ctx *ctx;
+	nni_aio  *aio;
+
+	if ((ctx = nni_list_first(&s->recvq)) != NULL) {
+		aio       = ctx->raio;
+		ctx->raio = NULL;
+		nni_list_remove(&s->recvq, ctx);
+		ctx->pipe_id = nni_msg_get_pipe(msg);
+		nni_aio_set_msg(aio, msg);
+		nni_aio_finish(aio, 0, nni_msg_len(msg));
+		return;
+	}
+	if (nni_lmq_full(&s->waitlmq) &&
+	    nni_lmq_resize(&s->waitlmq, nni_lmq_cap(&s->waitlmq) * 2) != 0) {
+		log_error("wait lmq resize failed.");
+		conn_param_free(nni_msg_get_conn_param(msg));
+		nni_msg_free(msg);
+		return;
+	}
+	nni_lmq_put(&s->waitlmq, msg);
+}
+
+// Rebuild one msg of an envelope as the PUBLISH its client held back.
+static int
+nano_envelope_deliver(void *arg, const char *topic, uint16_t tlen,
+    const uint8_t *payload, uint32_t plen, bool retain)
+{
+	nano_pipe *p = arg;
+	nano_sock *s = p->broker;
+	nni_msg   *msg;
+	uint8_t    hdr[5];
+	uint8_t    tl[2];
+	uint8_t    prop = 0;
+	uint8_t    hlen;
+	uint32_t   len;
+	bool       v5 = p->conn_param->pro_ver == MQTT_PROTOCOL_VERSION_v5;
+
+	len    = 2 + tlen + (v5 ? 1 : 0) + plen;
+	hdr[0] = CMD_PUBLISH | (retain ? 0x01 : 0);
+	hlen   = 1 + put_var_integer(hdr + 1, len);
+	NNI_PUT16(tl, tlen);
+	if (nni_msg_alloc(&msg, 0) != 0) {
+		return (MQTT_ERR_NOMEM);
+	}
+	if (nni_msg_header_append(msg, hdr, hlen) != 0 ||
+	    nni_msg_append(msg, tl, 2) != 0 ||
+	    nni_msg_append(msg, topic, tlen) != 0 ||
+	    (v5 && nni_msg_append(msg, &prop, 1) != 0) ||
+	    nni_msg_append(msg, payload, plen) != 0) {
+		nni_msg_free(msg);
+		return (MQTT_ERR_NOMEM);
+	}
+	nni_msg_set_remaining_len(msg, len);
+	nni_msg_set_cmd_type(msg, CMD_PUBLISH);
+	nni_msg_set_pipe(msg, p->id);
+	nni_msg_set_timestamp(msg, nng_clock());
+	nni_msg_set_conn_param(msg, p->conn_param);
+	conn_param_clone(p->conn_param);
+
+	// The records are QoS 0.  One client does not get to grow waitlmq,
+	// what does not fit is dropped along with the rest of the envelope.
+	nni_mtx_lock(&s->lk);
+	if (nni_list_empty(&s->recvq) && nni_lmq_full(&s->waitlmq)) {
+		nni_mtx_unlock(&s->lk);
+		conn_param_free(p->conn_param);
+		nni_msg_free(msg);
+		return (MQTT_ERR_NOMEM);
+	}
+	nano_sock_deliver(s, msg);
+	nni_mtx_unlock(&s->lk);
+	return (MQTT_SUCCESS);
+}
+
+// Unpack a PUBLISH to "$envelope/..." into the msgs it carries, which are
+// then handled as if they had come one by one.  Only when the broker is
+// configured to, else it is an ordinary PUBLISH.
+static bool
+nano_envelope_unpack(nano_pipe *p, nni_msg *msg)
+{
+	conf    *cfg  = p->broker->conf;
+	uint8_t *body = nni_msg_body(msg);
+	size_t   mlen = nni_msg_len(msg);
+	size_t   pos;
+	uint32_t plen;
+	uint8_t  bytes = 0;
+	char    *topic;
+	int      tlen;
+	int      rv;
+
+	if (!cfg->envelope_unpack) {
+		return (false);
+	}
+	topic = nni_msg_get_pub_topic(msg, &tlen);
+	if (!nni_mqtt_envelope_topic(topic, tlen)) {
+		return (false);
+	}
+	pos = 2 + tlen + (nni_msg_get_pub_qos(msg) > 0 ? 2 : 0);
+	if (p->conn_param->pro_ver == MQTT_PROTOCOL_VERSION_v5 && pos < mlen) {
+		plen = get_var_integer(body + pos, &bytes);
+		pos += bytes + plen;
+	}
+	if (pos > mlen) {
+		rv = MQTT_ERR_MALFORMED;
+	} else {
+		rv = nni_mqtt_envelope_open(body + pos, mlen - pos,
+		    (uint32_t) (cfg->max_packet_size < UINT32_MAX
+		            ? cfg->max_packet_size
+		            : UINT32_MAX),
+		    cfg->envelope_max_records, nano_envelope_deliver, p);
+	}
+	if (rv != MQTT_SUCCESS) {
+		log_warn("envelope of pipe %u not unpacked: %d", p->id, rv);
+	}
+	return (true);
+}
+
 static void
 nano_pipe_recv_cb(void *arg)
 {
@@ -1158,8 +1279,22 @@ nano_pipe_recv_cb(void *arg)
 		}
 		nni_pipe_close(p->pipe);
 		break;
-	case CMD_CONNACK:
 	case CMD_PUBLISH:
+		if (cparam->pro_ver == MQTT_PROTOCOL_VERSION_v5 &&
+		    nmq_pub_alias_resolve(msg, &p->alias_in) ==
+		        MQTT_ERR_PROTOCOL) {
+			log_warn("Invalid topic alias, close the pipe");
+			nni_msg_free(msg);
+			p->reason_code = TOPIC_ALIAS_INVALID;
+			nni_aio_set_msg(&p->aio_recv, NULL);
+			nni_pipe_close(p->pipe);
+			return;
+		}
+		if (nano_envelope_unpack(p, msg)) {
+			goto drop;
+		}
+		// fall through
+	case CMD_CONNACK:
 		// 1. Clone for App layer 2. Clone should be called before being used
 		conn_param_clone(cparam);
 		break;
@@ -64,6 +64,9 @@ extern void nni_nmq_broker_tcp_register();
 #ifdef NNG_TRANSPORT_MQTT_BROKER_TLS
 extern void nni_nmq_broker_tls_register();
 #endif
+#ifdef NNG_TRANSPORT_MQTT_BROKER_INPROC
+extern void nni_nmq_broker_inproc_register(void);
+#endif
 #ifdef NNG_TRANSPORT_TLS
 extern void nni_sp_tls_register(void);
 #endif
@@ -105,6 +108,9 @@ nni_sp_tran_sys_init(void)
 #ifdef NNG_TRANSPORT_MQTT_BROKER_TLS
 	nni_nmq_broker_tls_register();
 #endif
+#ifdef NNG_TRANSPORT_MQTT_BROKER_INPROC
+	nni_nmq_broker_inproc_register();
+#endif
 #ifdef NNG_TRANSPORT_TLS
 	nni_sp_tls_register();
 #endif
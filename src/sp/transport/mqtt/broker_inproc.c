@@ -0,0 +1,1456 @@
+//
+// Copyright 2024 NanoMQ Team, Inc. <jaylin@emqx.io>
+//
+// This software is supplied under the terms of the MIT License, a
+// copy of which should be located in the distribution where this
+// file was obtained (LICENSE.txt).  A copy of the license may also be
+// found online at https://opensource.org/licenses/MIT.
+//
+
+#include <string.h>
+
+#include "core/nng_impl.h"
+#include "core/sockimpl.h"
+#include "mqtt/transport.h"
+
+#include "nng/mqtt/mqtt_client.h"
+#include "nng/protocol/mqtt/mqtt.h"
+#include "nng/protocol/mqtt/mqtt_parser.h"
+#include "nng/supplemental/nanolib/conf.h"
+#include "nng/supplemental/nanolib/mqtt_db.h"
+#include "supplemental/mqtt/mqtt_msg.h"
+#include "supplemental/mqtt/mqtt_qos_db_api.h"
+
+// In-process MQTT transport. It connects an MQTT client socket to a
+// broker socket of the same process, so an application embedding both
+// skips the TCP stack and the encoding of every packet into a byte
+// stream. The broker listens on "nmq-inproc://<name>" and the client
+// dials "mqtt-inproc://<name>".
+//
+// Msgs are handed from one pipe to the other as they are. Only a PUBLISH
+// the broker forwards is composed again, as the QoS, packet id and
+// properties of it depend on the subscription and version of the client.
+// A QoS 0 PUBLISH both ends agree on is passed through without copying
+// unless the broker still holds it for other subscribers.
+
+#define NMQ_INPROC_QUEUE_LEN 1024
+
+typedef struct nmq_inproc_pair  nmq_inproc_pair;
+typedef struct nmq_inproc_pipe  nmq_inproc_pipe;
+typedef struct nmq_inproc_ep    nmq_inproc_ep;
+typedef struct nmq_inproc_queue nmq_inproc_queue;
+
+typedef struct {
+	nni_mtx  mx;
+	nni_list servers;
+} nmq_inproc_global;
+
+// nmq_inproc_queue carries the msgs of one direction. Senders are
+// finished as soon as their msgs are queued, unless the reader fell
+// too far behind.
+struct nmq_inproc_queue {
+	nni_lmq          msgs;
+	nni_list         readers;
+	nni_list         writers;
+	nni_mtx          lock;
+	bool             closed;
+	bool             client; // the client reads from this queue
+	nmq_inproc_pair *pair;
+};
+
+// nmq_inproc_pair is a connection. Queue 0 carries msgs from the client
+// to the broker and queue 1 the other way.
+struct nmq_inproc_pair {
+	nni_atomic_int   ref;
+	nmq_inproc_queue queues[2];
+	conn_param      *cparam; // from the CONNECT, as the broker sees it
+	uint8_t          pro_ver;
+	nmq_inproc_pipe *cpipe;
+	nmq_inproc_pipe *spipe;
+	nmq_inproc_ep   *cep; // dialer waiting for the CONNACK
+};
+
+struct nmq_inproc_pipe {
+	const char       *addr;
+	nmq_inproc_pair  *pair;
+	nmq_inproc_queue *recv_queue;
+	nmq_inproc_queue *send_queue;
+	nni_pipe         *npipe;
+	nni_list_node     node;
+	bool              broker;
+	conf             *conf;
+	nni_msg          *connack; // delivered on the first recv of a client
+	conn_param       *cparam;  // set on msgs a client receives
+};
+
+struct nmq_inproc_ep {
+	const char      *addr;
+	bool             listener;
+	bool             closed;
+	nni_list_node    node;
+	nni_list         waitpipes; // pipes of a server waiting to accept
+	nni_aio         *useraio;
+	conf            *conf;
+	nni_msg         *connmsg;
+	property        *property;
+	reason_code      reason_code;
+	nmq_inproc_pair *nego; // pair of a dialer waiting for the CONNACK
+};
+
+static nmq_inproc_global nmq_inproc = {
+	.servers = NNI_LIST_INITIALIZER(nmq_inproc.servers, nmq_inproc_ep, node),
+	.mx      = NNI_MTX_INITIALIZER,
+};
+
+static void nmq_inproc_queue_push(nmq_inproc_queue *, nni_msg *);
+static void nmq_inproc_queue_run(nmq_inproc_queue *);
+
+static void
+nmq_inproc_init(void)
+{
+}
+
+static void
+nmq_inproc_fini(void)
+{
+}
+
+// Both ends of a connection match on what follows the scheme.
+static const char *
+nmq_inproc_url_name(const nni_url *url)
+{
+	const char *name = strstr(url->u_rawurl, "://");
+
+	return (name != NULL ? name + 3 : url->u_rawurl);
+}
+
+static void
+nmq_inproc_pair_destroy(nmq_inproc_pair *pair)
+{
+	for (int i = 0; i < 2; i++) {
+		nni_lmq_fini(&pair->queues[i].msgs);
+		nni_mtx_fini(&pair->queues[i].lock);
+	}
+	if (pair->cparam != NULL) {
+		conn_param_free(pair->cparam);
+	}
+	NNI_FREE_STRUCT(pair);
+}
+
+static void
+nmq_inproc_pipe_fini(void *arg)
+{
+	nmq_inproc_pipe *p = arg;
+	nmq_inproc_pair *pair;
+
+	if ((pair = p->pair) != NULL) {
+		// If we are the last peer, then toss the pair structure.
+		if (nni_atomic_dec_nv(&pair->ref) == 0) {
+			nmq_inproc_pair_destroy(pair);
+		}
+	}
+	if (p->connack != NULL) {
+		nni_msg_free(p->connack);
+	}
+	if (p->cparam != NULL) {
+		conn_param_free(p->cparam);
+	}
+	NNI_FREE_STRUCT(p);
+}
+
+static int
+nmq_inproc_pipe_init(void *arg, nni_pipe *npipe)
+{
+	nmq_inproc_pipe *p    = arg;
+	conn_param      *cparam = p->pair->cparam;
+	char            *cid;
+
+	p->npipe = npipe;
+	if (!p->broker) {
+		return (0);
+	}
+	// as the broker transports over TCP do
+	nni_pipe_set_conn_param(npipe, cparam);
+	cid = (char *) conn_param_get_clientid(cparam);
+	(void) nni_pipe_set_pid(npipe, DJBHashn(cid, strlen(cid)));
+	if ((p->conf == NULL || !p->conf->sqlite.enable) &&
+	    npipe->nano_qos_db == NULL) {
+		nni_qos_db_init_id_hash(npipe->nano_qos_db);
+	}
+	return (0);
+}
+
+static void
+nmq_inproc_queue_run_closed(nmq_inproc_queue *queue)
+{
+	nni_aio *aio;
+
+	nni_lmq_flush(&queue->msgs);
+	while (((aio = nni_list_first(&queue->readers)) != NULL) ||
+	    ((aio = nni_list_first(&queue->writers)) != NULL)) {
+		nni_aio_list_remove(aio);
+		nni_aio_finish_error(aio, NNG_ECLOSED);
+	}
+}
+
+static void
+nmq_inproc_queue_close(nmq_inproc_queue *queue)
+{
+	nni_mtx_lock(&queue->lock);
+	queue->closed = true;
+	nmq_inproc_queue_run_closed(queue);
+	nni_mtx_unlock(&queue->lock);
+}
+
+// The acknowledgement owed for a msg, or NULL. Both ends answer the
+// same packets, which the TCP transports do as they read them.
+static nni_msg *
+nmq_inproc_ack(nni_msg *msg, uint8_t pro_ver)
+{
+	uint8_t  *header = nni_msg_header(msg);
+	uint16_t  packet_id   = 0;
+	uint8_t   reason_code = 0;
+	property *prop        = NULL;
+	uint8_t   ack_cmd;
+	nni_msg  *qmsg;
+
+	switch (header[0] & 0xf0) {
+	case CMD_PUBLISH:
+		switch (nni_msg_get_pub_qos(msg)) {
+		case 1:
+			ack_cmd = CMD_PUBACK;
+			break;
+		case 2:
+			ack_cmd = CMD_PUBREC;
+			break;
+		default:
+			return (NULL);
+		}
+		if ((packet_id = nni_msg_get_pub_pid(msg)) == 0) {
+			log_warn("0 Packet ID in QoS Message!");
+			return (NULL);
+		}
+		break;
+	case CMD_PUBREC:
+		ack_cmd = CMD_PUBREL;
+		break;
+	case CMD_PUBREL:
+		ack_cmd = CMD_PUBCOMP;
+		break;
+	default:
+		return (NULL);
+	}
+	if (ack_cmd == CMD_PUBREL || ack_cmd == CMD_PUBCOMP) {
+		if (nni_mqtt_pubres_decode(msg, &packet_id, &reason_code,
+		        &prop, pro_ver) != 0) {
+			log_error("decode PUBREC or PUBREL variable header "
+			          "failed!");
+			return (NULL);
+		}
+	}
+	if (nni_msg_alloc(&qmsg, 0) != 0) {
+		property_free(prop);
+		return (NULL);
+	}
+	nni_msg_set_cmd_type(qmsg, ack_cmd);
+	nni_mqtt_msgack_encode(qmsg, packet_id, reason_code, prop, pro_ver);
+	property_free(prop);
+	nni_mqtt_pubres_header_encode(qmsg, ack_cmd);
+	return (qmsg);
+}
+
+// Leave only the fixed header in the header of a msg, which is where a
+// client decodes it from.
+static int
+nmq_inproc_msg_split(nni_msg *msg)
+{
+	uint8_t *header = nni_msg_header(msg);
+	size_t   hlen   = nni_msg_header_len(msg);
+	uint8_t *body;
+	size_t   fixed = 2;
+	int      rv;
+
+	if (hlen == 0) {
+		body = nni_msg_body(msg);
+		if (nni_msg_len(msg) < 2) {
+			return (NNG_EPROTO);
+		}
+		while (fixed < 5 && fixed < nni_msg_len(msg) &&
+		    (body[fixed - 1] & 0x80) != 0) {
+			fixed++;
+		}
+		if ((rv = nni_msg_header_append(msg, body, fixed)) != 0) {
+			return (rv);
+		}
+		nni_msg_trim(msg, fixed);
+		return (0);
+	}
+	while (fixed < 5 && fixed < hlen && (header[fixed - 1] & 0x80) != 0) {
+		fixed++;
+	}
+	if (hlen > fixed) {
+		if ((rv = nni_msg_insert(msg, header + fixed, hlen - fixed)) !=
+		    0) {
+			return (rv);
+		}
+		nni_msg_header_chop(msg, hlen - fixed);
+	}
+	return (0);
+}
+
+// Deliver queued msgs to readers, then let writers go as space allows.
+static void
+nmq_inproc_queue_run(nmq_inproc_queue *queue)
+{
+	nmq_inproc_pair *pair = queue->pair;
+	nni_aio         *rd;
+	nni_aio         *wr;
+	nni_msg         *msg;
+
+	if (queue->closed) {
+		nmq_inproc_queue_run_closed(queue);
+		return;
+	}
+	while ((rd = nni_list_first(&queue->readers)) != NULL &&
+	    nni_lmq_get(&queue->msgs, &msg) == 0) {
+		nni_aio_list_remove(rd);
+		if (queue->client) {
+			// the protocol sends the acknowledgement for us
+			nni_aio_set_prov_data(rd, nmq_inproc_ack(msg, pair->pro_ver));
+			nni_msg_set_conn_param(msg, pair->cpipe->cparam);
+		}
+		nni_aio_set_msg(rd, msg);
+		nni_aio_finish(rd, 0, nni_msg_len(msg));
+	}
+	while ((wr = nni_list_first(&queue->writers)) != NULL &&
+	    nni_lmq_len(&queue->msgs) < NMQ_INPROC_QUEUE_LEN) {
+		nni_aio_list_remove(wr);
+		nni_aio_finish(wr, 0, 0);
+	}
+}
+
+// Queue a msg regardless of the length of the queue. Writers are held
+// back instead, so a single send never loses any of its msgs.
+static void
+nmq_inproc_queue_push(nmq_inproc_queue *queue, nni_msg *msg)
+{
+	if (queue->closed) {
+		nni_msg_free(msg);
+		return;
+	}
+	if (nni_lmq_full(&queue->msgs) &&
+	    nni_lmq_resize(&queue->msgs, nni_lmq_cap(&queue->msgs) * 2) != 0) {
+		log_warn("msg dropped due to lack of memory!");
+		nni_msg_free(msg);
+		return;
+	}
+	(void) nni_lmq_put(&queue->msgs, msg);
+}
+
+static void
+nmq_inproc_queue_cancel(nni_aio *aio, void *arg, int rv)
+{
+	nmq_inproc_queue *queue = arg;
+
+	nni_mtx_lock(&queue->lock);
+	if (nni_aio_list_active(aio)) {
+		nni_aio_list_remove(aio);
+		nni_aio_finish_error(aio, rv);
+	}
+	nni_mtx_unlock(&queue->lock);
+}
+
+// Finish a send once its msgs are queued, or hold it back until the
+// reader catches up.
+static void
+nmq_inproc_queue_wait(nmq_inproc_queue *queue, nni_aio *aio, size_t n)
+{
+	int rv;
+
+	if (queue->closed) {
+		nni_aio_finish_error(aio, NNG_ECLOSED);
+		return;
+	}
+	if (nni_lmq_len(&queue->msgs) < NMQ_INPROC_QUEUE_LEN) {
+		nni_aio_finish(aio, 0, n);
+		return;
+	}
+	if ((rv = nni_aio_schedule(aio, nmq_inproc_queue_cancel, queue)) != 0) {
+		nni_aio_finish_error(aio, rv);
+		return;
+	}
+	nni_aio_list_append(&queue->writers, aio);
+}
+
+// Compose the PUBLISH a subscription of the client gets, as the broker
+// transports over TCP do on the wire. The final QoS is capped by the
+// subscription, the packet id is one of this pipe and the properties
+// follow the MQTT version of the client. With own set, the msg may be
+// handed over, leaving *msgp NULL.
+static nni_msg *
+nmq_inproc_publish(nmq_inproc_pipe *p, nni_msg **msgp, subinfo *info,
+    nni_aio *aio, bool own)
+{
+	nni_msg  *msg       = *msgp;
+	nni_pipe *npipe     = p->npipe;
+	bool      is_sqlite = p->conf != NULL && p->conf->sqlite.enable;
+	bool      v5        = p->pair->pro_ver == MQTT_PROTOCOL_VERSION_v5;
+	bool      src_v5    = nni_msg_cmd_type(msg) == CMD_PUBLISH_V5;
+	uint8_t  *header    = nni_msg_header(msg);
+	uint8_t  *body      = nni_msg_body(msg);
+	size_t    mlen      = nni_msg_len(msg);
+	uint8_t   qos_pac   = nni_msg_get_pub_qos(msg);
+	uint8_t   qos       = qos_pac > info->qos ? info->qos : qos_pac;
+	uint8_t   fixheader = header[0];
+	uint8_t   var_prop[6], proplen[4], tmp[5];
+	uint32_t  prop_len = 0, prop_extra = 0;
+	uint8_t   prop_bytes = 0, tprop_bytes = 0;
+	size_t    tlen, pos, rlen;
+	uint16_t  pid;
+	nni_msg  *out;
+	nni_msg  *old;
+	uint8_t  *ptr;
+
+	NNI_GET16(body, tlen);
+	pos = 2 + tlen + (qos_pac > 0 ? 2 : 0);
+	if (pos > mlen) {
+		return (NULL);
+	}
+	if (src_v5) {
+		prop_len = get_var_integer(body + pos, &prop_bytes);
+		if (pos + prop_bytes + prop_len > mlen) {
+			return (NULL);
+		}
+	}
+
+	fixheader = (fixheader & 0xF9) | (uint8_t) (qos << 1);
+	if (qos == 0) {
+		// simply set DUP flag to 0 & correct error from client
+		fixheader &= ~(1 << 3);
+	}
+	if (v5 && info->rap == 0) {
+		fixheader &= 0xFE;
+	}
+	if (v5 && info->subid != 0) {
+		var_prop[0] = 0x0B;
+		prop_extra  = 1 + put_var_integer(var_prop + 1, info->subid);
+	}
+
+	// Nothing to change but the first byte: pass the msg through. It is
+	// copied only if the broker still holds it for others.
+	if (qos == 0 && qos_pac == 0 && v5 == src_v5 && prop_extra == 0) {
+		if (v5 && p->pair->cparam->max_packet_size != 0 &&
+		    nni_msg_header_len(msg) + mlen >
+		        p->pair->cparam->max_packet_size) {
+			log_warn("msg dropped due to overceed max packet size!");
+			return (NULL);
+		}
+		if (own) {
+			*msgp = NULL;
+		} else {
+			nni_msg_clone(msg);
+		}
+		if ((out = nni_msg_unique(msg)) == NULL) {
+			return (NULL);
+		}
+		if (nmq_inproc_msg_split(out) != 0) {
+			nni_msg_free(out);
+			return (NULL);
+		}
+		*(uint8_t *) nni_msg_header(out) = fixheader;
+		nni_msg_set_proto_data(out, NULL, NULL);
+		return (out);
+	}
+
+	// variable header up to the properties, which start at pos
+	rlen = 2 + tlen + (qos > 0 ? 2 : 0);
+	if (v5) {
+		tprop_bytes = put_var_integer(
+		    proplen, (src_v5 ? prop_len : 0) + prop_extra);
+		rlen += tprop_bytes + prop_extra + (src_v5 ? prop_len : 0);
+	}
+	rlen += mlen - pos - (src_v5 ? prop_bytes + prop_len : 0);
+	if (v5 && p->pair->cparam->max_packet_size != 0 &&
+	    rlen + 5 > p->pair->cparam->max_packet_size) {
+		log_warn("msg dropped due to overceed max packet size!");
+		return (NULL);
+	}
+	if (nni_msg_alloc(&out, rlen) != 0) {
+		return (NULL);
+	}
+	tmp[0] = fixheader;
+	if (nni_msg_header_append(
+	        out, tmp, 1 + put_var_integer(tmp + 1, (uint32_t) rlen)) != 0) {
+		nni_msg_free(out);
+		return (NULL);
+	}
+
+	ptr = nni_msg_body(out);
+	memcpy(ptr, body, 2 + tlen);
+	ptr += 2 + tlen;
+	if (qos > 0) {
+		// packetid in aio to differ resend msg
+		pid = (uint16_t) (size_t) nni_aio_get_prov_data(aio);
+		if (pid == 0) {
+			// first time send this msg, store it for qos retry
+			pid = nni_pipe_inc_packetid(npipe);
+			nni_msg_clone(msg);
+			if ((old = nni_qos_db_get(is_sqlite, npipe->nano_qos_db,
+			         npipe->p_id, pid)) != NULL) {
+				log_error("packet id duplicates in nano_qos_db");
+				nni_qos_db_remove_msg(
+				    is_sqlite, npipe->nano_qos_db, old);
+			}
+			nni_qos_db_set(is_sqlite, npipe->nano_qos_db,
+			    npipe->p_id, pid, msg);
+			nni_qos_db_remove_oldest(is_sqlite, npipe->nano_qos_db,
+			    p->conf != NULL ? p->conf->sqlite.disk_cache_size
+			                    : 0);
+		}
+		NNI_PUT16(ptr, pid);
+		ptr += 2;
+	}
+	if (v5) {
+		memcpy(ptr, proplen, tprop_bytes);
+		ptr += tprop_bytes;
+		memcpy(ptr, var_prop, prop_extra);
+		ptr += prop_extra;
+		if (src_v5) {
+			memcpy(ptr, body + pos + prop_bytes, prop_len);
+			ptr += prop_len;
+		}
+	}
+	if (src_v5) {
+		pos += prop_bytes + prop_len;
+	}
+	memcpy(ptr, body + pos, mlen - pos);
+	return (out);
+}
+
+// The broker end sends a PUBLISH to every subscription it matches.
+static void
+nmq_inproc_send_publish(nmq_inproc_pipe *p, nni_msg *msg, nni_aio *aio)
+{
+	nmq_inproc_queue *queue  = p->send_queue;
+	uint8_t          *header = nni_msg_header(msg);
+	bool              v5     = p->pair->pro_ver == MQTT_PROTOCOL_VERSION_v5;
+	int               topic_len = 0;
+	char             *topic = nni_msg_get_pub_topic(msg, &topic_len);
+	subinfo          *info;
+	subinfo          *last = NULL;
+	nni_msg          *out;
+	size_t            n = 0;
+
+	nni_mtx_lock(&queue->lock);
+	// Retained msgs go to every subscription, due to topic reflection.
+	// The last one matched may take the msg over.
+	NMQ_SUBINFO_FOREACH (p->npipe->subinfol, info, topic, topic_len,
+	    (*header & 0x01) == 1) {
+		if (v5 && info->no_local == 1 &&
+		    p->npipe->p_id == nni_msg_get_pipe(msg)) {
+			continue;
+		}
+		if (last != NULL &&
+		    (out = nmq_inproc_publish(p, &msg, last, aio, false)) !=
+		        NULL) {
+			n += nni_msg_len(out);
+			nmq_inproc_queue_push(queue, out);
+		}
+		last = info;
+	}
+	if (last != NULL &&
+	    (out = nmq_inproc_publish(p, &msg, last, aio, true)) != NULL) {
+		n += nni_msg_len(out);
+		nmq_inproc_queue_push(queue, out);
+	}
+	if (msg != NULL) {
+		nni_msg_free(msg);
+	}
+	nmq_inproc_queue_run(queue);
+	nmq_inproc_queue_wait(queue, aio, n);
+	nni_mtx_unlock(&queue->lock);
+}
+
+// The broker answered the CONNECT: the dialer is done.
+static void
+nmq_inproc_connack(nmq_inproc_pair *pair, nni_msg *msg)
+{
+	nmq_inproc_ep   *ep    = pair->cep;
+	nmq_inproc_pipe *cpipe = pair->cpipe;
+	nni_msg         *ack   = NULL;
+	nni_aio         *aio;
+	int              rv;
+
+	pair->cep = NULL;
+	ep->nego  = NULL;
+	aio       = ep->useraio;
+	ep->useraio = NULL;
+
+	if ((rv = nni_mqtt_msg_alloc(&ack, 0)) != 0 ||
+	    (rv = nni_msg_header_append(ack, nni_msg_header(msg),
+	         nni_msg_header_len(msg))) != 0 ||
+	    (rv = nni_msg_append(ack, nni_msg_body(msg), nni_msg_len(msg))) !=
+	        0 ||
+	    (rv = nmq_inproc_msg_split(ack)) != 0) {
+		goto error;
+	}
+	if (pair->pro_ver == MQTT_PROTOCOL_VERSION_v5) {
+		if ((rv = nni_mqttv5_msg_decode(ack)) != 0) {
+			ep->reason_code = rv;
+			goto error;
+		}
+		property_free(ep->property);
+		ep->property = NULL;
+		property_dup(
+		    &ep->property, nni_mqtt_msg_get_connack_property(ack));
+	} else {
+		if ((rv = nni_mqtt_msg_decode(ack)) != MQTT_SUCCESS) {
+			ep->reason_code = rv;
+			goto error;
+		}
+		ep->property = NULL;
+	}
+	ep->reason_code = nni_mqtt_msg_get_connack_return_code(ack);
+
+	cpipe->connack = ack;
+	cpipe->cparam  = nni_get_conn_param_from_msg(ep->connmsg);
+	nni_msg_set_conn_param(ep->connmsg, cpipe->cparam);
+	nni_aio_set_output(aio, 0, cpipe);
+	nni_aio_finish(aio, 0, 0);
+	return;
+
+error:
+	if (ack != NULL) {
+		nni_msg_free(ack);
+	}
+	nmq_inproc_queue_close(&pair->queues[0]);
+	nmq_inproc_queue_close(&pair->queues[1]);
+	pair->cpipe = NULL;
+	nmq_inproc_pipe_fini(cpipe);
+	nni_aio_finish_error(aio, NNG_EPROTO);
+}
+
+static void
+nmq_inproc_broker_send(nmq_inproc_pipe *p, nni_aio *aio)
+{
+	nmq_inproc_pair  *pair  = p->pair;
+	nmq_inproc_queue *queue = p->send_queue;
+	nni_msg          *msg   = nni_aio_get_msg(aio);
+	uint8_t           cmd   = nni_msg_cmd_type(msg);
+	uint8_t           flag  = 0;
+	size_t            n;
+
+	nni_aio_set_msg(aio, NULL);
+	if (cmd == CMD_CONNACK) {
+		if (nni_msg_len(msg) > 1) {
+			flag = ((uint8_t *) nni_msg_body(msg))[1];
+		}
+		nni_mtx_lock(&nmq_inproc.mx);
+		if (pair->cep != NULL) {
+			nmq_inproc_connack(pair, msg);
+			nni_mtx_unlock(&nmq_inproc.mx);
+			nni_msg_free(msg);
+			if (flag != 0x00) {
+				nni_aio_finish_error(aio, flag);
+			} else {
+				nni_aio_finish(aio, 0, 0);
+			}
+			return;
+		}
+		nni_mtx_unlock(&nmq_inproc.mx);
+		nni_msg_free(msg);
+		nni_aio_finish_error(aio, NNG_ECLOSED);
+		return;
+	}
+	if (nni_msg_header_len(msg) != 0 &&
+	    nni_msg_get_type(msg) == CMD_PUBLISH) {
+		nmq_inproc_send_publish(p, msg, aio);
+		return;
+	}
+
+	if ((msg = nni_msg_unique(msg)) == NULL ||
+	    nmq_inproc_msg_split(msg) != 0) {
+		nni_msg_free(msg);
+		nni_aio_finish_error(aio, NNG_ENOMEM);
+		return;
+	}
+	nni_msg_set_proto_data(msg, NULL, NULL);
+	n = nni_msg_len(msg);
+	nni_mtx_lock(&queue->lock);
+	nmq_inproc_queue_push(queue, msg);
+	nmq_inproc_queue_run(queue);
+	if (cmd == CMD_DISCONNECT) {
+		nni_aio_finish_error(aio, NNG_ECLOSED);
+	} else {
+		nmq_inproc_queue_wait(queue, aio, n);
+	}
+	nni_mtx_unlock(&queue->lock);
+}
+
+// The client end sends a msg as the broker would read it off the wire.
+static void
+nmq_inproc_client_send(nmq_inproc_pipe *p, nni_aio *aio)
+{
+	nmq_inproc_pair  *pair  = p->pair;
+	nmq_inproc_queue *queue = p->send_queue;
+	nni_msg          *msg   = nni_aio_get_msg(aio);
+	nni_msg          *ack;
+	uint8_t           type;
+	uint8_t           pos = 1;
+	size_t            n;
+
+	nni_aio_set_msg(aio, NULL);
+	if ((msg = nni_msg_unique(msg)) == NULL) {
+		nni_aio_finish_error(aio, NNG_ENOMEM);
+		return;
+	}
+	// the broker knows nothing of the encoding of the client
+	nni_msg_set_proto_data(msg, NULL, NULL);
+	if (nni_msg_header_len(msg) < 2) {
+		nni_msg_free(msg);
+		nni_aio_finish_error(aio, NNG_EPROTO);
+		return;
+	}
+	type = *(uint8_t *) nni_msg_header(msg) & 0xf0;
+	nni_msg_set_remaining_len(
+	    msg, get_var_integer(nni_msg_header(msg), &pos));
+	nni_msg_set_conn_param(msg, pair->cparam);
+	nni_msg_set_cmd_type(msg, type);
+	if (type == CMD_PUBLISH) {
+		nni_msg_set_timestamp(msg, nng_clock());
+	}
+	ack = nmq_inproc_ack(msg, pair->pro_ver);
+	n   = nni_msg_len(msg);
+
+	nni_mtx_lock(&queue->lock);
+	nmq_inproc_queue_push(queue, msg);
+	nmq_inproc_queue_run(queue);
+	nmq_inproc_queue_wait(queue, aio, n);
+	nni_mtx_unlock(&queue->lock);
+
+	if (ack != NULL) {
+		queue = p->recv_queue;
+		nni_mtx_lock(&queue->lock);
+		nmq_inproc_queue_push(queue, ack);
+		nmq_inproc_queue_run(queue);
+		nni_mtx_unlock(&queue->lock);
+	}
+}
+
+static void
+nmq_inproc_pipe_send(void *arg, nni_aio *aio)
+{
+	nmq_inproc_pipe *p = arg;
+
+	if (nni_aio_begin(aio) != 0) {
+		// No way to give the message back to the protocol, so
+		// we just discard it silently to prevent it from leaking.
+		nni_msg_free(nni_aio_get_msg(aio));
+		nni_aio_set_msg(aio, NULL);
+		return;
+	}
+	if (p->broker) {
+		nmq_inproc_broker_send(p, aio);
+	} else {
+		nmq_inproc_client_send(p, aio);
+	}
+}
+
+static void
+nmq_inproc_pipe_recv(void *arg, nni_aio *aio)
+{
+	nmq_inproc_pipe  *p     = arg;
+	nmq_inproc_queue *queue = p->recv_queue;
+	nni_msg          *msg;
+	int               rv;
+
+	if (nni_aio_begin(aio) != 0) {
+		return;
+	}
+
+	nni_mtx_lock(&queue->lock);
+	if ((msg = p->connack) != NULL) {
+		p->connack = NULL;
+		nni_msg_set_conn_param(msg, p->cparam);
+		nni_aio_set_msg(aio, msg);
+		nni_mtx_unlock(&queue->lock);
+		nni_aio_finish(aio, 0, 0);
+		return;
+	}
+	if ((rv = nni_aio_schedule(aio, nmq_inproc_queue_cancel, queue)) != 0) {
+		nni_mtx_unlock(&queue->lock);
+		nni_aio_finish_error(aio, rv);
+		return;
+	}
+	nni_aio_list_append(&queue->readers, aio);
+	nmq_inproc_queue_run(queue);
+	nni_mtx_unlock(&queue->lock);
+}
+
+static void
+nmq_inproc_pipe_close(void *arg)
+{
+	nmq_inproc_pipe *p    = arg;
+	nmq_inproc_pair *pair = p->pair;
+	nmq_inproc_ep   *ep;
+	nmq_inproc_pipe *cpipe;
+	nni_aio         *aio;
+
+	nni_mtx_lock(&nmq_inproc.mx);
+	if ((ep = pair->cep) != NULL) {
+		// closed by the broker before the CONNACK
+		pair->cep   = NULL;
+		ep->nego    = NULL;
+		aio         = ep->useraio;
+		ep->useraio = NULL;
+		cpipe       = pair->cpipe;
+		pair->cpipe = NULL;
+		nmq_inproc_pipe_fini(cpipe);
+		nni_aio_finish_error(aio, NNG_ECONNREFUSED);
+	}
+	nni_mtx_unlock(&nmq_inproc.mx);
+
+	for (int i = 0; i < 2; i++) {
+		nmq_inproc_queue_close(&pair->queues[i]);
+	}
+}
+
+static uint16_t
+nmq_inproc_pipe_peer(void *arg)
+{
+	NNI_ARG_UNUSED(arg);
+	return (0);
+}
+
+static int
+nmq_inproc_pipe_get_addr(void *arg, void *buf, size_t *szp, nni_opt_type t)
+{
+	nmq_inproc_pipe *p = arg;
+	nni_sockaddr     sa;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.s_inproc.sa_family = NNG_AF_INPROC;
+	nni_strlcpy(sa.s_inproc.sa_name, p->addr, sizeof(sa.s_inproc.sa_name));
+	return (nni_copyout_sockaddr(&sa, buf, szp, t));
+}
+
+// Msgs are queued one by one; there are no writes to batch.
+static int
+nmq_inproc_pipe_get_send_batch(
+    void *arg, void *v, size_t *szp, nni_opt_type t)
+{
+	NNI_ARG_UNUSED(arg);
+	return (nni_copyout_bool(false, v, szp, t));
+}
+
+static const nni_option nmq_inproc_pipe_options[] = {
+	{
+	    .o_name = NNG_OPT_LOCADDR,
+	    .o_get  = nmq_inproc_pipe_get_addr,
+	},
+	{
+	    .o_name = NNG_OPT_REMADDR,
+	    .o_get  = nmq_inproc_pipe_get_addr,
+	},
+	{
+	    .o_name = NNG_OPT_MQTT_SEND_BATCH,
+	    .o_get  = nmq_inproc_pipe_get_send_batch,
+	},
+	// terminate list
+	{
+	    .o_name = NULL,
+	},
+};
+
+static int
+nmq_inproc_pipe_getopt(
+    void *arg, const char *name, void *v, size_t *szp, nni_type t)
+{
+	return (nni_getopt(nmq_inproc_pipe_options, name, arg, v, szp, t));
+}
+
+static int
+nmq_inproc_pipe_alloc(
+    nmq_inproc_pipe **pipep, nmq_inproc_pair *pair, const char *addr)
+{
+	nmq_inproc_pipe *p;
+
+	if ((p = NNI_ALLOC_STRUCT(p)) == NULL) {
+		return (NNG_ENOMEM);
+	}
+	NNI_LIST_NODE_INIT(&p->node);
+	p->addr = addr;
+	p->pair = pair;
+	*pipep  = p;
+	return (0);
+}
+
+// Connect a pair of pipes for a CONNECT the broker accepted to read.
+static int
+nmq_inproc_pair_alloc(nmq_inproc_pair **pairp, nmq_inproc_ep *ep,
+    nmq_inproc_ep *server, conn_param *cparam)
+{
+	nmq_inproc_pair *pair;
+	int              rv;
+
+	if ((pair = NNI_ALLOC_STRUCT(pair)) == NULL) {
+		return (NNG_ENOMEM);
+	}
+	for (int i = 0; i < 2; i++) {
+		nni_aio_list_init(&pair->queues[i].readers);
+		nni_aio_list_init(&pair->queues[i].writers);
+		nni_mtx_init(&pair->queues[i].lock);
+		nni_lmq_init(&pair->queues[i].msgs, NMQ_INPROC_QUEUE_LEN);
+		pair->queues[i].pair = pair;
+	}
+	pair->queues[1].client = true;
+	nni_atomic_init(&pair->ref);
+	nni_atomic_set(&pair->ref, 2);
+	pair->cparam  = cparam;
+	pair->pro_ver = cparam->pro_ver;
+
+	if (((rv = nmq_inproc_pipe_alloc(&pair->cpipe, pair, ep->addr)) != 0) ||
+	    ((rv = nmq_inproc_pipe_alloc(&pair->spipe, pair, server->addr)) !=
+	        0)) {
+		if (pair->cpipe != NULL) {
+			NNI_FREE_STRUCT(pair->cpipe);
+		}
+		pair->cparam = NULL;
+		nmq_inproc_pair_destroy(pair);
+		return (rv);
+	}
+	pair->cpipe->send_queue = &pair->queues[0];
+	pair->cpipe->recv_queue = &pair->queues[1];
+	pair->spipe->send_queue = &pair->queues[1];
+	pair->spipe->recv_queue = &pair->queues[0];
+	pair->spipe->broker     = true;
+	pair->cep               = ep;
+	*pairp                  = pair;
+	return (0);
+}
+
+static void
+nmq_inproc_ep_match(nmq_inproc_ep *ep)
+{
+	nni_aio         *aio;
+	nmq_inproc_pipe *p;
+
+	if (((aio = ep->useraio) == NULL) ||
+	    ((p = nni_list_first(&ep->waitpipes)) == NULL)) {
+		return;
+	}
+	nni_list_remove(&ep->waitpipes, p);
+	ep->useraio = NULL;
+	p->conf     = ep->conf;
+	nni_aio_set_output(aio, 0, p);
+	nni_aio_finish(aio, 0, 0);
+}
+
+// Give up on the CONNECT of a dialer. The broker never saw the pipe if
+// it is still waiting to be accepted.
+static void
+nmq_inproc_nego_abort(nmq_inproc_ep *ep)
+{
+	nmq_inproc_pair *pair = ep->nego;
+	nmq_inproc_pipe *cpipe;
+	nmq_inproc_pipe *spipe;
+
+	ep->nego = NULL;
+	if (pair == NULL) {
+		return;
+	}
+	pair->cep   = NULL;
+	cpipe       = pair->cpipe;
+	spipe       = pair->spipe;
+	pair->cpipe = NULL;
+	nmq_inproc_queue_close(&pair->queues[0]);
+	nmq_inproc_queue_close(&pair->queues[1]);
+	if (nni_list_node_active(&spipe->node)) {
+		nni_list_node_remove(&spipe->node);
+		// the clone for the protocol is never taken either
+		conn_param_free(pair->cparam);
+		nmq_inproc_pipe_fini(spipe);
+	}
+	nmq_inproc_pipe_fini(cpipe);
+}
+
+static void
+nmq_inproc_ep_cancel(nni_aio *aio, void *arg, int rv)
+{
+	nmq_inproc_ep *ep = arg;
+
+	nni_mtx_lock(&nmq_inproc.mx);
+	if (ep->useraio == aio) {
+		ep->useraio = NULL;
+		if (!ep->listener) {
+			nmq_inproc_nego_abort(ep);
+		}
+		nni_aio_finish_error(aio, rv);
+	}
+	nni_mtx_unlock(&nmq_inproc.mx);
+}
+
+// Encode the CONNECT as the client would send it and let the broker
+// parse it, so both ends agree on what was asked for.
+static int
+nmq_inproc_connect_param(nmq_inproc_ep *ep, conn_param **cparamp)
+{
+	nni_msg    *connmsg = ep->connmsg;
+	conn_param *cparam;
+	uint8_t    *buf;
+	size_t      hlen, len;
+	uint8_t     ver;
+	int         rv;
+
+	if (connmsg == NULL) {
+		return (NNG_EINVAL);
+	}
+	ver = nni_mqtt_msg_get_connect_proto_version(connmsg);
+	if (ver == MQTT_PROTOCOL_VERSION_v311) {
+		rv = nni_mqtt_msg_encode(connmsg);
+	} else if (ver == MQTT_PROTOCOL_VERSION_v5) {
+		rv = nni_mqttv5_msg_encode(connmsg);
+	} else {
+		rv = MQTT_ERR_PROTOCOL;
+	}
+	if (rv != MQTT_SUCCESS) {
+		log_warn("Cancelled a illegal connnect msg from user.");
+		return (NNG_EINVAL);
+	}
+	hlen = nni_msg_header_len(connmsg);
+	len  = hlen + nni_msg_len(connmsg);
+	if ((buf = nni_alloc(len)) == NULL) {
+		return (NNG_ENOMEM);
+	}
+	memcpy(buf, nni_msg_header(connmsg), hlen);
+	memcpy(buf + hlen, nni_msg_body(connmsg), len - hlen);
+	if (conn_param_alloc(&cparam) != 0) {
+		nni_free(buf, len);
+		return (NNG_ENOMEM);
+	}
+	rv = conn_handler(buf, cparam, len);
+	nni_free(buf, len);
+	if (rv != 0) {
+		log_info("Disconnect Client due to %d parse CONNECT failed", rv);
+		conn_param_free(cparam);
+		return (NNG_EPROTO);
+	}
+	// connection packet handled successfully. clone it for protocol
+	conn_param_clone(cparam);
+	*cparamp = cparam;
+	return (0);
+}
+
+static void
+nmq_inproc_ep_connect(void *arg, nni_aio *aio)
+{
+	nmq_inproc_ep   *ep = arg;
+	nmq_inproc_ep   *server;
+	nmq_inproc_pair *pair;
+	conn_param      *cparam;
+	int              rv;
+
+	if (nni_aio_begin(aio) != 0) {
+		return;
+	}
+
+	nni_mtx_lock(&nmq_inproc.mx);
+	if (ep->closed) {
+		nni_mtx_unlock(&nmq_inproc.mx);
+		nni_aio_finish_error(aio, NNG_ECLOSED);
+		return;
+	}
+	if (ep->useraio != NULL) {
+		nni_mtx_unlock(&nmq_inproc.mx);
+		nni_aio_finish_error(aio, NNG_EBUSY);
+		return;
+	}
+	NNI_LIST_FOREACH (&nmq_inproc.servers, server) {
+		if (strcmp(server->addr, ep->addr) == 0) {
+			break;
+		}
+	}
+	if (server == NULL) {
+		nni_mtx_unlock(&nmq_inproc.mx);
+		nni_aio_finish_error(aio, NNG_ECONNREFUSED);
+		return;
+	}
+	if ((rv = nmq_inproc_connect_param(ep, &cparam)) != 0) {
+		nni_mtx_unlock(&nmq_inproc.mx);
+		nni_aio_finish_error(aio, rv);
+		return;
+	}
+	if (cparam->max_packet_size == 0) {
+		// set default max packet size for client
+		cparam->max_packet_size = server->conf == NULL
+		    ? NANO_MAX_RECV_PACKET_SIZE
+		    : server->conf->client_max_packet_size;
+		if (cparam->properties != NULL) {
+			property_remove(cparam->properties, MAXIMUM_PACKET_SIZE);
+			property_append(cparam->properties,
+			    property_set_value_u32(
+			        MAXIMUM_PACKET_SIZE, cparam->max_packet_size));
+		}
+	}
+	if ((rv = nmq_inproc_pair_alloc(&pair, ep, server, cparam)) != 0) {
+		conn_param_free(cparam);
+		conn_param_free(cparam);
+		nni_mtx_unlock(&nmq_inproc.mx);
+		nni_aio_finish_error(aio, rv);
+		return;
+	}
+	if ((rv = nni_aio_schedule(aio, nmq_inproc_ep_cancel, ep)) != 0) {
+		ep->nego = pair;
+		nmq_inproc_nego_abort(ep);
+		nni_mtx_unlock(&nmq_inproc.mx);
+		nni_aio_finish_error(aio, rv);
+		return;
+	}
+	// The dial completes once the broker sends the CONNACK.
+	ep->useraio = aio;
+	ep->nego    = pair;
+	nni_list_append(&server->waitpipes, pair->spipe);
+	nmq_inproc_ep_match(server);
+	nni_mtx_unlock(&nmq_inproc.mx);
+}
+
+static int
+nmq_inproc_ep_bind(void *arg)
+{
+	nmq_inproc_ep *ep = arg;
+	nmq_inproc_ep *srch;
+	nni_list      *list = &nmq_inproc.servers;
+
+	nni_mtx_lock(&nmq_inproc.mx);
+	NNI_LIST_FOREACH (list, srch) {
+		if (strcmp(srch->addr, ep->addr) == 0) {
+			nni_mtx_unlock(&nmq_inproc.mx);
+			return (NNG_EADDRINUSE);
+		}
+	}
+	nni_list_append(list, ep);
+	nni_mtx_unlock(&nmq_inproc.mx);
+	return (0);
+}
+
+static void
+nmq_inproc_ep_accept(void *arg, nni_aio *aio)
+{
+	nmq_inproc_ep *ep = arg;
+	int            rv;
+
+	if (nni_aio_begin(aio) != 0) {
+		return;
+	}
+	nni_mtx_lock(&nmq_inproc.mx);
+	if (ep->closed) {
+		nni_mtx_unlock(&nmq_inproc.mx);
+		nni_aio_finish_error(aio, NNG_ECLOSED);
+		return;
+	}
+	if (ep->useraio != NULL) {
+		nni_mtx_unlock(&nmq_inproc.mx);
+		nni_aio_finish_error(aio, NNG_EBUSY);
+		return;
+	}
+	if ((rv = nni_aio_schedule(aio, nmq_inproc_ep_cancel, ep)) != 0) {
+		nni_mtx_unlock(&nmq_inproc.mx);
+		nni_aio_finish_error(aio, rv);
+		return;
+	}
+	ep->useraio = aio;
+	nmq_inproc_ep_match(ep);
+	nni_mtx_unlock(&nmq_inproc.mx);
+}
+
+static void
+nmq_inproc_ep_close(void *arg)
+{
+	nmq_inproc_ep   *ep = arg;
+	nmq_inproc_pipe *p;
+
+	nni_mtx_lock(&nmq_inproc.mx);
+	ep->closed = true;
+	if (nni_list_active(&nmq_inproc.servers, ep)) {
+		nni_list_remove(&nmq_inproc.servers, ep);
+	}
+	// Refuse the dialers still waiting on us.
+	while ((p = nni_list_first(&ep->waitpipes)) != NULL) {
+		nmq_inproc_ep *cep = p->pair->cep;
+		nni_aio       *aio = cep->useraio;
+		cep->useraio       = NULL;
+		nmq_inproc_nego_abort(cep);
+		nni_aio_finish_error(aio, NNG_ECONNREFUSED);
+	}
+	if (ep->useraio != NULL) {
+		if (!ep->listener) {
+			nmq_inproc_nego_abort(ep);
+		}
+		nni_aio_finish_error(ep->useraio, NNG_ECLOSED);
+		ep->useraio = NULL;
+	}
+	nni_mtx_unlock(&nmq_inproc.mx);
+}
+
+static int
+nmq_inproc_ep_init(nmq_inproc_ep **epp, nni_url *url, bool listener)
+{
+	nmq_inproc_ep *ep;
+
+	if ((ep = NNI_ALLOC_STRUCT(ep)) == NULL) {
+		return (NNG_ENOMEM);
+	}
+	NNI_LIST_INIT(&ep->waitpipes, nmq_inproc_pipe, node);
+	ep->listener    = listener;
+	ep->addr        = nmq_inproc_url_name(url);
+	ep->reason_code = 0;
+	*epp            = ep;
+	return (0);
+}
+
+static int
+nmq_inproc_dialer_init(void **dp, nni_url *url, nni_dialer *ndialer)
+{
+	NNI_ARG_UNUSED(ndialer);
+	return (nmq_inproc_ep_init((nmq_inproc_ep **) dp, url, false));
+}
+
+static int
+nmq_inproc_listener_init(void **lp, nni_url *url, nni_listener *nlistener)
+{
+	NNI_ARG_UNUSED(nlistener);
+	return (nmq_inproc_ep_init((nmq_inproc_ep **) lp, url, true));
+}
+
+static void
+nmq_inproc_ep_fini(void *arg)
+{
+	nmq_inproc_ep *ep = arg;
+
+	// Free connmsg once
+	if (ep->connmsg != NULL) {
+		nni_msg_free(ep->connmsg);
+	}
+	property_free(ep->property);
+	NNI_FREE_STRUCT(ep);
+}
+
+static int
+nmq_inproc_ep_get_addr(void *arg, void *v, size_t *szp, nni_opt_type t)
+{
+	nmq_inproc_ep *ep = arg;
+	nng_sockaddr   sa;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.s_inproc.sa_family = NNG_AF_INPROC;
+	nni_strlcpy(
+	    sa.s_inproc.sa_name, ep->addr, sizeof(sa.s_inproc.sa_name));
+	return (nni_copyout_sockaddr(&sa, v, szp, t));
+}
+
+static int
+nmq_inproc_ep_set_conf(void *arg, const void *v, size_t sz, nni_opt_type t)
+{
+	nmq_inproc_ep *ep = arg;
+	NNI_ARG_UNUSED(sz);
+	NNI_ARG_UNUSED(t);
+
+	nni_mtx_lock(&nmq_inproc.mx);
+	ep->conf = (conf *) v;
+	nni_mtx_unlock(&nmq_inproc.mx);
+	return (0);
+}
+
+static int
+nmq_inproc_ep_get_reasoncode(void *arg, void *v, size_t *sz, nni_opt_type t)
+{
+	NNI_ARG_UNUSED(sz);
+	nmq_inproc_ep *ep = arg;
+	int            rv;
+
+	nni_mtx_lock(&nmq_inproc.mx);
+	rv = nni_copyin_int(
+	    v, &ep->reason_code, sizeof(ep->reason_code), 0, 256, t);
+	nni_mtx_unlock(&nmq_inproc.mx);
+	return (rv);
+}
+
+static int
+nmq_inproc_ep_get_property(void *arg, void *v, size_t *szp, nni_opt_type t)
+{
+	nmq_inproc_ep *ep = arg;
+	int            rv;
+
+	nni_mtx_lock(&nmq_inproc.mx);
+	rv = nni_copyout_ptr(ep->property, v, szp, t);
+	nni_mtx_unlock(&nmq_inproc.mx);
+	return (rv);
+}
+
+static int
+nmq_inproc_ep_get_connmsg(void *arg, void *v, size_t *szp, nni_opt_type t)
+{
+	nmq_inproc_ep *ep = arg;
+	int            rv;
+
+	nni_mtx_lock(&nmq_inproc.mx);
+	rv = nni_copyout_ptr(ep->connmsg, v, szp, t);
+	nni_mtx_unlock(&nmq_inproc.mx);
+	return (rv);
+}
+
+static int
+nmq_inproc_ep_set_connmsg(void *arg, const void *v, size_t sz, nni_opt_type t)
+{
+	nmq_inproc_ep *ep = arg;
+	int            rv;
+
+	nni_mtx_lock(&nmq_inproc.mx);
+	rv = nni_copyin_ptr((void **) &ep->connmsg, v, sz, t);
+	nni_mtx_unlock(&nmq_inproc.mx);
+	return (rv);
+}
+
+// There is no network to back off from, but the client sets it anyway.
+static int
+nmq_inproc_ep_set_reconnect_backoff(
+    void *arg, const void *v, size_t sz, nni_opt_type t)
+{
+	nni_duration tmp;
+
+	NNI_ARG_UNUSED(arg);
+	return (nni_copyin_ms(&tmp, v, sz, t));
+}
+
+static nni_sp_pipe_ops nmq_inproc_pipe_ops = {
+	.p_init   = nmq_inproc_pipe_init,
+	.p_fini   = nmq_inproc_pipe_fini,
+	.p_send   = nmq_inproc_pipe_send,
+	.p_recv   = nmq_inproc_pipe_recv,
+	.p_close  = nmq_inproc_pipe_close,
+	.p_peer   = nmq_inproc_pipe_peer,
+	.p_getopt = nmq_inproc_pipe_getopt,
+};
+
+static const nni_option nmq_inproc_dialer_options[] = {
+	{
+	    .o_name = NNG_OPT_MQTT_CONNECT_REASON,
+	    .o_get  = nmq_inproc_ep_get_reasoncode,
+	},
+	{
+	    .o_name = NNG_OPT_MQTT_CONNECT_PROPERTY,
+	    .o_get  = nmq_inproc_ep_get_property,
+	},
+	{
+	    .o_name = NNG_OPT_MQTT_CONNMSG,
+	    .o_get  = nmq_inproc_ep_get_connmsg,
+	    .o_set  = nmq_inproc_ep_set_connmsg,
+	},
+	{
+	    .o_name = NNG_OPT_MQTT_RECONNECT_BACKOFF_MAX,
+	    .o_set  = nmq_inproc_ep_set_reconnect_backoff,
+	},
+	{
+	    .o_name = NNG_OPT_LOCADDR,
+	    .o_get  = nmq_inproc_ep_get_addr,
+	},
+	{
+	    .o_name = NNG_OPT_REMADDR,
+	    .o_get  = nmq_inproc_ep_get_addr,
+	},
+	// terminate list
+	{
+	    .o_name = NULL,
+	},
+};
+
+static const nni_option nmq_inproc_listener_options[] = {
+	{
+	    .o_name = NANO_CONF,
+	    .o_set  = nmq_inproc_ep_set_conf,
+	},
+	{
+	    .o_name = NNG_OPT_LOCADDR,
+	    .o_get  = nmq_inproc_ep_get_addr,
+	},
+	// terminate list
+	{
+	    .o_name = NULL,
+	},
+};
+
+static int
+nmq_inproc_dialer_getopt(
+    void *arg, const char *name, void *v, size_t *szp, nni_type t)
+{
+	return (nni_getopt(nmq_inproc_dialer_options, name, arg, v, szp, t));
+}
+
+static int
+nmq_inproc_dialer_setopt(
+    void *arg, const char *name, const void *v, size_t sz, nni_type t)
+{
+	return (nni_setopt(nmq_inproc_dialer_options, name, arg, v, sz, t));
+}
+
+static int
+nmq_inproc_listener_getopt(
+    void *arg, const char *name, void *v, size_t *szp, nni_type t)
+{
+	return (nni_getopt(nmq_inproc_listener_options, name, arg, v, szp, t));
+}
+
+static int
+nmq_inproc_listener_setopt(
+    void *arg, const char *name, const void *v, size_t sz, nni_type t)
+{
+	return (nni_setopt(nmq_inproc_listener_options, name, arg, v, sz, t));
+}
+
+static nni_sp_dialer_ops nmq_inproc_dialer_ops = {
+	.d_init    = nmq_inproc_dialer_init,
+	.d_fini    = nmq_inproc_ep_fini,
+	.d_connect = nmq_inproc_ep_connect,
+	.d_close   = nmq_inproc_ep_close,
+	.d_getopt  = nmq_inproc_dialer_getopt,
+	.d_setopt  = nmq_inproc_dialer_setopt,
+};
+
+static nni_sp_listener_ops nmq_inproc_listener_ops = {
+	.l_init   = nmq_inproc_listener_init,
+	.l_fini   = nmq_inproc_ep_fini,
+	.l_bind   = nmq_inproc_ep_bind,
+	.l_accept = nmq_inproc_ep_accept,
+	.l_close  = nmq_inproc_ep_close,
+	.l_getopt = nmq_inproc_listener_getopt,
+	.l_setopt = nmq_inproc_listener_setopt,
+};
+
+// The broker end is an SP transport, the client end an MQTT one.
+static nni_sp_tran nmq_inproc_tran = {
+	.tran_scheme   = "nmq-inproc",
+	.tran_listener = &nmq_inproc_listener_ops,
+	.tran_pipe     = &nmq_inproc_pipe_ops,
+	.tran_init     = nmq_inproc_init,
+	.tran_fini     = nmq_inproc_fini,
+};
+
+static nni_sp_tran mqtt_inproc_tran = {
+	.tran_scheme = "mqtt-inproc",
+	.tran_dialer = &nmq_inproc_dialer_ops,
+	.tran_pipe   = &nmq_inproc_pipe_ops,
+	.tran_init   = nmq_inproc_init,
+	.tran_fini   = nmq_inproc_fini,
+};
+
+void
+nni_nmq_broker_inproc_register(void)
+{
+	nni_sp_tran_register(&nmq_inproc_tran);
+}
+
+void
+nni_mqtt_inproc_register(void)
+{
+	nni_mqtt_tran_register(&mqtt_inproc_tran);
+}
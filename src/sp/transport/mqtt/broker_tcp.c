@@ -38,6 +38,9 @@ struct tcptran_pipe {
 	size_t          wantrxhead;
 	bool            closed;
 	bool            busy; // protect the completeness of each msg
+	bool            admitted; // counted as pending until its CONNACK
+	bool            refused;  // to be turned away once CONNECT is in
+	bool            refusing; // busy CONNACK on its way
 	uint8_t         txlen[NANO_MIN_PACKET_LEN];
 	uint8_t         rxlen[NNI_NANO_MAX_HEADER_SIZE];
 	uint8_t         pro_ver;
@@ -61,8 +64,22 @@ struct tcptran_pipe {
 	// MQTT V5
 	uint16_t qrecv_quota;
 	uint32_t qsend_quota;
+	nmq_alias_tbl *alias_out; // outbound topic aliases (MQTT v5)
 };
 
+// A listener may be split into several shards, each an independent
+// socket bound to the same port with SO_REUSEPORT.  The kernel spreads
+// incoming connections over them, so a storm of reconnects is not
+// serialized behind a single accept queue.
+#define TCPTRAN_MAX_SHARDS 64
+
+typedef struct {
+	tcptran_ep          *ep;
+	nng_stream_listener *listener;
+	nni_aio             *connaio;
+	nni_aio             *timeaio;
+} tcptran_shard;
+
 struct tcptran_ep {
 	nni_mtx mtx;
 	size_t               rcvmax;
@@ -74,15 +91,17 @@ struct tcptran_ep {
 	conf                *conf;
 	int                  refcnt; // active pipes
 	nni_aio             *useraio;
-	nni_aio             *connaio;
-	nni_aio             *timeaio;
 	nni_list             busypipes; // busy pipes -- ones passed to socket
 	nni_list             waitpipes; // pipes waiting to match to socket
 	nni_list             negopipes; // pipes busy negotiating
 	nni_reap_node        reap;
-	nng_stream_listener *listener;
+	tcptran_shard        shards[TCPTRAN_MAX_SHARDS];
+	int                  nshards;     // shards allocated
+	int                  shards_want; // NNG_OPT_MQTT_LISTEN_SHARDS
+	nmq_admission        adm;
 #ifdef NNG_ENABLE_STATS
 	nni_stat_item st_rcv_max;
+	nni_stat_item st_refused;
 #endif
 };
 
@@ -126,7 +145,7 @@ tcptran_pipe_close(void *arg)
 {
 	tcptran_pipe *p = arg;
 
-	if (p->npipe->cache) {
+	if (p->npipe != NULL && p->npipe->cache) {
 		nng_stream_close(p->conn);
 		return;
 	}
@@ -194,6 +213,9 @@ tcptran_pipe_fini(void *arg)
 	if ((ep = p->ep) != NULL) {
 		nni_mtx_lock(&ep->mtx);
 		nni_list_node_remove(&p->node);
+		if (p->admitted) {
+			nmq_admission_done(&ep->adm);
+		}
 		ep->refcnt--;
 		if (ep->fini && (ep->refcnt == 0)) {
 			nni_reap(&tcptran_ep_reap_list, ep);
@@ -206,6 +228,7 @@ tcptran_pipe_fini(void *arg)
 		p->tcp_cparam = NULL;
 	}
 
+	nmq_alias_tbl_free(p->alias_out);
 	nng_free(p->qos_buf, 16 + NNI_NANO_MAX_PACKET_SIZE);
 	nng_stream_free(p->conn);
 	nni_aio_free(p->qsaio);
@@ -305,6 +328,10 @@ tcptran_pipe_nego_cb(void *arg)
 	    NANO_CONNECT_PACKET_LEN, p, p->gotrxhead, p->wantrxhead);
 	nni_mtx_lock(&ep->mtx);
 
+	if (p->refusing) {
+		// The busy CONNACK is out, or could not be sent.
+		goto refused;
+	}
 	if ((rv = nni_aio_result(aio)) != 0) {
 		log_warn("nego aio error: %s", nng_strerror(rv));
 		if (p->conn_buf != NULL) {
@@ -372,6 +399,19 @@ tcptran_pipe_nego_cb(void *arg)
 	// We have both sent and received the CONNECT headers.
 	// CONNECT packet serialization
 
+	if (p->gotrxhead >= p->wantrxhead && p->refused) {
+		if (p->conn_buf == NULL ||
+		    (iov.iov_len = nmq_connack_busy(
+		         p->conn_buf, p->wantrxhead, p->txlen)) == 0) {
+			goto refused;
+		}
+		p->refusing = true;
+		iov.iov_buf = p->txlen;
+		nni_aio_set_iov(aio, 1, &iov);
+		nng_stream_send(p->conn, aio);
+		nni_mtx_unlock(&ep->mtx);
+		return;
+	}
 	if (p->gotrxhead >= p->wantrxhead) {
 		if (0 != conn_param_alloc(&p->tcp_cparam)) {
 			rv   = NNG_ENOMEM;
@@ -389,6 +429,8 @@ tcptran_pipe_nego_cb(void *arg)
 			p->pro_ver = p->tcp_cparam->pro_ver;
 			if (p->pro_ver == MQTT_PROTOCOL_VERSION_v5) {
 				p->qsend_quota = p->tcp_cparam->rx_max;
+				p->alias_out   = nmq_alias_tbl_alloc(
+				    p->tcp_cparam->topic_alias_max);
 			}
 			nni_list_remove(&ep->negopipes, p);
 			nni_list_append(&ep->waitpipes, p);
@@ -465,6 +507,31 @@ error:
 	tcptran_pipe_reap(p);
 	log_error("connect nego error rv:(%d)", rv);
 	return;
+
+refused:
+	// Not an error of the listener, the accept loop is not told.
+	if (p->conn_buf != NULL) {
+		nng_free(p->conn_buf, p->wantrxhead);
+		p->conn_buf = NULL;
+	}
+	nng_stream_close(p->conn);
+	nni_mtx_unlock(&ep->mtx);
+	tcptran_pipe_reap(p);
+}
+
+// Once the CONNACK is written the connection no longer waits for
+// admission, whatever the verdict of the broker was.
+static void
+tcptran_pipe_answered(tcptran_pipe *p)
+{
+	tcptran_ep *ep = p->ep;
+
+	nni_mtx_lock(&ep->mtx);
+	if (p->admitted) {
+		p->admitted = false;
+		nmq_admission_done(&ep->adm);
+	}
+	nni_mtx_unlock(&ep->mtx);
 }
 
 static void
@@ -642,6 +709,9 @@ nmq_tcptran_pipe_send_cb(void *arg)
 	// nni_pipe_bump_tx(p->npipe, n);
 	nni_mtx_unlock(&p->mtx);
 
+	if (cmd == CMD_CONNACK) {
+		tcptran_pipe_answered(p);
+	}
 	nni_aio_set_msg(aio, NULL);
 	nni_msg_free(msg);
 	if (cmd == CMD_CONNACK && flag != 0x00) {
@@ -1022,26 +1092,13 @@ nmq_pipe_send_start_v4(tcptran_pipe *p, nni_msg *msg, nni_aio *aio)
 
 	// Recomposing for each msg
 	// never modify the original msg
-	NNI_LIST_FOREACH (subinfol, info) {
+	// Retained msgs go to every subscription, due to topic reflection
+	NMQ_SUBINFO_FOREACH (subinfol, info, topic, topic_len, retain_flag) {
 		if (tinfo != NULL && info != tinfo)
 			continue;
 
 		tinfo = NULL;
 
-		char *sub_topic = info->topic;
-		if (sub_topic[0] == '$') {
-			if (0 ==
-			    strncmp(sub_topic, "$share/", strlen("$share/"))) {
-				sub_topic = strchr(sub_topic, '/');
-				sub_topic++;
-				sub_topic = strchr(sub_topic, '/');
-				sub_topic++;
-			}
-		}
-		// We let retain msg through, due to topic reflection.
-		// And we never modify msg itself
-		if (false == topic_filtern(sub_topic, topic, topic_len) && retain_flag == 0)
-			continue;
 		if (niov > 4) {
 			// donot send too many msgs at a time
 			nni_aio_set_prov_data(txaio, info);
@@ -1246,7 +1303,8 @@ nmq_pipe_send_start_v5(tcptran_pipe *p, nni_msg *msg, nni_aio *aio)
 	target_prover target_prover = 0;
 	int           len_offset = 0, sub_id = 0, qos = 0;
 	uint16_t      pid;
-	uint32_t tprop_bytes, id_bytes = 0, property_len = 0;
+	uint32_t tprop_bytes, prop_extra = 0, property_len = 0;
+	uint16_t alias, new_alias = 0;
 	size_t   tlen, rlen, mlen, hlen, qlength, plength;
 
 	bool is_sqlite = p->conf->sqlite.enable;
@@ -1294,7 +1352,8 @@ nmq_pipe_send_start_v5(tcptran_pipe *p, nni_msg *msg, nni_aio *aio)
 	tinfo = nni_aio_get_prov_data(txaio);
 
 	nni_aio_set_prov_data(txaio, NULL);
-	NNI_LIST_FOREACH (p->npipe->subinfol, info) {
+	NMQ_SUBINFO_FOREACH (p->npipe->subinfol, info,
+	    (char *) (body + 2), tlen, retain_flag == 1) {
 		if (tinfo != NULL && info != tinfo) {
 			continue;
 		}
@@ -1304,151 +1363,162 @@ nmq_pipe_send_start_v5(tcptran_pipe *p, nni_msg *msg, nni_aio *aio)
 		}
 		tinfo           = NULL;
 		len_offset      = 0;
-		char *sub_topic = info->topic;
-		if (sub_topic[0] == '$') {
-			if (0 ==
-			    strncmp(sub_topic, "$share/", strlen("$share/"))) {
-				sub_topic = strchr(sub_topic, '/');
-				sub_topic++;
-				sub_topic = strchr(sub_topic, '/');
-				sub_topic++;
-			}
+		if (niov >= 8) {
+			// nng aio only allow 2 msgs at a time
+			nni_aio_set_prov_data(txaio, info);
+			break;
 		}
-		if (topic_filtern(sub_topic, (char *) (body + 2), tlen) || retain_flag == 1) {
-			if (niov >= 8) {
-				// nng aio only allow 2 msgs at a time
-				nni_aio_set_prov_data(txaio, info);
-				break;
-			}
-			uint8_t  pos = 1, var_extra[2], fixheader, tmp[4] = { 0 };
-			uint8_t  proplen[4] = { 0 }, var_subid[5] = { 0 };
-			sub_id       = info->subid;
-			qos          = info->qos;
-
-			fixheader = *header;
-			if (nni_msg_cmd_type(msg) == CMD_PUBLISH) {
-				// V4 to V5 add 0 property length
-				target_prover = MQTTV4_V5;
-				prop_bytes    = 1;
-				tprop_bytes   = 1;
-				len_offset    = 1;
-			}
-			if (info->rap == 0) {
-				fixheader = fixheader & 0xFE;
-			}
-			if (sub_id != 0) {
-				var_subid[0] = 0x0B;
-				id_bytes =
-				    put_var_integer(var_subid + 1, sub_id);
-				tprop_bytes = put_var_integer(
-				    proplen, property_len + 1 + id_bytes);
-				len_offset +=
-				    (tprop_bytes - prop_bytes + 1 + id_bytes);
+		uint8_t  pos = 1, var_extra[2], fixheader, tmp[4] = { 0 };
+		uint8_t  proplen[4] = { 0 }, var_prop[8] = { 0 };
+		bool     known = false;
+		sub_id       = info->subid;
+		qos          = info->qos;
+
+		fixheader = *header;
+		if (nni_msg_cmd_type(msg) == CMD_PUBLISH) {
+			// V4 to V5 add 0 property length
+			target_prover = MQTTV4_V5;
+			prop_bytes    = 1;
+			tprop_bytes   = 1;
+			len_offset    = 1;
+		}
+		if (info->rap == 0) {
+			fixheader = fixheader & 0xFE;
+		}
+		prop_extra = 0;
+		if (sub_id != 0) {
+			var_prop[0] = 0x0B;
+			prop_extra  = 1 + put_var_integer(var_prop + 1, sub_id);
+		}
+		// replace the topic with an alias the client already knows
+		alias = nmq_alias_assign(
+		    p->alias_out, (char *) (body + 2), tlen, &known);
+		if (alias != 0) {
+			var_prop[prop_extra] = TOPIC_ALIAS;
+			NNI_PUT16(var_prop + prop_extra + 1, alias);
+			prop_extra += 3;
+			if (!known) {
+				new_alias = alias;
 			}
-			// get final qos
-			qos = qos_pac > qos ? qos : qos_pac;
-
-			// alter qos according to sub qos
-			if (qos_pac > qos) {
-				if (qos == 1) {
-					// set qos to 1
-					fixheader = fixheader & 0xF9;
-					fixheader = fixheader | 0x02;
-				} else {
-					// set qos to 0
-					fixheader  = fixheader & 0xF9;
-					len_offset = len_offset - 2;
-				}
+		}
+		if (prop_extra != 0) {
+			tprop_bytes = put_var_integer(
+			    proplen, property_len + prop_extra);
+			len_offset += (tprop_bytes - prop_bytes + prop_extra);
+		}
+		if (known) {
+			len_offset -= tlen;
+		}
+		// get final qos
+		qos = qos_pac > qos ? qos : qos_pac;
+
+		// alter qos according to sub qos
+		if (qos_pac > qos) {
+			if (qos == 1) {
+				// set qos to 1
+				fixheader = fixheader & 0xF9;
+				fixheader = fixheader | 0x02;
+			} else {
+				// set qos to 0
+				fixheader  = fixheader & 0xF9;
+				len_offset = len_offset - 2;
 			}
-			// fixed header + remaining length
-			pos  = 1;
-			rlen = put_var_integer(
-			    tmp, get_var_integer(header, &pos) + len_offset);
-			// or just copy to qosbuf directly?
-			*(p->qos_buf + qlength) = fixheader;
-			memcpy(p->qos_buf + qlength + 1, tmp, rlen);
+		}
+		// fixed header + remaining length
+		pos  = 1;
+		rlen = put_var_integer(
+		    tmp, get_var_integer(header, &pos) + len_offset);
+		// or just copy to qosbuf directly?
+		*(p->qos_buf + qlength) = fixheader;
+		memcpy(p->qos_buf + qlength + 1, tmp, rlen);
+		iov[niov].iov_buf = p->qos_buf + qlength;
+		iov[niov].iov_len = rlen + 1;
+		niov++;
+		qlength += rlen + 1;
+		// 1st part of variable header: topic + topic len
+		if (known) {
+			// zero length topic, resolved by the alias
+			memset(p->qos_buf + qlength, 0, 2);
 			iov[niov].iov_buf = p->qos_buf + qlength;
-			iov[niov].iov_len = rlen + 1;
-			niov++;
-			qlength += rlen + 1;
-			// 1st part of variable header: topic + topic len
+			iov[niov].iov_len = 2;
+			qlength += 2;
+		} else {
 			iov[niov].iov_buf = body;
 			iov[niov].iov_len = tlen + 2;
-			niov++;
-			// len to indicate the offset in packet
-			len_offset = 0;
-			plength    = 0;
-			if (qos > 0) {
-				// set pid
-				len_offset = 2;
-				nni_msg *old;
-				// packetid in aio to differ resend msg
-				pid = (uint16_t) (size_t) nni_aio_get_prov_data(aio);
-				if (pid == 0) {
-					// first time send this msg
-					pid = nni_pipe_inc_packetid(pipe);
-					// store msg for qos retry
-					nni_msg_clone(msg);
-					if ((old = nni_qos_db_get(is_sqlite, pipe->nano_qos_db,
-											  pipe->p_id, pid)) != NULL) {
-						// TODO packetid already
-						// exists. do we need to
-						// replace old with new one ?
-						// print warning to users
-						log_error("packet id duplicates in nano_qos_db");
-						nni_qos_db_remove_msg(
-						    is_sqlite,
-						    pipe->nano_qos_db, old);
-					}
-					old = msg;
-					nni_qos_db_set(is_sqlite,
-					    pipe->nano_qos_db, pipe->p_id, pid,
-					    old);
-					nni_qos_db_remove_oldest(is_sqlite,
-					    pipe->nano_qos_db,
-					    p->conf->sqlite.disk_cache_size);
+		}
+		niov++;
+		// len to indicate the offset in packet
+		len_offset = 0;
+		plength    = 0;
+		if (qos > 0) {
+			// set pid
+			len_offset = 2;
+			nni_msg *old;
+			// packetid in aio to differ resend msg
+			pid = (uint16_t) (size_t) nni_aio_get_prov_data(aio);
+			if (pid == 0) {
+				// first time send this msg
+				pid = nni_pipe_inc_packetid(pipe);
+				// store msg for qos retry
+				nni_msg_clone(msg);
+				if ((old = nni_qos_db_get(is_sqlite, pipe->nano_qos_db,
+										  pipe->p_id, pid)) != NULL) {
+					// TODO packetid already
+					// exists. do we need to
+					// replace old with new one ?
+					// print warning to users
+					log_error("packet id duplicates in nano_qos_db");
+					nni_qos_db_remove_msg(
+					    is_sqlite,
+					    pipe->nano_qos_db, old);
 				}
-				NNI_PUT16(var_extra, pid);
-				// copy packet id
-				memcpy(p->qos_buf + qlength, var_extra, 2);
-				qlength += 2;
-				plength += 2;
-			} else if (qos_pac > 0) {
-				// ignore the packet id of original packet
-				len_offset += 2;
+				old = msg;
+				nni_qos_db_set(is_sqlite,
+				    pipe->nano_qos_db, pipe->p_id, pid,
+				    old);
+				nni_qos_db_remove_oldest(is_sqlite,
+				    pipe->nano_qos_db,
+				    p->conf->sqlite.disk_cache_size);
 			}
-			// prop len + sub id if any
-			if (sub_id != 0) {
+			NNI_PUT16(var_extra, pid);
+			// copy packet id
+			memcpy(p->qos_buf + qlength, var_extra, 2);
+			qlength += 2;
+			plength += 2;
+		} else if (qos_pac > 0) {
+			// ignore the packet id of original packet
+			len_offset += 2;
+		}
+		// prop len + sub id and topic alias if any
+		if (prop_extra != 0) {
+			memcpy(p->qos_buf + qlength, proplen,
+			    tprop_bytes);
+			qlength += tprop_bytes;
+			plength += tprop_bytes;
+			memcpy(p->qos_buf + qlength, var_prop, prop_extra);
+			qlength += prop_extra;
+			plength += prop_extra;
+			if (target_prover == MQTTV5)
+				len_offset += prop_bytes;
+		} else {
+			// need to add 0 len for V4 msg
+			if (target_prover == MQTTV4_V5) {
+				// add proplen even 0
 				memcpy(p->qos_buf + qlength, proplen,
 				    tprop_bytes);
 				qlength += tprop_bytes;
 				plength += tprop_bytes;
-				memcpy(p->qos_buf + qlength, var_subid,
-				    id_bytes + 1);
-				qlength += id_bytes + 1;
-				plength += id_bytes + 1;
-				if (target_prover == MQTTV5)
-					len_offset += prop_bytes;
-			} else {
-				// need to add 0 len for V4 msg
-				if (target_prover == MQTTV4_V5) {
-					// add proplen even 0
-					memcpy(p->qos_buf + qlength, proplen,
-					    tprop_bytes);
-					qlength += tprop_bytes;
-					plength += tprop_bytes;
-				}
 			}
-			// 2nd part of variable header: pid +
-			// proplen+0x0B+subid
-			iov[niov].iov_buf = p->qos_buf + qlength - plength;
-			iov[niov].iov_len = plength;
-			niov++;
-			// prop + body
-			iov[niov].iov_buf = body + 2 + tlen + len_offset;
-			iov[niov].iov_len = mlen - 2 - len_offset - tlen;
-			niov++;
 		}
+		// 2nd part of variable header: pid +
+		// proplen+0x0B+subid
+		iov[niov].iov_buf = p->qos_buf + qlength - plength;
+		iov[niov].iov_len = plength;
+		niov++;
+		// prop + body
+		iov[niov].iov_buf = body + 2 + tlen + len_offset;
+		iov[niov].iov_len = mlen - 2 - len_offset - tlen;
+		niov++;
 	}
 
 	// MQTT V5 flow control
@@ -1460,6 +1530,10 @@ nmq_pipe_send_start_v5(tcptran_pipe *p, nni_msg *msg, nni_aio *aio)
 			// max_recv? msg lost, make it look like a
 			// normal send. qos msg will be resend
 			// afterwards
+			if (new_alias != 0) {
+				// never reached the client
+				nmq_alias_forget(p->alias_out, new_alias);
+			}
 			nni_msg_free(msg);
 			nni_aio_set_prov_data(txaio, NULL);
 			nni_list_remove(&p->sendq, aio);
@@ -1686,11 +1760,15 @@ tcptran_ep_fini(void *arg)
 		return;
 	}
 	nni_mtx_unlock(&ep->mtx);
-	nni_aio_stop(ep->timeaio);
-	nni_aio_stop(ep->connaio);
-	nng_stream_listener_free(ep->listener);
-	nni_aio_free(ep->timeaio);
-	nni_aio_free(ep->connaio);
+	for (int i = 0; i < ep->nshards; i++) {
+		nni_aio_stop(ep->shards[i].timeaio);
+		nni_aio_stop(ep->shards[i].connaio);
+	}
+	for (int i = 0; i < ep->nshards; i++) {
+		nng_stream_listener_free(ep->shards[i].listener);
+		nni_aio_free(ep->shards[i].timeaio);
+		nni_aio_free(ep->shards[i].connaio);
+	}
 
 	nni_mtx_fini(&ep->mtx);
 	NNI_FREE_STRUCT(ep);
@@ -1706,9 +1784,11 @@ tcptran_ep_close(void *arg)
 
 	log_trace("tcptran_ep_close");
 	ep->closed = true;
-	nni_aio_close(ep->timeaio);
-	if (ep->listener != NULL) {
-		nng_stream_listener_close(ep->listener);
+	for (int i = 0; i < ep->nshards; i++) {
+		nni_aio_close(ep->shards[i].timeaio);
+		if (ep->shards[i].listener != NULL) {
+			nng_stream_listener_close(ep->shards[i].listener);
+		}
 	}
 	NNI_LIST_FOREACH (&ep->negopipes, p) {
 		tcptran_pipe_close(p);
@@ -1787,9 +1867,9 @@ tcptran_url_parse_source(nng_url *url, nng_sockaddr *sa, const nng_url *surl)
 static void
 tcptran_timer_cb(void *arg)
 {
-	tcptran_ep *ep = arg;
-	if (nni_aio_result(ep->timeaio) == 0) {
-		nng_stream_listener_accept(ep->listener, ep->connaio);
+	tcptran_shard *sh = arg;
+	if (nni_aio_result(sh->timeaio) == 0) {
+		nng_stream_listener_accept(sh->listener, sh->connaio);
 	}
 }
 
@@ -1797,11 +1877,12 @@ tcptran_timer_cb(void *arg)
 static void
 tcptran_accept_cb(void *arg)
 {
-	tcptran_ep   *ep  = arg;
-	nni_aio      *aio = ep->connaio;
-	tcptran_pipe *p;
-	int           rv;
-	nng_stream   *conn;
+	tcptran_shard *sh  = arg;
+	tcptran_ep    *ep  = sh->ep;
+	nni_aio       *aio = sh->connaio;
+	tcptran_pipe  *p;
+	int            rv;
+	nng_stream    *conn;
 
 	nni_mtx_lock(&ep->mtx);
 
@@ -1822,8 +1903,17 @@ tcptran_accept_cb(void *arg)
 		rv = NNG_ECLOSED;
 		goto error;
 	}
+	// Over the rate or too many waiting for a CONNACK: the CONNECT is
+	// still read, but only to answer it with a busy CONNACK.
+	p->admitted = nmq_admission_take(&ep->adm, nni_clock());
+	if (!p->admitted) {
+		p->refused = true;
+#ifdef NNG_ENABLE_STATS
+		nni_stat_inc(&ep->st_refused, 1);
+#endif
+	}
 	tcptran_pipe_start(p, conn, ep);
-	nng_stream_listener_accept(ep->listener, ep->connaio);
+	nng_stream_listener_accept(sh->listener, sh->connaio);
 	nni_mtx_unlock(&ep->mtx);
 	return;
 
@@ -1838,12 +1928,12 @@ error:
 
 	case NNG_ENOMEM:
 	case NNG_ENOFILES:
-		nng_sleep_aio(10, ep->timeaio);
+		nng_sleep_aio(10, sh->timeaio);
 		break;
 
 	default:
 		if (!ep->closed) {
-			nng_stream_listener_accept(ep->listener, ep->connaio);
+			nng_stream_listener_accept(sh->listener, sh->connaio);
 		}
 		break;
 	}
@@ -1865,7 +1955,8 @@ tcptran_ep_init(tcptran_ep **epp, nng_url *url, nni_sock *sock)
 	NNI_LIST_INIT(&ep->negopipes, tcptran_pipe, node);
 
 	// ep->proto = nni_sock_proto_id(sock);
-	ep->url = url;
+	ep->url         = url;
+	ep->shards_want = 1;
 #ifdef NNG_ENABLE_STATS
 	static const nni_stat_info rcv_max_info = {
 		.si_name   = "rcv_max",
@@ -1875,46 +1966,87 @@ tcptran_ep_init(tcptran_ep **epp, nng_url *url, nni_sock *sock)
 		.si_atomic = true,
 	};
 	nni_stat_init(&ep->st_rcv_max, &rcv_max_info);
+	static const nni_stat_info refused_info = {
+		.si_name   = "refused",
+		.si_desc   = "connections refused by admission control",
+		.si_type   = NNG_STAT_COUNTER,
+		.si_unit   = NNG_UNIT_EVENTS,
+		.si_atomic = true,
+	};
+	nni_stat_init(&ep->st_refused, &refused_info);
 #endif
 
 	*epp = ep;
 	return (0);
 }
 
+// The shard is counted before anything is allocated, so that
+// tcptran_ep_fini can clean up after a partial failure.
 static int
-tcptran_listener_init(void **lp, nng_url *url, nni_listener *nlistener)
+tcptran_shard_alloc(tcptran_ep *ep, const nng_url *url)
+{
+	tcptran_shard *sh = &ep->shards[ep->nshards++];
+	int            rv;
+
+	sh->ep = ep;
+	if (((rv = nni_aio_alloc(&sh->connaio, tcptran_accept_cb, sh)) != 0) ||
+	    ((rv = nni_aio_alloc(&sh->timeaio, tcptran_timer_cb, sh)) != 0) ||
+	    ((rv = nng_stream_listener_alloc_url(&sh->listener, url)) != 0)) {
+		return (rv);
+	}
+	return (0);
+}
+
+static int
+tcptran_listener_alloc(void **lp, nng_url *url, nni_listener *nlistener)
 {
 	tcptran_ep *ep;
 	int         rv;
 	nni_sock   *sock = nni_listener_sock(nlistener);
 
-	// Check for invalid URL components.
-	if ((strlen(url->u_path) != 0) && (strcmp(url->u_path, "/") != 0)) {
-		return (NNG_EADDRINVAL);
-	}
-	if ((url->u_fragment != NULL) || (url->u_userinfo != NULL) ||
-	    (url->u_query != NULL)) {
-		return (NNG_EADDRINVAL);
-	}
-
 	if ((rv = tcptran_ep_init(&ep, url, sock)) != 0) {
 		return (rv);
 	}
 
-	if (((rv = nni_aio_alloc(&ep->connaio, tcptran_accept_cb, ep)) != 0) ||
-	    ((rv = nni_aio_alloc(&ep->timeaio, tcptran_timer_cb, ep)) != 0) ||
-	    ((rv = nng_stream_listener_alloc_url(&ep->listener, url)) != 0)) {
+	if ((rv = tcptran_shard_alloc(ep, url)) != 0) {
 		tcptran_ep_fini(ep);
 		return (rv);
 	}
 
 #ifdef NNG_ENABLE_STATS
 	nni_listener_add_stat(nlistener, &ep->st_rcv_max);
+	nni_listener_add_stat(nlistener, &ep->st_refused);
 #endif
 	*lp = ep;
 	return (0);
 }
 
+static int
+tcptran_listener_init(void **lp, nng_url *url, nni_listener *nlistener)
+{
+	// Check for invalid URL components.
+	if ((strlen(url->u_path) != 0) && (strcmp(url->u_path, "/") != 0)) {
+		return (NNG_EADDRINVAL);
+	}
+	if ((url->u_fragment != NULL) || (url->u_userinfo != NULL) ||
+	    (url->u_query != NULL)) {
+		return (NNG_EADDRINVAL);
+	}
+	return (tcptran_listener_alloc(lp, url, nlistener));
+}
+
+#ifdef NNG_TRANSPORT_MQTT_SHM
+// The path of a shm URL is where its UNIX domain socket is bound.
+static int
+tcptran_shm_listener_init(void **lp, nng_url *url, nni_listener *nlistener)
+{
+	if (strlen(url->u_path) == 0) {
+		return (NNG_EADDRINVAL);
+	}
+	return (tcptran_listener_alloc(lp, url, nlistener));
+}
+#endif
+
 static void
 tcptran_ep_cancel(nni_aio *aio, void *arg, int rv)
 {
@@ -1936,9 +2068,9 @@ tcptran_ep_get_url(void *arg, void *v, size_t *szp, nni_opt_type t)
 	int         rv;
 	int         port = 0;
 
-	if (ep->listener != NULL) {
+	if (ep->shards[0].listener != NULL) {
 		(void) nng_stream_listener_get_int(
-		    ep->listener, NNG_OPT_TCP_BOUND_PORT, &port);
+		    ep->shards[0].listener, NNG_OPT_TCP_BOUND_PORT, &port);
 	}
 
 	if ((rv = nni_url_asprintf_port(&s, ep->url, port)) == 0) {
@@ -2001,13 +2133,207 @@ tcptran_ep_set_recvmaxsz(void *arg, const void *v, size_t sz, nni_opt_type t)
 }
 
 static int
-tcptran_ep_bind(void *arg)
+tcptran_ep_get_admission(
+    uint32_t *field, tcptran_ep *ep, void *v, size_t *szp, nni_opt_type t)
+{
+	int rv;
+
+	nni_mtx_lock(&ep->mtx);
+	rv = nni_copyout_int((int) *field, v, szp, t);
+	nni_mtx_unlock(&ep->mtx);
+	return (rv);
+}
+
+static int
+tcptran_ep_set_admission(uint32_t *field, tcptran_ep *ep, const void *v,
+    size_t sz, nni_opt_type t)
+{
+	int val;
+	int rv;
+
+	if ((rv = nni_copyin_int(&val, v, sz, 0, NNI_MAXINT, t)) == 0) {
+		nni_mtx_lock(&ep->mtx);
+		*field = (uint32_t) val;
+		nni_mtx_unlock(&ep->mtx);
+	}
+	return (rv);
+}
+
+static int
+tcptran_ep_get_connect_rate(void *arg, void *v, size_t *szp, nni_opt_type t)
+{
+	tcptran_ep *ep = arg;
+	return (tcptran_ep_get_admission(&ep->adm.rate, ep, v, szp, t));
+}
+
+static int
+tcptran_ep_set_connect_rate(
+    void *arg, const void *v, size_t sz, nni_opt_type t)
+{
+	tcptran_ep *ep = arg;
+	return (tcptran_ep_set_admission(&ep->adm.rate, ep, v, sz, t));
+}
+
+static int
+tcptran_ep_get_connect_burst(
+    void *arg, void *v, size_t *szp, nni_opt_type t)
+{
+	tcptran_ep *ep = arg;
+	return (tcptran_ep_get_admission(&ep->adm.burst, ep, v, szp, t));
+}
+
+static int
+tcptran_ep_set_connect_burst(
+    void *arg, const void *v, size_t sz, nni_opt_type t)
+{
+	tcptran_ep *ep = arg;
+	return (tcptran_ep_set_admission(&ep->adm.burst, ep, v, sz, t));
+}
+
+static int
+tcptran_ep_get_connect_pending(
+    void *arg, void *v, size_t *szp, nni_opt_type t)
+{
+	tcptran_ep *ep = arg;
+	return (
+	    tcptran_ep_get_admission(&ep->adm.max_pending, ep, v, szp, t));
+}
+
+static int
+tcptran_ep_set_connect_pending(
+    void *arg, const void *v, size_t sz, nni_opt_type t)
+{
+	tcptran_ep *ep = arg;
+	return (
+	    tcptran_ep_set_admission(&ep->adm.max_pending, ep, v, sz, t));
+}
+
+static int
+tcptran_ep_get_shards(void *arg, void *v, size_t *szp, nni_opt_type t)
+{
+	tcptran_ep *ep = arg;
+	int         rv;
+
+	nni_mtx_lock(&ep->mtx);
+	rv = nni_copyout_int(ep->shards_want, v, szp, t);
+	nni_mtx_unlock(&ep->mtx);
+	return (rv);
+}
+
+static int
+tcptran_ep_set_shards(void *arg, const void *v, size_t sz, nni_opt_type t)
 {
 	tcptran_ep *ep = arg;
+	int         val;
 	int         rv;
 
+	if ((rv = nni_copyin_int(&val, v, sz, 1, TCPTRAN_MAX_SHARDS, t)) ==
+	    0) {
+		nni_mtx_lock(&ep->mtx);
+		if (ep->nshards > 1 || ep->started) {
+			rv = NNG_EBUSY;
+		} else {
+			ep->shards_want = val;
+		}
+		nni_mtx_unlock(&ep->mtx);
+	}
+	return (rv);
+}
+
+// Shard i accepts on poller thread i, and keeps its connections there, so
+// the shards are spread over cores rather than sharing one poller.  The
+// poller threads are started as the shards ask for them, up to
+// NNG_INIT_MAX_POLLER_THREADS; more shards than that share them again.
+static int
+tcptran_shard_pin(tcptran_shard *sh, int i)
+{
+	int rv;
+
+	rv = nng_stream_listener_set_int(sh->listener, NNG_OPT_TCP_POLLER, i);
+	return (rv == NNG_ENOTSUP ? 0 : rv);
+}
+
+// The extra shards copy the socket options of the first one, and bind
+// to the port it was given, which matters when the URL asked for an
+// ephemeral port.
+static int
+tcptran_ep_bind_shards(tcptran_ep *ep)
+{
+	nng_stream_listener *l0 = ep->shards[0].listener;
+	nng_url             *url;
+	char                *s;
+	bool                 nodelay;
+	bool                 keepalive;
+	int                  port;
+	int                  rv;
+
+	if (((rv = nng_stream_listener_get_int(
+	          l0, NNG_OPT_TCP_BOUND_PORT, &port)) != 0) ||
+	    ((rv = nng_stream_listener_get_bool(
+	          l0, NNG_OPT_TCP_NODELAY, &nodelay)) != 0) ||
+	    ((rv = nng_stream_listener_get_bool(
+	          l0, NNG_OPT_TCP_KEEPALIVE, &keepalive)) != 0)) {
+		return (rv);
+	}
+	if ((rv = nni_url_asprintf_port(&s, ep->url, port)) != 0) {
+		return (rv);
+	}
+	rv = nng_url_parse(&url, s);
+	nni_strfree(s);
+	if (rv != 0) {
+		return (rv);
+	}
+	while (ep->nshards < ep->shards_want) {
+		tcptran_shard *sh;
+		if ((rv = tcptran_shard_alloc(ep, url)) != 0) {
+			break;
+		}
+		sh = &ep->shards[ep->nshards - 1];
+		if (((rv = nng_stream_listener_set_bool(sh->listener,
+		          NNG_OPT_TCP_NODELAY, nodelay)) != 0) ||
+		    ((rv = nng_stream_listener_set_bool(sh->listener,
+		          NNG_OPT_TCP_KEEPALIVE, keepalive)) != 0) ||
+		    ((rv = nng_stream_listener_set_bool(sh->listener,
+		          NNG_OPT_TCP_REUSEPORT, true)) != 0) ||
+		    ((rv = tcptran_shard_pin(sh, ep->nshards - 1)) != 0) ||
+		    ((rv = nng_stream_listener_listen(sh->listener)) != 0)) {
+			break;
+		}
+	}
+	nng_url_free(url);
+	return (rv);
+}
+
+static int
+tcptran_ep_bind(void *arg)
+{
+	tcptran_ep          *ep = arg;
+	nng_stream_listener *l0 = ep->shards[0].listener;
+	int                  rv;
+
 	nni_mtx_lock(&ep->mtx);
-	rv = nng_stream_listener_listen(ep->listener);
+	if (ep->shards_want > 1) {
+		rv = nng_stream_listener_set_bool(
+		    l0, NNG_OPT_TCP_REUSEPORT, true);
+		if (rv == NNG_ENOTSUP) {
+			// Not TCP, or no SO_REUSEPORT; one socket it is.
+			log_warn("listener shards unsupported, using one");
+			ep->shards_want = 1;
+		} else if ((rv != 0) ||
+		    ((rv = tcptran_shard_pin(&ep->shards[0], 0)) != 0)) {
+			nni_mtx_unlock(&ep->mtx);
+			return (rv);
+		}
+	}
+	if (((rv = nng_stream_listener_listen(l0)) == 0) &&
+	    (ep->shards_want > 1)) {
+		if ((rv = tcptran_ep_bind_shards(ep)) != 0) {
+			for (int i = 0; i < ep->nshards; i++) {
+				nng_stream_listener_close(
+				    ep->shards[i].listener);
+			}
+		}
+	}
 	nni_mtx_unlock(&ep->mtx);
 
 	return (rv);
@@ -2041,7 +2367,10 @@ tcptran_ep_accept(void *arg, nni_aio *aio)
 	ep->useraio = aio;
 	if (!ep->started) {
 		ep->started = true;
-		nng_stream_listener_accept(ep->listener, ep->connaio);
+		for (int i = 0; i < ep->nshards; i++) {
+			nng_stream_listener_accept(
+			    ep->shards[i].listener, ep->shards[i].connaio);
+		}
 	} else {
 		tcptran_ep_match(ep);	// not necessary now.
 	}
@@ -2073,6 +2402,26 @@ static const nni_option tcptran_ep_opts[] = {
 	    .o_name = NANO_CONF,
 	    .o_set  = tcptran_ep_set_conf,
 	},
+	{
+	    .o_name = NNG_OPT_MQTT_LISTEN_SHARDS,
+	    .o_get  = tcptran_ep_get_shards,
+	    .o_set  = tcptran_ep_set_shards,
+	},
+	{
+	    .o_name = NNG_OPT_MQTT_CONNECT_RATE,
+	    .o_get  = tcptran_ep_get_connect_rate,
+	    .o_set  = tcptran_ep_set_connect_rate,
+	},
+	{
+	    .o_name = NNG_OPT_MQTT_CONNECT_BURST,
+	    .o_get  = tcptran_ep_get_connect_burst,
+	    .o_set  = tcptran_ep_set_connect_burst,
+	},
+	{
+	    .o_name = NNG_OPT_MQTT_CONNECT_PENDING,
+	    .o_get  = tcptran_ep_get_connect_pending,
+	    .o_set  = tcptran_ep_set_connect_pending,
+	},
 	// terminate list
 	{
 	    .o_name = NULL,
@@ -2086,7 +2435,7 @@ tcptran_listener_getopt(
 	tcptran_ep *ep = arg;
 	int         rv;
 
-	rv = nni_stream_listener_get(ep->listener, name, buf, szp, t);
+	rv = nni_stream_listener_get(ep->shards[0].listener, name, buf, szp, t);
 	if (rv == NNG_ENOTSUP) {
 		rv = nni_getopt(tcptran_ep_opts, name, ep, buf, szp, t);
 	}
@@ -2100,8 +2449,14 @@ tcptran_listener_setopt(
 	tcptran_ep *ep = arg;
 	int         rv;
 
-	rv = nni_stream_listener_set(ep->listener, name, buf, sz, t);
-	if (rv == NNG_ENOTSUP) {
+	rv = nni_stream_listener_set(ep->shards[0].listener, name, buf, sz, t);
+	if (rv == 0) {
+		// Shards only exist once bound, but keep them in step.
+		for (int i = 1; i < ep->nshards; i++) {
+			(void) nni_stream_listener_set(
+			    ep->shards[i].listener, name, buf, sz, t);
+		}
+	} else if (rv == NNG_ENOTSUP) {
 		rv = nni_setopt(tcptran_ep_opts, name, ep, buf, sz, t);
 	}
 	return (rv);
@@ -2117,6 +2472,27 @@ static nni_sp_listener_ops tcptran_listener_ops = {
 	.l_setopt = tcptran_listener_setopt,
 };
 
+#ifdef NNG_TRANSPORT_MQTT_SHM
+static nni_sp_listener_ops tcptran_shm_listener_ops = {
+	.l_init   = tcptran_shm_listener_init,
+	.l_fini   = tcptran_ep_fini,
+	.l_bind   = tcptran_ep_bind,
+	.l_accept = tcptran_ep_accept,
+	.l_close  = tcptran_ep_close,
+	.l_getopt = tcptran_listener_getopt,
+	.l_setopt = tcptran_listener_setopt,
+};
+
+// MQTT over the shared memory streams, the bytes are the same as on TCP.
+static nni_sp_tran shm_tran_mqtt = {
+	.tran_scheme   = "nmq-shm",
+	.tran_listener = &tcptran_shm_listener_ops,
+	.tran_pipe     = &tcptran_pipe_ops,
+	.tran_init     = tcptran_init,
+	.tran_fini     = tcptran_fini,
+};
+#endif
+
 static nni_sp_tran tcp__tran_mqtt = {
 	.tran_scheme   = "broker+tcp",
 	.tran_listener = &tcptran_listener_ops,
@@ -2182,4 +2558,7 @@ nni_nmq_broker_tcp_register(void)
 	nni_sp_tran_register(&tcp__tran_mqtt);
 	nni_sp_tran_register(&tcp4__tran_mqtt);
 	nni_sp_tran_register(&tcp6__tran_mqtt);
+#ifdef NNG_TRANSPORT_MQTT_SHM
+	nni_sp_tran_register(&shm_tran_mqtt);
+#endif
 }
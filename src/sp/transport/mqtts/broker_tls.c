@@ -39,6 +39,9 @@ struct tlstran_pipe {
 	size_t          wantrxhead;
 	bool            closed;
 	bool            busy; // indicator for qos ack & aio
+	bool            admitted; // counted as pending until its CONNACK
+	bool            refused;  // to be turned away once CONNECT is in
+	bool            refusing; // busy CONNACK on its way
 	uint8_t         txlen[NANO_MIN_PACKET_LEN];
 	uint8_t         rxlen[NNI_NANO_MAX_HEADER_SIZE];
 	uint8_t         pro_ver;
@@ -64,6 +67,7 @@ struct tlstran_pipe {
 	// MQTT V5
 	uint16_t qrecv_quota;
 	uint32_t qsend_quota;
+	nmq_alias_tbl *alias_out; // outbound topic aliases (MQTT v5)
 };
 
 struct tlstran_ep {
@@ -87,8 +91,10 @@ struct tlstran_ep {
 	nni_list             negopipes; // pipes busy negotiating
 	nni_reap_node        reap;
 	nng_stream_listener *listener;
+	nmq_admission        adm;
 #ifdef NNG_ENABLE_STATS
 	nni_stat_item st_rcv_max;
+	nni_stat_item st_refused;
 #endif
 };
 
@@ -131,7 +137,7 @@ tlstran_pipe_close(void *arg)
 {
 	tlstran_pipe *p = arg;
 
-	if (p->npipe->cache) {
+	if (p->npipe != NULL && p->npipe->cache) {
 		nng_stream_close(p->conn);
 		return;
 	}
@@ -199,6 +205,9 @@ tlstran_pipe_fini(void *arg)
 	if ((ep = p->ep) != NULL) {
 		nni_mtx_lock(&ep->mtx);
 		nni_list_node_remove(&p->node);
+		if (p->admitted) {
+			nmq_admission_done(&ep->adm);
+		}
 		ep->refcnt--;
 		if (ep->fini && (ep->refcnt == 0)) {
 			nni_reap(&tlstran_ep_reap_list, ep);
@@ -211,6 +220,7 @@ tlstran_pipe_fini(void *arg)
     		p->tcp_cparam = NULL;
   	}
 
+	nmq_alias_tbl_free(p->alias_out);
 	nng_free(p->qos_buf, 16 + NNI_NANO_MAX_PACKET_SIZE);
 	nng_stream_free(p->conn);
 	nni_aio_free(p->qsaio);
@@ -307,6 +317,10 @@ tlstran_pipe_nego_cb(void *arg)
 	    NANO_CONNECT_PACKET_LEN, p, p->gotrxhead, p->wantrxhead);
 	nni_mtx_lock(&ep->mtx);
 
+	if (p->refusing) {
+		// The busy CONNACK is out, or could not be sent.
+		goto refused;
+	}
 	if ((rv = nni_aio_result(aio)) != 0) {
 		log_warn("nego aio error: %s", nng_strerror(rv));
 		if (p->conn_buf != NULL) {
@@ -374,6 +388,19 @@ tlstran_pipe_nego_cb(void *arg)
 	// We have both sent and received the CONNECT headers.
 	// CONNECT packet serialization
 
+	if (p->gotrxhead >= p->wantrxhead && p->refused) {
+		if (p->conn_buf == NULL ||
+		    (iov.iov_len = nmq_connack_busy(
+		         p->conn_buf, p->wantrxhead, p->txlen)) == 0) {
+			goto refused;
+		}
+		p->refusing = true;
+		iov.iov_buf = p->txlen;
+		nni_aio_set_iov(aio, 1, &iov);
+		nng_stream_send(p->conn, aio);
+		nni_mtx_unlock(&ep->mtx);
+		return;
+	}
 	if (p->gotrxhead >= p->wantrxhead) {
 		if (0 != conn_param_alloc(&p->tcp_cparam)) {
 			rv = NNG_ENOMEM;
@@ -390,6 +417,8 @@ tlstran_pipe_nego_cb(void *arg)
 			p->pro_ver = p->tcp_cparam->pro_ver;
 			if (p->pro_ver == MQTT_PROTOCOL_VERSION_v5) {
 				p->qsend_quota = p->tcp_cparam->rx_max;
+				p->alias_out   = nmq_alias_tbl_alloc(
+				    p->tcp_cparam->topic_alias_max);
 			}
 			nni_list_remove(&ep->negopipes, p);
 			nni_list_append(&ep->waitpipes, p);
@@ -469,6 +498,31 @@ error:
 	log_error("connect nego error rv:(%d) %s MQTT reason code %d",
 			  rv, nng_strerror(rv), code);
 	return;
+
+refused:
+	// Not an error of the listener, the accept loop is not told.
+	if (p->conn_buf != NULL) {
+		nng_free(p->conn_buf, p->wantrxhead);
+		p->conn_buf = NULL;
+	}
+	nng_stream_close(p->conn);
+	nni_mtx_unlock(&ep->mtx);
+	tlstran_pipe_reap(p);
+}
+
+// Once the CONNACK is written the connection no longer waits for
+// admission, whatever the verdict of the broker was.
+static void
+tlstran_pipe_answered(tlstran_pipe *p)
+{
+	tlstran_ep *ep = p->ep;
+
+	nni_mtx_lock(&ep->mtx);
+	if (p->admitted) {
+		p->admitted = false;
+		nmq_admission_done(&ep->adm);
+	}
+	nni_mtx_unlock(&ep->mtx);
 }
 
 static void
@@ -619,6 +673,9 @@ tlstran_pipe_send_cb(void *arg)
 	// nni_pipe_bump_tx(p->npipe, n);
 	nni_mtx_unlock(&p->mtx);
 
+	if (cmd == CMD_CONNACK) {
+		tlstran_pipe_answered(p);
+	}
 	nni_aio_set_msg(aio, NULL);
 	nni_msg_free(msg);
 	if (cmd == CMD_CONNACK && flag != 0x00) {
@@ -985,23 +1042,13 @@ tlstran_pipe_send_start_v4(tlstran_pipe *p, nni_msg *msg, nni_aio *aio)
 
 	// Recomposing for each msg
 	// never modify the original msg
-	NNI_LIST_FOREACH(subinfol, info) {
+	// Retained msgs go to every subscription, due to topic reflection
+	NMQ_SUBINFO_FOREACH (subinfol, info, topic, topic_len, retain_flag) {
 		if (tinfo != NULL && info != tinfo)
 			continue;
 
 		tinfo = NULL;
 
-		char *sub_topic = info->topic;
-		if (sub_topic[0] == '$') {
-			if (0 == strncmp(sub_topic, "$share/", strlen("$share/"))) {
-				sub_topic = strchr(sub_topic, '/');
-				sub_topic++;
-				sub_topic = strchr(sub_topic, '/');
-				sub_topic++;
-			}
-		}
-		if (false == topic_filtern(sub_topic, topic, topic_len) && retain_flag == 0)
-			continue;
 		if (niov > 4) {
 			// donot send too many msgs at a time
 			nni_aio_set_prov_data(txaio, info);
@@ -1215,7 +1262,8 @@ tlstran_pipe_send_start_v5(tlstran_pipe *p, nni_msg *msg, nni_aio *aio)
 	target_prover target_prover = 0;
 	int           len_offset = 0, sub_id = 0, qos = 0;
 	uint16_t      pid;
-	uint32_t tprop_bytes, id_bytes = 0, property_len = 0;
+	uint32_t tprop_bytes, prop_extra = 0, property_len = 0;
+	uint16_t alias, new_alias = 0;
 	size_t   tlen, rlen, mlen, hlen, qlength, plength;
 
 	bool is_sqlite = p->conf->sqlite.enable;
@@ -1263,7 +1311,8 @@ tlstran_pipe_send_start_v5(tlstran_pipe *p, nni_msg *msg, nni_aio *aio)
 	subinfo *info, *tinfo;
 	tinfo = nni_aio_get_prov_data(txaio);
 	nni_aio_set_prov_data(txaio, NULL);
-	NNI_LIST_FOREACH (p->npipe->subinfol, info) {
+	NMQ_SUBINFO_FOREACH (p->npipe->subinfol, info,
+	    (char *) (body + 2), tlen, retain_flag == 1) {
 		if (tinfo != NULL && info != tinfo) {
 			continue;
 		}
@@ -1272,151 +1321,166 @@ tlstran_pipe_send_start_v5(tlstran_pipe *p, nni_msg *msg, nni_aio *aio)
 		}
 		tinfo           = NULL;
 		len_offset      = 0;
-		char *sub_topic = info->topic;
-		if (sub_topic[0] == '$') {
-			if (0 == strncmp(sub_topic, "$share/", strlen("$share/"))) {
-				sub_topic = strchr(sub_topic, '/');
-				sub_topic++;
-				sub_topic = strchr(sub_topic, '/');
-				sub_topic++;
-			}
+		if (niov >= 8) {
+			// nng aio only allow 2 msgs at a time
+			nni_aio_set_prov_data(txaio, info);
+			break;
 		}
-		if (topic_filtern(sub_topic, (char *)(body + 2), tlen) || retain_flag == 1) {
-			if (niov >= 8) {
-				// nng aio only allow 2 msgs at a time
-				nni_aio_set_prov_data(txaio, info);
-				break;
-			}
-			uint8_t  var_extra[2], fixheader, tmp[4] = { 0 }, pos = 1;
-			uint8_t  proplen[4] = { 0 }, var_subid[5] = { 0 };
-			sub_id       = info->subid;
-			qos          = info->qos;
-
-			fixheader = *header;
-			if (nni_msg_cmd_type(msg) == CMD_PUBLISH) {
-				// V4 to V5 add 0 property length
-				target_prover = MQTTV4_V5;
-				prop_bytes    = 1;
-				tprop_bytes   = 1;
-				len_offset    = 1;
-			}
-			if (info->rap == 0) {
-				fixheader = fixheader & 0xFE;
-			}
-			if (sub_id != 0) {
-				var_subid[0] = 0x0B;
-				id_bytes = put_var_integer(var_subid+1, sub_id);
-				tprop_bytes = put_var_integer(proplen, property_len+1+id_bytes);
-				len_offset += (tprop_bytes - prop_bytes + 1 + id_bytes);
+		uint8_t  var_extra[2], fixheader, tmp[4] = { 0 }, pos = 1;
+		uint8_t  proplen[4] = { 0 }, var_prop[8] = { 0 };
+		bool     known = false;
+		sub_id       = info->subid;
+		qos          = info->qos;
+
+		fixheader = *header;
+		if (nni_msg_cmd_type(msg) == CMD_PUBLISH) {
+			// V4 to V5 add 0 property length
+			target_prover = MQTTV4_V5;
+			prop_bytes    = 1;
+			tprop_bytes   = 1;
+			len_offset    = 1;
+		}
+		if (info->rap == 0) {
+			fixheader = fixheader & 0xFE;
+		}
+		prop_extra = 0;
+		if (sub_id != 0) {
+			var_prop[0] = 0x0B;
+			prop_extra  = 1 + put_var_integer(var_prop + 1, sub_id);
+		}
+		// replace the topic with an alias the client already knows
+		alias = nmq_alias_assign(
+		    p->alias_out, (char *) (body + 2), tlen, &known);
+		if (alias != 0) {
+			var_prop[prop_extra] = TOPIC_ALIAS;
+			NNI_PUT16(var_prop + prop_extra + 1, alias);
+			prop_extra += 3;
+			if (!known) {
+				new_alias = alias;
 			}
-			// get final qos
-			qos = qos_pac > qos ? qos : qos_pac;
-
-			// alter qos according to sub qos
-			if (qos_pac > qos) {
-				if (qos == 1) {
-					// set qos to 1
-					fixheader = fixheader & 0xF9;
-					fixheader = fixheader | 0x02;
-				} else {
-					// set qos to 0
-					fixheader  = fixheader & 0xF9;
-					len_offset = len_offset - 2;
-				}
+		}
+		if (prop_extra != 0) {
+			tprop_bytes = put_var_integer(
+			    proplen, property_len + prop_extra);
+			len_offset += (tprop_bytes - prop_bytes + prop_extra);
+		}
+		if (known) {
+			len_offset -= tlen;
+		}
+		// get final qos
+		qos = qos_pac > qos ? qos : qos_pac;
+
+		// alter qos according to sub qos
+		if (qos_pac > qos) {
+			if (qos == 1) {
+				// set qos to 1
+				fixheader = fixheader & 0xF9;
+				fixheader = fixheader | 0x02;
+			} else {
+				// set qos to 0
+				fixheader  = fixheader & 0xF9;
+				len_offset = len_offset - 2;
 			}
-			// fixed header + remaining length
-			pos  = 1;
-			rlen = put_var_integer(
-			    tmp, get_var_integer(header, &pos) + len_offset);
-			// or just copy to qosbuf directly?
-			*(p->qos_buf + qlength) = fixheader;
-			memcpy(p->qos_buf + qlength + 1, tmp, rlen);
+		}
+		// fixed header + remaining length
+		pos  = 1;
+		rlen = put_var_integer(
+		    tmp, get_var_integer(header, &pos) + len_offset);
+		// or just copy to qosbuf directly?
+		*(p->qos_buf + qlength) = fixheader;
+		memcpy(p->qos_buf + qlength + 1, tmp, rlen);
+		iov[niov].iov_buf = p->qos_buf + qlength;
+		iov[niov].iov_len = rlen + 1;
+		niov++;
+		qlength += rlen + 1;
+		// 1st part of variable header: topic + topic len
+		if (known) {
+			// zero length topic, resolved by the alias
+			memset(p->qos_buf + qlength, 0, 2);
 			iov[niov].iov_buf = p->qos_buf + qlength;
-			iov[niov].iov_len = rlen + 1;
-			niov++;
-			qlength += rlen + 1;
-			// 1st part of variable header: topic + topic len
+			iov[niov].iov_len = 2;
+			qlength += 2;
+		} else {
 			iov[niov].iov_buf = body;
 			iov[niov].iov_len = tlen + 2;
-			niov++;
-			// len to indicate the offset in packet
-			len_offset = 0;
-			plength    = 0;
-			if (qos > 0) {
-				// set pid
-				len_offset = 2;
-				nni_msg *old;
-				// packetid in aio to differ resend msg
-				// TODO replace it with set prov data/pipe
-				pid = (uint16_t)(size_t) nni_aio_get_prov_data(aio);
-				if (pid == 0) {
-					// first time send this msg
-					pid = nni_pipe_inc_packetid(pipe);
-					// store msg for qos retry
-					nni_msg_clone(msg);
-					if ((old = nni_qos_db_get(is_sqlite,
-					         pipe->nano_qos_db, pipe->p_id,
-					         pid)) != NULL) {
-						// TODO packetid already
-						// exists. do we need to
-						// replace old with new one ?
-						// print warning to users
-						log_error("packet id "
-						          "duplicates in "
-						          "nano_qos_db");
-
-						nni_qos_db_remove_msg(
-						    is_sqlite,
-						    pipe->nano_qos_db, old);
-					}
-					old = msg;
-					nni_qos_db_set(is_sqlite,
-					    pipe->nano_qos_db, pipe->p_id, pid,
-					    old);
-					nni_qos_db_remove_oldest(is_sqlite,
-					    pipe->nano_qos_db,
-					    p->conf->sqlite.disk_cache_size);
+		}
+		niov++;
+		// len to indicate the offset in packet
+		len_offset = 0;
+		plength    = 0;
+		if (qos > 0) {
+			// set pid
+			len_offset = 2;
+			nni_msg *old;
+			// packetid in aio to differ resend msg
+			// TODO replace it with set prov data/pipe
+			pid = (uint16_t)(size_t) nni_aio_get_prov_data(aio);
+			if (pid == 0) {
+				// first time send this msg
+				pid = nni_pipe_inc_packetid(pipe);
+				// store msg for qos retry
+				nni_msg_clone(msg);
+				if ((old = nni_qos_db_get(is_sqlite,
+				         pipe->nano_qos_db, pipe->p_id,
+				         pid)) != NULL) {
+					// TODO packetid already
+					// exists. do we need to
+					// replace old with new one ?
+					// print warning to users
+					log_error("packet id "
+					          "duplicates in "
+					          "nano_qos_db");
+
+					nni_qos_db_remove_msg(
+					    is_sqlite,
+					    pipe->nano_qos_db, old);
 				}
-				NNI_PUT16(var_extra, pid);
-				// copy packet id
-				memcpy(p->qos_buf + qlength, var_extra, 2);
-				qlength += 2;
-				plength += 2;
-			} else if (qos_pac > 0) {
-				//ignore the packet id of original packet
-				len_offset += 2;
+				old = msg;
+				nni_qos_db_set(is_sqlite,
+				    pipe->nano_qos_db, pipe->p_id, pid,
+				    old);
+				nni_qos_db_remove_oldest(is_sqlite,
+				    pipe->nano_qos_db,
+				    p->conf->sqlite.disk_cache_size);
 			}
-			// prop len + sub id if any
-			if (sub_id != 0) {
+			NNI_PUT16(var_extra, pid);
+			// copy packet id
+			memcpy(p->qos_buf + qlength, var_extra, 2);
+			qlength += 2;
+			plength += 2;
+		} else if (qos_pac > 0) {
+			//ignore the packet id of original packet
+			len_offset += 2;
+		}
+		// prop len + sub id and topic alias if any
+		if (prop_extra != 0) {
+			memcpy(p->qos_buf + qlength, proplen,
+			    tprop_bytes);
+			qlength += tprop_bytes;
+			plength += tprop_bytes;
+			memcpy(p->qos_buf + qlength, var_prop, prop_extra);
+			qlength += prop_extra;
+			plength += prop_extra;
+			if (target_prover == MQTTV5)
+				len_offset += prop_bytes;
+		} else {
+			//need to add 0 len for V4 msg
+			if (target_prover == MQTTV4_V5) {
+				// add proplen even 0
 				memcpy(p->qos_buf + qlength, proplen,
 				    tprop_bytes);
 				qlength += tprop_bytes;
 				plength += tprop_bytes;
-				memcpy(p->qos_buf + qlength, var_subid,
-				    id_bytes + 1);
-				qlength += id_bytes + 1;
-				plength += id_bytes + 1;
-				if (target_prover == MQTTV5)
-					len_offset += prop_bytes;
-			} else {
-				//need to add 0 len for V4 msg
-				if (target_prover == MQTTV4_V5) {
-					// add proplen even 0
-					memcpy(p->qos_buf + qlength, proplen,
-					    tprop_bytes);
-					qlength += tprop_bytes;
-					plength += tprop_bytes;
-				}
 			}
-			// 2nd part of variable header: pid + proplen+0x0B+subid
-			iov[niov].iov_buf = p->qos_buf+qlength-plength;
-			iov[niov].iov_len = plength;
-			niov++;
-			// prop + body
-			iov[niov].iov_buf = body + 2 + tlen + len_offset;
-			iov[niov].iov_len = mlen - 2 - len_offset - tlen;
-			niov++;
 		}
+		// 2nd part of variable header: pid + proplen+0x0B+subid
+		iov[niov].iov_buf = p->qos_buf+qlength-plength;
+		iov[niov].iov_len = plength;
+		niov++;
+		// prop + body
+		iov[niov].iov_buf = body + 2 + tlen + len_offset;
+		iov[niov].iov_len = mlen - 2 - len_offset - tlen;
+		niov++;
 	}
 
 	// MQTT V5 flow control
@@ -1428,6 +1492,10 @@ tlstran_pipe_send_start_v5(tlstran_pipe *p, nni_msg *msg, nni_aio *aio)
 			// max_recv? msg lost, make it look like a
 			// normal send. qos msg will be resend
 			// afterwards
+			if (new_alias != 0) {
+				// never reached the client
+				nmq_alias_forget(p->alias_out, new_alias);
+			}
 			nni_msg_free(msg);
 			nni_aio_set_prov_data(txaio, NULL);
 			nni_list_remove(&p->sendq, aio);
@@ -1817,6 +1885,15 @@ tlstran_accept_cb(void *arg)
 		rv = NNG_ECLOSED;
 		goto error;
 	}
+	// Over the rate or too many waiting for a CONNACK: the CONNECT is
+	// still read, but only to answer it with a busy CONNACK.
+	p->admitted = nmq_admission_take(&ep->adm, nni_clock());
+	if (!p->admitted) {
+		p->refused = true;
+#ifdef NNG_ENABLE_STATS
+		nni_stat_inc(&ep->st_refused, 1);
+#endif
+	}
 	tlstran_pipe_start(p, conn, ep);
 	nng_stream_listener_accept(ep->listener, ep->connaio);
 	nni_mtx_unlock(&ep->mtx);
@@ -1870,6 +1947,14 @@ tlstran_ep_init(tlstran_ep **epp, nng_url *url, nni_sock *sock)
 		.si_atomic = true,
 	};
 	nni_stat_init(&ep->st_rcv_max, &rcv_max_info);
+	static const nni_stat_info refused_info = {
+		.si_name   = "refused",
+		.si_desc   = "connections refused by admission control",
+		.si_type   = NNG_STAT_COUNTER,
+		.si_unit   = NNG_UNIT_EVENTS,
+		.si_atomic = true,
+	};
+	nni_stat_init(&ep->st_refused, &refused_info);
 #endif
 
 	*epp = ep;
@@ -1943,6 +2028,7 @@ tlstran_ep_init_listener(void **lp, nng_url *url, nni_listener *nlistener)
 
 #ifdef NNG_ENABLE_STATS
 	nni_listener_add_stat(nlistener, &ep->st_rcv_max);
+	nni_listener_add_stat(nlistener, &ep->st_refused);
 #endif
 	*lp = ep;
 	return (0);
@@ -2033,6 +2119,82 @@ tlstran_ep_set_recvmaxsz(void *arg, const void *v, size_t sz, nni_opt_type t)
 	return (rv);
 }
 
+static int
+tlstran_ep_get_admission(
+    uint32_t *field, tlstran_ep *ep, void *v, size_t *szp, nni_opt_type t)
+{
+	int rv;
+
+	nni_mtx_lock(&ep->mtx);
+	rv = nni_copyout_int((int) *field, v, szp, t);
+	nni_mtx_unlock(&ep->mtx);
+	return (rv);
+}
+
+static int
+tlstran_ep_set_admission(uint32_t *field, tlstran_ep *ep, const void *v,
+    size_t sz, nni_opt_type t)
+{
+	int val;
+	int rv;
+
+	if ((rv = nni_copyin_int(&val, v, sz, 0, NNI_MAXINT, t)) == 0) {
+		nni_mtx_lock(&ep->mtx);
+		*field = (uint32_t) val;
+		nni_mtx_unlock(&ep->mtx);
+	}
+	return (rv);
+}
+
+static int
+tlstran_ep_get_connect_rate(void *arg, void *v, size_t *szp, nni_opt_type t)
+{
+	tlstran_ep *ep = arg;
+	return (tlstran_ep_get_admission(&ep->adm.rate, ep, v, szp, t));
+}
+
+static int
+tlstran_ep_set_connect_rate(
+    void *arg, const void *v, size_t sz, nni_opt_type t)
+{
+	tlstran_ep *ep = arg;
+	return (tlstran_ep_set_admission(&ep->adm.rate, ep, v, sz, t));
+}
+
+static int
+tlstran_ep_get_connect_burst(
+    void *arg, void *v, size_t *szp, nni_opt_type t)
+{
+	tlstran_ep *ep = arg;
+	return (tlstran_ep_get_admission(&ep->adm.burst, ep, v, szp, t));
+}
+
+static int
+tlstran_ep_set_connect_burst(
+    void *arg, const void *v, size_t sz, nni_opt_type t)
+{
+	tlstran_ep *ep = arg;
+	return (tlstran_ep_set_admission(&ep->adm.burst, ep, v, sz, t));
+}
+
+static int
+tlstran_ep_get_connect_pending(
+    void *arg, void *v, size_t *szp, nni_opt_type t)
+{
+	tlstran_ep *ep = arg;
+	return (
+	    tlstran_ep_get_admission(&ep->adm.max_pending, ep, v, szp, t));
+}
+
+static int
+tlstran_ep_set_connect_pending(
+    void *arg, const void *v, size_t sz, nni_opt_type t)
+{
+	tlstran_ep *ep = arg;
+	return (
+	    tlstran_ep_set_admission(&ep->adm.max_pending, ep, v, sz, t));
+}
+
 static int
 tlstran_ep_bind(void *arg)
 {
@@ -2107,6 +2269,21 @@ static const nni_option tlstran_ep_opts[] = {
 	    .o_name = NANO_CONF,
 	    .o_set  = tlstran_ep_set_conf,
 	},
+	{
+	    .o_name = NNG_OPT_MQTT_CONNECT_RATE,
+	    .o_get  = tlstran_ep_get_connect_rate,
+	    .o_set  = tlstran_ep_set_connect_rate,
+	},
+	{
+	    .o_name = NNG_OPT_MQTT_CONNECT_BURST,
+	    .o_get  = tlstran_ep_get_connect_burst,
+	    .o_set  = tlstran_ep_set_connect_burst,
+	},
+	{
+	    .o_name = NNG_OPT_MQTT_CONNECT_PENDING,
+	    .o_get  = tlstran_ep_get_connect_pending,
+	    .o_set  = tlstran_ep_set_connect_pending,
+	},
 	// terminate list
 	{
 	    .o_name = NULL,
@@ -40,11 +40,15 @@ struct ws_listener {
 	nni_aio             *accaio;
 	nng_stream_listener *listener;
 	bool                 started;
+	nmq_admission        adm;
 };
 
 struct ws_pipe {
 	nni_mtx     mtx;
 	bool        closed;
+	bool        admitted; // counted as pending until its CONNACK
+	bool        answered; // CONNACK on its way
+	ws_listener *listener;
 	uint8_t     txlen[NANO_MIN_PACKET_LEN];
 	uint16_t    peer;
 	size_t      gotrxhead;
@@ -65,11 +69,31 @@ struct ws_pipe {
 	// MQTT V5
 	uint16_t    qrecv_quota;
 	uint32_t    qsend_quota;
+	nmq_alias_tbl *alias_out; // outbound topic aliases (MQTT v5)
 	reason_code err_code; // work with closed flag
 };
 
 static void wstran_pipe_close(void *arg);
 
+// Once the CONNACK is written, or the CONNECT is given up on, the
+// connection no longer waits for admission.  Called without the lock of
+// the listener, possibly with the one of the pipe.
+static void
+wstran_pipe_admitted_done(ws_pipe *p)
+{
+	ws_listener *l = p->listener;
+
+	if (l == NULL) {
+		return;
+	}
+	nni_mtx_lock(&l->mtx);
+	if (p->admitted) {
+		p->admitted = false;
+		nmq_admission_done(&l->adm);
+	}
+	nni_mtx_unlock(&l->mtx);
+}
+
 static void
 wstran_pipe_send_cb(void *arg)
 {
@@ -81,6 +105,10 @@ wstran_pipe_send_cb(void *arg)
 	taio          = p->txaio;
 	uaio          = p->user_txaio;
 	p->user_txaio = NULL;
+	if (p->answered) {
+		p->answered = false;
+		wstran_pipe_admitted_done(p);
+	}
 
 	if (uaio != NULL) {
 		if (p->closed){
@@ -213,6 +241,8 @@ done:
 			log_trace("MQTT Clientid is %s", p->ws_param->clientid.body);
 			if (p->ws_param->pro_ver == 5) {
 				p->qsend_quota = p->ws_param->rx_max;
+				p->alias_out   = nmq_alias_tbl_alloc(
+				    p->ws_param->topic_alias_max);
 			}
 			if (p->ws_param->max_packet_size == 0) {
 				// set default max packet size for client
@@ -370,6 +400,7 @@ reset:
 	// with the accept file descriptor being closed.
 	// listener will treat this errorcode as TCP err. so NNG_ECLOSED shall not be used.
 		rv = NNG_ECONNABORTED;
+		wstran_pipe_admitted_done(p);
 		nni_aio_finish_error(p->ep_aio, rv);
 	} else if (uaio != NULL) {
 		nni_aio_set_msg(uaio, NULL);
@@ -391,6 +422,9 @@ recv_error:
 	nni_mtx_unlock(&p->mtx);
 	if (smsg)
 		nni_msg_free(smsg);
+	if (uaio == p->ep_aio) {
+		wstran_pipe_admitted_done(p);
+	}
 	if (uaio != NULL) {
 		nni_aio_finish_error(uaio, rv);
 	} else if (p->ep_aio != NULL) {
@@ -492,116 +526,106 @@ wstran_pipe_send_start_v4(ws_pipe *p, nni_msg *msg, nni_aio *aio)
 		plength       = property_len + prop_bytes;
 	}
 
-	NNI_LIST_FOREACH (p->npipe->subinfol, info) {
+	NMQ_SUBINFO_FOREACH (p->npipe->subinfol, info,
+	    (char *) (body + 2), tlen, retain_flag == 1) {
 		if (tinfo != NULL && info != tinfo ) {
 			continue;
 		}
 		tinfo = NULL;
 		len_offset=0;
-		char *sub_topic = info->topic;
-		if (sub_topic[0] == '$') {
-			if (0 == strncmp(sub_topic, "$share/", strlen("$share/"))) {
-				sub_topic = strchr(sub_topic, '/');
-				sub_topic++;
-				sub_topic = strchr(sub_topic, '/');
-				sub_topic++;
+		uint8_t pos    = 1, var_extra[2], fixheader,
+		        tmp[4] = { 0 };
+		qos            = info->qos;
+		fixheader      = *header;
+
+		// get final qos
+		qos = qos_pac > qos ? qos : qos_pac;
+
+		// alter qos according to sub qos
+		if (qos_pac > qos) {
+			if (qos == 1) {
+				// set qos to 1
+				fixheader = fixheader & 0xF9;
+				fixheader = fixheader | 0x02;
+			} else {
+				// set qos to 0
+				fixheader = fixheader & 0xF9;
+				len_offset   = len_offset - 2;
 			}
 		}
-		if (topic_filtern(sub_topic, (char *) (body + 2), tlen) || retain_flag == 1) {
-			uint8_t pos    = 1, var_extra[2], fixheader,
-			        tmp[4] = { 0 };
-			qos            = info->qos;
-			fixheader      = *header;
-
-			// get final qos
-			qos = qos_pac > qos ? qos : qos_pac;
-
-			// alter qos according to sub qos
-			if (qos_pac > qos) {
-				if (qos == 1) {
-					// set qos to 1
-					fixheader = fixheader & 0xF9;
-					fixheader = fixheader | 0x02;
-				} else {
-					// set qos to 0
-					fixheader = fixheader & 0xF9;
-					len_offset   = len_offset - 2;
-				}
-			}
-			// fixed header + remaining length
-			rlen = put_var_integer(tmp,
-			    get_var_integer(header, &pos) + len_offset -
-			        plength);
-			*(p->qos_buf + qlength) = fixheader;
-			// copy remaining length
-			memcpy(p->qos_buf + qlength + 1, tmp, rlen);
-			iov[niov].iov_buf = p->qos_buf + qlength;
-			iov[niov].iov_len = rlen + 1;
-			niov++;
-			qlength += rlen + 1;
-			// 1st part of variable header: topic + topic len
-			iov[niov].iov_buf = body;
-			iov[niov].iov_len = tlen+2;
-			niov++;
-			// len to indicate the offset in packet
-			len_offset = 0;
-			if (qos > 0) {
-				// set pid
-				len_offset = 2;
-				nni_msg *old;
-				// packetid in aio to differ resend msg
-				// TODO replace it with set prov data
-				pid = (uint16_t)(size_t) nni_aio_get_prov_data(aio);
-				if (pid == 0) {
-					// first time send this msg
-					pid = nni_pipe_inc_packetid(pipe);
-					// store msg for qos retrying
-					nni_msg_clone(msg);
-					if ((old = nni_qos_db_get(is_sqlite,
-					         pipe->nano_qos_db, pipe->p_id,
-					         pid)) != NULL) {
-						// TODO packetid already
-						// exists. we need to
-						// replace old with new one
-						// print warning to users
-						nni_println("ERROR: packet id "
-						            "duplicates in "
-						            "nano_qos_db");
-						nni_qos_db_remove_msg(
-						    is_sqlite,
-						    pipe->nano_qos_db, old);
-					}
-					old = msg;
-					nni_qos_db_set(is_sqlite,
-					    pipe->nano_qos_db, pipe->p_id, pid,
-					    old);
-					nni_qos_db_remove_oldest(is_sqlite,
-					    pipe->nano_qos_db,
-					    p->conf->sqlite.disk_cache_size);
+		// fixed header + remaining length
+		rlen = put_var_integer(tmp,
+		    get_var_integer(header, &pos) + len_offset -
+		        plength);
+		*(p->qos_buf + qlength) = fixheader;
+		// copy remaining length
+		memcpy(p->qos_buf + qlength + 1, tmp, rlen);
+		iov[niov].iov_buf = p->qos_buf + qlength;
+		iov[niov].iov_len = rlen + 1;
+		niov++;
+		qlength += rlen + 1;
+		// 1st part of variable header: topic + topic len
+		iov[niov].iov_buf = body;
+		iov[niov].iov_len = tlen+2;
+		niov++;
+		// len to indicate the offset in packet
+		len_offset = 0;
+		if (qos > 0) {
+			// set pid
+			len_offset = 2;
+			nni_msg *old;
+			// packetid in aio to differ resend msg
+			// TODO replace it with set prov data
+			pid = (uint16_t)(size_t) nni_aio_get_prov_data(aio);
+			if (pid == 0) {
+				// first time send this msg
+				pid = nni_pipe_inc_packetid(pipe);
+				// store msg for qos retrying
+				nni_msg_clone(msg);
+				if ((old = nni_qos_db_get(is_sqlite,
+				         pipe->nano_qos_db, pipe->p_id,
+				         pid)) != NULL) {
+					// TODO packetid already
+					// exists. we need to
+					// replace old with new one
+					// print warning to users
+					nni_println("ERROR: packet id "
+					            "duplicates in "
+					            "nano_qos_db");
+					nni_qos_db_remove_msg(
+					    is_sqlite,
+					    pipe->nano_qos_db, old);
 				}
-				NNI_PUT16(var_extra, pid);
-				// copy packet id
-				memcpy(p->qos_buf + qlength, var_extra, 2);
-			} else if (qos_pac > 0) {
-				//ignore the packet id of original packet
-				len_offset += 2;
-			}
-			// 2nd part of variable header: pid
-			iov[niov].iov_buf = p->qos_buf + qlength;
-			iov[niov].iov_len = qos > 0 ? 2 : 0;
-			niov++;
-			qlength += qos > 0 ? 2 : 0;
-			// body
-			iov[niov].iov_buf = body + 2 + tlen + len_offset + plength;
-			iov[niov].iov_len = mlen - 2 - len_offset - tlen - plength;
-			niov++;
-			// apending directly
-			for (int i = 0; i < niov; i++) {
-				nni_msg_append(
-				    smsg, iov[i].iov_buf, iov[i].iov_len);
+				old = msg;
+				nni_qos_db_set(is_sqlite,
+				    pipe->nano_qos_db, pipe->p_id, pid,
+				    old);
+				nni_qos_db_remove_oldest(is_sqlite,
+				    pipe->nano_qos_db,
+				    p->conf->sqlite.disk_cache_size);
 			}
-			niov = 0;
+			NNI_PUT16(var_extra, pid);
+			// copy packet id
+			memcpy(p->qos_buf + qlength, var_extra, 2);
+		} else if (qos_pac > 0) {
+			//ignore the packet id of original packet
+			len_offset += 2;
+		}
+		// 2nd part of variable header: pid
+		iov[niov].iov_buf = p->qos_buf + qlength;
+		iov[niov].iov_len = qos > 0 ? 2 : 0;
+		niov++;
+		qlength += qos > 0 ? 2 : 0;
+		// body
+		iov[niov].iov_buf = body + 2 + tlen + len_offset + plength;
+		iov[niov].iov_len = mlen - 2 - len_offset - tlen - plength;
+		niov++;
+		// apending directly
+		for (int i = 0; i < niov; i++) {
+			nni_msg_append(
+			    smsg, iov[i].iov_buf, iov[i].iov_len);
 		}
+		niov = 0;
 	}
 
 	// duplicated msg is gonna be freed by http. so we free old one
@@ -618,6 +642,7 @@ send:
 	// for websocket, cmd type is 0x00 for PUBLISH
 	if (nni_msg_cmd_type(msg) == CMD_CONNACK) {
 		uint8_t *header = nni_msg_header(msg);
+		p->answered     = true;
 		if (*(header + 3) != 0x00) {
 			p->closed = true;
 			// TODO get err code from CONNACK
@@ -647,7 +672,8 @@ wstran_pipe_send_start_v5(ws_pipe *p, nni_msg *msg, nni_aio *aio)
 	target_prover target_prover;
 	int           len_offset = 0, sub_id = 0;
 	uint16_t      pid;
-	uint32_t      id_bytes = 0, property_len = 0;
+	uint32_t      prop_extra = 0, property_len = 0;
+	uint16_t      alias, new_alias = 0;
 	size_t        tlen, rlen, mlen, hlen, qlength, plength;
 	bool          is_sqlite = p->conf->sqlite.enable;
 
@@ -695,160 +721,177 @@ wstran_pipe_send_start_v5(ws_pipe *p, nni_msg *msg, nni_aio *aio)
 	subinfo *info = NULL;
 	nni_msg_alloc(&smsg, 0);
 
-	NNI_LIST_FOREACH (p->npipe->subinfol, info) {
+	NMQ_SUBINFO_FOREACH (p->npipe->subinfol, info,
+	    (char *) (body + 2), tlen, retain_flag == 1) {
 		if (info->no_local == 1 &&
 		    p->npipe->p_id == nni_msg_get_pipe(msg)) {
 			continue;
 		}
 		len_offset      = 0;
-		char *sub_topic = info->topic;
-		if (sub_topic[0] == '$') {
-			if (0 ==
-			    strncmp(sub_topic, "$share/", strlen("$share/"))) {
-				sub_topic = strchr(sub_topic, '/');
-				sub_topic++;
-				sub_topic = strchr(sub_topic, '/');
-				sub_topic++;
-			}
+		// qos_buf is copied into smsg at the end of every round
+		qlength         = 0;
+		uint8_t  var_extra[2], fixheader, tmp[4] = { 0 }, pos = 1;
+		uint8_t  proplen[4] = { 0 }, var_prop[8] = { 0 };
+		bool     known = false;
+		sub_id       = info->subid;
+		qos          = info->qos;
+
+		//else use original var payload & pid
+		fixheader = *header;
+		if (nni_msg_cmd_type(msg) == CMD_PUBLISH) {
+			// V4 to V5 add 0 property length
+			target_prover = MQTTV4_V5;
+			prop_bytes    = 1;
+			tprop_bytes   = 1;
+			len_offset    = 1;
 		}
-		if (topic_filtern(sub_topic, (char *) (body + 2), tlen) || retain_flag == 1) {
-			uint8_t  var_extra[2], fixheader, tmp[4] = { 0 }, pos = 1;
-			uint8_t  proplen[4] = { 0 }, var_subid[5] = { 0 };
-			sub_id       = info->subid;
-			qos          = info->qos;
-
-			//else use original var payload & pid
-			fixheader = *header;
-			if (nni_msg_cmd_type(msg) == CMD_PUBLISH) {
-				// V4 to V5 add 0 property length
-				target_prover = MQTTV4_V5;
-				prop_bytes    = 1;
-				tprop_bytes   = 1;
-				len_offset    = 1;
-			}
-			if (info->rap == 0) {
-				fixheader = fixheader & 0xFE;
-			}
-			if (sub_id != 0) {
-				var_subid[0] = 0x0B;
-				id_bytes = put_var_integer(var_subid+1, sub_id);
-				tprop_bytes = put_var_integer(proplen, property_len+1+id_bytes);
-				len_offset += (tprop_bytes - prop_bytes + 1 + id_bytes);
+		if (info->rap == 0) {
+			fixheader = fixheader & 0xFE;
+		}
+		prop_extra = 0;
+		if (sub_id != 0) {
+			var_prop[0] = 0x0B;
+			prop_extra  = 1 + put_var_integer(var_prop + 1, sub_id);
+		}
+		// replace the topic with an alias the client already knows
+		alias = nmq_alias_assign(
+		    p->alias_out, (char *) (body + 2), tlen, &known);
+		if (alias != 0) {
+			var_prop[prop_extra] = TOPIC_ALIAS;
+			NNI_PUT16(var_prop + prop_extra + 1, alias);
+			prop_extra += 3;
+			if (!known) {
+				new_alias = alias;
 			}
+		}
+		if (prop_extra != 0) {
+			tprop_bytes = put_var_integer(
+			    proplen, property_len + prop_extra);
+			len_offset += (tprop_bytes - prop_bytes + prop_extra);
+		}
+		if (known) {
+			len_offset -= tlen;
+		}
 
-			// get final qos
-			qos = qos_pac > qos ? qos : qos_pac;
+		// get final qos
+		qos = qos_pac > qos ? qos : qos_pac;
 
-			// alter qos according to sub qos
-			if (qos_pac > qos) {
-				if (qos == 1) {
-					// set qos to 1
-					fixheader = fixheader & 0xF9;
-					fixheader = fixheader | 0x02;
-				} else {
-					// set qos to 0
-					fixheader = fixheader & 0xF9;
-					len_offset   = len_offset - 2;
-				}
+		// alter qos according to sub qos
+		if (qos_pac > qos) {
+			if (qos == 1) {
+				// set qos to 1
+				fixheader = fixheader & 0xF9;
+				fixheader = fixheader | 0x02;
+			} else {
+				// set qos to 0
+				fixheader = fixheader & 0xF9;
+				len_offset   = len_offset - 2;
 			}
-			// fixed header + remaining length
-			rlen = put_var_integer(
-			    tmp, get_var_integer(header, &pos) + len_offset);
-			// or just copy to qosbuf directly?
-			*(p->qos_buf + qlength) = fixheader;
-			memcpy(p->qos_buf + qlength + 1, tmp, rlen);
+		}
+		// fixed header + remaining length
+		rlen = put_var_integer(
+		    tmp, get_var_integer(header, &pos) + len_offset);
+		// or just copy to qosbuf directly?
+		*(p->qos_buf + qlength) = fixheader;
+		memcpy(p->qos_buf + qlength + 1, tmp, rlen);
+		iov[niov].iov_buf = p->qos_buf + qlength;
+		iov[niov].iov_len = rlen + 1;
+		niov++;
+		qlength += rlen + 1;
+		// 1st part of variable header: topic + topic len
+		if (known) {
+			// zero length topic, resolved by the alias
+			memset(p->qos_buf + qlength, 0, 2);
 			iov[niov].iov_buf = p->qos_buf + qlength;
-			iov[niov].iov_len = rlen + 1;
-			niov++;
-			qlength += rlen + 1;
-			// 1st part of variable header: topic + topic len
+			iov[niov].iov_len = 2;
+			qlength += 2;
+		} else {
 			iov[niov].iov_buf = body;
-			iov[niov].iov_len = tlen+2;
-			niov++;
-			// len to indicate the offset in packet
-			len_offset = 0;
-			plength = 0;
-			if (qos > 0) {
-				// set pid
-				len_offset = 2;
-				nni_msg *old;
-				// packetid in aio to differ resend msg
-				// TODO replace it with set prov data
-				pid = (uint16_t)(size_t) nni_aio_get_prov_data(
-				    aio);
-				if (pid == 0) {
-					// first time send this msg
-					pid = nni_pipe_inc_packetid(pipe);
-					// store msg for qos retrying
-					nni_msg_clone(msg);
-					if ((old = nni_qos_db_get(is_sqlite,
-					         pipe->nano_qos_db, pipe->p_id,
-					         pid)) != NULL) {
-						// TODO packetid already
-						// exists. we need to
-						// replace old with new one
-						// print warning to users
-						nni_println("ERROR: packet id "
-						            "duplicates in "
-						            "nano_qos_db");
-						nni_qos_db_remove_msg(
-						    is_sqlite,
-						    pipe->nano_qos_db, old);
-					}
-					old = msg;
-					nni_qos_db_set(is_sqlite,
-					    pipe->nano_qos_db, pipe->p_id, pid,
-					    old);
-					nni_qos_db_remove_oldest(is_sqlite,
-					    pipe->nano_qos_db,
-					    p->conf->sqlite.disk_cache_size);
+			iov[niov].iov_len = tlen + 2;
+		}
+		niov++;
+		// len to indicate the offset in packet
+		len_offset = 0;
+		plength = 0;
+		if (qos > 0) {
+			// set pid
+			len_offset = 2;
+			nni_msg *old;
+			// packetid in aio to differ resend msg
+			// TODO replace it with set prov data
+			pid = (uint16_t)(size_t) nni_aio_get_prov_data(
+			    aio);
+			if (pid == 0) {
+				// first time send this msg
+				pid = nni_pipe_inc_packetid(pipe);
+				// store msg for qos retrying
+				nni_msg_clone(msg);
+				if ((old = nni_qos_db_get(is_sqlite,
+				         pipe->nano_qos_db, pipe->p_id,
+				         pid)) != NULL) {
+					// TODO packetid already
+					// exists. we need to
+					// replace old with new one
+					// print warning to users
+					nni_println("ERROR: packet id "
+					            "duplicates in "
+					            "nano_qos_db");
+					nni_qos_db_remove_msg(
+					    is_sqlite,
+					    pipe->nano_qos_db, old);
 				}
-				NNI_PUT16(var_extra, pid);
-				// copy packet id
-				memcpy(p->qos_buf + qlength, var_extra, 2);
-				qlength += 2;
-				plength += 2;
-			} else if (qos_pac > 0) {
-				//ignore the packet id of original packet
-				len_offset += 2;
+				old = msg;
+				nni_qos_db_set(is_sqlite,
+				    pipe->nano_qos_db, pipe->p_id, pid,
+				    old);
+				nni_qos_db_remove_oldest(is_sqlite,
+				    pipe->nano_qos_db,
+				    p->conf->sqlite.disk_cache_size);
 			}
-			// prop len + sub id if any
-			if (sub_id != 0) {
+			NNI_PUT16(var_extra, pid);
+			// copy packet id
+			memcpy(p->qos_buf + qlength, var_extra, 2);
+			qlength += 2;
+			plength += 2;
+		} else if (qos_pac > 0) {
+			//ignore the packet id of original packet
+			len_offset += 2;
+		}
+		// prop len + sub id and topic alias if any
+		if (prop_extra != 0) {
+			memcpy(p->qos_buf + qlength, proplen,
+			    tprop_bytes);
+			qlength += tprop_bytes;
+			plength += tprop_bytes;
+			memcpy(p->qos_buf + qlength, var_prop, prop_extra);
+			qlength += prop_extra;
+			plength += prop_extra;
+			if (target_prover == MQTTV5)
+				len_offset += prop_bytes;
+		} else {
+			//need to add 0 len for V4 msg
+			if (target_prover == MQTTV4_V5) {
+				// add proplen even 0
 				memcpy(p->qos_buf + qlength, proplen,
 				    tprop_bytes);
 				qlength += tprop_bytes;
 				plength += tprop_bytes;
-				memcpy(p->qos_buf + qlength, var_subid,
-				    id_bytes + 1);
-				qlength += id_bytes + 1;
-				plength += id_bytes + 1;
-				if (target_prover == MQTTV5)
-					len_offset += prop_bytes;
-			} else {
-				//need to add 0 len for V4 msg
-				if (target_prover == MQTTV4_V5) {
-					// add proplen even 0
-					memcpy(p->qos_buf + qlength, proplen,
-					    tprop_bytes);
-					qlength += tprop_bytes;
-					plength += tprop_bytes;
-				}
-			}
-			// 2nd part of variable header: pid + proplen+0x0B+subid
-			iov[niov].iov_buf = p->qos_buf+qlength-plength;
-			iov[niov].iov_len = plength;
-			niov++;
-			// prop + body
-			iov[niov].iov_buf = body + 2 + tlen + len_offset;
-			iov[niov].iov_len = mlen - 2 - len_offset - tlen;
-			niov++;
-			// apending directly
-			for (int i = 0; i < niov; i++) {
-				nni_msg_append(
-				    smsg, iov[i].iov_buf, iov[i].iov_len);
 			}
-			niov = 0;
 		}
+		// 2nd part of variable header: pid + proplen+0x0B+subid
+		iov[niov].iov_buf = p->qos_buf+qlength-plength;
+		iov[niov].iov_len = plength;
+		niov++;
+		// prop + body
+		iov[niov].iov_buf = body + 2 + tlen + len_offset;
+		iov[niov].iov_len = mlen - 2 - len_offset - tlen;
+		niov++;
+		// apending directly
+		for (int i = 0; i < niov; i++) {
+			nni_msg_append(
+			    smsg, iov[i].iov_buf, iov[i].iov_len);
+		}
+		niov = 0;
 	}
 
 	// duplicated msg is gonna be freed by http. so we free old one
@@ -865,6 +908,10 @@ wstran_pipe_send_start_v5(ws_pipe *p, nni_msg *msg, nni_aio *aio)
 			// max_recv? msg lost, make it look like a
 			// normal send. qos msg will be resend
 			// afterwards
+			if (new_alias != 0) {
+				// never reached the client
+				nmq_alias_forget(p->alias_out, new_alias);
+			}
 			nni_msg_free(msg);
 			// nni_aio_set_prov_data(txaio, NULL);
 			nni_aio_set_msg(aio, NULL);
@@ -881,6 +928,7 @@ send:
 	// verify connect
 	if (nni_msg_cmd_type(msg) == CMD_CONNACK) {
 		uint8_t *header = nni_msg_header(msg);
+		p->answered     = true;
 		if (*(header + 3) != 0x00) {
 			p->closed = true;
 			p->err_code = NOT_AUTHORIZED;
@@ -986,6 +1034,7 @@ wstran_pipe_fini(void *arg)
 {
 	ws_pipe *p = arg;
 
+	wstran_pipe_admitted_done(p);
 	nng_stream_free(p->ws);
 	nni_aio_free(p->rxaio);
 	nni_aio_free(p->txaio);
@@ -999,6 +1048,7 @@ wstran_pipe_fini(void *arg)
 	nni_aio_free(p->qsaio);
 	nni_msg_free(p->tmp_msg);
 	nni_mtx_fini(&p->mtx);
+	nmq_alias_tbl_free(p->alias_out);
 	nng_free(p->qos_buf, 16 + NNI_NANO_MAX_PACKET_SIZE);
 	NNI_FREE_STRUCT(p);
 }
@@ -1163,6 +1213,81 @@ ws_pipe_start(ws_pipe *pipe, nng_stream *conn, ws_listener *l)
 	nng_stream_recv(p->ws, p->rxaio);
 }
 
+// A connection refused by admission control only lives to read its
+// CONNECT and answer it with a busy CONNACK.  It never becomes a pipe,
+// and the accept of the socket keeps waiting for the next connection.
+typedef struct {
+	nng_stream   *ws;
+	nni_aio      *aio;
+	bool          sent;
+	nni_reap_node reap;
+} ws_refusal;
+
+static void
+ws_refusal_fini(void *arg)
+{
+	ws_refusal *r = arg;
+	nni_msg    *msg;
+
+	nni_aio_stop(r->aio);
+	// a failed send leaves the message behind
+	if ((msg = nni_aio_get_msg(r->aio)) != NULL) {
+		nni_msg_free(msg);
+	}
+	nni_aio_free(r->aio);
+	nng_stream_free(r->ws);
+	NNI_FREE_STRUCT(r);
+}
+
+static nni_reap_list ws_refusal_reap_list = {
+	.rl_offset = offsetof(ws_refusal, reap),
+	.rl_func   = ws_refusal_fini,
+};
+
+static void
+ws_refusal_cb(void *arg)
+{
+	ws_refusal *r   = arg;
+	nni_msg    *msg = nni_aio_get_msg(r->aio);
+	uint8_t     buf[5];
+	int         n;
+
+	if (!r->sent && nni_aio_result(r->aio) == 0 && msg != NULL) {
+		// The CONNECT has to come in one websocket message.
+		n = nmq_connack_busy(nni_msg_body(msg), nni_msg_len(msg), buf);
+		if (n > 0) {
+			nni_msg_header_clear(msg);
+			nni_msg_clear(msg);
+			if (nni_msg_append(msg, buf, n) == 0) {
+				r->sent = true;
+				nng_stream_send(r->ws, r->aio);
+				return;
+			}
+		}
+	}
+	nng_stream_close(r->ws);
+	nni_reap(&ws_refusal_reap_list, r);
+}
+
+static void
+ws_refuse(nng_stream *ws)
+{
+	ws_refusal *r;
+
+	if ((r = NNI_ALLOC_STRUCT(r)) == NULL) {
+		nng_stream_free(ws);
+		return;
+	}
+	if (nni_aio_alloc(&r->aio, ws_refusal_cb, r) != 0) {
+		NNI_FREE_STRUCT(r);
+		nng_stream_free(ws);
+		return;
+	}
+	r->ws = ws;
+	nni_aio_set_timeout(r->aio, 15 * 1000);
+	nng_stream_recv(r->ws, r->aio);
+}
+
 static void
 wstran_accept_cb(void *arg)
 {
@@ -1180,7 +1305,10 @@ wstran_accept_cb(void *arg)
 		}
 	} else {
 		nng_stream *ws = nni_aio_get_output(aaio, 0);
-		if (uaio != NULL) {
+		if (uaio != NULL &&
+		    !nmq_admission_take(&l->adm, nni_clock())) {
+			ws_refuse(ws);
+		} else if (uaio != NULL) {
 			ws_pipe *p;
 			// Make a pipe
 			nni_aio_list_remove(uaio);
@@ -1188,8 +1316,10 @@ wstran_accept_cb(void *arg)
 				nng_stream_close(ws);
 				nni_aio_finish_error(uaio, rv);
 			} else {
-				p->peer = l->peer;
-				p->ep_aio = uaio;
+				p->peer     = l->peer;
+				p->ep_aio   = uaio;
+				p->listener = l;
+				p->admitted = true;
 				ws_pipe_start(p, p->ws, l);
 			}
 		}
@@ -1257,11 +1387,97 @@ wstran_ep_set_conf(void *arg, const void *v, size_t sz, nni_type t)
 	return 0;
 }
 
+static int
+wstran_ep_get_admission(
+    uint32_t *field, ws_listener *l, void *v, size_t *szp, nni_type t)
+{
+	int rv;
+
+	nni_mtx_lock(&l->mtx);
+	rv = nni_copyout_int((int) *field, v, szp, t);
+	nni_mtx_unlock(&l->mtx);
+	return (rv);
+}
+
+static int
+wstran_ep_set_admission(
+    uint32_t *field, ws_listener *l, const void *v, size_t sz, nni_type t)
+{
+	int val;
+	int rv;
+
+	if ((rv = nni_copyin_int(&val, v, sz, 0, NNI_MAXINT, t)) == 0) {
+		nni_mtx_lock(&l->mtx);
+		*field = (uint32_t) val;
+		nni_mtx_unlock(&l->mtx);
+	}
+	return (rv);
+}
+
+static int
+wstran_ep_get_connect_rate(void *arg, void *v, size_t *szp, nni_type t)
+{
+	ws_listener *l = arg;
+	return (wstran_ep_get_admission(&l->adm.rate, l, v, szp, t));
+}
+
+static int
+wstran_ep_set_connect_rate(void *arg, const void *v, size_t sz, nni_type t)
+{
+	ws_listener *l = arg;
+	return (wstran_ep_set_admission(&l->adm.rate, l, v, sz, t));
+}
+
+static int
+wstran_ep_get_connect_burst(void *arg, void *v, size_t *szp, nni_type t)
+{
+	ws_listener *l = arg;
+	return (wstran_ep_get_admission(&l->adm.burst, l, v, szp, t));
+}
+
+static int
+wstran_ep_set_connect_burst(
+    void *arg, const void *v, size_t sz, nni_type t)
+{
+	ws_listener *l = arg;
+	return (wstran_ep_set_admission(&l->adm.burst, l, v, sz, t));
+}
+
+static int
+wstran_ep_get_connect_pending(void *arg, void *v, size_t *szp, nni_type t)
+{
+	ws_listener *l = arg;
+	return (wstran_ep_get_admission(&l->adm.max_pending, l, v, szp, t));
+}
+
+static int
+wstran_ep_set_connect_pending(
+    void *arg, const void *v, size_t sz, nni_type t)
+{
+	ws_listener *l = arg;
+	return (wstran_ep_set_admission(&l->adm.max_pending, l, v, sz, t));
+}
+
 static const nni_option wstran_ep_opts[] = {
 	{
 	    .o_name = NANO_CONF,
 	    .o_set  = wstran_ep_set_conf,
 	},
+	{
+	    .o_name = NNG_OPT_MQTT_CONNECT_RATE,
+	    .o_get  = wstran_ep_get_connect_rate,
+	    .o_set  = wstran_ep_set_connect_rate,
+	},
+	{
+	    .o_name = NNG_OPT_MQTT_CONNECT_BURST,
+	    .o_get  = wstran_ep_get_connect_burst,
+	    .o_set  = wstran_ep_set_connect_burst,
+	},
+	{
+	    .o_name = NNG_OPT_MQTT_CONNECT_PENDING,
+	    .o_get  = wstran_ep_get_connect_pending,
+	    .o_set  = wstran_ep_set_connect_pending,
+	},
 	// terminate list
 	{
 	    .o_name = NULL,
@@ -283,6 +283,40 @@ test_tcp_recv_max(void)
 	NUTS_CLOSE(s1);
 }
 
+void
+test_tcp_poller_option(void)
+{
+	nng_socket   s0;
+	nng_socket   s1;
+	nng_listener l;
+	int          x;
+	char        *addr;
+
+	NUTS_ADDR(addr, "tcp");
+	NUTS_OPEN(s0);
+	NUTS_OPEN(s1);
+	NUTS_PASS(nng_socket_set_ms(s0, NNG_OPT_RECVTIMEO, 1000));
+	NUTS_PASS(nng_socket_set_ms(s1, NNG_OPT_SENDTIMEO, 1000));
+	NUTS_PASS(nng_listener_create(&l, s0, addr));
+	NUTS_PASS(nng_listener_get_int(l, NNG_OPT_TCP_POLLER, &x));
+	NUTS_TRUE(x == -1);
+	NUTS_FAIL(nng_listener_set_int(l, NNG_OPT_TCP_POLLER, -2), NNG_EINVAL);
+	NUTS_FAIL(
+	    nng_listener_set_bool(l, NNG_OPT_TCP_POLLER, true), NNG_EBADTYPE);
+	// A poller that is not running yet is started for the listener
+	NUTS_PASS(nng_listener_set_int(l, NNG_OPT_TCP_POLLER, 3));
+	NUTS_PASS(nng_listener_start(l, 0));
+	NUTS_PASS(nng_listener_get_int(l, NNG_OPT_TCP_POLLER, &x));
+	NUTS_TRUE(x == 3);
+	NUTS_FAIL(nng_listener_set_int(l, NNG_OPT_TCP_POLLER, 1), NNG_EBUSY);
+
+	NUTS_PASS(nng_dial(s1, addr, NULL, 0));
+	NUTS_SEND(s1, "pinned");
+	NUTS_RECV(s0, "pinned");
+	NUTS_CLOSE(s0);
+	NUTS_CLOSE(s1);
+}
+
 NUTS_TESTS = {
 
 	{ "tcp wild card connect fail", test_tcp_wild_card_connect_fail },
@@ -295,5 +329,6 @@ NUTS_TESTS = {
 	{ "tcp no delay option", test_tcp_no_delay_option },
 	{ "tcp keep alive option", test_tcp_keep_alive_option },
 	{ "tcp recv max", test_tcp_recv_max },
+	{ "tcp poller option", test_tcp_poller_option },
 	{ NULL, NULL },
 };
\ No newline at end of file
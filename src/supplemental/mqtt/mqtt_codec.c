@@ -9,7 +9,6 @@
 
 static void nni_mqtt_msg_append_u8(nni_msg *, uint8_t);
 static void nni_mqtt_msg_append_u16(nni_msg *, uint16_t);
-static void nni_mqtt_msg_append_u32(nni_msg *, uint32_t);
 
 static void nni_mqtt_msg_append_byte_str(nni_msg *, nni_mqtt_buffer *);
 
@@ -84,6 +83,11 @@ static void dup_unsubscribe(nni_mqtt_proto_data *, nni_mqtt_proto_data *);
 
 static void mqtt_msg_content_free(nni_mqtt_proto_data *);
 
+static int read_variable_int(uint8_t *, uint32_t, uint32_t *, uint8_t *);
+static int encode_properties_buf(
+    struct pos_buf *, property *, uint32_t, uint8_t);
+static uint32_t encode_properties_size(property *, uint8_t);
+
 typedef struct {
 	nni_mqtt_packet_type packet_type;
 	int (*encode)(nni_msg *);
@@ -155,6 +159,9 @@ static mqtt_msg_codec_handler codec_v5_handler[] = {
 int
 nni_mqtt_msg_encode(nni_msg *msg)
 {
+	// Lazy properties must be parsed before the body is rewritten
+	nni_mqtt_msg_publish_rebase(msg);
+	nni_mqttv5_msg_decode_properties(msg);
 	nni_msg_clear(msg);
 	nni_msg_header_clear(msg);
 
@@ -179,6 +186,9 @@ nni_mqtt_msg_encode(nni_msg *msg)
 int
 nni_mqttv5_msg_encode(nni_msg *msg)
 {
+	// Lazy properties must be parsed before the body is rewritten
+	nni_mqtt_msg_publish_rebase(msg);
+	nni_mqttv5_msg_decode_properties(msg);
 	nni_msg_clear(msg);
 	nni_msg_header_clear(msg);
 
@@ -192,7 +202,7 @@ nni_mqttv5_msg_encode(nni_msg *msg)
 				mqtt->initialized = true;
 				mqtt->is_copied   = true;
 			}
-			mqtt->is_copied  = true;
+			mqtt->is_decoded = false;
 			return codec_v5_handler[i].encode(msg);
 		}
 	}
@@ -220,6 +230,8 @@ nni_mqtt_msg_decode(nni_msg *msg)
 				mqtt->is_copied   = false;
 			}
 			mqtt->is_decoded = true;
+			mqtt->is_lazy    = false;
+			mqtt->view_body  = nni_msg_body(msg);
 			return codec_handler[i].decode(msg);
 		}
 	}
@@ -247,6 +259,8 @@ nni_mqttv5_msg_decode(nni_msg *msg)
 				mqtt->is_copied   = false;
 			}
 			mqtt->is_decoded = true;
+			mqtt->is_lazy    = false;
+			mqtt->view_body  = nni_msg_body(msg);
 			return codec_v5_handler[i].decode(msg);
 		}
 	}
@@ -254,6 +268,67 @@ nni_mqttv5_msg_decode(nni_msg *msg)
 	return MQTT_ERR_PROTOCOL;
 }
 
+// Decodes the message like nni_mqttv5_msg_decode and parses and verifies
+// the properties it left in the body too.
+int
+nni_mqttv5_msg_decode_full(nni_msg *msg)
+{
+	int rv;
+
+	if ((rv = nni_mqttv5_msg_decode(msg)) != MQTT_SUCCESS) {
+		return rv;
+	}
+	return nni_mqttv5_msg_decode_properties(msg);
+}
+
+// Parses the properties of a lazily decoded PUBLISH from the body. Values
+// are copied, the list outlives changes of the body like a re-encode.
+int
+nni_mqttv5_msg_decode_properties(nni_msg *msg)
+{
+	nni_mqtt_proto_data *mqtt = nni_msg_get_proto_data(msg);
+	uint32_t             pos;
+	uint32_t             prop_len;
+
+	if (mqtt == NULL || !mqtt->is_lazy) {
+		return MQTT_SUCCESS;
+	}
+	mqtt->is_lazy = false;
+	pos           = mqtt->var_header.publish.prop_pos;
+	mqtt->var_header.publish.properties = decode_buf_properties(
+	    nni_msg_body(msg), nni_msg_len(msg), &pos, &prop_len, true);
+	if (check_properties(mqtt->var_header.publish.properties, msg) !=
+	    SUCCESS) {
+		return MQTT_ERR_PROTOCOL;
+	}
+	return MQTT_SUCCESS;
+}
+
+// The topic and payload of a decoded PUBLISH point into the body, a copy
+// made by nni_msg_dup still points into the body of the original. Moves
+// them to the same offsets in the body of this message.
+void
+nni_mqtt_msg_publish_rebase(nni_msg *msg)
+{
+	nni_mqtt_proto_data *mqtt = nni_msg_get_proto_data(msg);
+	uint8_t             *body = nni_msg_body(msg);
+
+	if (mqtt == NULL || mqtt->is_copied || !mqtt->is_decoded ||
+	    mqtt->view_body == NULL || mqtt->view_body == body ||
+	    mqtt->fixed_header.common.packet_type != NNG_MQTT_PUBLISH) {
+		return;
+	}
+	if (mqtt->var_header.publish.topic_name.buf != NULL) {
+		mqtt->var_header.publish.topic_name.buf = body +
+		    (mqtt->var_header.publish.topic_name.buf - mqtt->view_body);
+	}
+	if (mqtt->payload.publish.payload.buf != NULL) {
+		mqtt->payload.publish.payload.buf = body +
+		    (mqtt->payload.publish.payload.buf - mqtt->view_body);
+	}
+	mqtt->view_body = body;
+}
+
 int
 nni_mqtt_msg_packet_validate(
     uint8_t *buf, size_t buf_len, size_t header_len, uint8_t mqtt_version)
@@ -441,7 +516,8 @@ nni_mqtt_msg_dup(void **dest, const void *src)
 
 	mqtt = NNI_ALLOC_STRUCT(mqtt);
 	memcpy(mqtt, (nni_mqtt_proto_data *) src, sizeof(nni_mqtt_proto_data));
-	mqtt->initialized = false;
+	// A decoded view keeps borrowing from the body, see publish_rebase
+	mqtt->initialized = s->is_decoded && !s->is_copied;
 
 	switch (mqtt->fixed_header.common.packet_type) {
 	case NNG_MQTT_CONNECT:
@@ -709,23 +785,6 @@ nni_mqtt_msg_append_u16(nni_msg *msg, uint16_t val)
 	nni_msg_append(msg, buf, 2);
 }
 
-static void
-nni_mqtt_msg_append_u32(nni_msg *msg, uint32_t val)
-{
-	uint8_t buf[4] = { 0 };
-	NNI_PUT32(buf, val);
-	nni_msg_append(msg, buf, 4);
-}
-
-static void
-nni_mqtt_msg_append_varint(nni_msg *msg, uint32_t val)
-{
-	uint8_t        buf[4] = { 0 };
-	struct pos_buf pbuf   = { .curpos = &buf[0], .endpos = &buf[4] };
-	int            bytes  = write_variable_length_value(val, &pbuf);
-	nni_msg_append(msg, buf, bytes);
-}
-
 static void
 nni_mqtt_msg_append_byte_str(nni_msg *msg, nni_mqtt_buffer *str)
 {
@@ -736,30 +795,128 @@ nni_mqtt_msg_append_byte_str(nni_msg *msg, nni_mqtt_buffer *str)
 static int
 nni_mqtt_msg_encode_fixed_header(nni_msg *msg, nni_mqtt_proto_data *data)
 {
-	uint8_t        *rlen;
-	rlen = nng_alloc(sizeof(uint8_t)*8);
-	struct pos_buf buf     = { .curpos = &rlen[0],
-                .endpos                = &rlen[sizeof(rlen)] };
+	uint8_t        hdr[5];
+	struct pos_buf buf = { .curpos = &hdr[1], .endpos = &hdr[5] };
 
 	nni_msg_header_clear(msg);
-	uint8_t header = *(uint8_t *) &data->fixed_header.common;
-
-	int rv = nni_msg_header_append(msg, &header, 1);
+	hdr[0] = *(uint8_t *) &data->fixed_header.common;
 
 	int len = write_variable_length_value(
 	    data->fixed_header.remaining_length, &buf);
 
 	log_debug("%d %x %x %x %x", data->fixed_header.remaining_length,
-	    rlen[0], rlen[1], rlen[2], rlen[3]);
+	    hdr[1], hdr[2], hdr[3], hdr[4]);
 	if (len == -1) {
 		log_error("encode remaining length failed!");
-		nng_free(rlen, sizeof(uint8_t)*8);
 		return -1;
 	}
 	data->used_bytes = len;
-	rv |= nni_msg_header_append(msg, rlen, len);
-	nng_free(rlen, sizeof(uint8_t)*8);
-	return rv;
+	return nni_msg_header_append(msg, hdr, len + 1);
+}
+
+// Sizes the body to len bytes with one allocation at most, so the encoder
+// can write it in a single pass. Values of a decoded message may still
+// point into the body, those are kept and moved along when it grows.
+static uint8_t *
+nni_mqtt_msg_body_alloc(nni_msg *msg, size_t len, mqtt_buf **src, int nsrc)
+{
+	uint8_t *body = nni_msg_body(msg);
+	size_t   cap  = nni_msg_capacity(msg);
+	size_t   keep = 0;
+
+	for (int i = 0; i < nsrc; i++) {
+		uint8_t *p = src[i]->buf;
+		if (p != NULL && body != NULL && p >= body && p < body + cap) {
+			if ((size_t) (p - body) + src[i]->length > keep) {
+				keep = (size_t) (p - body) + src[i]->length;
+			}
+		}
+	}
+	nni_msg_clear(msg);
+	if (len > cap && keep > 0) {
+		// Still in place past the cleared length, let grow copy it
+		nni_msg_realloc(msg, keep);
+	}
+	if (nni_msg_reserve(msg, len) != 0 ||
+	    nni_msg_realloc(msg, len) != 0) {
+		return NULL;
+	}
+	if (keep > 0 && nni_msg_body(msg) != body) {
+		for (int i = 0; i < nsrc; i++) {
+			uint8_t *p = src[i]->buf;
+			if (p != NULL && p >= body && p < body + cap) {
+				src[i]->buf = (uint8_t *) nni_msg_body(msg) +
+				    (p - body);
+			}
+		}
+	}
+	return nni_msg_body(msg);
+}
+
+// Both versions of PUBLISH, the hot path of clients. The payload is moved
+// before the topic and properties are written in front of it, it may
+// come from this very body when a decoded message is encoded again.
+static int
+nni_mqtt_msg_encode_publish_common(nni_msg *msg, bool v5)
+{
+	nni_mqtt_proto_data *mqtt     = nni_msg_get_proto_data(msg);
+	mqtt_publish_vhdr *  vhdr     = &mqtt->var_header.publish;
+	mqtt_buf *           payload  = &mqtt->payload.publish.payload;
+	mqtt_buf *           src[]    = { &vhdr->topic_name, payload };
+	uint32_t             prop_len = 0;
+	size_t               len;
+	uint8_t *            body;
+	struct pos_buf       buf;
+
+	len = 2 + vhdr->topic_name.length + payload->length;
+	if (mqtt->fixed_header.publish.qos > 0) {
+		len += 2; /* Packet Identifier */
+	}
+	if (v5) {
+		prop_len = get_properties_len(vhdr->properties, CMD_PUBLISH);
+		len += byte_number_for_variable_length(prop_len) + prop_len;
+	}
+	if (len > MQTT_MAX_MSG_LEN) {
+		return MQTT_ERR_PAYLOAD_SIZE;
+	}
+	if ((body = nni_mqtt_msg_body_alloc(msg, len, src, 2)) == NULL) {
+		return MQTT_ERR_NOMEM;
+	}
+
+	/* Payload */
+	if (payload->length > 0) {
+		memmove(body + len - payload->length, payload->buf,
+		    payload->length);
+	}
+
+	buf.curpos = body;
+	buf.endpos = body + len - payload->length;
+
+	/* Topic Name */
+	NNI_PUT16(buf.curpos, vhdr->topic_name.length);
+	if (vhdr->topic_name.length > 0) {
+		memmove(buf.curpos + 2, vhdr->topic_name.buf,
+		    vhdr->topic_name.length);
+	}
+	buf.curpos += 2 + vhdr->topic_name.length;
+
+	if (mqtt->fixed_header.publish.qos > 0) {
+		/* Packet Id */
+		write_uint16(vhdr->packet_id, &buf);
+	}
+	if (v5 &&
+	    encode_properties_buf(
+	        &buf, vhdr->properties, prop_len, CMD_PUBLISH) != 0) {
+		return MQTT_ERR_PROTOCOL;
+	}
+
+	mqtt->fixed_header.remaining_length = (uint32_t) len;
+	if (nni_mqtt_msg_encode_fixed_header(msg, mqtt) != 0) {
+		return MQTT_ERR_PROTOCOL;
+	}
+
+	/* A PUBLISH without payload is refused, as it has always been */
+	return payload->length > 0 ? MQTT_SUCCESS : MQTT_ERR_PROTOCOL;
 }
 
 static int
@@ -821,6 +978,9 @@ nni_mqtt_msg_encode_connect(nni_msg *msg)
 		return MQTT_ERR_PAYLOAD_SIZE;
 	}
 	nni_mqtt_msg_encode_fixed_header(msg, mqtt);
+	if (nni_msg_reserve(msg, poslength) != 0) {
+		return MQTT_ERR_NOMEM;
+	}
 
 	nni_mqtt_msg_append_byte_str(msg, &var_header->protocol_name);
 
@@ -947,6 +1107,14 @@ nni_mqttv5_msg_encode_connect(nni_msg *msg)
 		poslength += 2 + payload->password.length;
 		var_header->conn_flags.password_flag = 1;
 	}
+	poslength += encode_properties_size(var_header->properties, CMD_CONNECT);
+	if (var_header->conn_flags.will_flag) {
+		poslength += encode_properties_size(
+		    payload->will_properties, CMD_CONNECT);
+	}
+	if (nni_msg_reserve(msg, poslength) != 0) {
+		return MQTT_ERR_NOMEM;
+	}
 
 	nni_mqtt_msg_append_byte_str(msg, &var_header->protocol_name);
 
@@ -1219,87 +1387,13 @@ nni_mqttv5_msg_encode_suback(nni_msg *msg)
 static int
 nni_mqtt_msg_encode_publish(nni_msg *msg)
 {
-	nni_mqtt_proto_data *mqtt = nni_msg_get_proto_data(msg);
-	nni_msg_clear(msg);
-	nni_msg_header_clear(msg);
-
-	uint32_t poslength = 0;
-	int      rv = 0;
-
-	poslength += 2; /* for Topic Name length field */
-	poslength += mqtt->var_header.publish.topic_name.length;
-	/* Packet Identifier is requested if QoS>0 */
-	if (mqtt->fixed_header.publish.qos > 0) {
-		poslength += 2; /* for Packet Identifier */
-	}
-	poslength += mqtt->payload.publish.payload.length;
-	mqtt->fixed_header.remaining_length = poslength;
-
-	if (nni_mqtt_msg_encode_fixed_header(msg, mqtt) != 0)
-		return MQTT_ERR_PROTOCOL;
-
-	mqtt_publish_vhdr *var_header = &mqtt->var_header.publish;
-
-	/* Topic Name */
-	nni_mqtt_msg_append_byte_str(msg, &var_header->topic_name);
-
-	if (mqtt->fixed_header.publish.qos > 0) {
-		/* Packet Id */
-		nni_mqtt_msg_append_u16(msg, var_header->packet_id);
-	}
-
-	/* Payload */
-	if (mqtt->payload.publish.payload.length > 0) {
-		rv = nni_msg_append(msg, mqtt->payload.publish.payload.buf,
-		    mqtt->payload.publish.payload.length);
-	} else {
-		rv = MQTT_ERR_INVAL;
-	}
-	if (mqtt->fixed_header.remaining_length != nni_msg_len(msg)) {
-		log_error("encode header error!");
-		rv = MQTT_ERR_PROTOCOL;
-	}
-
-	return rv == 0? MQTT_SUCCESS : MQTT_ERR_PROTOCOL;
+	return nni_mqtt_msg_encode_publish_common(msg, false);
 }
 
 static int
 nni_mqttv5_msg_encode_publish(nni_msg *msg)
 {
-	int rv = 0;
-
-	nni_msg_clear(msg);
-	nni_msg_header_clear(msg);
-
-	nni_mqtt_proto_data *mqtt = nni_msg_get_proto_data(msg);
-	mqtt_publish_vhdr *var_header = &mqtt->var_header.publish;
-
-	/* Topic Name */
-	nni_mqtt_msg_append_byte_str(msg, &var_header->topic_name);
-
-	if (mqtt->fixed_header.publish.qos > 0) {
-		/* Packet Id */
-		nni_mqtt_msg_append_u16(msg, var_header->packet_id);
-	}
-
-	if (encode_properties(
-	        msg, mqtt->var_header.publish.properties, CMD_PUBLISH) != 0) {
-		return MQTT_ERR_PROTOCOL;
-	}
-
-	/* Payload */
-	if (mqtt->payload.publish.payload.length > 0) {
-		rv = nni_msg_append(msg, mqtt->payload.publish.payload.buf,
-		    mqtt->payload.publish.payload.length);
-	} else {
-		rv = MQTT_ERR_INVAL;
-	}
-
-	mqtt->fixed_header.remaining_length = nng_msg_len(msg);
-	if (nni_mqtt_msg_encode_fixed_header(msg, mqtt) != 0)
-		return MQTT_ERR_PROTOCOL;
-
-	return rv == 0? MQTT_SUCCESS : MQTT_ERR_PROTOCOL;
+	return nni_mqtt_msg_encode_publish_common(msg, true);
 }
 
 static int
@@ -2290,14 +2384,21 @@ nni_mqttv5_msg_decode_publish(nni_msg *msg)
 		packid_length = 2;
 	}
 
-	uint32_t pos = buf.curpos - &body[0];
-	uint32_t prop_len = 0, prop_sz;
-	uint32_t pos1 = pos;
-	mqtt->var_header.publish.properties =
-	    decode_buf_properties(body, length, &pos, &prop_len, true);
-	check_properties(mqtt->var_header.publish.properties, msg);
-	buf.curpos = &body[0] + pos;
-	prop_sz = pos - pos1;
+	/* Properties, only located here and parsed on first access */
+	uint32_t prop_len = 0, prop_sz = 0;
+	uint8_t  bytes    = 0;
+	mqtt->var_header.publish.properties = NULL;
+	mqtt->var_header.publish.prop_pos   = buf.curpos - &body[0];
+	if (buf.curpos < buf.endpos) {
+		if (read_variable_int(buf.curpos, buf.endpos - buf.curpos,
+		        &prop_len, &bytes) != 0 ||
+		    prop_len > (uint32_t) (buf.endpos - buf.curpos) - bytes) {
+			return MQTT_ERR_PROTOCOL;
+		}
+		prop_sz = bytes + prop_len;
+		buf.curpos += prop_sz;
+		mqtt->is_lazy = prop_len > 0;
+	}
 
 
 	/* Payload */
@@ -3487,6 +3588,33 @@ mqtt_msg_dump(mqtt_msg *msg, mqtt_buf *buf, mqtt_buf *packet, bool print_bytes)
 	return 0;
 }
 
+// Decoded property lists are one allocation. The head of the list comes
+// first, so the list pointer is the arena, and is marked by an id no
+// property has. index holds the first node of every id for O(1) lookups.
+#define PROPERTY_ARENA_ID 0xFF
+#define PROPERTY_ID_MAX SHARED_SUBSCRIPTION_AVAILABLE
+
+typedef struct {
+	property  head;
+	size_t    size;
+	property *index[PROPERTY_ID_MAX + 1];
+	property  nodes[];
+} property_arena;
+
+static inline property_arena *
+property_arena_of(const property *list)
+{
+	return (list != NULL && list->id == PROPERTY_ARENA_ID)
+	    ? (property_arena *) list
+	    : NULL;
+}
+
+static inline bool
+property_in_arena(const property_arena *arena, const property *p)
+{
+	return (arena != NULL && (const uint8_t *) p >= (const uint8_t *) arena &&
+	    (const uint8_t *) p < (const uint8_t *) arena + arena->size);
+}
 
 property *
 property_alloc(void)
@@ -3734,7 +3862,13 @@ property_parse(struct pos_buf *buf, property *prop, uint8_t prop_id,
 void
 property_append(property *prop_list, property *last)
 {
-	property *p = prop_list;
+	property_arena *arena = property_arena_of(prop_list);
+	property *      p     = prop_list;
+
+	if (arena != NULL && last->id <= PROPERTY_ID_MAX &&
+	    arena->index[last->id] == NULL) {
+		arena->index[last->id] = last;
+	}
 	while (p) {
 		if (p->next == NULL) {
 			p->next    = last;
@@ -3748,30 +3882,44 @@ property_append(property *prop_list, property *last)
 void
 property_remove(property *prop_list, uint8_t prop_id)
 {
+	property_arena *arena = property_arena_of(prop_list);
+
 	for (property *p = prop_list; p != NULL; p = p->next) {
 		if (p->next != NULL) {
 			property *p_temp = p->next;
 			if (prop_id == p_temp->id) {
-				switch (p_temp->data.p_type) {
-				case STR:
-					mqtt_buf_free(
-					    &p_temp->data.p_value.str);
-					break;
-				case BINARY:
-					mqtt_buf_free(
-					    &p_temp->data.p_value.binary);
-					break;
-				case STR_PAIR:
-					mqtt_kv_free(
-					    &p_temp->data.p_value.strpair);
-					break;
-				default:
+				p->next = p_temp->next;
+				if (arena != NULL && prop_id <= PROPERTY_ID_MAX &&
+				    arena->index[prop_id] == p_temp) {
+					arena->index[prop_id] = NULL;
+					for (property *n = p->next; n != NULL;
+					     n = n->next) {
+						if (n->id == prop_id) {
+							arena->index[prop_id] = n;
+							break;
+						}
+					}
+				}
+				if (property_in_arena(arena, p_temp)) {
 					break;
 				}
-				if (p_temp->next != NULL) {
-					p->next = p_temp->next;
-				} else {
-					p->next = NULL;
+				if (p_temp->data.is_copy) {
+					switch (p_temp->data.p_type) {
+					case STR:
+						mqtt_buf_free(
+						    &p_temp->data.p_value.str);
+						break;
+					case BINARY:
+						mqtt_buf_free(
+						    &p_temp->data.p_value.binary);
+						break;
+					case STR_PAIR:
+						mqtt_kv_free(
+						    &p_temp->data.p_value.strpair);
+						break;
+					default:
+						break;
+					}
 				}
 				free(p_temp);
 				break;
@@ -3848,12 +3996,17 @@ property_foreach(property *prop, void (*cb)(property *))
 int
 property_free(property *prop)
 {
-	property *head = prop;
-	property *p;
+	property_arena *arena = property_arena_of(prop);
+	property *      head  = prop;
+	property *      p;
 
 	while (head) {
 		p    = head;
 		head = head->next;
+		if (property_in_arena(arena, p)) {
+			// Strings of the arena go with it
+			continue;
+		}
 		if (p->data.is_copy) {
 			switch (p->data.p_type) {
 			case STR:
@@ -3872,6 +4025,9 @@ property_free(property *prop)
 		free(p);
 		p = NULL;
 	}
+	if (arena != NULL) {
+		nni_free(arena, arena->size);
+	}
 	return 0;
 }
 
@@ -3886,7 +4042,8 @@ check_properties(property *prop, nni_msg *msg)
 		return SUCCESS;
 	}
 	// uint32_t pos = 0;
-	bool mei = false; // MESSAGE_EXPIRY_INTERVAL:
+	bool     mei  = false; // MESSAGE_EXPIRY_INTERVAL:
+	uint64_t seen = 0;     // ids that must not repeat
 	for (property *p1 = prop->next; p1 != NULL; p1 = p1->next) {
 #ifdef MQTTV5_VERIFY
 		switch (p1->id) {
@@ -3947,32 +4104,88 @@ check_properties(property *prop, nni_msg *msg)
 			break;
 		}
 #endif
-		for (property *p2 = p1->next; p2 != NULL; p2 = p2->next) {
-			if (p1->id == p2->id &&
-			    p1->data.p_type != STR_PAIR) {
+		if (p1->data.p_type != STR_PAIR && p1->id < 64) {
+			if (seen & (1ull << p1->id)) {
 				return PROTOCOL_ERROR;
 			}
+			seen |= 1ull << p1->id;
 		}
 	}
 
 	return SUCCESS;
 }
 
+// Skips over the value of a property, fails on truncated or unknown ones.
+// The bytes copied values need are added to strings.
+static int
+property_skip(struct pos_buf *buf, uint8_t prop_id, size_t *strings)
+{
+	mqtt_buf str;
+	uint32_t varint;
+
+	switch (property_get_value_type(prop_id)) {
+	case U8:
+		return (read_bytes(buf, &str.buf, 1));
+	case U16:
+		return (read_bytes(buf, &str.buf, 2));
+	case U32:
+		return (read_bytes(buf, &str.buf, 4));
+	case VARINT:
+		return (read_variable_integer(buf, &varint));
+	case BINARY:
+	case STR:
+		if (read_utf8_str(buf, &str) != 0) {
+			return (MQTT_ERR_PROTOCOL);
+		}
+		*strings += str.length;
+		return (0);
+	case STR_PAIR:
+		if (read_utf8_str(buf, &str) != 0) {
+			return (MQTT_ERR_PROTOCOL);
+		}
+		*strings += str.length;
+		if (read_utf8_str(buf, &str) != 0) {
+			return (MQTT_ERR_PROTOCOL);
+		}
+		*strings += str.length;
+		return (0);
+	default:
+		return (MQTT_ERR_PROTOCOL);
+	}
+}
+
+static uint8_t *
+property_arena_str(mqtt_buf *str, uint8_t *strings)
+{
+	if (str->length > 0) {
+		memcpy(strings, str->buf, str->length);
+		str->buf = strings;
+	}
+	return (strings + str->length);
+}
+
 /**
  * packet_len: remaining length
  * len: property length
+ *
+ * The list is a single property_arena holding the nodes and, with
+ * copy_value, their strings too. A malformed block gives NULL.
  * */
 property *
 decode_buf_properties(uint8_t *packet, uint32_t packet_len, uint32_t *pos,
     uint32_t *len, bool copy_value)
 {
-	int       rv;
-	uint8_t * msg_body    = packet;
-	size_t    msg_len     = packet_len;
-	uint32_t  prop_len    = 0;
-	uint8_t   bytes       = 0;
-	uint32_t  current_pos = *pos;
-	property *list        = NULL;
+	int             rv;
+	uint8_t *       msg_body    = packet;
+	size_t          msg_len     = packet_len;
+	uint32_t        prop_len    = 0;
+	uint8_t         bytes       = 0;
+	uint32_t        current_pos = *pos;
+	uint32_t        count       = 0;
+	size_t          strings     = 0;
+	uint8_t         prop_id     = 0;
+	property_arena *arena       = NULL;
+	struct pos_buf  buf;
 
 	if (current_pos >= msg_len) {
 		return NULL;
@@ -3987,38 +4200,92 @@ decode_buf_properties(uint8_t *packet, uint32_t packet_len, uint32_t *pos,
 	if (prop_len == 0) {
 		goto out;
 	}
-	struct pos_buf buf = {
-		.curpos = &msg_body[current_pos],
-		.endpos = &msg_body[current_pos + prop_len],
-	};
 
-	log_debug("remain len %d prop len %d curpos %p endpos %p", msg_len, prop_len, buf.curpos, buf.endpos);
+	log_debug("remain len %d prop len %d", msg_len, prop_len);
 	if (msg_len - current_pos < prop_len) {
 		log_warn("Malformed packet: property len > remaining len!");
 		goto out;
 	}
-	uint8_t prop_id = 0;
-	list            = property_alloc();
-	/* Check properties appearance time */
-	// TODO
-
+	buf.curpos = &msg_body[current_pos];
+	buf.endpos = &msg_body[current_pos + prop_len];
 	while (buf.curpos < buf.endpos) {
-		if (0 != read_byte(&buf, &prop_id)) {
-			property_free(list);
-			break;
+		if (read_byte(&buf, &prop_id) != 0 ||
+		    property_skip(&buf, prop_id, &strings) != 0) {
+			log_warn("Malformed packet: property %d invalid!",
+			    prop_id);
+			goto out;
+		}
+		count++;
+	}
+
+	size_t size = sizeof(property_arena) + count * sizeof(property) +
+	    (copy_value ? strings : 0);
+	if ((arena = nni_zalloc(size)) == NULL) {
+		goto out;
+	}
+	arena->head.id = PROPERTY_ARENA_ID;
+	arena->size    = size;
+
+	property *last = &arena->head;
+	uint8_t * str  = (uint8_t *) &arena->nodes[count];
+
+	buf.curpos = &msg_body[current_pos];
+	for (uint32_t i = 0; i < count; i++) {
+		property *p = &arena->nodes[i];
+
+		read_byte(&buf, &prop_id);
+		property_parse(&buf, p, prop_id,
+		    property_get_value_type(prop_id), false);
+		if (copy_value) {
+			p->data.is_copy = true;
+			switch (p->data.p_type) {
+			case BINARY:
+			case STR:
+				str = property_arena_str(&p->data.p_value.str, str);
+				break;
+			case STR_PAIR:
+				str = property_arena_str(
+				    &p->data.p_value.strpair.key, str);
+				str = property_arena_str(
+				    &p->data.p_value.strpair.value, str);
+				break;
+			default:
+				break;
+			}
+		}
+		if (arena->index[prop_id] == NULL) {
+			arena->index[prop_id] = p;
 		}
-		property *         cur_prop = NULL;
-		property_type_enum type     = property_get_value_type(prop_id);
-		cur_prop =
-		    property_parse(&buf, cur_prop, prop_id, type, copy_value);
-		property_append(list, cur_prop);
+		last->next = p;
+		last       = p;
 	}
 
 out:
 	current_pos += (prop_len);
 	*pos = current_pos;
 	*len = prop_len;
-	return list;
+	return arena == NULL ? NULL : &arena->head;
+}
+
+// Finds prop_id in a property block, props points past the property
+// length. *off is set to the offset of the identifier. Nothing is copied.
+int
+property_scan(uint8_t *props, uint32_t len, uint8_t prop_id, uint32_t *off)
+{
+	struct pos_buf buf     = { .curpos = props, .endpos = props + len };
+	size_t         strings = 0;
+
+	while (buf.curpos < buf.endpos) {
+		uint8_t id = *buf.curpos++;
+		if (id == prop_id) {
+			*off = (uint32_t) (buf.curpos - 1 - props);
+			return (MQTT_SUCCESS);
+		}
+		if (property_skip(&buf, id, &strings) != 0) {
+			return (MQTT_ERR_PROTOCOL);
+		}
+	}
+	return (MQTT_ERR_NOT_FOUND);
 }
 
 property *
@@ -4095,6 +4362,12 @@ get_properties_len(property *prop, uint8_t cmd)
 property_data *
 property_get_value(property *prop, uint8_t prop_id)
 {
+	property_arena *arena = property_arena_of(prop);
+
+	if (arena != NULL && prop_id <= PROPERTY_ID_MAX) {
+		property *p = arena->index[prop_id];
+		return p == NULL ? NULL : &p->data;
+	}
 	if (prop) {
 		for (property *p = prop->next; p != NULL; p = p->next) {
 			if (p->id == prop_id) {
@@ -4178,25 +4451,19 @@ out:
 	return NULL;
 }
 
-int
-encode_properties(nni_msg *msg, property *prop, uint8_t cmd)
+// Writes the length and the properties, prop_len is the one of
+// get_properties_len. Room has been made for them.
+static int
+encode_properties_buf(
+    struct pos_buf *buf, property *prop, uint32_t prop_len, uint8_t cmd)
 {
-	uint8_t        rlen[4] = { 0 };
-	uint32_t       prop_len;
-	struct pos_buf buf     = { .curpos = &rlen[0],
-                .endpos                = &rlen[sizeof(rlen)] };
-
-	prop_len = get_properties_len(prop, cmd);
 	if (cmd == CMD_CONNACK)
-	// return 3 available flag by default, costs 6 bytes
+		// return 3 available flag by default, costs 6 bytes
 		prop_len += 6;
 
-	int bytes    = write_variable_length_value(prop_len, &buf);
-
-	if (bytes < 0)
+	if (write_variable_length_value(prop_len, buf) < 0)
 		return -1;
 
-	nni_msg_append(msg, rlen, bytes);
 	if (prop_len == 0) {
 		return 0;
 	}
@@ -4216,12 +4483,12 @@ encode_properties(nni_msg *msg, property *prop, uint8_t cmd)
 	}
 	if (cmd == CMD_CONNACK) {
 		uint8_t var = 0x01;
-		nni_mqtt_msg_append_u8(msg, SHARED_SUBSCRIPTION_AVAILABLE);
-		nni_mqtt_msg_append_u8(msg, var);
-		nni_mqtt_msg_append_u8(msg, SUBSCRIPTION_IDENTIFIER_AVAILABLE);
-		nni_mqtt_msg_append_u8(msg, var);
-		nni_mqtt_msg_append_u8(msg, WILDCARD_SUBSCRIPTION_AVAILABLE);
-		nni_mqtt_msg_append_u8(msg, var);
+		write_byte(SHARED_SUBSCRIPTION_AVAILABLE, buf);
+		write_byte(var, buf);
+		write_byte(SUBSCRIPTION_IDENTIFIER_AVAILABLE, buf);
+		write_byte(var, buf);
+		write_byte(WILDCARD_SUBSCRIPTION_AVAILABLE, buf);
+		write_byte(var, buf);
 	}
 	if (prop == NULL)
 		return 0;
@@ -4241,38 +4508,34 @@ encode_properties(nni_msg *msg, property *prop, uint8_t cmd)
 				// Response Information
 			    p->id != SERVER_KEEP_ALIVE)
 				continue;
-		nni_mqtt_msg_append_u8(msg, p->id);
+		write_byte(p->id, buf);
 		property_type_enum type = property_get_value_type(p->id);
 		switch (type) {
 		case U8:
-			nni_mqtt_msg_append_u8(msg, p->data.p_value.u8);
+			write_byte(p->data.p_value.u8, buf);
 			break;
 		case U16:
 			if (p->id == TOPIC_ALIAS_MAXIMUM)
-				nni_mqtt_msg_append_u16(msg, 0xFFFF);
+				write_uint16(0xFFFF, buf);
 			else
-				nni_mqtt_msg_append_u16(msg, p->data.p_value.u16);
+				write_uint16(p->data.p_value.u16, buf);
 			break;
 		case U32:
-			nni_mqtt_msg_append_u32(msg, p->data.p_value.u32);
+			write_uint32(p->data.p_value.u32, buf);
 			break;
 		case VARINT:
-			nni_mqtt_msg_append_varint(
-			    msg, p->data.p_value.varint);
+			write_variable_length_value(
+			    p->data.p_value.varint, buf);
 			break;
 		case BINARY:
-			nni_mqtt_msg_append_byte_str(
-			    msg, &p->data.p_value.binary);
+			write_byte_string(&p->data.p_value.binary, buf);
 			break;
 		case STR:
-			nni_mqtt_msg_append_byte_str(
-			    msg, &p->data.p_value.str);
+			write_byte_string(&p->data.p_value.str, buf);
 			break;
 		case STR_PAIR:
-			nni_mqtt_msg_append_byte_str(
-			    msg, &p->data.p_value.strpair.key);
-			nni_mqtt_msg_append_byte_str(
-			    msg, &p->data.p_value.strpair.value);
+			write_byte_string(&p->data.p_value.strpair.key, buf);
+			write_byte_string(&p->data.p_value.strpair.value, buf);
 			break;
 
 		default:
@@ -4283,6 +4546,33 @@ encode_properties(nni_msg *msg, property *prop, uint8_t cmd)
 	return 0;
 }
 
+// Size of the properties on the wire, their length included
+static uint32_t
+encode_properties_size(property *prop, uint8_t cmd)
+{
+	uint32_t prop_len = get_properties_len(prop, cmd);
+
+	if (cmd == CMD_CONNACK)
+		prop_len += 6;
+	return byte_number_for_variable_length(prop_len) + prop_len;
+}
+
+int
+encode_properties(nni_msg *msg, property *prop, uint8_t cmd)
+{
+	uint32_t       prop_len = get_properties_len(prop, cmd);
+	size_t         len      = nni_msg_len(msg);
+	struct pos_buf buf;
+
+	if (nni_msg_realloc(msg, len + encode_properties_size(prop, cmd)) !=
+	    0) {
+		return -1;
+	}
+	buf.curpos = (uint8_t *) nni_msg_body(msg) + len;
+	buf.endpos = (uint8_t *) nni_msg_body(msg) + nni_msg_len(msg);
+	return encode_properties_buf(&buf, prop, prop_len, cmd);
+}
+
 /* introduced from mqtt_parser, might be duplicated */
 
 /**
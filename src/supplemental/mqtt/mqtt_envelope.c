@@ -0,0 +1,215 @@
+//
+// Copyright 2024 NanoMQ Team, Inc. <jaylin@emqx.io>
+//
+// This software is supplied under the terms of the MIT License, a
+// copy of which should be located in the distribution where this
+// file was obtained (LICENSE.txt).  A copy of the license may also be
+// found online at https://opensource.org/licenses/MIT.
+//
+
+#include <string.h>
+
+#include "mqtt_msg.h"
+#include "nng/protocol/mqtt/mqtt_parser.h"
+#include "nng/supplemental/nanolib/conf.h"
+
+#if defined(NNG_SUPP_ZLIB)
+#include <zlib.h>
+#endif
+
+// An envelope is the payload of a single PUBLISH carrying many QoS 0
+// msgs. It starts with a header:
+//
+//   'N' 'E' | version | codec | count (u32) | length of records (u32)
+//
+// followed by the records, compressed as a whole by the codec. A record
+// is a msg:
+//
+//   flags (bit 0: retain) | topic length (u16) | topic |
+//   payload length (u32) | payload
+
+#define ENVELOPE_VERSION 1
+#define ENVELOPE_HDR_LEN 12
+#define ENVELOPE_REC_MIN 8 // a record with one byte of topic
+
+bool
+nni_mqtt_envelope_topic(const char *topic, size_t len)
+{
+	size_t n = strlen(NNI_MQTT_ENVELOPE_TOPIC);
+
+	return (len > n && memcmp(topic, NNI_MQTT_ENVELOPE_TOPIC, n) == 0);
+}
+
+int
+nni_mqtt_envelope_add(nni_msg *records, const char *topic, uint16_t tlen,
+    const uint8_t *payload, uint32_t plen, bool retain)
+{
+	uint8_t hdr[3];
+	uint8_t len[4];
+
+	hdr[0] = retain ? 1 : 0;
+	NNI_PUT16(hdr + 1, tlen);
+	NNI_PUT32(len, plen);
+	if (nni_msg_append(records, hdr, sizeof(hdr)) != 0 ||
+	    nni_msg_append(records, topic, tlen) != 0 ||
+	    nni_msg_append(records, len, sizeof(len)) != 0 ||
+	    nni_msg_append(records, payload, plen) != 0) {
+		return (MQTT_ERR_NOMEM);
+	}
+	return (MQTT_SUCCESS);
+}
+
+int
+nni_mqtt_envelope_seal(
+    nni_msg *records, uint32_t count, uint8_t codec, nni_msg *msg)
+{
+	uint8_t *raw    = nni_msg_body(records);
+	size_t   rawlen = nni_msg_len(records);
+	uint8_t *buf    = NULL;
+	size_t   cap    = 0;
+	size_t   len    = rawlen;
+	int      rv;
+
+#if defined(NNG_SUPP_ZLIB)
+	if (codec == ENVELOPE_CODEC_ZLIB) {
+		uLongf zlen = compressBound(rawlen);
+		cap         = ENVELOPE_HDR_LEN + zlen;
+		if ((buf = nni_alloc(cap)) == NULL) {
+			return (MQTT_ERR_NOMEM);
+		}
+		if (compress2(buf + ENVELOPE_HDR_LEN, &zlen, raw, rawlen,
+		        Z_DEFAULT_COMPRESSION) == Z_OK &&
+		    zlen < rawlen) {
+			len = zlen;
+		} else {
+			// not worth it, send the records as they are
+			nni_free(buf, cap);
+			buf = NULL;
+		}
+	}
+#endif
+	if (buf == NULL) {
+		codec = ENVELOPE_CODEC_NONE;
+		cap   = ENVELOPE_HDR_LEN + rawlen;
+		if ((buf = nni_alloc(cap)) == NULL) {
+			return (MQTT_ERR_NOMEM);
+		}
+		memcpy(buf + ENVELOPE_HDR_LEN, raw, rawlen);
+	}
+	buf[0] = 'N';
+	buf[1] = 'E';
+	buf[2] = ENVELOPE_VERSION;
+	buf[3] = codec;
+	NNI_PUT32(buf + 4, count);
+	NNI_PUT32(buf + 8, (uint32_t) rawlen);
+
+	rv = nni_mqtt_msg_set_publish_payload(
+	    msg, buf, (uint32_t) (ENVELOPE_HDR_LEN + len));
+	nni_free(buf, cap);
+	return (rv == 0 ? MQTT_SUCCESS : MQTT_ERR_NOMEM);
+}
+
+// Walks the records, with cb NULL only checking them.  The topic of each
+// must be one a PUBLISH could carry.
+static int
+envelope_records(const uint8_t *pos, const uint8_t *end, uint32_t count,
+    nni_mqtt_envelope_cb cb, void *arg)
+{
+	int rv = MQTT_SUCCESS;
+
+	for (uint32_t i = 0; i < count && rv == MQTT_SUCCESS; i++) {
+		uint16_t tlen;
+		uint32_t plen;
+		bool     retain;
+		if (end - pos < 3) {
+			return (MQTT_ERR_MALFORMED);
+		}
+		retain = (pos[0] & 1) != 0;
+		NNI_GET16(pos + 1, tlen);
+		pos += 3;
+		if (end - pos < (ptrdiff_t) tlen + 4) {
+			return (MQTT_ERR_MALFORMED);
+		}
+		NNI_GET32(pos + tlen, plen);
+		if ((size_t) (end - pos) - tlen - 4 < plen) {
+			return (MQTT_ERR_MALFORMED);
+		}
+		if (cb == NULL) {
+			if (!topic_name_valid((const char *) pos, tlen)) {
+				return (MQTT_ERR_PROTOCOL);
+			}
+		} else {
+			rv = cb(arg, (const char *) pos, tlen, pos + tlen + 4,
+			    plen, retain);
+		}
+		pos += tlen + 4 + plen;
+	}
+	if (rv == MQTT_SUCCESS && pos != end) {
+		rv = MQTT_ERR_MALFORMED;
+	}
+	return (rv);
+}
+
+// The records are checked as a whole before any of them is handed to cb,
+// and an envelope declaring more than max_len bytes of records or more
+// than max_count of them is not opened at all.
+int
+nni_mqtt_envelope_open(const uint8_t *payload, size_t len, uint32_t max_len,
+    uint32_t max_count, nni_mqtt_envelope_cb cb, void *arg)
+{
+	uint32_t       count;
+	uint32_t       rawlen;
+	uint8_t       *buf = NULL;
+	const uint8_t *pos;
+	int            rv;
+
+	if (len < ENVELOPE_HDR_LEN || payload[0] != 'N' ||
+	    payload[1] != 'E' || payload[2] != ENVELOPE_VERSION) {
+		return (MQTT_ERR_MALFORMED);
+	}
+	NNI_GET32(payload + 4, count);
+	NNI_GET32(payload + 8, rawlen);
+	if (rawlen > max_len || rawlen > MQTT_MAX_MSG_LEN ||
+	    count > max_count) {
+		return (MQTT_ERR_PAYLOAD_SIZE);
+	}
+	if (count > rawlen / ENVELOPE_REC_MIN) {
+		return (MQTT_ERR_MALFORMED);
+	}
+
+	switch (payload[3]) {
+	case ENVELOPE_CODEC_NONE:
+		if (rawlen != len - ENVELOPE_HDR_LEN) {
+			return (MQTT_ERR_MALFORMED);
+		}
+		pos = payload + ENVELOPE_HDR_LEN;
+		break;
+#if defined(NNG_SUPP_ZLIB)
+	case ENVELOPE_CODEC_ZLIB: {
+		uLongf zlen = rawlen;
+		if (rawlen > 0 && (buf = nni_alloc(rawlen)) == NULL) {
+			return (MQTT_ERR_NOMEM);
+		}
+		if (uncompress(buf, &zlen, payload + ENVELOPE_HDR_LEN,
+		        len - ENVELOPE_HDR_LEN) != Z_OK ||
+		    zlen != rawlen) {
+			nni_free(buf, rawlen);
+			return (MQTT_ERR_MALFORMED);
+		}
+		pos = buf;
+		break;
+	}
+#endif
+	default:
+		return (MQTT_ERR_NOT_SUPPORTED);
+	}
+
+	if ((rv = envelope_records(pos, pos + rawlen, count, NULL, NULL)) ==
+	    MQTT_SUCCESS) {
+		rv = envelope_records(pos, pos + rawlen, count, cb, arg);
+	}
+	if (buf != NULL) {
+		nni_free(buf, rawlen);
+	}
+	return (rv);
+}
@@ -156,6 +156,7 @@ property *
 nni_mqtt_msg_get_publish_property(nng_msg *msg)
 {
 	nni_mqtt_proto_data *mqtt = nni_msg_get_proto_data(msg);
+	nni_mqttv5_msg_decode_properties(msg);
 	return mqtt->var_header.publish.properties;
 }
 
@@ -163,6 +164,7 @@ void
 nni_mqtt_msg_set_publish_property(nng_msg *msg, property *prop)
 {
 	nni_mqtt_proto_data *mqtt = nni_msg_get_proto_data(msg);
+	mqtt->is_lazy = false;
 	mqtt->var_header.publish.properties = prop;
 }
 
@@ -235,6 +237,8 @@ const char *
 nni_mqtt_msg_get_publish_topic(nni_msg *msg, uint32_t *topic_len)
 {
 	nni_mqtt_proto_data *proto_data = nni_msg_get_proto_data(msg);
+
+	nni_mqtt_msg_publish_rebase(msg);
 	*topic_len = proto_data->var_header.publish.topic_name.length;
 	return (const char *) proto_data->var_header.publish.topic_name.buf;
 }
@@ -251,6 +255,8 @@ uint8_t *
 nni_mqtt_msg_get_publish_payload(nni_msg *msg, uint32_t *outlen)
 {
 	nni_mqtt_proto_data *proto_data = nni_msg_get_proto_data(msg);
+
+	nni_mqtt_msg_publish_rebase(msg);
 	*outlen = proto_data->payload.publish.payload.length;
 	return proto_data->payload.publish.payload.buf;
 }
@@ -102,6 +102,7 @@ typedef struct mqtt_connack_vhdr_t {
 typedef struct mqtt_publish_vhdr_t {
 	mqtt_buf  topic_name;
 	uint16_t  packet_id;
+	uint32_t  prop_pos; /* offset of the property length in the body */
 	property *properties;
 } mqtt_publish_vhdr;
 
@@ -274,7 +275,8 @@ typedef struct mqtt_msg_t {
 	// is_copied is for bridging(if true needs free)
 	bool is_copied : 1;  /* indicates string or array members are copied */
 	bool initialized : 1; /* message is decoded or encoded*/
-	uint8_t _unused : 1;
+	bool is_lazy : 1;     /* properties are still only in the body */
+	uint8_t *view_body;   /* body the decoded PUBLISH points into */
 } mqtt_msg;
 
 NNG_DECL int mqtt_get_remaining_length(
@@ -327,9 +329,28 @@ NNG_DECL int nni_mqtt_msg_alloc(nni_msg **, size_t);
 NNG_DECL int nni_mqtt_msg_encode(nni_msg *);
 NNG_DECL int nni_mqtt_msg_decode(nni_msg *);
 
-// mqtt message encode/decode for v5
+// mqtt message encode/decode for v5. The properties of a PUBLISH are left
+// in the body by decode, they are parsed by the first property getter or
+// all at once by decode_full.
 NNG_DECL int nni_mqttv5_msg_encode(nni_msg *);
 NNG_DECL int nni_mqttv5_msg_decode(nni_msg *);
+NNG_DECL int nni_mqttv5_msg_decode_full(nni_msg *);
+NNG_DECL int nni_mqttv5_msg_decode_properties(nni_msg *);
+NNG_DECL void nni_mqtt_msg_publish_rebase(nni_msg *);
+
+// mqtt envelope, many QoS 0 msgs in the payload of one PUBLISH sent to
+// NNI_MQTT_ENVELOPE_TOPIC followed by the topic prefix they share.
+#define NNI_MQTT_ENVELOPE_TOPIC "$envelope/"
+
+typedef int (*nni_mqtt_envelope_cb)(void *, const char *, uint16_t,
+    const uint8_t *, uint32_t, bool);
+
+NNG_DECL bool nni_mqtt_envelope_topic(const char *, size_t);
+NNG_DECL int  nni_mqtt_envelope_add(
+     nni_msg *, const char *, uint16_t, const uint8_t *, uint32_t, bool);
+NNG_DECL int  nni_mqtt_envelope_seal(nni_msg *, uint32_t, uint8_t, nni_msg *);
+NNG_DECL int  nni_mqtt_envelope_open(const uint8_t *, size_t, uint32_t,
+     uint32_t, nni_mqtt_envelope_cb, void *);
 
 NNG_DECL int nni_mqtt_msg_validate(nni_msg *, uint8_t);
 NNG_DECL int nni_mqtt_msg_packet_validate(uint8_t *, size_t, size_t, uint8_t);
@@ -497,6 +518,8 @@ NNG_DECL property *decode_buf_properties(uint8_t *packet, uint32_t packet_len,
     uint32_t *pos, uint32_t *len, bool copy_value);
 NNG_DECL property *decode_properties(
     nng_msg *msg, uint32_t *pos, uint32_t *len, bool copy_value);
+NNG_DECL int       property_scan(
+          uint8_t *props, uint32_t len, uint8_t prop_id, uint32_t *off);
 NNG_DECL int encode_properties(nng_msg *msg, property *prop, uint8_t cmd);
 
 NNG_DECL uint32_t  get_properties_len(property *prop, uint8_t cmd);
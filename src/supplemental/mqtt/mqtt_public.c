@@ -44,6 +44,12 @@ nng_mqttv5_msg_decode(nng_msg *msg)
 	return nni_mqttv5_msg_decode(msg);
 }
 
+int
+nng_mqttv5_msg_decode_full(nng_msg *msg)
+{
+	return nni_mqttv5_msg_decode_full(msg);
+}
+
 int
 nng_mqtt_msg_validate(nng_msg *msg, uint8_t proto_ver)
 {
@@ -1157,6 +1157,58 @@ nni_mqtt_qos_db_get_client_offline_msg(
 	return msg;
 }
 
+// Reads up to max offline messages with a row id above *cursor, oldest
+// first, and moves the cursor past them. Returns the number read.
+size_t
+nni_mqtt_qos_db_get_client_offline_msg_batch(sqlite3 *db, int64_t *cursor,
+    const char *config_name, nni_msg **msgs, int64_t *row_ids, size_t max)
+{
+	sqlite3_stmt *stmt;
+	size_t        n = 0;
+
+	char sql[] = "SELECT id, proto_ver, data FROM " table_client_offline_msg
+	             " WHERE info_id = (SELECT id FROM " table_client_info
+	             " WHERE config_name = ? LIMIT 1) AND id > ? "
+	             " ORDER BY id ASC LIMIT ? ";
+
+	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
+	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	sqlite3_reset(stmt);
+	sqlite3_bind_text(
+	    stmt, 1, config_name, strlen(config_name), SQLITE_TRANSIENT);
+	sqlite3_bind_int64(stmt, 2, *cursor);
+	sqlite3_bind_int64(stmt, 3, (sqlite3_int64) max);
+
+	while (n < max && SQLITE_ROW == sqlite3_step(stmt)) {
+		int64_t  row_id    = sqlite3_column_int64(stmt, 0);
+		uint8_t  proto_ver = sqlite3_column_int(stmt, 1);
+		size_t   nbyte     = (size_t) sqlite3_column_bytes(stmt, 2);
+		uint8_t *bytes     = sqlite3_malloc(nbyte);
+		nni_msg *msg;
+
+		*cursor = row_id;
+		if (bytes == NULL) {
+			break;
+		}
+		memcpy(bytes, sqlite3_column_blob(stmt, 2), nbyte);
+		// deserialize blob data to nni_msg
+		msg = nni_mqtt_msg_deserialize(bytes, nbyte, false, proto_ver);
+		sqlite3_free(bytes);
+		if (msg == NULL) {
+			log_warn("offline msg %lld is broken, skipped",
+			    (long long) row_id);
+			continue;
+		}
+		msgs[n]    = msg;
+		row_ids[n] = row_id;
+		n++;
+	}
+	sqlite3_finalize(stmt);
+	sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+
+	return n;
+}
+
 void
 nni_mqtt_qos_db_remove_oldest_client_offline_msg(
     sqlite3 *db, uint64_t limit, const char *config_name)
@@ -1181,6 +1233,24 @@ nni_mqtt_qos_db_remove_client_offline_msg(sqlite3 *db, int64_t row_id)
 	return sqlite3_exec(db, "COMMIT;", 0, 0, 0);
 }
 
+int
+nni_mqtt_qos_db_remove_client_offline_msg_batch(
+    sqlite3 *db, int64_t *row_ids, size_t n)
+{
+	sqlite3_stmt *stmt;
+	char sql[] = "DELETE FROM " table_client_offline_msg " WHERE id = ?";
+	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
+	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	for (size_t i = 0; i < n; i++) {
+		sqlite3_reset(stmt);
+		sqlite3_bind_int64(stmt, 1, row_ids[i]);
+		sqlite3_step(stmt);
+	}
+	sqlite3_finalize(stmt);
+
+	return sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+}
+
 int
 nni_mqtt_qos_db_remove_all_client_offline_msg(sqlite3 *db, const char *config_name)
 {
@@ -1449,6 +1519,48 @@ out:
 	return NULL;
 }
 
+static void
+replay_init(nni_mqtt_replay *r, conf_sqlite *conf)
+{
+	size_t window = conf->replay_window > 0 ? conf->replay_window : 1;
+
+	memset(r, 0, sizeof(*r));
+	r->msgs  = nni_zalloc(window * sizeof(nni_msg *));
+	r->rows  = nni_zalloc(window * sizeof(int64_t));
+	r->batch = conf->replay_batch > 0 ? conf->replay_batch : 1;
+	r->acked = nni_zalloc(r->batch * sizeof(int64_t));
+	if (r->msgs == NULL || r->rows == NULL || r->acked == NULL) {
+		log_error("no memory for offline msg replay");
+		nni_free(r->msgs, window * sizeof(nni_msg *));
+		nni_free(r->rows, window * sizeof(int64_t));
+		nni_free(r->acked, r->batch * sizeof(int64_t));
+		memset(r, 0, sizeof(*r));
+		return;
+	}
+	r->cap        = window;
+	r->live_share = conf->replay_live_share > 100
+	    ? 100
+	    : (uint8_t) conf->replay_live_share;
+}
+
+static void
+replay_fini(nni_mqtt_replay *r, sqlite3 *db)
+{
+	if (r->nacked > 0) {
+		nni_mqtt_qos_db_remove_client_offline_msg_batch(
+		    db, r->acked, r->nacked);
+	}
+	for (; r->len > 0; r->len--) {
+		nni_msg_free(r->msgs[r->head++]);
+	}
+	if (r->cap > 0) {
+		nni_free(r->msgs, r->cap * sizeof(nni_msg *));
+		nni_free(r->rows, r->cap * sizeof(int64_t));
+		nni_free(r->acked, r->batch * sizeof(int64_t));
+	}
+	memset(r, 0, sizeof(*r));
+}
+
 void
 nni_mqtt_sqlite_db_init(nng_mqtt_sqlite_option *opt, const char *db_name)
 {
@@ -1461,6 +1573,7 @@ nni_mqtt_sqlite_db_init(nng_mqtt_sqlite_option *opt, const char *db_name)
 		    opt->bridge->sqlite->mounted_file_path, db_name, false);
 		nni_mqtt_qos_db_set_client_info(opt->db, opt->bridge->name,
 		    NULL, "MQTT", opt->bridge->proto_ver);
+		replay_init(&opt->replay, opt->bridge->sqlite);
 	}
 }
 
@@ -1470,6 +1583,7 @@ nni_mqtt_sqlite_db_fini(nni_mqtt_sqlite_option *sqlite_opt)
 	if (sqlite_opt != NULL && sqlite_opt->bridge != NULL &&
 	    sqlite_opt->bridge->sqlite->enable) {
 		nni_lmq_fini(&sqlite_opt->offline_cache);
+		replay_fini(&sqlite_opt->replay, sqlite_opt->db);
 		nni_strfree(sqlite_opt->db_name);
 		nni_mqtt_qos_db_close(sqlite_opt->db);
 	}
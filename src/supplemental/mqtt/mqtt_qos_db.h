@@ -69,6 +69,24 @@
 -------------------------------------------------------------------
 **/
 
+// Replay state of the offline table. Rows are read ahead in batches
+// following a cursor, and deleted in batches once they are sent.
+typedef struct {
+	nni_msg **msgs;       // rows read but not sent yet
+	int64_t  *rows;       // row id of each message in msgs
+	size_t    cap;        // window, rows read ahead at most
+	size_t    head;       // next one to send
+	size_t    len;        // left to send
+	int64_t   cursor;     // highest row id read so far
+	int64_t   inflight;   // row the pipe is sending, 0 for none
+	int64_t  *acked;      // rows sent, waiting to be deleted
+	size_t    nacked;
+	size_t    batch;      // rows deleted in one transaction
+	bool      drained;    // nothing left in the table
+	uint8_t   live_share; // percent of sends kept for live messages
+	uint8_t   turn;
+} nni_mqtt_replay;
+
 struct nng_mqtt_sqlite_option {
 #if defined(NNG_HAVE_MQTT_BROKER)
 	conf_bridge_node *bridge;
@@ -77,6 +95,7 @@ struct nng_mqtt_sqlite_option {
 #endif
 	char *  db_name;
 	nni_lmq offline_cache;
+	nni_mqtt_replay replay;
 #if defined(NNG_SUPP_SQLITE)
 	sqlite3 *db;
 #else
@@ -139,7 +158,11 @@ extern int nni_mqtt_qos_db_set_client_offline_msg(
 extern int nni_mqtt_qos_db_set_client_offline_msg_batch(
     sqlite3 *, nni_lmq *, const char *, uint8_t);
 extern nng_msg *nni_mqtt_qos_db_get_client_offline_msg(sqlite3 *, int64_t *,const char *);
+extern size_t nni_mqtt_qos_db_get_client_offline_msg_batch(
+    sqlite3 *, int64_t *, const char *, nni_msg **, int64_t *, size_t);
 extern int      nni_mqtt_qos_db_remove_client_offline_msg(sqlite3 *, int64_t);
+extern int      nni_mqtt_qos_db_remove_client_offline_msg_batch(
+         sqlite3 *, int64_t *, size_t);
 extern int      nni_mqtt_qos_db_remove_all_client_offline_msg(sqlite3 *,const char *);
 
 extern int nni_mqtt_qos_db_set_client_info(
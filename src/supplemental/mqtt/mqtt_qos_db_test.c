@@ -352,6 +352,68 @@ test_remove_oldest_client_offline_msg(void)
 	nni_mqtt_qos_db_close(db);
 }
 
+void
+test_batch_replay_client_offline_msg(void)
+{
+	sqlite3 *db = NULL;
+	nni_mqtt_qos_db_init(&db, NULL, test_db, false);
+	nni_mqtt_qos_db_remove_all_client_offline_msg(db, "emqx");
+
+	nni_lmq lmq;
+	nni_lmq_init(&lmq, 10);
+	for (int i = 0; i < 10; i++) {
+		nni_msg *msg;
+		nni_mqtt_msg_alloc(&msg, 0);
+		nni_mqtt_msg_set_packet_type(msg, NNG_MQTT_CONNECT);
+		nni_mqtt_msg_set_connect_proto_version(msg, 4);
+		nng_mqtt_msg_set_connect_keep_alive(msg, 60 + i);
+		nni_mqtt_msg_encode(msg);
+		nni_lmq_put(&lmq, msg);
+	}
+	TEST_CHECK(nni_mqtt_qos_db_set_client_offline_msg_batch(
+	               db, &lmq, "emqx", 4) == 0);
+	nni_lmq_fini(&lmq);
+
+	nni_msg *msgs[4];
+	int64_t  rows[12];
+	int64_t  cursor = 0;
+	size_t   total  = 0;
+	size_t   n;
+
+	// read in batches following the cursor, oldest first
+	while ((n = nni_mqtt_qos_db_get_client_offline_msg_batch(
+	            db, &cursor, "emqx", msgs, rows + total, 4)) > 0) {
+		TEST_CHECK(n == (total < 8 ? 4 : 2));
+		for (size_t i = 0; i < n; i++) {
+			TEST_CHECK(nni_mqtt_msg_get_connect_keep_alive(
+			               msgs[i]) == 60 + total + i);
+			nni_msg_free(msgs[i]);
+		}
+		total += n;
+		TEST_CHECK(cursor == rows[total - 1]);
+	}
+	TEST_CHECK(total == 10);
+
+	// rows stay until they are removed
+	cursor = 0;
+	total  = 0;
+	while ((n = nni_mqtt_qos_db_get_client_offline_msg_batch(
+	            db, &cursor, "emqx", msgs, rows + total, 4)) > 0) {
+		for (size_t i = 0; i < n; i++) {
+			nni_msg_free(msgs[i]);
+		}
+		total += n;
+	}
+	TEST_CHECK(total == 10);
+	TEST_CHECK(nni_mqtt_qos_db_remove_client_offline_msg_batch(
+	               db, rows, total) == 0);
+
+	cursor = 0;
+	TEST_CHECK(nni_mqtt_qos_db_get_client_offline_msg_batch(
+	               db, &cursor, "emqx", msgs, rows, 4) == 0);
+	nni_mqtt_qos_db_close(db);
+}
+
 void 
 test_set_retain_msg(void)
 {
@@ -443,5 +505,7 @@ TEST_LIST = {
 	    test_batch_insert_client_offline_msg },
 	{ "db_remove_oldest_client_offline_msg",
 	    test_remove_oldest_client_offline_msg },
+	{ "db_batch_replay_client_offline_msg",
+	    test_batch_replay_client_offline_msg },
 	{ NULL, NULL },
 };
\ No newline at end of file
@@ -1058,6 +1058,306 @@ test_decode_publish(void)
 	nng_msg_free(msg);
 }
 
+// Encodes a v5 PUBLISH with properties and copies it into a fresh message,
+// the way a transport hands it to the protocol.
+static nng_msg *
+publish_v5_wire(void)
+{
+	nng_msg *msg;
+	nng_msg *wire;
+
+	NUTS_PASS(nng_mqtt_msg_alloc(&msg, 0));
+	nng_mqtt_msg_set_packet_type(msg, NNG_MQTT_PUBLISH);
+	nng_mqtt_msg_set_publish_qos(msg, 1);
+	nni_mqtt_msg_set_publish_packet_id(msg, 7);
+	nng_mqtt_msg_set_publish_topic(msg, "/nanomq/lazy");
+	nng_mqtt_msg_set_publish_payload(msg, (uint8_t *) "hello", 5);
+
+	property *plist = mqtt_property_alloc();
+	mqtt_property_append(
+	    plist, mqtt_property_set_value_u32(MESSAGE_EXPIRY_INTERVAL, 60));
+	mqtt_property_append(plist,
+	    mqtt_property_set_value_str(
+	        CONTENT_TYPE, "text/plain", strlen("text/plain"), true));
+	nng_mqtt_msg_set_publish_property(msg, plist);
+	NUTS_PASS(nng_mqttv5_msg_encode(msg));
+
+	NUTS_PASS(nng_mqtt_msg_alloc(&wire, 0));
+	NUTS_PASS(nng_msg_header_append(
+	    wire, nng_msg_header(msg), nng_msg_header_len(msg)));
+	NUTS_PASS(nng_msg_append(wire, nng_msg_body(msg), nng_msg_len(msg)));
+	nng_msg_free(msg);
+	return (wire);
+}
+
+static void
+check_lazy_properties(property *p)
+{
+	property_data *pd;
+
+	NUTS_TRUE(p != NULL);
+	NUTS_TRUE((pd = mqtt_property_get_value(p, MESSAGE_EXPIRY_INTERVAL)) !=
+	    NULL);
+	NUTS_TRUE(pd->p_value.u32 == 60);
+	NUTS_TRUE((pd = mqtt_property_get_value(p, CONTENT_TYPE)) != NULL);
+	NUTS_TRUE(pd->p_value.str.length == strlen("text/plain"));
+	NUTS_TRUE(memcmp(pd->p_value.str.buf, "text/plain",
+	              pd->p_value.str.length) == 0);
+}
+
+void
+test_decode_publish_v5_lazy(void)
+{
+	nng_msg             *msg;
+	nng_msg             *dup;
+	nni_mqtt_proto_data *mqtt;
+	uint32_t             len;
+	const char          *topic;
+
+	msg = publish_v5_wire();
+	NUTS_PASS(nng_mqttv5_msg_decode(msg));
+	mqtt = nni_msg_get_proto_data(msg);
+	NUTS_TRUE(mqtt->is_lazy);
+	NUTS_NULL(mqtt->var_header.publish.properties);
+
+	// Topic, QoS and payload need no properties
+	NUTS_TRUE(nng_mqtt_msg_get_publish_qos(msg) == 1);
+	NUTS_TRUE(nni_mqtt_msg_get_publish_packet_id(msg) == 7);
+	topic = nng_mqtt_msg_get_publish_topic(msg, &len);
+	NUTS_TRUE(len == strlen("/nanomq/lazy"));
+	NUTS_TRUE(memcmp(topic, "/nanomq/lazy", len) == 0);
+	NUTS_TRUE(memcmp(nng_mqtt_msg_get_publish_payload(msg, &len),
+	              "hello", 5) == 0);
+	NUTS_TRUE(len == 5);
+	NUTS_TRUE(mqtt->is_lazy);
+
+	// A copy parses from its own body, after the original is gone
+	NUTS_PASS(nng_msg_dup(&dup, msg));
+	nng_msg_free(msg);
+	topic = nng_mqtt_msg_get_publish_topic(dup, &len);
+	NUTS_TRUE(len == strlen("/nanomq/lazy"));
+	NUTS_TRUE(memcmp(topic, "/nanomq/lazy", len) == 0);
+	NUTS_TRUE(nng_mqtt_msg_get_publish_payload(dup, &len) ==
+	    (uint8_t *) nng_msg_body(dup) + nng_msg_len(dup) - 5);
+	check_lazy_properties(nng_mqtt_msg_get_publish_property(dup));
+	mqtt = nni_msg_get_proto_data(dup);
+	NUTS_TRUE(!mqtt->is_lazy);
+
+	// Re-encoding keeps the properties
+	NUTS_PASS(nng_mqttv5_msg_encode(dup));
+	NUTS_PASS(nng_mqttv5_msg_decode_full(dup));
+	mqtt = nni_msg_get_proto_data(dup);
+	NUTS_TRUE(!mqtt->is_lazy);
+	check_lazy_properties(mqtt->var_header.publish.properties);
+	nng_msg_free(dup);
+
+	// Encoding a view that was never read must not lose them either
+	msg = publish_v5_wire();
+	NUTS_PASS(nng_mqttv5_msg_decode(msg));
+	NUTS_PASS(nng_mqttv5_msg_encode(msg));
+	NUTS_PASS(nng_mqttv5_msg_decode(msg));
+	check_lazy_properties(nng_mqtt_msg_get_publish_property(msg));
+	nng_msg_free(msg);
+}
+
+static void
+check_publish(nng_msg *msg, const char *topic, uint32_t payload_len)
+{
+	const char *t;
+	uint8_t    *payload;
+	uint32_t    len;
+
+	t = nng_mqtt_msg_get_publish_topic(msg, &len);
+	NUTS_TRUE(len == strlen(topic));
+	NUTS_TRUE(memcmp(t, topic, len) == 0);
+	payload = nng_mqtt_msg_get_publish_payload(msg, &len);
+	NUTS_TRUE(len == payload_len);
+	for (uint32_t i = 0; i < len; i++) {
+		NUTS_TRUE(payload[i] == (uint8_t) i);
+	}
+}
+
+void
+test_encode_publish_single_pass(void)
+{
+	nng_msg  *msg;
+	nng_msg  *wire;
+	uint8_t   payload[1000];
+	property *plist;
+
+	for (size_t i = 0; i < sizeof(payload); i++) {
+		payload[i] = (uint8_t) i;
+	}
+	NUTS_PASS(nng_mqtt_msg_alloc(&msg, 0));
+	nng_mqtt_msg_set_packet_type(msg, NNG_MQTT_PUBLISH);
+	nng_mqtt_msg_set_publish_qos(msg, 1);
+	nni_mqtt_msg_set_publish_packet_id(msg, 9);
+	nng_mqtt_msg_set_publish_topic(msg, "/nanomq/one/pass");
+	nng_mqtt_msg_set_publish_payload(msg, payload, sizeof(payload));
+	plist = mqtt_property_alloc();
+	mqtt_property_append(
+	    plist, mqtt_property_set_value_u32(MESSAGE_EXPIRY_INTERVAL, 60));
+	nng_mqtt_msg_set_publish_property(msg, plist);
+	NUTS_PASS(nng_mqttv5_msg_encode(msg));
+	// Sized up front, so exactly one body of the final size
+	NUTS_TRUE(nni_msg_capacity(msg) == nng_msg_len(msg));
+	NUTS_TRUE(nng_msg_len(msg) == 2 + 16 + 2 + 1 + 5 + sizeof(payload));
+
+	NUTS_PASS(nng_mqtt_msg_alloc(&wire, 0));
+	NUTS_PASS(nng_msg_header_append(
+	    wire, nng_msg_header(msg), nng_msg_header_len(msg)));
+	NUTS_PASS(nng_msg_append(wire, nng_msg_body(msg), nng_msg_len(msg)));
+	nng_msg_free(msg);
+
+	// Growing a decoded message moves its payload along with the body
+	NUTS_PASS(nng_mqttv5_msg_decode(wire));
+	plist = nng_mqtt_msg_get_publish_property(wire);
+	property_append(plist,
+	    property_set_value_strpair(USER_PROPERTY, "key", 3,
+	        "a value long enough to outgrow the body", 39, true));
+	NUTS_PASS(nng_mqttv5_msg_encode(wire));
+	NUTS_PASS(nng_mqttv5_msg_decode(wire));
+	check_publish(wire, "/nanomq/one/pass", sizeof(payload));
+	NUTS_TRUE(nni_mqtt_msg_get_publish_packet_id(wire) == 9);
+	plist = nng_mqtt_msg_get_publish_property(wire);
+	NUTS_TRUE(property_get_value(plist, USER_PROPERTY) != NULL);
+
+	// And shrinking it moves the payload back
+	property_remove(plist, USER_PROPERTY);
+	property_remove(plist, MESSAGE_EXPIRY_INTERVAL);
+	NUTS_PASS(nng_mqttv5_msg_encode(wire));
+	NUTS_TRUE(nng_msg_len(wire) == 2 + 16 + 2 + 1 + sizeof(payload));
+	NUTS_PASS(nng_mqttv5_msg_decode(wire));
+	check_publish(wire, "/nanomq/one/pass", sizeof(payload));
+	NUTS_NULL(nng_mqtt_msg_get_publish_property(wire));
+	nng_msg_free(wire);
+}
+
+void
+test_decode_publish_v5_malformed(void)
+{
+	nng_msg *msg;
+	// Property length 0x20 runs past the end of the packet
+	uint8_t publish[] = { 0x30, 0x07, 0x00, 0x01, 0x61, 0x20, 0x01, 0x00,
+		0x68 };
+
+	NUTS_PASS(nng_mqtt_msg_alloc(&msg, 0));
+	NUTS_PASS(nng_msg_header_append(msg, publish, 2));
+	NUTS_PASS(nng_msg_append(msg, publish + 2, sizeof(publish) - 2));
+	NUTS_FAIL(nng_mqttv5_msg_decode(msg), MQTT_ERR_PROTOCOL);
+	nng_msg_free(msg);
+}
+
+typedef struct {
+	int  count;
+	char topics[3][16];
+	char payloads[3][16];
+	bool retain[3];
+} envelope_result;
+
+static int
+envelope_record(void *arg, const char *topic, uint16_t tlen,
+    const uint8_t *payload, uint32_t plen, bool retain)
+{
+	envelope_result *res = arg;
+
+	NUTS_ASSERT(res->count < 3);
+	memcpy(res->topics[res->count], topic, tlen);
+	memcpy(res->payloads[res->count], payload, plen);
+	res->retain[res->count] = retain;
+	res->count++;
+	return (MQTT_SUCCESS);
+}
+
+void
+test_envelope(void)
+{
+	nng_msg        *records;
+	nng_msg        *msg;
+	uint8_t        *payload;
+	uint32_t        len;
+	envelope_result res;
+
+	memset(&res, 0, sizeof(res));
+	NUTS_TRUE(nni_mqtt_envelope_topic("$envelope/a", 11));
+	NUTS_TRUE(!nni_mqtt_envelope_topic("$envelope/", 10));
+	NUTS_TRUE(!nni_mqtt_envelope_topic("a/b", 3));
+
+	NUTS_PASS(nng_msg_alloc(&records, 0));
+	NUTS_PASS(nni_mqtt_envelope_add(
+	    records, "a/1", 3, (uint8_t *) "one", 3, false));
+	NUTS_PASS(nni_mqtt_envelope_add(records, "a/2", 3, NULL, 0, true));
+	NUTS_PASS(nni_mqtt_envelope_add(
+	    records, "a/3", 3, (uint8_t *) "three", 5, false));
+
+	NUTS_PASS(nng_mqtt_msg_alloc(&msg, 0));
+	nng_mqtt_msg_set_packet_type(msg, NNG_MQTT_PUBLISH);
+	NUTS_PASS(nni_mqtt_envelope_seal(records, 3, 0, msg));
+	payload = nng_mqtt_msg_get_publish_payload(msg, &len);
+
+	NUTS_PASS(nni_mqtt_envelope_open(
+	    payload, len, 1024, 16, envelope_record, &res));
+	NUTS_TRUE(res.count == 3);
+	NUTS_MATCH(res.topics[0], "a/1");
+	NUTS_MATCH(res.payloads[0], "one");
+	NUTS_TRUE(!res.retain[0]);
+	NUTS_MATCH(res.topics[1], "a/2");
+	NUTS_MATCH(res.payloads[1], "");
+	NUTS_TRUE(res.retain[1]);
+	NUTS_MATCH(res.topics[2], "a/3");
+	NUTS_MATCH(res.payloads[2], "three");
+
+	// more records or bytes of them than allowed
+	res.count = 0;
+	NUTS_FAIL(nni_mqtt_envelope_open(
+	              payload, len, 1024, 2, envelope_record, &res),
+	    MQTT_ERR_PAYLOAD_SIZE);
+	NUTS_FAIL(nni_mqtt_envelope_open(payload, len, len - 13, 16,
+	              envelope_record, &res),
+	    MQTT_ERR_PAYLOAD_SIZE);
+	// cut short, the last record runs past the end
+	NUTS_FAIL(nni_mqtt_envelope_open(
+	              payload, len - 1, 1024, 16, envelope_record, &res),
+	    MQTT_ERR_MALFORMED);
+	NUTS_TRUE(res.count == 0);
+	payload[3] = 0x7f;
+	NUTS_FAIL(nni_mqtt_envelope_open(
+	              payload, len, 1024, 16, envelope_record, &res),
+	    MQTT_ERR_NOT_SUPPORTED);
+	nng_msg_free(records);
+	nng_msg_free(msg);
+
+	// a topic no PUBLISH may carry spoils the whole envelope
+	NUTS_PASS(nng_msg_alloc(&records, 0));
+	NUTS_PASS(nni_mqtt_envelope_add(
+	    records, "a/1", 3, (uint8_t *) "one", 3, false));
+	NUTS_PASS(nni_mqtt_envelope_add(
+	    records, "a/+", 3, (uint8_t *) "two", 3, false));
+	NUTS_PASS(nng_mqtt_msg_alloc(&msg, 0));
+	nng_mqtt_msg_set_packet_type(msg, NNG_MQTT_PUBLISH);
+	NUTS_PASS(nni_mqtt_envelope_seal(records, 2, 0, msg));
+	payload = nng_mqtt_msg_get_publish_payload(msg, &len);
+	NUTS_FAIL(nni_mqtt_envelope_open(
+	              payload, len, 1024, 16, envelope_record, &res),
+	    MQTT_ERR_PROTOCOL);
+	NUTS_TRUE(res.count == 0);
+	nng_msg_free(records);
+	nng_msg_free(msg);
+
+	NUTS_PASS(nng_msg_alloc(&records, 0));
+	NUTS_PASS(nni_mqtt_envelope_add(
+	    records, "", 0, (uint8_t *) "one", 3, false));
+	NUTS_PASS(nng_mqtt_msg_alloc(&msg, 0));
+	nng_mqtt_msg_set_packet_type(msg, NNG_MQTT_PUBLISH);
+	NUTS_PASS(nni_mqtt_envelope_seal(records, 1, 0, msg));
+	payload = nng_mqtt_msg_get_publish_payload(msg, &len);
+	NUTS_FAIL(nni_mqtt_envelope_open(
+	              payload, len, 1024, 16, envelope_record, &res),
+	    MQTT_ERR_PROTOCOL);
+	nng_msg_free(records);
+	nng_msg_free(msg);
+}
+
 void
 test_decode_puback(void)
 {
@@ -1498,6 +1798,84 @@ test_property_cb(property *prop)
 	return;
 }
 
+void
+test_property_arena(void)
+{
+	uint8_t block[] = { 0x1e, 0x02, 0x00, 0x00, 0x00, 0x3c, 0x03, 0x00,
+		0x03, 't', 'x', 't', 0x26, 0x00, 0x01, 'k', 0x00, 0x01, 'v',
+		0x26, 0x00, 0x02, 'k', '2', 0x00, 0x02, 'v', '2', 0x23, 0x00,
+		0x05 };
+	uint32_t       pos = 0;
+	uint32_t       len = 0;
+	property      *plist;
+	property_data *pd;
+
+	plist = decode_buf_properties(block, sizeof(block), &pos, &len, true);
+	NUTS_TRUE(plist != NULL);
+	NUTS_TRUE(pos == sizeof(block));
+	NUTS_TRUE(len == sizeof(block) - 1);
+	NUTS_TRUE(check_properties(plist, NULL) == SUCCESS);
+
+	NUTS_TRUE((pd = property_get_value(plist, MESSAGE_EXPIRY_INTERVAL)) !=
+	    NULL);
+	NUTS_TRUE(pd->p_value.u32 == 60);
+	NUTS_TRUE((pd = property_get_value(plist, CONTENT_TYPE)) != NULL);
+	NUTS_TRUE(pd->p_value.str.length == 3);
+	NUTS_TRUE(memcmp(pd->p_value.str.buf, "txt", 3) == 0);
+	// Copied values live in the arena, not in the packet
+	NUTS_TRUE(pd->p_value.str.buf != &block[9]);
+	NUTS_TRUE((pd = property_get_value(plist, TOPIC_ALIAS)) != NULL);
+	NUTS_TRUE(pd->p_value.u16 == 5);
+	NUTS_TRUE((pd = property_get_value(plist, USER_PROPERTY)) != NULL);
+	NUTS_TRUE(memcmp(pd->p_value.strpair.key.buf, "k", 1) == 0);
+	NUTS_NULL(property_get_value(plist, RESPONSE_TOPIC));
+
+	// Edits of the list keep the index right
+	property_remove(plist, USER_PROPERTY);
+	NUTS_TRUE((pd = property_get_value(plist, USER_PROPERTY)) != NULL);
+	NUTS_TRUE(memcmp(pd->p_value.strpair.key.buf, "k2", 2) == 0);
+	property_remove(plist, MESSAGE_EXPIRY_INTERVAL);
+	NUTS_NULL(property_get_value(plist, MESSAGE_EXPIRY_INTERVAL));
+	property_append(plist,
+	    property_set_value_str(
+	        RESPONSE_TOPIC, "a/b", strlen("a/b"), true));
+	property_append(
+	    plist, property_set_value_u32(MESSAGE_EXPIRY_INTERVAL, 10));
+	NUTS_TRUE((pd = property_get_value(plist, MESSAGE_EXPIRY_INTERVAL)) !=
+	    NULL);
+	NUTS_TRUE(pd->p_value.u32 == 10);
+	NUTS_TRUE((pd = property_get_value(plist, RESPONSE_TOPIC)) != NULL);
+	NUTS_TRUE(pd->p_value.str.length == 3);
+	property_remove(plist, RESPONSE_TOPIC);
+	NUTS_NULL(property_get_value(plist, RESPONSE_TOPIC));
+
+	property *dup = NULL;
+	NUTS_PASS(property_dup(&dup, plist));
+	NUTS_TRUE(get_properties_len(dup, 0) == get_properties_len(plist, 0));
+	property_free(dup);
+	property_free(plist);
+
+	// Without copies the values point into the packet
+	pos   = 0;
+	plist = decode_buf_properties(block, sizeof(block), &pos, &len, false);
+	NUTS_TRUE((pd = property_get_value(plist, CONTENT_TYPE)) != NULL);
+	NUTS_TRUE(pd->p_value.str.buf == &block[9]);
+	property_free(plist);
+
+	// Repeated ids other than user properties are refused
+	uint8_t twice[] = { 0x06, 0x23, 0x00, 0x05, 0x23, 0x00, 0x06 };
+	pos             = 0;
+	plist = decode_buf_properties(twice, sizeof(twice), &pos, &len, true);
+	NUTS_TRUE(check_properties(plist, NULL) == PROTOCOL_ERROR);
+	property_free(plist);
+
+	// A value running past the block makes it malformed
+	uint8_t truncated[] = { 0x03, 0x02, 0x00, 0x00, 0x00, 0x3c };
+	pos                 = 0;
+	NUTS_NULL(decode_buf_properties(
+	    truncated, sizeof(truncated), &pos, &len, true));
+}
+
 void
 test_property_api(void)
 {
@@ -1597,6 +1975,7 @@ TEST_LIST = {
 	{ "encode suback v5", test_encode_suback_v5 },
 	{ "encode publish", test_encode_publish },
 	{ "encode publish v5", test_encode_publish_v5 },
+	{ "encode publish single pass", test_encode_publish_single_pass },
 	{ "encode puback", test_encode_puback },
 	{ "encode puback v5", test_encode_puback_v5 },
 	{ "encode pubrec", test_encode_pubrec },
@@ -1615,6 +1994,9 @@ TEST_LIST = {
 	{ "decode subscribe v5", test_decode_subscribe_v5 },
 	{ "decode suback", test_decode_suback },
 	{ "decode publish", test_decode_publish },
+	{ "decode publish v5 lazy", test_decode_publish_v5_lazy },
+	{ "decode publish v5 malformed", test_decode_publish_v5_malformed },
+	{ "envelope", test_envelope },
 	{ "decode puback", test_decode_puback },
 	{ "decode puback v5", test_decode_puback_v5 },
 	{ "decode unsubscribe", test_decode_unsubscribe },
@@ -1630,5 +2012,6 @@ TEST_LIST = {
 	{ "test topic_qos create & free", test_topic_qos_array_create_free },
 	{ "test topic create & free", test_topic_array_create_free },
 	{ "test property api", test_property_api },
+	{ "test property arena", test_property_arena },
 	{ NULL, NULL },
 };
\ No newline at end of file
@@ -14,8 +14,8 @@
 #include <iomanip>
 #include <iostream>
 #include <locale>
-#include <sstream>
 #include <string>
+#include <strings.h>
 #include <sys/stat.h>
 #include <thread>
 #include <vector>
@@ -36,19 +36,6 @@ static conf_blf *g_conf = NULL;
 
 #define FREE_IF_NOT_NULL(free, size) DO_IT_IF_NOT_NULL(nng_free, free, size)
 
-#define json_read_num(structure, field, key, jso)                             \
-	do {                                                                  \
-		cJSON *jso_key = cJSON_GetObjectItem(jso, key);               \
-		if (NULL == jso_key) {                                        \
-			log_debug("Config %s is not set, use default!", key); \
-			break;                                                \
-		}                                                             \
-		if (cJSON_IsNumber(jso_key)) {                                \
-			if (jso_key->valuedouble > 0)                         \
-				(structure)->field = jso_key->valuedouble;    \
-		}                                                             \
-	} while (0);
-
 CircularQueue   blf_queue;
 CircularQueue   blf_file_queue;
 pthread_mutex_t blf_queue_mutex     = PTHREAD_MUTEX_INITIALIZER;
@@ -194,36 +181,116 @@ update_blf_file_ranges(conf_blf *conf, blf_object *elem, blf_file_range *range)
 	}
 }
 
-void
-read_binary_data(const std::string &inputString, unsigned int inputSize,
-    array<uint8_t, 8> &data)
+static inline uint8_t
+hex_nibble(char c)
+{
+	// '0'-'9' have bit 6 clear, 'a'-'f' and 'A'-'F' have it set
+	return (c & 0x0F) + 9 * ((c >> 6) & 0x01);
+}
+
+// Decode the hex string of a frame, 8 characters at a time on little
+// endian hosts (the nibbles of one u64 are computed and packed in place).
+static void
+read_binary_data(const char *hex, size_t len, array<uint8_t, 8> &data)
 {
-	std::vector<unsigned char> binaryData;
-	for (size_t i = 0; 2 * i < inputString.length(); i++) {
-		std::istringstream iss(inputString.substr(2 * i, 2));
-		unsigned int       value;
-		iss >> std::hex >> value;
-		data[i] = (static_cast<unsigned char>(value));
+	size_t n = len / 2 < data.size() ? len / 2 : data.size();
+	size_t i = 0;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	for (; i + 4 <= n; i += 4) {
+		uint64_t x;
+		memcpy(&x, hex + 2 * i, sizeof(x));
+		uint64_t nib = (x & 0x0F0F0F0F0F0F0F0FULL) +
+		    ((x >> 6) & 0x0101010101010101ULL) * 9;
+		uint64_t y = ((nib & 0x000F000F000F000FULL) << 4) |
+		    ((nib >> 8) & 0x000F000F000F000FULL);
+		y = (y | (y >> 8)) & 0x0000FFFF0000FFFFULL;
+		y = (y | (y >> 16)) & 0x00000000FFFFFFFFULL;
+		uint32_t out = (uint32_t) y;
+		memcpy(&data[i], &out, sizeof(out));
+	}
+#endif
+	for (; i < n; i++) {
+		data[i] = (hex_nibble(hex[2 * i]) << 4) |
+		    hex_nibble(hex[2 * i + 1]);
 	}
 }
 
 void
 blf_write_can_message(Vector::BLF::File &file, cJSON *jso)
 {
-	/* write a CanMessage */
-	// puts(cJSON_Print(jso));
-	auto *canMessage = new Vector::BLF::CanMessage;
-	json_read_num(canMessage, id, "id", jso);
-	json_read_num(canMessage, objectTimeStamp, "t", jso);
-	json_read_num(canMessage, channel, "bus", jso);
-	json_read_num(canMessage, flags, "d", jso);
-	json_read_num(canMessage, dlc, "l", jso);
-	cJSON *data = cJSON_GetObjectItem(jso, "data");
-	// printf("ori: %s\n", data->valuestring);
-	read_binary_data(data->valuestring, canMessage->dlc, canMessage->data);
+	/* write a CanMessage, the file takes ownership of it */
+	auto  *canMessage = new Vector::BLF::CanMessage;
+	cJSON *item       = NULL;
+	// One pass over the fields instead of a lookup per field
+	cJSON_ArrayForEach(item, jso)
+	{
+		const char *k = item->string;
+		if (k == NULL) {
+			continue;
+		}
+		if (cJSON_IsNumber(item)) {
+			if (item->valuedouble <= 0) {
+				continue;
+			}
+			if (strcasecmp(k, "id") == 0) {
+				canMessage->id = item->valuedouble;
+			} else if (strcasecmp(k, "t") == 0) {
+				canMessage->objectTimeStamp = item->valuedouble;
+			} else if (strcasecmp(k, "bus") == 0) {
+				canMessage->channel = item->valuedouble;
+			} else if (strcasecmp(k, "d") == 0) {
+				canMessage->flags = item->valuedouble;
+			} else if (strcasecmp(k, "l") == 0) {
+				canMessage->dlc = item->valuedouble;
+			}
+		} else if (cJSON_IsString(item) && strcasecmp(k, "data") == 0) {
+			read_binary_data(item->valuestring,
+			    strlen(item->valuestring), canMessage->data);
+		}
+	}
 	file.write(canMessage);
 }
 
+// Write a payload in the binary frame format, returns false if the payload
+// is not in that format.
+static bool
+blf_write_can_frames(Vector::BLF::File &file, const uint8_t *buf, uint32_t len)
+{
+	blf_can_frames_hdr hdr;
+	if (len < sizeof(hdr)) {
+		return false;
+	}
+	memcpy(&hdr, buf, sizeof(hdr));
+	if (hdr.magic != BLF_CAN_FRAMES_MAGIC) {
+		return false;
+	}
+
+	uint32_t max = (len - sizeof(hdr)) / sizeof(blf_can_frame);
+	if (hdr.count > max) {
+		log_warn("Truncated can frames payload, %u of %u frames",
+		    max, hdr.count);
+		hdr.count = max;
+	}
+
+	const uint8_t *ptr = buf + sizeof(hdr);
+	for (uint32_t i = 0; i < hdr.count; i++) {
+		blf_can_frame frame;
+		memcpy(&frame, ptr, sizeof(frame));
+		ptr += sizeof(frame);
+
+		auto *canMessage            = new Vector::BLF::CanMessage;
+		canMessage->objectTimeStamp = frame.timestamp;
+		canMessage->id              = frame.id;
+		canMessage->channel         = frame.channel;
+		canMessage->flags           = frame.flags;
+		canMessage->dlc             = frame.dlc;
+		memcpy(canMessage->data.data(), frame.data, sizeof(frame.data));
+		file.write(canMessage);
+	}
+	return true;
+}
+
 int
 blf_write_core(
     char *name, blf_object *elem, uint32_t old_index, uint32_t new_index)
@@ -237,6 +304,9 @@ blf_write_core(
 	}
 
 	for (uint32_t i = old_index; i <= new_index; i++) {
+		if (blf_write_can_frames(file, elem->darray[i], elem->dsize[i])) {
+			continue;
+		}
 
 		cJSON *jso = cJSON_ParseWithLength(
 		    (const char *) elem->darray[i], elem->dsize[i]);
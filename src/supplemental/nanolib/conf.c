@@ -456,6 +456,16 @@ conf_basic_parse(conf *config, const char *path)
 			    nni_strcasecmp(value, "yes") == 0 ||
 			    nni_strcasecmp(value, "true") == 0;
 			nng_strfree(value);
+		} else if ((value = get_conf_value(
+		                line, sz, "envelope_unpack")) != NULL) {
+			config->envelope_unpack =
+			    nni_strcasecmp(value, "yes") == 0 ||
+			    nni_strcasecmp(value, "true") == 0;
+			nng_strfree(value);
+		} else if ((value = get_conf_value(
+		                line, sz, "envelope_max_records")) != NULL) {
+			config->envelope_max_records = (uint32_t) atol(value);
+			nng_strfree(value);
 #ifdef ACL_SUPP
 		} else if ((value = get_conf_value(
 		                line, sz, "acl_enable")) != NULL) {
@@ -829,6 +839,9 @@ conf_sqlite_init(conf_sqlite *sqlite)
 	sqlite->mounted_file_path   = NULL;
 	sqlite->flush_mem_threshold = 100;
 	sqlite->resend_interval     = 5000;
+	sqlite->replay_window       = 256;
+	sqlite->replay_batch        = 64;
+	sqlite->replay_live_share   = 50;
 }
 
 #if defined(SUPP_RULE_ENGINE)
@@ -900,6 +913,9 @@ conf_init(conf *nanomq_conf)
 	nanomq_conf->allow_anonymous = true;
 	nanomq_conf->ipc_internal    = true;
 
+	nanomq_conf->envelope_unpack      = false;
+	nanomq_conf->envelope_max_records = 1024;
+
 #ifdef ACL_SUPP
 	nanomq_conf->acl_nomatch        = ACL_ALLOW;
 	nanomq_conf->enable_acl_cache   = true;
@@ -1165,6 +1181,8 @@ print_exchange_conf(conf_exchange *exchange)
 		conf_exchange_node *n = exchange->nodes[i];
 		log_info("exchange name            %s", n->name);
 		log_info("exchange topic           %s", n->topic);
+		log_info("exchange partition       %d", n->partition);
+		log_info("exchange partition window %lu", n->partition_window);
 		for (int j=0; j< (int) n->rbufs_sz; j++) {
 			ringBuffer_node *r = n->rbufs[j];
 			log_info("exchange ringbus name      %s", r->name);
@@ -1324,6 +1342,10 @@ print_conf(conf *nanomq_conf)
 	log_info("await_rel_timeout:        %ds", nanomq_conf->await_rel_timeout);
 	log_info("retry_interval:           %ds", nanomq_conf->qos_duration);
 	log_info("keepalive_multiplier:     %f", nanomq_conf->backoff);
+	log_info("envelope_unpack:          %s",
+	    nanomq_conf->envelope_unpack ? "true" : "false");
+	log_info("envelope_max_records:     %u",
+	    nanomq_conf->envelope_max_records);
 
 	if (nanomq_conf->http_server.enable) {
 		conf_http_server hs = nanomq_conf->http_server;
@@ -2762,6 +2784,12 @@ conf_bridge_node_init(conf_bridge_node *node)
 
 	node->sqlite         = NULL;
 
+	node->envelope.enable        = false;
+	node->envelope.prefix_levels = 1;
+	node->envelope.window        = 100;
+	node->envelope.max_size      = 16384;
+	node->envelope.codec         = ENVELOPE_CODEC_NONE;
+
 	node->bridge_aio     = NULL;
 	node->bridge_arg = NULL;
 
@@ -2958,6 +2986,29 @@ conf_bridge_node_parse_with_name(const char *path,const char *key_prefix, const
 		                key_prefix, name, ".max_send_queue_len")) != NULL) {
 			node->max_send_queue_len = atoi(value);
 			free(value);
+		} else if ((value = get_conf_value_with_prefix2(line, sz,
+		                key_prefix, name, ".envelope.enable")) != NULL) {
+			node->envelope.enable = nni_strcasecmp(value, "true") == 0;
+			free(value);
+		} else if ((value = get_conf_value_with_prefix2(line, sz,
+		                key_prefix, name, ".envelope.prefix_levels")) !=
+		    NULL) {
+			node->envelope.prefix_levels = (uint8_t) atoi(value);
+			free(value);
+		} else if ((value = get_conf_value_with_prefix2(line, sz,
+		                key_prefix, name, ".envelope.window")) != NULL) {
+			node->envelope.window = (uint32_t) atol(value);
+			free(value);
+		} else if ((value = get_conf_value_with_prefix2(line, sz,
+		                key_prefix, name, ".envelope.max_size")) != NULL) {
+			node->envelope.max_size = (uint32_t) atol(value);
+			free(value);
+		} else if ((value = get_conf_value_with_prefix2(line, sz,
+		                key_prefix, name, ".envelope.codec")) != NULL) {
+			node->envelope.codec = nni_strcasecmp(value, "zlib") == 0
+			    ? ENVELOPE_CODEC_ZLIB
+			    : ENVELOPE_CODEC_NONE;
+			free(value);
 		} else if ((value = get_conf_value_with_prefix2(line, sz,
 		                key_prefix, name, ".max_recv_queue_len")) != NULL) {
 			node->max_recv_queue_len = atoi(value);
@@ -3267,6 +3318,20 @@ print_bridge_conf(conf_bridge *bridge, const char *prefix)
 		    node->name, node->backoff_max);
 		log_info("%sbridge.mqtt.%s.max_parallel_processes:     %ld", prefix,
 		    node->name, node->parallel);
+		log_info("%sbridge.mqtt.%s.envelope.enable:            %s", prefix,
+		    node->name, node->envelope.enable ? "true" : "false");
+		if (node->envelope.enable) {
+			log_info("%sbridge.mqtt.%s.envelope.prefix_levels:     %d",
+			    prefix, node->name, node->envelope.prefix_levels);
+			log_info("%sbridge.mqtt.%s.envelope.window:            %d",
+			    prefix, node->name, node->envelope.window);
+			log_info("%sbridge.mqtt.%s.envelope.max_size:          %d",
+			    prefix, node->name, node->envelope.max_size);
+			log_info("%sbridge.mqtt.%s.envelope.codec:             %s",
+			    prefix, node->name,
+			    node->envelope.codec == ENVELOPE_CODEC_ZLIB ? "zlib"
+			                                                : "none");
+		}
 
 #if defined(SUPP_QUIC)
 		log_info("%sbridge.mqtt.%s.quic_multi_stream:          %s", prefix,
@@ -3338,6 +3403,12 @@ print_bridge_conf(conf_bridge *bridge, const char *prefix)
 		    bridge->sqlite.flush_mem_threshold);
 		log_info("%sbridge.sqlite.resend_interval: %ld", prefix,
 		    bridge->sqlite.resend_interval);
+		log_info("%sbridge.sqlite.replay_window: %ld", prefix,
+		    bridge->sqlite.replay_window);
+		log_info("%sbridge.sqlite.replay_batch: %ld", prefix,
+		    bridge->sqlite.replay_batch);
+		log_info("%sbridge.sqlite.replay_live_share: %ld", prefix,
+		    bridge->sqlite.replay_live_share);
 	}
 }
 
@@ -3898,6 +3969,18 @@ conf_sqlite_parse(
 		                key_prefix, ".resend_interval")) != NULL) {
 			sqlite->resend_interval = (uint64_t) atoll(value);
 			free(value);
+		} else if ((value = get_conf_value_with_prefix(line, sz,
+		                key_prefix, ".replay_window")) != NULL) {
+			sqlite->replay_window = (size_t) atol(value);
+			free(value);
+		} else if ((value = get_conf_value_with_prefix(line, sz,
+		                key_prefix, ".replay_batch")) != NULL) {
+			sqlite->replay_batch = (size_t) atol(value);
+			free(value);
+		} else if ((value = get_conf_value_with_prefix(line, sz,
+		                key_prefix, ".replay_live_share")) != NULL) {
+			sqlite->replay_live_share = (size_t) atol(value);
+			free(value);
 		}
 		free(line);
 		line = NULL;
@@ -40,6 +40,19 @@ static enum_map webhook_encoding[] = {
 	{ -1, NULL },
 };
 
+static enum_map exchange_partition_type[] = {
+	{ EX_PARTITION_NONE, "none" },
+	{ EX_PARTITION_KEY, "key" },
+	{ EX_PARTITION_TIME, "time" },
+	{ -1, NULL },
+};
+
+static enum_map envelope_codec_type[] = {
+	{ ENVELOPE_CODEC_NONE, "none" },
+	{ ENVELOPE_CODEC_ZLIB, "zlib" },
+	{ -1, NULL },
+};
+
 static enum_map http_server_auth_type[] = {
 	{ BASIC, "basic" },
 	{ JWT, "jwt" },
@@ -346,6 +359,8 @@ conf_basic_parse_ver2(conf *config, cJSON *jso)
 		hocon_read_num(config, max_inflight_window, jso_mqtt);
 		hocon_read_time(config, max_awaiting_rel, jso_mqtt);
 		hocon_read_time(config, await_rel_timeout, jso_mqtt);
+		hocon_read_bool(config, envelope_unpack, jso_mqtt);
+		hocon_read_num(config, envelope_max_records, jso_mqtt);
 	}
 
 	cJSON *jso_listeners = cJSON_GetObjectItem(jso, "listeners");
@@ -1161,6 +1176,16 @@ conf_bridge_node_parse(
 	update_bridge_node_vin(node, CONF_NODE_FORWARD);
 	hocon_read_num(node, max_recv_queue_len, obj);
 	hocon_read_num(node, max_send_queue_len, obj);
+
+	cJSON *envelope = hocon_get_obj("envelope", obj);
+	if (envelope != NULL) {
+		conf_bridge_envelope *env = &node->envelope;
+		hocon_read_bool(env, enable, envelope);
+		hocon_read_num(env, prefix_levels, envelope);
+		hocon_read_num(env, window, envelope);
+		hocon_read_num(env, max_size, envelope);
+		hocon_read_enum(env, codec, envelope, envelope_codec_type);
+	}
 }
 
 static void
@@ -1181,6 +1206,12 @@ conf_bridge_parse_ver2(conf *config, cJSON *jso)
 			    bridge_sqlite, flush_mem_threshold, node_item);
 			hocon_read_num(
 			    bridge_sqlite, resend_interval, node_item);
+			hocon_read_num(
+			    bridge_sqlite, replay_window, node_item);
+			hocon_read_num(
+			    bridge_sqlite, replay_batch, node_item);
+			hocon_read_num(
+			    bridge_sqlite, replay_live_share, node_item);
 			hocon_read_str(
 			    bridge_sqlite, mounted_file_path, node_item);
 
@@ -1236,21 +1267,9 @@ conf_plugin_parse_ver2(conf *config, cJSON *jso)
 }
 #endif
 
-void
-conf_exchange_node_parse(conf_exchange_node *node, cJSON *obj)
+static void
+conf_ringbus_parse(conf_exchange_node *node, cJSON *rb)
 {
-	cJSON *exchange = hocon_get_obj("exchange", obj);
-
-	hocon_read_str(node, name, exchange);
-	hocon_read_str(node, topic, exchange);
-
-	if (node->name == NULL || node->topic == NULL) {
-		log_error("invalid exchange configuration!");
-		return;
-	}
-
-	cJSON *rb = hocon_get_obj("ringbus", exchange);
-
 	ringBuffer_node *rb_node = NNI_ALLOC_STRUCT(rb_node);
 	if (rb_node == NULL) {
 		return;
@@ -1276,6 +1295,35 @@ conf_exchange_node_parse(conf_exchange_node *node, cJSON *obj)
 	node->rbufs_sz = cvector_size(node->rbufs);
 }
 
+void
+conf_exchange_node_parse(conf_exchange_node *node, cJSON *obj)
+{
+	cJSON *exchange = hocon_get_obj("exchange", obj);
+
+	hocon_read_str(node, name, exchange);
+	hocon_read_str(node, topic, exchange);
+
+	if (node->name == NULL || node->topic == NULL) {
+		log_error("invalid exchange configuration!");
+		return;
+	}
+
+	hocon_read_enum(node, partition, exchange, exchange_partition_type);
+	hocon_read_time(node, partition_window, exchange);
+
+	/* ringbus is one ring buffer or an array of them for partitions */
+	cJSON *rbs = hocon_get_obj("ringbus", exchange);
+	cJSON *rb  = NULL;
+	if (!cJSON_IsArray(rbs)) {
+		conf_ringbus_parse(node, rbs);
+		return;
+	}
+	cJSON_ArrayForEach(rb, rbs)
+	{
+		conf_ringbus_parse(node, rb);
+	}
+}
+
 void
 conf_exchange_encryption_parse(conf_exchange_encryption *node, cJSON *obj)
 {
@@ -1310,6 +1358,8 @@ conf_exchange_parse_ver2(conf *config, cJSON *jso)
 		node->name               = NULL;
 		node->rbufs              = NULL;
 		node->rbufs_sz           = 0;
+		node->partition          = EX_PARTITION_NONE;
+		node->partition_window   = 1;
 		conf_exchange_node_parse(node, node_item);
 
 		conf_exchange_encryption *enc = NNI_ALLOC_STRUCT(enc);
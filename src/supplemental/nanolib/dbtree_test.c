@@ -373,8 +373,180 @@ dbtree_test(void)
 	puts("---------------TEST FINISHED----------------\n");
 }
 
+static uint32_t
+test_shared_depth(uint32_t pipe_id, void *arg)
+{
+	return ((uint32_t *) arg)[pipe_id];
+}
+
+// Returns the member of group g picked for a publish on a/b
+static uint32_t
+test_shared_pick(dbtree *tree, uint32_t key)
+{
+	uint32_t *v = dbtree_find_shared_clients_by(tree, "a/b", key);
+	uint32_t  id = 0;
+
+	// Group h has the single member 4
+	NUTS_TRUE(cvector_size(v) == 2);
+	for (size_t i = 0; i < cvector_size(v); i++) {
+		if (v[i] != 4) {
+			id = v[i];
+		}
+	}
+	NUTS_TRUE(id >= 1 && id <= 3);
+	cvector_free(v);
+	return id;
+}
+
+static void
+test_shared_strategy(void)
+{
+	dbtree  *tree;
+	uint32_t hits[4]  = { 0 };
+	uint32_t depth[5] = { 0, 5, 0, 3, 0 };
+	uint32_t id;
+
+	dbtree_create(&tree);
+	dbtree_insert_client(tree, "$share/g/a/b", 1);
+	dbtree_insert_client(tree, "$share/g/a/b", 2);
+	dbtree_insert_client(tree, "$share/g/a/b", 3);
+	dbtree_insert_client(tree, "$share/h/a/+", 4);
+
+	// Round robin by default, one cursor per group
+	for (int i = 0; i < 30; i++) {
+		hits[test_shared_pick(tree, 0)]++;
+	}
+	NUTS_TRUE(hits[1] == 10 && hits[2] == 10 && hits[3] == 10);
+
+	dbtree_set_shared_strategy(tree, DBTREE_SHARED_RANDOM, NULL, NULL);
+	for (int i = 0; i < 30; i++) {
+		test_shared_pick(tree, 0);
+	}
+
+	dbtree_set_shared_strategy(tree, DBTREE_SHARED_STICKY, NULL, NULL);
+	id = test_shared_pick(tree, 77);
+	for (int i = 0; i < 10; i++) {
+		NUTS_TRUE(test_shared_pick(tree, 77) == id);
+	}
+	// Another member leaving keeps the key where it was
+	uint32_t other = id == 1 ? 2 : 1;
+	dbtree_delete_client(tree, "$share/g/a/b", other);
+	NUTS_TRUE(test_shared_pick(tree, 77) == id);
+	dbtree_insert_client(tree, "$share/g/a/b", other);
+
+	dbtree_set_shared_strategy(
+	    tree, DBTREE_SHARED_LEAST_INFLIGHT, test_shared_depth, depth);
+	for (int i = 0; i < 10; i++) {
+		NUTS_TRUE(test_shared_pick(tree, 0) == 2);
+	}
+	depth[2] = 9;
+	for (int i = 0; i < 10; i++) {
+		NUTS_TRUE(test_shared_pick(tree, 0) == 3);
+	}
+
+	dbtree_delete_client(tree, "$share/g/a/b", 1);
+	dbtree_delete_client(tree, "$share/g/a/b", 2);
+	dbtree_delete_client(tree, "$share/g/a/b", 3);
+	dbtree_delete_client(tree, "$share/h/a/+", 4);
+	dbtree_destory(tree);
+}
+
+static nng_msg *
+test_retain_msg(size_t len)
+{
+	nng_msg *msg;
+	NUTS_PASS(nng_msg_alloc(&msg, len));
+	return msg;
+}
+
+static void
+test_retain_count_cb(nng_msg **msgs, size_t n, void *arg)
+{
+	size_t *calls = arg;
+	NUTS_TRUE(n > 0 && n <= 3);
+	calls[0]++;
+	calls[1] += n;
+	for (size_t i = 0; i < n; i++) {
+		nng_msg_free(msgs[i]);
+	}
+}
+
+static size_t
+test_retain_count(dbtree *tree, char *filter)
+{
+	nng_msg **r = dbtree_find_retain(tree, filter);
+	size_t    n = cvector_size(r);
+	for (size_t i = 0; i < n; i++) {
+		nng_msg_free(r[i]);
+	}
+	cvector_free(r);
+	return n;
+}
+
+static void
+test_retain_store(void)
+{
+	dbtree *tree;
+	char    topic[32];
+	size_t  calls[2] = { 0 };
+
+	dbtree_create(&tree);
+	for (int i = 0; i < 10; i++) {
+		snprintf(topic, sizeof(topic), "r/%d/x", i);
+		nng_msg *old = dbtree_insert_retain(tree, topic, test_retain_msg(100));
+		NUTS_NULL(old);
+	}
+	NUTS_TRUE(dbtree_retain_bytes(tree) == 1000);
+
+	NUTS_TRUE(test_retain_count(tree, "r/#") == 10);
+	NUTS_TRUE(test_retain_count(tree, "r/+/x") == 10);
+	NUTS_TRUE(test_retain_count(tree, "r/3/x") == 1);
+	NUTS_TRUE(test_retain_count(tree, "+/+") == 0);
+	NUTS_TRUE(test_retain_count(tree, "#") == 10);
+
+	// Every branch of a "+" before a "#" counts
+	NUTS_TRUE(test_retain_count(tree, "+/+/#") == 10);
+
+	dbtree_find_retain_chunked(
+	    tree, "r/#", 3, test_retain_count_cb, calls);
+	NUTS_TRUE(calls[0] == 4 && calls[1] == 10);
+
+	// Replacing keeps the byte count right
+	nng_msg *old = dbtree_insert_retain(tree, "r/0/x", test_retain_msg(50));
+	NUTS_TRUE(old != NULL);
+	nng_msg_free(old);
+	NUTS_TRUE(dbtree_retain_bytes(tree) == 950);
+
+	// r/1/x is the least recently used now, touch it so r/2/x goes first
+	NUTS_TRUE(test_retain_count(tree, "r/1/x") == 1);
+	dbtree_set_retain_limit(tree, 900);
+	NUTS_TRUE(dbtree_retain_bytes(tree) == 850);
+	NUTS_TRUE(test_retain_count(tree, "r/2/x") == 0);
+	NUTS_TRUE(test_retain_count(tree, "r/1/x") == 1);
+
+	// A new one pushes out the oldest ones
+	old = dbtree_insert_retain(tree, "r/new", test_retain_msg(200));
+	NUTS_NULL(old);
+	NUTS_TRUE(dbtree_retain_bytes(tree) <= 900);
+	NUTS_TRUE(test_retain_count(tree, "r/new") == 1);
+	NUTS_TRUE(test_retain_count(tree, "r/3/x") == 0);
+
+	for (int i = 0; i < 10; i++) {
+		snprintf(topic, sizeof(topic), "r/%d/x", i);
+		nng_msg *m = dbtree_delete_retain(tree, topic);
+		if (m != NULL) {
+			nng_msg_free(m);
+		}
+	}
+	nng_msg_free(dbtree_delete_retain(tree, "r/new"));
+	NUTS_TRUE(dbtree_retain_bytes(tree) == 0);
+	dbtree_destory(tree);
+}
+
 TEST_LIST = {
    {"dbtree_test", dbtree_test},
+   {"dbtree_shared_strategy", test_shared_strategy},
+   {"dbtree_retain_store", test_retain_store},
 
    {NULL, NULL} 
 };
\ No newline at end of file
@@ -18,11 +18,6 @@
 #include "nng/supplemental/nanolib/mqtt_db.h"
 #include "nng/supplemental/nanolib/log.h"
 
-#define ROUND_ROBIN
-// #define RANDOM
-
-static size_t acnt;
-
 typedef struct dbtree_node dbtree_node;
 
 struct dbtree_node {
@@ -33,11 +28,28 @@ struct dbtree_node {
 	cvector(uint32_t) clients;
 	cvector(dbtree_node *) child;
 	nni_rwlock rwlock;
+	// Dispatch cursor of the shared group, if this node ends a
+	// $share/<group>/<filter> subscription
+	nni_atomic_u64 cursor;
+	// Position in the retain LRU while retain is set
+	size_t        retain_size;
+	nni_list_node lru;
 };
 
 struct dbtree {
 	dbtree_node *root;
 	nni_rwlock   rwlock;
+
+	dbtree_shared_strategy strategy;
+	uint32_t (*depth)(uint32_t pipe_id, void *arg);
+	void *depth_arg;
+
+	// Nodes holding a retained msg, least recently used first. Lookups
+	// only hold the read lock, so the order has a lock of its own.
+	nni_list retain_lru;
+	nni_mtx  retain_mtx;
+	size_t   retain_bytes;
+	size_t   retain_limit; // 0 for no limit
 };
 
 /**
@@ -391,6 +403,8 @@ dbtree_node_new(char *topic)
 	node->plus    = -1;
 
 	nni_rwlock_init(&node->rwlock);
+	nni_atomic_init64(&node->cursor);
+	NNI_LIST_NODE_INIT(&node->lru);
 	return node;
 }
 
@@ -429,9 +443,9 @@ dbtree_create(dbtree **db)
 	dbtree_node *node = dbtree_node_new("\0");
 	(*db)->root       = node;
 	nni_rwlock_init(&(*db)->rwlock);
-#ifdef RANDOM
-	srand(time(NULL));
-#endif
+	(*db)->strategy = DBTREE_SHARED_ROUND_ROBIN;
+	NNI_LIST_INIT(&(*db)->retain_lru, dbtree_node, lru);
+	nni_mtx_init(&(*db)->retain_mtx);
 	return;
 }
 
@@ -445,6 +459,7 @@ dbtree_destory(dbtree *db)
 {
 	if (db) {
 		dbtree_node_free(db->root);
+		nni_mtx_fini(&db->retain_mtx);
 		free(db);
 		db = NULL;
 	}
@@ -679,9 +694,9 @@ dbtree_insert_client(dbtree *db, char *topic, uint32_t pipe_id)
  * @param topic_queue - topic queue position
  * @return all clients on lots of nodes
  */
-static uint32_t **
-collect_clients(uint32_t **vec, dbtree_node **nodes, dbtree_node ***nodes_t,
-    char **topic_queue)
+static dbtree_node **
+collect_clients(dbtree_node **vec, dbtree_node **nodes,
+    dbtree_node ***nodes_t, char **topic_queue)
 {
 	// TODO insert sort for clients
 	while (!cvector_empty(nodes)) {
@@ -700,8 +715,7 @@ collect_clients(uint32_t **vec, dbtree_node **nodes, dbtree_node ***nodes_t,
 		if (node_t->well != -1) {
 			if (!cvector_empty(child[node_t->well]->clients)) {
 				log_debug("Find # tag");
-				cvector_push_back(
-				    vec, child[node_t->well]->clients);
+				cvector_push_back(vec, child[node_t->well]);
 			}
 		}
 
@@ -711,7 +725,7 @@ collect_clients(uint32_t **vec, dbtree_node **nodes, dbtree_node ***nodes_t,
 				if (!cvector_empty(
 				        child[node_t->plus]->clients)) {
 					cvector_push_back(
-					    vec, child[node_t->plus]->clients);
+					    vec, child[node_t->plus]);
 				}
 
 			} else {
@@ -736,7 +750,7 @@ collect_clients(uint32_t **vec, dbtree_node **nodes, dbtree_node ***nodes_t,
 				if (!cvector_empty(t->clients)) {
 					log_debug(
 					    "Searching client: %s", t->topic);
-					cvector_push_back(vec, t->clients);
+					cvector_push_back(vec, t);
 				}
 
 				if (t->well != -1) {
@@ -745,8 +759,7 @@ collect_clients(uint32_t **vec, dbtree_node **nodes, dbtree_node ***nodes_t,
 						log_debug(
 						    "Searching client: %s",
 						    t->topic);
-						cvector_push_back(
-						    vec, t->clients);
+						cvector_push_back(vec, t);
 					}
 				}
 
@@ -769,26 +782,27 @@ collect_clients(uint32_t **vec, dbtree_node **nodes, dbtree_node ***nodes_t,
  * @return pipe id vector
  */
 static uint32_t *
-iterate_client(uint32_t **v)
+iterate_client(dbtree_node **v)
 {
 	cvector(uint32_t) ids = NULL;
 
 	if (v) {
 		for (size_t i = 0; i < cvector_size(v); ++i) {
+			uint32_t *clients = v[i]->clients;
 
-			for (size_t j = 0; j < cvector_size(v[i]); j++) {
+			for (size_t j = 0; j < cvector_size(clients); j++) {
 				size_t index = 0;
 
 				if (false ==
 				    binary_search_uint32(
-				        ids, 0, &index, v[i][j], ids_cmp)) {
+				        ids, 0, &index, clients[j], ids_cmp)) {
 					if (cvector_empty(ids) ||
 					    index == cvector_size(ids)) {
 						cvector_push_back(
-						    ids, v[i][j]);
+						    ids, clients[j]);
 					} else {
 						cvector_insert(
-						    ids, index, v[i][j]);
+						    ids, index, clients[j]);
 					}
 				}
 			}
@@ -813,7 +827,7 @@ search_client(dbtree *db, char *topic)
 	nni_rwlock_rdlock(&(db->rwlock));
 
 	dbtree_node *node              = db->root;
-	cvector(uint32_t *) pipe_ids   = NULL;
+	cvector(dbtree_node *) pipe_ids = NULL;
 	cvector(dbtree_node *) nodes   = NULL;
 	cvector(dbtree_node *) nodes_t = NULL;
 
@@ -901,7 +915,8 @@ delete_dbtree_node(dbtree_node *node, size_t index)
 	dbtree_node *node_t = node->child[index];
 	// TODO plus && well
 
-	if (cvector_empty(node_t->child) && cvector_empty(node_t->clients)) {
+	if (cvector_empty(node_t->child) && cvector_empty(node_t->clients) &&
+	    node_t->retain == NULL) {
 		log_debug("Delete node: [%s]", node_t->topic);
 		cvector_free(node_t->child);
 		cvector_free(node_t->clients);
@@ -1025,203 +1040,219 @@ mem_free:
 	return NULL;
 }
 
+static size_t
+retain_msg_size(nng_msg *msg)
+{
+	return nng_msg_header_len(msg) + nng_msg_len(msg);
+}
+
+// Drops the least recently used retained msgs until the store fits in
+// its budget again, keep is never dropped. Write lock of db held.
+static void
+retain_evict(dbtree *db, dbtree_node *keep)
+{
+	dbtree_node *node;
+
+	if (db->retain_limit == 0) {
+		return;
+	}
+	nni_mtx_lock(&db->retain_mtx);
+	while (db->retain_bytes > db->retain_limit &&
+	    (node = nni_list_first(&db->retain_lru)) != NULL && node != keep) {
+		nni_list_remove(&db->retain_lru, node);
+		db->retain_bytes -= node->retain_size;
+		log_debug("Evict retain: [%s]", node->topic);
+		nng_msg_free(node->retain);
+		node->retain      = NULL;
+		node->retain_size = 0;
+	}
+	nni_mtx_unlock(&db->retain_mtx);
+}
+
+typedef struct {
+	dbtree  *db;
+	nng_msg *msg;
+} retain_args;
+
 static void *
 insert_dbtree_retain(dbtree_node *node, void *args)
 {
-	nng_msg *retain = (nng_msg *) args;
-	void *             ret    = NULL;
+	retain_args *ra     = args;
+	dbtree      *db     = ra->db;
+	nng_msg     *retain = ra->msg;
+	void        *ret    = NULL;
 	nni_rwlock_wrlock(&(node->rwlock));
+	nni_mtx_lock(&db->retain_mtx);
 	if (node->retain != NULL) {
 		ret = node->retain;
+		nni_list_remove(&db->retain_lru, node);
+		db->retain_bytes -= node->retain_size;
 	}
 
-	node->retain = retain;
+	node->retain      = retain;
+	node->retain_size = 0;
+	if (retain != NULL) {
+		node->retain_size = retain_msg_size(retain);
+		db->retain_bytes += node->retain_size;
+		nni_list_append(&db->retain_lru, node);
+	}
+	nni_mtx_unlock(&db->retain_mtx);
 
 	nni_rwlock_unlock(&(node->rwlock));
 
+	retain_evict(db, node);
 	return ret;
 }
 
 nng_msg *
 dbtree_insert_retain(dbtree *db, char *topic, nng_msg *ret_msg)
 {
-	return search_insert_node(db, topic, ret_msg, insert_dbtree_retain);
+	retain_args ra = { .db = db, .msg = ret_msg };
+	return search_insert_node(db, topic, &ra, insert_dbtree_retain);
 }
 
-nng_msg **
-collect_retain_well(void **vec, dbtree_node *node)
+void
+dbtree_set_retain_limit(dbtree *db, size_t bytes)
 {
-	dbtree_node **nodes   = NULL;
-	dbtree_node **nodes_t = NULL;
-	cvector_push_back(nodes, node);
-	while (!cvector_empty(nodes)) {
-		for (size_t i = 0; i < cvector_size(nodes); i++) {
-			if (nodes[i]->retain) {
-				nng_msg_clone(nodes[i]->retain);
-				cvector_push_back(vec, nodes[i]->retain);
-			}
-
-			for (size_t j = 0; j < cvector_size(nodes[i]->child);
-			     j++) {
-				cvector_push_back(
-				    nodes_t, (nodes[i]->child)[j]);
-			}
-		}
+	nni_rwlock_wrlock(&(db->rwlock));
+	db->retain_limit = bytes;
+	retain_evict(db, NULL);
+	nni_rwlock_unlock(&(db->rwlock));
+}
 
-		cvector_free(nodes);
-		nodes = NULL;
+size_t
+dbtree_retain_bytes(dbtree *db)
+{
+	size_t bytes;
+	nni_mtx_lock(&db->retain_mtx);
+	bytes = db->retain_bytes;
+	nni_mtx_unlock(&db->retain_mtx);
+	return bytes;
+}
 
-		for (size_t i = 0; i < cvector_size(nodes_t); i++) {
-			if (nodes_t[i]->retain) {
-				nng_msg_clone(nodes_t[i]->retain);
-				cvector_push_back(vec, nodes_t[i]->retain);
-			}
+typedef struct {
+	dbtree   *db;
+	nng_msg **buf;
+	size_t    n;
+	size_t    chunk;
+	void (*cb)(nng_msg **msgs, size_t n, void *arg);
+	void *arg;
+} retain_walk;
 
-			for (size_t j = 0; j < cvector_size(nodes_t[i]->child);
-			     j++) {
-				cvector_push_back(
-				    nodes, (nodes_t[i]->child)[j]);
-			}
-		}
-		cvector_free(nodes_t);
-		nodes_t = NULL;
+static void
+retain_walk_emit(retain_walk *w, dbtree_node *node)
+{
+	if (node->retain == NULL) {
+		return;
+	}
+	// Most recently used goes last
+	nni_mtx_lock(&w->db->retain_mtx);
+	nni_list_remove(&w->db->retain_lru, node);
+	nni_list_append(&w->db->retain_lru, node);
+	nni_mtx_unlock(&w->db->retain_mtx);
+
+	nng_msg_clone(node->retain);
+	w->buf[w->n++] = node->retain;
+	if (w->n == w->chunk) {
+		w->cb(w->buf, w->n, w->arg);
+		w->n = 0;
 	}
+}
 
-	return (struct nng_msg **)vec;
+static void
+retain_walk_all(retain_walk *w, dbtree_node *node)
+{
+	retain_walk_emit(w, node);
+	for (size_t i = 0; i < cvector_size(node->child); i++) {
+		retain_walk_all(w, node->child[i]);
+	}
 }
 
 /**
- * @brief collect_retains - Get all retain in nodes
- * @param vec - all clients obey this rule will insert
- * @param nodes - all node need to be compare
- * @param nodes_t - all node need to be compare next time
- * @param topic_queue - topic queue position
- * @return all clients on lots of nodes
+ * @brief retain_walk_match - Emit the retained msgs below node
+ *        matching the rest of a filter, depth first
+ * @param w - walk state
+ * @param node - node matching the levels before topic_queue
+ * @param topic_queue - remaining levels of the filter
+ * @return void
  */
-static nng_msg **
-collect_retains(void **vec, dbtree_node **nodes,
-    dbtree_node ***nodes_t, char **topic_queue)
+static void
+retain_walk_match(retain_walk *w, dbtree_node *node, char **topic_queue)
 {
-
-	while (!cvector_empty(nodes)) {
-		dbtree_node **node_t_ = cvector_end(nodes) - 1;
-		dbtree_node * node_t  = *node_t_;
-		cvector_pop_back(nodes);
-
-		if (node_t == NULL || node_t->child == NULL ||
-		    (*(node_t->child)) == NULL) {
-			continue;
+	if (*topic_queue == NULL) {
+		retain_walk_emit(w, node);
+	} else if (is_well(*topic_queue)) {
+		// "a/#" matches "a" as well
+		retain_walk_all(w, node);
+	} else if (is_plus(*topic_queue)) {
+		for (size_t i = 0; i < cvector_size(node->child); i++) {
+			retain_walk_match(w, node->child[i], topic_queue + 1);
 		}
-
-		dbtree_node * t     = *node_t->child;
-		dbtree_node **child = node_t->child;
-
-		if (is_well(*topic_queue)) {
-			vec = (void **)collect_retain_well(vec, node_t);
-			break;
-		} else if (is_plus(*topic_queue)) {
-			if (*(topic_queue + 1) == NULL) {
-				for (size_t i = 0; i < cvector_size(child);
-				     i++) {
-					node_t = child[i];
-					if (node_t->retain) {
-						nng_msg_clone(node_t->retain);
-						cvector_push_back(
-						    vec, node_t->retain);
-					}
-				}
-
-			} else {
-				for (size_t i = 0; i < cvector_size(child);
-				     i++) {
-					node_t = child[i];
-					cvector_push_back(
-					    ((*nodes_t)), node_t);
-				}
-			}
-
-		} else {
-			bool equal = false;
-
-			if (strcmp(t->topic, *topic_queue)) {
-				size_t index = 0;
-				t            = find_next(
-                                    node_t, &equal, topic_queue, &index);
-
-			} else {
-				equal = true;
-			}
-
-			if (equal == true) {
-				log_debug(
-				    "Searching client: %s", node_t->topic);
-				if (*(topic_queue + 1) == NULL) {
-					if (t->retain) {
-						log_debug(
-						    "Searching client: %s",
-						    t->topic);
-						nng_msg_clone(t->retain);
-						cvector_push_back(
-						    vec, t->retain);
-					}
-				} else {
-					log_debug(
-					    "Searching client: %s", t->topic);
-					cvector_push_back((*nodes_t), t);
-					log_debug("add node_t: %s",
-					    (*(cvector_end((*nodes_t)) - 1))
-					        ->topic);
-				}
-			}
+	} else if (node->child != NULL) {
+		bool         equal = false;
+		size_t       index = 0;
+		dbtree_node *t     = find_next(node, &equal, topic_queue, &index);
+		if (equal == true) {
+			retain_walk_match(w, t, topic_queue + 1);
 		}
 	}
-
-	return (struct nng_msg **)vec;
 }
 
-nng_msg **
-dbtree_find_retain(dbtree *db, char *topic)
+void
+dbtree_find_retain_chunked(dbtree *db, char *topic, size_t chunk,
+    void (*cb)(nng_msg **msgs, size_t n, void *arg), void *arg)
 {
-
-	if (db == NULL || topic == NULL) {
+	if (db == NULL || topic == NULL || chunk == 0) {
 		log_error("db or topic is NULL");
-		return NULL;
+		return;
 	}
-	char **topic_queue = topic_parse(topic);
-	char **for_free    = topic_queue;
-	nni_rwlock_rdlock(&(db->rwlock));
-
-	dbtree_node *node              = db->root;
-	cvector(nng_msg *) rets        = NULL;
-	cvector(dbtree_node *) nodes   = NULL;
-	cvector(dbtree_node *) nodes_t = NULL;
+	char    **topic_queue = topic_parse(topic);
+	nng_msg **buf         = nni_alloc(chunk * sizeof(nng_msg *));
+	if (buf == NULL) {
+		topic_queue_free(topic_queue);
+		return;
+	}
+	retain_walk w = {
+		.db    = db,
+		.buf   = buf,
+		.chunk = chunk,
+		.cb    = cb,
+		.arg   = arg,
+	};
 
-	if (node->child && *node->child) {
-		cvector_push_back(nodes, node);
+	nni_rwlock_rdlock(&(db->rwlock));
+	retain_walk_match(&w, db->root, topic_queue);
+	if (w.n > 0) {
+		cb(w.buf, w.n, arg);
 	}
+	nni_rwlock_unlock(&(db->rwlock));
 
-	while (*topic_queue && (!cvector_empty(nodes))) {
+	nni_free(buf, chunk * sizeof(nng_msg *));
+	topic_queue_free(topic_queue);
+}
 
-		rets = collect_retains((void **)rets, nodes, &nodes_t, topic_queue);
-		topic_queue++;
-		if (*topic_queue == NULL) {
-			break;
-		}
-		rets = collect_retains((void **)rets, nodes_t, &nodes, topic_queue);
-		topic_queue++;
+static void
+retain_push_cb(nng_msg **msgs, size_t n, void *arg)
+{
+	nng_msg ***rets = arg;
+	cvector(nng_msg *) v = *rets;
+	for (size_t i = 0; i < n; i++) {
+		cvector_push_back(v, msgs[i]);
 	}
+	*rets = v;
+}
 
-	nni_rwlock_unlock(&(db->rwlock));
-
-	topic_queue_free(for_free);
-	cvector_free(nodes);
-	cvector_free(nodes_t);
+nng_msg **
+dbtree_find_retain(dbtree *db, char *topic)
+{
+	cvector(nng_msg *) rets = NULL;
 
+	dbtree_find_retain_chunked(db, topic, 64, retain_push_cb, &rets);
 	return rets;
 }
 
 static void *
-delete_dbtree_retain(dbtree_node *node)
+delete_dbtree_retain(dbtree *db, dbtree_node *node)
 {
 	if (node == NULL) {
 		log_debug("node is NULL");
@@ -1232,6 +1263,13 @@ delete_dbtree_retain(dbtree_node *node)
 		retain       = node->retain;
 		node->retain = NULL;
 	}
+	if (retain != NULL) {
+		nni_mtx_lock(&db->retain_mtx);
+		nni_list_remove(&db->retain_lru, node);
+		db->retain_bytes -= node->retain_size;
+		node->retain_size = 0;
+		nni_mtx_unlock(&db->retain_mtx);
+	}
 
 	return retain;
 }
@@ -1287,7 +1325,7 @@ dbtree_delete_retain(dbtree *db, char *topic)
 	}
 
 	if (node->child) {
-		ret = delete_dbtree_retain(node->child[index]);
+		ret = delete_dbtree_retain(db, node->child[index]);
 		// print_client(node->child[index]->clients);
 		delete_dbtree_node(node, index);
 		// print_client(node->child[index]->clients);
@@ -1314,50 +1352,146 @@ mem_free:
 	return ret;
 }
 
-// TODO only use one of vector
+static uint64_t
+shared_cursor_next(dbtree_node *node)
+{
+	uint64_t c;
+	do {
+		c = nni_atomic_get64(&node->cursor);
+	} while (!nni_atomic_cas64(&node->cursor, c, c + 1));
+	return c;
+}
+
+// Mixes the publisher key with a member, the member with the highest
+// weight wins. Members joining or leaving only move the keys of their own.
+static uint32_t
+shared_sticky_weight(uint32_t key, uint32_t pipe_id)
+{
+	uint32_t h = key ^ (pipe_id * 0x9e3779b9u);
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35u;
+	h ^= h >> 16;
+	return h;
+}
+
+/**
+ * @brief shared_pick - Pick one member of a shared group
+ * @param db - dbtree, for the strategy
+ * @param node - node holding the members of the group
+ * @param key - hash of the publisher, for sticky
+ * @return pipe id
+ */
+static uint32_t
+shared_pick(dbtree *db, dbtree_node *node, uint32_t key)
+{
+	uint32_t *clients = node->clients;
+	size_t    n       = cvector_size(clients);
+	size_t    index   = 0;
+
+	dbtree_shared_strategy strategy = db->strategy;
+	if (strategy == DBTREE_SHARED_LEAST_INFLIGHT && db->depth == NULL) {
+		// Nothing to compare with
+		strategy = DBTREE_SHARED_ROUND_ROBIN;
+	}
+
+	switch (strategy) {
+	case DBTREE_SHARED_RANDOM:
+		index = nni_random() % n;
+		break;
+
+	case DBTREE_SHARED_STICKY: {
+		uint32_t best = 0;
+		for (size_t i = 0; i < n; i++) {
+			uint32_t w = shared_sticky_weight(key, clients[i]);
+			if (i == 0 || w > best) {
+				best  = w;
+				index = i;
+			}
+		}
+		break;
+	}
+
+	case DBTREE_SHARED_LEAST_INFLIGHT: {
+		// Start from the cursor so ties are spread as well
+		size_t   start = shared_cursor_next(node) % n;
+		uint32_t least = UINT32_MAX;
+		for (size_t i = 0; i < n && least != 0; i++) {
+			size_t   j = (start + i) % n;
+			uint32_t d = db->depth(clients[j], db->depth_arg);
+			if (d < least) {
+				least = d;
+				index = j;
+			}
+		}
+		break;
+	}
+
+	case DBTREE_SHARED_ROUND_ROBIN:
+	default:
+		index = shared_cursor_next(node) % n;
+		break;
+	}
+
+	return clients[index];
+}
+
+/**
+ * @brief iterate_shared_client - Pick one client of every shared group
+ *        and deduplicate them
+ * @param db - dbtree
+ * @param v - nodes of the groups matched
+ * @param key - hash of the publisher, for sticky
+ * @return pipe id vector
+ */
 static uint32_t *
-iterate_shared_client(uint32_t **v)
+iterate_shared_client(dbtree *db, dbtree_node **v, uint32_t key)
 {
 	cvector(uint32_t) ids = NULL;
 
-	if (v) {
-		for (size_t i = 0; i < cvector_size(v); ++i) {
-			// Dispatch strategy.
-#ifdef RANDOM
-			int index = rand();
-#elif defined(ROUND_ROBIN)
-			size_t index = acnt;
-#endif
-			// Get one pipe id from pipe id vector.
-			// This vector is from a node.
-			size_t j = index % cvector_size(v[i]);
-
-			index = 0;
-			// Deduplicate id.
-			if (false ==
-			    binary_search_uint32(
-			        ids, 0, &index, v[i][j], ids_cmp)) {
-				if (cvector_empty(ids) ||
-				    (size_t) index == cvector_size(ids)) {
-					cvector_push_back(ids, v[i][j]);
-				} else {
-					cvector_insert(ids, index, v[i][j]);
-				}
-			}
+	for (size_t i = 0; i < cvector_size(v); ++i) {
+		if (cvector_empty(v[i]->clients)) {
+			continue;
 		}
-		acnt++;
-		if (acnt == ULLONG_MAX) {
-			acnt = 0;
+		uint32_t id    = shared_pick(db, v[i], key);
+		size_t   index = 0;
+		// Deduplicate id.
+		if (false ==
+		    binary_search_uint32(ids, 0, &index, id, ids_cmp)) {
+			if (cvector_empty(ids) ||
+			    (size_t) index == cvector_size(ids)) {
+				cvector_push_back(ids, id);
+			} else {
+				cvector_insert(ids, index, id);
+			}
 		}
 	}
 
 	return ids;
 }
 
+void
+dbtree_set_shared_strategy(dbtree *db, dbtree_shared_strategy strategy,
+    uint32_t (*depth)(uint32_t pipe_id, void *arg), void *arg)
+{
+	nni_rwlock_wrlock(&(db->rwlock));
+	db->strategy  = strategy;
+	db->depth     = depth;
+	db->depth_arg = arg;
+	nni_rwlock_unlock(&(db->rwlock));
+}
+
 uint32_t *
 dbtree_find_shared_clients(dbtree *db, char *topic)
 {
-	cvector(uint32_t *) ids        = NULL;
+	return dbtree_find_shared_clients_by(db, topic, 0);
+}
+
+uint32_t *
+dbtree_find_shared_clients_by(dbtree *db, char *topic, uint32_t key)
+{
+	cvector(dbtree_node *) ids     = NULL;
 	cvector(dbtree_node *) nodes_p = NULL;
 	cvector(dbtree_node *) nodes_q = NULL;
 	bool   equal                   = false;
@@ -1404,7 +1538,7 @@ dbtree_find_shared_clients(dbtree *db, char *topic)
 		topic_queue++;
 	}
 
-	uint32_t *ret = iterate_shared_client(ids);
+	uint32_t *ret = iterate_shared_client(db, ids, key);
 	nni_rwlock_unlock(&(db->rwlock));
 	topic_queue_free(for_free);
 	cvector_free(nodes_p);
@@ -1,20 +1,26 @@
 #include <arrow/io/file.h>
 #include <parquet/stream_reader.h>
+#include <parquet/page_index.h>
+#include <parquet/statistics.h>
 #include <parquet/stream_writer.h>
 
 #include "nng/supplemental/nanolib/log.h"
 #include "nng/supplemental/nanolib/md5.h"
 #include "nng/supplemental/nanolib/parquet.h"
 #include "nng/supplemental/nanolib/queue.h"
+#include <algorithm>
 #include <assert.h>
 #include <atomic>
 #include <dirent.h>
 #include <fstream>
 #include <inttypes.h>
 #include <iostream>
+#include <list>
+#include <mutex>
 #include <string>
 #include <sys/stat.h>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 using namespace std;
 using parquet::ConvertedType;
@@ -38,6 +44,11 @@ atomic_bool is_available = false;
 		nng_msleep(10);
 
 #define UINT64_MAX_DIGITS 20
+#define PARQUET_READER_CACHE_SIZE 16
+#define PARQUET_READ_BATCH 1024
+#define PARQUET_READER_THREADS 4
+// Smaller pages give the page index a finer granularity to skip by
+#define PARQUET_DATA_PAGE_SIZE (64 * 1024)
 
 CircularQueue        parquet_queue;
 CircularQueue        parquet_file_queue;
@@ -45,6 +56,115 @@ pthread_mutex_t      parquet_queue_mutex     = PTHREAD_MUTEX_INITIALIZER;
 pthread_cond_t       parquet_queue_not_empty = PTHREAD_COND_INITIALIZER;
 static conf_parquet *g_conf                  = NULL;
 
+// Readers are kept open across queries so the footer and page index of a
+// file are parsed once instead of on every lookup.
+struct parquet_reader_entry {
+	string                                 filename;
+	unique_ptr<parquet::ParquetFileReader> reader;
+	mutex                                  mtx;
+};
+
+static list<shared_ptr<parquet_reader_entry>> parquet_reader_cache;
+static mutex                                  parquet_reader_cache_mtx;
+
+struct parquet_read_query {
+	nng_aio                      *aio;
+	conf_parquet                 *conf;
+	vector<uint64_t>              keys;
+	vector<parquet_data_packet *> packets;
+	size_t                        files;
+	atomic<size_t>                pending;
+	// set by the cancel function once the aio is finished without us,
+	// the readers then skip their work and only drop the query
+	atomic<bool> abandoned;
+	// a span query reads [low, high] instead of keys, one result list
+	// per file, joined in file order once all are read
+	bool                                  span;
+	uint64_t                              low;
+	uint64_t                              high;
+	vector<vector<parquet_data_packet *>> spans;
+};
+
+// One file worth of keys of a query, handed to the reader pool.
+struct parquet_read_task {
+	parquet_read_query *query;
+	string              filename;
+	vector<uint32_t>    idxs;
+	size_t              order; // of the file in a span query
+};
+
+CircularQueue   parquet_read_queue;
+pthread_mutex_t parquet_read_mutex     = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t  parquet_read_not_empty = PTHREAD_COND_INITIALIZER;
+static once_flag parquet_read_once;
+// Queries still owning their aio, under parquet_read_mutex.  The cancel
+// function only touches a query found here, so it never races its delete.
+static unordered_map<nng_aio *, parquet_read_query *> parquet_read_aios;
+
+struct parquet_page_span {
+	int64_t first;
+	int64_t rows;
+};
+
+// What a read is looking for: either a set of point keys, each with its own
+// result slot, or a contiguous key span whose rows are appended in order.
+struct parquet_key_filter {
+	bool                           span;
+	uint64_t                       low;
+	uint64_t                       high;
+	vector<pair<uint64_t, size_t>> keys;
+	size_t                         pending;
+
+	parquet_key_filter(const vector<uint64_t> &k)
+	    : span(false), low(0), high(0), pending(k.size())
+	{
+		for (size_t i = 0; i < k.size(); i++) {
+			keys.push_back(make_pair(k[i], i));
+		}
+		sort(keys.begin(), keys.end());
+	}
+
+	parquet_key_filter(uint64_t start, uint64_t end)
+	    : span(true), low(start), high(end), pending(0)
+	{
+	}
+
+	bool overlaps(uint64_t min, uint64_t max) const
+	{
+		if (span) {
+			return !(low > max || high < min);
+		}
+		auto it = lower_bound(
+		    keys.begin(), keys.end(), make_pair(min, (size_t) 0));
+		return it != keys.end() && it->first <= max;
+	}
+
+	void match(uint64_t key, int64_t row,
+	    vector<pair<int64_t, size_t>> &hits,
+	    vector<parquet_data_packet *> &out)
+	{
+		if (span) {
+			if (key >= low && key <= high) {
+				hits.push_back(make_pair(row, out.size()));
+				out.push_back(NULL);
+			}
+			return;
+		}
+		// First row carrying a key wins, as before
+		auto it = lower_bound(
+		    keys.begin(), keys.end(), make_pair(key, (size_t) 0));
+		for (; it != keys.end() && it->first == key; ++it) {
+			if (it->second != SIZE_MAX) {
+				hits.push_back(make_pair(row, it->second));
+				it->second = SIZE_MAX;
+				pending--;
+			}
+		}
+	}
+
+	bool done() const { return !span && pending == 0; }
+};
+
 static bool
 directory_exists(const std::string &directory_path)
 {
@@ -114,11 +234,14 @@ get_random_file_name(char *prefix, uint64_t key_start, uint64_t key_end)
 	return file_name;
 }
 
+static void parquet_reader_evict(const char *filename);
+
 static int
 remove_old_file(void)
 {
 	int   ret      = 0;
 	char *filename = (char *) DEQUEUE(parquet_file_queue);
+	parquet_reader_evict(filename);
 	if (remove(filename) == 0) {
 		log_debug("File '%s' removed successfully.\n", filename);
 	} else {
@@ -339,6 +462,8 @@ again:
 		builder.created_by("NanoMQ")
 		    ->version(parquet::ParquetVersion::PARQUET_2_6)
 		    ->data_page_version(parquet::ParquetDataPageVersion::V2)
+		    ->data_pagesize(PARQUET_DATA_PAGE_SIZE)
+		    ->enable_write_page_index()
 		    ->compression(static_cast<arrow::Compression::type>(
 		        conf->comp_type));
 
@@ -514,6 +639,8 @@ again:
 		builder.created_by("NanoMQ")
 		    ->version(parquet::ParquetVersion::PARQUET_2_6)
 		    ->data_page_version(parquet::ParquetDataPageVersion::V2)
+		    ->data_pagesize(PARQUET_DATA_PAGE_SIZE)
+		    ->enable_write_page_index()
 		    ->compression(static_cast<arrow::Compression::type>(
 		        conf->comp_type));
 		log_debug("check encry");
@@ -841,236 +968,359 @@ parquet_read_set_property(
 	return;
 }
 
-static uint8_t *
-parquet_read(conf_parquet *conf, char *filename, uint64_t key, uint32_t *len)
+static parquet_data_packet *
+parquet_data_packet_alloc(const uint8_t *data, uint32_t len)
 {
-	conf                                 = g_conf;
-	std::string               path_int64 = "key";
-	std::string               path_str   = "data";
+	parquet_data_packet *pack =
+	    (parquet_data_packet *) malloc(sizeof(parquet_data_packet));
+	if (pack == NULL) {
+		return NULL;
+	}
+	pack->data = (uint8_t *) malloc(len * sizeof(uint8_t));
+	if (pack->data == NULL && len != 0) {
+		free(pack);
+		return NULL;
+	}
+	memcpy(pack->data, data, len);
+	pack->size = len;
+	return pack;
+}
+
+static shared_ptr<parquet_reader_entry>
+parquet_reader_get(conf_parquet *conf, const char *filename)
+{
+	{
+		lock_guard<mutex> lk(parquet_reader_cache_mtx);
+		for (auto it = parquet_reader_cache.begin();
+		     it != parquet_reader_cache.end(); ++it) {
+			if ((*it)->filename == filename) {
+				parquet_reader_cache.splice(
+				    parquet_reader_cache.begin(),
+				    parquet_reader_cache, it);
+				return parquet_reader_cache.front();
+			}
+		}
+	}
+
+	// Open outside of the cache lock, parsing the footer of a large
+	// file must not stall lookups on other files.
 	parquet::ReaderProperties reader_properties =
 	    parquet::default_reader_properties();
-
 	parquet_read_set_property(reader_properties, conf);
+	// Only fetch the pages we ask for instead of whole column chunks.
+	reader_properties.enable_buffered_stream();
+
+	shared_ptr<parquet_reader_entry> entry =
+	    make_shared<parquet_reader_entry>();
+	entry->filename = filename;
+	entry->reader   = parquet::ParquetFileReader::OpenFile(
+            filename, false, reader_properties);
+
+	lock_guard<mutex> lk(parquet_reader_cache_mtx);
+	for (auto &e : parquet_reader_cache) {
+		if (e->filename == filename) {
+			return e;
+		}
+	}
+	parquet_reader_cache.push_front(entry);
+	if (parquet_reader_cache.size() > PARQUET_READER_CACHE_SIZE) {
+		parquet_reader_cache.pop_back();
+	}
+	return entry;
+}
 
-	// Create a ParquetReader instance
-	std::string exception_msg = "";
-	try {
-		std::unique_ptr<parquet::ParquetFileReader> parquet_reader =
-		    parquet::ParquetFileReader::OpenFile(
-		        filename, false, reader_properties);
-
-		// Get the File MetaData
-		std::shared_ptr<parquet::FileMetaData> file_metadata =
-		    parquet_reader->metadata();
-
-		int num_row_groups =
-		    file_metadata
-		        ->num_row_groups(); // Get the number of RowGroups
-		int num_columns =
-		    file_metadata->num_columns(); // Get the number of Columns
-		assert(num_columns == 2);
-
-		for (int r = 0; r < num_row_groups; ++r) {
-
-			std::shared_ptr<parquet::RowGroupReader>
-			    row_group_reader = parquet_reader->RowGroup(
-			        r); // Get the RowGroup Reader
-			int64_t values_read = 0;
-			int64_t rows_read   = 0;
-			int16_t definition_level;
-			int16_t repetition_level;
-			std::shared_ptr<parquet::ColumnReader> column_reader;
-
-			// Get the Column Reader for the Int64 column
-			column_reader = row_group_reader->Column(0);
-			parquet::Int64Reader *int64_reader =
-			    static_cast<parquet::Int64Reader *>(
-			        column_reader.get());
-
-			int i = 0;
-			while (int64_reader->HasNext()) {
-				int64_t value;
-				rows_read = int64_reader->ReadBatch(1,
-				    &definition_level, &repetition_level,
-				    &value, &values_read);
-				if (1 == rows_read && 1 == values_read) {
-					if (((uint64_t) value) == key)
-						break;
-				}
-				i++;
-			}
-
-			// Get the Column Reader for the ByteArray column
-			column_reader = row_group_reader->Column(1);
-			parquet::ByteArrayReader *ba_reader =
-			    static_cast<parquet::ByteArrayReader *>(
-			        column_reader.get());
+static void
+parquet_reader_evict(const char *filename)
+{
+	lock_guard<mutex> lk(parquet_reader_cache_mtx);
+	parquet_reader_cache.remove_if(
+	    [filename](const shared_ptr<parquet_reader_entry> &e) {
+		    return e->filename == filename;
+	    });
+}
 
-			if (ba_reader->HasNext()) {
-				ba_reader->Skip(i);
-			}
+// Row span of every data page of one column chunk. Without an offset
+// index the whole chunk is treated as a single page.
+static vector<parquet_page_span>
+parquet_page_spans(const shared_ptr<parquet::OffsetIndex> &oidx, int64_t rows)
+{
+	vector<parquet_page_span> spans;
+	if (oidx == nullptr || oidx->page_locations().empty()) {
+		spans.push_back({ 0, rows });
+		return spans;
+	}
+	const vector<parquet::PageLocation> &locs = oidx->page_locations();
+	for (size_t p = 0; p < locs.size(); p++) {
+		int64_t end = p + 1 < locs.size() ? locs[p + 1].first_row_index
+		                                  : rows;
+		spans.push_back({ locs[p].first_row_index,
+		    end - locs[p].first_row_index });
+	}
+	return spans;
+}
 
-			if (ba_reader->HasNext()) {
-				parquet::ByteArray value;
-				rows_read =
-				    ba_reader->ReadBatch(1, &definition_level,
-				        nullptr, &value, &values_read);
-				if (1 == rows_read && 1 == values_read) {
-					uint8_t *ret = (uint8_t *) malloc(
-					    value.len * sizeof(uint8_t));
-					memcpy(ret, value.ptr, value.len);
-					*len = value.len;
-					return ret;
-				}
-			}
+static size_t
+parquet_page_of(const vector<parquet_page_span> &spans, int64_t row)
+{
+	size_t lo = 0;
+	size_t hi = spans.size();
+	while (hi - lo > 1) {
+		size_t mid = (lo + hi) / 2;
+		if (spans[mid].first <= row) {
+			lo = mid;
+		} else {
+			hi = mid;
 		}
+	}
+	return lo;
+}
 
-	} catch (const std::exception &e) {
-		exception_msg = e.what();
-		log_error("exception_msg=[%s]", exception_msg.c_str());
+// Open column col of row group r so that only the pages flagged in wanted
+// are decompressed and decoded, the others are skipped by the page reader.
+static shared_ptr<parquet::ColumnReader>
+parquet_column_open(parquet::ParquetFileReader *reader, int r, int col,
+    const vector<bool> &wanted)
+{
+	shared_ptr<parquet::RowGroupReader> rg_reader = reader->RowGroup(r);
+	unique_ptr<parquet::PageReader>     pager =
+	    rg_reader->GetColumnPageReader(col);
+
+	if (wanted.size() > 1) {
+		shared_ptr<size_t> ordinal = make_shared<size_t>(0);
+		pager->set_data_page_filter(
+		    [wanted, ordinal](const parquet::DataPageStats &) {
+			    size_t p = (*ordinal)++;
+			    return p < wanted.size() && !wanted[p];
+		    });
 	}
+	return parquet::ColumnReader::Make(
+	    reader->metadata()->schema()->Column(col), std::move(pager));
+}
 
-	return NULL;
+static void
+parquet_page_index_get(parquet::ParquetFileReader *reader, int r,
+    shared_ptr<parquet::ColumnIndex> &key_cidx,
+    shared_ptr<parquet::OffsetIndex> &key_oidx,
+    shared_ptr<parquet::OffsetIndex> &data_oidx)
+{
+	// Files written before the page index was enabled (or with
+	// encrypted indexes we can not read) fall back to full scans.
+	try {
+		shared_ptr<parquet::PageIndexReader> pidx =
+		    reader->GetPageIndexReader();
+		if (pidx == nullptr) {
+			return;
+		}
+		shared_ptr<parquet::RowGroupPageIndexReader> rg_pidx =
+		    pidx->RowGroup(r);
+		if (rg_pidx == nullptr) {
+			return;
+		}
+		key_cidx  = rg_pidx->GetColumnIndex(0);
+		key_oidx  = rg_pidx->GetOffsetIndex(0);
+		data_oidx = rg_pidx->GetOffsetIndex(1);
+	} catch (const std::exception &e) {
+		log_debug("page index unavailable: %s", e.what());
+		key_cidx  = nullptr;
+		key_oidx  = nullptr;
+		data_oidx = nullptr;
+	}
 }
 
-static vector<int>
-get_keys_indexes(
-    parquet::Int64Reader *int64_reader, const vector<uint64_t> &keys)
+// Collect (row, slot) pairs of the rows of row group r that match the
+// filter, reading only the key pages whose min/max may match.
+static void
+parquet_scan_keys(parquet::ParquetFileReader *reader, int r, int64_t rows,
+    parquet_key_filter &filter, vector<pair<int64_t, size_t>> &hits,
+    vector<parquet_data_packet *> &out)
 {
-	vector<int> index_vector;
-	int64_t     values_read = 0;
-	int64_t     rows_read   = 0;
-	int16_t     definition_level;
-	int16_t     repetition_level;
-
-	// FIXME:
-	for (const auto &key : keys) {
-		int  i     = 0;
-		bool found = false;
-		while (int64_reader->HasNext()) {
-			int64_t value;
-			rows_read =
-			    int64_reader->ReadBatch(1, &definition_level,
-			        &repetition_level, &value, &values_read);
-			if (1 == rows_read && 1 == values_read) {
-				if (((uint64_t) value) == key) {
-					if (index_vector.empty()) {
-						index_vector.push_back(i);
-					} else {
-						index_vector.push_back(i);
-					}
-					found = true;
-					break;
+	shared_ptr<parquet::ColumnIndex> key_cidx;
+	shared_ptr<parquet::OffsetIndex> key_oidx;
+	shared_ptr<parquet::OffsetIndex> data_oidx;
+	parquet_page_index_get(reader, r, key_cidx, key_oidx, data_oidx);
+
+	vector<parquet_page_span> spans = parquet_page_spans(key_oidx, rows);
+	vector<bool>              wanted(spans.size(), true);
+	if (key_cidx != nullptr && key_oidx != nullptr &&
+	    spans.size() > 1) {
+		auto typed = static_pointer_cast<parquet::Int64ColumnIndex>(
+		    key_cidx);
+		const vector<bool>    &nulls = typed->null_pages();
+		const vector<int64_t> &mins  = typed->min_values();
+		const vector<int64_t> &maxs  = typed->max_values();
+		for (size_t p = 0; p < spans.size() && p < nulls.size(); p++) {
+			wanted[p] = !nulls[p] &&
+			    filter.overlaps((uint64_t) mins[p], (uint64_t) maxs[p]);
+		}
+	}
+
+	shared_ptr<parquet::ColumnReader> column_reader =
+	    parquet_column_open(reader, r, 0, wanted);
+	parquet::Int64Reader *int64_reader =
+	    static_cast<parquet::Int64Reader *>(column_reader.get());
+
+	int16_t definition_level[PARQUET_READ_BATCH];
+	int64_t values[PARQUET_READ_BATCH];
+	for (size_t p = 0; p < spans.size(); p++) {
+		if (!wanted[p]) {
+			continue;
+		}
+		int64_t row    = spans[p].first;
+		int64_t remain = spans[p].rows;
+		while (remain > 0 && int64_reader->HasNext()) {
+			int64_t values_read = 0;
+			int64_t levels      = int64_reader->ReadBatch(
+                            remain < PARQUET_READ_BATCH ? remain
+                                                             : PARQUET_READ_BATCH,
+                            definition_level, nullptr, values, &values_read);
+			if (levels <= 0) {
+				break;
+			}
+			int64_t v = 0;
+			for (int64_t i = 0; i < levels; i++, row++) {
+				if (definition_level[i] == 0) {
+					continue;
 				}
+				filter.match((uint64_t) values[v++], row, hits, out);
 			}
-			i++;
+			remain -= levels;
 		}
-		if (!found) {
-			index_vector.push_back(-1);
+	}
+}
+
+// Read the data column for the collected hits, fetching only the pages
+// that contain them.
+static void
+parquet_read_hits(parquet::ParquetFileReader *reader, int r, int64_t rows,
+    const vector<pair<int64_t, size_t>> &hits,
+    vector<parquet_data_packet *>       &out)
+{
+	shared_ptr<parquet::ColumnIndex> key_cidx;
+	shared_ptr<parquet::OffsetIndex> key_oidx;
+	shared_ptr<parquet::OffsetIndex> data_oidx;
+	parquet_page_index_get(reader, r, key_cidx, key_oidx, data_oidx);
+
+	vector<parquet_page_span> spans = parquet_page_spans(data_oidx, rows);
+	vector<bool>              wanted(spans.size(), spans.size() == 1);
+	for (const auto &hit : hits) {
+		wanted[parquet_page_of(spans, hit.first)] = true;
+	}
+
+	// Skipped pages are invisible to the column reader, so rows are
+	// addressed by their offset within the pages that are read.
+	vector<int64_t> base(spans.size());
+	int64_t         acc = 0;
+	for (size_t p = 0; p < spans.size(); p++) {
+		base[p] = acc;
+		if (wanted[p]) {
+			acc += spans[p].rows;
 		}
 	}
 
-	return index_vector;
+	shared_ptr<parquet::ColumnReader> column_reader =
+	    parquet_column_open(reader, r, 1, wanted);
+	parquet::ByteArrayReader *ba_reader =
+	    static_cast<parquet::ByteArrayReader *>(column_reader.get());
+
+	int64_t cursor = 0;
+	size_t  h      = 0;
+	while (h < hits.size()) {
+		int64_t row = hits[h].first;
+		size_t  p   = parquet_page_of(spans, row);
+		int64_t off = base[p] + row - spans[p].first;
+		if (off > cursor) {
+			cursor += ba_reader->Skip(off - cursor);
+		}
+
+		parquet::ByteArray value;
+		int16_t            definition_level;
+		int64_t            values_read = 0;
+		int64_t            rows_read   = 0;
+		if (off == cursor && ba_reader->HasNext()) {
+			rows_read = ba_reader->ReadBatch(
+			    1, &definition_level, nullptr, &value, &values_read);
+			cursor += rows_read;
+		}
+		if (rows_read == 0) {
+			break;
+		}
+		for (; h < hits.size() && hits[h].first == row; h++) {
+			if (1 == values_read) {
+				out[hits[h].second] =
+				    parquet_data_packet_alloc(value.ptr, value.len);
+			}
+		}
+	}
 }
 
-static vector<parquet_data_packet *>
-parquet_read(conf_parquet *conf, char *filename, vector<uint64_t> keys)
+static void
+parquet_read(conf_parquet *conf, const char *filename,
+    parquet_key_filter &filter, vector<parquet_data_packet *> &out)
 {
 	conf = g_conf;
-	vector<parquet_data_packet *> ret_vec;
-	std::string                   path_int64 = "key";
-	std::string                   path_str   = "data";
-	parquet::ReaderProperties     reader_properties =
-	    parquet::default_reader_properties();
-
-	parquet_read_set_property(reader_properties, conf);
-	vector<int> index_vector(keys.size());
 
-	// Create a ParquetReader instance
 	std::string exception_msg = "";
 	try {
-		std::unique_ptr<parquet::ParquetFileReader> parquet_reader =
-		    parquet::ParquetFileReader::OpenFile(
-		        filename, false, reader_properties);
-
-		// Get the File MetaData
-		std::shared_ptr<parquet::FileMetaData> file_metadata =
-		    parquet_reader->metadata();
-
-		int num_row_groups =
-		    file_metadata
-		        ->num_row_groups(); // Get the number of RowGroups
-		int num_columns =
-		    file_metadata->num_columns(); // Get the number of Columns
-		assert(num_columns == 2);
-
-		for (int r = 0; r < num_row_groups; ++r) {
-
-			std::shared_ptr<parquet::RowGroupReader>
-			    row_group_reader = parquet_reader->RowGroup(
-			        r); // Get the RowGroup Reader
-			int64_t values_read = 0;
-			int64_t rows_read   = 0;
-			int16_t definition_level;
-			std::shared_ptr<parquet::ColumnReader> column_reader;
-
-			column_reader = row_group_reader->Column(0);
-			parquet::Int64Reader *int64_reader =
-			    static_cast<parquet::Int64Reader *>(
-			        column_reader.get());
-
-			index_vector = get_keys_indexes(int64_reader, keys);
-			// Get the Column Reader for the ByteArray column
-			column_reader = row_group_reader->Column(1);
-			parquet::ByteArrayReader *ba_reader =
-			    static_cast<parquet::ByteArrayReader *>(
-			        column_reader.get());
-
-			for (const auto &index : index_vector) {
-				if (-1 == index) {
-					ret_vec.push_back(NULL);
+		shared_ptr<parquet_reader_entry> entry =
+		    parquet_reader_get(conf, filename);
+		lock_guard<mutex> lk(entry->mtx);
+
+		parquet::ParquetFileReader *reader = entry->reader.get();
+		shared_ptr<parquet::FileMetaData> file_metadata =
+		    reader->metadata();
+		assert(file_metadata->num_columns() == 2);
+
+		for (int r = 0; r < file_metadata->num_row_groups(); ++r) {
+			unique_ptr<parquet::RowGroupMetaData> rg_metadata =
+			    file_metadata->RowGroup(r);
+			shared_ptr<parquet::Statistics> stats =
+			    rg_metadata->ColumnChunk(0)->statistics();
+			if (stats != nullptr && stats->HasMinMax()) {
+				auto key_stats = static_pointer_cast<
+				    parquet::Int64Statistics>(stats);
+				if (!filter.overlaps((uint64_t) key_stats->min(),
+				        (uint64_t) key_stats->max())) {
 					continue;
 				}
+			}
 
-				if (ba_reader->HasNext()) {
-					ba_reader->Skip(index - 1);
-				}
-
-				if (ba_reader->HasNext()) {
-					parquet::ByteArray value;
-					rows_read = ba_reader->ReadBatch(1,
-					    &definition_level, nullptr, &value,
-					    &values_read);
-					if (1 == rows_read &&
-					    1 == values_read) {
-						parquet_data_packet *pack =
-						    (parquet_data_packet *)
-						        malloc(sizeof(
-						            parquet_data_packet));
-						pack->data =
-						    (uint8_t *) malloc(
-						        value.len *
-						        sizeof(uint8_t));
-						memcpy(pack->data, value.ptr,
-						    value.len);
-						pack->size = value.len;
-						ret_vec.push_back(pack);
-					}
-				}
+			int64_t                        rows = rg_metadata->num_rows();
+			vector<pair<int64_t, size_t>> hits;
+			parquet_scan_keys(reader, r, rows, filter, hits, out);
+			if (!hits.empty()) {
+				parquet_read_hits(reader, r, rows, hits, out);
+			}
+			if (filter.done()) {
+				break;
 			}
 		}
-
 	} catch (const std::exception &e) {
 		exception_msg = e.what();
 		log_error("exception_msg=[%s]", exception_msg.c_str());
+		parquet_reader_evict(filename);
 	}
+}
 
-	return ret_vec;
+static bool
+parquet_file_tracked(const char *filename)
+{
+	bool  found = false;
+	void *elem  = NULL;
+	pthread_mutex_lock(&parquet_queue_mutex);
+	FOREACH_QUEUE(parquet_file_queue, elem)
+	{
+		if (elem && nng_strcasecmp((char *) elem, filename) == 0) {
+			found = true;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&parquet_queue_mutex);
+	return found;
 }
 
 vector<parquet_data_packet *>
 parquet_find_data_packet(
-    conf_parquet *conf, char *filename, vector<uint64_t> keys)
+    conf_parquet *conf, const char *filename, vector<uint64_t> keys)
 {
 	vector<parquet_data_packet *> ret_vec;
 	if (g_conf == NULL || g_conf->enable == false) {
@@ -1078,100 +1328,339 @@ parquet_find_data_packet(
 		return ret_vec;
 	}
 	WAIT_FOR_AVAILABLE
-	void *elem = NULL;
-	pthread_mutex_lock(&parquet_queue_mutex);
-	FOREACH_QUEUE(parquet_file_queue, elem)
-	{
-		if (elem && nng_strcasecmp((char *) elem, filename) == 0) {
-			goto find;
-		}
-	}
 
-find:
-	pthread_mutex_unlock(&parquet_queue_mutex);
-
-	if (elem) {
-		ret_vec = parquet_read(conf, (char *) elem, keys);
-	} else {
-
-		ret_vec.resize(keys.size(), nullptr);
-		log_debug("Not find file %s in file queue", (char *) elem);
+	ret_vec.resize(keys.size(), nullptr);
+	if (!parquet_file_tracked(filename)) {
+		log_debug("Not find file %s in file queue", filename);
+		return ret_vec;
 	}
+
+	parquet_key_filter filter(keys);
+	parquet_read(conf, filename, filter, ret_vec);
 	return ret_vec;
 }
 
 parquet_data_packet *
 parquet_find_data_packet(conf_parquet *conf, char *filename, uint64_t key)
 {
-	if (g_conf == NULL || g_conf->enable == false) {
-		log_error("Parquet is not ready or not launch!");
+	vector<parquet_data_packet *> ret_vec =
+	    parquet_find_data_packet(conf, filename, vector<uint64_t>{ key });
+	if (ret_vec.empty() || ret_vec[0] == NULL) {
+		log_debug("No key %ld in file: %s", key, filename);
 		return NULL;
 	}
-	WAIT_FOR_AVAILABLE
-	void *elem = NULL;
-	pthread_mutex_lock(&parquet_queue_mutex);
-	FOREACH_QUEUE(parquet_file_queue, elem)
-	{
-		if (elem && nng_strcasecmp((char *) elem, filename) == 0) {
-			goto find;
+	return ret_vec[0];
+}
+
+static void
+parquet_read_query_free(parquet_read_query *query)
+{
+	for (auto &part : query->spans) {
+		query->packets.insert(
+		    query->packets.end(), part.begin(), part.end());
+	}
+	for (auto packet : query->packets) {
+		if (packet != NULL) {
+			free(packet->data);
+			free(packet);
 		}
 	}
+	delete query;
+}
 
-find:
-	pthread_mutex_unlock(&parquet_queue_mutex);
+static void
+parquet_read_query_finish(parquet_read_query *query)
+{
+	parquet_data_packet **packets = NULL;
+	nng_aio              *aio     = NULL;
+	uint32_t              len;
+	int                   rv = NNG_ENOENT;
+
+	pthread_mutex_lock(&parquet_read_mutex);
+	if (!query->abandoned) {
+		aio = query->aio;
+		parquet_read_aios.erase(aio);
+	}
+	pthread_mutex_unlock(&parquet_read_mutex);
+	if (aio == NULL) {
+		parquet_read_query_free(query);
+		return;
+	}
 
-	if (elem) {
-		uint32_t size = 0;
-		uint8_t *data = parquet_read(conf, (char *) elem, key, &size);
-		if (size) {
-			parquet_data_packet *pack =
-			    (parquet_data_packet *) malloc(
-			        sizeof(parquet_data_packet));
-			pack->data = data;
-			pack->size = size;
-			return pack;
-		} else {
-			log_debug(
-			    "No key %ld in file: %s", key, (char *) elem);
+	for (auto &part : query->spans) {
+		query->packets.insert(
+		    query->packets.end(), part.begin(), part.end());
+	}
+	len = query->packets.size();
+	if (query->files != 0 && len != 0) {
+		packets = (parquet_data_packet **) malloc(
+		    sizeof(parquet_data_packet *) * len);
+		copy(query->packets.begin(), query->packets.end(), packets);
+		rv = 0;
+	}
+	nng_aio_set_output(aio, 0, packets);
+	nng_aio_set_output(aio, 1, (void *) (uintptr_t) len);
+	nng_aio_finish(aio, rv);
+	delete query;
+}
+
+static void
+parquet_read_cancel(nng_aio *aio, void *arg, int rv)
+{
+	parquet_read_query *query = (parquet_read_query *) arg;
+
+	pthread_mutex_lock(&parquet_read_mutex);
+	auto it = parquet_read_aios.find(aio);
+	if (it == parquet_read_aios.end() || it->second != query) {
+		pthread_mutex_unlock(&parquet_read_mutex);
+		return;
+	}
+	parquet_read_aios.erase(it);
+	query->abandoned = true;
+	pthread_mutex_unlock(&parquet_read_mutex);
+
+	nng_aio_finish_error(aio, rv);
+}
+
+// Hands the tasks of a query to the reader pool.  The cancel function is in
+// place before any task runs, and from then on only it or the last reader
+// finishes the aio.
+static void
+parquet_read_query_submit(
+    parquet_read_query *query, vector<parquet_read_task *> &tasks)
+{
+	pthread_mutex_lock(&parquet_read_mutex);
+	parquet_read_aios[query->aio] = query;
+	pthread_mutex_unlock(&parquet_read_mutex);
+
+	nng_aio_defer(query->aio, parquet_read_cancel, query);
+
+	pthread_mutex_lock(&parquet_read_mutex);
+	for (auto task : tasks) {
+		ENQUEUE(parquet_read_queue, task);
+	}
+	pthread_cond_broadcast(&parquet_read_not_empty);
+	pthread_mutex_unlock(&parquet_read_mutex);
+}
+
+static void
+parquet_read_loop(void)
+{
+	while (true) {
+		pthread_mutex_lock(&parquet_read_mutex);
+		while (IS_EMPTY(parquet_read_queue)) {
+			pthread_cond_wait(
+			    &parquet_read_not_empty, &parquet_read_mutex);
 		}
+		parquet_read_task *task =
+		    (parquet_read_task *) DEQUEUE(parquet_read_queue);
+		pthread_mutex_unlock(&parquet_read_mutex);
+
+		parquet_read_query *query = task->query;
+		vector<uint64_t>    file_keys;
+
+		if (query->abandoned) {
+			delete task;
+			if (--query->pending == 0) {
+				parquet_read_query_finish(query);
+			}
+			continue;
+		}
+		if (query->span) {
+			parquet_key_filter filter(query->low, query->high);
+			if (parquet_file_tracked(task->filename.c_str())) {
+				parquet_read(query->conf,
+				    task->filename.c_str(), filter,
+				    query->spans[task->order]);
+			}
+			delete task;
+			if (--query->pending == 0) {
+				parquet_read_query_finish(query);
+			}
+			continue;
+		}
+		file_keys.reserve(task->idxs.size());
+		for (uint32_t idx : task->idxs) {
+			file_keys.push_back(query->keys[idx]);
+		}
+
+		auto tmp = parquet_find_data_packet(
+		    query->conf, task->filename.c_str(), file_keys);
+		for (size_t i = 0; i < tmp.size() && i < task->idxs.size();
+		     i++) {
+			query->packets[task->idxs[i]] = tmp[i];
+		}
+		delete task;
+
+		if (--query->pending == 0) {
+			parquet_read_query_finish(query);
+		}
+	}
+}
+
+static void
+parquet_read_launcher(void)
+{
+	INIT_QUEUE(parquet_read_queue);
+	for (int i = 0; i < PARQUET_READER_THREADS; i++) {
+		thread read_loop(parquet_read_loop);
+		read_loop.detach();
 	}
-	log_debug("Not find file %s in file queue", (char *) elem);
-	return NULL;
+}
+
+int
+parquet_find_data_packets_async(conf_parquet *conf, char **filenames,
+    uint64_t *keys, uint32_t len, nng_aio *aio)
+{
+	if (!nng_aio_begin(aio)) {
+		return NNG_ECLOSED;
+	}
+	call_once(parquet_read_once, parquet_read_launcher);
+
+	unordered_map<string, vector<uint32_t>> file_name_map;
+	// Group the keys by file, remembering where each result goes
+	for (uint32_t i = 0; i < len; i++) {
+		if (filenames[i] != NULL) {
+			file_name_map[filenames[i]].push_back(i);
+		}
+	}
+
+	parquet_read_query *query = new parquet_read_query;
+	query->aio                = aio;
+	query->conf               = conf;
+	query->span               = false;
+	query->abandoned          = false;
+	query->keys.assign(keys, keys + len);
+	query->packets.assign(len, nullptr);
+	query->files   = file_name_map.size();
+	query->pending = query->files;
+
+	if (query->files == 0) {
+		parquet_read_query_finish(query);
+		return 0;
+	}
+
+	// Every file is read once by one reader, files are read in parallel
+	vector<parquet_read_task *> tasks;
+	for (auto &entry : file_name_map) {
+		parquet_read_task *task = new parquet_read_task;
+		task->query             = query;
+		task->filename          = entry.first;
+		task->idxs              = std::move(entry.second);
+		tasks.push_back(task);
+	}
+	parquet_read_query_submit(query, tasks);
+
+	return 0;
 }
 
 parquet_data_packet **
 parquet_find_data_packets(
     conf_parquet *conf, char **filenames, uint64_t *keys, uint32_t len)
 {
-	unordered_map<char *, vector<uint64_t>> file_name_map;
-	vector<parquet_data_packet *>           ret_vec;
-	parquet_data_packet                   **packets = NULL;
-	// Get the file map
+	nng_aio              *aio     = NULL;
+	parquet_data_packet **packets = NULL;
+
+	if (nng_aio_alloc(&aio, NULL, NULL) != 0) {
+		log_error("Failed to allocate aio for parquet query");
+		return NULL;
+	}
+	if (parquet_find_data_packets_async(conf, filenames, keys, len, aio) ==
+	    0) {
+		nng_aio_wait(aio);
+		if (nng_aio_result(aio) == 0) {
+			packets =
+			    (parquet_data_packet **) nng_aio_get_output(aio, 0);
+		}
+	}
+	nng_aio_free(aio);
+
+	return packets;
+}
+
+void
+parquet_data_packets_free(parquet_data_packet **packets, uint32_t len)
+{
+	if (packets == NULL) {
+		return;
+	}
 	for (uint32_t i = 0; i < len; i++) {
-		vector<uint64_t> key_vec;
-		if (auto s = file_name_map.find(filenames[i]);
-		    s != file_name_map.end()) {
-			s->second.push_back(keys[i]);
-		} else {
-			key_vec.push_back(keys[i]);
-			file_name_map.insert(pair(filenames[i], key_vec));
+		if (packets[i] != NULL) {
+			free(packets[i]->data);
+			free(packets[i]);
 		}
 	}
+	free(packets);
+}
+
+int
+parquet_find_data_span_packets_async(
+    conf_parquet *conf, uint64_t start_key, uint64_t end_key, nng_aio *aio)
+{
+	uint32_t fsize = 0;
 
-	// Traverse the map and get the vector of parquet_data_packet
-	for (const auto &entry : file_name_map) {
-		char		        *filename = entry.first;
-		const std::vector<uint64_t> &sizes    = entry.second;
+	if (!nng_aio_begin(aio)) {
+		return NNG_ECLOSED;
+	}
+	call_once(parquet_read_once, parquet_read_launcher);
+
+	const char **fnames = parquet_find_span(start_key, end_key, &fsize);
+
+	parquet_read_query *query = new parquet_read_query;
+	query->aio                = aio;
+	query->conf               = conf;
+	query->span               = true;
+	query->abandoned          = false;
+	query->low                = start_key;
+	query->high               = end_key;
+	query->spans.resize(fsize);
+	query->files   = fsize;
+	query->pending = fsize;
+
+	if (fsize == 0) {
+		nng_free(fnames, sizeof(char *) * fsize);
+		parquet_read_query_finish(query);
+		return 0;
+	}
 
-		auto tmp = parquet_find_data_packet(conf, filename, sizes);
-		ret_vec.insert(ret_vec.end(), tmp.begin(), tmp.end());
+	// Files are read in parallel, the rows of each land in its own slot
+	vector<parquet_read_task *> tasks;
+	for (uint32_t i = 0; i < fsize; i++) {
+		parquet_read_task *task = new parquet_read_task;
+		task->query             = query;
+		task->filename          = fnames[i];
+		task->order             = i;
+		tasks.push_back(task);
+		nng_strfree((char *) fnames[i]);
 	}
+	nng_free(fnames, sizeof(char *) * fsize);
+	parquet_read_query_submit(query, tasks);
 
-	if (!ret_vec.empty()) {
-		packets = (parquet_data_packet **) malloc(
-		    sizeof(parquet_data_packet *) * len);
-		copy(ret_vec.begin(), ret_vec.end(), packets);
+	return 0;
+}
+
+parquet_data_packet **
+parquet_find_data_span_packets(conf_parquet *conf, uint64_t start_key,
+    uint64_t end_key, uint32_t *size)
+{
+	nng_aio              *aio     = NULL;
+	parquet_data_packet **packets = NULL;
+
+	*size = 0;
+	if (nng_aio_alloc(&aio, NULL, NULL) != 0) {
+		log_error("Failed to allocate aio for parquet query");
+		return NULL;
+	}
+	if (parquet_find_data_span_packets_async(
+	        conf, start_key, end_key, aio) == 0) {
+		nng_aio_wait(aio);
+		if (nng_aio_result(aio) == 0) {
+			packets =
+			    (parquet_data_packet **) nng_aio_get_output(aio, 0);
+			*size = (uint32_t) (uintptr_t) nng_aio_get_output(aio, 1);
+		}
 	}
+	nng_aio_free(aio);
 
 	return packets;
 }
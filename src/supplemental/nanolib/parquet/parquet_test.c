@@ -0,0 +1,127 @@
+//
+// Copyright 2024 NanoMQ Team, Inc. <jaylin@emqx.io>
+//
+// This software is supplied under the terms of the MIT License, a
+// copy of which should be located in the distribution where this
+// file was obtained (LICENSE.txt).  A copy of the license may also be
+// found online at https://opensource.org/licenses/MIT.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "nng/supplemental/nanolib/parquet.h"
+#include <nuts.h>
+
+#define SPAN_ROWS 200
+#define SPAN_ROW_SIZE 2048 // 400 KiB of data, several 64 KiB pages
+#define SPAN_KEY0 1000
+
+static conf_parquet span_conf = {
+	.enable           = true,
+	.file_name_prefix = "span",
+	.file_count       = 5,
+	.file_size        = 16 * 1024 * 1024,
+	.comp_type        = UNCOMPRESSED,
+};
+
+static uint8_t span_data[SPAN_ROWS][SPAN_ROW_SIZE];
+
+static void
+span_write(void)
+{
+	uint64_t  *keys   = malloc(sizeof(uint64_t) * SPAN_ROWS);
+	uint32_t  *dsize  = malloc(sizeof(uint32_t) * SPAN_ROWS);
+	uint8_t  **darray = malloc(sizeof(uint8_t *) * SPAN_ROWS);
+	nng_aio   *aio;
+
+	NUTS_ASSERT(keys != NULL && dsize != NULL && darray != NULL);
+	for (int i = 0; i < SPAN_ROWS; i++) {
+		memset(span_data[i], i & 0xff, SPAN_ROW_SIZE);
+		keys[i]   = SPAN_KEY0 + i;
+		dsize[i]  = SPAN_ROW_SIZE;
+		darray[i] = span_data[i];
+	}
+	NUTS_PASS(nng_aio_alloc(&aio, NULL, NULL));
+	NUTS_PASS(parquet_write_batch_async(
+	    parquet_object_alloc(keys, darray, dsize, SPAN_ROWS, aio, NULL)));
+	nng_aio_wait(aio);
+	NUTS_PASS(nng_aio_result(aio));
+	free(nng_aio_get_msg(aio));
+	nng_aio_free(aio);
+}
+
+static void
+span_check(parquet_data_packet **packets, uint32_t len, uint64_t start)
+{
+	for (uint32_t i = 0; i < len; i++) {
+		uint8_t fill = (uint8_t) ((start - SPAN_KEY0 + i) & 0xff);
+		NUTS_ASSERT(packets[i] != NULL);
+		NUTS_TRUE(packets[i]->size == SPAN_ROW_SIZE);
+		NUTS_TRUE(packets[i]->data[0] == fill);
+		NUTS_TRUE(packets[i]->data[SPAN_ROW_SIZE - 1] == fill);
+	}
+}
+
+void
+test_parquet_span(void)
+{
+	char                  dir[64];
+	parquet_data_packet **packets;
+	uint32_t              len;
+	nng_aio              *aio;
+
+	(void) snprintf(
+	    dir, sizeof(dir), "/tmp/parquet_span_%08x", nng_random());
+	NUTS_TRUE(mkdir(dir, 0755) == 0);
+	span_conf.dir = dir;
+	NUTS_PASS(parquet_write_launcher(&span_conf));
+	span_write();
+
+	// rows 50 to 149 start and end in the middle of data pages
+	packets = parquet_find_data_span_packets(
+	    NULL, SPAN_KEY0 + 50, SPAN_KEY0 + 149, &len);
+	NUTS_ASSERT(packets != NULL);
+	NUTS_TRUE(len == 100);
+	span_check(packets, len, SPAN_KEY0 + 50);
+	parquet_data_packets_free(packets, len);
+
+	// the same span on the reader pool
+	NUTS_PASS(nng_aio_alloc(&aio, NULL, NULL));
+	NUTS_PASS(parquet_find_data_span_packets_async(
+	    NULL, SPAN_KEY0 + 10, SPAN_KEY0 + 189, aio));
+	nng_aio_wait(aio);
+	NUTS_PASS(nng_aio_result(aio));
+	packets = nng_aio_get_output(aio, 0);
+	len     = (uint32_t) (uintptr_t) nng_aio_get_output(aio, 1);
+	NUTS_TRUE(len == 180);
+	span_check(packets, len, SPAN_KEY0 + 10);
+	parquet_data_packets_free(packets, len);
+
+	// a span beyond the keys written finds nothing
+	packets = parquet_find_data_span_packets(
+	    NULL, SPAN_KEY0 + SPAN_ROWS, SPAN_KEY0 + 2 * SPAN_ROWS, &len);
+	NUTS_TRUE(packets == NULL);
+	NUTS_TRUE(len == 0);
+	nng_aio_free(aio);
+
+	// stopping the aio waits for it, even with readers still busy
+	NUTS_PASS(nng_aio_alloc(&aio, NULL, NULL));
+	NUTS_PASS(parquet_find_data_span_packets_async(
+	    NULL, SPAN_KEY0, SPAN_KEY0 + SPAN_ROWS - 1, aio));
+	nng_aio_stop(aio);
+	if (nng_aio_result(aio) == 0) {
+		packets = nng_aio_get_output(aio, 0);
+		len     = (uint32_t) (uintptr_t) nng_aio_get_output(aio, 1);
+		parquet_data_packets_free(packets, len);
+	} else {
+		NUTS_FAIL(nng_aio_result(aio), NNG_ECANCELED);
+	}
+	nng_aio_free(aio);
+}
+
+NUTS_TESTS = {
+	{ "parquet span across pages", test_parquet_span },
+	{ NULL, NULL },
+};
@@ -8,6 +8,7 @@
 #include "nng/supplemental/nanolib/parquet.h"
 #include "nng/supplemental/nanolib/blf.h"
 #include "nng/supplemental/nanolib/ringbuffer.h"
+#include "ringbuffer_mmap.h"
 #include "core/nng_impl.h"
 
 static inline int ringBuffer_get_msgs(ringBuffer_t *rb, unsigned int *count, nng_msg ***list)
@@ -131,6 +132,7 @@ int ringBuffer_init(ringBuffer_t **rb,
 		return -1;
 	}
 
+	newRB->name[0] = '\0';
 	newRB->head = 0;
 	newRB->tail = 0;
 	newRB->size = 0;
@@ -139,6 +141,8 @@ int ringBuffer_init(ringBuffer_t **rb,
 	newRB->expiredAt = expiredAt;
 	newRB->fullOp = fullOp;
 	newRB->files = NULL;
+	newRB->mmap = NULL;
+	newRB->mmapDrop = false;
 
 	newRB->enqinRuleList[0] = NULL;
 	newRB->enqoutRuleList[0] = NULL;
@@ -365,6 +369,13 @@ static inline void free_msgs_from_file(uint64_t *keys, char **filenames,
 	}
 
 	if (filenames != NULL) {
+		/* Names are copies, keys of one file range share a copy */
+		for (uint32_t i = 0; i < request_count; i++) {
+			if (filenames[i] != NULL &&
+				(i == 0 || filenames[i] != filenames[i - 1])) {
+				nng_strfree(filenames[i]);
+			}
+		}
 		nng_free(filenames, sizeof(char *) * request_count);
 	}
 
@@ -385,7 +396,9 @@ static inline void free_msgs_from_file(uint64_t *keys, char **filenames,
 	if (packet != NULL) {
 		for (uint32_t i = 0; i < request_count; i++) {
 			if (packet[i] != NULL) {
-				nng_free(packet[i]->data, packet[i]->size);
+				if (packet[i]->data != NULL) {
+					nng_free(packet[i]->data, packet[i]->size);
+				}
 				nng_free(packet[i], sizeof(parquet_data_packet));
 			}
 		}
@@ -401,29 +414,39 @@ static inline int ringBuffer_get_filenames_with_keys(ringBuffer_t *rb, char ***f
 		log_error("ringbuffer is NULL or files is NULL or filenames is NULL or keys is NULL\n");
 		return -1;
 	}
-	char **fnames = nng_alloc(sizeof(char *) * count);
+	char **fnames = nng_zalloc(sizeof(char *) * count);
 	if (fnames == NULL) {
 		log_error("alloc new fnames failed! no memory! msg will be freed\n");
 		return -1;
 	}
 
+	/* Names are copied, files may be rotated out once ring_lock is released */
 	for (uint32_t i = 0; i < count; i++) {
-		fnames[i] = NULL;
 		for (uint32_t j = 0; j < cvector_size(rb->files); j++) {
 			ringBufferFile_t *file = rb->files[j];
 			if (file == NULL || file->keys == NULL) {
 				log_error("file is NULL or file keys is NULL\n");
-				nng_free(fnames, sizeof(char *) * count);
+				free_msgs_from_file(NULL, fnames, NULL, NULL,
+									NULL, 0, count);
 				return -1;
 			}
 
-			for (uint32_t k = 0; k < rb->cap; k++) {
+			for (uint32_t k = 0; k < file->keysLen; k++) {
 				if (file->keys[k] == keys[i]) {
-					fnames[i] = file->ranges[0]->filename;
+					fnames[i] = nng_strdup(file->ranges[0]->filename);
+					if (fnames[i] == NULL) {
+						log_error("copy filename failed! no memory!\n");
+						free_msgs_from_file(NULL, fnames, NULL, NULL,
+											NULL, 0, count);
+						return -1;
+					}
 					file_count++;
 					break;
 				}
 			}
+			if (fnames[i] != NULL) {
+				break;
+			}
 		}
 	}
 
@@ -455,18 +478,10 @@ static inline int init_newList_with_packet(void ***newList, int **newmsgLen,
 			continue;
 		}
 
-		char *msg = nng_alloc(packet[i]->size);
-		if (msg == NULL) {
-			log_error("alloc new msg failed! no memory! msg will be freed\n");
-			nng_free(list, sizeof(char *) * packet_count);
-			nng_free(msgLen, sizeof(int) * packet_count);
-			return -1;
-		}
-
-		memcpy(msg, packet[i]->data, packet[i]->size);
-
+		/* Take over the payload read from file instead of copying it */
 		msgLen[msgidx] = packet[i]->size;
-		list[msgidx++] = msg;
+		list[msgidx++] = (char *)packet[i]->data;
+		packet[i]->data = NULL;
 	}
 
 	*newList = (void **)list;
@@ -484,16 +499,23 @@ int ringBuffer_get_msgs_from_file_by_keys(ringBuffer_t *rb, uint64_t *keys, uint
 	}
 
 	char **filenames = NULL;
+	nng_mtx_lock(rb->ring_lock);
 	int ret = ringBuffer_get_filenames_with_keys(rb, &filenames, keys, count);
+	nng_mtx_unlock(rb->ring_lock);
 	if (ret <= 0 || filenames == NULL) {
 		log_error("get filenames failed\n");
+		if (filenames != NULL) {
+			free_msgs_from_file(NULL, filenames, NULL, NULL,
+								NULL, 0, count);
+		}
 		return -1;
 	}
 
 	parquet_data_packet **packet = parquet_find_data_packets(NULL, filenames, keys, count);
 	if (packet == NULL) {
 		log_error("packet is NULL\n");
-		nng_free(filenames, sizeof(char *) * count);
+		free_msgs_from_file(NULL, filenames, NULL, NULL,
+							NULL, 0, count);
 
 		return -1;
 	}
@@ -508,7 +530,8 @@ int ringBuffer_get_msgs_from_file_by_keys(ringBuffer_t *rb, uint64_t *keys, uint
 
 	if (packet_count == 0) {
 		log_error("packet count is 0\n");
-		nng_free(filenames, sizeof(char *) * count);
+		free_msgs_from_file(NULL, filenames, NULL, NULL,
+							packet, packet_count, count);
 
 		return -1;
 	}
@@ -529,15 +552,9 @@ int ringBuffer_get_msgs_from_file_by_keys(ringBuffer_t *rb, uint64_t *keys, uint
 
 }
 
-int ringBuffer_get_msgs_from_file(ringBuffer_t *rb, void ***msgs, int **msgLen)
+static inline int ringBuffer_get_keys_in_files(ringBuffer_t *rb, uint64_t **fkeys,
+											   char ***fnames, int *fcount)
 {
-	int ret = 0;
-
-	if (rb == NULL || rb->files == NULL || msgs == NULL || msgLen == NULL) {
-		log_error("ringbuffer is NULL or files is NULL or msgs is NULL or msgLen is NULL\n");
-		return -1;
-	}
-
 	int count = 0;
 	for (long unsigned int i = 0; i < cvector_size(rb->files); i++) {
 		for (long unsigned int j = 0; j < cvector_size(rb->files[i]->ranges); j++) {
@@ -551,7 +568,7 @@ int ringBuffer_get_msgs_from_file(ringBuffer_t *rb, void ***msgs, int **msgLen)
 		return -1;
 	}
 
-	char **filenames = nng_alloc(sizeof(char *) * count);
+	char **filenames = nng_zalloc(sizeof(char *) * count);
 	if (filenames == NULL) {
 		log_error("alloc new filenames failed! no memory! msg will be freed\n");
 		free_msgs_from_file(keys, NULL, NULL, NULL,
@@ -570,11 +587,151 @@ int ringBuffer_get_msgs_from_file(ringBuffer_t *rb, void ***msgs, int **msgLen)
 		}
 
 		for (long unsigned int j = 0; j < cvector_size(file->ranges); j++) {
+			/* One copy per range, files may be rotated out once ring_lock is released */
+			char *fname = nng_strdup(file->ranges[j]->filename);
+			if (fname == NULL) {
+				log_error("copy filename failed! no memory!\n");
+				free_msgs_from_file(keys, filenames, NULL, NULL,
+									NULL, 0, count);
+				return -1;
+			}
+			int first = tmpidx;
 			for (unsigned int k = file->ranges[j]->startidx; k <= file->ranges[j]->endidx; k++) {
 				keys[tmpidx] = file->keys[k];
-				filenames[tmpidx++] = file->ranges[j]->filename;
+				filenames[tmpidx++] = fname;
+			}
+			if (tmpidx == first) {
+				nng_strfree(fname);
+			}
+		}
+	}
+
+	*fkeys = keys;
+	*fnames = filenames;
+	*fcount = count;
+
+	return 0;
+}
+
+int ringBuffer_get_msgs_from_file_by_keys_async(ringBuffer_t **rbs, unsigned int rbsCount,
+												uint64_t *keys, uint32_t count, nng_aio *aio)
+{
+	if (rbs == NULL || rbsCount == 0 || keys == NULL || aio == NULL) {
+		log_error("ringbuffers is NULL or keys is NULL or aio is NULL\n");
+		return -1;
+	}
+
+	char **filenames = nng_zalloc(sizeof(char *) * count);
+	if (filenames == NULL) {
+		log_error("alloc new filenames failed! no memory!\n");
+		return -1;
+	}
+
+	int found = 0;
+	for (unsigned int i = 0; i < rbsCount; i++) {
+		char **fnames = NULL;
+
+		nng_mtx_lock(rbs[i]->ring_lock);
+		if (rbs[i]->files == NULL ||
+			ringBuffer_get_filenames_with_keys(rbs[i], &fnames, keys, count) <= 0) {
+			nng_mtx_unlock(rbs[i]->ring_lock);
+			if (fnames != NULL) {
+				free_msgs_from_file(NULL, fnames, NULL, NULL,
+									NULL, 0, count);
+			}
+			continue;
+		}
+		nng_mtx_unlock(rbs[i]->ring_lock);
+
+		/* the names are our copies, take them over */
+		for (uint32_t j = 0; j < count; j++) {
+			if (filenames[j] == NULL && fnames[j] != NULL) {
+				filenames[j] = fnames[j];
+				fnames[j] = NULL;
+				found++;
 			}
 		}
+		free_msgs_from_file(NULL, fnames, NULL, NULL, NULL, 0, count);
+	}
+
+	if (found == 0) {
+		log_error("get filenames failed\n");
+		nng_free(filenames, sizeof(char *) * count);
+		return -1;
+	}
+
+	/* filenames and keys are copied, the lookup runs on the reader pool */
+	int ret = parquet_find_data_packets_async(NULL, filenames, keys, count, aio);
+	free_msgs_from_file(NULL, filenames, NULL, NULL, NULL, 0, count);
+
+	return ret == 0 ? 0 : -1;
+}
+
+int ringBuffer_get_msgs_from_file_async(ringBuffer_t **rbs, unsigned int rbsCount, nng_aio *aio)
+{
+	if (rbs == NULL || rbsCount == 0 || aio == NULL) {
+		log_error("ringbuffers is NULL or aio is NULL\n");
+		return -1;
+	}
+
+	uint64_t *keys = NULL;
+	char **filenames = NULL;
+	for (unsigned int i = 0; i < rbsCount; i++) {
+		int rbcount = 0;
+		uint64_t *rbkeys = NULL;
+		char **rbfilenames = NULL;
+
+		nng_mtx_lock(rbs[i]->ring_lock);
+		if (rbs[i]->files == NULL ||
+			ringBuffer_get_keys_in_files(rbs[i], &rbkeys, &rbfilenames, &rbcount) != 0) {
+			nng_mtx_unlock(rbs[i]->ring_lock);
+			continue;
+		}
+		nng_mtx_unlock(rbs[i]->ring_lock);
+
+		/* the names are our copies, take them over */
+		for (int j = 0; j < rbcount; j++) {
+			cvector_push_back(keys, rbkeys[j]);
+			cvector_push_back(filenames, rbfilenames[j]);
+		}
+		nng_free(rbkeys, sizeof(uint64_t) * rbcount);
+		nng_free(rbfilenames, sizeof(char *) * rbcount);
+	}
+
+	if (cvector_size(keys) == 0) {
+		log_error("no msgs in files\n");
+		return -1;
+	}
+
+	int ret = parquet_find_data_packets_async(NULL, filenames, keys, cvector_size(keys), aio);
+	for (size_t j = 0; j < cvector_size(filenames); j++) {
+		if (j == 0 || filenames[j] != filenames[j - 1]) {
+			nng_strfree(filenames[j]);
+		}
+	}
+	cvector_free(keys);
+	cvector_free(filenames);
+
+	return ret == 0 ? 0 : -1;
+}
+
+int ringBuffer_get_msgs_from_file(ringBuffer_t *rb, void ***msgs, int **msgLen)
+{
+	int ret = 0;
+
+	if (rb == NULL || rb->files == NULL || msgs == NULL || msgLen == NULL) {
+		log_error("ringbuffer is NULL or files is NULL or msgs is NULL or msgLen is NULL\n");
+		return -1;
+	}
+
+	int count = 0;
+	uint64_t *keys = NULL;
+	char **filenames = NULL;
+	nng_mtx_lock(rb->ring_lock);
+	ret = ringBuffer_get_keys_in_files(rb, &keys, &filenames, &count);
+	nng_mtx_unlock(rb->ring_lock);
+	if (ret != 0) {
+		return -1;
 	}
 
 	int packet_count = 0;
@@ -799,6 +956,7 @@ static int write_msgs_to_file(ringBuffer_t *rb)
 	for (unsigned int i = 0; i < rb->cap; i++) {
 		parquet_file->keys[i] = rb->msgs[i].key;
 	}
+	parquet_file->keysLen = rb->cap;
 
 	cvector_push_back(rb->files, parquet_file);
 
@@ -834,6 +992,7 @@ static int write_msgs_to_file(ringBuffer_t *rb)
 	for (unsigned int i = 0; i < rb->cap; i++) {
 		blf_file->keys[i] = rb->msgs[i].key;
 	}
+	blf_file->keysLen = rb->cap;
 
 	cvector_push_back(rb->files, blf_file);
 
@@ -908,6 +1067,70 @@ int ringBuffer_set_fullOp(ringBuffer_t *rb, enum fullOption fullOp)
 	return 0;
 }
 
+int ringBuffer_set_mmap(ringBuffer_t *rb, const char *dir,
+						size_t segSize, unsigned int maxSegs)
+{
+	int ret;
+
+	if (rb == NULL) {
+		return -1;
+	}
+
+	nng_mtx_lock(rb->ring_lock);
+	if (ringBufferMmap_spilled(rb->mmap)) {
+		log_error("ringbuffer already spilled to mmap, can not change it\n");
+		nng_mtx_unlock(rb->ring_lock);
+		return -1;
+	}
+
+	ringBufferMmap_free(rb->mmap);
+	rb->mmap = NULL;
+	ret = ringBufferMmap_alloc(&rb->mmap, dir, segSize, maxSegs);
+	nng_mtx_unlock(rb->ring_lock);
+
+	return ret;
+}
+
+int ringBuffer_set_mmap_drop(ringBuffer_t *rb, bool drop)
+{
+	if (rb == NULL) {
+		return -1;
+	}
+
+	nng_mtx_lock(rb->ring_lock);
+	rb->mmapDrop = drop;
+	nng_mtx_unlock(rb->ring_lock);
+
+	return 0;
+}
+
+/* Move the oldest msg to the mmap tier to make room for a new one */
+static int spill_msg_to_mmap(ringBuffer_t *rb)
+{
+	int ret;
+
+	if (rb->mmap == NULL) {
+		ret = ringBufferMmap_alloc(&rb->mmap, RB_MMAP_DEFAULT_DIR,
+								   RB_MMAP_DEFAULT_SEG_SIZE,
+								   RB_MMAP_DEFAULT_MAX_SEGS);
+		if (ret != 0) {
+			return -1;
+		}
+	}
+
+	ret = ringBufferMmap_append(rb, &rb->msgs[rb->head]);
+	if (ret != 0) {
+		return -1;
+	}
+
+	nng_msg_free(rb->msgs[rb->head].data);
+	rb->msgs[rb->head].data = NULL;
+	rb->head = (rb->head + 1) % rb->cap;
+	rb->size--;
+
+	return 0;
+}
+
 int ringBuffer_enqueue(ringBuffer_t *rb,
 					   uint64_t key,
 					   void *data,
@@ -915,6 +1138,7 @@ int ringBuffer_enqueue(ringBuffer_t *rb,
 					   nng_aio *aio)
 {
 	int ret;
+	ringBufferMmap_t *spill = NULL;
 
 	nng_mtx_lock(rb->ring_lock);
 	ret = ringBuffer_rule_check(rb, data, ENQUEUE_IN_HOOK);
@@ -949,6 +1173,16 @@ int ringBuffer_enqueue(ringBuffer_t *rb,
 				return -1;
 			}
 		}
+		if (rb->fullOp == RB_FULL_MMAP) {
+			ret = spill_msg_to_mmap(rb);
+			if (ret != 0) {
+				log_error("Ring buffer is full and spill msg to mmap failed!\n");
+				nng_mtx_unlock(rb->ring_lock);
+				return -1;
+			}
+			/* It is kept until release once it was spilled to */
+			spill = rb->mmap;
+		}
 	}
 
 	ringBufferMsg_t *msg = &rb->msgs[rb->tail];
@@ -963,6 +1197,11 @@ int ringBuffer_enqueue(ringBuffer_t *rb,
 	(void)ringBuffer_rule_check(rb, data, ENQUEUE_OUT_HOOK);
 
 	nng_mtx_unlock(rb->ring_lock);
+
+	/* The next segment is created and mapped here, not under ring_lock */
+	if (spill != NULL) {
+		(void)ringBufferMmap_prepare(spill, rb->name);
+	}
 	return 0;
 }
 
@@ -976,6 +1215,18 @@ int ringBuffer_dequeue(ringBuffer_t *rb, void **data)
 		return -1;
 	}
 
+	/* Spilled msgs are older than any in RAM, they go first */
+	if (ringBufferMmap_count(rb->mmap) != 0) {
+		if (ringBufferMmap_pop(rb->mmap, (nng_msg **)data) != 0) {
+			log_error("Ring buffer dequeue from mmap failed\n");
+			nng_mtx_unlock(rb->ring_lock);
+			return -1;
+		}
+		(void)ringBuffer_rule_check(rb, *data, DEQUEUE_OUT_HOOK);
+		nng_mtx_unlock(rb->ring_lock);
+		return 0;
+	}
+
 	if (rb->size == 0) {
 		log_error("Ring buffer is NULL dequeue failed\n");
 		nng_mtx_unlock(rb->ring_lock);
@@ -1045,6 +1296,9 @@ int ringBuffer_release(ringBuffer_t *rb)
 		cvector_free(rb->files);
 	}
 
+	ringBufferMmap_free(rb->mmap);
+	rb->mmap = NULL;
+
 	ringBufferRuleList_release(rb->enqinRuleList, rb->enqinRuleListLen);
 	ringBufferRuleList_release(rb->deqinRuleList, rb->deqinRuleListLen);
 	ringBufferRuleList_release(rb->enqoutRuleList, rb->enqoutRuleListLen);
@@ -1128,6 +1382,12 @@ int ringBuffer_add_rule(ringBuffer_t *rb,
 	return 0;
 }
 
+/* i-th msg counted from head */
+static inline ringBufferMsg_t *ringBuffer_msg_at(ringBuffer_t *rb, unsigned int i)
+{
+	return &rb->msgs[(rb->head + i) % rb->cap];
+}
+
 int ringBuffer_search_msg_by_key(ringBuffer_t *rb, uint64_t key, nng_msg **msg)
 {
 	unsigned int i = 0;
@@ -1137,107 +1397,130 @@ int ringBuffer_search_msg_by_key(ringBuffer_t *rb, uint64_t key, nng_msg **msg)
 	}
 
 	nng_mtx_lock(rb->ring_lock);
-	for (i = rb->head; i < rb->size; i++) {
-		i = i % rb->cap;
-		if (rb->msgs[i].key == key) {
-			*msg = rb->msgs[i].data;
+	for (i = 0; i < rb->size; i++) {
+		ringBufferMsg_t *rbmsg = ringBuffer_msg_at(rb, i);
+		if (rbmsg->key == key) {
+			*msg = rbmsg->data;
 			nng_mtx_unlock(rb->ring_lock);
 			return 0;
 		}
 	}
 
+	/* Not in RAM, try the msgs spilled to mmap */
+	if (rb->mmap != NULL && ringBufferMmap_search(rb->mmap, key, msg) == 0) {
+		nng_mtx_unlock(rb->ring_lock);
+		return 0;
+	}
+
 	nng_mtx_unlock(rb->ring_lock);
 	return -1;
 }
 
 /*
- * binary search, only for ringbuffer head is 0
+ * binary search over the msgs in RAM, keys are expected to be ascending.
+ * Msgs spilled to mmap are older, so they come first in the list. At most
+ * limit msgs are returned, the ones with the lowest keys.
  */
-int ringBuffer_search_msgs_fuzz(ringBuffer_t *rb,
-								uint64_t start,
-								uint64_t end,
-								uint32_t *count,
-								nng_msg ***list)
+static int ringBuffer_search_msgs_span(ringBuffer_t *rb,
+									   uint64_t start,
+									   uint64_t end,
+									   uint32_t limit,
+									   uint32_t *count,
+									   nng_msg ***list)
 {
 	uint32_t low = 0;
 	uint32_t high = 0;
 	uint32_t mid = 0;
 	uint32_t start_index = 0;
 	uint32_t end_index = 0;
+	uint32_t ram_count = 0;
+	nng_msg **mmapList = NULL;
 
-	nng_mtx_lock(rb->ring_lock);
-	if (rb == NULL || rb->size == 0 || count == NULL || list == NULL) {
-		nng_mtx_unlock(rb->ring_lock);
+	if (rb == NULL || count == NULL || list == NULL) {
 		log_error("ringbuffer is NULL or count is NULL or list is NULL\n");
 		return -1;
 	}
 
-	if (start > end ||
-		start > rb->msgs[rb->head + rb->size - 1].key ||
-		end < rb->msgs[rb->head].key) {
-		nng_mtx_unlock(rb->ring_lock);
+	if (start > end) {
 		return -1;
 	}
 
-	if (rb->head != 0) {
-		log_error("Ringbuffer head is not 0, can not use binary search\n");
+	nng_mtx_lock(rb->ring_lock);
+	if (rb->mmap != NULL &&
+		ringBufferMmap_search_fuzz(rb->mmap, start, end, limit, &mmapList) != 0) {
+		cvector_free(mmapList);
 		nng_mtx_unlock(rb->ring_lock);
 		return -1;
 	}
 
-	low	= rb->head;
-	high = rb->head + rb->size - 1;
-	while (low < high) {
-		mid = (low + high) / 2;
-		if (rb->msgs[mid].key < start) {
-			low = mid + 1;
-		} else {
-			high = mid;
+	if (rb->size != 0 &&
+		start <= ringBuffer_msg_at(rb, rb->size - 1)->key &&
+		end >= ringBuffer_msg_at(rb, 0)->key) {
+		low	= 0;
+		high = rb->size - 1;
+		while (low < high) {
+			mid = (low + high) / 2;
+			if (ringBuffer_msg_at(rb, mid)->key < start) {
+				low = mid + 1;
+			} else {
+				high = mid;
+			}
 		}
-	}
-
-	if (rb->msgs[high].key >= start) {
 		start_index = high;
-	} else {
-		nng_mtx_unlock(rb->ring_lock);
-		return -1;
-	}
 
-	low	= rb->head;
-	high = rb->head + rb->size - 1;
-	while (low < high) {
-		mid = (low + high + 1) / 2;
-		if (rb->msgs[mid].key <= end) {
-			low = mid;
-		} else {
-			high = mid - 1;
+		low	= 0;
+		high = rb->size - 1;
+		while (low < high) {
+			mid = (low + high + 1) / 2;
+			if (ringBuffer_msg_at(rb, mid)->key <= end) {
+				low = mid;
+			} else {
+				high = mid - 1;
+			}
+		}
+		end_index = low;
+
+		if (ringBuffer_msg_at(rb, start_index)->key >= start &&
+			ringBuffer_msg_at(rb, end_index)->key <= end &&
+			start_index <= end_index) {
+			ram_count = end_index - start_index + 1;
+		}
+		if (ram_count > limit - cvector_size(mmapList)) {
+			ram_count = limit - cvector_size(mmapList);
 		}
 	}
 
-	if (rb->msgs[low].key > end) {
+	*count = cvector_size(mmapList) + ram_count;
+	if (*count == 0) {
+		cvector_free(mmapList);
 		nng_mtx_unlock(rb->ring_lock);
 		return -1;
-	} else {
-		end_index = low;
 	}
 
-	*count = end_index - start_index + 1;
 	nng_msg **newList = nng_alloc((*count) * sizeof(nng_msg *));
 	if (newList == NULL) {
+		cvector_free(mmapList);
 		nng_mtx_unlock(rb->ring_lock);
 		return -1;
 	}
 
-	for (uint32_t i = start_index; i <= end_index; i++) {
-		nng_msg *msg = rb->msgs[i].data;
+	uint32_t j = 0;
+	for (; j < cvector_size(mmapList); j++) {
+		newList[j] = mmapList[j];
+	}
+	cvector_free(mmapList);
+
+	for (uint32_t i = 0; i < ram_count; i++) {
+		ringBufferMsg_t *rbmsg = ringBuffer_msg_at(rb, start_index + i);
+		nng_msg *msg = rbmsg->data;
 		if (msg == NULL) {
 			nng_free(newList, sizeof(*newList));
 			nng_mtx_unlock(rb->ring_lock);
 			log_error("msg is NULL and some error occured\n");
 			return -1;
 		}
-		nng_msg_set_proto_data(msg, NULL, (void *)(uintptr_t)rb->msgs[i].key);
-		newList[i - start_index] = msg;
+		nng_msg_set_proto_data(msg, NULL, (void *)(uintptr_t)rbmsg->key);
+		newList[j++] = msg;
 	}
 
 	*list = newList;
@@ -1245,6 +1528,27 @@ int ringBuffer_search_msgs_fuzz(ringBuffer_t *rb,
 	return 0;
 }
 
+int ringBuffer_search_msgs_fuzz(ringBuffer_t *rb,
+								uint64_t start,
+								uint64_t end,
+								uint32_t *count,
+								nng_msg ***list)
+{
+	return ringBuffer_search_msgs_span(rb, start, end, UINT32_MAX, count, list);
+}
+
+int ringBuffer_search_msgs_from(ringBuffer_t *rb,
+								uint64_t start,
+								uint32_t limit,
+								uint32_t *count,
+								nng_msg ***list)
+{
+	if (limit == 0) {
+		return -1;
+	}
+	return ringBuffer_search_msgs_span(rb, start, UINT64_MAX, limit, count, list);
+}
+
 int ringBuffer_search_msgs_by_key(ringBuffer_t *rb, uint64_t key, uint32_t count, nng_msg ***list)
 {
 	unsigned int i = 0;
@@ -1266,17 +1570,15 @@ int ringBuffer_search_msgs_by_key(ringBuffer_t *rb, uint64_t key, uint32_t count
 		return -1;
 	}
 
-	for (i = rb->head; i < rb->size; i++) {
-		i = i % rb->cap;
-		if (rb->msgs[i].key == key) {
+	for (i = 0; i < rb->size; i++) {
+		if (ringBuffer_msg_at(rb, i)->key == key) {
 			for (j = 0; j < count; j++) {
-				nng_msg *msg = rb->msgs[i].data;
+				ringBufferMsg_t *rbmsg = ringBuffer_msg_at(rb, i + j);
+				nng_msg *msg = rbmsg->data;
 
-				nng_msg_set_proto_data(msg, NULL, (void *)(uintptr_t)rb->msgs[i].key);
+				nng_msg_set_proto_data(msg, NULL, (void *)(uintptr_t)rbmsg->key);
 
 				newList[j] = msg;
-
-				i = (i + 1) % rb->cap;
 			}
 			*list = newList;
 			nng_mtx_unlock(rb->ring_lock);
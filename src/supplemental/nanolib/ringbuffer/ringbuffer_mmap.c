@@ -0,0 +1,858 @@
+//
+// Copyright 2023 NanoMQ Team, Inc.
+// This software is supplied under the terms of the MIT License, a
+// copy of which should be located in the distribution where this
+// file was obtained (LICENSE.txt).  A copy of the license may also be
+// found online at https://opensource.org/licenses/MIT.
+//
+#include "nng/supplemental/nanolib/parquet.h"
+#include "ringbuffer_mmap.h"
+#include "core/nng_impl.h"
+
+#ifdef NNG_PLATFORM_POSIX
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define RB_MMAP_ALIGN(n)      (((n) + 7) & ~((size_t) 7))
+#define RB_MMAP_NO_PAYLOAD    0xffffffff
+
+enum rbMmapSegState {
+	RB_SEG_OPEN,
+	RB_SEG_SEALED,
+	RB_SEG_CONVERTING,
+	RB_SEG_CONVERTED,
+};
+
+/* Layout of each record, followed by header and body of the message */
+typedef struct {
+	uint64_t key;
+	uint64_t expiredAt;
+	uint32_t hlen;
+	uint32_t blen;
+	uint32_t poff;
+	uint8_t  type;
+	uint8_t  pad[3];
+} rbMmapRecord_t;
+
+typedef struct {
+	uint64_t key;
+	size_t   off;
+	/* Materialized on first lookup, freed with the segment */
+	nng_msg *msg;
+} rbMmapEntry_t;
+
+typedef struct rbMmapSeg_s rbMmapSeg_t;
+
+struct rbMmapSeg_s {
+	ringBufferMmap_t       *mm;
+	char                   *path;
+	int                     fd;
+	uint8_t                *base;
+	size_t                  len;
+	size_t                  used;
+	uint64_t                minKey;
+	uint64_t                maxKey;
+	bool                    sorted;
+	/* Entries before head were dequeued */
+	size_t                  head;
+	/* Protected by mm->mtx once the segment is sealed */
+	enum rbMmapSegState     state;
+	rbMmapEntry_t          *entries;
+	nng_aio                *aio;
+	ringBufferFileRange_t **ranges;
+};
+
+struct ringBufferMmap_s {
+	char         *dir;
+	size_t        segSize;
+	unsigned int  maxSegs;
+	unsigned int  count;
+	/* Oldest first, the last one is the one being appended to */
+	rbMmapSeg_t **segs;
+	nng_mtx      *mtx;
+	/* Under mtx, opened ahead of time outside ring_lock */
+	uint64_t      seq;
+	rbMmapSeg_t  *spare;
+	bool          preparing;
+};
+
+int ringBufferMmap_alloc(ringBufferMmap_t **mmp, const char *dir,
+                         size_t segSize, unsigned int maxSegs)
+{
+#ifdef NNG_PLATFORM_POSIX
+	ringBufferMmap_t *mm;
+
+	if (mmp == NULL || dir == NULL || segSize < sizeof(rbMmapRecord_t) || maxSegs == 0) {
+		log_error("ringbuffer mmap dir is NULL or segSize/maxSegs is not valid\n");
+		return -1;
+	}
+
+	mm = nng_alloc(sizeof(ringBufferMmap_t));
+	if (mm == NULL) {
+		log_error("alloc ringbuffer mmap failed! no memory!\n");
+		return -1;
+	}
+
+	mm->dir = nng_strdup(dir);
+	if (mm->dir == NULL) {
+		log_error("alloc ringbuffer mmap dir failed! no memory!\n");
+		nng_free(mm, sizeof(ringBufferMmap_t));
+		return -1;
+	}
+	if (nng_mtx_alloc(&mm->mtx) != 0) {
+		log_error("alloc ringbuffer mmap mutex failed!\n");
+		nng_strfree(mm->dir);
+		nng_free(mm, sizeof(ringBufferMmap_t));
+		return -1;
+	}
+
+	mm->segSize = segSize;
+	mm->maxSegs = maxSegs;
+	mm->count = 0;
+	mm->seq = 0;
+	mm->segs = NULL;
+	mm->spare = NULL;
+	mm->preparing = false;
+
+	*mmp = mm;
+	return 0;
+#else
+	NNI_ARG_UNUSED(mmp);
+	NNI_ARG_UNUSED(dir);
+	NNI_ARG_UNUSED(segSize);
+	NNI_ARG_UNUSED(maxSegs);
+	log_error("RB_FULL_MMAP is only supported on posix platforms\n");
+	return -1;
+#endif
+}
+
+#ifdef NNG_PLATFORM_POSIX
+
+static inline enum rbMmapSegState rbMmapSeg_state(rbMmapSeg_t *seg)
+{
+	enum rbMmapSegState state;
+
+	nng_mtx_lock(seg->mm->mtx);
+	state = seg->state;
+	nng_mtx_unlock(seg->mm->mtx);
+
+	return state;
+}
+
+static inline rbMmapRecord_t *rbMmapSeg_record(rbMmapSeg_t *seg, size_t off)
+{
+	return (rbMmapRecord_t *)(seg->base + off);
+}
+
+static rbMmapSeg_t *rbMmapSeg_open(ringBufferMmap_t *mm, const char *name, size_t need)
+{
+	rbMmapSeg_t *seg;
+	size_t pagesize = (size_t)sysconf(_SC_PAGESIZE);
+	size_t len = mm->segSize;
+	unsigned long long seq;
+	int plen;
+
+	if (name[0] == '\0') {
+		name = "ringbuffer";
+	}
+
+	if (need > len) {
+		/* A single message larger than segSize gets its own segment */
+		len = need;
+	}
+	len = (len + pagesize - 1) / pagesize * pagesize;
+
+	seg = nng_alloc(sizeof(rbMmapSeg_t));
+	if (seg == NULL) {
+		log_error("alloc mmap segment failed! no memory!\n");
+		return NULL;
+	}
+
+	nng_mtx_lock(mm->mtx);
+	seq = (unsigned long long)mm->seq++;
+	nng_mtx_unlock(mm->mtx);
+
+	/* Sized to the exact string, it is released by nng_strfree */
+	plen = snprintf(NULL, 0, "%s/%s-%d-%llu.rbseg", mm->dir, name,
+	                (int)getpid(), seq) + 1;
+	seg->path = nng_alloc(plen);
+	if (seg->path == NULL) {
+		log_error("alloc mmap segment path failed! no memory!\n");
+		nng_free(seg, sizeof(rbMmapSeg_t));
+		return NULL;
+	}
+	(void)snprintf(seg->path, plen, "%s/%s-%d-%llu.rbseg", mm->dir, name,
+	               (int)getpid(), seq);
+
+	seg->fd = open(seg->path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (seg->fd < 0) {
+		log_error("open mmap segment %s failed: %s\n", seg->path, strerror(errno));
+		nng_strfree(seg->path);
+		nng_free(seg, sizeof(rbMmapSeg_t));
+		return NULL;
+	}
+	if (ftruncate(seg->fd, (off_t)len) != 0) {
+		log_error("resize mmap segment %s failed: %s\n", seg->path, strerror(errno));
+		goto fail;
+	}
+	seg->base = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, seg->fd, 0);
+	if (seg->base == MAP_FAILED) {
+		log_error("mmap segment %s failed: %s\n", seg->path, strerror(errno));
+		goto fail;
+	}
+
+	seg->mm = mm;
+	seg->len = len;
+	seg->used = 0;
+	seg->minKey = UINT64_MAX;
+	seg->maxKey = 0;
+	seg->sorted = true;
+	seg->head = 0;
+	seg->state = RB_SEG_OPEN;
+	seg->entries = NULL;
+	seg->aio = NULL;
+	seg->ranges = NULL;
+
+	log_debug("ringbus: open spill segment %s size %zu", seg->path, len);
+	return seg;
+
+fail:
+	close(seg->fd);
+	(void)unlink(seg->path);
+	nng_strfree(seg->path);
+	nng_free(seg, sizeof(rbMmapSeg_t));
+	return NULL;
+}
+
+static void rbMmapSeg_free(rbMmapSeg_t *seg)
+{
+	if (seg->aio != NULL) {
+		nng_aio_free(seg->aio);
+	}
+
+	for (size_t i = 0; i < cvector_size(seg->entries); i++) {
+		if (seg->entries[i].msg != NULL) {
+			nng_msg_free(seg->entries[i].msg);
+		}
+	}
+	cvector_free(seg->entries);
+
+	for (size_t i = 0; i < cvector_size(seg->ranges); i++) {
+		nng_strfree(seg->ranges[i]->filename);
+		nng_free(seg->ranges[i], sizeof(ringBufferFileRange_t));
+	}
+	cvector_free(seg->ranges);
+
+	(void)munmap(seg->base, seg->len);
+	close(seg->fd);
+	(void)unlink(seg->path);
+	nng_strfree(seg->path);
+	nng_free(seg, sizeof(rbMmapSeg_t));
+}
+
+#ifdef SUPP_PARQUET
+static void rbMmapSeg_parquet_cb(void *arg)
+{
+	rbMmapSeg_t *seg = arg;
+	ringBufferFileRange_t **ranges = NULL;
+
+	uint32_t *szp = (uint32_t *)nng_aio_get_msg(seg->aio);
+	if (szp != NULL) {
+		free(szp);
+		nng_aio_set_msg(seg->aio, NULL);
+	}
+
+	parquet_file_ranges *file_ranges = nng_aio_get_output(seg->aio, 1);
+	if (nng_aio_result(seg->aio) != 0 || file_ranges == NULL || file_ranges->size == 0) {
+		log_error("parquet write of spill segment %s failed, keep it\n", seg->path);
+		nng_mtx_lock(seg->mm->mtx);
+		seg->state = RB_SEG_SEALED;
+		nng_mtx_unlock(seg->mm->mtx);
+		return;
+	}
+
+	int count = 0;
+	for (int i = file_ranges->start; count < file_ranges->size; count++, i++) {
+		if (i >= file_ranges->size) {
+			i = 0;
+		}
+		parquet_file_range *file_range = file_ranges->range[i];
+
+		ringBufferFileRange_t *range = nng_alloc(sizeof(ringBufferFileRange_t));
+		if (range == NULL) {
+			log_error("alloc new file range failed! no memory!\n");
+			break;
+		}
+		range->startidx = file_range->start_idx;
+		range->endidx = file_range->end_idx;
+		range->filename = nng_strdup(file_range->filename);
+		if (range->filename == NULL) {
+			log_error("alloc new file range filename failed! no memory!\n");
+			nng_free(range, sizeof(ringBufferFileRange_t));
+			break;
+		}
+		cvector_push_back(ranges, range);
+		log_info("ringbus: spill segment %s written to %s", seg->path, range->filename);
+	}
+
+	nng_mtx_lock(seg->mm->mtx);
+	seg->ranges = ranges;
+	seg->state = ranges != NULL ? RB_SEG_CONVERTED : RB_SEG_SEALED;
+	nng_mtx_unlock(seg->mm->mtx);
+}
+
+/* Hand a sealed segment to the parquet writer, straight from the mapping */
+static void rbMmapSeg_convert(rbMmapSeg_t *seg)
+{
+	uint32_t n = cvector_size(seg->entries) - seg->head;
+
+	uint64_t *keys = nng_alloc(sizeof(uint64_t) * n);
+	uint8_t **darray = nng_alloc(sizeof(uint8_t *) * n);
+	uint32_t *dsize = nng_alloc(sizeof(uint32_t) * n);
+	if (keys == NULL || darray == NULL || dsize == NULL) {
+		log_error("alloc new keys darray dsize failed! no memory!\n");
+		goto fail;
+	}
+
+	for (uint32_t i = 0; i < n; i++) {
+		rbMmapRecord_t *rec = rbMmapSeg_record(seg, seg->entries[seg->head + i].off);
+		uint8_t *body = (uint8_t *)(rec + 1) + rec->hlen;
+
+		keys[i] = rec->key;
+		if (rec->poff == RB_MMAP_NO_PAYLOAD) {
+			darray[i] = body;
+			dsize[i] = rec->blen;
+		} else {
+			darray[i] = body + rec->poff;
+			dsize[i] = rec->blen - rec->poff;
+		}
+	}
+
+	if (nng_aio_alloc(&seg->aio, rbMmapSeg_parquet_cb, seg) != 0) {
+		log_error("alloc new aio failed! no memory!\n");
+		goto fail;
+	}
+	nng_aio_begin(seg->aio);
+
+	parquet_object *obj = parquet_object_alloc(keys, darray, dsize, n, seg->aio, NULL);
+	if (obj == NULL) {
+		log_error("alloc new parquet object failed! no memory!\n");
+		nng_aio_free(seg->aio);
+		seg->aio = NULL;
+		goto fail;
+	}
+
+	nng_mtx_lock(seg->mm->mtx);
+	seg->state = RB_SEG_CONVERTING;
+	nng_mtx_unlock(seg->mm->mtx);
+
+	if (parquet_write_batch_async(obj) != 0) {
+		/* Finishes the aio, the callback puts the segment back to sealed */
+		parquet_object_free(obj);
+	}
+	return;
+
+fail:
+	if (keys != NULL) {
+		nng_free(keys, sizeof(uint64_t) * n);
+	}
+	if (darray != NULL) {
+		nng_free(darray, sizeof(uint8_t *) * n);
+	}
+	if (dsize != NULL) {
+		nng_free(dsize, sizeof(uint32_t) * n);
+	}
+}
+
+/* Register segments written to parquet as ring buffer files and unmap them */
+static void rbMmap_reap(ringBuffer_t *rb, ringBufferMmap_t *mm)
+{
+	for (size_t i = 0; i < cvector_size(mm->segs);) {
+		rbMmapSeg_t *seg = mm->segs[i];
+		if (rbMmapSeg_state(seg) != RB_SEG_CONVERTED) {
+			i++;
+			continue;
+		}
+
+		uint32_t n = cvector_size(seg->entries) - seg->head;
+		if (n == 0) {
+			/* All of it was dequeued meanwhile */
+			rbMmapSeg_free(seg);
+			cvector_erase(mm->segs, i);
+			continue;
+		}
+		ringBufferFile_t *file = nng_alloc(sizeof(ringBufferFile_t));
+		uint64_t *keys = nng_alloc(sizeof(uint64_t) * n);
+		if (file == NULL || keys == NULL) {
+			log_error("alloc new file failed! no memory!\n");
+			if (file != NULL) {
+				nng_free(file, sizeof(ringBufferFile_t));
+			}
+			if (keys != NULL) {
+				nng_free(keys, sizeof(uint64_t) * n);
+			}
+			i++;
+			continue;
+		}
+		for (uint32_t j = 0; j < n; j++) {
+			keys[j] = seg->entries[seg->head + j].key;
+		}
+		file->keys = keys;
+		file->keysLen = n;
+		file->aio = NULL;
+		file->ranges = seg->ranges;
+		seg->ranges = NULL;
+		cvector_push_back(rb->files, file);
+
+		mm->count -= n;
+		rbMmapSeg_free(seg);
+		cvector_erase(mm->segs, i);
+	}
+}
+#endif
+
+/*
+ * Make room for one more segment within maxSegs. Sealed segments are only
+ * dropped, oldest first, when the ring buffer opted in to it, otherwise
+ * the spill is refused and the message stays in RAM.
+ */
+static int rbMmap_room(ringBuffer_t *rb, ringBufferMmap_t *mm)
+{
+	while (cvector_size(mm->segs) >= mm->maxSegs) {
+		rbMmapSeg_t *seg = mm->segs[0];
+		enum rbMmapSegState state = rbMmapSeg_state(seg);
+		if (!rb->mmapDrop || state == RB_SEG_OPEN || state == RB_SEG_CONVERTING) {
+			return -1;
+		}
+
+		log_warn("ringbus: spill tier full, drop segment %s with %zu msgs\n",
+		         seg->path, cvector_size(seg->entries) - seg->head);
+		mm->count -= cvector_size(seg->entries) - seg->head;
+		rbMmapSeg_free(seg);
+		cvector_erase(mm->segs, 0);
+	}
+
+	return 0;
+}
+
+static inline void rbMmapSeg_seal(rbMmapSeg_t *seg)
+{
+	nng_mtx_lock(seg->mm->mtx);
+	seg->state = RB_SEG_SEALED;
+	nng_mtx_unlock(seg->mm->mtx);
+
+#ifdef SUPP_PARQUET
+	if (cvector_size(seg->entries) != seg->head) {
+		rbMmapSeg_convert(seg);
+	}
+#endif
+}
+
+static nng_msg *rbMmapSeg_msg(rbMmapSeg_t *seg, rbMmapEntry_t *entry)
+{
+	nng_msg *msg;
+
+	if (entry->msg != NULL) {
+		return entry->msg;
+	}
+
+	rbMmapRecord_t *rec = rbMmapSeg_record(seg, entry->off);
+	uint8_t *header = (uint8_t *)(rec + 1);
+	uint8_t *body = header + rec->hlen;
+
+	if (nng_msg_alloc(&msg, rec->blen) != 0) {
+		log_error("alloc msg from spill segment failed! no memory!\n");
+		return NULL;
+	}
+	if (rec->hlen != 0 && nng_msg_header_append(msg, header, rec->hlen) != 0) {
+		log_error("alloc msg header from spill segment failed! no memory!\n");
+		nng_msg_free(msg);
+		return NULL;
+	}
+	memcpy(nng_msg_body(msg), body, rec->blen);
+	if (rec->poff != RB_MMAP_NO_PAYLOAD) {
+		nng_msg_set_payload_ptr(msg, (uint8_t *)nng_msg_body(msg) + rec->poff);
+	}
+	nni_msg_set_cmd_type(msg, rec->type);
+
+	entry->msg = msg;
+	return msg;
+}
+
+/* First entry with a key not less than key */
+static size_t rbMmapSeg_lower_bound(rbMmapSeg_t *seg, uint64_t key)
+{
+	size_t low = 0;
+	size_t high = cvector_size(seg->entries);
+
+	if (!seg->sorted) {
+		return 0;
+	}
+
+	while (low < high) {
+		size_t mid = (low + high) / 2;
+		if (seg->entries[mid].key < key) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	return low;
+}
+
+void ringBufferMmap_free(ringBufferMmap_t *mm)
+{
+	if (mm == NULL) {
+		return;
+	}
+
+	for (size_t i = 0; i < cvector_size(mm->segs); i++) {
+		rbMmapSeg_t *seg = mm->segs[i];
+		if (seg->aio != NULL) {
+			/* The mapping is read until parquet is done with it */
+			nng_aio_wait(seg->aio);
+		}
+		rbMmapSeg_free(seg);
+	}
+	cvector_free(mm->segs);
+	if (mm->spare != NULL) {
+		rbMmapSeg_free(mm->spare);
+	}
+
+	nng_mtx_free(mm->mtx);
+	nng_strfree(mm->dir);
+	nng_free(mm, sizeof(ringBufferMmap_t));
+}
+
+int ringBufferMmap_append(ringBuffer_t *rb, ringBufferMsg_t *msg)
+{
+	ringBufferMmap_t *mm = rb->mmap;
+	rbMmapSeg_t *seg = NULL;
+	nng_msg *m = msg->data;
+
+	size_t hlen = nng_msg_header_len(m);
+	size_t blen = nng_msg_len(m);
+	uint8_t *body = nng_msg_body(m);
+	uint8_t *payload = nng_msg_payload_ptr(m);
+	size_t need = RB_MMAP_ALIGN(sizeof(rbMmapRecord_t) + hlen + blen);
+
+	if (hlen + blen >= RB_MMAP_NO_PAYLOAD) {
+		log_error("msg is too large for the spill tier\n");
+		return -1;
+	}
+
+#ifdef SUPP_PARQUET
+	rbMmap_reap(rb, mm);
+#endif
+
+	if (cvector_size(mm->segs) != 0) {
+		seg = mm->segs[cvector_size(mm->segs) - 1];
+		if (rbMmapSeg_state(seg) != RB_SEG_OPEN) {
+			seg = NULL;
+		} else if (seg->used + need > seg->len) {
+			rbMmapSeg_seal(seg);
+			seg = NULL;
+		}
+	}
+
+	if (seg == NULL) {
+		if (rbMmap_room(rb, mm) != 0) {
+			log_error("spill tier is full, %u segments\n", mm->maxSegs);
+			return -1;
+		}
+		/* The spare was opened outside ring_lock, use it if it fits */
+		nng_mtx_lock(mm->mtx);
+		if (mm->spare != NULL && mm->spare->len >= need) {
+			seg = mm->spare;
+			mm->spare = NULL;
+		}
+		nng_mtx_unlock(mm->mtx);
+		if (seg == NULL) {
+			seg = rbMmapSeg_open(mm, rb->name, need);
+		}
+		if (seg == NULL) {
+			return -1;
+		}
+		cvector_push_back(mm->segs, seg);
+	}
+
+	rbMmapRecord_t *rec = rbMmapSeg_record(seg, seg->used);
+	rec->key = msg->key;
+	rec->expiredAt = msg->expiredAt;
+	rec->hlen = (uint32_t)hlen;
+	rec->blen = (uint32_t)blen;
+	rec->poff = RB_MMAP_NO_PAYLOAD;
+	if (payload != NULL && payload >= body && payload <= body + blen) {
+		rec->poff = (uint32_t)(payload - body);
+	}
+	rec->type = nni_msg_cmd_type(m);
+	memset(rec->pad, 0, sizeof(rec->pad));
+	if (hlen != 0) {
+		memcpy(rec + 1, nng_msg_header(m), hlen);
+	}
+	if (blen != 0) {
+		memcpy((uint8_t *)(rec + 1) + hlen, body, blen);
+	}
+
+	rbMmapEntry_t entry = {
+		.key = msg->key,
+		.off = seg->used,
+		.msg = NULL,
+	};
+	if (cvector_size(seg->entries) != 0 && msg->key < seg->maxKey) {
+		seg->sorted = false;
+	}
+	/* Grow geometrically, a segment holds a lot of small records */
+	if (cvector_capacity(seg->entries) == cvector_size(seg->entries)) {
+		size_t cap = cvector_capacity(seg->entries);
+		cvector_grow(seg->entries, cap == 0 ? 64 : cap * 2);
+	}
+	cvector_push_back(seg->entries, entry);
+
+	seg->minKey = msg->key < seg->minKey ? msg->key : seg->minKey;
+	seg->maxKey = msg->key > seg->maxKey ? msg->key : seg->maxKey;
+	seg->used += need;
+	mm->count++;
+
+	return 0;
+}
+
+unsigned int ringBufferMmap_count(ringBufferMmap_t *mm)
+{
+	return mm == NULL ? 0 : mm->count;
+}
+
+bool ringBufferMmap_spilled(ringBufferMmap_t *mm)
+{
+	bool spilled;
+
+	if (mm == NULL) {
+		return false;
+	}
+	nng_mtx_lock(mm->mtx);
+	spilled = mm->seq != 0;
+	nng_mtx_unlock(mm->mtx);
+
+	return spilled;
+}
+
+int ringBufferMmap_prepare(ringBufferMmap_t *mm, const char *name)
+{
+	rbMmapSeg_t *seg;
+
+	nng_mtx_lock(mm->mtx);
+	if (mm->spare != NULL || mm->preparing) {
+		nng_mtx_unlock(mm->mtx);
+		return 0;
+	}
+	mm->preparing = true;
+	nng_mtx_unlock(mm->mtx);
+
+	seg = rbMmapSeg_open(mm, name, 0);
+
+	nng_mtx_lock(mm->mtx);
+	mm->spare = seg;
+	mm->preparing = false;
+	nng_mtx_unlock(mm->mtx);
+
+	return seg == NULL ? -1 : 0;
+}
+
+int ringBufferMmap_pop(ringBufferMmap_t *mm, nng_msg **msg)
+{
+	rbMmapSeg_t *seg = NULL;
+	rbMmapEntry_t *entry;
+
+	if (mm == NULL || mm->count == 0) {
+		return -1;
+	}
+
+	for (size_t i = 0; i < cvector_size(mm->segs); i++) {
+		if (mm->segs[i]->head < cvector_size(mm->segs[i]->entries)) {
+			seg = mm->segs[i];
+			break;
+		}
+	}
+	if (seg == NULL) {
+		return -1;
+	}
+
+	entry = &seg->entries[seg->head];
+	if ((*msg = rbMmapSeg_msg(seg, entry)) == NULL) {
+		return -1;
+	}
+	/* The caller owns it now, like a msg dequeued from RAM */
+	entry->msg = NULL;
+	seg->head++;
+	mm->count--;
+
+	if (seg->head < cvector_size(seg->entries)) {
+		return 0;
+	}
+
+	switch (rbMmapSeg_state(seg)) {
+	case RB_SEG_OPEN:
+		/* Drained while still appended to, start it over */
+		cvector_set_size(seg->entries, 0);
+		seg->head = 0;
+		seg->used = 0;
+		seg->minKey = UINT64_MAX;
+		seg->maxKey = 0;
+		seg->sorted = true;
+		break;
+	case RB_SEG_CONVERTING:
+		/* Parquet still reads it, reaped once it is done */
+		break;
+	default:
+		for (size_t i = 0; i < cvector_size(mm->segs); i++) {
+			if (mm->segs[i] == seg) {
+				cvector_erase(mm->segs, i);
+				break;
+			}
+		}
+		rbMmapSeg_free(seg);
+		break;
+	}
+
+	return 0;
+}
+
+int ringBufferMmap_search(ringBufferMmap_t *mm, uint64_t key, nng_msg **msg)
+{
+	if (mm == NULL) {
+		return -1;
+	}
+
+	for (size_t i = 0; i < cvector_size(mm->segs); i++) {
+		rbMmapSeg_t *seg = mm->segs[i];
+		size_t n = cvector_size(seg->entries);
+		if (n == 0 || key < seg->minKey || key > seg->maxKey) {
+			continue;
+		}
+
+		size_t j = rbMmapSeg_lower_bound(seg, key);
+		/* Entries before head were dequeued already */
+		for (j = j < seg->head ? seg->head : j; j < n; j++) {
+			if (seg->entries[j].key == key) {
+				*msg = rbMmapSeg_msg(seg, &seg->entries[j]);
+				return *msg == NULL ? -1 : 0;
+			}
+			if (seg->sorted) {
+				break;
+			}
+		}
+	}
+
+	return -1;
+}
+
+int ringBufferMmap_search_fuzz(ringBufferMmap_t *mm, uint64_t start,
+                               uint64_t end, uint32_t limit, nng_msg ***list)
+{
+	nng_msg **msgs = *list;
+	uint32_t found = 0;
+
+	if (mm == NULL) {
+		return 0;
+	}
+
+	for (size_t i = 0; i < cvector_size(mm->segs) && found < limit; i++) {
+		rbMmapSeg_t *seg = mm->segs[i];
+		size_t n = cvector_size(seg->entries);
+		if (n == 0 || end < seg->minKey || start > seg->maxKey) {
+			continue;
+		}
+
+		size_t j = rbMmapSeg_lower_bound(seg, start);
+		for (j = j < seg->head ? seg->head : j; j < n && found < limit; j++) {
+			rbMmapEntry_t *entry = &seg->entries[j];
+			if (entry->key > end) {
+				if (seg->sorted) {
+					break;
+				}
+				continue;
+			}
+			if (entry->key < start) {
+				continue;
+			}
+
+			nng_msg *msg = rbMmapSeg_msg(seg, entry);
+			if (msg == NULL) {
+				*list = msgs;
+				return -1;
+			}
+			nng_msg_set_proto_data(msg, NULL, (void *)(uintptr_t)entry->key);
+			cvector_push_back(msgs, msg);
+			found++;
+		}
+	}
+
+	*list = msgs;
+	return 0;
+}
+
+#else
+
+void ringBufferMmap_free(ringBufferMmap_t *mm)
+{
+	NNI_ARG_UNUSED(mm);
+}
+
+int ringBufferMmap_append(ringBuffer_t *rb, ringBufferMsg_t *msg)
+{
+	NNI_ARG_UNUSED(rb);
+	NNI_ARG_UNUSED(msg);
+	return -1;
+}
+
+unsigned int ringBufferMmap_count(ringBufferMmap_t *mm)
+{
+	NNI_ARG_UNUSED(mm);
+	return 0;
+}
+
+bool ringBufferMmap_spilled(ringBufferMmap_t *mm)
+{
+	NNI_ARG_UNUSED(mm);
+	return false;
+}
+
+int ringBufferMmap_prepare(ringBufferMmap_t *mm, const char *name)
+{
+	NNI_ARG_UNUSED(mm);
+	NNI_ARG_UNUSED(name);
+	return -1;
+}
+
+int ringBufferMmap_pop(ringBufferMmap_t *mm, nng_msg **msg)
+{
+	NNI_ARG_UNUSED(mm);
+	NNI_ARG_UNUSED(msg);
+	return -1;
+}
+
+int ringBufferMmap_search(ringBufferMmap_t *mm, uint64_t key, nng_msg **msg)
+{
+	NNI_ARG_UNUSED(mm);
+	NNI_ARG_UNUSED(key);
+	NNI_ARG_UNUSED(msg);
+	return -1;
+}
+
+int ringBufferMmap_search_fuzz(ringBufferMmap_t *mm, uint64_t start,
+                               uint64_t end, uint32_t limit, nng_msg ***list)
+{
+	NNI_ARG_UNUSED(mm);
+	NNI_ARG_UNUSED(start);
+	NNI_ARG_UNUSED(end);
+	NNI_ARG_UNUSED(limit);
+	NNI_ARG_UNUSED(list);
+	return 0;
+}
+
+#endif
@@ -0,0 +1,54 @@
+//
+// Copyright 2023 NanoMQ Team, Inc.
+// This software is supplied under the terms of the MIT License, a
+// copy of which should be located in the distribution where this
+// file was obtained (LICENSE.txt).  A copy of the license may also be
+// found online at https://opensource.org/licenses/MIT.
+//
+
+#ifndef RINGBUFFER_MMAP_H
+#define RINGBUFFER_MMAP_H
+
+#include "nng/supplemental/nanolib/ringbuffer.h"
+
+/*
+ * Spill tier of RB_FULL_MMAP. When the ring is full the oldest message is
+ * appended to a memory-mapped segment log, segments are rotated once full.
+ * Sealed segments are written to parquet in the background when it is
+ * enabled. Beyond maxSegs a spill is refused, unless rb->mmapDrop allows
+ * dropping the oldest sealed segment.
+ *
+ * All of these are called with rb->ring_lock held, but for
+ * ringBufferMmap_prepare.
+ */
+int  ringBufferMmap_alloc(ringBufferMmap_t **mmp, const char *dir,
+                          size_t segSize, unsigned int maxSegs);
+void ringBufferMmap_free(ringBufferMmap_t *mm);
+
+int  ringBufferMmap_append(ringBuffer_t *rb, ringBufferMsg_t *msg);
+unsigned int ringBufferMmap_count(ringBufferMmap_t *mm);
+/* Whether a segment was ever opened, the tier can not be replaced then */
+bool ringBufferMmap_spilled(ringBufferMmap_t *mm);
+
+/*
+ * Open the next segment ahead of time, without ring_lock, so rotating in
+ * ringBufferMmap_append does not create and map a file under it.
+ */
+int  ringBufferMmap_prepare(ringBufferMmap_t *mm, const char *name);
+
+/* Take the oldest spilled message, the caller owns it afterwards */
+int  ringBufferMmap_pop(ringBufferMmap_t *mm, nng_msg **msg);
+
+/*
+ * Messages found in the spill tier are materialized once and stay owned by
+ * their segment, like the ones in RAM they must not be freed by callers.
+ */
+int  ringBufferMmap_search(ringBufferMmap_t *mm, uint64_t key, nng_msg **msg);
+/*
+ * Append the messages with a key in [start, end] to the cvector *list,
+ * oldest first, stopping after limit of them.
+ */
+int  ringBufferMmap_search_fuzz(ringBufferMmap_t *mm, uint64_t start,
+                                uint64_t end, uint32_t limit, nng_msg ***list);
+
+#endif
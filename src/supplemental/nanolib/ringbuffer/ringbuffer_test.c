@@ -529,6 +529,151 @@ void test_ringBuffer_get_and_clean_up()
 
 }
 
+void test_ringBuffer_mmap_spill()
+{
+	ringBuffer_t *rb = NULL;
+	nng_msg *tmp = NULL;
+	nng_msg **msgList = NULL;
+	uint32_t count = 0;
+	char payload[32];
+
+	NUTS_TRUE(ringBuffer_init(&rb, 10, RB_FULL_MMAP, -1) == 0);
+	NUTS_TRUE(rb != NULL);
+	NUTS_TRUE(ringBuffer_set_mmap(rb, "/tmp", 4096, 64) == 0);
+
+	/* Older msgs are spilled, enqueue never fails */
+	for (int i = 0; i < 200; i++) {
+		tmp = alloc_pub_msg("topic1");
+		NUTS_TRUE(tmp != NULL);
+		snprintf(payload, sizeof(payload), "payload%d", i);
+		NUTS_TRUE(nng_msg_append(tmp, payload, strlen(payload)) == 0);
+		NUTS_TRUE(ringBuffer_enqueue(rb, i * 10, tmp, -1, NULL) == 0);
+	}
+	NUTS_TRUE(rb->size == 10);
+	NUTS_TRUE(ringBuffer_set_mmap(rb, "/tmp", 4096, 64) != 0);
+
+	/* Spilled to mmap */
+	NUTS_TRUE(ringBuffer_search_msg_by_key(rb, 50, &tmp) == 0);
+	NUTS_TRUE(nng_msg_len(tmp) == strlen("payload5"));
+	NUTS_TRUE(memcmp(nng_msg_body(tmp), "payload5", nng_msg_len(tmp)) == 0);
+	/* Still in RAM */
+	NUTS_TRUE(ringBuffer_search_msg_by_key(rb, 1990, &tmp) == 0);
+	NUTS_TRUE(memcmp(nng_msg_body(tmp), "payload199", nng_msg_len(tmp)) == 0);
+	NUTS_TRUE(ringBuffer_search_msg_by_key(rb, 55, &tmp) != 0);
+
+	/* Spans both of them, in key order */
+	NUTS_TRUE(ringBuffer_search_msgs_fuzz(rb, 1805, 1990, &count, &msgList) == 0);
+	NUTS_TRUE(count == 19);
+	for (uint32_t i = 0; i < count; i++) {
+		uint64_t key = (uintptr_t)nng_msg_get_proto_data(msgList[i]);
+		NUTS_TRUE(key == 1810 + i * 10);
+	}
+	nng_free(msgList, sizeof(nng_msg *) * count);
+
+	NUTS_TRUE(ringBuffer_search_msgs_fuzz(rb, 0, 5000, &count, &msgList) == 0);
+	NUTS_TRUE(count == 200);
+	nng_free(msgList, sizeof(nng_msg *) * count);
+
+	NUTS_TRUE(ringBuffer_search_msgs_fuzz(rb, 2000, 5000, &count, &msgList) == -1);
+
+	/* Only the first few from a key on, across mmap and RAM */
+	NUTS_TRUE(ringBuffer_search_msgs_from(rb, 1865, 5, &count, &msgList) == 0);
+	NUTS_TRUE(count == 5);
+	for (uint32_t i = 0; i < count; i++) {
+		uint64_t key = (uintptr_t)nng_msg_get_proto_data(msgList[i]);
+		NUTS_TRUE(key == 1870 + i * 10);
+	}
+	nng_free(msgList, sizeof(nng_msg *) * count);
+	NUTS_TRUE(ringBuffer_search_msgs_from(rb, 15, 3, &count, &msgList) == 0);
+	NUTS_TRUE(count == 3);
+	NUTS_TRUE((uintptr_t)nng_msg_get_proto_data(msgList[0]) == 20);
+	nng_free(msgList, sizeof(nng_msg *) * count);
+
+	NUTS_TRUE(ringBuffer_release(rb) == 0);
+
+	/* Beyond maxSegs enqueue fails and nothing is lost */
+	int i;
+	NUTS_TRUE(ringBuffer_init(&rb, 10, RB_FULL_MMAP, -1) == 0);
+	NUTS_TRUE(ringBuffer_set_mmap(rb, "/tmp", 4096, 1) == 0);
+	for (i = 0; i < 1000; i++) {
+		tmp = alloc_pub_msg("topic1");
+		NUTS_TRUE(tmp != NULL);
+		snprintf(payload, sizeof(payload), "payload%d", i);
+		NUTS_TRUE(nng_msg_append(tmp, payload, strlen(payload)) == 0);
+		if (ringBuffer_enqueue(rb, i, tmp, -1, NULL) != 0) {
+			nng_msg_free(tmp);
+			break;
+		}
+	}
+	NUTS_TRUE(i < 1000);
+	NUTS_TRUE(ringBuffer_search_msg_by_key(rb, 0, &tmp) == 0);
+
+	/* Unless dropping the oldest segment was asked for */
+	NUTS_TRUE(ringBuffer_set_mmap_drop(rb, true) == 0);
+	for (; i < 1000; i++) {
+		tmp = alloc_pub_msg("topic1");
+		NUTS_TRUE(tmp != NULL);
+		snprintf(payload, sizeof(payload), "payload%d", i);
+		NUTS_TRUE(nng_msg_append(tmp, payload, strlen(payload)) == 0);
+		NUTS_TRUE(ringBuffer_enqueue(rb, i, tmp, -1, NULL) == 0);
+	}
+	NUTS_TRUE(ringBuffer_search_msg_by_key(rb, 0, &tmp) != 0);
+	NUTS_TRUE(ringBuffer_search_msg_by_key(rb, 989, &tmp) == 0);
+	NUTS_TRUE(ringBuffer_search_msg_by_key(rb, 999, &tmp) == 0);
+
+	NUTS_TRUE(ringBuffer_release(rb) == 0);
+}
+
+void test_ringBuffer_mmap_dequeue()
+{
+	ringBuffer_t *rb = NULL;
+	nng_msg *tmp = NULL;
+	char payload[32];
+
+	NUTS_TRUE(ringBuffer_init(&rb, 10, RB_FULL_MMAP, -1) == 0);
+	NUTS_TRUE(ringBuffer_set_mmap(rb, "/tmp", 4096, 64) == 0);
+
+	for (int i = 0; i < 200; i++) {
+		tmp = alloc_pub_msg("topic1");
+		NUTS_TRUE(tmp != NULL);
+		snprintf(payload, sizeof(payload), "payload%d", i);
+		NUTS_TRUE(nng_msg_append(tmp, payload, strlen(payload)) == 0);
+		NUTS_TRUE(ringBuffer_enqueue(rb, i, tmp, -1, NULL) == 0);
+	}
+
+	/* A search hands out the spilled msg, dequeue takes it over */
+	NUTS_TRUE(ringBuffer_search_msg_by_key(rb, 3, &tmp) == 0);
+
+	/* Spilled msgs come back first, all in the order they went in */
+	for (int i = 0; i < 200; i++) {
+		snprintf(payload, sizeof(payload), "payload%d", i);
+		NUTS_TRUE(ringBuffer_dequeue(rb, (void **)&tmp) == 0);
+		NUTS_TRUE(nng_msg_len(tmp) == strlen(payload));
+		NUTS_TRUE(memcmp(nng_msg_body(tmp), payload, nng_msg_len(tmp)) == 0);
+		nng_msg_free(tmp);
+		if (i == 100) {
+			/* Dequeued ones are not found any more */
+			NUTS_TRUE(ringBuffer_search_msg_by_key(rb, 50, &tmp) != 0);
+			NUTS_TRUE(ringBuffer_search_msg_by_key(rb, 150, &tmp) == 0);
+		}
+	}
+	NUTS_TRUE(ringBuffer_dequeue(rb, (void **)&tmp) != 0);
+
+	/* Drained segments are reused */
+	for (int i = 200; i < 300; i++) {
+		tmp = alloc_pub_msg("topic1");
+		NUTS_TRUE(tmp != NULL);
+		NUTS_TRUE(ringBuffer_enqueue(rb, i, tmp, -1, NULL) == 0);
+	}
+	for (int i = 200; i < 300; i++) {
+		NUTS_TRUE(ringBuffer_dequeue(rb, (void **)&tmp) == 0);
+		nng_msg_free(tmp);
+	}
+	NUTS_TRUE(ringBuffer_dequeue(rb, (void **)&tmp) != 0);
+
+	NUTS_TRUE(ringBuffer_release(rb) == 0);
+}
+
 NUTS_TESTS = {
 	{ "Ring buffer init test", test_ringBuffer_init },
 	{ "Ring buffer release test", test_ringBuffer_release },
@@ -539,5 +684,7 @@ NUTS_TESTS = {
 	{ "Ring buffer search msgs by key", test_ringBuffer_search_msgs_by_key },
 	{ "Ring buffer search msgs fuzz", test_ringBuffer_search_msgs_fuzz },
 	{ "Ring buffer get and clean up test", test_ringBuffer_get_and_clean_up},
+	{ "Ring buffer mmap spill test", test_ringBuffer_mmap_spill },
+	{ "Ring buffer mmap dequeue test", test_ringBuffer_mmap_dequeue },
 	{ NULL, NULL },
 };
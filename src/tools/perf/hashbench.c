@@ -0,0 +1,112 @@
+//
+// Copyright 2023 NanoMQ Team, Inc.
+//
+// This software is supplied under the terms of the MIT License, a
+// copy of which should be located in the distribution where this
+// file was obtained (LICENSE.txt).  A copy of the license may also be
+// found online at https://opensource.org/licenses/MIT.
+//
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nng/nng.h>
+#include <nng/protocol/mqtt/mqtt_parser.h>
+#include <nng/supplemental/util/platform.h>
+
+// hash_bench - throughput of the string hashes of the broker in MB/s, for
+// keys as short as client ids and topics up to whole payloads.
+//
+// Usage: hash_bench <megabytes per run>
+
+static void die(const char *, ...);
+
+static volatile uint32_t sink;
+
+static uint32_t
+bench_djb(char *s, size_t n)
+{
+	return DJBHashn(s, (uint16_t) n);
+}
+
+static uint32_t
+bench_nano(char *s, size_t n)
+{
+	return nano_hashn(s, n);
+}
+
+static struct {
+	const char *name;
+	uint32_t (*fn)(char *, size_t);
+} hashes[] = {
+	{ "DJBHashn", bench_djb },
+	{ "fnv1a_hashn", fnv1a_hashn },
+	{ "crc32_hashn", crc32_hashn },
+	{ "crc32c_hashn", crc32c_hashn },
+	{ "nano_hashn", bench_nano },
+};
+
+static const size_t sizes[] = { 8, 16, 32, 64, 256, 1024, 16384 };
+
+int
+main(int argc, char **argv)
+{
+	long  mb;
+	char *eptr;
+	char *buf;
+
+	if (argc != 2) {
+		die("Usage: hash_bench <megabytes per run>");
+	}
+	mb = strtol(argv[1], &eptr, 10);
+	if ((mb <= 0) || (mb > 100000) || (*eptr != 0)) {
+		die("Invalid megabytes");
+	}
+	if ((buf = malloc(16384 + 8)) == NULL) {
+		die("Out of memory");
+	}
+	for (size_t i = 0; i < 16384 + 8; i++) {
+		buf[i] = (char) ('a' + i % 26);
+	}
+
+	printf("%-14s", "size");
+	for (size_t j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++) {
+		printf("%10zu", sizes[j]);
+	}
+	printf("\n");
+	for (size_t i = 0; i < sizeof(hashes) / sizeof(hashes[0]); i++) {
+		printf("%-14s", hashes[i].name);
+		for (size_t j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++) {
+			size_t   n     = sizes[j];
+			size_t   count = ((size_t) mb << 20) / n;
+			uint32_t h     = 0;
+			nng_time start = nng_clock();
+
+			for (size_t k = 0; k < count; k++) {
+				// Depends on the last hash, no overlapping calls
+				h += hashes[i].fn(buf + (h & 7), n);
+			}
+			sink = h;
+			nng_duration ms = nng_clock() - start;
+			printf("%10.0f", (double) mb * 1000 / (ms ? ms : 1));
+		}
+		printf("  MB/s\n");
+	}
+	free(buf);
+	return (0);
+}
+
+static void
+die(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fprintf(stderr, "\n");
+	exit(2);
+}
@@ -0,0 +1,196 @@
+//
+// Copyright 2023 NanoMQ Team, Inc.
+//
+// This software is supplied under the terms of the MIT License, a
+// copy of which should be located in the distribution where this
+// file was obtained (LICENSE.txt).  A copy of the license may also be
+// found online at https://opensource.org/licenses/MIT.
+//
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nng/nng.h>
+#include <nng/protocol/mqtt/mqtt_parser.h>
+#include <nng/supplemental/util/platform.h>
+
+// topic_bench - measures the cost of matching a publish topic against
+// subscription filters, in ns per match. The matcher of the broker is
+// compared with the former one, which split both sides into a queue of
+// allocated levels for every match.
+//
+// Usage: topic_bench <count>
+
+static void die(const char *, ...);
+
+static volatile int sink;
+
+// Typical 5 level topics of a device fleet, matching and not matching.
+static const char *pub_topics[] = {
+	"factory/line1/cell3/robot7/temperature",
+	"factory/line2/cell1/robot2/vibration",
+	"vehicle/fleet4/truck32/can/engine_rpm",
+	"building/floor3/room12/hvac/humidity",
+};
+
+static const char *sub_filters[] = {
+	"factory/line1/cell3/robot7/temperature",
+	"factory/+/cell1/+/vibration",
+	"vehicle/fleet4/#",
+	"building/+/+/hvac/pressure",
+	"factory/line1/#",
+	"+/+/+/+/+",
+};
+
+#define NTOPICS (sizeof(pub_topics) / sizeof(pub_topics[0]))
+#define NFILTERS (sizeof(sub_filters) / sizeof(sub_filters[0]))
+
+static char **
+legacy_topic_parse(const char *topic)
+{
+	int         cnt = 1;
+	int         row = 0;
+	const char *b_pos = topic;
+	const char *pos;
+
+	for (pos = topic; *pos; pos++) {
+		if (*pos == '/') {
+			cnt++;
+		}
+	}
+	char **q = calloc(cnt + 1, sizeof(char *));
+	while ((pos = strchr(b_pos, '/')) != NULL) {
+		q[row] = calloc(pos - b_pos + 1, 1);
+		memcpy(q[row++], b_pos, pos - b_pos);
+		b_pos = pos + 1;
+	}
+	q[row++] = strdup(b_pos);
+	q[row]   = NULL;
+	return (q);
+}
+
+static void
+legacy_topic_free(char **q)
+{
+	for (char **t = q; *t; t++) {
+		free(*t);
+	}
+	free(q);
+}
+
+static bool
+legacy_topic_filtern(const char *origin, const char *input, size_t n)
+{
+	char *buff = calloc(n + 1, 1);
+	memcpy(buff, input, n);
+	if (strlen(origin) == n && strncmp(origin, input, n) == 0) {
+		free(buff);
+		return (true);
+	}
+
+	char **w_q    = legacy_topic_parse(origin);
+	char **n_q    = legacy_topic_parse(buff);
+	char **wq     = w_q;
+	char **nq     = n_q;
+	bool   result = true;
+	bool   flag   = false;
+
+	while (*w_q != NULL && *n_q != NULL) {
+		if (strcmp(*w_q, *n_q) != 0) {
+			if (strcmp(*w_q, "#") == 0) {
+				flag = true;
+				break;
+			} else if (strcmp(*w_q, "+") != 0) {
+				result = false;
+				break;
+			}
+		}
+		w_q++;
+		n_q++;
+	}
+	if (*w_q && strcmp(*w_q, "#") == 0) {
+		flag = true;
+	}
+	if (!flag && (*w_q || *n_q)) {
+		result = false;
+	}
+	legacy_topic_free(wq);
+	legacy_topic_free(nq);
+	free(buff);
+	return (result);
+}
+
+static uint64_t
+run(bool (*match)(const char *, const char *, size_t), int count)
+{
+	size_t   tlen[NTOPICS];
+	nng_time start;
+	int      hits = 0;
+
+	for (size_t i = 0; i < NTOPICS; i++) {
+		tlen[i] = strlen(pub_topics[i]);
+	}
+	start = nng_clock();
+	for (int n = 0; n < count; n++) {
+		for (size_t i = 0; i < NTOPICS; i++) {
+			for (size_t j = 0; j < NFILTERS; j++) {
+				hits += match(
+				    sub_filters[j], pub_topics[i], tlen[i]);
+			}
+		}
+	}
+	sink = hits;
+	return ((nng_clock() - start) * 1000000);
+}
+
+int
+main(int argc, char **argv)
+{
+	long  count;
+	char *eptr;
+
+	if (argc != 2) {
+		die("Usage: topic_bench <count>");
+	}
+	count = strtol(argv[1], &eptr, 10);
+	if ((count <= 0) || (count > 100000000) || (*eptr != 0)) {
+		die("Invalid count");
+	}
+
+	// Both sides must agree before timing them
+	for (size_t i = 0; i < NTOPICS; i++) {
+		for (size_t j = 0; j < NFILTERS; j++) {
+			const char *f   = sub_filters[j];
+			const char *t   = pub_topics[i];
+			size_t      len = strlen(t);
+			if (topic_filtern(f, t, len) !=
+			    legacy_topic_filtern(f, t, len)) {
+				die("Mismatch on %s %s", f, t);
+			}
+		}
+	}
+
+	double matches = (double) count * NTOPICS * NFILTERS;
+	double legacy  = (double) run(legacy_topic_filtern, (int) count);
+	double current = (double) run(topic_filtern, (int) count);
+
+	printf("matches: %.0f\n", matches);
+	printf("legacy topic_filtern: %.2f ns/match\n", legacy / matches);
+	printf("topic_filtern: %.2f ns/match\n", current / matches);
+	return (0);
+}
+
+static void
+die(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fprintf(stderr, "\n");
+	exit(2);
+}
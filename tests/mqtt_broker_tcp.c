@@ -20,6 +20,137 @@
 #include "stubs.h"
 #include "trantest.h"
 
+// MQTT 3.1.1 CONNECT of client "busy"
+static uint8_t busy_connect[] = { 0x10, 0x10, 0x00, 0x04, 'M', 'Q', 'T', 'T',
+	0x04, 0x02, 0x00, 0x3c, 0x00, 0x04, 'b', 'u', 's', 'y' };
+
 TestMain("Broker-MQTT-TCP Transport", {
-	mqtt_broker_trantest_test("nmq-tcp://127.0.0.1:");
+	mqtt_broker_trantest_test(
+	    "nmq-tcp://127.0.0.1:", "mqtt-tcp://127.0.0.1:1883");
+	mqtt_broker_stripes_test(
+	    "nmq-tcp://127.0.0.1:", "mqtt-tcp://127.0.0.1:1885");
+
+	Convey("Sharded listener accepts connections", {
+		nng_socket           s;
+		nng_listener         l;
+		nng_stream_dialer   *d = NULL;
+		nng_aio             *aio;
+		int                  shards;
+		int                  port;
+		char                 addr[64];
+		conf                *nanomq_conf;
+
+		So((nanomq_conf = nng_zalloc(sizeof(conf))) != NULL);
+		conf_init(nanomq_conf);
+		s.data = nanomq_conf;
+		So(nng_nmq_tcp0_open(&s) == 0);
+		So(nng_aio_alloc(&aio, NULL, NULL) == 0);
+		Reset({
+			nng_stream_dialer_free(d);
+			nng_aio_free(aio);
+			nng_close(s);
+		});
+
+		So(nng_listener_create(&l, s, "nmq-tcp://127.0.0.1:0") == 0);
+		So(nng_listener_set(l, NANO_CONF, nanomq_conf, sizeof(conf)) ==
+		    0);
+		So(nng_listener_set_int(l, NNG_OPT_MQTT_LISTEN_SHARDS, 0) ==
+		    NNG_EINVAL);
+		So(nng_listener_set_int(l, NNG_OPT_MQTT_LISTEN_SHARDS, 4) == 0);
+		So(nng_listener_start(l, 0) == 0);
+		So(nng_listener_get_int(l, NNG_OPT_MQTT_LISTEN_SHARDS,
+		       &shards) == 0);
+		So(shards == 4);
+		So(nng_listener_set_int(l, NNG_OPT_MQTT_LISTEN_SHARDS, 2) ==
+		    NNG_EBUSY);
+		So(nng_listener_get_int(l, NNG_OPT_TCP_BOUND_PORT, &port) == 0);
+		So(port != 0);
+
+		(void) snprintf(addr, sizeof(addr), "tcp://127.0.0.1:%d", port);
+		So(nng_stream_dialer_alloc(&d, addr) == 0);
+		for (int i = 0; i < 16; i++) {
+			nng_stream *c;
+			nng_stream_dialer_dial(d, aio);
+			nng_aio_wait(aio);
+			So(nng_aio_result(aio) == 0);
+			c = nng_aio_get_output(aio, 0);
+			nng_stream_free(c);
+		}
+	});
+
+	Convey("Connections over the pending bound are refused", {
+		nng_socket         s;
+		nng_listener       l;
+		nng_stream_dialer *d = NULL;
+		nng_stream        *c1 = NULL;
+		nng_stream        *c2 = NULL;
+		nng_aio           *aio;
+		nng_iov            iov;
+		int                port;
+		char               addr[64];
+		conf              *nanomq_conf;
+		uint8_t            connack[4];
+
+		So((nanomq_conf = nng_zalloc(sizeof(conf))) != NULL);
+		conf_init(nanomq_conf);
+		s.data = nanomq_conf;
+		So(nng_nmq_tcp0_open(&s) == 0);
+		So(nng_aio_alloc(&aio, NULL, NULL) == 0);
+		nng_aio_set_timeout(aio, 5000);
+		Reset({
+			nng_stream_free(c1);
+			nng_stream_free(c2);
+			nng_stream_dialer_free(d);
+			nng_aio_free(aio);
+			nng_close(s);
+		});
+
+		So(nng_listener_create(&l, s, "nmq-tcp://127.0.0.1:0") == 0);
+		So(nng_listener_set(l, NANO_CONF, nanomq_conf, sizeof(conf)) ==
+		    0);
+		So(nng_listener_set_int(l, NNG_OPT_MQTT_CONNECT_PENDING, 1) ==
+		    0);
+		So(nng_listener_start(l, 0) == 0);
+		So(nng_listener_get_int(l, NNG_OPT_TCP_BOUND_PORT, &port) == 0);
+		(void) snprintf(addr, sizeof(addr), "tcp://127.0.0.1:%d", port);
+		So(nng_stream_dialer_alloc(&d, addr) == 0);
+
+		// Nobody answers the first CONNECT, it stays pending.
+		nng_stream_dialer_dial(d, aio);
+		nng_aio_wait(aio);
+		So(nng_aio_result(aio) == 0);
+		c1 = nng_aio_get_output(aio, 0);
+		iov.iov_buf = busy_connect;
+		iov.iov_len = sizeof(busy_connect);
+		So(nng_aio_set_iov(aio, 1, &iov) == 0);
+		nng_stream_send(c1, aio);
+		nng_aio_wait(aio);
+		So(nng_aio_result(aio) == 0);
+		nng_msleep(100);
+
+		nng_stream_dialer_dial(d, aio);
+		nng_aio_wait(aio);
+		So(nng_aio_result(aio) == 0);
+		c2 = nng_aio_get_output(aio, 0);
+		busy_connect[17] = '2';
+		So(nng_aio_set_iov(aio, 1, &iov) == 0);
+		nng_stream_send(c2, aio);
+		nng_aio_wait(aio);
+		So(nng_aio_result(aio) == 0);
+
+		iov.iov_buf = connack;
+		iov.iov_len = sizeof(connack);
+		So(nng_aio_set_iov(aio, 1, &iov) == 0);
+		nng_stream_recv(c2, aio);
+		nng_aio_wait(aio);
+		So(nng_aio_result(aio) == 0);
+		So(nng_aio_count(aio) == sizeof(connack));
+		So(connack[0] == 0x20);
+		So(connack[1] == 0x02);
+		So(connack[3] == 0x03); // server unavailable
+		// and then the connection is closed
+		nng_stream_recv(c2, aio);
+		nng_aio_wait(aio);
+		So(nng_aio_result(aio) != 0);
+	});
 })
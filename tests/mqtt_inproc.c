@@ -0,0 +1,24 @@
+//
+// Copyright 2024 NanoMQ Team, Inc. <jaylin@emqx.io>
+//
+// This software is supplied under the terms of the MIT License, a
+// copy of which should be located in the distribution where this
+// file was obtained (LICENSE.txt).  A copy of the license may also be
+// found online at https://opensource.org/licenses/MIT.
+//
+
+#include <nng/nng.h>
+
+#include "convey.h"
+#include "stubs.h"
+#include "trantest.h"
+
+// The broker and the client of the same process, over no network.
+TestMain("Broker-MQTT-inproc Transport", {
+	mqtt_broker_trantest_test(
+	    "nmq-inproc://broker", "mqtt-inproc://broker1883");
+	mqttv5_broker_trantest_test(
+	    "nmq-inproc://brokerv5", "mqtt-inproc://brokerv51883");
+	mqtt_broker_throughput_test(
+	    "nmq-inproc://broker", "mqtt-inproc://broker1884");
+})
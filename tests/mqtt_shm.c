@@ -0,0 +1,24 @@
+//
+// Copyright 2024 NanoMQ Team, Inc. <jaylin@emqx.io>
+//
+// This software is supplied under the terms of the MIT License, a
+// copy of which should be located in the distribution where this
+// file was obtained (LICENSE.txt).  A copy of the license may also be
+// found online at https://opensource.org/licenses/MIT.
+//
+
+#include <nng/nng.h>
+
+#include "convey.h"
+#include "stubs.h"
+#include "trantest.h"
+
+// MQTT through shared memory rings, set up over a UNIX domain socket.
+TestMain("Broker-MQTT-shm Transport", {
+	mqtt_broker_trantest_test(
+	    "nmq-shm:///tmp/nng_mqtt_shm", "mqtt-shm:///tmp/nng_mqtt_shm1883");
+	mqttv5_broker_trantest_test("nmq-shm:///tmp/nng_mqttv5_shm",
+	    "mqtt-shm:///tmp/nng_mqttv5_shm1883");
+	mqtt_broker_throughput_test("nmq-shm:///tmp/nng_mqtt_shm",
+	    "mqtt-shm:///tmp/nng_mqtt_shm1884");
+})
@@ -0,0 +1,23 @@
+//
+// Copyright 2024 NanoMQ Team, Inc. <jaylin@emqx.io>
+//
+// This software is supplied under the terms of the MIT License, a
+// copy of which should be located in the distribution where this
+// file was obtained (LICENSE.txt).  A copy of the license may also be
+// found online at https://opensource.org/licenses/MIT.
+//
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#endif
+
+#include <nng/nng.h>
+
+#include "convey.h"
+#include "stubs.h"
+#include "trantest.h"
+
+TestMain("MQTT-TCP Transport Throughput", {
+	mqtt_broker_throughput_test(
+	    "nmq-tcp://127.0.0.1:", "mqtt-tcp://127.0.0.1:1884");
+})
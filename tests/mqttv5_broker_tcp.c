@@ -22,5 +22,6 @@
 
 TestMain("Broker-MQTTv5-TCP Transport", {
     // TODO: better use one file to test v4/v5 broker tcp
-	mqttv5_broker_trantest_test("nmq-tcp://127.0.0.1:");
+	mqttv5_broker_trantest_test(
+	    "nmq-tcp://127.0.0.1:", "mqtt-tcp://127.0.0.1:1883");
 })
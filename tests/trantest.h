@@ -1126,10 +1126,9 @@ encode_unsuback_msg(nng_msg *msg, nano_work *work)
 }
 
 void
-trantest_mqtt_broker_send_recv(trantest *tt)
+trantest_mqtt_broker_send_recv(trantest *tt, const char *url)
 {
 	Convey("mqtt broker pub and sub", {
-		const char      *url   = "mqtt-tcp://127.0.0.1:1883";
 		uint8_t          qos   = 0; // TODO: test for qos 2;
 		const char      *topic = "Topic-nanomq-test";
 		const char      *data  = "ping";
@@ -1229,10 +1228,9 @@ trantest_mqtt_broker_send_recv(trantest *tt)
 }
 
 void
-trantest_mqttv5_broker_send_recv(trantest *tt)
+trantest_mqttv5_broker_send_recv(trantest *tt, const char *url)
 {
 	Convey("mqttv5 broker pub and sub", {
-		const char      *url   = "mqtt-tcp://127.0.0.1:1883";
 		uint8_t          qos   = 0; // TODO: test for qos 2;
 		const char      *topic = "Topic-nanomq-test";
 		const char      *data  = "ping";
@@ -1254,6 +1252,20 @@ trantest_mqttv5_broker_send_recv(trantest *tt)
 		client_connect(&tt->reqsock, &dialer, url, MQTT_PROTOCOL_VERSION_v5);
 		So((client = nng_mqtt_client_alloc(tt->reqsock, &send_callback, true)) != NULL);
 
+		// inflight window of QoS 1/2 msgs.
+		int inflight = -1;
+		So(nng_socket_set_int(tt->reqsock, NNG_OPT_MQTT_INFLIGHT_WINDOW, 0) == NNG_EINVAL);
+		So(nng_socket_set_int(tt->reqsock, NNG_OPT_MQTT_INFLIGHT_WINDOW, 32) == 0);
+		So(nng_socket_get_int(tt->reqsock, NNG_OPT_MQTT_INFLIGHT_WINDOW, &inflight) == 0);
+		So(inflight == 32);
+		So(nng_socket_get_int(tt->reqsock, NNG_OPT_MQTT_INFLIGHT, &inflight) == 0);
+		So(inflight == 0);
+		// a single connection unless more are striped.
+		int stripes = 0;
+		So(nng_socket_get_int(tt->reqsock, NNG_OPT_MQTT_STRIPES, &stripes) == 0);
+		So(stripes == 1);
+		So(nng_socket_set_int(tt->reqsock, NNG_OPT_MQTT_STRIPES, 17) == NNG_EINVAL);
+
 		// recv aio may be slightly behind.
 		nng_msleep(100);
 
@@ -1332,6 +1344,279 @@ trantest_mqttv5_broker_send_recv(trantest *tt)
 	});
 }
 
+// Publish many small msgs back to back and count them on the broker, so
+// the send path of the client (batched writes) is exercised under load.
+void
+trantest_mqtt_broker_throughput(trantest *tt, const char *url)
+{
+	Convey("mqtt broker publish throughput", {
+		const char  *topic = "Topic-nanomq-throughput";
+		const char  *data  = "throughput";
+		const int    total = 10000;
+		int          rv    = 0;
+		int          recvd = 0;
+		int          batch = 0;
+		nng_dialer   dialer;
+		nng_listener listener;
+		nng_msg     *rmsg = NULL;
+		nng_msg     *msg  = NULL;
+		nng_aio     *raio = NULL;
+		conn_param  *cp   = NULL;
+		conn_param  *rcp  = NULL;
+		nng_time     start;
+		nng_duration took;
+
+		trantest_broker_start(tt, listener);
+		// create client and send CONNECT msg to establish connection.
+		client_connect(&tt->reqsock, &dialer, url, MQTT_PROTOCOL_VERSION_v311);
+
+		// queued msgs are written in batches by default.
+		So(nng_socket_get_int(tt->reqsock, NNG_OPT_MQTT_SEND_BATCH, &batch) == 0);
+		So(batch == 64);
+		So(nng_socket_set_int(tt->reqsock, NNG_OPT_MQTT_SEND_BATCH, 0) == NNG_EINVAL);
+		So(nng_socket_set_ms(tt->reqsock, NNG_OPT_MQTT_SEND_DELAY, 1) == 0);
+
+		// recv aio may be slightly behind.
+		nng_msleep(100);
+
+		// server recv CONNECT msg.
+		nng_ctx_recv(work->ctx, work->aio);
+		nng_aio_wait(work->aio);
+		So((rmsg = nng_aio_get_msg(work->aio)) != NULL);
+		So((cp = nng_msg_get_conn_param(rmsg)) != NULL);
+		// send CONNACK back to the client.
+		nng_aio_set_msg(work->aio, rmsg);
+		nng_ctx_send(work->ctx, work->aio);
+		// cp is cloned in protocol layer, so we free it here
+		conn_param_free(cp);
+
+		// client recv CONNACK msg.
+		So(nng_recvmsg(tt->reqsock, &msg, 0) == 0);
+		So(nng_mqtt_msg_get_packet_type(msg) == NNG_MQTT_CONNACK);
+		rcp = nng_msg_get_conn_param(msg);
+
+		start = nng_clock();
+		for (int i = 0; i < total; i++) {
+			nng_msg *pubmsg;
+			nng_mqtt_msg_alloc(&pubmsg, 0);
+			nng_mqtt_msg_set_packet_type(pubmsg, NNG_MQTT_PUBLISH);
+			nng_mqtt_msg_set_publish_qos(pubmsg, 0);
+			nng_mqtt_msg_set_publish_payload(
+			    pubmsg, (uint8_t *) data, strlen(data));
+			nng_mqtt_msg_set_publish_topic(pubmsg, topic);
+			rv |= nng_sendmsg(tt->reqsock, pubmsg, 0);
+		}
+		So(rv == 0);
+
+		// server recv all of them. The aio of CONNACK is never
+		// finished by the broker, so wait on an aio of our own.
+		So(nng_aio_alloc(&raio, NULL, NULL) == 0);
+		while (recvd < total) {
+			nng_ctx_recv(work->ctx, raio);
+			nng_aio_wait(raio);
+			if (nng_aio_result(raio) != 0) {
+				break;
+			}
+			rmsg = nng_aio_get_msg(raio);
+			if (nng_msg_get_type(rmsg) == CMD_PUBLISH) {
+				conn_param_free(nng_msg_get_conn_param(rmsg));
+				recvd++;
+			}
+			nng_msg_free(rmsg);
+		}
+		took = (nng_duration) (nng_clock() - start);
+		nng_aio_free(raio);
+		So(recvd == total);
+		printf("%d msgs published in %d ms (%.0f msgs/sec)\n", recvd,
+		    took, recvd * 1000.0 / (took > 0 ? took : 1));
+
+		// close the broker first, as in the tests above.
+		nng_close(tt->repsock);
+		conn_param_free(rcp);
+		nng_msg_free(msg);
+		// for offline event msg
+		conn_param_free(cp);
+	});
+}
+
+static nni_atomic_int stripes_up;
+
+static void
+stripe_connect_cb(nng_pipe p, nng_pipe_ev ev, void *arg)
+{
+	NNI_ARG_UNUSED(p);
+	NNI_ARG_UNUSED(ev);
+	NNI_ARG_UNUSED(arg);
+	nni_atomic_inc(&stripes_up);
+}
+
+// Stripe QoS 1 msgs of several topics over two connections, and check
+// each topic keeps to one connection and to the order it was sent in.
+void
+trantest_mqtt_broker_stripes(trantest *tt, const char *url)
+{
+	Convey("mqtt broker striped connections", {
+		const int    ntopic = 8;
+		const int    total  = 256;
+		char         topic[32];
+		char         ids[8][32];
+		int          next[8];
+		int          stripes = 0;
+		int          inflight = -1;
+		int          recvd    = 0;
+		int          rv       = 0;
+		nng_dialer   dialer[3];
+		nng_listener listener;
+		nng_aio     *aios[256];
+		nng_aio     *caio[3];
+		nng_aio     *raio = NULL;
+		nng_msg     *rmsg = NULL;
+		nng_msg     *msg  = NULL;
+		conn_param  *cp   = NULL;
+
+		nni_atomic_init(&stripes_up);
+		memset(ids, 0, sizeof(ids));
+		memset(next, 0, sizeof(next));
+		trantest_broker_start(tt, listener);
+		So(nng_mqtt_client_open(&tt->reqsock) == 0);
+		So(nng_socket_set_int(tt->reqsock, NNG_OPT_MQTT_STRIPES, 2) == 0);
+		So(nng_mqtt_set_connect_cb(
+		       tt->reqsock, stripe_connect_cb, NULL) == 0);
+		// one more dialer than stripes, its connection is refused.
+		for (int i = 0; i < 3; i++) {
+			nng_msg *connmsg;
+			char     id[32];
+			(void) snprintf(id, sizeof(id), "nng-stripe-%d", i);
+			So(nng_mqtt_msg_alloc(&connmsg, 0) == 0);
+			nng_mqtt_msg_set_packet_type(connmsg, NNG_MQTT_CONNECT);
+			nng_mqtt_msg_set_connect_proto_version(
+			    connmsg, MQTT_PROTOCOL_VERSION_v311);
+			nng_mqtt_msg_set_connect_keep_alive(connmsg, 60);
+			nng_mqtt_msg_set_connect_client_id(connmsg, id);
+			nng_mqtt_msg_set_connect_clean_session(connmsg, true);
+			So(nng_dialer_create(&dialer[i], tt->reqsock, url) == 0);
+			So(nng_dialer_set_ptr(
+			       dialer[i], NNG_OPT_MQTT_CONNMSG, connmsg) == 0);
+			// the refused one is not to come back while the test runs
+			So(nng_dialer_set_ms(
+			       dialer[i], NNG_OPT_RECONNMINT, 60000) == 0);
+			So(nng_dialer_start(dialer[i], NNG_FLAG_NONBLOCK) == 0);
+
+			// server recv CONNECT msg and send CONNACK back, the
+			// aio of which the broker never finishes.
+			So(nng_aio_alloc(&caio[i], NULL, NULL) == 0);
+			nng_ctx_recv(work->ctx, caio[i]);
+			nng_aio_wait(caio[i]);
+			So((rmsg = nng_aio_get_msg(caio[i])) != NULL);
+			So((cp = nng_msg_get_conn_param(rmsg)) != NULL);
+			nng_aio_set_msg(caio[i], rmsg);
+			nng_ctx_send(work->ctx, caio[i]);
+			conn_param_free(cp);
+			if (i < 2) {
+				// client recv CONNACK msg.
+				So(nng_recvmsg(tt->reqsock, &msg, 0) == 0);
+				So(nng_mqtt_msg_get_packet_type(msg) ==
+				    NNG_MQTT_CONNACK);
+				conn_param_free(nng_msg_get_conn_param(msg));
+				nng_msg_free(msg);
+			}
+		}
+		nng_msleep(200);
+		So(nni_atomic_get(&stripes_up) == 2);
+		// stripes are taken, they cannot be changed any more.
+		So(nng_socket_set_int(tt->reqsock, NNG_OPT_MQTT_STRIPES, 4) ==
+		    NNG_EBUSY);
+		So(nng_socket_get_int(
+		       tt->reqsock, NNG_OPT_MQTT_STRIPES, &stripes) == 0);
+		So(stripes == 2);
+		So(nng_dialer_close(dialer[2]) == 0);
+
+		for (int i = 0; i < total; i++) {
+			nng_msg *pubmsg;
+			uint8_t  seq[4];
+			NNI_PUT32(seq, (uint32_t) (i / ntopic));
+			(void) snprintf(
+			    topic, sizeof(topic), "stripe/%d", i % ntopic);
+			So(nng_aio_alloc(&aios[i], NULL, NULL) == 0);
+			nng_mqtt_msg_alloc(&pubmsg, 0);
+			nng_mqtt_msg_set_packet_type(pubmsg, NNG_MQTT_PUBLISH);
+			nng_mqtt_msg_set_publish_qos(pubmsg, 1);
+			nng_mqtt_msg_set_publish_payload(pubmsg, seq, 4);
+			nng_mqtt_msg_set_publish_topic(pubmsg, topic);
+			nng_aio_set_msg(aios[i], pubmsg);
+			nng_send_aio(tt->reqsock, aios[i]);
+		}
+
+		// msgs of a topic come in order and over the same connection.
+		So(nng_aio_alloc(&raio, NULL, NULL) == 0);
+		while (recvd < total) {
+			uint8_t    *body;
+			uint16_t    tlen;
+			uint32_t    seq;
+			int         t;
+			const char *id;
+			nng_ctx_recv(work->ctx, raio);
+			nng_aio_wait(raio);
+			if (nng_aio_result(raio) != 0) {
+				break;
+			}
+			rmsg = nng_aio_get_msg(raio);
+			if (nng_msg_get_type(rmsg) != CMD_PUBLISH) {
+				nng_msg_free(rmsg);
+				continue;
+			}
+			cp   = nng_msg_get_conn_param(rmsg);
+			id   = (const char *) conn_param_get_clientid(cp);
+			body = nng_msg_body(rmsg);
+			NNI_GET16(body, tlen);
+			if (tlen != 8 || memcmp(body + 2, "stripe/", 7) != 0) {
+				// $SYS events of the connections
+				conn_param_free(cp);
+				nng_msg_free(rmsg);
+				continue;
+			}
+			t = body[tlen + 1] - '0';
+			NNI_GET32(body + 2 + tlen + 2, seq);
+			So(t >= 0 && t < ntopic);
+			So(seq == (uint32_t) next[t]);
+			next[t]++;
+			if (ids[t][0] == '\0') {
+				(void) snprintf(ids[t], sizeof(ids[t]), "%s", id);
+			}
+			So(strcmp(ids[t], id) == 0);
+			conn_param_free(cp);
+			nng_msg_free(rmsg);
+			recvd++;
+		}
+		nng_aio_free(raio);
+		So(recvd == total);
+		// both connections carried some of the topics.
+		rv = 0;
+		for (int t = 1; t < ntopic; t++) {
+			rv |= strcmp(ids[t], ids[0]);
+		}
+		So(rv != 0);
+
+		// and all of them are acknowledged.
+		rv = 0;
+		for (int i = 0; i < total; i++) {
+			nng_aio_wait(aios[i]);
+			rv |= nng_aio_result(aios[i]);
+			nng_aio_free(aios[i]);
+		}
+		So(rv == 0);
+		So(nng_socket_get_int(
+		       tt->reqsock, NNG_OPT_MQTT_INFLIGHT, &inflight) == 0);
+		So(inflight == 0);
+
+		nng_close(tt->repsock);
+		nng_close(tt->reqsock);
+		for (int i = 0; i < 3; i++) {
+			nng_aio_free(caio[i]);
+		}
+	});
+}
+
 void
 trantest_send_recv_multi(trantest *tt)
 {
@@ -1536,7 +1821,7 @@ mqtt_trantest_test(const char *addr)
 }
 
 void
-mqtt_broker_trantest_test(const char *addr)
+mqtt_broker_trantest_test(const char *addr, const char *url)
 {
 	trantest tt;
 
@@ -1544,12 +1829,12 @@ mqtt_broker_trantest_test(const char *addr)
 	Convey("MQTT broker given transport", {
 		mqtt_broker_trantest_init(&tt, addr);
 
-		trantest_mqtt_broker_send_recv(&tt);
+		trantest_mqtt_broker_send_recv(&tt, url);
 	})
 }
 
 void
-mqttv5_broker_trantest_test(const char *addr)
+mqttv5_broker_trantest_test(const char *addr, const char *url)
 {
 	trantest tt;
 
@@ -1558,7 +1843,37 @@ mqttv5_broker_trantest_test(const char *addr)
 		Reset({ trantest_fini(&tt); });
 		mqtt_broker_trantest_init(&tt, addr);
 
-		trantest_mqttv5_broker_send_recv(&tt);
+		trantest_mqttv5_broker_send_recv(&tt, url);
+	})
+}
+
+void
+mqtt_broker_throughput_test(const char *addr, const char *url)
+{
+	trantest tt;
+
+	memset(&tt, 0, sizeof(tt));
+	Convey("MQTT broker throughput given transport", {
+		Reset({ trantest_fini(&tt); });
+		mqtt_broker_trantest_init(&tt, addr);
+		// own port, to run alongside the other broker tests
+		(void) snprintf(tt.addr, sizeof(tt.addr), "%s%u", addr, 1884);
+
+		trantest_mqtt_broker_throughput(&tt, url);
+	})
+}
+void
+mqtt_broker_stripes_test(const char *addr, const char *url)
+{
+	trantest tt;
+
+	memset(&tt, 0, sizeof(tt));
+	Convey("MQTT broker stripes given transport", {
+		Reset({ trantest_fini(&tt); });
+		mqtt_broker_trantest_init(&tt, addr);
+		(void) snprintf(tt.addr, sizeof(tt.addr), "%s%u", addr, 1885);
+
+		trantest_mqtt_broker_stripes(&tt, url);
 	})
 }
 void